@@ -0,0 +1,529 @@
+/*
+ * FreeRTOS V202203.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file http_connection_pool.c
+ * @brief Pool of kept-alive HTTP connections, keyed by host and port.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "http_connection_pool.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Each compilation unit that consumes the NetworkContext must define it.
+ * It should contain a single pointer to the type of your desired transport.
+ * When using multiple transports in the same compilation unit, define this pointer as void *.
+ *
+ * @note Transport stacks are defined in amazon-freertos/libraries/abstractions/transport/secure_sockets/transport_secure_sockets.h.
+ */
+struct NetworkContext
+{
+    SecureSocketsTransportParams_t * pParams;
+};
+
+/**
+ * @brief A slot of the pool.
+ *
+ * A slot is free when it is neither in use nor connected. The host name and
+ * port are valid in every other state.
+ */
+struct HttpPoolConnection
+{
+    NetworkContext_t xNetworkContext;
+    SecureSocketsTransportParams_t xTransportParams;
+    TransportInterface_t xTransportInterface;
+    char cHost[ httpconnectionpoolMAX_HOST_NAME_LENGTH + 1U ];
+    uint16_t usPort;
+    BaseType_t xInUse;
+    BaseType_t xConnected;
+    TickType_t xLastUsed;
+    uint32_t ulRequests;
+};
+
+/*-----------------------------------------------------------*/
+
+static HttpPoolConnection_t xConnections[ httpconnectionpoolMAX_CONNECTIONS ];
+static HttpPoolStats_t xStats;
+static HttpPoolConnect_t xConnectFunction = NULL;
+
+/**
+ * @brief Protects the slot states and the counters. Never held while talking
+ * to the network.
+ */
+static SemaphoreHandle_t xPoolMutex = NULL;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Check whether a slot holds a connection to a given server.
+ */
+static BaseType_t prvMatches( const HttpPoolConnection_t * pxConnection,
+                              const char * pcHost,
+                              size_t xHostLen,
+                              uint16_t usPort );
+
+/**
+ * @brief Claim the most recently used idle connection to a server.
+ *
+ * Must be called with the pool mutex held.
+ */
+static HttpPoolConnection_t * prvClaimIdle( const char * pcHost,
+                                            size_t xHostLen,
+                                            uint16_t usPort );
+
+/**
+ * @brief Claim a slot for a new connection to a server, within the limits.
+ *
+ * Must be called with the pool mutex held.
+ *
+ * @param[out] pxEvict Set to pdTRUE if the slot still holds an idle connection
+ * to another server that the caller must close first.
+ */
+static HttpPoolConnection_t * prvClaimSlot( const char * pcHost,
+                                            size_t xHostLen,
+                                            uint16_t usPort,
+                                            BaseType_t * pxEvict );
+
+/**
+ * @brief Close the connection held by a claimed slot.
+ */
+static void prvClose( HttpPoolConnection_t * pxConnection );
+
+/**
+ * @brief Hand a claimed slot back to the pool.
+ */
+static void prvRelease( HttpPoolConnection_t * pxConnection );
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvMatches( const HttpPoolConnection_t * pxConnection,
+                              const char * pcHost,
+                              size_t xHostLen,
+                              uint16_t usPort )
+{
+    BaseType_t xMatches = pdFALSE;
+
+    if( ( ( pxConnection->xInUse == pdTRUE ) || ( pxConnection->xConnected == pdTRUE ) ) &&
+        ( pxConnection->usPort == usPort ) &&
+        ( strncmp( pxConnection->cHost, pcHost, xHostLen ) == 0 ) &&
+        ( pxConnection->cHost[ xHostLen ] == '\0' ) )
+    {
+        xMatches = pdTRUE;
+    }
+
+    return xMatches;
+}
+
+/*-----------------------------------------------------------*/
+
+static HttpPoolConnection_t * prvClaimIdle( const char * pcHost,
+                                            size_t xHostLen,
+                                            uint16_t usPort )
+{
+    HttpPoolConnection_t * pxConnection = NULL;
+    TickType_t xNow = xTaskGetTickCount();
+    size_t i;
+
+    for( i = 0; i < httpconnectionpoolMAX_CONNECTIONS; i++ )
+    {
+        if( ( xConnections[ i ].xInUse == pdFALSE ) &&
+            ( prvMatches( &xConnections[ i ], pcHost, xHostLen, usPort ) == pdTRUE ) )
+        {
+            if( ( pxConnection == NULL ) ||
+                ( ( xNow - xConnections[ i ].xLastUsed ) < ( xNow - pxConnection->xLastUsed ) ) )
+            {
+                pxConnection = &xConnections[ i ];
+            }
+        }
+    }
+
+    if( pxConnection != NULL )
+    {
+        pxConnection->xInUse = pdTRUE;
+    }
+
+    return pxConnection;
+}
+
+/*-----------------------------------------------------------*/
+
+static HttpPoolConnection_t * prvClaimSlot( const char * pcHost,
+                                            size_t xHostLen,
+                                            uint16_t usPort,
+                                            BaseType_t * pxEvict )
+{
+    HttpPoolConnection_t * pxConnection = NULL;
+    HttpPoolConnection_t * pxOldest = NULL;
+    TickType_t xNow = xTaskGetTickCount();
+    size_t xToHost = 0;
+    size_t i;
+
+    *pxEvict = pdFALSE;
+
+    for( i = 0; i < httpconnectionpoolMAX_CONNECTIONS; i++ )
+    {
+        if( prvMatches( &xConnections[ i ], pcHost, xHostLen, usPort ) == pdTRUE )
+        {
+            xToHost++;
+        }
+        else if( ( xConnections[ i ].xInUse == pdFALSE ) && ( xConnections[ i ].xConnected == pdFALSE ) )
+        {
+            pxConnection = &xConnections[ i ];
+        }
+        else if( ( xConnections[ i ].xInUse == pdFALSE ) &&
+                 ( ( pxOldest == NULL ) ||
+                   ( ( xNow - xConnections[ i ].xLastUsed ) > ( xNow - pxOldest->xLastUsed ) ) ) )
+        {
+            pxOldest = &xConnections[ i ];
+        }
+        else
+        {
+            /* Checked out to another server. */
+        }
+    }
+
+    if( xToHost >= httpconnectionpoolMAX_CONNECTIONS_PER_HOST )
+    {
+        pxConnection = NULL;
+    }
+    else if( pxConnection == NULL )
+    {
+        pxConnection = pxOldest;
+        *pxEvict = ( pxConnection != NULL ) ? pdTRUE : pdFALSE;
+    }
+    else
+    {
+        /* Use the free slot. */
+    }
+
+    if( pxConnection != NULL )
+    {
+        pxConnection->xInUse = pdTRUE;
+    }
+
+    return pxConnection;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvClose( HttpPoolConnection_t * pxConnection )
+{
+    TransportSocketStatus_t xNetworkStatus;
+
+    if( pxConnection->xConnected == pdTRUE )
+    {
+        xNetworkStatus = SecureSocketsTransport_Disconnect( &pxConnection->xNetworkContext );
+
+        if( xNetworkStatus != TRANSPORT_SOCKET_STATUS_SUCCESS )
+        {
+            LogWarn( ( "SecureSocketsTransport_Disconnect() failed. StatusCode=%d.",
+                       ( int ) xNetworkStatus ) );
+        }
+
+        LogInfo( ( "Closed connection to %s:%u after %lu requests.",
+                   pxConnection->cHost,
+                   ( unsigned ) pxConnection->usPort,
+                   pxConnection->ulRequests ) );
+
+        pxConnection->xConnected = pdFALSE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRelease( HttpPoolConnection_t * pxConnection )
+{
+    ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+    pxConnection->xLastUsed = xTaskGetTickCount();
+    pxConnection->xInUse = pdFALSE;
+    ( void ) xSemaphoreGive( xPoolMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t HttpConnectionPool_Init( HttpPoolConnect_t xConnect )
+{
+    BaseType_t xStatus = pdPASS;
+    size_t i;
+
+    configASSERT( xConnect != NULL );
+
+    if( xPoolMutex == NULL )
+    {
+        xPoolMutex = xSemaphoreCreateMutex();
+    }
+
+    if( xPoolMutex == NULL )
+    {
+        LogError( ( "Failed to create the HTTP connection pool mutex." ) );
+        xStatus = pdFAIL;
+    }
+    else
+    {
+        ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+
+        xConnectFunction = xConnect;
+
+        for( i = 0; i < httpconnectionpoolMAX_CONNECTIONS; i++ )
+        {
+            xConnections[ i ].xNetworkContext.pParams = &xConnections[ i ].xTransportParams;
+        }
+
+        ( void ) xSemaphoreGive( xPoolMutex );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+HttpPoolConnection_t * HttpConnectionPool_Checkout( const char * pcHost,
+                                                    size_t xHostLen,
+                                                    uint16_t usPort )
+{
+    HttpPoolConnection_t * pxConnection = NULL;
+    BaseType_t xReused = pdFALSE;
+    BaseType_t xClose = pdFALSE;
+    BaseType_t xStatus = pdPASS;
+    int32_t lPollStatus = 0;
+
+    if( ( pcHost == NULL ) || ( xHostLen == 0U ) ||
+        ( xHostLen > httpconnectionpoolMAX_HOST_NAME_LENGTH ) )
+    {
+        LogError( ( "Invalid parameter: pcHost=%p, xHostLen=%lu.",
+                    ( void * ) pcHost, ( unsigned long ) xHostLen ) );
+        xStatus = pdFAIL;
+    }
+    else if( xPoolMutex == NULL )
+    {
+        LogError( ( "HttpConnectionPool_Init() must be called first." ) );
+        xStatus = pdFAIL;
+    }
+    else
+    {
+        ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+
+        pxConnection = prvClaimIdle( pcHost, xHostLen, usPort );
+
+        if( pxConnection == NULL )
+        {
+            pxConnection = prvClaimSlot( pcHost, xHostLen, usPort, &xClose );
+
+            if( pxConnection == NULL )
+            {
+                xStats.ulLimitRejections++;
+            }
+        }
+        else if( ( xTaskGetTickCount() - pxConnection->xLastUsed ) >=
+                 pdMS_TO_TICKS( httpconnectionpoolIDLE_TIMEOUT_MS ) )
+        {
+            xStats.ulIdleTimeouts++;
+            xClose = pdTRUE;
+        }
+        else
+        {
+            xReused = pdTRUE;
+        }
+
+        ( void ) xSemaphoreGive( xPoolMutex );
+
+        if( pxConnection == NULL )
+        {
+            LogWarn( ( "No HTTP connection available for %.*s:%u within the pool limits.",
+                       ( int32_t ) xHostLen, pcHost, ( unsigned ) usPort ) );
+            xStatus = pdFAIL;
+        }
+    }
+
+    if( xReused == pdTRUE )
+    {
+        /* Anything that arrived since the last response, a close_notify or a
+         * FIN included, means the server is done with this connection. */
+        lPollStatus = SOCKETS_Poll( pxConnection->xTransportParams.tcpSocket );
+
+        if( lPollStatus != SOCKETS_ERROR_NONE )
+        {
+            LogInfo( ( "Pooled connection to %s:%u failed its health check. Status=%d.",
+                       pxConnection->cHost,
+                       ( unsigned ) pxConnection->usPort,
+                       ( int ) lPollStatus ) );
+            xReused = pdFALSE;
+            xClose = pdTRUE;
+
+            ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+            xStats.ulHealthCheckFailures++;
+            ( void ) xSemaphoreGive( xPoolMutex );
+        }
+    }
+
+    if( xClose == pdTRUE )
+    {
+        prvClose( pxConnection );
+    }
+
+    if( ( xStatus == pdPASS ) && ( xReused == pdFALSE ) )
+    {
+        /* Other tasks read the key of claimed slots to apply the limits. */
+        ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+        ( void ) memcpy( pxConnection->cHost, pcHost, xHostLen );
+        pxConnection->cHost[ xHostLen ] = '\0';
+        pxConnection->usPort = usPort;
+        ( void ) xSemaphoreGive( xPoolMutex );
+
+        pxConnection->ulRequests = 0;
+
+        if( xConnectFunction( &pxConnection->xNetworkContext, pxConnection->cHost, usPort ) == pdPASS )
+        {
+            pxConnection->xConnected = pdTRUE;
+
+            ( void ) memset( &pxConnection->xTransportInterface, 0, sizeof( TransportInterface_t ) );
+            pxConnection->xTransportInterface.pNetworkContext = &pxConnection->xNetworkContext;
+            pxConnection->xTransportInterface.send = SecureSocketsTransport_Send;
+            pxConnection->xTransportInterface.recv = SecureSocketsTransport_Recv;
+
+            ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+            xStats.ulHandshakes++;
+            ( void ) xSemaphoreGive( xPoolMutex );
+        }
+        else
+        {
+            LogError( ( "Failed to connect to %s:%u.", pxConnection->cHost, ( unsigned ) usPort ) );
+            prvRelease( pxConnection );
+            pxConnection = NULL;
+            xStatus = pdFAIL;
+        }
+    }
+
+    if( xStatus == pdPASS )
+    {
+        pxConnection->ulRequests++;
+
+        ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+        xStats.ulRequests++;
+
+        if( xReused == pdTRUE )
+        {
+            xStats.ulReuses++;
+        }
+
+        ( void ) xSemaphoreGive( xPoolMutex );
+    }
+
+    return pxConnection;
+}
+
+/*-----------------------------------------------------------*/
+
+const TransportInterface_t * HttpConnectionPool_GetTransport( HttpPoolConnection_t * pxConnection )
+{
+    configASSERT( pxConnection != NULL );
+
+    return &pxConnection->xTransportInterface;
+}
+
+/*-----------------------------------------------------------*/
+
+void HttpConnectionPool_Checkin( HttpPoolConnection_t * pxConnection,
+                                 HTTPStatus_t xHttpStatus,
+                                 const HTTPResponse_t * pxResponse )
+{
+    configASSERT( pxConnection != NULL );
+
+    /* A failed request may have left part of a response in the stream. */
+    if( ( xHttpStatus != HTTPSuccess ) ||
+        ( pxResponse == NULL ) ||
+        ( ( pxResponse->respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG ) != 0U ) )
+    {
+        prvClose( pxConnection );
+    }
+    else if( pxConnection->xTransportParams.tlsEnabled == true )
+    {
+        /* The response was read in full, so nothing is buffered. The TLS
+         * record buffers are not needed until the next request. */
+        ( void ) SecureSocketsTransport_Idle( &pxConnection->xNetworkContext );
+    }
+    else
+    {
+        /* Kept open as is. */
+    }
+
+    prvRelease( pxConnection );
+}
+
+/*-----------------------------------------------------------*/
+
+void HttpConnectionPool_CloseIdle( void )
+{
+    HttpPoolConnection_t * pxConnection = NULL;
+    size_t i;
+
+    if( xPoolMutex != NULL )
+    {
+        for( i = 0; i < httpconnectionpoolMAX_CONNECTIONS; i++ )
+        {
+            pxConnection = NULL;
+
+            ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+
+            if( ( xConnections[ i ].xInUse == pdFALSE ) && ( xConnections[ i ].xConnected == pdTRUE ) )
+            {
+                pxConnection = &xConnections[ i ];
+                pxConnection->xInUse = pdTRUE;
+            }
+
+            ( void ) xSemaphoreGive( xPoolMutex );
+
+            if( pxConnection != NULL )
+            {
+                prvClose( pxConnection );
+                prvRelease( pxConnection );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void HttpConnectionPool_GetStats( HttpPoolStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    if( xPoolMutex != NULL )
+    {
+        ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+        *pxStats = xStats;
+        ( void ) xSemaphoreGive( xPoolMutex );
+    }
+    else
+    {
+        ( void ) memset( pxStats, 0, sizeof( HttpPoolStats_t ) );
+    }
+}
@@ -0,0 +1,178 @@
+/*
+ * FreeRTOS V202203.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file http_connection_pool.h
+ * @brief Pool of kept-alive HTTP connections, keyed by host and port.
+ *
+ * A request checks a connection out, sends through its transport interface
+ * and checks it back in with the outcome. Connections whose last response
+ * allowed keep-alive stay open for the next request to the same server, so
+ * periodic REST calls and ranged downloads pay for one TLS handshake instead
+ * of one per request.
+ */
+
+#ifndef HTTP_CONNECTION_POOL_H
+#define HTTP_CONNECTION_POOL_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+/* Transport interface implementation include header for TLS. */
+#include "transport_secure_sockets.h"
+
+/* HTTP API header. */
+#include "core_http_client.h"
+
+/**
+ * @brief Number of connections the pool holds open at most.
+ */
+#ifndef httpconnectionpoolMAX_CONNECTIONS
+    #define httpconnectionpoolMAX_CONNECTIONS    ( 2U )
+#endif
+
+/**
+ * @brief Number of connections to one host and port at most.
+ */
+#ifndef httpconnectionpoolMAX_CONNECTIONS_PER_HOST
+    #define httpconnectionpoolMAX_CONNECTIONS_PER_HOST    ( 1U )
+#endif
+
+/**
+ * @brief Idle connections older than this are closed instead of reused.
+ *
+ * Keep this below the keep-alive timeout of the servers, so that the pool
+ * rarely hands out a connection the server is about to close.
+ */
+#ifndef httpconnectionpoolIDLE_TIMEOUT_MS
+    #define httpconnectionpoolIDLE_TIMEOUT_MS    ( 30000U )
+#endif
+
+/**
+ * @brief Longest host name the pool can connect to.
+ */
+#ifndef httpconnectionpoolMAX_HOST_NAME_LENGTH
+    #define httpconnectionpoolMAX_HOST_NAME_LENGTH    ( 128U )
+#endif
+
+/**
+ * @brief Function pointer for establishing a connection for the pool.
+ *
+ * @param[out] pxNetworkContext Network context to connect.
+ * @param[in] pcHost NULL-terminated host name.
+ * @param[in] usPort Port in host order.
+ *
+ * @return pdFAIL on failure; pdPASS on successful connection.
+ */
+typedef BaseType_t ( * HttpPoolConnect_t )( NetworkContext_t * pxNetworkContext,
+                                            const char * pcHost,
+                                            uint16_t usPort );
+
+/**
+ * @brief A pooled connection, as handed out by HttpConnectionPool_Checkout().
+ */
+typedef struct HttpPoolConnection HttpPoolConnection_t;
+
+/**
+ * @brief Counters of the pool.
+ *
+ * Requests per TLS handshake is ulRequests / ulHandshakes.
+ */
+typedef struct HttpPoolStats
+{
+    uint32_t ulRequests;            /**< Connections checked out. */
+    uint32_t ulHandshakes;          /**< Connections opened. */
+    uint32_t ulReuses;              /**< Checkouts served by an open connection. */
+    uint32_t ulIdleTimeouts;        /**< Connections closed for being idle too long. */
+    uint32_t ulHealthCheckFailures; /**< Idle connections found closed or dirty on checkout. */
+    uint32_t ulLimitRejections;     /**< Checkouts refused by the connection limits. */
+} HttpPoolStats_t;
+
+/**
+ * @brief Set up the pool. Must be called once before any other function.
+ *
+ * @param[in] xConnect Function used to open new connections.
+ *
+ * @return pdPASS on success; pdFAIL otherwise.
+ */
+BaseType_t HttpConnectionPool_Init( HttpPoolConnect_t xConnect );
+
+/**
+ * @brief Get a connection to a server for one request.
+ *
+ * An idle connection to the server is reused if it is within the idle timeout
+ * and the peer has neither closed it nor sent anything since the last
+ * response. Otherwise a new connection is opened, evicting the least recently
+ * used idle connection to another server if the pool is full.
+ *
+ * @param[in] pcHost Host name of the server.
+ * @param[in] xHostLen Length of pcHost, which need not be NULL-terminated.
+ * @param[in] usPort Port of the server in host order.
+ *
+ * @return The connection, or NULL if it could not be opened or the limits are
+ * reached.
+ */
+HttpPoolConnection_t * HttpConnectionPool_Checkout( const char * pcHost,
+                                                    size_t xHostLen,
+                                                    uint16_t usPort );
+
+/**
+ * @brief Get the transport interface of a checked out connection.
+ *
+ * @param[in] pxConnection The connection.
+ *
+ * @return The transport interface to pass to HTTPClient_Send().
+ */
+const TransportInterface_t * HttpConnectionPool_GetTransport( HttpPoolConnection_t * pxConnection );
+
+/**
+ * @brief Return a connection to the pool after a request.
+ *
+ * The connection is kept open only if the request succeeded and the server
+ * did not ask to close it. A kept TLS connection releases its record buffers
+ * until the next request.
+ *
+ * @param[in] pxConnection The connection.
+ * @param[in] xHttpStatus Result of HTTPClient_Send().
+ * @param[in] pxResponse The response, or NULL if there is none.
+ */
+void HttpConnectionPool_Checkin( HttpPoolConnection_t * pxConnection,
+                                 HTTPStatus_t xHttpStatus,
+                                 const HTTPResponse_t * pxResponse );
+
+/**
+ * @brief Close every connection that is not checked out.
+ */
+void HttpConnectionPool_CloseIdle( void );
+
+/**
+ * @brief Copy the counters of the pool.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void HttpConnectionPool_GetStats( HttpPoolStats_t * pxStats );
+
+#endif /* ifndef HTTP_CONNECTION_POOL_H */
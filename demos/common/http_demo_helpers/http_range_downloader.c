@@ -0,0 +1,476 @@
+/*
+ * FreeRTOS V202203.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file http_range_downloader.c
+ * @brief Download of a file as a pipeline of HTTP range requests.
+ *
+ * Requests are written straight to the pooled connection. Each response is
+ * then read with HTTPClient_Send() over a transport that drops the request it
+ * is given and reads from the connection, so coreHTTP parses the responses
+ * without sending anything. coreHTTP may read past the end of a response into
+ * the next one; those bytes are kept and handed back first on the next read.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "http_range_downloader.h"
+
+/* Common HTTP demo utilities. */
+#include "http_demo_utils.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reading side of a pipeline on one connection.
+ *
+ * The transport interface used to parse responses points at this structure
+ * in place of a network context.
+ */
+typedef struct RangePipeline
+{
+    const TransportInterface_t * pxTransport; /**< The pooled connection. */
+    uint8_t * pucCarry;                       /**< Bytes read past the previous response. */
+    size_t xCarryLen;                         /**< Number of bytes at pucCarry. */
+    size_t xDelivered;                        /**< Bytes handed to coreHTTP for the current response. */
+} RangePipeline_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Transport send that drops the request, which is already on the wire.
+ */
+static int32_t prvDiscardSend( NetworkContext_t * pxNetworkContext,
+                               const void * pvBuffer,
+                               size_t xBytesToSend );
+
+/**
+ * @brief Transport receive that serves carried over bytes before reading the
+ * connection.
+ */
+static int32_t prvPipelineRecv( NetworkContext_t * pxNetworkContext,
+                                void * pvBuffer,
+                                size_t xBytesToRecv );
+
+/**
+ * @brief Build a range request and write it to the connection.
+ */
+static HTTPStatus_t prvSendRangeRequest( const TransportInterface_t * pxTransport,
+                                         const HttpRangeDownloadParams_t * pxParams,
+                                         const HTTPRequestInfo_t * pxRequestInfo,
+                                         HTTPRequestHeaders_t * pxRequestHeaders,
+                                         uint32_t ulStart,
+                                         uint32_t ulEnd );
+
+/**
+ * @brief Download from *pulWritten on, over one connection, until the file is
+ * complete or something fails.
+ *
+ * @param[out] pxSinkFailed Set to pdTRUE if the sink refused a block, which
+ * is not worth a retry.
+ *
+ * @return HTTPSuccess if the connection is clean, with no response pending.
+ */
+static HTTPStatus_t prvRunPipeline( const HttpRangeDownloadParams_t * pxParams,
+                                    const TransportInterface_t * pxTransport,
+                                    const HTTPRequestInfo_t * pxRequestInfo,
+                                    HTTPResponse_t * pxResponse,
+                                    uint32_t * pulWritten,
+                                    HttpRangeDownloadStats_t * pxStats,
+                                    BaseType_t * pxSinkFailed );
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvDiscardSend( NetworkContext_t * pxNetworkContext,
+                               const void * pvBuffer,
+                               size_t xBytesToSend )
+{
+    ( void ) pxNetworkContext;
+    ( void ) pvBuffer;
+
+    return ( int32_t ) xBytesToSend;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvPipelineRecv( NetworkContext_t * pxNetworkContext,
+                                void * pvBuffer,
+                                size_t xBytesToRecv )
+{
+    RangePipeline_t * pxPipeline = ( RangePipeline_t * ) pxNetworkContext; /*lint !e9087 !e740 The pipeline stands in for the network context. */
+    int32_t lReceived = 0;
+    size_t xLength = 0;
+
+    if( pxPipeline->xCarryLen > 0U )
+    {
+        xLength = ( pxPipeline->xCarryLen < xBytesToRecv ) ? pxPipeline->xCarryLen : xBytesToRecv;
+
+        /* The carried bytes sit further up the same response buffer. */
+        ( void ) memmove( pvBuffer, pxPipeline->pucCarry, xLength );
+        pxPipeline->pucCarry += xLength;
+        pxPipeline->xCarryLen -= xLength;
+        lReceived = ( int32_t ) xLength;
+    }
+    else
+    {
+        lReceived = pxPipeline->pxTransport->recv( pxPipeline->pxTransport->pNetworkContext,
+                                                   pvBuffer,
+                                                   xBytesToRecv );
+    }
+
+    if( lReceived > 0 )
+    {
+        pxPipeline->xDelivered += ( size_t ) lReceived;
+    }
+
+    return lReceived;
+}
+
+/*-----------------------------------------------------------*/
+
+static HTTPStatus_t prvSendRangeRequest( const TransportInterface_t * pxTransport,
+                                         const HttpRangeDownloadParams_t * pxParams,
+                                         const HTTPRequestInfo_t * pxRequestInfo,
+                                         HTTPRequestHeaders_t * pxRequestHeaders,
+                                         uint32_t ulStart,
+                                         uint32_t ulEnd )
+{
+    HTTPStatus_t xHttpStatus = HTTPSuccess;
+    size_t xSent = 0;
+    int32_t lSent = 0;
+
+    ( void ) memset( pxRequestHeaders, 0, sizeof( HTTPRequestHeaders_t ) );
+    pxRequestHeaders->pBuffer = pxParams->pucRequestBuffer;
+    pxRequestHeaders->bufferLen = pxParams->xRequestBufferLen;
+
+    xHttpStatus = HTTPClient_InitializeRequestHeaders( pxRequestHeaders, pxRequestInfo );
+
+    if( xHttpStatus == HTTPSuccess )
+    {
+        xHttpStatus = HTTPClient_AddRangeHeader( pxRequestHeaders,
+                                                 ( int32_t ) ulStart,
+                                                 ( int32_t ) ulEnd );
+    }
+
+    while( ( xHttpStatus == HTTPSuccess ) && ( xSent < pxRequestHeaders->headersLen ) )
+    {
+        lSent = pxTransport->send( pxTransport->pNetworkContext,
+                                   pxRequestHeaders->pBuffer + xSent,
+                                   pxRequestHeaders->headersLen - xSent );
+
+        if( lSent <= 0 )
+        {
+            LogError( ( "Failed to send range request for bytes %lu-%lu. Status=%d.",
+                        ulStart, ulEnd, ( int ) lSent ) );
+            xHttpStatus = HTTPNetworkError;
+        }
+        else
+        {
+            xSent += ( size_t ) lSent;
+        }
+    }
+
+    return xHttpStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static HTTPStatus_t prvRunPipeline( const HttpRangeDownloadParams_t * pxParams,
+                                    const TransportInterface_t * pxTransport,
+                                    const HTTPRequestInfo_t * pxRequestInfo,
+                                    HTTPResponse_t * pxResponse,
+                                    uint32_t * pulWritten,
+                                    HttpRangeDownloadStats_t * pxStats,
+                                    BaseType_t * pxSinkFailed )
+{
+    HTTPStatus_t xHttpStatus = HTTPSuccess;
+    RangePipeline_t xPipeline = { 0 };
+    TransportInterface_t xPipelineTransport = { 0 };
+    HTTPRequestHeaders_t xRequestHeaders = { 0 };
+    TickType_t xSentAt[ httprangedownloaderMAX_WINDOW ];
+    uint32_t ulNextRequest = *pulWritten;
+    uint32_t ulRequested = 0;
+    uint32_t ulAnswered = 0;
+    uint32_t ulWindow = 1;
+    uint32_t ulEnd = 0;
+    uint32_t ulExpected = 0;
+    uint32_t ulRttMs = 0;
+    size_t xResponseEnd = 0;
+    int16_t sWritten = 0;
+
+    xPipeline.pxTransport = pxTransport;
+    xPipelineTransport.pNetworkContext = ( NetworkContext_t * ) &xPipeline; /*lint !e9087 !e740 The pipeline stands in for the network context. */
+    xPipelineTransport.send = prvDiscardSend;
+    xPipelineTransport.recv = prvPipelineRecv;
+
+    while( ( xHttpStatus == HTTPSuccess ) && ( *pulWritten < pxParams->ulFileSize ) )
+    {
+        /* Keep the window full. */
+        while( ( xHttpStatus == HTTPSuccess ) &&
+               ( ( ulRequested - ulAnswered ) < ulWindow ) &&
+               ( ulNextRequest < pxParams->ulFileSize ) )
+        {
+            ulEnd = ( ( pxParams->ulFileSize - ulNextRequest ) > pxParams->ulBlockSize ) ?
+                    ( ulNextRequest + pxParams->ulBlockSize - 1U ) : ( pxParams->ulFileSize - 1U );
+
+            xHttpStatus = prvSendRangeRequest( pxTransport, pxParams, pxRequestInfo,
+                                               &xRequestHeaders, ulNextRequest, ulEnd );
+
+            if( xHttpStatus == HTTPSuccess )
+            {
+                xSentAt[ ulRequested % httprangedownloaderMAX_WINDOW ] = xTaskGetTickCount();
+                ulRequested++;
+                ulNextRequest = ulEnd + 1U;
+                pxStats->ulRequests++;
+
+                if( ( ulRequested - ulAnswered ) > pxStats->ulMaxWindow )
+                {
+                    pxStats->ulMaxWindow = ulRequested - ulAnswered;
+                }
+            }
+        }
+
+        /* Parse the oldest outstanding response. */
+        if( xHttpStatus == HTTPSuccess )
+        {
+            ( void ) memset( pxResponse, 0, sizeof( HTTPResponse_t ) );
+            pxResponse->pBuffer = pxParams->pucResponseBuffer;
+            pxResponse->bufferLen = pxParams->xResponseBufferLen;
+            xPipeline.xDelivered = 0;
+
+            xHttpStatus = HTTPClient_Send( &xPipelineTransport,
+                                           &xRequestHeaders,
+                                           NULL,
+                                           0,
+                                           pxResponse,
+                                           0 );
+        }
+
+        if( xHttpStatus == HTTPSuccess )
+        {
+            ulExpected = ( ( pxParams->ulFileSize - *pulWritten ) > pxParams->ulBlockSize ) ?
+                         pxParams->ulBlockSize : ( pxParams->ulFileSize - *pulWritten );
+
+            if( ( pxResponse->statusCode != 206U ) ||
+                ( pxResponse->pBody == NULL ) ||
+                ( pxResponse->bodyLen != ( size_t ) ulExpected ) )
+            {
+                LogError( ( "Unexpected response to range request at offset %lu: "
+                            "Status=%u, BodyLength=%lu.",
+                            *pulWritten,
+                            ( unsigned ) pxResponse->statusCode,
+                            ( unsigned long ) pxResponse->bodyLen ) );
+                xHttpStatus = HTTPInvalidResponse;
+            }
+        }
+
+        if( xHttpStatus == HTTPSuccess )
+        {
+            /* Whatever coreHTTP read past this response belongs to the next. */
+            xResponseEnd = ( size_t ) ( ( pxResponse->pBody + pxResponse->bodyLen ) - pxResponse->pBuffer );
+
+            if( xPipeline.xDelivered > xResponseEnd )
+            {
+                xPipeline.pucCarry = pxResponse->pBuffer + xResponseEnd;
+                xPipeline.xCarryLen = xPipeline.xDelivered - xResponseEnd;
+            }
+
+            sWritten = pxParams->xWriteBlock( pxParams->pvWriteContext,
+                                              *pulWritten,
+                                              ( uint8_t * ) pxResponse->pBody,
+                                              ulExpected );
+
+            if( sWritten != ( int16_t ) ulExpected )
+            {
+                LogError( ( "Failed to write block at offset %lu. Result=%d.",
+                            *pulWritten, ( int ) sWritten ) );
+                *pxSinkFailed = pdTRUE;
+                xHttpStatus = HTTPInvalidResponse;
+            }
+        }
+
+        if( xHttpStatus == HTTPSuccess )
+        {
+            ulRttMs = ( uint32_t ) ( ( xTaskGetTickCount() - xSentAt[ ulAnswered % httprangedownloaderMAX_WINDOW ] ) *
+                                     portTICK_PERIOD_MS );
+            ulAnswered++;
+            *pulWritten += ulExpected;
+            pxStats->ulBytes += ulExpected;
+            pxStats->ulLastRttMs = ulRttMs;
+
+            if( ulRttMs < pxStats->ulMinRttMs )
+            {
+                pxStats->ulMinRttMs = ulRttMs;
+            }
+
+            /* Close to the fastest round trip means the link has room for
+             * another request; twice that means requests are queueing. */
+            if( ( ( ulRttMs * 2U ) <= ( pxStats->ulMinRttMs * 3U ) ) &&
+                ( ulWindow < httprangedownloaderMAX_WINDOW ) )
+            {
+                ulWindow++;
+            }
+            else if( ( ulRttMs > ( pxStats->ulMinRttMs * 2U ) ) && ( ulWindow > 1U ) )
+            {
+                ulWindow--;
+            }
+            else
+            {
+                /* Keep the window. */
+            }
+        }
+    }
+
+    if( ( xHttpStatus == HTTPSuccess ) && ( xPipeline.xCarryLen > 0U ) )
+    {
+        LogError( ( "%lu unexpected bytes after the last response.",
+                    ( unsigned long ) xPipeline.xCarryLen ) );
+        xHttpStatus = HTTPInvalidResponse;
+    }
+
+    return xHttpStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t HttpRangeDownloader_Download( const HttpRangeDownloadParams_t * pxParams,
+                                         HttpRangeDownloadStats_t * pxStats )
+{
+    BaseType_t xStatus = pdPASS;
+    BaseType_t xSinkFailed = pdFALSE;
+    HTTPStatus_t xHttpStatus = HTTPSuccess;
+    HTTPRequestInfo_t xRequestInfo = { 0 };
+    HTTPResponse_t xResponse = { 0 };
+    HttpRangeDownloadStats_t xStats = { 0 };
+    HttpPoolConnection_t * pxConnection = NULL;
+    const char * pcPath = NULL;
+    size_t xPathLen = 0;
+    uint32_t ulWritten = 0;
+    uint32_t ulAttempts = 0;
+    TickType_t xStart = xTaskGetTickCount();
+
+    if( ( pxParams == NULL ) || ( pxParams->pcUrl == NULL ) ||
+        ( pxParams->ulBlockSize == 0U ) || ( pxParams->ulBlockSize > 32767U ) ||
+        ( pxParams->pucRequestBuffer == NULL ) || ( pxParams->pucResponseBuffer == NULL ) ||
+        ( pxParams->xResponseBufferLen <= pxParams->ulBlockSize ) ||
+        ( pxParams->xWriteBlock == NULL ) )
+    {
+        LogError( ( "Invalid parameters for a range download." ) );
+        xStatus = pdFAIL;
+    }
+
+    if( xStatus == pdPASS )
+    {
+        xHttpStatus = getUrlAddress( pxParams->pcUrl, pxParams->xUrlLen,
+                                     &xRequestInfo.pHost, &xRequestInfo.hostLen );
+
+        if( xHttpStatus == HTTPSuccess )
+        {
+            xHttpStatus = getUrlPath( pxParams->pcUrl, pxParams->xUrlLen, &pcPath, &xPathLen );
+        }
+
+        if( xHttpStatus == HTTPSuccess )
+        {
+            /* Keep the query, which carries the signature of presigned URLs. */
+            xRequestInfo.pPath = pcPath;
+            xRequestInfo.pathLen = pxParams->xUrlLen - ( size_t ) ( pcPath - pxParams->pcUrl );
+            xRequestInfo.pMethod = HTTP_METHOD_GET;
+            xRequestInfo.methodLen = sizeof( HTTP_METHOD_GET ) - 1U;
+            xRequestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+        }
+        else
+        {
+            xStatus = pdFAIL;
+        }
+    }
+
+    xStats.ulMinRttMs = UINT32_MAX;
+
+    while( ( xStatus == pdPASS ) &&
+           ( ulWritten < pxParams->ulFileSize ) &&
+           ( ulAttempts < httprangedownloaderMAX_ATTEMPTS ) )
+    {
+        ulAttempts++;
+
+        pxConnection = HttpConnectionPool_Checkout( xRequestInfo.pHost,
+                                                    xRequestInfo.hostLen,
+                                                    pxParams->usPort );
+
+        if( pxConnection != NULL )
+        {
+            xStats.ulConnections++;
+
+            xHttpStatus = prvRunPipeline( pxParams,
+                                          HttpConnectionPool_GetTransport( pxConnection ),
+                                          &xRequestInfo,
+                                          &xResponse,
+                                          &ulWritten,
+                                          &xStats,
+                                          &xSinkFailed );
+
+            /* Responses still in flight make the connection unusable. */
+            HttpConnectionPool_Checkin( pxConnection, xHttpStatus, &xResponse );
+
+            if( xHttpStatus != HTTPSuccess )
+            {
+                LogWarn( ( "Range download interrupted at offset %lu of %lu: Error=%s.",
+                           ulWritten, pxParams->ulFileSize,
+                           HTTPClient_strerror( xHttpStatus ) ) );
+            }
+        }
+
+        if( xSinkFailed == pdTRUE )
+        {
+            xStatus = pdFAIL;
+        }
+    }
+
+    if( ulWritten < pxParams->ulFileSize )
+    {
+        xStatus = pdFAIL;
+    }
+
+    if( xStats.ulMinRttMs == UINT32_MAX )
+    {
+        xStats.ulMinRttMs = 0;
+    }
+
+    xStats.ulElapsedMs = ( uint32_t ) ( ( xTaskGetTickCount() - xStart ) * portTICK_PERIOD_MS );
+
+    LogInfo( ( "Range download %s: %lu bytes in %lu ms, %lu requests over %lu connections, "
+               "up to %lu in flight, RTT min %lu ms.",
+               ( xStatus == pdPASS ) ? "complete" : "failed",
+               xStats.ulBytes, xStats.ulElapsedMs, xStats.ulRequests,
+               xStats.ulConnections, xStats.ulMaxWindow, xStats.ulMinRttMs ) );
+
+    if( pxStats != NULL )
+    {
+        *pxStats = xStats;
+    }
+
+    return xStatus;
+}
@@ -0,0 +1,127 @@
+/*
+ * FreeRTOS V202203.00
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file http_range_downloader.h
+ * @brief Download of a file as a pipeline of HTTP range requests.
+ *
+ * Several "Range:" requests are kept in flight on one kept-alive connection
+ * from the HTTP connection pool, so the link stays busy while each response
+ * is parsed and written out. HTTP/1.1 answers pipelined requests in order, so
+ * blocks reach the sink in file order and no reorder buffer is needed. The
+ * number of requests in flight adapts to the measured round trip time: it
+ * grows while responses come back at the fastest round trip time seen, and
+ * shrinks once they start queueing behind each other.
+ */
+
+#ifndef HTTP_RANGE_DOWNLOADER_H
+#define HTTP_RANGE_DOWNLOADER_H
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+/* Pool of kept-alive HTTP connections. */
+#include "http_connection_pool.h"
+
+/**
+ * @brief Largest number of range requests in flight.
+ */
+#ifndef httprangedownloaderMAX_WINDOW
+    #define httprangedownloaderMAX_WINDOW    ( 4U )
+#endif
+
+/**
+ * @brief Number of connections tried before a download fails. Every new
+ * connection resumes after the last block written.
+ */
+#ifndef httprangedownloaderMAX_ATTEMPTS
+    #define httprangedownloaderMAX_ATTEMPTS    ( 3U )
+#endif
+
+/**
+ * @brief Consumes one block of the file.
+ *
+ * Matches otaPal_WriteBlock(), so an OTA file context can be passed through
+ * pvContext.
+ *
+ * @param[in] pvContext HttpRangeDownloadParams_t::pvWriteContext.
+ * @param[in] ulOffset Offset of the block in the file.
+ * @param[in] pucData The block.
+ * @param[in] ulBlockSize Length of the block.
+ *
+ * @return Number of bytes written, or a negative value on error.
+ */
+typedef int16_t ( * HttpRangeWriteBlock_t )( void * pvContext,
+                                             uint32_t ulOffset,
+                                             uint8_t * const pucData,
+                                             uint32_t ulBlockSize );
+
+/**
+ * @brief Parameters of a download.
+ */
+typedef struct HttpRangeDownloadParams
+{
+    const char * pcUrl;                /**< "https://host/path?query" of the file, such as an S3 presigned URL. */
+    size_t xUrlLen;                    /**< Length of pcUrl. */
+    uint16_t usPort;                   /**< Port of the server in host order. */
+    uint32_t ulFileSize;               /**< Size of the file in bytes. */
+    uint32_t ulBlockSize;              /**< Bytes per range request; at most 32767 to fit the sink. */
+    uint8_t * pucRequestBuffer;        /**< Buffer for building request headers. */
+    size_t xRequestBufferLen;          /**< Length of pucRequestBuffer. */
+    uint8_t * pucResponseBuffer;       /**< Buffer for one response; headers plus one block. */
+    size_t xResponseBufferLen;         /**< Length of pucResponseBuffer. */
+    HttpRangeWriteBlock_t xWriteBlock; /**< Sink of the blocks. */
+    void * pvWriteContext;             /**< Passed to xWriteBlock. */
+} HttpRangeDownloadParams_t;
+
+/**
+ * @brief Counters of a download.
+ */
+typedef struct HttpRangeDownloadStats
+{
+    uint32_t ulRequests;      /**< Range requests sent. */
+    uint32_t ulBytes;         /**< Bytes handed to the sink. */
+    uint32_t ulConnections;   /**< Connections checked out of the pool. */
+    uint32_t ulMaxWindow;     /**< Largest number of requests in flight. */
+    uint32_t ulMinRttMs;      /**< Fastest request to response time. */
+    uint32_t ulLastRttMs;     /**< Request to response time of the last block. */
+    uint32_t ulElapsedMs;     /**< Duration of the download. */
+} HttpRangeDownloadStats_t;
+
+/**
+ * @brief Download a file into a sink.
+ *
+ * HttpConnectionPool_Init() must have been called.
+ *
+ * @param[in] pxParams Parameters of the download.
+ * @param[out] pxStats Receives the counters of the download; may be NULL.
+ *
+ * @return pdPASS once the whole file was written; pdFAIL otherwise.
+ */
+BaseType_t HttpRangeDownloader_Download( const HttpRangeDownloadParams_t * pxParams,
+                                         HttpRangeDownloadStats_t * pxStats );
+
+#endif /* ifndef HTTP_RANGE_DOWNLOADER_H */
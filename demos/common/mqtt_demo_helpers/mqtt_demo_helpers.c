@@ -145,7 +145,19 @@
  * @brief Maximum number of outgoing publishes maintained in the application
  * until an ack is received from the broker.
  */
-#define MAX_OUTGOING_PUBLISHES                       ( 1U )
+#define MAX_OUTGOING_PUBLISHES                       ( democonfigMAX_OUTGOING_PUBLISHES )
+
+/**
+ * @brief Size of the table mapping the packet identifier of an outgoing
+ * publish to its index in #outgoingPublishPackets. Kept at most half full.
+ */
+#define OUTGOING_PUBLISH_MAP_SIZE                    ( 2U * MAX_OUTGOING_PUBLISHES )
+
+/**
+ * @brief Marks no outgoing publish. The links between outgoing publishes and
+ * the entries of the packet identifier table hold the index plus one.
+ */
+#define NO_OUTGOING_PUBLISH                          ( 0U )
 
 /**
  * @brief Milliseconds per second.
@@ -173,6 +185,14 @@
  */
 #define mqttexampleINCOMING_PUBLISH_RECORD_LEN            ( 15U )
 
+#if ( MAX_OUTGOING_PUBLISHES < 1 ) || ( MAX_OUTGOING_PUBLISHES > 127 )
+    #error "democonfigMAX_OUTGOING_PUBLISHES must be between 1 and 127."
+#endif
+
+#if ( MAX_OUTGOING_PUBLISHES > mqttexampleOUTGOING_PUBLISH_RECORD_LEN )
+    #error "coreMQTT must be able to track every outgoing publish, increase mqttexampleOUTGOING_PUBLISH_RECORD_LEN."
+#endif
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -204,6 +224,17 @@ typedef struct PublishPackets
      * @brief Publish info of the publish packet.
      */
     MQTTPublishInfo_t pubInfo;
+
+    /**
+     * @brief Link to the publish sent before this one.
+     */
+    uint8_t ucOlder;
+
+    /**
+     * @brief Link to the publish sent after this one, or to the next free
+     * entry.
+     */
+    uint8_t ucNewer;
 } PublishPackets_t;
 
 /**
@@ -265,6 +296,27 @@ static topicFilterContext_t xTopicFilterContext;
  */
 static PublishPackets_t outgoingPublishPackets[ MAX_OUTGOING_PUBLISHES ] = { 0 };
 
+/**
+ * @brief Links to the oldest and to the newest publish waiting for an ack,
+ * and to the first entry of #outgoingPublishPackets freed by an ack.
+ */
+static uint8_t ucOldestOutgoingPublish = NO_OUTGOING_PUBLISH;
+static uint8_t ucNewestOutgoingPublish = NO_OUTGOING_PUBLISH;
+static uint8_t ucFreeOutgoingPublish = NO_OUTGOING_PUBLISH;
+
+/**
+ * @brief Number of entries of #outgoingPublishPackets used since the last
+ * clean session, and number of them waiting for an ack.
+ */
+static uint8_t ucOutgoingPublishesUsed = 0U;
+static uint8_t ucOutgoingPublishCount = 0U;
+
+/**
+ * @brief Table mapping the packet identifier of an outgoing publish to its
+ * entry of #outgoingPublishPackets, with linear probing.
+ */
+static uint8_t ucOutgoingPublishMap[ OUTGOING_PUBLISH_MAP_SIZE ] = { 0 };
+
 /**
  * @brief The flag to indicate the mqtt session changed.
  */
@@ -368,6 +420,54 @@ static MQTTStatus_t prvProcessLoopWithTimeout( MQTTContext_t * pMqttContext,
  */
 static BaseType_t prvGetNextFreeIndexForOutgoingPublishes( uint8_t * pucIndex );
 
+/**
+ * @brief Function to wait until an outgoing publish can be stored, processing
+ * the incoming acks.
+ *
+ * @param[in] pxMqttContext MQTT context pointer.
+ * @param[out] pucIndex The output parameter to return the index at which an
+ * outgoing publish message can be stored.
+ *
+ * @return pdFAIL if no publish was acked in time;
+ * pdPASS if an index to store the next outgoing publish is obtained.
+ */
+static BaseType_t prvWaitForFreeIndexForOutgoingPublishes( MQTTContext_t * pxMqttContext,
+                                                           uint8_t * pucIndex );
+
+/**
+ * @brief Function to find the index of the outgoing publish with a packet
+ * identifier.
+ *
+ * @param[in] usPacketId Packet identifier of the publish.
+ * @param[out] pucMapIndex The output parameter to return the entry of
+ * #ucOutgoingPublishMap pointing to the publish.
+ *
+ * @return The index of the publish, or MAX_OUTGOING_PUBLISHES if no publish
+ * waits for an ack with this packet identifier.
+ */
+static uint8_t prvFindOutgoingPublish( uint16_t usPacketId,
+                                       uint8_t * pucMapIndex );
+
+/**
+ * @brief Function to store an outgoing publish at given index and send it.
+ *
+ * @param[in] pxMqttContext MQTT context pointer.
+ * @param[in] ucIndex The index at which the publish message is stored.
+ * @param[in] pcTopicFilter Points to the topic.
+ * @param[in] topicFilterLength The length of the topic.
+ * @param[in] pcPayload Points to the payload.
+ * @param[in] payloadLength The length of the payload.
+ *
+ * @return pdPASS if PUBLISH was successfully sent;
+ * pdFAIL otherwise.
+ */
+static BaseType_t prvSendOutgoingPublishAt( MQTTContext_t * pxMqttContext,
+                                            uint8_t ucIndex,
+                                            const char * pcTopicFilter,
+                                            int32_t topicFilterLength,
+                                            const char * pcPayload,
+                                            size_t payloadLength );
+
 /**
  * @brief Function to clean up an outgoing publish at given index from the
  * #outgoingPublishPackets array.
@@ -703,25 +803,153 @@ BaseType_t SubscribeToTopic( MQTTContext_t * pxMqttContext,
 
 static BaseType_t prvGetNextFreeIndexForOutgoingPublishes( uint8_t * pucIndex )
 {
-    BaseType_t xReturnStatus = pdFAIL;
-    uint8_t ucIndex = 0;
+    BaseType_t xReturnStatus = pdPASS;
+    uint8_t ucIndex = MAX_OUTGOING_PUBLISHES;
 
     assert( outgoingPublishPackets != NULL );
     assert( pucIndex != NULL );
 
-    for( ucIndex = 0; ucIndex < MAX_OUTGOING_PUBLISHES; ucIndex++ )
+    /* Reuse an entry freed by an ack, or else take the next one never used. */
+    if( ucFreeOutgoingPublish != NO_OUTGOING_PUBLISH )
+    {
+        ucIndex = ucFreeOutgoingPublish - 1U;
+        ucFreeOutgoingPublish = outgoingPublishPackets[ ucIndex ].ucNewer;
+        outgoingPublishPackets[ ucIndex ].ucNewer = NO_OUTGOING_PUBLISH;
+    }
+    else if( ucOutgoingPublishesUsed < MAX_OUTGOING_PUBLISHES )
+    {
+        ucIndex = ucOutgoingPublishesUsed;
+        ucOutgoingPublishesUsed++;
+    }
+    else
+    {
+        xReturnStatus = pdFAIL;
+    }
+
+    /* Copy the available ucIndex into the output param. */
+    *pucIndex = ucIndex;
+
+    return xReturnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvWaitForFreeIndexForOutgoingPublishes( MQTTContext_t * pxMqttContext,
+                                                           uint8_t * pucIndex )
+{
+    BaseType_t xReturnStatus = pdFAIL;
+    MQTTStatus_t eMqttStatus = MQTTSuccess;
+    uint32_t ulMqttProcessLoopTimeoutTime;
+    uint32_t ulCurrentTime;
+
+    ulCurrentTime = pxMqttContext->getTime();
+    ulMqttProcessLoopTimeoutTime = ulCurrentTime + mqttexamplePROCESS_LOOP_TIMEOUT_MS;
+
+    xReturnStatus = prvGetNextFreeIndexForOutgoingPublishes( pucIndex );
+
+    /* Every entry waits for an ack: process the incoming packets until one
+     * arrives. */
+    while( ( xReturnStatus == pdFAIL ) &&
+           ( ulCurrentTime < ulMqttProcessLoopTimeoutTime ) &&
+           ( ( eMqttStatus == MQTTSuccess ) || ( eMqttStatus == MQTTNeedMoreBytes ) ) )
+    {
+        eMqttStatus = MQTT_ProcessLoop( pxMqttContext );
+        ulCurrentTime = pxMqttContext->getTime();
+        xReturnStatus = prvGetNextFreeIndexForOutgoingPublishes( pucIndex );
+    }
+
+    return xReturnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint8_t prvFindOutgoingPublish( uint16_t usPacketId,
+                                       uint8_t * pucMapIndex )
+{
+    uint8_t ucMapIndex = ( uint8_t ) ( usPacketId % OUTGOING_PUBLISH_MAP_SIZE );
+    uint8_t ucIndex = MAX_OUTGOING_PUBLISHES;
+
+    /* The table is at most half full, so a probe ends on an empty entry. */
+    while( ucOutgoingPublishMap[ ucMapIndex ] != NO_OUTGOING_PUBLISH )
     {
-        /* A free ucIndex is marked by invalid packet id.
-         * Check if the the ucIndex has a free slot. */
-        if( outgoingPublishPackets[ ucIndex ].packetId == MQTT_PACKET_ID_INVALID )
+        if( outgoingPublishPackets[ ucOutgoingPublishMap[ ucMapIndex ] - 1U ].packetId == usPacketId )
         {
-            xReturnStatus = pdPASS;
+            ucIndex = ucOutgoingPublishMap[ ucMapIndex ] - 1U;
             break;
         }
+
+        ucMapIndex = ( uint8_t ) ( ( ucMapIndex + 1U ) % OUTGOING_PUBLISH_MAP_SIZE );
     }
 
-    /* Copy the available ucIndex into the output param. */
-    *pucIndex = ucIndex;
+    *pucMapIndex = ucMapIndex;
+
+    return ucIndex;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSendOutgoingPublishAt( MQTTContext_t * pxMqttContext,
+                                            uint8_t ucIndex,
+                                            const char * pcTopicFilter,
+                                            int32_t topicFilterLength,
+                                            const char * pcPayload,
+                                            size_t payloadLength )
+{
+    BaseType_t xReturnStatus = pdPASS;
+    MQTTStatus_t eMqttStatus = MQTTSuccess;
+    PublishPackets_t * pxPublish = &( outgoingPublishPackets[ ucIndex ] );
+    uint8_t ucMapIndex = 0U;
+
+    LogInfo( ( "the published payload:%.*s \r\n ", payloadLength, pcPayload ) );
+    /* This example publishes to only one topic and uses QOS1. */
+    pxPublish->pubInfo.qos = MQTTQoS1;
+    pxPublish->pubInfo.pTopicName = pcTopicFilter;
+    pxPublish->pubInfo.topicNameLength = topicFilterLength;
+    pxPublish->pubInfo.pPayload = pcPayload;
+    pxPublish->pubInfo.payloadLength = payloadLength;
+
+    /* Get a new packet id. */
+    pxPublish->packetId = MQTT_GetPacketId( pxMqttContext );
+
+    /* Record the publish by its packet id, and after the publishes already
+     * sent so that they are sent again in order. */
+    ( void ) prvFindOutgoingPublish( pxPublish->packetId, &ucMapIndex );
+    ucOutgoingPublishMap[ ucMapIndex ] = ucIndex + 1U;
+
+    pxPublish->ucOlder = ucNewestOutgoingPublish;
+    pxPublish->ucNewer = NO_OUTGOING_PUBLISH;
+
+    if( ucNewestOutgoingPublish != NO_OUTGOING_PUBLISH )
+    {
+        outgoingPublishPackets[ ucNewestOutgoingPublish - 1U ].ucNewer = ucIndex + 1U;
+    }
+    else
+    {
+        ucOldestOutgoingPublish = ucIndex + 1U;
+    }
+
+    ucNewestOutgoingPublish = ucIndex + 1U;
+    ucOutgoingPublishCount++;
+
+    /* Send PUBLISH packet. */
+    eMqttStatus = MQTT_Publish( pxMqttContext,
+                                &( pxPublish->pubInfo ),
+                                pxPublish->packetId );
+
+    if( eMqttStatus != MQTTSuccess )
+    {
+        LogError( ( "Failed to send PUBLISH packet to broker with error = %s.",
+                    MQTT_Status_strerror( eMqttStatus ) ) );
+        vCleanupOutgoingPublishAt( ucIndex );
+        xReturnStatus = pdFAIL;
+    }
+    else
+    {
+        LogInfo( ( "PUBLISH sent for topic %.*s to broker with packet ID %u.\n\n",
+                   topicFilterLength,
+                   pcTopicFilter,
+                   pxPublish->packetId ) );
+    }
 
     return xReturnStatus;
 }
@@ -730,13 +958,64 @@ static BaseType_t prvGetNextFreeIndexForOutgoingPublishes( uint8_t * pucIndex )
 
 static void vCleanupOutgoingPublishAt( uint8_t ucIndex )
 {
+    PublishPackets_t * pxPublish = NULL;
+    uint8_t ucMapIndex = 0U, ucNextMapIndex = 0U, ucHomeIndex = 0U;
+
     assert( outgoingPublishPackets != NULL );
     assert( ucIndex < MAX_OUTGOING_PUBLISHES );
 
-    /* Clear the outgoing publish packet. */
-    ( void ) memset( &( outgoingPublishPackets[ ucIndex ] ),
-                     0x00,
-                     sizeof( outgoingPublishPackets[ ucIndex ] ) );
+    pxPublish = &( outgoingPublishPackets[ ucIndex ] );
+
+    /* Remove the packet id from the table, moving back the entries probed
+     * past it so that they are still found. */
+    if( prvFindOutgoingPublish( pxPublish->packetId, &ucMapIndex ) == ucIndex )
+    {
+        ucOutgoingPublishMap[ ucMapIndex ] = NO_OUTGOING_PUBLISH;
+        ucNextMapIndex = ( uint8_t ) ( ( ucMapIndex + 1U ) % OUTGOING_PUBLISH_MAP_SIZE );
+
+        while( ucOutgoingPublishMap[ ucNextMapIndex ] != NO_OUTGOING_PUBLISH )
+        {
+            ucHomeIndex = ( uint8_t ) ( outgoingPublishPackets[ ucOutgoingPublishMap[ ucNextMapIndex ] - 1U ].packetId % OUTGOING_PUBLISH_MAP_SIZE );
+
+            /* Move the entry unless its home lies cyclically after the hole
+             * and up to its current position. */
+            if( ( ( ucNextMapIndex > ucMapIndex ) && ( ( ucHomeIndex <= ucMapIndex ) || ( ucHomeIndex > ucNextMapIndex ) ) ) ||
+                ( ( ucNextMapIndex < ucMapIndex ) && ( ucHomeIndex <= ucMapIndex ) && ( ucHomeIndex > ucNextMapIndex ) ) )
+            {
+                ucOutgoingPublishMap[ ucMapIndex ] = ucOutgoingPublishMap[ ucNextMapIndex ];
+                ucOutgoingPublishMap[ ucNextMapIndex ] = NO_OUTGOING_PUBLISH;
+                ucMapIndex = ucNextMapIndex;
+            }
+
+            ucNextMapIndex = ( uint8_t ) ( ( ucNextMapIndex + 1U ) % OUTGOING_PUBLISH_MAP_SIZE );
+        }
+
+        /* Unlink the publish from the publishes in the order they were sent. */
+        if( pxPublish->ucOlder != NO_OUTGOING_PUBLISH )
+        {
+            outgoingPublishPackets[ pxPublish->ucOlder - 1U ].ucNewer = pxPublish->ucNewer;
+        }
+        else
+        {
+            ucOldestOutgoingPublish = pxPublish->ucNewer;
+        }
+
+        if( pxPublish->ucNewer != NO_OUTGOING_PUBLISH )
+        {
+            outgoingPublishPackets[ pxPublish->ucNewer - 1U ].ucOlder = pxPublish->ucOlder;
+        }
+        else
+        {
+            ucNewestOutgoingPublish = pxPublish->ucOlder;
+        }
+
+        ucOutgoingPublishCount--;
+
+        /* Clear the outgoing publish packet and make it available again. */
+        ( void ) memset( pxPublish, 0x00, sizeof( *pxPublish ) );
+        pxPublish->ucNewer = ucFreeOutgoingPublish;
+        ucFreeOutgoingPublish = ucIndex + 1U;
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -747,27 +1026,30 @@ static void vCleanupOutgoingPublishes( void )
 
     /* Clean up all the outgoing publish packets. */
     ( void ) memset( outgoingPublishPackets, 0x00, sizeof( outgoingPublishPackets ) );
+    ( void ) memset( ucOutgoingPublishMap, 0x00, sizeof( ucOutgoingPublishMap ) );
+    ucOldestOutgoingPublish = NO_OUTGOING_PUBLISH;
+    ucNewestOutgoingPublish = NO_OUTGOING_PUBLISH;
+    ucFreeOutgoingPublish = NO_OUTGOING_PUBLISH;
+    ucOutgoingPublishesUsed = 0U;
+    ucOutgoingPublishCount = 0U;
 }
 
 /*-----------------------------------------------------------*/
 
 static void vCleanupOutgoingPublishWithPacketID( uint16_t usPacketId )
 {
-    uint8_t ucIndex = 0;
+    uint8_t ucIndex = 0, ucMapIndex = 0;
 
     assert( outgoingPublishPackets != NULL );
     assert( usPacketId != MQTT_PACKET_ID_INVALID );
 
-    /* Clean up all the saved outgoing publishes. */
-    for( ; ucIndex < MAX_OUTGOING_PUBLISHES; ucIndex++ )
+    ucIndex = prvFindOutgoingPublish( usPacketId, &ucMapIndex );
+
+    if( ucIndex < MAX_OUTGOING_PUBLISHES )
     {
-        if( outgoingPublishPackets[ ucIndex ].packetId == usPacketId )
-        {
-            vCleanupOutgoingPublishAt( ucIndex );
-            LogInfo( ( "Cleaned up outgoing publish packet with packet id %u.\n\n",
-                       usPacketId ) );
-            break;
-        }
+        vCleanupOutgoingPublishAt( ucIndex );
+        LogInfo( ( "Cleaned up outgoing publish packet with packet id %u.\n\n",
+                   usPacketId ) );
     }
 }
 
@@ -848,39 +1130,38 @@ static BaseType_t handlePublishResend( MQTTContext_t * pxMqttContext )
 {
     BaseType_t xReturnStatus = pdPASS;
     MQTTStatus_t eMqttStatus = MQTTSuccess;
-    uint8_t ucIndex = 0U;
+    uint8_t ucPublish = NO_OUTGOING_PUBLISH;
+    PublishPackets_t * pxPublish = NULL;
 
     assert( outgoingPublishPackets != NULL );
 
-    /* Resend all the QoS1 publishes still in the array. These are the
-     * publishes that hasn't received a PUBACK. When a PUBACK is
-     * received, the publish is removed from the array. */
-    for( ucIndex = 0U; ucIndex < MAX_OUTGOING_PUBLISHES; ucIndex++ )
+    /* Resend all the QoS1 publishes still waiting for an ack, in the order
+     * they were first sent. When a PUBACK is received, the publish is removed
+     * from the array. */
+    for( ucPublish = ucOldestOutgoingPublish; ucPublish != NO_OUTGOING_PUBLISH; ucPublish = pxPublish->ucNewer )
     {
-        if( outgoingPublishPackets[ ucIndex ].packetId != MQTT_PACKET_ID_INVALID )
-        {
-            outgoingPublishPackets[ ucIndex ].pubInfo.dup = true;
+        pxPublish = &( outgoingPublishPackets[ ucPublish - 1U ] );
+        pxPublish->pubInfo.dup = true;
 
-            LogInfo( ( "Sending duplicate PUBLISH with packet id %u.",
-                       outgoingPublishPackets[ ucIndex ].packetId ) );
-            eMqttStatus = MQTT_Publish( pxMqttContext,
-                                        &outgoingPublishPackets[ ucIndex ].pubInfo,
-                                        outgoingPublishPackets[ ucIndex ].packetId );
+        LogInfo( ( "Sending duplicate PUBLISH with packet id %u.",
+                   pxPublish->packetId ) );
+        eMqttStatus = MQTT_Publish( pxMqttContext,
+                                    &( pxPublish->pubInfo ),
+                                    pxPublish->packetId );
 
-            if( eMqttStatus != MQTTSuccess )
-            {
-                LogError( ( "Sending duplicate PUBLISH for packet id %u "
-                            " failed with status %s.",
-                            outgoingPublishPackets[ ucIndex ].packetId,
-                            MQTT_Status_strerror( eMqttStatus ) ) );
-                xReturnStatus = pdFAIL;
-                break;
-            }
-            else
-            {
-                LogInfo( ( "Sent duplicate PUBLISH successfully for packet id %u.\n\n",
-                           outgoingPublishPackets[ ucIndex ].packetId ) );
-            }
+        if( eMqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Sending duplicate PUBLISH for packet id %u "
+                        " failed with status %s.",
+                        pxPublish->packetId,
+                        MQTT_Status_strerror( eMqttStatus ) ) );
+            xReturnStatus = pdFAIL;
+            break;
+        }
+        else
+        {
+            LogInfo( ( "Sent duplicate PUBLISH successfully for packet id %u.\n\n",
+                       pxPublish->packetId ) );
         }
     }
 
@@ -925,7 +1206,7 @@ BaseType_t EstablishMqttSession( MQTTContext_t * pxMqttContext,
         xTransport.pNetworkContext = pxNetworkContext;
         xTransport.send = SecureSocketsTransport_Send;
         xTransport.recv = SecureSocketsTransport_Recv;
-        xTransport.writev = NULL;
+        xTransport.writev = SecureSocketsTransport_Writev;
 
         /* Initialize MQTT library. */
         eMqttStatus = MQTT_Init( pxMqttContext,
@@ -1141,6 +1422,43 @@ BaseType_t PublishToTopic( MQTTContext_t * pxMqttContext,
 {
     BaseType_t xReturnStatus = pdPASS;
     MQTTStatus_t eMqttStatus = MQTTSuccess;
+
+    xReturnStatus = PublishToTopicNoWait( pxMqttContext,
+                                          pcTopicFilter,
+                                          topicFilterLength,
+                                          pcPayload,
+                                          payloadLength );
+
+    if( xReturnStatus == pdPASS )
+    {
+        /* Calling MQTT_ProcessLoop to process incoming publish echo, since
+         * application subscribed to the same topic the broker will send
+         * publish message back to the application. This function also
+         * sends ping request to broker if MQTT_KEEP_ALIVE_INTERVAL_SECONDS
+         * has expired since the last MQTT packet sent and receive
+         * ping responses. */
+        eMqttStatus = prvProcessLoopWithTimeout( pxMqttContext, mqttexamplePROCESS_LOOP_TIMEOUT_MS );
+
+        if( eMqttStatus != MQTTSuccess )
+        {
+            LogError( ( "MQTT_ProcessLoop returned with status = %s.",
+                        MQTT_Status_strerror( eMqttStatus ) ) );
+            xReturnStatus = pdFAIL;
+        }
+    }
+
+    return xReturnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t PublishToTopicNoWait( MQTTContext_t * pxMqttContext,
+                                 const char * pcTopicFilter,
+                                 int32_t topicFilterLength,
+                                 const char * pcPayload,
+                                 size_t payloadLength )
+{
+    BaseType_t xReturnStatus = pdPASS;
     uint8_t ucPublishIndex = MAX_OUTGOING_PUBLISHES;
 
     assert( pxMqttContext != NULL );
@@ -1151,7 +1469,7 @@ BaseType_t PublishToTopic( MQTTContext_t * pxMqttContext,
      * publishes are stored until a PUBACK is received. These messages are
      * stored for supporting a resend if a network connection is broken before
      * receiving a PUBACK. */
-    xReturnStatus = prvGetNextFreeIndexForOutgoingPublishes( &ucPublishIndex );
+    xReturnStatus = prvWaitForFreeIndexForOutgoingPublishes( pxMqttContext, &ucPublishIndex );
 
     if( xReturnStatus == pdFAIL )
     {
@@ -1159,51 +1477,49 @@ BaseType_t PublishToTopic( MQTTContext_t * pxMqttContext,
     }
     else
     {
-        LogInfo( ( "the published payload:%.*s \r\n ", payloadLength, pcPayload ) );
-        /* This example publishes to only one topic and uses QOS1. */
-        outgoingPublishPackets[ ucPublishIndex ].pubInfo.qos = MQTTQoS1;
-        outgoingPublishPackets[ ucPublishIndex ].pubInfo.pTopicName = pcTopicFilter;
-        outgoingPublishPackets[ ucPublishIndex ].pubInfo.topicNameLength = topicFilterLength;
-        outgoingPublishPackets[ ucPublishIndex ].pubInfo.pPayload = pcPayload;
-        outgoingPublishPackets[ ucPublishIndex ].pubInfo.payloadLength = payloadLength;
-
-        /* Get a new packet id. */
-        outgoingPublishPackets[ ucPublishIndex ].packetId = MQTT_GetPacketId( pxMqttContext );
-
-        /* Send PUBLISH packet. */
-        eMqttStatus = MQTT_Publish( pxMqttContext,
-                                    &outgoingPublishPackets[ ucPublishIndex ].pubInfo,
-                                    outgoingPublishPackets[ ucPublishIndex ].packetId );
+        xReturnStatus = prvSendOutgoingPublishAt( pxMqttContext,
+                                                  ucPublishIndex,
+                                                  pcTopicFilter,
+                                                  topicFilterLength,
+                                                  pcPayload,
+                                                  payloadLength );
+    }
 
-        if( eMqttStatus != MQTTSuccess )
-        {
-            LogError( ( "Failed to send PUBLISH packet to broker with error = %s.",
-                        MQTT_Status_strerror( eMqttStatus ) ) );
-            vCleanupOutgoingPublishAt( ucPublishIndex );
-            xReturnStatus = pdFAIL;
-        }
-        else
-        {
-            LogInfo( ( "PUBLISH sent for topic %.*s to broker with packet ID %u.\n\n",
-                       topicFilterLength,
-                       pcTopicFilter,
-                       outgoingPublishPackets[ ucPublishIndex ].packetId ) );
-
-            /* Calling MQTT_ProcessLoop to process incoming publish echo, since
-             * application subscribed to the same topic the broker will send
-             * publish message back to the application. This function also
-             * sends ping request to broker if MQTT_KEEP_ALIVE_INTERVAL_SECONDS
-             * has expired since the last MQTT packet sent and receive
-             * ping responses. */
-            eMqttStatus = prvProcessLoopWithTimeout( pxMqttContext, mqttexamplePROCESS_LOOP_TIMEOUT_MS );
+    return xReturnStatus;
+}
 
-            if( eMqttStatus != MQTTSuccess )
-            {
-                LogError( ( "MQTT_ProcessLoop returned with status = %s.",
-                            MQTT_Status_strerror( eMqttStatus ) ) );
-                xReturnStatus = pdFAIL;
-            }
-        }
+/*-----------------------------------------------------------*/
+
+BaseType_t WaitForOutgoingPublishes( MQTTContext_t * pxMqttContext,
+                                     uint32_t ulTimeoutMs )
+{
+    BaseType_t xReturnStatus = pdFAIL;
+    MQTTStatus_t eMqttStatus = MQTTSuccess;
+    uint32_t ulMqttProcessLoopTimeoutTime;
+    uint32_t ulCurrentTime;
+
+    assert( pxMqttContext != NULL );
+
+    ulCurrentTime = pxMqttContext->getTime();
+    ulMqttProcessLoopTimeoutTime = ulCurrentTime + ulTimeoutMs;
+
+    while( ( ucOutgoingPublishCount > 0U ) &&
+           ( ulCurrentTime < ulMqttProcessLoopTimeoutTime ) &&
+           ( ( eMqttStatus == MQTTSuccess ) || ( eMqttStatus == MQTTNeedMoreBytes ) ) )
+    {
+        eMqttStatus = MQTT_ProcessLoop( pxMqttContext );
+        ulCurrentTime = pxMqttContext->getTime();
+    }
+
+    if( ucOutgoingPublishCount == 0U )
+    {
+        xReturnStatus = pdPASS;
+    }
+    else
+    {
+        LogError( ( "%u publishes still wait for a PUBACK, MQTT_ProcessLoop status = %s.",
+                    ( unsigned int ) ucOutgoingPublishCount,
+                    MQTT_Status_strerror( eMqttStatus ) ) );
     }
 
     return xReturnStatus;
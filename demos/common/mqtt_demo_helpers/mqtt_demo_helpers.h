@@ -66,6 +66,15 @@
     #define democonfigMQTT_BROKER_PORT    clientcredentialMQTT_BROKER_PORT
 #endif
 
+#ifndef democonfigMAX_OUTGOING_PUBLISHES
+
+/**
+ * @brief The number of QoS1 publishes that may wait for their PUBACK at the
+ * same time. At most 127.
+ */
+    #define democonfigMAX_OUTGOING_PUBLISHES    ( 4U )
+#endif
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -157,6 +166,43 @@ BaseType_t PublishToTopic( MQTTContext_t * pxContext,
                            const char * pcPayload,
                            size_t payloadLength );
 
+/**
+ * @brief Publish a message to a MQTT topic without processing the incoming
+ * packets for a while afterwards, so that several publishes wait for their
+ * PUBACK at the same time.
+ *
+ * Blocks only while democonfigMAX_OUTGOING_PUBLISHES publishes already wait
+ * for their PUBACK. The topic and the payload must stay unchanged until the
+ * PUBACK is received, as they are sent again if the session is resumed.
+ *
+ * @param[in] pxContext The MQTT context for the MQTT connection.
+ * @param[in] pcTopicFilter Points to the topic.
+ * @param[in] topicFilterLength The length of the topic.
+ * @param[in] pcPayload Points to the payload.
+ * @param[in] payloadLength The length of the payload.
+ *
+ * @return pdPASS if PUBLISH was successfully sent;
+ * pdFAIL otherwise.
+ */
+BaseType_t PublishToTopicNoWait( MQTTContext_t * pxContext,
+                                 const char * pcTopicFilter,
+                                 int32_t topicFilterLength,
+                                 const char * pcPayload,
+                                 size_t payloadLength );
+
+/**
+ * @brief Process the incoming packets until every publish sent received its
+ * PUBACK.
+ *
+ * @param[in] pxMqttContext The MQTT context for the MQTT connection.
+ * @param[in] ulTimeoutMs Maximum time to wait.
+ *
+ * @return pdPASS if no publish waits for its PUBACK anymore;
+ * pdFAIL otherwise.
+ */
+BaseType_t WaitForOutgoingPublishes( MQTTContext_t * pxMqttContext,
+                                     uint32_t ulTimeoutMs );
+
 /**
  * @brief Invoke the core MQTT library's process loop function.
  *
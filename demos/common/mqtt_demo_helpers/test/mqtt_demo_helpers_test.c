@@ -0,0 +1,591 @@
+/*
+ * FreeRTOS V202107.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file mqtt_demo_helpers_test.c
+ * @brief Host simulation of the QoS1 publish window of the MQTT demo helpers.
+ *
+ * The coreMQTT functions are replaced by a simulated broker on a simulated
+ * millisecond clock: sending a PUBLISH and each MQTT_ProcessLoop call take
+ * 1 ms, and the PUBACK of a publish is due 50 to 99 ms after it was sent, in
+ * any order. The broker checks that no packet identifier still waiting for
+ * its PUBACK is sent again without the DUP flag, and that no more than
+ * democonfigMAX_OUTGOING_PUBLISHES publishes wait at once.
+ *
+ * The test first sends TEST_PUBLISH_COUNT publishes with PublishToTopicNoWait,
+ * waits for them with WaitForOutgoingPublishes and prints the publish rate.
+ * It then holds the PUBACKs and reconnects: with a session present the
+ * publishes still waiting must be sent again, in order, with the DUP flag
+ * and their packet identifiers, also after part of them were acknowledged;
+ * with a clean session they must be dropped. Build and run from this
+ * directory with, for each window to measure:
+ *
+ *   for w in 1 4 15; do \
+ *       gcc -std=c99 -Wall -Wextra -g -fsanitize=address,undefined -Istubs \
+ *           -I.. -DdemoconfigMAX_OUTGOING_PUBLISHES=$w \
+ *           mqtt_demo_helpers_test.c -o mqtt_demo_helpers_test && \
+ *       ./mqtt_demo_helpers_test; done
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../mqtt_demo_helpers.c"
+
+#define TEST_PUBLISH_COUNT        2000U
+#define TEST_ACK_DELAY_MS         50U
+#define TEST_WAIT_TIMEOUT_MS      5000U
+#define TEST_MAX_PENDING_ACKS     64U
+#define TEST_MAX_SENT             64U
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+/**
+ * @brief A PUBACK the simulated broker still has to send.
+ */
+typedef struct PendingAck
+{
+    uint16_t usPacketId;
+    uint32_t ulDueMs;
+} PendingAck_t;
+
+/**
+ * @brief A PUBLISH received by the simulated broker, kept for the resend
+ * checks.
+ */
+typedef struct SentPublish
+{
+    uint16_t usPacketId;
+    bool dup;
+} SentPublish_t;
+
+static uint32_t ulFailures = 0;
+
+/* Simulated clock, in milliseconds. */
+static uint32_t ulNowMs = 0;
+
+static uint16_t usNextPacketId = 1U;
+static bool xNextSessionPresent = false;
+static bool xHoldAcks = false;
+
+/* PUBACKs on their way, and whether an identifier waits for one. */
+static PendingAck_t xPendingAcks[ TEST_MAX_PENDING_ACKS ];
+static uint32_t ulPendingAckCount = 0;
+static bool xWaitingForAck[ 65536 ];
+static uint32_t ulWaitingCount = 0;
+static uint32_t ulAcksReceived = 0;
+
+/* PUBLISHes received since the last reset of the log. */
+static SentPublish_t xSent[ TEST_MAX_SENT ];
+static uint32_t ulSentCount = 0;
+
+static MQTTContext_t xMqttContext;
+static NetworkContext_t xNetworkContext;
+static uint8_t ucBuffer[ 64 ];
+static MQTTFixedBuffer_t xBuffer = { ucBuffer, sizeof( ucBuffer ) };
+
+/*-----------------------------------------------------------*/
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+    ulNowMs += xTicksToDelay;
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+    return ulNowMs;
+}
+
+BaseType_t xPkcs11GenerateRandomNumber( uint8_t * pusRandomNumBuffer,
+                                        size_t xBufferLength )
+{
+    memset( pusRandomNumBuffer, 0x00, xBufferLength );
+    return pdPASS;
+}
+
+void BackoffAlgorithm_InitializeParams( BackoffAlgorithmContext_t * pContext,
+                                        uint16_t backOffBase,
+                                        uint16_t maxBackOff,
+                                        uint32_t maxAttempts )
+{
+    pContext->maxRetryAttempts = maxAttempts;
+    pContext->attemptsDone = 0;
+    pContext->nextJitterMax = backOffBase;
+    pContext->maxBackoffDelay = maxBackOff;
+}
+
+BackoffAlgorithmStatus_t BackoffAlgorithm_GetNextBackoff( BackoffAlgorithmContext_t * pRetryContext,
+                                                          uint32_t randomValue,
+                                                          uint16_t * pNextBackOff )
+{
+    ( void ) randomValue;
+    *pNextBackOff = pRetryContext->nextJitterMax;
+    return BackoffAlgorithmRetriesExhausted;
+}
+
+TransportSocketStatus_t SecureSocketsTransport_Connect( NetworkContext_t * pNetworkContext,
+                                                        const ServerInfo_t * pServerInfo,
+                                                        const SocketsConfig_t * pSocketsConfig )
+{
+    ( void ) pNetworkContext;
+    ( void ) pServerInfo;
+    ( void ) pSocketsConfig;
+    return TRANSPORT_SOCKET_STATUS_SUCCESS;
+}
+
+TransportSocketStatus_t SecureSocketsTransport_Disconnect( const NetworkContext_t * pNetworkContext )
+{
+    ( void ) pNetworkContext;
+    return TRANSPORT_SOCKET_STATUS_SUCCESS;
+}
+
+int32_t SecureSocketsTransport_Send( NetworkContext_t * pNetworkContext,
+                                     const void * pMessage,
+                                     size_t bytesToSend )
+{
+    ( void ) pNetworkContext;
+    ( void ) pMessage;
+    return ( int32_t ) bytesToSend;
+}
+
+int32_t SecureSocketsTransport_Recv( NetworkContext_t * pNetworkContext,
+                                     void * pBuffer,
+                                     size_t bytesToRecv )
+{
+    ( void ) pNetworkContext;
+    ( void ) pBuffer;
+    ( void ) bytesToRecv;
+    return 0;
+}
+
+int32_t SecureSocketsTransport_Writev( NetworkContext_t * pNetworkContext,
+                                       TransportOutVector_t * pIoVec,
+                                       size_t ioVecCount )
+{
+    ( void ) pNetworkContext;
+    ( void ) pIoVec;
+    ( void ) ioVecCount;
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
+                        const TransportInterface_t * pTransportInterface,
+                        MQTTGetCurrentTimeFunc_t getTimeFunction,
+                        MQTTEventCallback_t userCallback,
+                        const MQTTFixedBuffer_t * pNetworkBuffer )
+{
+    ( void ) pNetworkBuffer;
+    pContext->transportInterface = *pTransportInterface;
+    pContext->getTime = getTimeFunction;
+    pContext->appCallback = userCallback;
+    pContext->connectStatus = MQTTNotConnected;
+    return MQTTSuccess;
+}
+
+MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
+                                   MQTTPubAckInfo_t * pOutgoingPublishRecords,
+                                   size_t outgoingPublishCount,
+                                   MQTTPubAckInfo_t * pIncomingPublishRecords,
+                                   size_t incomingPublishCount )
+{
+    ( void ) pContext;
+    ( void ) pOutgoingPublishRecords;
+    ( void ) pIncomingPublishRecords;
+    TEST_CHECK( outgoingPublishCount >= MAX_OUTGOING_PUBLISHES );
+    TEST_CHECK( incomingPublishCount > 0U );
+    return MQTTSuccess;
+}
+
+MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
+                           const MQTTConnectInfo_t * pConnectInfo,
+                           const MQTTPublishInfo_t * pWillInfo,
+                           uint32_t timeoutMs,
+                           bool * pSessionPresent )
+{
+    ( void ) pConnectInfo;
+    ( void ) pWillInfo;
+    ( void ) timeoutMs;
+    pContext->connectStatus = MQTTConnected;
+    *pSessionPresent = xNextSessionPresent;
+    return MQTTSuccess;
+}
+
+MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext )
+{
+    pContext->connectStatus = MQTTNotConnected;
+    return MQTTSuccess;
+}
+
+MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
+                             const MQTTSubscribeInfo_t * pSubscriptionList,
+                             size_t subscriptionCount,
+                             uint16_t packetId )
+{
+    ( void ) pContext;
+    ( void ) pSubscriptionList;
+    ( void ) subscriptionCount;
+    ( void ) packetId;
+    return MQTTSuccess;
+}
+
+MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
+                               const MQTTSubscribeInfo_t * pSubscriptionList,
+                               size_t subscriptionCount,
+                               uint16_t packetId )
+{
+    ( void ) pContext;
+    ( void ) pSubscriptionList;
+    ( void ) subscriptionCount;
+    ( void ) packetId;
+    return MQTTSuccess;
+}
+
+uint16_t MQTT_GetPacketId( MQTTContext_t * pContext )
+{
+    uint16_t usPacketId = usNextPacketId;
+
+    ( void ) pContext;
+
+    usNextPacketId++;
+
+    if( usNextPacketId == MQTT_PACKET_ID_INVALID )
+    {
+        usNextPacketId = 1U;
+    }
+
+    return usPacketId;
+}
+
+MQTTStatus_t MQTT_GetSubAckStatusCodes( const MQTTPacketInfo_t * pSubackPacket,
+                                        uint8_t ** pPayloadStart,
+                                        size_t * pPayloadSize )
+{
+    *pPayloadStart = pSubackPacket->pRemainingData;
+    *pPayloadSize = pSubackPacket->remainingLength;
+    return MQTTSuccess;
+}
+
+const char * MQTT_Status_strerror( MQTTStatus_t status )
+{
+    ( void ) status;
+    return "status";
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
+                           const MQTTPublishInfo_t * pPublishInfo,
+                           uint16_t packetId )
+{
+    ( void ) pContext;
+
+    /* A publish waiting for its PUBACK may only be sent again as a
+     * duplicate. */
+    TEST_CHECK( ( xWaitingForAck[ packetId ] == false ) || ( pPublishInfo->dup == true ) );
+    TEST_CHECK( pPublishInfo->qos == MQTTQoS1 );
+
+    if( xWaitingForAck[ packetId ] == false )
+    {
+        xWaitingForAck[ packetId ] = true;
+        ulWaitingCount++;
+    }
+
+    TEST_CHECK( ulWaitingCount <= MAX_OUTGOING_PUBLISHES );
+
+    if( ulSentCount < TEST_MAX_SENT )
+    {
+        xSent[ ulSentCount ].usPacketId = packetId;
+        xSent[ ulSentCount ].dup = pPublishInfo->dup;
+        ulSentCount++;
+    }
+
+    if( ( xHoldAcks == false ) && ( ulPendingAckCount < TEST_MAX_PENDING_ACKS ) )
+    {
+        xPendingAcks[ ulPendingAckCount ].usPacketId = packetId;
+        xPendingAcks[ ulPendingAckCount ].ulDueMs = ulNowMs + TEST_ACK_DELAY_MS +
+                                                    ( uint32_t ) ( rand() % TEST_ACK_DELAY_MS );
+        ulPendingAckCount++;
+    }
+
+    /* Sending the packet takes 1 ms. */
+    ulNowMs++;
+
+    return MQTTSuccess;
+}
+
+MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext )
+{
+    MQTTPacketInfo_t xPacketInfo = { 0 };
+    MQTTDeserializedInfo_t xDeserializedInfo = { 0 };
+    uint32_t i = 0;
+
+    /* Receiving takes 1 ms, whether or not a packet is there. */
+    ulNowMs++;
+
+    while( i < ulPendingAckCount )
+    {
+        if( xPendingAcks[ i ].ulDueMs <= ulNowMs )
+        {
+            xPacketInfo.type = MQTT_PACKET_TYPE_PUBACK;
+            xDeserializedInfo.packetIdentifier = xPendingAcks[ i ].usPacketId;
+
+            if( xWaitingForAck[ xPendingAcks[ i ].usPacketId ] == true )
+            {
+                xWaitingForAck[ xPendingAcks[ i ].usPacketId ] = false;
+                ulWaitingCount--;
+            }
+
+            xPendingAcks[ i ] = xPendingAcks[ ulPendingAckCount - 1U ];
+            ulPendingAckCount--;
+
+            pContext->appCallback( pContext, &xPacketInfo, &xDeserializedInfo );
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return MQTTSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvEventCallback( MQTTContext_t * pxMqttContext,
+                              MQTTPacketInfo_t * pxPacketInfo,
+                              MQTTDeserializedInfo_t * pxDeserializedInfo )
+{
+    ( void ) pxMqttContext;
+
+    if( pxPacketInfo->type == MQTT_PACKET_TYPE_PUBACK )
+    {
+        ulAcksReceived++;
+    }
+
+    vHandleOtherIncomingPacket( pxPacketInfo, pxDeserializedInfo->packetIdentifier );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Drop the connection: the PUBACKs on their way are lost.
+ */
+static void prvLoseConnection( void )
+{
+    ulPendingAckCount = 0;
+    xMqttContext.connectStatus = MQTTNotConnected;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Acknowledge, after the usual delay, the publishes waiting for a
+ * PUBACK whose packet identifier is odd.
+ */
+static void prvAckOddPublishes( void )
+{
+    uint32_t i;
+
+    for( i = 0; i < 65536U; i++ )
+    {
+        if( ( xWaitingForAck[ i ] == true ) && ( ( i & 1U ) != 0U ) )
+        {
+            xPendingAcks[ ulPendingAckCount ].usPacketId = ( uint16_t ) i;
+            xPendingAcks[ ulPendingAckCount ].ulDueMs = ulNowMs + TEST_ACK_DELAY_MS;
+            ulPendingAckCount++;
+        }
+    }
+
+    ( void ) ProcessLoop( &xMqttContext, 2U * TEST_ACK_DELAY_MS );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestThroughput( void )
+{
+    uint32_t ulStartMs;
+    uint32_t ulElapsedMs;
+    uint32_t i;
+    BaseType_t xStatus = pdPASS;
+
+    xNextSessionPresent = false;
+    TEST_CHECK( EstablishMqttSession( &xMqttContext, &xNetworkContext, &xBuffer, prvEventCallback ) == pdPASS );
+
+    ulStartMs = ulNowMs;
+    ulAcksReceived = 0;
+
+    for( i = 0; ( i < TEST_PUBLISH_COUNT ) && ( xStatus == pdPASS ); i++ )
+    {
+        xStatus = PublishToTopicNoWait( &xMqttContext, "t", 1, "p", 1U );
+    }
+
+    TEST_CHECK( xStatus == pdPASS );
+    TEST_CHECK( WaitForOutgoingPublishes( &xMqttContext, TEST_WAIT_TIMEOUT_MS ) == pdPASS );
+
+    ulElapsedMs = ulNowMs - ulStartMs;
+
+    TEST_CHECK( ulAcksReceived == TEST_PUBLISH_COUNT );
+    TEST_CHECK( ucOutgoingPublishCount == 0U );
+    TEST_CHECK( ulWaitingCount == 0U );
+
+    printf( "window %2u: %6.1f publishes/s, %u ms to send and acknowledge %u publishes\n",
+            ( unsigned int ) MAX_OUTGOING_PUBLISHES,
+            ( double ) TEST_PUBLISH_COUNT * 1000.0 / ( double ) ulElapsedMs,
+            ( unsigned int ) ulElapsedMs,
+            ( unsigned int ) TEST_PUBLISH_COUNT );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestResendOnSessionPresent( void )
+{
+    uint16_t usFirstPacketId;
+    uint16_t usExpected;
+    uint32_t i;
+
+    /* Fill the window while the PUBACKs are held back. */
+    xHoldAcks = true;
+    ulSentCount = 0;
+    usFirstPacketId = usNextPacketId;
+
+    for( i = 0; i < MAX_OUTGOING_PUBLISHES; i++ )
+    {
+        TEST_CHECK( PublishToTopicNoWait( &xMqttContext, "t", 1, "p", 1U ) == pdPASS );
+    }
+
+    TEST_CHECK( ucOutgoingPublishCount == MAX_OUTGOING_PUBLISHES );
+
+    /* All of them are sent again on reconnecting to the same session. */
+    prvLoseConnection();
+    ulSentCount = 0;
+    xNextSessionPresent = true;
+    TEST_CHECK( EstablishMqttSession( &xMqttContext, &xNetworkContext, &xBuffer, prvEventCallback ) == pdPASS );
+
+    TEST_CHECK( ulSentCount == MAX_OUTGOING_PUBLISHES );
+
+    for( i = 0; i < ulSentCount; i++ )
+    {
+        TEST_CHECK( xSent[ i ].usPacketId == ( uint16_t ) ( usFirstPacketId + i ) );
+        TEST_CHECK( xSent[ i ].dup == true );
+    }
+
+    /* Once part of them are acknowledged, only the others are sent again,
+     * still oldest first. */
+    prvAckOddPublishes();
+    prvLoseConnection();
+    ulSentCount = 0;
+    TEST_CHECK( EstablishMqttSession( &xMqttContext, &xNetworkContext, &xBuffer, prvEventCallback ) == pdPASS );
+
+    TEST_CHECK( ulSentCount == ucOutgoingPublishCount );
+    usExpected = usFirstPacketId;
+
+    for( i = 0; i < ulSentCount; i++ )
+    {
+        while( ( usExpected & 1U ) != 0U )
+        {
+            usExpected++;
+        }
+
+        TEST_CHECK( xSent[ i ].usPacketId == usExpected );
+        TEST_CHECK( xSent[ i ].dup == true );
+        usExpected++;
+    }
+
+    /* New publishes go after the ones sent again, and everything is
+     * acknowledged in the end. */
+    xHoldAcks = false;
+    prvLoseConnection();
+    TEST_CHECK( EstablishMqttSession( &xMqttContext, &xNetworkContext, &xBuffer, prvEventCallback ) == pdPASS );
+
+    for( i = 0; i < MAX_OUTGOING_PUBLISHES; i++ )
+    {
+        TEST_CHECK( PublishToTopicNoWait( &xMqttContext, "t", 1, "p", 1U ) == pdPASS );
+    }
+
+    TEST_CHECK( WaitForOutgoingPublishes( &xMqttContext, TEST_WAIT_TIMEOUT_MS ) == pdPASS );
+    TEST_CHECK( ulWaitingCount == 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestCleanSessionDropsPublishes( void )
+{
+    uint32_t i;
+
+    xHoldAcks = true;
+
+    for( i = 0; i < MAX_OUTGOING_PUBLISHES; i++ )
+    {
+        TEST_CHECK( PublishToTopicNoWait( &xMqttContext, "t", 1, "p", 1U ) == pdPASS );
+    }
+
+    /* Nothing is sent again, and the whole window is free. */
+    prvLoseConnection();
+    ulSentCount = 0;
+    xNextSessionPresent = false;
+    TEST_CHECK( EstablishMqttSession( &xMqttContext, &xNetworkContext, &xBuffer, prvEventCallback ) == pdPASS );
+
+    TEST_CHECK( ulSentCount == 0U );
+    TEST_CHECK( ucOutgoingPublishCount == 0U );
+    TEST_CHECK( WaitForOutgoingPublishes( &xMqttContext, TEST_WAIT_TIMEOUT_MS ) == pdPASS );
+
+    /* The broker forgot them too. */
+    memset( xWaitingForAck, 0x00, sizeof( xWaitingForAck ) );
+    ulWaitingCount = 0;
+    xHoldAcks = false;
+
+    for( i = 0; i < MAX_OUTGOING_PUBLISHES; i++ )
+    {
+        TEST_CHECK( PublishToTopicNoWait( &xMqttContext, "t", 1, "p", 1U ) == pdPASS );
+    }
+
+    TEST_CHECK( ulSentCount == MAX_OUTGOING_PUBLISHES );
+    TEST_CHECK( WaitForOutgoingPublishes( &xMqttContext, TEST_WAIT_TIMEOUT_MS ) == pdPASS );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    srand( 1 );
+
+    prvTestThroughput();
+    prvTestResendOnSessionPresent();
+    prvTestCleanSessionDropsPublishes();
+
+    printf( "%s: %u failures\n", ( ulFailures == 0U ) ? "PASS" : "FAIL", ( unsigned int ) ulFailures );
+
+    return ( ulFailures == 0U ) ? 0 : 1;
+}
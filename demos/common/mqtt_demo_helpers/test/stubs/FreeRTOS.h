@@ -0,0 +1,29 @@
+/*
+ * Host build stand-in for FreeRTOS.h, used by the MQTT demo helpers tests.
+ *
+ * Only what mqtt_demo_helpers.c uses is provided. Time is simulated: the
+ * tick count is a millisecond clock the test moves; see task.h.
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long             BaseType_t;
+typedef unsigned long    UBaseType_t;
+typedef uint32_t         TickType_t;
+
+#define pdFALSE                       ( ( BaseType_t ) 0 )
+#define pdTRUE                        ( ( BaseType_t ) 1 )
+#define pdFAIL                        ( pdFALSE )
+#define pdPASS                        ( pdTRUE )
+
+#define configTICK_RATE_HZ            ( ( TickType_t ) 1000 )
+#define pdMS_TO_TICKS( xTimeInMs )    ( ( TickType_t ) ( xTimeInMs ) )
+
+#define configASSERT( x )    assert( x )
+
+#endif /* INC_FREERTOS_H */
@@ -0,0 +1,13 @@
+/*
+ * Host build stand-in for aws_clientcredential.h, used by the MQTT demo
+ * helpers tests.
+ */
+
+#ifndef AWS_CLIENT_CREDENTIAL_H
+#define AWS_CLIENT_CREDENTIAL_H
+
+#define clientcredentialMQTT_BROKER_ENDPOINT    "broker.test"
+#define clientcredentialIOT_THING_NAME          "thing"
+#define clientcredentialMQTT_BROKER_PORT        8883
+
+#endif /* AWS_CLIENT_CREDENTIAL_H */
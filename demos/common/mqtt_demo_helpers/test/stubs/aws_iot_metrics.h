@@ -0,0 +1,12 @@
+/*
+ * Host build stand-in for aws_iot_metrics.h, used by the MQTT demo helpers
+ * tests.
+ */
+
+#ifndef AWS_IOT_METRICS_H_
+#define AWS_IOT_METRICS_H_
+
+#define AWS_IOT_METRICS_STRING           "?SDK=FreeRTOS"
+#define AWS_IOT_METRICS_STRING_LENGTH    ( ( uint16_t ) ( sizeof( AWS_IOT_METRICS_STRING ) - 1 ) )
+
+#endif /* AWS_IOT_METRICS_H_ */
@@ -0,0 +1,34 @@
+/*
+ * Host build stand-in for backoff_algorithm.h, used by the MQTT demo helpers
+ * tests. The test defines the functions; no retry is ever needed.
+ */
+
+#ifndef BACKOFF_ALGORITHM_H_
+#define BACKOFF_ALGORITHM_H_
+
+#include <stdint.h>
+
+typedef enum BackoffAlgorithmStatus
+{
+    BackoffAlgorithmSuccess = 0,
+    BackoffAlgorithmRetriesExhausted
+} BackoffAlgorithmStatus_t;
+
+typedef struct BackoffAlgorithmContext
+{
+    uint32_t maxRetryAttempts;
+    uint32_t attemptsDone;
+    uint16_t nextJitterMax;
+    uint16_t maxBackoffDelay;
+} BackoffAlgorithmContext_t;
+
+void BackoffAlgorithm_InitializeParams( BackoffAlgorithmContext_t * pContext,
+                                        uint16_t backOffBase,
+                                        uint16_t maxBackOff,
+                                        uint32_t maxAttempts );
+
+BackoffAlgorithmStatus_t BackoffAlgorithm_GetNextBackoff( BackoffAlgorithmContext_t * pRetryContext,
+                                                          uint32_t randomValue,
+                                                          uint16_t * pNextBackOff );
+
+#endif /* BACKOFF_ALGORITHM_H_ */
@@ -0,0 +1,209 @@
+/*
+ * Host build stand-in for core_mqtt.h, used by the MQTT demo helpers tests.
+ *
+ * Only the types and functions mqtt_demo_helpers.c uses are provided, with
+ * the fields it reads. The test defines the functions as a simulated broker.
+ */
+
+#ifndef CORE_MQTT_H
+#define CORE_MQTT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging_stack.h"
+
+#define MQTT_PACKET_ID_INVALID       ( ( uint16_t ) 0U )
+
+#define MQTT_PACKET_TYPE_PUBLISH     ( ( uint8_t ) 0x30U )
+#define MQTT_PACKET_TYPE_PUBACK      ( ( uint8_t ) 0x40U )
+#define MQTT_PACKET_TYPE_SUBACK      ( ( uint8_t ) 0x90U )
+#define MQTT_PACKET_TYPE_UNSUBACK    ( ( uint8_t ) 0xB0U )
+#define MQTT_PACKET_TYPE_PINGRESP    ( ( uint8_t ) 0xD0U )
+
+typedef enum MQTTStatus
+{
+    MQTTSuccess = 0,
+    MQTTBadParameter,
+    MQTTNoMemory,
+    MQTTSendFailed,
+    MQTTRecvFailed,
+    MQTTBadResponse,
+    MQTTServerRefused,
+    MQTTNoDataAvailable,
+    MQTTIllegalState,
+    MQTTStateCollision,
+    MQTTKeepAliveTimeout,
+    MQTTNeedMoreBytes
+} MQTTStatus_t;
+
+typedef enum MQTTQoS
+{
+    MQTTQoS0 = 0,
+    MQTTQoS1 = 1,
+    MQTTQoS2 = 2
+} MQTTQoS_t;
+
+typedef enum MQTTSubAckStatus
+{
+    MQTTSubAckSuccessQos0 = 0x00,
+    MQTTSubAckSuccessQos1 = 0x01,
+    MQTTSubAckSuccessQos2 = 0x02,
+    MQTTSubAckFailure = 0x80
+} MQTTSubAckStatus_t;
+
+typedef enum MQTTConnectionStatus
+{
+    MQTTNotConnected,
+    MQTTConnected
+} MQTTConnectionStatus_t;
+
+typedef struct MQTTPublishInfo
+{
+    MQTTQoS_t qos;
+    bool retain;
+    bool dup;
+    const char * pTopicName;
+    uint16_t topicNameLength;
+    const void * pPayload;
+    size_t payloadLength;
+} MQTTPublishInfo_t;
+
+typedef struct MQTTSubscribeInfo
+{
+    MQTTQoS_t qos;
+    const char * pTopicFilter;
+    uint16_t topicFilterLength;
+} MQTTSubscribeInfo_t;
+
+typedef struct MQTTConnectInfo
+{
+    bool cleanSession;
+    uint16_t keepAliveSeconds;
+    const char * pClientIdentifier;
+    uint16_t clientIdentifierLength;
+    const char * pUserName;
+    uint16_t userNameLength;
+    const char * pPassword;
+    uint16_t passwordLength;
+} MQTTConnectInfo_t;
+
+typedef struct MQTTPacketInfo
+{
+    uint8_t type;
+    uint8_t * pRemainingData;
+    size_t remainingLength;
+} MQTTPacketInfo_t;
+
+typedef struct MQTTDeserializedInfo
+{
+    uint16_t packetIdentifier;
+    MQTTPublishInfo_t * pPublishInfo;
+    MQTTStatus_t deserializationResult;
+} MQTTDeserializedInfo_t;
+
+typedef struct MQTTPubAckInfo
+{
+    uint16_t packetId;
+    MQTTQoS_t qos;
+    uint8_t publishState;
+} MQTTPubAckInfo_t;
+
+typedef struct MQTTFixedBuffer
+{
+    uint8_t * pBuffer;
+    size_t size;
+} MQTTFixedBuffer_t;
+
+typedef struct NetworkContext NetworkContext_t;
+
+typedef int32_t ( * TransportRecv_t )( NetworkContext_t * pNetworkContext,
+                                       void * pBuffer,
+                                       size_t bytesToRecv );
+
+typedef int32_t ( * TransportSend_t )( NetworkContext_t * pNetworkContext,
+                                       const void * pBuffer,
+                                       size_t bytesToSend );
+
+typedef struct TransportOutVector
+{
+    const void * iov_base;
+    size_t iov_len;
+} TransportOutVector_t;
+
+typedef int32_t ( * TransportWritev_t )( NetworkContext_t * pNetworkContext,
+                                         TransportOutVector_t * pIoVec,
+                                         size_t ioVecCount );
+
+typedef struct TransportInterface
+{
+    TransportRecv_t recv;
+    TransportSend_t send;
+    TransportWritev_t writev;
+    NetworkContext_t * pNetworkContext;
+} TransportInterface_t;
+
+typedef uint32_t ( * MQTTGetCurrentTimeFunc_t )( void );
+
+struct MQTTContext;
+
+typedef void ( * MQTTEventCallback_t )( struct MQTTContext * pContext,
+                                        MQTTPacketInfo_t * pPacketInfo,
+                                        MQTTDeserializedInfo_t * pDeserializedInfo );
+
+typedef struct MQTTContext
+{
+    TransportInterface_t transportInterface;
+    MQTTGetCurrentTimeFunc_t getTime;
+    MQTTEventCallback_t appCallback;
+    MQTTConnectionStatus_t connectStatus;
+} MQTTContext_t;
+
+MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
+                        const TransportInterface_t * pTransportInterface,
+                        MQTTGetCurrentTimeFunc_t getTimeFunction,
+                        MQTTEventCallback_t userCallback,
+                        const MQTTFixedBuffer_t * pNetworkBuffer );
+
+MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
+                                   MQTTPubAckInfo_t * pOutgoingPublishRecords,
+                                   size_t outgoingPublishCount,
+                                   MQTTPubAckInfo_t * pIncomingPublishRecords,
+                                   size_t incomingPublishCount );
+
+MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
+                           const MQTTConnectInfo_t * pConnectInfo,
+                           const MQTTPublishInfo_t * pWillInfo,
+                           uint32_t timeoutMs,
+                           bool * pSessionPresent );
+
+MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext );
+
+MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
+                             const MQTTSubscribeInfo_t * pSubscriptionList,
+                             size_t subscriptionCount,
+                             uint16_t packetId );
+
+MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
+                               const MQTTSubscribeInfo_t * pSubscriptionList,
+                               size_t subscriptionCount,
+                               uint16_t packetId );
+
+MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
+                           const MQTTPublishInfo_t * pPublishInfo,
+                           uint16_t packetId );
+
+MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext );
+
+uint16_t MQTT_GetPacketId( MQTTContext_t * pContext );
+
+MQTTStatus_t MQTT_GetSubAckStatusCodes( const MQTTPacketInfo_t * pSubackPacket,
+                                        uint8_t ** pPayloadStart,
+                                        size_t * pPayloadSize );
+
+const char * MQTT_Status_strerror( MQTTStatus_t status );
+
+#endif /* CORE_MQTT_H */
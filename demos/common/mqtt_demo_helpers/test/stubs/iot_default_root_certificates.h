@@ -0,0 +1,4 @@
+/*
+ * Host build stand-in for iot_default_root_certificates.h, used by the MQTT
+ * demo helpers tests. Nothing of it is used.
+ */
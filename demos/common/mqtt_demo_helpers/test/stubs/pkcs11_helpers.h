@@ -0,0 +1,17 @@
+/*
+ * Host build stand-in for pkcs11_helpers.h, used by the MQTT demo helpers
+ * tests. The test defines the function.
+ */
+
+#ifndef PKCS11_HELPERS_H_
+#define PKCS11_HELPERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+BaseType_t xPkcs11GenerateRandomNumber( uint8_t * pusRandomNumBuffer,
+                                        size_t xBufferLength );
+
+#endif /* PKCS11_HELPERS_H_ */
@@ -0,0 +1,18 @@
+/*
+ * Host build stand-in for task.h, used by the MQTT demo helpers tests.
+ *
+ * The test defines both functions over its simulated clock.
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include task.h"
+#endif
+
+void vTaskDelay( const TickType_t xTicksToDelay );
+
+TickType_t xTaskGetTickCount( void );
+
+#endif /* INC_TASK_H */
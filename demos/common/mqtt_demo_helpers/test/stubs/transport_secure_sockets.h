@@ -0,0 +1,64 @@
+/*
+ * Host build stand-in for transport_secure_sockets.h, used by the MQTT demo
+ * helpers tests. The test defines the functions; connecting always succeeds.
+ */
+
+#ifndef TRANSPORT_SECURE_SOCKETS_H
+#define TRANSPORT_SECURE_SOCKETS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core_mqtt.h"
+
+#define socketsAWS_IOT_ALPN_MQTT    "x-amzn-mqtt-ca"
+
+typedef enum TransportSocketStatus
+{
+    TRANSPORT_SOCKET_STATUS_SUCCESS = 0,
+    TRANSPORT_SOCKET_STATUS_INVALID_PARAMETER,
+    TRANSPORT_SOCKET_STATUS_CONNECT_FAILURE
+} TransportSocketStatus_t;
+
+typedef struct ServerInfo
+{
+    const char * pHostName;
+    size_t hostNameLength;
+    uint16_t port;
+} ServerInfo_t;
+
+typedef struct SocketsConfig
+{
+    bool enableTls;
+    const char * pAlpnProtos;
+    size_t maxFragmentLength;
+    bool disableSni;
+    uint32_t sendTimeoutMs;
+    uint32_t recvTimeoutMs;
+} SocketsConfig_t;
+
+typedef struct SecureSocketsTransportParams
+{
+    int tcpSocket;
+} SecureSocketsTransportParams_t;
+
+TransportSocketStatus_t SecureSocketsTransport_Connect( NetworkContext_t * pNetworkContext,
+                                                        const ServerInfo_t * pServerInfo,
+                                                        const SocketsConfig_t * pSocketsConfig );
+
+TransportSocketStatus_t SecureSocketsTransport_Disconnect( const NetworkContext_t * pNetworkContext );
+
+int32_t SecureSocketsTransport_Send( NetworkContext_t * pNetworkContext,
+                                     const void * pMessage,
+                                     size_t bytesToSend );
+
+int32_t SecureSocketsTransport_Recv( NetworkContext_t * pNetworkContext,
+                                     void * pBuffer,
+                                     size_t bytesToRecv );
+
+int32_t SecureSocketsTransport_Writev( NetworkContext_t * pNetworkContext,
+                                       TransportOutVector_t * pIoVec,
+                                       size_t ioVecCount );
+
+#endif /* TRANSPORT_SECURE_SOCKETS_H */
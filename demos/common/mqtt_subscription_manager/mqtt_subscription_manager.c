@@ -36,14 +36,276 @@
 #include "mqtt_subscription_manager.h"
 
 
-bool SubscriptionManager_AddSubscription( SubscriptionElement_t * pxSubscriptionList,
+/**
+ * @brief Link to no element.
+ */
+#define NO_LINK                      ( 0U )
+
+/**
+ * @brief Element of a list given its link.
+ */
+#define ELEMENT( pxList, usLink )    ( &( ( pxList )->xElements[ ( usLink ) - 1U ] ) )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Hash a topic, or a topic filter without wildcards.
+ *
+ * @param[in] pcTopic The topic.
+ * @param[in] usTopicLength Length of the topic.
+ *
+ * @return The hash.
+ */
+static uint32_t prvHashTopic( const char * pcTopic,
+                              uint16_t usTopicLength );
+
+/**
+ * @brief Record the levels of a topic filter in its element.
+ *
+ * @param[in] pxElement The element, with its topic filter set.
+ *
+ * @return `false` if the filter has wildcards and too many levels, or a "#"
+ * that is not its last level.
+ */
+static bool prvCompileFilter( SubscriptionElement_t * pxElement );
+
+/**
+ * @brief Find the offsets of the levels of the topic of a publish.
+ *
+ * @param[in] pxPublishInfo Info of incoming publish.
+ * @param[out] pusLevelStarts Receives the offsets of up to
+ * SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS + 1 levels.
+ *
+ * @return The number of levels of the topic.
+ */
+static uint32_t prvSplitTopic( const MQTTPublishInfo_t * pxPublishInfo,
+                               uint16_t * pusLevelStarts );
+
+/**
+ * @brief Match the topic of a publish against a topic filter with wildcards.
+ *
+ * @param[in] pxElement The element of the filter.
+ * @param[in] pxPublishInfo Info of incoming publish.
+ * @param[in] pusLevelStarts The offsets of the levels of the topic.
+ * @param[in] ulLevelCount The number of levels of the topic.
+ *
+ * @return `true` if the topic matches the filter.
+ */
+static bool prvMatchWildcardFilter( const SubscriptionElement_t * pxElement,
+                                    const MQTTPublishInfo_t * pxPublishInfo,
+                                    const uint16_t * pusLevelStarts,
+                                    uint32_t ulLevelCount );
+
+/**
+ * @brief Get the list an element with a compiled filter belongs to: the bucket
+ * of its hash, or the list of the filters with wildcards.
+ *
+ * @param[in] pxSubscriptionList The subscription list.
+ * @param[in] pxElement The element.
+ *
+ * @return The head of the list.
+ */
+static uint16_t * prvGetListHead( SubscriptionList_t * pxSubscriptionList,
+                                  const SubscriptionElement_t * pxElement );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvHashTopic( const char * pcTopic,
+                              uint16_t usTopicLength )
+{
+    /* FNV-1a. */
+    uint32_t ulHash = 2166136261UL;
+    uint16_t usIndex = 0U;
+
+    for( usIndex = 0U; usIndex < usTopicLength; usIndex++ )
+    {
+        ulHash = ( ulHash ^ ( uint8_t ) pcTopic[ usIndex ] ) * 16777619UL;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvCompileFilter( SubscriptionElement_t * pxElement )
+{
+    const char * pcFilter = pxElement->pcSubscriptionFilterString;
+    uint16_t usLength = pxElement->usFilterStringLength;
+    uint16_t usStart = 0U, usEnd = 0U;
+    uint32_t ulLevels = 0U;
+    bool xWildcard = false, xValid = true, xLastLevel = false;
+
+    pxElement->ucLevelCount = 0U;
+    pxElement->xMultiLevel = false;
+
+    while( xLastLevel == false )
+    {
+        usEnd = usStart;
+
+        while( ( usEnd < usLength ) && ( pcFilter[ usEnd ] != '/' ) )
+        {
+            usEnd++;
+        }
+
+        xLastLevel = ( usEnd == usLength );
+
+        if( ulLevels < SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS )
+        {
+            pxElement->usLevelStarts[ ulLevels ] = usStart;
+        }
+
+        if( ( usEnd - usStart ) == 1U )
+        {
+            if( pcFilter[ usStart ] == '+' )
+            {
+                xWildcard = true;
+            }
+            else if( pcFilter[ usStart ] == '#' )
+            {
+                xWildcard = true;
+                pxElement->xMultiLevel = true;
+                xValid = ( xValid == true ) && ( xLastLevel == true );
+            }
+            else
+            {
+                /* Not a wildcard. */
+            }
+        }
+
+        ulLevels++;
+        usStart = ( uint16_t ) ( usEnd + 1U );
+    }
+
+    if( xWildcard == true )
+    {
+        if( ulLevels <= SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS )
+        {
+            pxElement->ucLevelCount = ( uint8_t ) ulLevels;
+        }
+        else
+        {
+            xValid = false;
+        }
+    }
+    else
+    {
+        pxElement->ulFilterHash = prvHashTopic( pcFilter, usLength );
+    }
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvSplitTopic( const MQTTPublishInfo_t * pxPublishInfo,
+                               uint16_t * pusLevelStarts )
+{
+    uint16_t usIndex = 0U;
+    uint32_t ulLevels = 1U;
+
+    pusLevelStarts[ 0 ] = 0U;
+
+    for( usIndex = 0U; usIndex < pxPublishInfo->topicNameLength; usIndex++ )
+    {
+        if( pxPublishInfo->pTopicName[ usIndex ] == '/' )
+        {
+            /* The levels past those of the longest filter are only counted. */
+            if( ulLevels <= SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS )
+            {
+                pusLevelStarts[ ulLevels ] = ( uint16_t ) ( usIndex + 1U );
+            }
+
+            ulLevels++;
+        }
+    }
+
+    return ulLevels;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvMatchWildcardFilter( const SubscriptionElement_t * pxElement,
+                                    const MQTTPublishInfo_t * pxPublishInfo,
+                                    const uint16_t * pusLevelStarts,
+                                    uint32_t ulLevelCount )
+{
+    const char * pcFilter = pxElement->pcSubscriptionFilterString;
+    uint32_t ulLevel = 0U, ulLevelsToCompare = pxElement->ucLevelCount;
+    uint16_t usFilterStart = 0U, usFilterLength = 0U;
+    uint16_t usTopicStart = 0U, usTopicLength = 0U;
+    bool isMatched = false;
+
+    /* A "#" level also matches the parent level on its own. */
+    if( pxElement->xMultiLevel == true )
+    {
+        ulLevelsToCompare--;
+        isMatched = ( ulLevelCount >= ulLevelsToCompare );
+    }
+    else
+    {
+        isMatched = ( ulLevelCount == ulLevelsToCompare );
+    }
+
+    /* Filters starting with a wildcard do not match topics starting with '$'. */
+    if( ( isMatched == true ) &&
+        ( pxPublishInfo->topicNameLength > 0U ) &&
+        ( pxPublishInfo->pTopicName[ 0 ] == '$' ) &&
+        ( ( pcFilter[ 0 ] == '+' ) || ( pcFilter[ 0 ] == '#' ) ) )
+    {
+        isMatched = false;
+    }
+
+    for( ulLevel = 0U; ( isMatched == true ) && ( ulLevel < ulLevelsToCompare ); ulLevel++ )
+    {
+        usFilterStart = pxElement->usLevelStarts[ ulLevel ];
+        usFilterLength = ( ( ulLevel + 1U ) < pxElement->ucLevelCount ) ?
+                         ( uint16_t ) ( pxElement->usLevelStarts[ ulLevel + 1U ] - usFilterStart - 1U ) :
+                         ( uint16_t ) ( pxElement->usFilterStringLength - usFilterStart );
+
+        if( ( usFilterLength != 1U ) || ( pcFilter[ usFilterStart ] != '+' ) )
+        {
+            usTopicStart = pusLevelStarts[ ulLevel ];
+            usTopicLength = ( ( ulLevel + 1U ) < ulLevelCount ) ?
+                            ( uint16_t ) ( pusLevelStarts[ ulLevel + 1U ] - usTopicStart - 1U ) :
+                            ( uint16_t ) ( pxPublishInfo->topicNameLength - usTopicStart );
+
+            isMatched = ( usFilterLength == usTopicLength ) &&
+                        ( memcmp( &( pcFilter[ usFilterStart ] ),
+                                  &( pxPublishInfo->pTopicName[ usTopicStart ] ),
+                                  usFilterLength ) == 0 );
+        }
+    }
+
+    return isMatched;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t * prvGetListHead( SubscriptionList_t * pxSubscriptionList,
+                                  const SubscriptionElement_t * pxElement )
+{
+    uint16_t * pusHead = &( pxSubscriptionList->usWildcardElements );
+
+    if( pxElement->ucLevelCount == 0U )
+    {
+        pusHead = &( pxSubscriptionList->usExactBuckets[ pxElement->ulFilterHash % SUBSCRIPTION_MANAGER_EXACT_BUCKETS ] );
+    }
+
+    return pusHead;
+}
+
+/*-----------------------------------------------------------*/
+
+bool SubscriptionManager_AddSubscription( SubscriptionList_t * pxSubscriptionList,
                                           const char * pcTopicFilterString,
                                           uint16_t usTopicFilterLength,
                                           IncomingPubCallback_t pxIncomingPublishCallback,
                                           void * pvIncomingPublishCallbackContext )
 {
-    int32_t lIndex = 0;
-    size_t xAvailableIndex = SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS;
+    SubscriptionElement_t xCompiled = { 0 };
+    SubscriptionElement_t * pxElement = NULL;
+    uint16_t * pusHead = NULL;
+    uint16_t usElement = NO_LINK, usAvailable = NO_LINK;
     bool xReturnStatus = false;
 
     if( ( pxSubscriptionList == NULL ) ||
@@ -60,36 +322,54 @@ bool SubscriptionManager_AddSubscription( SubscriptionElement_t * pxSubscription
     }
     else
     {
-        /* Start at end of array, so that we will insert at the first available index.
-         * Scans backwards to find duplicates. */
-        for( lIndex = ( int32_t ) SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS - 1; lIndex >= 0; lIndex-- )
+        xCompiled.pcSubscriptionFilterString = pcTopicFilterString;
+        xCompiled.usFilterStringLength = usTopicFilterLength;
+        xCompiled.pxIncomingPublishCallback = pxIncomingPublishCallback;
+        xCompiled.pvIncomingPublishCallbackContext = pvIncomingPublishCallbackContext;
+
+        if( prvCompileFilter( &xCompiled ) == false )
         {
-            if( pxSubscriptionList[ lIndex ].usFilterStringLength == 0 )
-            {
-                xAvailableIndex = lIndex;
-            }
-            else if( ( pxSubscriptionList[ lIndex ].usFilterStringLength == usTopicFilterLength ) &&
-                     ( strncmp( pcTopicFilterString, pxSubscriptionList[ lIndex ].pcSubscriptionFilterString, ( size_t ) usTopicFilterLength ) == 0 ) )
+            LogError( ( "Cannot compile topic filter %.*s.",
+                        ( int ) usTopicFilterLength,
+                        pcTopicFilterString ) );
+        }
+        else
+        {
+            /* Only the elements of the same list can be duplicates. */
+            pusHead = prvGetListHead( pxSubscriptionList, &xCompiled );
+
+            for( usElement = *pusHead; usElement != NO_LINK; usElement = pxElement->usNextElement )
             {
+                pxElement = ELEMENT( pxSubscriptionList, usElement );
+
                 /* If a subscription already exists, don't do anything. */
-                if( ( pxSubscriptionList[ lIndex ].pxIncomingPublishCallback == pxIncomingPublishCallback ) &&
-                    ( pxSubscriptionList[ lIndex ].pvIncomingPublishCallbackContext == pvIncomingPublishCallbackContext ) )
+                if( ( pxElement->usFilterStringLength == usTopicFilterLength ) &&
+                    ( strncmp( pcTopicFilterString, pxElement->pcSubscriptionFilterString, ( size_t ) usTopicFilterLength ) == 0 ) &&
+                    ( pxElement->pxIncomingPublishCallback == pxIncomingPublishCallback ) &&
+                    ( pxElement->pvIncomingPublishCallbackContext == pvIncomingPublishCallbackContext ) )
                 {
                     LogWarn( ( "Subscription already exists.\n" ) );
-                    xAvailableIndex = SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS;
                     xReturnStatus = true;
                     break;
                 }
             }
-        }
 
-        if( xAvailableIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
-        {
-            pxSubscriptionList[ xAvailableIndex ].pcSubscriptionFilterString = pcTopicFilterString;
-            pxSubscriptionList[ xAvailableIndex ].usFilterStringLength = usTopicFilterLength;
-            pxSubscriptionList[ xAvailableIndex ].pxIncomingPublishCallback = pxIncomingPublishCallback;
-            pxSubscriptionList[ xAvailableIndex ].pvIncomingPublishCallbackContext = pvIncomingPublishCallbackContext;
-            xReturnStatus = true;
+            for( usElement = 1U; ( xReturnStatus == false ) && ( usElement <= SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ); usElement++ )
+            {
+                if( ELEMENT( pxSubscriptionList, usElement )->usFilterStringLength == 0U )
+                {
+                    usAvailable = usElement;
+                    break;
+                }
+            }
+
+            if( usAvailable != NO_LINK )
+            {
+                xCompiled.usNextElement = *pusHead;
+                *ELEMENT( pxSubscriptionList, usAvailable ) = xCompiled;
+                *pusHead = usAvailable;
+                xReturnStatus = true;
+            }
         }
     }
 
@@ -98,11 +378,13 @@ bool SubscriptionManager_AddSubscription( SubscriptionElement_t * pxSubscription
 
 /*-----------------------------------------------------------*/
 
-void SubscriptionManager_RemoveSubscription( SubscriptionElement_t * pxSubscriptionList,
+void SubscriptionManager_RemoveSubscription( SubscriptionList_t * pxSubscriptionList,
                                              const char * pcTopicFilterString,
                                              uint16_t usTopicFilterLength )
 {
-    int32_t lIndex = 0;
+    SubscriptionElement_t xCompiled = { 0 };
+    SubscriptionElement_t * pxElement = NULL;
+    uint16_t * pusLink = NULL;
 
     if( ( pxSubscriptionList == NULL ) ||
         ( pcTopicFilterString == NULL ) ||
@@ -116,14 +398,25 @@ void SubscriptionManager_RemoveSubscription( SubscriptionElement_t * pxSubscript
     }
     else
     {
-        for( lIndex = 0; lIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; lIndex++ )
+        xCompiled.pcSubscriptionFilterString = pcTopicFilterString;
+        xCompiled.usFilterStringLength = usTopicFilterLength;
+        ( void ) prvCompileFilter( &xCompiled );
+
+        pusLink = prvGetListHead( pxSubscriptionList, &xCompiled );
+
+        while( *pusLink != NO_LINK )
         {
-            if( pxSubscriptionList[ lIndex ].usFilterStringLength == usTopicFilterLength )
+            pxElement = ELEMENT( pxSubscriptionList, *pusLink );
+
+            if( ( pxElement->usFilterStringLength == usTopicFilterLength ) &&
+                ( strncmp( pxElement->pcSubscriptionFilterString, pcTopicFilterString, usTopicFilterLength ) == 0 ) )
             {
-                if( strncmp( pxSubscriptionList[ lIndex ].pcSubscriptionFilterString, pcTopicFilterString, usTopicFilterLength ) == 0 )
-                {
-                    memset( &( pxSubscriptionList[ lIndex ] ), 0x00, sizeof( SubscriptionElement_t ) );
-                }
+                *pusLink = pxElement->usNextElement;
+                memset( pxElement, 0x00, sizeof( SubscriptionElement_t ) );
+            }
+            else
+            {
+                pusLink = &( pxElement->usNextElement );
             }
         }
     }
@@ -131,11 +424,14 @@ void SubscriptionManager_RemoveSubscription( SubscriptionElement_t * pxSubscript
 
 /*-----------------------------------------------------------*/
 
-bool SubscriptionManager_HandleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
+bool SubscriptionManager_HandleIncomingPublishes( SubscriptionList_t * pxSubscriptionList,
                                                   MQTTPublishInfo_t * pxPublishInfo )
 {
-    int32_t lIndex = 0;
-    bool isMatched = false, publishHandled = false;
+    const SubscriptionElement_t * pxElement = NULL;
+    uint16_t usLevelStarts[ SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS + 1U ];
+    uint16_t usElement = NO_LINK;
+    uint32_t ulHash = 0U, ulLevelCount = 0U;
+    bool publishHandled = false;
 
     if( ( pxSubscriptionList == NULL ) ||
         ( pxPublishInfo == NULL ) )
@@ -146,23 +442,45 @@ bool SubscriptionManager_HandleIncomingPublishes( SubscriptionElement_t * pxSubs
     }
     else
     {
-        for( lIndex = 0; lIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; lIndex++ )
+        /* The filters without wildcards equal to the topic. */
+        ulHash = prvHashTopic( pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+        usElement = pxSubscriptionList->usExactBuckets[ ulHash % SUBSCRIPTION_MANAGER_EXACT_BUCKETS ];
+
+        while( usElement != NO_LINK )
         {
-            if( pxSubscriptionList[ lIndex ].usFilterStringLength > 0 )
+            pxElement = ELEMENT( pxSubscriptionList, usElement );
+            usElement = pxElement->usNextElement;
+
+            if( ( pxElement->ulFilterHash == ulHash ) &&
+                ( pxElement->usFilterStringLength == pxPublishInfo->topicNameLength ) &&
+                ( memcmp( pxElement->pcSubscriptionFilterString, pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength ) == 0 ) )
             {
-                MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                 pxPublishInfo->topicNameLength,
-                                 pxSubscriptionList[ lIndex ].pcSubscriptionFilterString,
-                                 pxSubscriptionList[ lIndex ].usFilterStringLength,
-                                 &isMatched );
+                pxElement->pxIncomingPublishCallback( pxElement->pvIncomingPublishCallbackContext,
+                                                      pxPublishInfo );
 
-                if( isMatched == true )
-                {
-                    pxSubscriptionList[ lIndex ].pxIncomingPublishCallback( pxSubscriptionList[ lIndex ].pvIncomingPublishCallbackContext,
-                                                                            pxPublishInfo );
+                publishHandled = true;
+            }
+        }
 
-                    publishHandled = true;
-                }
+        /* Then the filters with wildcards, against the levels of the topic. */
+        usElement = pxSubscriptionList->usWildcardElements;
+
+        if( usElement != NO_LINK )
+        {
+            ulLevelCount = prvSplitTopic( pxPublishInfo, usLevelStarts );
+        }
+
+        while( usElement != NO_LINK )
+        {
+            pxElement = ELEMENT( pxSubscriptionList, usElement );
+            usElement = pxElement->usNextElement;
+
+            if( prvMatchWildcardFilter( pxElement, pxPublishInfo, usLevelStarts, ulLevelCount ) == true )
+            {
+                pxElement->pxIncomingPublishCallback( pxElement->pvIncomingPublishCallbackContext,
+                                                      pxPublishInfo );
+
+                publishHandled = true;
             }
         }
     }
@@ -65,6 +65,20 @@
     #define SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS    10U
 #endif
 
+/**
+ * @brief Number of hash buckets for the topic filters without wildcards.
+ */
+#ifndef SUBSCRIPTION_MANAGER_EXACT_BUCKETS
+    #define SUBSCRIPTION_MANAGER_EXACT_BUCKETS    SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS
+#endif
+
+/**
+ * @brief Maximum number of levels in a topic filter with wildcards.
+ */
+#ifndef SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS
+    #define SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS    8U
+#endif
+
 /**
  * @brief Callback function called when receiving a publish.
  *
@@ -77,8 +91,10 @@ typedef void (* IncomingPubCallback_t )( void * pvIncomingPublishCallbackContext
 /**
  * @brief An element in the list of subscriptions.
  *
- * This subscription manager implementation expects that the array of the
- * subscription elements used for storing subscriptions to be initialized to 0.
+ * The topic filter is compiled when the subscription is added: a filter
+ * without wildcards is hashed whole, and the offsets of the levels of a filter
+ * with wildcards are recorded, so that neither is parsed again for each
+ * incoming publish.
  *
  * @note This implementation allows multiple tasks to subscribe to the same topic.
  * In this case, another element is added to the subscription list, differing
@@ -92,8 +108,30 @@ typedef struct subscriptionElement
     void * pvIncomingPublishCallbackContext;
     uint16_t usFilterStringLength;
     const char * pcSubscriptionFilterString;
+    uint32_t ulFilterHash;                                           /* Hash of a filter without wildcards. */
+    uint16_t usNextElement;                                          /* Next element in the same bucket, or with wildcards. */
+    uint16_t usLevelStarts[ SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS ]; /* Offsets of the levels of a filter with wildcards. */
+    uint8_t ucLevelCount;                                            /* Number of levels of a filter with wildcards, 0 without. */
+    bool xMultiLevel;                                                /* Whether the last level is "#". */
 } SubscriptionElement_t;
 
+/**
+ * @brief A list of subscriptions.
+ *
+ * The subscriptions whose filter has no wildcard are found through a hash of
+ * the topic of the incoming publish, computed once; only those with wildcards
+ * are matched one by one. Links between elements hold the index of the
+ * element plus one, so that a list initialized to 0 is an empty list; this
+ * subscription manager implementation expects the list to be initialized
+ * to 0.
+ */
+typedef struct subscriptionList
+{
+    SubscriptionElement_t xElements[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
+    uint16_t usExactBuckets[ SUBSCRIPTION_MANAGER_EXACT_BUCKETS ];
+    uint16_t usWildcardElements;
+} SubscriptionList_t;
+
 /**
  * @brief Add a subscription to the subscription list.
  *
@@ -101,15 +139,17 @@ typedef struct subscriptionElement
  * context-callback pairs. However, a single context-callback pair may only be
  * associated to the same topic filter once.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pcTopicFilterString Topic filter string of subscription.
  * @param[in] usTopicFilterLength Length of topic filter string.
  * @param[in] pxIncomingPublishCallback Callback function for the subscription.
  * @param[in] pvIncomingPublishCallbackContext Context for the subscription callback.
  *
- * @return `true` if subscription added or exists, `false` if insufficient memory.
+ * @return `true` if subscription added or exists, `false` if insufficient memory,
+ * if a filter with wildcards has more than SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS
+ * levels or if "#" is not its last level.
  */
-bool SubscriptionManager_AddSubscription( SubscriptionElement_t * pxSubscriptionList,
+bool SubscriptionManager_AddSubscription( SubscriptionList_t * pxSubscriptionList,
                                           const char * pcTopicFilterString,
                                           uint16_t usTopicFilterLength,
                                           IncomingPubCallback_t pxIncomingPublishCallback,
@@ -121,11 +161,11 @@ bool SubscriptionManager_AddSubscription( SubscriptionElement_t * pxSubscription
  * @note If the topic filter exists multiple times in the subscription list,
  * then every instance of the subscription will be removed.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pcTopicFilterString Topic filter of subscription.
  * @param[in] usTopicFilterLength Length of topic filter.
  */
-void SubscriptionManager_RemoveSubscription( SubscriptionElement_t * pxSubscriptionList,
+void SubscriptionManager_RemoveSubscription( SubscriptionList_t * pxSubscriptionList,
                                              const char * pcTopicFilterString,
                                              uint16_t usTopicFilterLength );
 
@@ -133,13 +173,13 @@ void SubscriptionManager_RemoveSubscription( SubscriptionElement_t * pxSubscript
  * @brief Handle incoming publishes by invoking the callbacks registered
  * for the incoming publish's topic filter.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pxPublishInfo Info of incoming publish.
  *
  * @return `true` if an application callback could be invoked;
  *  `false` otherwise.
  */
-bool SubscriptionManager_HandleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
+bool SubscriptionManager_HandleIncomingPublishes( SubscriptionList_t * pxSubscriptionList,
                                                   MQTTPublishInfo_t * pxPublishInfo );
 
 #endif /* MQTT_SUBSCRIPTION_MANAGER_H */
@@ -74,6 +74,9 @@
 /* Common HTTP demo utilities. */
 #include "http_demo_utils.h"
 
+/* Pool of kept-alive HTTP connections. */
+#include "http_connection_pool.h"
+
 /* HTTP API header. */
 #include "core_http_client.h"
 
@@ -157,6 +160,14 @@
     #define httpexampleMAX_DEMO_COUNT    ( 3 )
 #endif
 
+/**
+ * @brief The number of requests sent in each iteration of the demo. They
+ * share one pooled connection as long as the server keeps it alive.
+ */
+#ifndef httpexampleREQUESTS_PER_ITERATION
+    #define httpexampleREQUESTS_PER_ITERATION    ( 3 )
+#endif
+
 /**
  * @brief Time in ticks to wait between each cycle of the demo implemented
  * by RunCoreHttpMutualAuthDemo().
@@ -202,10 +213,22 @@ static uint8_t ucUserBuffer[ democonfigUSER_BUFFER_LENGTH ];
 static BaseType_t prvConnectToServer( NetworkContext_t * pxNetworkContext );
 
 /**
- * @brief Send an HTTP request based on a specified method and path, then
- * print the response received from the server.
+ * @brief Open a connection for the HTTP connection pool.
+ *
+ * @param[out] pxNetworkContext The output parameter to return the created network context.
+ * @param[in] pcHost The host name requested by the pool.
+ * @param[in] usPort The port requested by the pool.
+ *
+ * @return pdPASS on successful connection, pdFAIL otherwise.
+ */
+static BaseType_t prvPoolConnect( NetworkContext_t * pxNetworkContext,
+                                  const char * pcHost,
+                                  uint16_t usPort );
+
+/**
+ * @brief Send an HTTP request based on a specified method and path over a
+ * pooled connection, then print the response received from the server.
  *
- * @param[in] pxTransportInterface The transport interface for making network calls.
  * @param[in] pcMethod The HTTP request method.
  * @param[in] xMethodLen The length of the HTTP request method.
  * @param[in] pcPath The Request-URI to the objects of interest.
@@ -213,8 +236,7 @@ static BaseType_t prvConnectToServer( NetworkContext_t * pxNetworkContext );
  *
  * @return pdFAIL on failure; pdPASS on success.
  */
-static BaseType_t prvSendHttpRequest( const TransportInterface_t * pxTransportInterface,
-                                      const char * pcMethod,
+static BaseType_t prvSendHttpRequest( const char * pcMethod,
                                       size_t xMethodLen,
                                       const char * pcPath,
                                       size_t xPathLen );
@@ -227,9 +249,11 @@ static BaseType_t prvSendHttpRequest( const TransportInterface_t * pxTransportIn
  * This example resolves the AWS IoT Core endpoint, establishes a TCP
  * connection, and performs a mutually authenticated TLS handshake such that all
  * further communication is encrypted. After which, the HTTP Client Library API
- * is used to make a POST request to AWS IoT Core in order to publish a message
+ * is used to make POST requests to AWS IoT Core in order to publish a message
  * to a topic named "topic" with QoS=1 so that all clients subscribed to this
- * topic receive the message at least once. Any possible errors are also logged.
+ * topic receive the message at least once. The connection is kept alive in the
+ * HTTP connection pool, so the requests share a single TLS handshake. Any
+ * possible errors are also logged.
  *
  * @note This example is single-threaded and uses statically allocated memory.
  *
@@ -240,14 +264,10 @@ int RunCoreHttpMutualAuthDemo( bool awsIotMqttMode,
                                void * pNetworkCredentialInfo,
                                const IotNetworkInterface_t * pNetworkInterface )
 {
-    /* The transport layer interface used by the HTTP Client library. */
-    TransportInterface_t xTransportInterface;
-    /* The network context for the transport layer interface. */
-    NetworkContext_t xNetworkContext = { 0 };
-    TransportSocketStatus_t xNetworkStatus;
-    BaseType_t xIsConnectionEstablished = pdFALSE;
     UBaseType_t uxDemoRunCount = 0UL;
-    SecureSocketsTransportParams_t secureSocketsTransportParams = { 0 };
+    UBaseType_t uxRequestCount = 0UL;
+    HttpPoolStats_t xPoolStats = { 0 };
+    BaseType_t xPoolStatus = pdFAIL;
 
     /* Upon return, pdPASS will indicate a successful demo execution.
     * pdFAIL will indicate some failures occurred during execution. The
@@ -261,7 +281,7 @@ int RunCoreHttpMutualAuthDemo( bool awsIotMqttMode,
     ( void ) pNetworkCredentialInfo;
     ( void ) pNetworkInterface;
 
-    xNetworkContext.pParams = &secureSocketsTransportParams;
+    xPoolStatus = HttpConnectionPool_Init( prvPoolConnect );
 
     do
     {
@@ -272,63 +292,30 @@ int RunCoreHttpMutualAuthDemo( bool awsIotMqttMode,
             vTaskDelay( pdMS_TO_TICKS( 2000U ) );
         } while( wifi_is_connected_to_ap() != 0 );
 
-        /**************************** Connect. ******************************/
+        /*********************** Send HTTP requests.************************/
 
-        /* Attempt to connect to the HTTP server. If connection fails, retry
-         * after a timeout. The timeout value will be exponentially increased
-         * until either the maximum number of attempts or the maximum timeout
-         * value is reached. The function returns pdFAIL if the TCP connection
-         * cannot be established with the broker after the configured number of
-         * attempts. */
-        xDemoStatus = connectToServerWithBackoffRetries( prvConnectToServer,
-                                                         &xNetworkContext );
+        /* The first request connects to the HTTP server, retrying with
+         * backoff, and every later one reuses that connection until the
+         * server closes it or it fails. */
+        xDemoStatus = xPoolStatus;
 
-        if( xDemoStatus == pdPASS )
+        for( uxRequestCount = 0UL;
+             ( xDemoStatus == pdPASS ) && ( uxRequestCount < httpexampleREQUESTS_PER_ITERATION );
+             uxRequestCount++ )
         {
-            /* Set a flag indicating that a TLS connection exists. */
-            xIsConnectionEstablished = pdTRUE;
-
-            /* Define the transport interface. */
-            xTransportInterface.pNetworkContext = &xNetworkContext;
-            xTransportInterface.send = SecureSocketsTransport_Send;
-            xTransportInterface.recv = SecureSocketsTransport_Recv;
-        }
-        else
-        {
-            /* Log error to indicate connection failure after all
-             * reconnect attempts are over. */
-            LogError( ( "Failed to connect to HTTP server %.*s.",
-                        ( int32_t ) httpexampleAWS_IOT_ENDPOINT_LENGTH,
-                        democonfigAWS_IOT_ENDPOINT ) );
-        }
-
-        /*********************** Send HTTP request.************************/
-
-        if( xDemoStatus == pdPASS )
-        {
-            xDemoStatus = prvSendHttpRequest( &xTransportInterface,
-                                              HTTP_METHOD_POST,
+            xDemoStatus = prvSendHttpRequest( HTTP_METHOD_POST,
                                               httpexampleHTTP_METHOD_POST_LENGTH,
                                               democonfigPOST_PATH,
                                               httpexamplePOST_PATH_LENGTH );
         }
 
-        /**************************** Disconnect. ******************************/
-
-        /* Close the network connection to clean up any system resources that the
-         * demo may have consumed. */
-        if( xIsConnectionEstablished == pdTRUE )
-        {
-            /* Close the network connection.  */
-            xNetworkStatus = SecureSocketsTransport_Disconnect( &xNetworkContext );
-
-            if( xNetworkStatus != TRANSPORT_SOCKET_STATUS_SUCCESS )
-            {
-                xDemoStatus = pdFAIL;
-                LogError( ( "SecureSocketsTransport_Disconnect() failed to close the network connection. "
-                            "StatusCode=%d.", ( int ) xNetworkStatus ) );
-            }
-        }
+        HttpConnectionPool_GetStats( &xPoolStats );
+        LogInfo( ( "HTTP connection pool: %lu requests over %lu TLS handshakes, "
+                   "%lu idle timeouts, %lu failed health checks.",
+                   xPoolStats.ulRequests,
+                   xPoolStats.ulHandshakes,
+                   xPoolStats.ulIdleTimeouts,
+                   xPoolStats.ulHealthCheckFailures ) );
 
         /* Increment the demo run count. */
         uxDemoRunCount++;
@@ -351,6 +338,10 @@ int RunCoreHttpMutualAuthDemo( bool awsIotMqttMode,
         }
     } while( xDemoStatus != pdPASS );
 
+    /* Close the network connection to clean up any system resources that the
+     * demo may have consumed. */
+    HttpConnectionPool_CloseIdle();
+
     if( xDemoStatus == pdPASS )
     {
         LogInfo( ( "Demo completed successfully." ) );
@@ -406,8 +397,28 @@ static BaseType_t prvConnectToServer( NetworkContext_t * pxNetworkContext )
 
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvSendHttpRequest( const TransportInterface_t * pxTransportInterface,
-                                      const char * pcMethod,
+static BaseType_t prvPoolConnect( NetworkContext_t * pxNetworkContext,
+                                  const char * pcHost,
+                                  uint16_t usPort )
+{
+    /* This demo only talks to democonfigAWS_IOT_ENDPOINT, which
+     * prvConnectToServer() connects to. */
+    ( void ) pcHost;
+    ( void ) usPort;
+
+    /* Attempt to connect to the HTTP server. If connection fails, retry
+     * after a timeout. The timeout value will be exponentially increased
+     * until either the maximum number of attempts or the maximum timeout
+     * value is reached. The function returns pdFAIL if the TCP connection
+     * cannot be established with the broker after the configured number of
+     * attempts. */
+    return connectToServerWithBackoffRetries( prvConnectToServer,
+                                              pxNetworkContext );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSendHttpRequest( const char * pcMethod,
                                       size_t xMethodLen,
                                       const char * pcPath,
                                       size_t xPathLen )
@@ -425,6 +436,8 @@ static BaseType_t prvSendHttpRequest( const TransportInterface_t * pxTransportIn
 
     /* Return value of all methods from the HTTP Client library API. */
     HTTPStatus_t xHTTPStatus = HTTPSuccess;
+    /* The pooled connection the request is sent over. */
+    HttpPoolConnection_t * pxConnection = NULL;
 
     configASSERT( pcMethod != NULL );
     configASSERT( pcPath != NULL );
@@ -454,6 +467,26 @@ static BaseType_t prvSendHttpRequest( const TransportInterface_t * pxTransportIn
                                                        &xRequestInfo );
 
     if( xHTTPStatus == HTTPSuccess )
+    {
+        pxConnection = HttpConnectionPool_Checkout( democonfigAWS_IOT_ENDPOINT,
+                                                    httpexampleAWS_IOT_ENDPOINT_LENGTH,
+                                                    democonfigAWS_HTTP_PORT );
+
+        if( pxConnection == NULL )
+        {
+            LogError( ( "Failed to connect to HTTP server %.*s.",
+                        ( int32_t ) httpexampleAWS_IOT_ENDPOINT_LENGTH,
+                        democonfigAWS_IOT_ENDPOINT ) );
+            xHTTPStatus = HTTPNoResponse;
+        }
+    }
+    else
+    {
+        LogError( ( "Failed to initialize HTTP request headers: Error=%s.",
+                    HTTPClient_strerror( xHTTPStatus ) ) );
+    }
+
+    if( pxConnection != NULL )
     {
         /* Initialize the response object. The same buffer used for storing
          * request headers is reused here. */
@@ -471,17 +504,16 @@ static BaseType_t prvSendHttpRequest( const TransportInterface_t * pxTransportIn
                     ( int32_t ) httpexampleREQUEST_BODY_LENGTH, democonfigREQUEST_BODY ) );
 
         /* Send the request and receive the response. */
-        xHTTPStatus = HTTPClient_Send( pxTransportInterface,
+        xHTTPStatus = HTTPClient_Send( HttpConnectionPool_GetTransport( pxConnection ),
                                        &xRequestHeaders,
                                        ( uint8_t * ) democonfigREQUEST_BODY,
                                        httpexampleREQUEST_BODY_LENGTH,
                                        &xResponse,
                                        0 );
-    }
-    else
-    {
-        LogError( ( "Failed to initialize HTTP request headers: Error=%s.",
-                    HTTPClient_strerror( xHTTPStatus ) ) );
+
+        /* Keep the connection for the next request unless the request failed
+         * or the server asked to close it. */
+        HttpConnectionPool_Checkin( pxConnection, xHTTPStatus, &xResponse );
     }
 
     if( xHTTPStatus == HTTPSuccess )
@@ -55,6 +55,7 @@
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "queue.h"
+#include "semphr.h"
 #include "task.h"
 
 /* Demo Specific configs. */
@@ -76,6 +77,11 @@
 /* Subscription manager header include. */
 #include "subscription_manager.h"
 
+#if defined( MQTT_AGENT_COALESCE_PUBLISHES ) && ( MQTT_AGENT_COALESCE_PUBLISHES != 0 )
+    /* Transport functions holding QoS0 PUBLISH back. */
+    #include "publish_coalescer.h"
+#endif
+
 /* Transport interface implementation include header for TLS. */
 #include "transport_secure_sockets.h"
 
@@ -88,6 +94,11 @@
 /* Include AWS IoT metrics macros header. */
 #include "aws_iot_metrics.h"
 
+#if defined( MQTT_AGENT_STORE_AND_FORWARD ) && ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+    /* Store of the publishes issued while offline. */
+    #include "iot_publish_store.h"
+#endif
+
 /**
  * These configuration settings are required to run the demo.
  */
@@ -135,10 +146,37 @@
 #endif
 
 /**
- * @brief The length of the queue used to hold commands for the agent.
+ * @brief Set to 1 to hold the QoS0 PUBLISH sent by the agent in a buffer, so
+ * that several of them go out in one transport write, and so in as few TLS
+ * records and TCP segments as possible.
+ */
+#ifndef MQTT_AGENT_COALESCE_PUBLISHES
+    #define MQTT_AGENT_COALESCE_PUBLISHES    ( 0 )
+#endif
+
+/**
+ * @brief Set to 1 to keep the publishes the demo tasks issue while the agent
+ * is not connected, and forward them once it is connected again.
+ */
+#ifndef MQTT_AGENT_STORE_AND_FORWARD
+    #define MQTT_AGENT_STORE_AND_FORWARD    ( 0 )
+#endif
+
+/**
+ * @brief Largest number of stored publishes forwarded per second, so that the
+ * backlog does not crowd out the publishes issued after the reconnect.
+ */
+#ifndef MQTT_AGENT_FORWARD_RATE_PER_SECOND
+    #define MQTT_AGENT_FORWARD_RATE_PER_SECOND    ( 10U )
+#endif
+
+/**
+ * @brief Flash region the store spills to once its RAM ring is full: a
+ * pointer to a PublishStoreFlash_t the application defines over sectors it
+ * reserves. NULL keeps the store in RAM only.
  */
-#ifndef MQTT_AGENT_COMMAND_QUEUE_LENGTH
-    #define MQTT_AGENT_COMMAND_QUEUE_LENGTH    ( 10 )
+#ifndef MQTT_AGENT_STORE_FLASH
+    #define MQTT_AGENT_STORE_FLASH    ( NULL )
 #endif
 
 /**
@@ -200,6 +238,55 @@
 #define mqttexampleMILLISECONDS_PER_SECOND           ( 1000U )
 #define mqttexampleMILLISECONDS_PER_TICK             ( mqttexampleMILLISECONDS_PER_SECOND / configTICK_RATE_HZ )
 
+/**
+ * @brief Maximum number of topic filters in a SUBSCRIBE sent to restore the
+ * subscriptions after a reconnect. AWS IoT accepts at most 8.
+ */
+#define mqttexampleRESUBSCRIBE_BATCH_FILTERS         ( 8U )
+
+/**
+ * @brief Maximum size in bytes of a SUBSCRIBE sent to restore the
+ * subscriptions. A topic filter larger than this is sent on its own.
+ */
+#define mqttexampleRESUBSCRIBE_BATCH_BYTES           ( 512U )
+
+/**
+ * @brief Number of SUBSCRIBE sent to restore the subscriptions that may wait
+ * for their SUBACK at the same time.
+ */
+#define mqttexampleRESUBSCRIBE_BATCHES_IN_FLIGHT     ( 2U )
+
+/**
+ * @brief Number of times a topic filter refused by the broker is subscribed
+ * again before it is removed from the subscription list.
+ */
+#define mqttexampleRESUBSCRIBE_MAX_RETRIES           ( 2U )
+
+/**
+ * @brief Size of the fixed header, at most, and of the packet identifier of a
+ * SUBSCRIBE.
+ */
+#define mqttexampleSUBSCRIBE_HEADER_BYTES            ( 7U )
+
+/**
+ * @brief Store classes of the publishes: those the broker acknowledges are
+ * forwarded before the QoS0 ones.
+ */
+#define mqttexampleSTORE_CLASS_ACKNOWLEDGED          ( 0U )
+#define mqttexampleSTORE_CLASS_QOS0                  ( 1U )
+
+/**
+ * @brief Size of the header of a stored publish: the QoS and the length of
+ * the topic, which the topic and the payload follow.
+ */
+#define mqttexampleSTORE_HEADER_BYTES                ( 3U )
+
+/**
+ * @brief Time in milliseconds the forwarding task waits before it checks
+ * again for a connection or for stored publishes.
+ */
+#define mqttexampleFORWARD_IDLE_DELAY_MS             ( 500U )
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -223,6 +310,38 @@ struct DemoParams
     bool xSuccess;
 };
 
+/**
+ * @brief Whether the broker holds each subscription of the subscription list.
+ */
+typedef enum ResubscribeState
+{
+    eResubscribeDone = 0, /* The broker holds the subscription, or it is not used. */
+    eResubscribePending,  /* The subscription must be sent. */
+    eResubscribeInFlight  /* The subscription was sent, its SUBACK is awaited. */
+} ResubscribeState_t;
+
+/**
+ * @brief A SUBSCRIBE sent to restore some of the subscriptions, with the
+ * index of each subscription in the subscription list.
+ */
+typedef struct ResubscribeBatch
+{
+    MQTTAgentSubscribeArgs_t xSubscribeArgs;
+    MQTTSubscribeInfo_t xSubscribeInfo[ mqttexampleRESUBSCRIBE_BATCH_FILTERS ];
+    uint16_t usElements[ mqttexampleRESUBSCRIBE_BATCH_FILTERS ];
+    MQTTAgentCommandInfo_t xCommandInfo;
+    bool xInFlight;
+} ResubscribeBatch_t;
+
+/**
+ * @brief Context of the publish sent by the forwarding task.
+ */
+typedef struct ForwardCommand
+{
+    TaskHandle_t xTaskToNotify;
+    MQTTStatus_t xReturnStatus;
+} ForwardCommand_t;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -299,13 +418,22 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         MQTTPublishInfo_t * pxPublishInfo );
 
 /**
- * @brief Function to attempt to resubscribe to the topics already present in the
- * subscription list.
+ * @brief Mark every subscription of the subscription list as to be sent
+ * again, as the broker did not keep the session.
+ */
+static void prvMarkSubscriptionsPending( void );
+
+/**
+ * @brief Function to attempt to resubscribe to the topics of the subscription
+ * list that the broker does not hold.
  *
  * This function will be invoked when this demo requests the broker to
- * reestablish the session and the broker cannot do so. This function will
- * enqueue commands to the MQTT Agent queue and will be processed once the
- * command loop starts.
+ * reestablish the session, and again as SUBACKs arrive. The topic filters are
+ * split into SUBSCRIBE of at most mqttexampleRESUBSCRIBE_BATCH_FILTERS filters
+ * and mqttexampleRESUBSCRIBE_BATCH_BYTES bytes, up to
+ * mqttexampleRESUBSCRIBE_BATCHES_IN_FLIGHT of which are enqueued without
+ * waiting for their SUBACK. The commands will be processed once the command
+ * loop starts.
  *
  * @return `MQTTSuccess` if adding subscribes to the command queue succeeds, else
  * appropriate error code from MQTTAgent_Subscribe.
@@ -315,8 +443,9 @@ static MQTTStatus_t prvHandleResubscribe( void );
 /**
  * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when the
  * broker ACKs the SUBSCRIBE message. This callback implementation is used for
- * handling the completion of resubscribes. Any topic filter failed to resubscribe
- * will be removed from the subscription list.
+ * handling the completion of resubscribes. A topic filter refused by the broker
+ * is sent again up to mqttexampleRESUBSCRIBE_MAX_RETRIES times, and then
+ * removed from the subscription list.
  *
  * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
  *
@@ -370,6 +499,94 @@ static uint32_t prvGetTimeMs( void );
  */
 static BaseType_t prvConnectToMQTTBroker( bool xCreateCleanSession );
 
+#if ( MQTT_AGENT_COALESCE_PUBLISHES != 0 )
+
+/**
+ * @brief Transport interface send function holding QoS0 PUBLISH back.
+ *
+ * Other packets, including QoS1 and QoS2 PUBLISH, are written out with the
+ * packets held before them as soon as they are complete.
+ *
+ * @param[in] pxNetworkContext Network context.
+ * @param[in] pvBuffer Bytes to send.
+ * @param[in] xBytesToSend Number of bytes to send.
+ *
+ * @return Number of bytes taken, or a negative value if a write failed.
+ */
+    static int32_t prvCoalescingSend( NetworkContext_t * pxNetworkContext,
+                                      const void * pvBuffer,
+                                      size_t xBytesToSend );
+
+/**
+ * @brief Transport interface writev function holding QoS0 PUBLISH back.
+ *
+ * @param[in] pxNetworkContext Network context.
+ * @param[in] pxIoVec Buffers to send, in order.
+ * @param[in] xIoVecCount Number of entries in pxIoVec.
+ *
+ * @return Number of bytes taken, or a negative value if a write failed.
+ */
+    static int32_t prvCoalescingWritev( NetworkContext_t * pxNetworkContext,
+                                        TransportOutVector_t * pxIoVec,
+                                        size_t xIoVecCount );
+
+/**
+ * @brief Transport interface receive function writing out the held packets
+ * once their deadline has passed.
+ *
+ * @param[in] pxNetworkContext Network context.
+ * @param[out] pvBuffer Buffer to receive into.
+ * @param[in] xBytesToRecv Number of bytes requested.
+ *
+ * @return Number of bytes received, 0 if none, or a negative value on error.
+ */
+    static int32_t prvCoalescingRecv( NetworkContext_t * pxNetworkContext,
+                                      void * pvBuffer,
+                                      size_t xBytesToRecv );
+
+#endif /* if ( MQTT_AGENT_COALESCE_PUBLISHES != 0 ) */
+
+#if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+
+/**
+ * @brief Task sending the stored publishes, by class then in order, while
+ * the agent is connected. A publish leaves the store once the agent reports
+ * it sent, or acknowledged for QoS1 and QoS2; after a failure it is sent
+ * again.
+ *
+ * @param[in] pvParameters Not used.
+ */
+    static void prvForwardTask( void * pvParameters );
+
+/**
+ * @brief Passed into MQTTAgent_Publish() by the forwarding task, to notify it
+ * when the publish completes.
+ *
+ * @param[in] pxCommandContext The ForwardCommand_t of the task.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+    static void prvForwardCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Whether the agent is connected to the broker. Used by the demo tasks
+ * to store their publishes while it is not.
+ *
+ * @return pdTRUE if the agent is connected.
+ */
+    BaseType_t xMQTTAgentIsConnected( void );
+
+/**
+ * @brief Stores a publish to be forwarded once the agent is connected.
+ *
+ * @param[in] pxPublishInfo The publish.
+ *
+ * @return pdTRUE if the publish was stored, pdFALSE if the store is full or
+ * the publish too large.
+ */
+    BaseType_t xMQTTAgentStorePublish( const MQTTPublishInfo_t * pxPublishInfo );
+#endif /* if ( MQTT_AGENT_STORE_AND_FORWARD != 0 ) */
+
 /*
  * Function that starts the tasks demonstrated by this project.
  */
@@ -420,15 +637,52 @@ static MQTTAgentMessageContext_t xCommandQueue;
 static struct DemoParams taskParameters[ democonfigNUM_SIMPLE_SUB_PUB_TASKS_TO_CREATE ];
 
 /**
- * @brief The global array of subscription elements.
+ * @brief The global list of subscriptions.
+ *
+ * @note No thread safety is required to this list, since updates to the list
+ * are done only from the MQTT agent task. The subscription manager
+ * implementation expects that the list used for storing subscriptions to be
+ * initialized to 0. As this is a global variable, it will be initialized to 0
+ * by default.
+ */
+SubscriptionList_t xGlobalSubscriptionList;
+
+/**
+ * @brief Whether the broker holds each subscription of xGlobalSubscriptionList,
+ * and the number of times it refused it.
+ */
+static uint8_t ucResubscribeState[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
+static uint8_t ucResubscribeRetries[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
+
+/**
+ * @brief The SUBSCRIBE sent to restore the subscriptions.
+ */
+static ResubscribeBatch_t xResubscribeBatches[ mqttexampleRESUBSCRIBE_BATCHES_IN_FLIGHT ];
+
+#if ( MQTT_AGENT_COALESCE_PUBLISHES != 0 )
+
+/**
+ * @brief The packets held back by the transport functions of the agent.
  *
- * @note No thread safety is required to this array, since updates to the array
- * elements are done only from the MQTT agent task. The subscription manager
- * implementation expects that the array of the subscription elements used for
- * storing subscriptions to be initialized to 0. As this is a global array, it
- * will be initialized to 0 by default.
+ * @note Only the agent task calls the transport functions, so no locking is
+ * needed.
  */
-SubscriptionElement_t xGlobalSubscriptionList[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
+    static PublishCoalescer_t xCoalescer;
+#endif
+
+#if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+
+/**
+ * @brief Whether the agent is connected to the broker.
+ */
+    static volatile BaseType_t xAgentConnected = pdFALSE;
+
+/**
+ * @brief Serializes the access to the publish store, used by the demo tasks
+ * and the forwarding task.
+ */
+    static SemaphoreHandle_t xStoreMutex = NULL;
+#endif
 
 /*-----------------------------------------------------------*/
 
@@ -486,8 +740,6 @@ static MQTTStatus_t prvMQTTAgentInit( void )
     TransportInterface_t xTransport;
     MQTTStatus_t xReturn;
     MQTTFixedBuffer_t xFixedBuffer = { .pBuffer = xNetworkBuffer, .size = MQTT_AGENT_NETWORK_BUFFER_SIZE };
-    static uint8_t staticQueueStorageArea[ MQTT_AGENT_COMMAND_QUEUE_LENGTH * sizeof( MQTTAgentCommand_t * ) ];
-    static StaticQueue_t staticQueueStructure;
     MQTTAgentMessageInterface_t messageInterface =
     {
         .pMsgCtx        = NULL,
@@ -497,12 +749,8 @@ static MQTTStatus_t prvMQTTAgentInit( void )
         .releaseCommand = Agent_ReleaseCommand
     };
 
-    LogDebug( ( "Creating command queue." ) );
-    xCommandQueue.queue = xQueueCreateStatic( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
-                                              sizeof( MQTTAgentCommand_t * ),
-                                              staticQueueStorageArea,
-                                              &staticQueueStructure );
-    configASSERT( xCommandQueue.queue );
+    LogDebug( ( "Creating command ring." ) );
+    Agent_MessageInit( &xCommandQueue );
     messageInterface.pMsgCtx = &xCommandQueue;
 
     /* Initialize the command struct pool. */
@@ -510,9 +758,21 @@ static MQTTStatus_t prvMQTTAgentInit( void )
 
     /* Fill in Transport Interface send and receive function pointers. */
     xTransport.pNetworkContext = &xNetworkContext;
-    xTransport.send = SecureSocketsTransport_Send;
-    xTransport.recv = SecureSocketsTransport_Recv;
-    xTransport.writev = NULL;
+    #if ( MQTT_AGENT_COALESCE_PUBLISHES != 0 )
+        xTransport.send = SecureSocketsTransport_Send;
+        xTransport.recv = SecureSocketsTransport_Recv;
+        xTransport.writev = SecureSocketsTransport_Writev;
+        coalescerInit( &xCoalescer, &xTransport, prvGetTimeMs );
+
+        /* The agent writes through the coalescer, which writes to the socket. */
+        xTransport.send = prvCoalescingSend;
+        xTransport.recv = prvCoalescingRecv;
+        xTransport.writev = prvCoalescingWritev;
+    #else
+        xTransport.send = SecureSocketsTransport_Send;
+        xTransport.recv = SecureSocketsTransport_Recv;
+        xTransport.writev = SecureSocketsTransport_Writev;
+    #endif
 
     /* Initialize MQTT library. */
     xReturn = MQTTAgent_Init( &xGlobalMqttAgentContext,
@@ -521,8 +781,8 @@ static MQTTStatus_t prvMQTTAgentInit( void )
                               &xTransport,
                               prvGetTimeMs,
                               prvIncomingPublishCallback,
-                              /* Context to pass into the callback. Passing the pointer to subscription array. */
-                              xGlobalSubscriptionList );
+                              /* Context to pass into the callback. Passing the pointer to subscription list. */
+                              &xGlobalSubscriptionList );
 
     return xReturn;
 }
@@ -595,9 +855,15 @@ static MQTTStatus_t prvMQTTConnect( bool xCleanSession )
     {
         xResult = MQTTAgent_ResumeSession( &xGlobalMqttAgentContext, xSessionPresent );
 
-        /* Resubscribe to all the subscribed topics. */
-        if( ( xResult == MQTTSuccess ) && ( xSessionPresent == false ) )
+        /* Resubscribe to all the subscribed topics if the broker did not keep
+         * the session, else only to those it did not acknowledge. */
+        if( xResult == MQTTSuccess )
         {
+            if( xSessionPresent == false )
+            {
+                prvMarkSubscriptionsPending();
+            }
+
             xResult = prvHandleResubscribe();
         }
     }
@@ -607,57 +873,108 @@ static MQTTStatus_t prvMQTTConnect( bool xCleanSession )
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t prvHandleResubscribe( void )
+static void prvMarkSubscriptionsPending( void )
 {
-    MQTTStatus_t xResult = MQTTBadParameter;
     uint32_t ulIndex = 0U;
-    uint16_t usNumSubscriptions = 0U;
-
-    /* These variables need to stay in scope until command completes. */
-    static MQTTAgentSubscribeArgs_t xSubArgs = { 0 };
-    static MQTTSubscribeInfo_t xSubInfo[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ] = { 0 };
-    static MQTTAgentCommandInfo_t xCommandParams = { 0 };
 
-    /* Loop through each subscription in the subscription list and add a subscribe
-     * command to the command queue. */
     for( ulIndex = 0U; ulIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; ulIndex++ )
     {
-        /* Check if there is a subscription in the subscription list. This demo
-         * doesn't check for duplicate subscriptions. */
-        if( xGlobalSubscriptionList[ ulIndex ].usFilterStringLength != 0 )
+        if( xGlobalSubscriptionList.xElements[ ulIndex ].usFilterStringLength != 0 )
         {
-            xSubInfo[ usNumSubscriptions ].pTopicFilter = xGlobalSubscriptionList[ ulIndex ].pcSubscriptionFilterString;
-            xSubInfo[ usNumSubscriptions ].topicFilterLength = xGlobalSubscriptionList[ ulIndex ].usFilterStringLength;
-
-            /* QoS1 is used for all the subscriptions in this demo. */
-            xSubInfo[ usNumSubscriptions ].qos = MQTTQoS1;
-
-            LogInfo( ( "Resubscribe to the topic %.*s will be attempted.",
-                       xSubInfo[ usNumSubscriptions ].topicFilterLength,
-                       xSubInfo[ usNumSubscriptions ].pTopicFilter ) );
-
-            usNumSubscriptions++;
+            ucResubscribeState[ ulIndex ] = eResubscribePending;
         }
     }
+}
 
-    if( usNumSubscriptions > 0U )
-    {
-        xSubArgs.pSubscribeInfo = xSubInfo;
-        xSubArgs.numSubscriptions = usNumSubscriptions;
+/*-----------------------------------------------------------*/
 
-        /* The block time can be 0 as the command loop is not running at this point. */
-        xCommandParams.blockTimeMs = 0U;
-        xCommandParams.cmdCompleteCallback = prvSubscriptionCommandCallback;
-        xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xSubArgs;
+static MQTTStatus_t prvHandleResubscribe( void )
+{
+    MQTTStatus_t xResult = MQTTSuccess;
+    ResubscribeBatch_t * pxBatch = NULL;
+    const SubscriptionElement_t * pxElement = NULL;
+    uint32_t ulBatch = 0U, ulIndex = 0U, ulPacketBytes = 0U, ulFilterBytes = 0U;
+    uint16_t usNumSubscriptions = 0U;
+    bool xPending = true;
 
-        /* Enqueue subscribe to the command queue. These commands will be processed only
-         * when command loop starts. */
-        xResult = MQTTAgent_Subscribe( &xGlobalMqttAgentContext, &xSubArgs, &xCommandParams );
-    }
-    else
+    for( ulBatch = 0U; ( ulBatch < mqttexampleRESUBSCRIBE_BATCHES_IN_FLIGHT ) && ( xPending == true ) && ( xResult == MQTTSuccess ); ulBatch++ )
     {
-        /* Mark the resubscribe as success if there is nothing to be subscribed. */
-        xResult = MQTTSuccess;
+        pxBatch = &( xResubscribeBatches[ ulBatch ] );
+
+        if( pxBatch->xInFlight == false )
+        {
+            usNumSubscriptions = 0U;
+            ulPacketBytes = mqttexampleSUBSCRIBE_HEADER_BYTES;
+
+            /* Loop through each subscription in the subscription list the
+             * broker does not hold, and add it to the batch while it fits. This
+             * demo doesn't check for duplicate subscriptions. */
+            for( ulIndex = 0U; ( ulIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ) && ( usNumSubscriptions < mqttexampleRESUBSCRIBE_BATCH_FILTERS ); ulIndex++ )
+            {
+                pxElement = &( xGlobalSubscriptionList.xElements[ ulIndex ] );
+
+                if( ( ucResubscribeState[ ulIndex ] == eResubscribePending ) &&
+                    ( pxElement->usFilterStringLength != 0 ) )
+                {
+                    /* Length prefix, topic filter and requested QoS. */
+                    ulFilterBytes = 2U + pxElement->usFilterStringLength + 1U;
+
+                    if( ( usNumSubscriptions > 0U ) && ( ( ulPacketBytes + ulFilterBytes ) > mqttexampleRESUBSCRIBE_BATCH_BYTES ) )
+                    {
+                        break;
+                    }
+
+                    pxBatch->xSubscribeInfo[ usNumSubscriptions ].pTopicFilter = pxElement->pcSubscriptionFilterString;
+                    pxBatch->xSubscribeInfo[ usNumSubscriptions ].topicFilterLength = pxElement->usFilterStringLength;
+
+                    /* QoS1 is used for all the subscriptions in this demo. */
+                    pxBatch->xSubscribeInfo[ usNumSubscriptions ].qos = MQTTQoS1;
+                    pxBatch->usElements[ usNumSubscriptions ] = ( uint16_t ) ulIndex;
+                    ucResubscribeState[ ulIndex ] = eResubscribeInFlight;
+                    ulPacketBytes += ulFilterBytes;
+
+                    LogInfo( ( "Resubscribe to the topic %.*s will be attempted.",
+                               pxElement->usFilterStringLength,
+                               pxElement->pcSubscriptionFilterString ) );
+
+                    usNumSubscriptions++;
+                }
+            }
+
+            if( usNumSubscriptions > 0U )
+            {
+                pxBatch->xSubscribeArgs.pSubscribeInfo = pxBatch->xSubscribeInfo;
+                pxBatch->xSubscribeArgs.numSubscriptions = usNumSubscriptions;
+
+                /* The block time can be 0 as the command loop is not running at
+                 * this point, or this is called from the agent task itself. */
+                pxBatch->xCommandInfo.blockTimeMs = 0U;
+                pxBatch->xCommandInfo.cmdCompleteCallback = prvSubscriptionCommandCallback;
+                pxBatch->xCommandInfo.pCmdCompleteCallbackContext = ( void * ) pxBatch;
+
+                /* Enqueue subscribe to the command queue. These commands will be
+                 * processed only when command loop starts, one after the other
+                 * without waiting for the SUBACK of the previous one. */
+                xResult = MQTTAgent_Subscribe( &xGlobalMqttAgentContext, &( pxBatch->xSubscribeArgs ), &( pxBatch->xCommandInfo ) );
+
+                if( xResult == MQTTSuccess )
+                {
+                    pxBatch->xInFlight = true;
+                }
+                else
+                {
+                    for( ulIndex = 0U; ulIndex < usNumSubscriptions; ulIndex++ )
+                    {
+                        ucResubscribeState[ pxBatch->usElements[ ulIndex ] ] = eResubscribePending;
+                    }
+                }
+            }
+            else
+            {
+                /* Nothing left to be subscribed. */
+                xPending = false;
+            }
+        }
     }
 
     if( xResult != MQTTSuccess )
@@ -675,28 +992,63 @@ static void prvSubscriptionCommandCallback( MQTTAgentCommandContext_t * pxComman
                                             MQTTAgentReturnInfo_t * pxReturnInfo )
 {
     size_t lIndex = 0;
-    MQTTAgentSubscribeArgs_t * pxSubscribeArgs = ( MQTTAgentSubscribeArgs_t * ) pxCommandContext;
+    uint16_t usElement = 0U;
+    ResubscribeBatch_t * pxBatch = ( ResubscribeBatch_t * ) pxCommandContext;
+    const MQTTSubscribeInfo_t * pxSubscribeInfo = NULL;
 
-    /* If the return code is success, no further action is required as all the topic filters
-     * are already part of the subscription list. */
-    if( pxReturnInfo->returnCode != MQTTSuccess )
+    for( lIndex = 0; lIndex < pxBatch->xSubscribeArgs.numSubscriptions; lIndex++ )
     {
-        /* Check through each of the suback codes and determine if there are any failures. */
-        for( lIndex = 0; lIndex < pxSubscribeArgs->numSubscriptions; lIndex++ )
+        usElement = pxBatch->usElements[ lIndex ];
+        pxSubscribeInfo = &( pxBatch->xSubscribeInfo[ lIndex ] );
+
+        if( xGlobalSubscriptionList.xElements[ usElement ].pcSubscriptionFilterString != pxSubscribeInfo->pTopicFilter )
         {
-            /* This demo doesn't attempt to resubscribe in the event that a SUBACK failed. */
-            if( pxReturnInfo->pSubackCodes[ lIndex ] == MQTTSubAckFailure )
-            {
-                LogError( ( "Failed to resubscribe to topic %.*s.",
-                            pxSubscribeArgs->pSubscribeInfo[ lIndex ].topicFilterLength,
-                            pxSubscribeArgs->pSubscribeInfo[ lIndex ].pTopicFilter ) );
-                /* Remove subscription callback for unsubscribe. */
-                removeSubscription( xGlobalSubscriptionList,
-                                    pxSubscribeArgs->pSubscribeInfo[ lIndex ].pTopicFilter,
-                                    pxSubscribeArgs->pSubscribeInfo[ lIndex ].topicFilterLength );
-            }
+            /* The subscription was removed from the list in the meantime, and
+             * the element possibly reused by a subscription the broker holds. */
+            ucResubscribeState[ usElement ] = eResubscribeDone;
+            ucResubscribeRetries[ usElement ] = 0U;
+        }
+        else if( pxReturnInfo->pSubackCodes == NULL )
+        {
+            /* The command did not complete, for instance because the connection
+             * was lost. The subscription is sent again after the reconnect. */
+            ucResubscribeState[ usElement ] = eResubscribePending;
+        }
+        else if( pxReturnInfo->pSubackCodes[ lIndex ] != MQTTSubAckFailure )
+        {
+            ucResubscribeState[ usElement ] = eResubscribeDone;
+            ucResubscribeRetries[ usElement ] = 0U;
+        }
+        else if( ucResubscribeRetries[ usElement ] < mqttexampleRESUBSCRIBE_MAX_RETRIES )
+        {
+            LogWarn( ( "Broker refused the resubscribe to topic %.*s, retrying.",
+                       pxSubscribeInfo->topicFilterLength,
+                       pxSubscribeInfo->pTopicFilter ) );
+            ucResubscribeRetries[ usElement ]++;
+            ucResubscribeState[ usElement ] = eResubscribePending;
+        }
+        else
+        {
+            LogError( ( "Failed to resubscribe to topic %.*s.",
+                        pxSubscribeInfo->topicFilterLength,
+                        pxSubscribeInfo->pTopicFilter ) );
+            ucResubscribeState[ usElement ] = eResubscribeDone;
+            ucResubscribeRetries[ usElement ] = 0U;
+
+            /* Remove subscription callback for unsubscribe. */
+            removeSubscription( &xGlobalSubscriptionList,
+                                pxSubscribeInfo->pTopicFilter,
+                                pxSubscribeInfo->topicFilterLength );
         }
     }
+
+    pxBatch->xInFlight = false;
+
+    /* Send the next batch, and the topic filters to retry, while connected. */
+    if( pxReturnInfo->pSubackCodes != NULL )
+    {
+        ( void ) prvHandleResubscribe();
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -784,6 +1136,11 @@ static BaseType_t prvSocketConnect( NetworkContext_t * pxNetworkContext )
 
     xConnected = ( xNetworkStatus == TRANSPORT_SOCKET_STATUS_SUCCESS ) ? pdPASS : pdFAIL;
 
+    #if ( MQTT_AGENT_COALESCE_PUBLISHES != 0 )
+        /* Packets held for the previous connection are lost with it. */
+        coalescerReset( &xCoalescer );
+    #endif
+
     /* Set the socket wakeup callback and ensure the read block time. */
     if( xConnected )
     {
@@ -809,6 +1166,43 @@ static BaseType_t prvSocketDisconnect( NetworkContext_t * pxNetworkContext )
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_AGENT_COALESCE_PUBLISHES != 0 )
+
+    static int32_t prvCoalescingSend( NetworkContext_t * pxNetworkContext,
+                                      const void * pvBuffer,
+                                      size_t xBytesToSend )
+    {
+        ( void ) pxNetworkContext;
+
+        return coalescerSend( &xCoalescer, pvBuffer, xBytesToSend );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int32_t prvCoalescingWritev( NetworkContext_t * pxNetworkContext,
+                                        TransportOutVector_t * pxIoVec,
+                                        size_t xIoVecCount )
+    {
+        ( void ) pxNetworkContext;
+
+        return coalescerWritev( &xCoalescer, pxIoVec, xIoVecCount );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int32_t prvCoalescingRecv( NetworkContext_t * pxNetworkContext,
+                                      void * pvBuffer,
+                                      size_t xBytesToRecv )
+    {
+        ( void ) pxNetworkContext;
+
+        return coalescerRecv( &xCoalescer, pvBuffer, xBytesToRecv );
+    }
+
+#endif /* if ( MQTT_AGENT_COALESCE_PUBLISHES != 0 ) */
+
+/*-----------------------------------------------------------*/
+
 static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         uint16_t packetId,
                                         MQTTPublishInfo_t * pxPublishInfo )
@@ -820,7 +1214,7 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 
     /* Fan out the incoming publishes to the callbacks registered using
      * subscription manager. */
-    xPublishHandled = handleIncomingPublishes( ( SubscriptionElement_t * ) pMqttAgentContext->pIncomingCallbackContext,
+    xPublishHandled = handleIncomingPublishes( ( SubscriptionList_t * ) pMqttAgentContext->pIncomingCallbackContext,
                                                pxPublishInfo );
 
     /* If there are no callbacks to handle the incoming publishes,
@@ -873,6 +1267,10 @@ static void prvMQTTAgentTask( void * pvParameters )
         /* Any error. */
         else
         {
+            #if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+                xAgentConnected = pdFALSE;
+            #endif
+
             /* Reconnect TCP. */
             xNetworkResult = prvSocketDisconnect( &xNetworkContext );
 
@@ -892,6 +1290,10 @@ static void prvMQTTAgentTask( void * pvParameters )
         }
     } while( xMQTTStatus != MQTTSuccess );
 
+    #if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+        xAgentConnected = pdFALSE;
+    #endif
+
     /* Delete the task if it is complete. */
     LogInfo( ( "MQTT Agent task completed." ) );
     vTaskDelete( NULL );
@@ -945,6 +1347,10 @@ static BaseType_t prvConnectToMQTTBroker( bool xCreateCleanSession )
         }
     } while( ( xMQTTStatus != MQTTSuccess ) && ( xBackoffStatus == pdPASS ) );
 
+    #if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+        xAgentConnected = ( xMQTTStatus == MQTTSuccess ) ? pdTRUE : pdFALSE;
+    #endif
+
     return ( xMQTTStatus == MQTTSuccess ) ? pdPASS : pdFAIL;
 }
 /*-----------------------------------------------------------*/
@@ -964,6 +1370,29 @@ static int prvConnectAndCreateDemoTasks( void * pvParameters )
     /* Set the pParams member of the network context with desired transport. */
     xNetworkContext.pParams = &secureSocketsTransportParams;
 
+    #if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+
+        /* The store and its task outlive the iterations of the demo, so that
+         * the publishes of one are forwarded in the next. */
+        if( xStoreMutex == NULL )
+        {
+            xStoreMutex = xSemaphoreCreateMutex();
+            configASSERT( xStoreMutex != NULL );
+
+            if( PublishStore_Init( MQTT_AGENT_STORE_FLASH ) == pdFALSE )
+            {
+                LogWarn( ( "The publish store flash region cannot be used, keeping publishes in RAM only." ) );
+            }
+
+            xTaskCreate( prvForwardTask,
+                         "MQTT Forward",
+                         democonfigSIMPLE_SUB_PUB_TASK_STACK_SIZE,
+                         NULL,
+                         tskIDLE_PRIORITY,
+                         NULL );
+        }
+    #endif /* if ( MQTT_AGENT_STORE_AND_FORWARD != 0 ) */
+
     /* Initialize the MQTT context with the buffer and transport interface. */
     xMQTTStatus = prvMQTTAgentInit();
 
@@ -1017,6 +1446,176 @@ static int prvConnectAndCreateDemoTasks( void * pvParameters )
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+
+    BaseType_t xMQTTAgentIsConnected( void )
+    {
+        return xAgentConnected;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t xMQTTAgentStorePublish( const MQTTPublishInfo_t * pxPublishInfo )
+    {
+        static uint8_t ucMessage[ publishstoreconfigMAX_MESSAGE ];
+        BaseType_t xStored = pdFALSE;
+        uint32_t ulLength = mqttexampleSTORE_HEADER_BYTES + pxPublishInfo->topicNameLength + ( uint32_t ) pxPublishInfo->payloadLength;
+
+        if( ( xStoreMutex == NULL ) || ( ulLength > publishstoreconfigMAX_MESSAGE ) )
+        {
+            LogError( ( "Cannot store a publish of %lu bytes.", ( unsigned long ) ulLength ) );
+        }
+        else
+        {
+            /* ucMessage is only used with the mutex held. */
+            ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+
+            ucMessage[ 0 ] = ( uint8_t ) pxPublishInfo->qos;
+            ucMessage[ 1 ] = ( uint8_t ) ( pxPublishInfo->topicNameLength >> 8 );
+            ucMessage[ 2 ] = ( uint8_t ) pxPublishInfo->topicNameLength;
+            ( void ) memcpy( &ucMessage[ mqttexampleSTORE_HEADER_BYTES ],
+                             pxPublishInfo->pTopicName,
+                             pxPublishInfo->topicNameLength );
+            ( void ) memcpy( &ucMessage[ mqttexampleSTORE_HEADER_BYTES + pxPublishInfo->topicNameLength ],
+                             pxPublishInfo->pPayload,
+                             pxPublishInfo->payloadLength );
+
+            xStored = PublishStore_Put( ( pxPublishInfo->qos == MQTTQoS0 ) ? mqttexampleSTORE_CLASS_QOS0 : mqttexampleSTORE_CLASS_ACKNOWLEDGED,
+                                        ucMessage,
+                                        ulLength );
+
+            ( void ) xSemaphoreGive( xStoreMutex );
+
+            if( xStored == pdFALSE )
+            {
+                LogWarn( ( "Publish store full, dropping a publish on topic %.*s.",
+                           pxPublishInfo->topicNameLength,
+                           pxPublishInfo->pTopicName ) );
+            }
+        }
+
+        return xStored;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvForwardCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+    {
+        ForwardCommand_t * pxForward = ( ForwardCommand_t * ) pxCommandContext;
+
+        pxForward->xReturnStatus = pxReturnInfo->returnCode;
+        xTaskNotifyGive( pxForward->xTaskToNotify );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvForwardTask( void * pvParameters )
+    {
+        /* The agent reads the publish from this buffer until it completes,
+         * including when it sends it again after a reconnect. */
+        static uint8_t ucMessage[ publishstoreconfigMAX_MESSAGE ];
+        static ForwardCommand_t xForward;
+        MQTTPublishInfo_t xPublishInfo;
+        MQTTAgentCommandInfo_t xCommandParams = { 0 };
+        PublishStoreStats_t xStats;
+        MQTTStatus_t xCommandAdded;
+        uint32_t ulLength = 0, ulTopicLength = 0;
+        uint8_t ucClass = 0;
+        bool xBacklog = false;
+
+        ( void ) pvParameters;
+
+        xForward.xTaskToNotify = xTaskGetCurrentTaskHandle();
+        xCommandParams.blockTimeMs = 0U;
+        xCommandParams.cmdCompleteCallback = prvForwardCommandCallback;
+        xCommandParams.pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) &xForward;
+
+        for( ; ; )
+        {
+            ulLength = 0;
+
+            if( xAgentConnected != pdFALSE )
+            {
+                ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+                ulLength = PublishStore_Peek( ucMessage, &ucClass );
+                ( void ) xSemaphoreGive( xStoreMutex );
+            }
+
+            if( ulLength > 0U )
+            {
+                ulTopicLength = ( ( uint32_t ) ucMessage[ 1 ] << 8 ) | ucMessage[ 2 ];
+            }
+
+            if( ulLength == 0U )
+            {
+                if( xBacklog == true )
+                {
+                    xBacklog = false;
+                    ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+                    PublishStore_GetStats( &xStats );
+                    ( void ) xSemaphoreGive( xStoreMutex );
+                    LogInfo( ( "Publish store drained: %lu stored (%lu in flash), %lu forwarded, %lu dropped, %lu recovered, %lu lost.",
+                               ( unsigned long ) xStats.ulStored,
+                               ( unsigned long ) xStats.ulSpilled,
+                               ( unsigned long ) xStats.ulForwarded,
+                               ( unsigned long ) xStats.ulDropped,
+                               ( unsigned long ) xStats.ulRecovered,
+                               ( unsigned long ) xStats.ulLost ) );
+                }
+
+                vTaskDelay( pdMS_TO_TICKS( mqttexampleFORWARD_IDLE_DELAY_MS ) );
+            }
+            else if( ( ulTopicLength == 0U ) || ( ( mqttexampleSTORE_HEADER_BYTES + ulTopicLength ) > ulLength ) )
+            {
+                LogError( ( "Discarding a malformed stored publish of class %u.", ucClass ) );
+                ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+                ( void ) PublishStore_Remove();
+                ( void ) xSemaphoreGive( xStoreMutex );
+            }
+            else
+            {
+                xBacklog = true;
+
+                memset( ( void * ) &xPublishInfo, 0x00, sizeof( xPublishInfo ) );
+                xPublishInfo.qos = ( MQTTQoS_t ) ucMessage[ 0 ];
+                xPublishInfo.pTopicName = ( const char * ) &ucMessage[ mqttexampleSTORE_HEADER_BYTES ];
+                xPublishInfo.topicNameLength = ( uint16_t ) ulTopicLength;
+                xPublishInfo.pPayload = &ucMessage[ mqttexampleSTORE_HEADER_BYTES + ulTopicLength ];
+                xPublishInfo.payloadLength = ulLength - mqttexampleSTORE_HEADER_BYTES - ulTopicLength;
+
+                xForward.xReturnStatus = MQTTSendFailed;
+                xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext, &xPublishInfo, &xCommandParams );
+
+                if( xCommandAdded == MQTTSuccess )
+                {
+                    /* The agent completes every command it accepted, with an
+                     * error if it is terminated. */
+                    ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+                }
+
+                if( ( xCommandAdded == MQTTSuccess ) && ( xForward.xReturnStatus == MQTTSuccess ) )
+                {
+                    ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+                    ( void ) PublishStore_Remove();
+                    ( void ) xSemaphoreGive( xStoreMutex );
+
+                    /* Pace the backlog. */
+                    vTaskDelay( pdMS_TO_TICKS( 1000U / MQTT_AGENT_FORWARD_RATE_PER_SECOND ) );
+                }
+                else
+                {
+                    /* Sent again once the agent is connected and has room. */
+                    vTaskDelay( pdMS_TO_TICKS( mqttexampleFORWARD_IDLE_DELAY_MS ) );
+                }
+            }
+        }
+    }
+
+#endif /* if ( MQTT_AGENT_STORE_AND_FORWARD != 0 ) */
+
+/*-----------------------------------------------------------*/
+
 static uint32_t prvGetTimeMs( void )
 {
     TickType_t xTickCount = 0;
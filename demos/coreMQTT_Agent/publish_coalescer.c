@@ -0,0 +1,437 @@
+/*
+ * FreeRTOS V202107.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file publish_coalescer.c
+ * @brief Transport functions holding QoS0 PUBLISH back so that several of
+ * them are written out together, and so in as few TLS records and TCP
+ * segments as possible.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* Publish coalescer header include. */
+#include "publish_coalescer.h"
+
+
+/**
+ * @brief Milliseconds per second.
+ */
+#define MILLISECONDS_PER_SECOND    ( 1000U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Follow the packet boundaries in bytes handed to the transport, and
+ * note if the packet completed last must be written out at once.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[in] pucData Bytes handed to the transport.
+ * @param[in] xLength Number of bytes.
+ */
+static void prvTrackPackets( PublishCoalescer_t * pxCoalescer,
+                             const uint8_t * pucData,
+                             size_t xLength );
+
+/**
+ * @brief Write bytes out, retrying until the transport took them all.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[in] pucData Bytes to write.
+ * @param[in] xLength Number of bytes.
+ *
+ * @return 0 if every byte was written, else a negative value.
+ */
+static int32_t prvWrite( PublishCoalescer_t * pxCoalescer,
+                         const uint8_t * pucData,
+                         size_t xLength );
+
+/**
+ * @brief Write out the held packets.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ *
+ * @return 0 if nothing is held anymore, else a negative value.
+ */
+static int32_t prvFlush( PublishCoalescer_t * pxCoalescer );
+
+/**
+ * @brief Append bytes to the held packets. The caller checked they fit.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[in] pucData Bytes to hold.
+ * @param[in] xLength Number of bytes.
+ */
+static void prvHold( PublishCoalescer_t * pxCoalescer,
+                     const uint8_t * pucData,
+                     size_t xLength );
+
+/**
+ * @brief Write out the held packets if a packet that cannot wait completed or
+ * the deadline passed, and no packet is partly written.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ *
+ * @return 0 if nothing needed writing or it was written, else a negative value.
+ */
+static int32_t prvFlushIfDue( PublishCoalescer_t * pxCoalescer );
+
+/**
+ * @brief Log the transport writes per second and bytes per write.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ */
+static void prvReport( PublishCoalescer_t * pxCoalescer );
+
+/*-----------------------------------------------------------*/
+
+static void prvReport( PublishCoalescer_t * pxCoalescer )
+{
+    uint32_t ulElapsedSeconds = ( pxCoalescer->xGetTimeMs() - pxCoalescer->ulStartMs ) / MILLISECONDS_PER_SECOND;
+
+    if( ( ulElapsedSeconds > 0U ) && ( pxCoalescer->ulWrites > 0U ) )
+    {
+        LogInfo( ( "Coalescing: %lu packets in %lu writes, %lu writes/s, %lu bytes/write.",
+                   ( unsigned long ) pxCoalescer->ulPackets,
+                   ( unsigned long ) pxCoalescer->ulWrites,
+                   ( unsigned long ) ( pxCoalescer->ulWrites / ulElapsedSeconds ),
+                   ( unsigned long ) ( pxCoalescer->ulBytes / pxCoalescer->ulWrites ) ) );
+    }
+
+    pxCoalescer->ulReportMs = pxCoalescer->xGetTimeMs();
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTrackPackets( PublishCoalescer_t * pxCoalescer,
+                             const uint8_t * pucData,
+                             size_t xLength )
+{
+    size_t xIndex = 0U, xSkip = 0U;
+    uint8_t ucByte = 0U;
+
+    while( xIndex < xLength )
+    {
+        if( pxCoalescer->ulBodyLeft > 0U )
+        {
+            /* Skip the rest of the packet. */
+            xSkip = xLength - xIndex;
+
+            if( xSkip > pxCoalescer->ulBodyLeft )
+            {
+                xSkip = pxCoalescer->ulBodyLeft;
+            }
+
+            xIndex += xSkip;
+            pxCoalescer->ulBodyLeft -= ( uint32_t ) xSkip;
+        }
+        else
+        {
+            ucByte = pucData[ xIndex ];
+            xIndex++;
+
+            if( pxCoalescer->xInHeader == false )
+            {
+                /* First byte of a packet: only a QoS0 PUBLISH may wait. */
+                pxCoalescer->xInHeader = true;
+                pxCoalescer->ulRemainingLength = 0U;
+                pxCoalescer->ulLengthShift = 0U;
+                pxCoalescer->ulPackets++;
+
+                if( ( ( ucByte & 0xF0U ) != MQTT_PACKET_TYPE_PUBLISH ) ||
+                    ( ( ucByte & 0x06U ) != 0U ) )
+                {
+                    pxCoalescer->xFlushAtPacketEnd = true;
+                }
+            }
+            else
+            {
+                /* Remaining length, 7 bits per byte. */
+                pxCoalescer->ulRemainingLength |= ( ( uint32_t ) ( ucByte & 0x7FU ) ) << pxCoalescer->ulLengthShift;
+                pxCoalescer->ulLengthShift += 7U;
+
+                if( ( ( ucByte & 0x80U ) == 0U ) || ( pxCoalescer->ulLengthShift >= 28U ) )
+                {
+                    pxCoalescer->xInHeader = false;
+                    pxCoalescer->ulBodyLeft = pxCoalescer->ulRemainingLength;
+                }
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvWrite( PublishCoalescer_t * pxCoalescer,
+                         const uint8_t * pucData,
+                         size_t xLength )
+{
+    int32_t lSent = 0;
+    size_t xSent = 0U;
+
+    while( xSent < xLength )
+    {
+        lSent = pxCoalescer->xTransport.send( pxCoalescer->xTransport.pNetworkContext,
+                                              &( pucData[ xSent ] ),
+                                              xLength - xSent );
+
+        if( lSent <= 0 )
+        {
+            LogError( ( "Failed to write %lu coalesced bytes, status %ld.",
+                        ( unsigned long ) ( xLength - xSent ),
+                        ( long ) lSent ) );
+            break;
+        }
+
+        xSent += ( size_t ) lSent;
+    }
+
+    pxCoalescer->ulWrites++;
+    pxCoalescer->ulBytes += ( uint32_t ) xSent;
+
+    if( ( pxCoalescer->xGetTimeMs() - pxCoalescer->ulReportMs ) >= MQTT_AGENT_COALESCE_REPORT_INTERVAL_MS )
+    {
+        prvReport( pxCoalescer );
+    }
+
+    return ( xSent == xLength ) ? 0 : ( ( lSent < 0 ) ? lSent : -1 );
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvFlush( PublishCoalescer_t * pxCoalescer )
+{
+    int32_t lResult = 0;
+
+    if( pxCoalescer->xLength > 0U )
+    {
+        lResult = prvWrite( pxCoalescer, pxCoalescer->ucBuffer, pxCoalescer->xLength );
+
+        /* On an error the connection is dropped, and what was held with it. */
+        pxCoalescer->xLength = 0U;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvHold( PublishCoalescer_t * pxCoalescer,
+                     const uint8_t * pucData,
+                     size_t xLength )
+{
+    if( pxCoalescer->xLength == 0U )
+    {
+        pxCoalescer->ulDeadlineMs = pxCoalescer->xGetTimeMs() + ( ( MQTT_AGENT_COALESCE_DEADLINE_US + 999U ) / 1000U );
+    }
+
+    ( void ) memcpy( &( pxCoalescer->ucBuffer[ pxCoalescer->xLength ] ), pucData, xLength );
+    pxCoalescer->xLength += xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvFlushIfDue( PublishCoalescer_t * pxCoalescer )
+{
+    int32_t lResult = 0;
+
+    /* Held packets are complete only between two packets. */
+    if( ( pxCoalescer->xInHeader == false ) && ( pxCoalescer->ulBodyLeft == 0U ) )
+    {
+        if( ( pxCoalescer->xFlushAtPacketEnd == true ) ||
+            ( ( pxCoalescer->xLength > 0U ) &&
+              ( ( int32_t ) ( pxCoalescer->xGetTimeMs() - pxCoalescer->ulDeadlineMs ) >= 0 ) ) )
+        {
+            pxCoalescer->xFlushAtPacketEnd = false;
+            lResult = prvFlush( pxCoalescer );
+        }
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void coalescerInit( PublishCoalescer_t * pxCoalescer,
+                    const TransportInterface_t * pxTransport,
+                    MQTTGetCurrentTimeFunc_t xGetTimeMs )
+{
+    ( void ) memset( pxCoalescer, 0, sizeof( PublishCoalescer_t ) );
+    pxCoalescer->xTransport = *pxTransport;
+    pxCoalescer->xGetTimeMs = xGetTimeMs;
+    pxCoalescer->ulStartMs = xGetTimeMs();
+    pxCoalescer->ulReportMs = pxCoalescer->ulStartMs;
+}
+
+/*-----------------------------------------------------------*/
+
+void coalescerReset( PublishCoalescer_t * pxCoalescer )
+{
+    prvReport( pxCoalescer );
+
+    pxCoalescer->xLength = 0U;
+    pxCoalescer->xInHeader = false;
+    pxCoalescer->xFlushAtPacketEnd = false;
+    pxCoalescer->ulBodyLeft = 0U;
+    pxCoalescer->ulStartMs = pxCoalescer->xGetTimeMs();
+    pxCoalescer->ulReportMs = pxCoalescer->ulStartMs;
+    pxCoalescer->ulWrites = 0U;
+    pxCoalescer->ulBytes = 0U;
+    pxCoalescer->ulPackets = 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t coalescerSend( PublishCoalescer_t * pxCoalescer,
+                       const void * pvBuffer,
+                       size_t xBytesToSend )
+{
+    int32_t lResult = 0;
+    const uint8_t * pucData = ( const uint8_t * ) pvBuffer;
+
+    prvTrackPackets( pxCoalescer, pucData, xBytesToSend );
+
+    if( xBytesToSend > ( sizeof( pxCoalescer->ucBuffer ) - pxCoalescer->xLength ) )
+    {
+        lResult = prvFlush( pxCoalescer );
+    }
+
+    if( lResult == 0 )
+    {
+        if( xBytesToSend > sizeof( pxCoalescer->ucBuffer ) )
+        {
+            /* Too large to be held, written out after what was held. */
+            lResult = prvWrite( pxCoalescer, pucData, xBytesToSend );
+        }
+        else
+        {
+            prvHold( pxCoalescer, pucData, xBytesToSend );
+        }
+    }
+
+    if( lResult == 0 )
+    {
+        lResult = prvFlushIfDue( pxCoalescer );
+    }
+
+    return ( lResult == 0 ) ? ( int32_t ) xBytesToSend : lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t coalescerWritev( PublishCoalescer_t * pxCoalescer,
+                         TransportOutVector_t * pxIoVec,
+                         size_t xIoVecCount )
+{
+    int32_t lResult = 0;
+    size_t xIndex = 0U, xTotal = 0U, xTaken = 0U;
+
+    for( xIndex = 0U; xIndex < xIoVecCount; xIndex++ )
+    {
+        xTotal += pxIoVec[ xIndex ].iov_len;
+    }
+
+    if( xTotal > ( sizeof( pxCoalescer->ucBuffer ) - pxCoalescer->xLength ) )
+    {
+        lResult = prvFlush( pxCoalescer );
+    }
+
+    if( lResult != 0 )
+    {
+        /* The held packets could not be written out. */
+    }
+    else if( xTotal > sizeof( pxCoalescer->ucBuffer ) )
+    {
+        /* Too large to be held, written out after what was held. The MQTT
+         * library hands again what was not taken, so only the bytes taken
+         * are followed. */
+        lResult = pxCoalescer->xTransport.writev( pxCoalescer->xTransport.pNetworkContext,
+                                                  pxIoVec,
+                                                  xIoVecCount );
+        pxCoalescer->ulWrites++;
+
+        for( xIndex = 0U; ( lResult > 0 ) && ( xIndex < xIoVecCount ) && ( xTaken < ( size_t ) lResult ); xIndex++ )
+        {
+            xTotal = ( size_t ) lResult - xTaken;
+
+            if( xTotal > pxIoVec[ xIndex ].iov_len )
+            {
+                xTotal = pxIoVec[ xIndex ].iov_len;
+            }
+
+            prvTrackPackets( pxCoalescer, ( const uint8_t * ) pxIoVec[ xIndex ].iov_base, xTotal );
+            xTaken += xTotal;
+        }
+
+        pxCoalescer->ulBytes += ( uint32_t ) xTaken;
+
+        /* Nothing is held once the packets taken are complete. The rest of a
+         * packet taken in part may be held, and must then still go out at
+         * its end. */
+        if( ( pxCoalescer->xInHeader == false ) && ( pxCoalescer->ulBodyLeft == 0U ) )
+        {
+            pxCoalescer->xFlushAtPacketEnd = false;
+        }
+    }
+    else
+    {
+        for( xIndex = 0U; xIndex < xIoVecCount; xIndex++ )
+        {
+            prvTrackPackets( pxCoalescer, ( const uint8_t * ) pxIoVec[ xIndex ].iov_base, pxIoVec[ xIndex ].iov_len );
+            prvHold( pxCoalescer, ( const uint8_t * ) pxIoVec[ xIndex ].iov_base, pxIoVec[ xIndex ].iov_len );
+        }
+
+        lResult = prvFlushIfDue( pxCoalescer );
+
+        if( lResult == 0 )
+        {
+            lResult = ( int32_t ) xTotal;
+        }
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t coalescerRecv( PublishCoalescer_t * pxCoalescer,
+                       void * pvBuffer,
+                       size_t xBytesToRecv )
+{
+    /* The agent polls the network every time it runs its loop, which bounds
+     * how late the deadline is noticed. */
+    int32_t lResult = prvFlushIfDue( pxCoalescer );
+
+    if( lResult == 0 )
+    {
+        lResult = pxCoalescer->xTransport.recv( pxCoalescer->xTransport.pNetworkContext,
+                                                pvBuffer,
+                                                xBytesToRecv );
+    }
+
+    return lResult;
+}
@@ -0,0 +1,192 @@
+/*
+ * FreeRTOS V202107.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file publish_coalescer.h
+ * @brief Transport functions holding QoS0 PUBLISH back so that several of
+ * them are written out together.
+ */
+#ifndef PUBLISH_COALESCER_H
+#define PUBLISH_COALESCER_H
+
+/**************************************************/
+/******* DO NOT CHANGE the following order ********/
+/**************************************************/
+
+/* Logging related header files are required to be included in the following order:
+ * 1. Include the header file "logging_levels.h".
+ * 2. Define LIBRARY_LOG_NAME and  LIBRARY_LOG_LEVEL.
+ * 3. Include the header file "logging_stack.h".
+ */
+
+/* Include header that defines log levels. */
+#include "logging_levels.h"
+
+/* Logging configuration for the Publish Coalescer module. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME     "Publish Coalescer"
+#endif
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+
+/* Demo config include. */
+#include "mqtt_agent_demo_config.h"
+
+/* core MQTT include. */
+#include "core_mqtt.h"
+
+/* Transport interface include. */
+#include "transport_interface.h"
+
+
+/**
+ * @brief Size in bytes of the buffer holding the coalesced packets. It is
+ * written out when the next packet does not fit.
+ */
+#ifndef MQTT_AGENT_COALESCE_BUFFER_SIZE
+    #ifdef MQTT_AGENT_NETWORK_BUFFER_SIZE
+        #define MQTT_AGENT_COALESCE_BUFFER_SIZE    ( MQTT_AGENT_NETWORK_BUFFER_SIZE )
+    #else
+        #define MQTT_AGENT_COALESCE_BUFFER_SIZE    ( 5000U )
+    #endif
+#endif
+
+/**
+ * @brief Longest time in microseconds a coalesced packet is held. It is
+ * checked with the resolution of the time function, each time the receive
+ * function is called.
+ */
+#ifndef MQTT_AGENT_COALESCE_DEADLINE_US
+    #define MQTT_AGENT_COALESCE_DEADLINE_US    ( 2000U )
+#endif
+
+/**
+ * @brief Interval in milliseconds between two logs of the coalescing metrics.
+ */
+#ifndef MQTT_AGENT_COALESCE_REPORT_INTERVAL_MS
+    #define MQTT_AGENT_COALESCE_REPORT_INTERVAL_MS    ( 60000U )
+#endif
+
+/**
+ * @brief The packets held to be written out together, and the position in the
+ * packet being written.
+ *
+ * @note The functions of a coalescer are not thread safe; a single task, the
+ * MQTT agent, is expected to call them.
+ */
+typedef struct publishCoalescer
+{
+    TransportInterface_t xTransport;  /* Transport the packets are written to. */
+    MQTTGetCurrentTimeFunc_t xGetTimeMs;
+
+    uint8_t ucBuffer[ MQTT_AGENT_COALESCE_BUFFER_SIZE ];
+    size_t xLength;
+    uint32_t ulDeadlineMs;
+
+    /* Packet being written: its fixed header is incomplete while xInHeader
+     * is set, then ulBodyLeft bytes of it are still to come. */
+    bool xInHeader;
+    bool xFlushAtPacketEnd;
+    uint32_t ulRemainingLength;
+    uint32_t ulLengthShift;
+    uint32_t ulBodyLeft;
+
+    /* Metrics: transport writes, bytes and packets since ulStartMs. */
+    uint32_t ulStartMs;
+    uint32_t ulReportMs;
+    uint32_t ulWrites;
+    uint32_t ulBytes;
+    uint32_t ulPackets;
+} PublishCoalescer_t;
+
+/**
+ * @brief Initialize a coalescer writing to a transport.
+ *
+ * @param[in] pxCoalescer The coalescer to initialize.
+ * @param[in] pxTransport Transport the packets are written to and received
+ * from. Its send function is used to write held packets, its writev function
+ * to write those too large to be held.
+ * @param[in] xGetTimeMs Function returning the time in milliseconds.
+ */
+void coalescerInit( PublishCoalescer_t * pxCoalescer,
+                    const TransportInterface_t * pxTransport,
+                    MQTTGetCurrentTimeFunc_t xGetTimeMs );
+
+/**
+ * @brief Drop the held packets and restart the metrics, for a new connection.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ */
+void coalescerReset( PublishCoalescer_t * pxCoalescer );
+
+/**
+ * @brief Transport interface send function holding QoS0 PUBLISH back.
+ *
+ * Other packets, including QoS1 and QoS2 PUBLISH, are written out with the
+ * packets held before them as soon as they are complete.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[in] pvBuffer Bytes to send.
+ * @param[in] xBytesToSend Number of bytes to send.
+ *
+ * @return Number of bytes taken, or a negative value if a write failed.
+ */
+int32_t coalescerSend( PublishCoalescer_t * pxCoalescer,
+                       const void * pvBuffer,
+                       size_t xBytesToSend );
+
+/**
+ * @brief Transport interface writev function holding QoS0 PUBLISH back.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[in] pxIoVec Buffers to send, in order.
+ * @param[in] xIoVecCount Number of entries in pxIoVec.
+ *
+ * @return Number of bytes taken, or a negative value if a write failed.
+ */
+int32_t coalescerWritev( PublishCoalescer_t * pxCoalescer,
+                         TransportOutVector_t * pxIoVec,
+                         size_t xIoVecCount );
+
+/**
+ * @brief Transport interface receive function writing out the held packets
+ * once their deadline has passed.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[out] pvBuffer Buffer to receive into.
+ * @param[in] xBytesToRecv Number of bytes requested.
+ *
+ * @return Number of bytes received, 0 if none, or a negative value on error.
+ */
+int32_t coalescerRecv( PublishCoalescer_t * pxCoalescer,
+                       void * pvBuffer,
+                       size_t xBytesToRecv );
+
+#endif /* PUBLISH_COALESCER_H */
@@ -100,6 +100,14 @@
  */
 #define mqttexampleQOS_MODULUS                            ( 2UL )
 
+/**
+ * @brief Set to 1 to store the publishes issued while the agent is not
+ * connected. See mqtt_agent_task.c.
+ */
+#ifndef MQTT_AGENT_STORE_AND_FORWARD
+    #define MQTT_AGENT_STORE_AND_FORWARD    ( 0 )
+#endif
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -214,6 +222,16 @@ static void prvSimpleSubscribePublishTask( void * pvParameters );
  */
 extern MQTTAgentContext_t xGlobalMqttAgentContext;
 
+#if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+
+/**
+ * @brief The store of the publishes issued while the agent is not connected,
+ * in mqtt_agent_task.c.
+ */
+    extern BaseType_t xMQTTAgentIsConnected( void );
+    extern BaseType_t xMQTTAgentStorePublish( const MQTTPublishInfo_t * pxPublishInfo );
+#endif
+
 /*-----------------------------------------------------------*/
 
 static TaskHandle_t xMainTask;
@@ -295,7 +313,7 @@ static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandCo
     {
         /* Add subscription so that incoming publishes are routed to the application
          * callback. */
-        xSubscriptionAdded = addSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+        xSubscriptionAdded = addSubscription( ( SubscriptionList_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
                                               pxSubscribeArgs->pSubscribeInfo->pTopicFilter,
                                               pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
                                               prvIncomingPublishCallback,
@@ -519,9 +537,20 @@ static void prvSimpleSubscribePublishTask( void * pvParameters )
          * as it is to be checked against the value sent from the callback.. */
         ulNotification = ~ulValueToNotify;
 
-        xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
-                                           &xPublishInfo,
-                                           &xCommandParams );
+        #if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+            if( xMQTTAgentIsConnected() == pdFALSE )
+            {
+                /* The agent would not send it before the reconnect, and its
+                 * queue may be full; keep it to be forwarded then. */
+                xCommandAdded = MQTTSendFailed;
+            }
+            else
+        #endif
+        {
+            xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                                               &xPublishInfo,
+                                               &xCommandParams );
+        }
 
         if( xCommandAdded == MQTTSuccess )
         {
@@ -532,6 +561,15 @@ static void prvSimpleSubscribePublishTask( void * pvParameters )
                        ulValueToNotify ) );
             prvWaitForCommandAcknowledgment( &ulNotification );
         }
+        #if ( MQTT_AGENT_STORE_AND_FORWARD != 0 )
+            else if( xMQTTAgentStorePublish( &xPublishInfo ) != pdFALSE )
+            {
+                LogInfo( ( "Task %s stored publish %d to forward after the reconnect.",
+                           taskName,
+                           ulValueToNotify ) );
+                ulNotification = ulValueToNotify;
+            }
+        #endif
         else
         {
             LogError( ( "Failed to enqueue publish command. Error code=%s", MQTT_Status_strerror( xCommandAdded ) ) );
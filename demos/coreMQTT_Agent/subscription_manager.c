@@ -36,14 +36,414 @@
 #include "subscription_manager.h"
 
 
-bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
+/**
+ * @brief Link to no node or no element.
+ */
+#define NO_LINK                      ( 0U )
+
+/**
+ * @brief Link to the root of the trie.
+ */
+#define ROOT_LINK                    ( 1U )
+
+/**
+ * @brief Node and element of a list given their link.
+ */
+#define NODE( pxList, usLink )       ( &( ( pxList )->xNodes[ ( usLink ) - 1U ] ) )
+#define ELEMENT( pxList, usLink )    ( &( ( pxList )->xElements[ ( usLink ) - 1U ] ) )
+
+/**
+ * @brief A node of the trie to visit while dispatching a publish, with the
+ * offset of the level of the topic it is to be matched against.
+ */
+typedef struct trieVisit
+{
+    uint16_t usNode;
+    uint32_t ulOffset;
+} TrieVisit_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Hash a topic level, with the node it is a child of.
+ *
+ * @param[in] usParent Link to the parent node.
+ * @param[in] pcLevel The level.
+ * @param[in] usLevelLength Length of the level.
+ *
+ * @return The hash.
+ */
+static uint32_t prvHashLevel( uint16_t usParent,
+                              const char * pcLevel,
+                              uint16_t usLevelLength );
+
+/**
+ * @brief Find the child of a node for a level that is not a wildcard.
+ *
+ * @param[in] pxSubscriptionList The subscription list.
+ * @param[in] usParent Link to the parent node.
+ * @param[in] pcLevel The level.
+ * @param[in] usLevelLength Length of the level.
+ *
+ * @return Link to the child, or NO_LINK.
+ */
+static uint16_t prvFindExactChild( const SubscriptionList_t * pxSubscriptionList,
+                                   uint16_t usParent,
+                                   const char * pcLevel,
+                                   uint16_t usLevelLength );
+
+/**
+ * @brief Find the child of a node for a level of a topic filter, and create
+ * it if asked to.
+ *
+ * @param[in] pxSubscriptionList The subscription list.
+ * @param[in] usParent Link to the parent node.
+ * @param[in] pcLevel The level.
+ * @param[in] usLevelLength Length of the level.
+ * @param[in] xCreate Whether to create the child if it does not exist.
+ *
+ * @return Link to the child, or NO_LINK.
+ */
+static uint16_t prvGetChild( SubscriptionList_t * pxSubscriptionList,
+                             uint16_t usParent,
+                             const char * pcLevel,
+                             uint16_t usLevelLength,
+                             bool xCreate );
+
+/**
+ * @brief Find the node of the last level of a topic filter, and create the
+ * missing nodes on the way if asked to.
+ *
+ * @param[in] pxSubscriptionList The subscription list.
+ * @param[in] pcTopicFilterString Topic filter.
+ * @param[in] usTopicFilterLength Length of topic filter.
+ * @param[in] xCreate Whether to create the missing nodes.
+ *
+ * @return Link to the node, or NO_LINK if it does not exist, could not be
+ * created, or if the filter has too many levels.
+ */
+static uint16_t prvWalkFilter( SubscriptionList_t * pxSubscriptionList,
+                               const char * pcTopicFilterString,
+                               uint16_t usTopicFilterLength,
+                               bool xCreate );
+
+/**
+ * @brief Update the count of the subscriptions going through a node and
+ * through its ancestors.
+ *
+ * @param[in] pxSubscriptionList The subscription list.
+ * @param[in] usNode Link to the node.
+ * @param[in] xAdd Whether a subscription was added or removed.
+ */
+static void prvUpdateReferences( SubscriptionList_t * pxSubscriptionList,
+                                 uint16_t usNode,
+                                 bool xAdd );
+
+/**
+ * @brief Free a node and its ancestors as long as no subscription goes
+ * through them.
+ *
+ * @param[in] pxSubscriptionList The subscription list.
+ * @param[in] usNode Link to the node.
+ */
+static void prvPruneNodes( SubscriptionList_t * pxSubscriptionList,
+                           uint16_t usNode );
+
+/**
+ * @brief Invoke the callbacks of the subscriptions ending at a node whose
+ * topic filter matches the topic of a publish.
+ *
+ * @param[in] pxSubscriptionList The subscription list.
+ * @param[in] usNode Link to the node.
+ * @param[in] pxPublishInfo Info of incoming publish.
+ *
+ * @return `true` if a callback was invoked.
+ */
+static bool prvDeliver( const SubscriptionList_t * pxSubscriptionList,
+                        uint16_t usNode,
+                        MQTTPublishInfo_t * pxPublishInfo );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvHashLevel( uint16_t usParent,
+                              const char * pcLevel,
+                              uint16_t usLevelLength )
+{
+    /* FNV-1a, over the parent link and then over the level. */
+    uint32_t ulHash = 2166136261UL;
+    uint16_t usIndex = 0U;
+
+    ulHash = ( ulHash ^ ( usParent & 0xFFU ) ) * 16777619UL;
+    ulHash = ( ulHash ^ ( usParent >> 8 ) ) * 16777619UL;
+
+    for( usIndex = 0U; usIndex < usLevelLength; usIndex++ )
+    {
+        ulHash = ( ulHash ^ ( uint8_t ) pcLevel[ usIndex ] ) * 16777619UL;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t prvFindExactChild( const SubscriptionList_t * pxSubscriptionList,
+                                   uint16_t usParent,
+                                   const char * pcLevel,
+                                   uint16_t usLevelLength )
+{
+    uint32_t ulHash = prvHashLevel( usParent, pcLevel, usLevelLength );
+    uint16_t usChild = pxSubscriptionList->usBuckets[ ulHash % SUBSCRIPTION_MANAGER_TRIE_BUCKETS ];
+    const SubscriptionTrieNode_t * pxChild = NULL;
+
+    while( usChild != NO_LINK )
+    {
+        pxChild = NODE( pxSubscriptionList, usChild );
+
+        if( ( pxChild->ulLevelHash == ulHash ) &&
+            ( pxChild->usLevelLength == usLevelLength ) &&
+            ( pxChild->usParent == usParent ) )
+        {
+            break;
+        }
+
+        usChild = pxChild->usNextInBucket;
+    }
+
+    return usChild;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t prvGetChild( SubscriptionList_t * pxSubscriptionList,
+                             uint16_t usParent,
+                             const char * pcLevel,
+                             uint16_t usLevelLength,
+                             bool xCreate )
+{
+    SubscriptionTrieNode_t * pxParent = NODE( pxSubscriptionList, usParent );
+    SubscriptionTrieNode_t * pxChild = NULL;
+    uint16_t * pusWildcardChild = NULL;
+    uint16_t usChild = NO_LINK;
+    uint32_t ulBucket = 0U;
+
+    if( ( usLevelLength == 1U ) && ( pcLevel[ 0 ] == '+' ) )
+    {
+        pusWildcardChild = &( pxParent->usPlusChild );
+        usChild = *pusWildcardChild;
+    }
+    else if( ( usLevelLength == 1U ) && ( pcLevel[ 0 ] == '#' ) )
+    {
+        pusWildcardChild = &( pxParent->usHashChild );
+        usChild = *pusWildcardChild;
+    }
+    else
+    {
+        usChild = prvFindExactChild( pxSubscriptionList, usParent, pcLevel, usLevelLength );
+    }
+
+    if( ( usChild == NO_LINK ) && ( xCreate == true ) )
+    {
+        /* Take a node released earlier, or else the next one never used. */
+        if( pxSubscriptionList->usFreeNodes != NO_LINK )
+        {
+            usChild = pxSubscriptionList->usFreeNodes;
+            pxSubscriptionList->usFreeNodes = NODE( pxSubscriptionList, usChild )->usNextInBucket;
+        }
+        else if( pxSubscriptionList->usNodesUsed < ( SUBSCRIPTION_MANAGER_MAX_TRIE_NODES - 1U ) )
+        {
+            pxSubscriptionList->usNodesUsed++;
+            usChild = ( uint16_t ) ( pxSubscriptionList->usNodesUsed + ROOT_LINK );
+        }
+        else
+        {
+            LogError( ( "No free node in the topic filter trie." ) );
+        }
+
+        if( usChild != NO_LINK )
+        {
+            pxChild = NODE( pxSubscriptionList, usChild );
+            memset( pxChild, 0x00, sizeof( SubscriptionTrieNode_t ) );
+            pxChild->usParent = usParent;
+            pxChild->usLevelLength = usLevelLength;
+
+            if( pusWildcardChild != NULL )
+            {
+                *pusWildcardChild = usChild;
+            }
+            else
+            {
+                pxChild->ulLevelHash = prvHashLevel( usParent, pcLevel, usLevelLength );
+                ulBucket = pxChild->ulLevelHash % SUBSCRIPTION_MANAGER_TRIE_BUCKETS;
+                pxChild->usNextInBucket = pxSubscriptionList->usBuckets[ ulBucket ];
+                pxSubscriptionList->usBuckets[ ulBucket ] = usChild;
+            }
+        }
+    }
+
+    return usChild;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t prvWalkFilter( SubscriptionList_t * pxSubscriptionList,
+                               const char * pcTopicFilterString,
+                               uint16_t usTopicFilterLength,
+                               bool xCreate )
+{
+    uint16_t usNode = ROOT_LINK, usChild = NO_LINK;
+    uint16_t usStart = 0U, usEnd = 0U, usLevels = 0U;
+    bool xLastLevel = false;
+
+    while( ( usNode != NO_LINK ) && ( xLastLevel == false ) )
+    {
+        usEnd = usStart;
+
+        while( ( usEnd < usTopicFilterLength ) && ( pcTopicFilterString[ usEnd ] != '/' ) )
+        {
+            usEnd++;
+        }
+
+        usLevels++;
+        usChild = NO_LINK;
+
+        if( usLevels <= SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS )
+        {
+            usChild = prvGetChild( pxSubscriptionList,
+                                   usNode,
+                                   &( pcTopicFilterString[ usStart ] ),
+                                   ( uint16_t ) ( usEnd - usStart ),
+                                   xCreate );
+        }
+
+        /* Do not leave behind the nodes created for a filter that could not
+         * be added. */
+        if( ( usChild == NO_LINK ) && ( xCreate == true ) )
+        {
+            prvPruneNodes( pxSubscriptionList, usNode );
+        }
+
+        usNode = usChild;
+        xLastLevel = ( usEnd == usTopicFilterLength );
+        usStart = ( uint16_t ) ( usEnd + 1U );
+    }
+
+    return usNode;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvUpdateReferences( SubscriptionList_t * pxSubscriptionList,
+                                 uint16_t usNode,
+                                 bool xAdd )
+{
+    SubscriptionTrieNode_t * pxNode = NULL;
+
+    while( usNode != NO_LINK )
+    {
+        pxNode = NODE( pxSubscriptionList, usNode );
+
+        if( xAdd == true )
+        {
+            pxNode->usReferences++;
+        }
+        else
+        {
+            pxNode->usReferences--;
+        }
+
+        usNode = pxNode->usParent;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPruneNodes( SubscriptionList_t * pxSubscriptionList,
+                           uint16_t usNode )
+{
+    SubscriptionTrieNode_t * pxNode = NULL, * pxParent = NULL;
+    uint16_t * pusLink = NULL;
+    uint16_t usParent = NO_LINK;
+
+    /* A node no subscription goes through has no children left either. */
+    while( ( usNode != ROOT_LINK ) && ( NODE( pxSubscriptionList, usNode )->usReferences == 0U ) )
+    {
+        pxNode = NODE( pxSubscriptionList, usNode );
+        usParent = pxNode->usParent;
+        pxParent = NODE( pxSubscriptionList, usParent );
+
+        if( pxParent->usPlusChild == usNode )
+        {
+            pxParent->usPlusChild = NO_LINK;
+        }
+        else if( pxParent->usHashChild == usNode )
+        {
+            pxParent->usHashChild = NO_LINK;
+        }
+        else
+        {
+            pusLink = &( pxSubscriptionList->usBuckets[ pxNode->ulLevelHash % SUBSCRIPTION_MANAGER_TRIE_BUCKETS ] );
+
+            while( *pusLink != usNode )
+            {
+                pusLink = &( NODE( pxSubscriptionList, *pusLink )->usNextInBucket );
+            }
+
+            *pusLink = pxNode->usNextInBucket;
+        }
+
+        memset( pxNode, 0x00, sizeof( SubscriptionTrieNode_t ) );
+        pxNode->usNextInBucket = pxSubscriptionList->usFreeNodes;
+        pxSubscriptionList->usFreeNodes = usNode;
+
+        usNode = usParent;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvDeliver( const SubscriptionList_t * pxSubscriptionList,
+                        uint16_t usNode,
+                        MQTTPublishInfo_t * pxPublishInfo )
+{
+    const SubscriptionElement_t * pxElement = NULL;
+    uint16_t usElement = NODE( pxSubscriptionList, usNode )->usFirstElement;
+    bool isMatched = false, publishHandled = false;
+
+    while( usElement != NO_LINK )
+    {
+        pxElement = ELEMENT( pxSubscriptionList, usElement );
+        isMatched = false;
+
+        /* The trie only compares hashes of the levels, check the whole filter. */
+        MQTT_MatchTopic( pxPublishInfo->pTopicName,
+                         pxPublishInfo->topicNameLength,
+                         pxElement->pcSubscriptionFilterString,
+                         pxElement->usFilterStringLength,
+                         &isMatched );
+
+        if( isMatched == true )
+        {
+            pxElement->pxIncomingPublishCallback( pxElement->pvIncomingPublishCallbackContext,
+                                                  pxPublishInfo );
+            publishHandled = true;
+        }
+
+        usElement = pxElement->usNextElement;
+    }
+
+    return publishHandled;
+}
+
+/*-----------------------------------------------------------*/
+
+bool addSubscription( SubscriptionList_t * pxSubscriptionList,
                       const char * pcTopicFilterString,
                       uint16_t usTopicFilterLength,
                       IncomingPubCallback_t pxIncomingPublishCallback,
                       void * pvIncomingPublishCallbackContext )
 {
-    int32_t lIndex = 0;
-    size_t xAvailableIndex = SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS;
+    SubscriptionElement_t * pxElement = NULL;
+    uint16_t usNode = NO_LINK, usElement = NO_LINK;
     bool xReturnStatus = false;
 
     if( ( pxSubscriptionList == NULL ) ||
@@ -60,36 +460,73 @@ bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
     }
     else
     {
-        /* Start at end of array, so that we will insert at the first available index.
-         * Scans backwards to find duplicates. */
-        for( lIndex = ( int32_t ) SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS - 1; lIndex >= 0; lIndex-- )
+        usNode = prvWalkFilter( pxSubscriptionList, pcTopicFilterString, usTopicFilterLength, true );
+
+        if( usNode == NO_LINK )
         {
-            if( pxSubscriptionList[ lIndex ].usFilterStringLength == 0 )
-            {
-                xAvailableIndex = lIndex;
-            }
-            else if( ( pxSubscriptionList[ lIndex ].usFilterStringLength == usTopicFilterLength ) &&
-                     ( strncmp( pcTopicFilterString, pxSubscriptionList[ lIndex ].pcSubscriptionFilterString, ( size_t ) usTopicFilterLength ) == 0 ) )
+            LogError( ( "Cannot add topic filter %.*s to the trie.",
+                        ( int ) usTopicFilterLength,
+                        pcTopicFilterString ) );
+        }
+        else
+        {
+            /* Only the subscriptions ending at the node can be duplicates. */
+            usElement = NODE( pxSubscriptionList, usNode )->usFirstElement;
+
+            while( usElement != NO_LINK )
             {
+                pxElement = ELEMENT( pxSubscriptionList, usElement );
+
                 /* If a subscription already exists, don't do anything. */
-                if( ( pxSubscriptionList[ lIndex ].pxIncomingPublishCallback == pxIncomingPublishCallback ) &&
-                    ( pxSubscriptionList[ lIndex ].pvIncomingPublishCallbackContext == pvIncomingPublishCallbackContext ) )
+                if( ( pxElement->usFilterStringLength == usTopicFilterLength ) &&
+                    ( strncmp( pcTopicFilterString, pxElement->pcSubscriptionFilterString, ( size_t ) usTopicFilterLength ) == 0 ) &&
+                    ( pxElement->pxIncomingPublishCallback == pxIncomingPublishCallback ) &&
+                    ( pxElement->pvIncomingPublishCallbackContext == pvIncomingPublishCallbackContext ) )
                 {
                     LogWarn( ( "Subscription already exists.\n" ) );
-                    xAvailableIndex = SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS;
                     xReturnStatus = true;
                     break;
                 }
+
+                usElement = pxElement->usNextElement;
             }
-        }
 
-        if( xAvailableIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
-        {
-            pxSubscriptionList[ xAvailableIndex ].pcSubscriptionFilterString = pcTopicFilterString;
-            pxSubscriptionList[ xAvailableIndex ].usFilterStringLength = usTopicFilterLength;
-            pxSubscriptionList[ xAvailableIndex ].pxIncomingPublishCallback = pxIncomingPublishCallback;
-            pxSubscriptionList[ xAvailableIndex ].pvIncomingPublishCallbackContext = pvIncomingPublishCallbackContext;
-            xReturnStatus = true;
+            if( xReturnStatus == false )
+            {
+                /* Take an element released earlier, or else the next one never used. */
+                if( pxSubscriptionList->usFreeElements != NO_LINK )
+                {
+                    usElement = pxSubscriptionList->usFreeElements;
+                    pxSubscriptionList->usFreeElements = ELEMENT( pxSubscriptionList, usElement )->usNextElement;
+                }
+                else if( pxSubscriptionList->usElementsUsed < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
+                {
+                    pxSubscriptionList->usElementsUsed++;
+                    usElement = pxSubscriptionList->usElementsUsed;
+                }
+                else
+                {
+                    usElement = NO_LINK;
+                }
+
+                if( usElement != NO_LINK )
+                {
+                    pxElement = ELEMENT( pxSubscriptionList, usElement );
+                    pxElement->pcSubscriptionFilterString = pcTopicFilterString;
+                    pxElement->usFilterStringLength = usTopicFilterLength;
+                    pxElement->pxIncomingPublishCallback = pxIncomingPublishCallback;
+                    pxElement->pvIncomingPublishCallbackContext = pvIncomingPublishCallbackContext;
+                    pxElement->usTrieNode = usNode;
+                    pxElement->usNextElement = NODE( pxSubscriptionList, usNode )->usFirstElement;
+                    NODE( pxSubscriptionList, usNode )->usFirstElement = usElement;
+                    prvUpdateReferences( pxSubscriptionList, usNode, true );
+                    xReturnStatus = true;
+                }
+                else
+                {
+                    prvPruneNodes( pxSubscriptionList, usNode );
+                }
+            }
         }
     }
 
@@ -98,11 +535,13 @@ bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
 
 /*-----------------------------------------------------------*/
 
-void removeSubscription( SubscriptionElement_t * pxSubscriptionList,
+void removeSubscription( SubscriptionList_t * pxSubscriptionList,
                          const char * pcTopicFilterString,
                          uint16_t usTopicFilterLength )
 {
-    int32_t lIndex = 0;
+    SubscriptionElement_t * pxElement = NULL;
+    uint16_t * pusLink = NULL;
+    uint16_t usNode = NO_LINK, usElement = NO_LINK;
 
     if( ( pxSubscriptionList == NULL ) ||
         ( pcTopicFilterString == NULL ) ||
@@ -116,26 +555,51 @@ void removeSubscription( SubscriptionElement_t * pxSubscriptionList,
     }
     else
     {
-        for( lIndex = 0; lIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; lIndex++ )
+        usNode = prvWalkFilter( pxSubscriptionList, pcTopicFilterString, usTopicFilterLength, false );
+
+        if( usNode != NO_LINK )
         {
-            if( pxSubscriptionList[ lIndex ].usFilterStringLength == usTopicFilterLength )
+            pusLink = &( NODE( pxSubscriptionList, usNode )->usFirstElement );
+
+            while( *pusLink != NO_LINK )
             {
-                if( strncmp( pxSubscriptionList[ lIndex ].pcSubscriptionFilterString, pcTopicFilterString, usTopicFilterLength ) == 0 )
+                usElement = *pusLink;
+                pxElement = ELEMENT( pxSubscriptionList, usElement );
+
+                if( ( pxElement->usFilterStringLength == usTopicFilterLength ) &&
+                    ( strncmp( pxElement->pcSubscriptionFilterString, pcTopicFilterString, usTopicFilterLength ) == 0 ) )
                 {
-                    memset( &( pxSubscriptionList[ lIndex ] ), 0x00, sizeof( SubscriptionElement_t ) );
+                    *pusLink = pxElement->usNextElement;
+                    memset( pxElement, 0x00, sizeof( SubscriptionElement_t ) );
+                    pxElement->usNextElement = pxSubscriptionList->usFreeElements;
+                    pxSubscriptionList->usFreeElements = usElement;
+                    prvUpdateReferences( pxSubscriptionList, usNode, false );
+                }
+                else
+                {
+                    pusLink = &( pxElement->usNextElement );
                 }
             }
+
+            prvPruneNodes( pxSubscriptionList, usNode );
         }
     }
 }
 
 /*-----------------------------------------------------------*/
 
-bool handleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
+bool handleIncomingPublishes( SubscriptionList_t * pxSubscriptionList,
                               MQTTPublishInfo_t * pxPublishInfo )
 {
-    int32_t lIndex = 0;
-    bool isMatched = false, publishHandled = false;
+    /* The trie is at most SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS deep and each
+     * visit adds at most two nodes of the next level, one of which is visited
+     * next: one pending node per level is left at most, and the root. */
+    TrieVisit_t xVisits[ SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS + 1U ];
+    const SubscriptionTrieNode_t * pxNode = NULL;
+    size_t xPending = 0U;
+    uint16_t usNode = NO_LINK, usChild = NO_LINK;
+    uint32_t ulOffset = 0U, ulEnd = 0U;
+    bool xWildcards = false, publishHandled = false;
 
     if( ( pxSubscriptionList == NULL ) ||
         ( pxPublishInfo == NULL ) )
@@ -146,21 +610,63 @@ bool handleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
     }
     else
     {
-        for( lIndex = 0; lIndex < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS; lIndex++ )
+        xVisits[ 0 ].usNode = ROOT_LINK;
+        xVisits[ 0 ].ulOffset = 0U;
+        xPending = 1U;
+
+        while( xPending > 0U )
         {
-            if( pxSubscriptionList[ lIndex ].usFilterStringLength > 0 )
+            xPending--;
+            usNode = xVisits[ xPending ].usNode;
+            ulOffset = xVisits[ xPending ].ulOffset;
+            pxNode = NODE( pxSubscriptionList, usNode );
+
+            /* Filters starting with a wildcard do not match topics starting
+             * with '$'. */
+            xWildcards = ( usNode != ROOT_LINK ) ||
+                         ( pxPublishInfo->topicNameLength == 0U ) ||
+                         ( pxPublishInfo->pTopicName[ 0 ] != '$' );
+
+            /* A "#" level matches the remaining levels, and the parent level
+             * on its own too. */
+            if( ( xWildcards == true ) && ( pxNode->usHashChild != NO_LINK ) )
             {
-                MQTT_MatchTopic( pxPublishInfo->pTopicName,
-                                 pxPublishInfo->topicNameLength,
-                                 pxSubscriptionList[ lIndex ].pcSubscriptionFilterString,
-                                 pxSubscriptionList[ lIndex ].usFilterStringLength,
-                                 &isMatched );
+                publishHandled |= prvDeliver( pxSubscriptionList, pxNode->usHashChild, pxPublishInfo );
+            }
+
+            if( ulOffset > pxPublishInfo->topicNameLength )
+            {
+                /* Every level of the topic was matched. */
+                publishHandled |= prvDeliver( pxSubscriptionList, usNode, pxPublishInfo );
+            }
+            else
+            {
+                ulEnd = ulOffset;
+
+                while( ( ulEnd < pxPublishInfo->topicNameLength ) && ( pxPublishInfo->pTopicName[ ulEnd ] != '/' ) )
+                {
+                    ulEnd++;
+                }
+
+                usChild = prvFindExactChild( pxSubscriptionList,
+                                             usNode,
+                                             &( pxPublishInfo->pTopicName[ ulOffset ] ),
+                                             ( uint16_t ) ( ulEnd - ulOffset ) );
+
+                if( ( usChild != NO_LINK ) && ( xPending < ( sizeof( xVisits ) / sizeof( xVisits[ 0 ] ) ) ) )
+                {
+                    xVisits[ xPending ].usNode = usChild;
+                    xVisits[ xPending ].ulOffset = ulEnd + 1U;
+                    xPending++;
+                }
+
+                usChild = pxNode->usPlusChild;
 
-                if( isMatched == true )
+                if( ( xWildcards == true ) && ( usChild != NO_LINK ) && ( xPending < ( sizeof( xVisits ) / sizeof( xVisits[ 0 ] ) ) ) )
                 {
-                    pxSubscriptionList[ lIndex ].pxIncomingPublishCallback( pxSubscriptionList[ lIndex ].pvIncomingPublishCallbackContext,
-                                                                            pxPublishInfo );
-                    publishHandled = true;
+                    xVisits[ xPending ].usNode = usChild;
+                    xVisits[ xPending ].ulOffset = ulEnd + 1U;
+                    xPending++;
                 }
             }
         }
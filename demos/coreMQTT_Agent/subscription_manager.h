@@ -70,6 +70,31 @@
     #define SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS    10U
 #endif
 
+/**
+ * @brief Number of nodes in the topic filter trie of a list, the root included.
+ *
+ * A topic filter takes one node per level, and shares the nodes of the levels
+ * it starts with in common with other filters. At most 65534.
+ */
+#ifndef SUBSCRIPTION_MANAGER_MAX_TRIE_NODES
+    #define SUBSCRIPTION_MANAGER_MAX_TRIE_NODES    ( ( SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS * 4U ) + 1U )
+#endif
+
+/**
+ * @brief Number of hash buckets over which the trie nodes of the levels that
+ * are not wildcards are spread.
+ */
+#ifndef SUBSCRIPTION_MANAGER_TRIE_BUCKETS
+    #define SUBSCRIPTION_MANAGER_TRIE_BUCKETS    SUBSCRIPTION_MANAGER_MAX_TRIE_NODES
+#endif
+
+/**
+ * @brief Maximum number of levels in a topic filter.
+ */
+#ifndef SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS
+    #define SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS    16U
+#endif
+
 /**
  * @brief Callback function called when receiving a publish.
  *
@@ -82,9 +107,6 @@ typedef void (* IncomingPubCallback_t )( void * pvIncomingPublishCallbackContext
 /**
  * @brief An element in the list of subscriptions.
  *
- * This subscription manager implementation expects that the array of the
- * subscription elements used for storing subscriptions to be initialized to 0.
- *
  * @note This implementation allows multiple tasks to subscribe to the same topic.
  * In this case, another element is added to the subscription list, differing
  * in the intended publish callback. Also note that the topic filters are not
@@ -97,8 +119,51 @@ typedef struct subscriptionElement
     void * pvIncomingPublishCallbackContext;
     uint16_t usFilterStringLength;
     const char * pcSubscriptionFilterString;
+    uint16_t usTrieNode;    /* Node of the last level of the topic filter. */
+    uint16_t usNextElement; /* Next element ending at the same node, or next free element. */
 } SubscriptionElement_t;
 
+/**
+ * @brief A node of the topic filter trie, standing for one level of one or
+ * more topic filters.
+ *
+ * The level itself is not kept, only its hash: filters whose levels collide
+ * share a node, and a publish is only delivered to the subscriptions whose
+ * whole filter matches its topic.
+ */
+typedef struct subscriptionTrieNode
+{
+    uint32_t ulLevelHash;    /* Hash of the level and of the parent node. */
+    uint16_t usLevelLength;
+    uint16_t usParent;
+    uint16_t usNextInBucket; /* Next node in the same bucket, or next free node. */
+    uint16_t usPlusChild;    /* Child for a "+" level. */
+    uint16_t usHashChild;    /* Child for a "#" level. */
+    uint16_t usFirstElement; /* Elements whose topic filter ends at the node. */
+    uint16_t usReferences;   /* Elements whose topic filter goes through the node. */
+} SubscriptionTrieNode_t;
+
+/**
+ * @brief A list of subscriptions, indexed by a trie of the levels of their
+ * topic filters so that an incoming publish is dispatched in a time that
+ * depends on the depth of its topic, not on the number of subscriptions.
+ *
+ * Node 0 is the root of the trie. Links between nodes and elements hold the
+ * index plus one, so that a list initialized to 0 is an empty list; this
+ * subscription manager implementation expects the list to be initialized
+ * to 0.
+ */
+typedef struct subscriptionList
+{
+    SubscriptionElement_t xElements[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
+    SubscriptionTrieNode_t xNodes[ SUBSCRIPTION_MANAGER_MAX_TRIE_NODES ];
+    uint16_t usBuckets[ SUBSCRIPTION_MANAGER_TRIE_BUCKETS ];
+    uint16_t usElementsUsed; /* Elements taken from the array so far. */
+    uint16_t usFreeElements; /* Elements released since. */
+    uint16_t usNodesUsed;    /* Nodes taken from the array so far, the root aside. */
+    uint16_t usFreeNodes;    /* Nodes released since. */
+} SubscriptionList_t;
+
 /**
  * @brief Add a subscription to the subscription list.
  *
@@ -106,15 +171,17 @@ typedef struct subscriptionElement
  * context-callback pairs. However, a single context-callback pair may only be
  * associated to the same topic filter once.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pcTopicFilterString Topic filter string of subscription.
  * @param[in] usTopicFilterLength Length of topic filter string.
  * @param[in] pxIncomingPublishCallback Callback function for the subscription.
  * @param[in] pvIncomingPublishCallbackContext Context for the subscription callback.
  *
- * @return `true` if subscription added or exists, `false` if insufficient memory.
+ * @return `true` if subscription added or exists, `false` if insufficient memory
+ * or if the topic filter has more than SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS
+ * levels.
  */
-bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
+bool addSubscription( SubscriptionList_t * pxSubscriptionList,
                       const char * pcTopicFilterString,
                       uint16_t usTopicFilterLength,
                       IncomingPubCallback_t pxIncomingPublishCallback,
@@ -126,11 +193,11 @@ bool addSubscription( SubscriptionElement_t * pxSubscriptionList,
  * @note If the topic filter exists multiple times in the subscription list,
  * then every instance of the subscription will be removed.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pcTopicFilterString Topic filter of subscription.
  * @param[in] usTopicFilterLength Length of topic filter.
  */
-void removeSubscription( SubscriptionElement_t * pxSubscriptionList,
+void removeSubscription( SubscriptionList_t * pxSubscriptionList,
                          const char * pcTopicFilterString,
                          uint16_t usTopicFilterLength );
 
@@ -138,13 +205,15 @@ void removeSubscription( SubscriptionElement_t * pxSubscriptionList,
  * @brief Handle incoming publishes by invoking the callbacks registered
  * for the incoming publish's topic filter.
  *
- * @param[in] pxSubscriptionList  The pointer to the subscription list array.
+ * @note The callbacks must not add or remove subscriptions of the list.
+ *
+ * @param[in] pxSubscriptionList  The pointer to the subscription list.
  * @param[in] pxPublishInfo Info of incoming publish.
  *
  * @return `true` if an application callback could be invoked;
  *  `false` otherwise.
  */
-bool handleIncomingPublishes( SubscriptionElement_t * pxSubscriptionList,
+bool handleIncomingPublishes( SubscriptionList_t * pxSubscriptionList,
                               MQTTPublishInfo_t * pxPublishInfo );
 
 #endif /* SUBSCRIPTION_MANAGER_H */
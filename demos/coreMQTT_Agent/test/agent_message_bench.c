@@ -0,0 +1,226 @@
+/*
+ * FreeRTOS V202107.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file agent_message_bench.c
+ * @brief Host benchmark of delivering commands to the MQTT agent task.
+ *
+ * Sender tasks each send bursts of commands and wait for the agent to
+ * complete the last of a burst, as a task publishing and waiting for its
+ * callback does. The agent takes one command per receive, as the agent's
+ * command loop does. Commands go through a FreeRTOS queue of pointers, which
+ * the agent used before the ring, then through the ring sent one at a time,
+ * then through the ring sent as one batch per burst. Besides the time per
+ * command, the number of times the agent blocked is counted: on a target,
+ * each is a switch out of and back into the agent task. The timings are host
+ * timings of POSIX threads; the block counts are what carries over. Build and
+ * run from this directory with:
+ *
+ *   gcc -std=c99 -O2 -Istubs \
+ *       -I../../../libraries/common/abstractions/mqtt_agent/include \
+ *       agent_message_bench.c stubs/freertos_stubs.c -pthread \
+ *       -o agent_message_bench && ./agent_message_bench
+ */
+
+#define _POSIX_C_SOURCE    200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../../../libraries/common/abstractions/mqtt_agent/freertos_agent_message.c"
+
+/* The queue the agent used before the ring. */
+#include "queue.h"
+
+#define BENCH_MAX_SENDERS         4U
+#define BENCH_BURSTS              20000U
+#define BENCH_BURST_LENGTH        8U
+#define BENCH_QUEUE_LENGTH        MQTT_AGENT_MESSAGE_RING_LENGTH
+#define BENCH_COMPLETE_NOTIFY_IDX 0U
+
+typedef enum BenchMethod
+{
+    BENCH_QUEUE,
+    BENCH_RING,
+    BENCH_RING_BATCH
+} BenchMethod_t;
+
+struct MQTTAgentCommand
+{
+    TaskHandle_t xSender;
+    bool xLastOfBurst;
+};
+
+static BenchMethod_t xMethod;
+static MQTTAgentMessageContext_t xContext;
+static QueueHandle_t xQueue;
+static MQTTAgentCommand_t xCommands[ BENCH_MAX_SENDERS ][ BENCH_BURST_LENGTH ];
+
+/*-----------------------------------------------------------*/
+
+static double prvNow( void )
+{
+    struct timespec xTime;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xTime );
+
+    return ( ( double ) xTime.tv_sec * 1e9 ) + ( double ) xTime.tv_nsec;
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvSender( void * pvArgument )
+{
+    MQTTAgentCommand_t * pxBurst[ BENCH_BURST_LENGTH ];
+    uint32_t ulSender = ( uint32_t ) ( uintptr_t ) pvArgument;
+    uint32_t ulRound, i;
+
+    for( i = 0; i < BENCH_BURST_LENGTH; i++ )
+    {
+        xCommands[ ulSender ][ i ].xSender = xTaskGetCurrentTaskHandle();
+        xCommands[ ulSender ][ i ].xLastOfBurst = ( i == ( BENCH_BURST_LENGTH - 1U ) ) ? true : false;
+        pxBurst[ i ] = &xCommands[ ulSender ][ i ];
+    }
+
+    for( ulRound = 0; ulRound < BENCH_BURSTS; ulRound++ )
+    {
+        if( xMethod == BENCH_RING_BATCH )
+        {
+            ( void ) Agent_MessageSendBatch( &xContext, pxBurst, BENCH_BURST_LENGTH, portMAX_DELAY );
+        }
+        else
+        {
+            for( i = 0; i < BENCH_BURST_LENGTH; i++ )
+            {
+                if( xMethod == BENCH_QUEUE )
+                {
+                    ( void ) xQueueSendToBack( xQueue, &pxBurst[ i ], portMAX_DELAY );
+                }
+                else
+                {
+                    ( void ) Agent_MessageSend( &xContext, &pxBurst[ i ], portMAX_DELAY );
+                }
+            }
+        }
+
+        ( void ) ulTaskNotifyTakeIndexed( BENCH_COMPLETE_NOTIFY_IDX, pdTRUE, portMAX_DELAY );
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Run the agent on the calling thread until every command is taken.
+ *
+ * @return Nanoseconds per command; the blocks of the agent are added to
+ * pulBlocks.
+ */
+static double prvRun( BenchMethod_t xRunMethod,
+                      uint32_t ulSenders,
+                      uint32_t * pulBlocks )
+{
+    TaskHandle_t xAgent = xTaskGetCurrentTaskHandle();
+    pthread_t xThreads[ BENCH_MAX_SENDERS ];
+    MQTTAgentCommand_t * pxCommand = NULL;
+    uint32_t ulTotal = ulSenders * BENCH_BURSTS * BENCH_BURST_LENGTH;
+    uint32_t ulBlocks = ulStubTaskBlockCount( xAgent );
+    uint32_t ulTaken = 0, i;
+    bool xReceived;
+    double xStart;
+
+    xMethod = xRunMethod;
+    Agent_MessageInit( &xContext );
+    xStart = prvNow();
+
+    for( i = 0; i < ulSenders; i++ )
+    {
+        ( void ) pthread_create( &xThreads[ i ], NULL, prvSender, ( void * ) ( uintptr_t ) i );
+    }
+
+    while( ulTaken < ulTotal )
+    {
+        if( xMethod == BENCH_QUEUE )
+        {
+            xReceived = ( xQueueReceive( xQueue, &pxCommand, portMAX_DELAY ) == pdPASS ) ? true : false;
+        }
+        else
+        {
+            xReceived = Agent_MessageReceive( &xContext, &pxCommand, 1000U );
+        }
+
+        if( xReceived == true )
+        {
+            ulTaken++;
+
+            if( pxCommand->xLastOfBurst == true )
+            {
+                ( void ) xTaskNotifyGiveIndexed( pxCommand->xSender, BENCH_COMPLETE_NOTIFY_IDX );
+            }
+        }
+    }
+
+    for( i = 0; i < ulSenders; i++ )
+    {
+        ( void ) pthread_join( xThreads[ i ], NULL );
+    }
+
+    *pulBlocks = ulStubTaskBlockCount( xAgent ) - ulBlocks;
+
+    return ( prvNow() - xStart ) / ulTotal;
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    static const char * const pcNames[] = { "queue", "ring", "ring batch" };
+    static const uint32_t ulSenderCounts[] = { 1U, BENCH_MAX_SENDERS };
+    uint32_t ulBlocks, ulTotal;
+    size_t i, j;
+    double xTime;
+
+    xQueue = xQueueCreate( BENCH_QUEUE_LENGTH, sizeof( MQTTAgentCommand_t * ) );
+
+    printf( "%8s %12s %14s %22s\n", "senders", "method", "ns/command", "agent blocks/1000 cmd" );
+
+    for( i = 0; i < sizeof( ulSenderCounts ) / sizeof( ulSenderCounts[ 0 ] ); i++ )
+    {
+        for( j = 0; j < sizeof( pcNames ) / sizeof( pcNames[ 0 ] ); j++ )
+        {
+            ulTotal = ulSenderCounts[ i ] * BENCH_BURSTS * BENCH_BURST_LENGTH;
+            xTime = prvRun( ( BenchMethod_t ) j, ulSenderCounts[ i ], &ulBlocks );
+            printf( "%8u %12s %14.1f %22.1f\n", ( unsigned ) ulSenderCounts[ i ], pcNames[ j ],
+                    xTime, ( 1000.0 * ulBlocks ) / ulTotal );
+        }
+    }
+
+    vQueueDelete( xQueue );
+
+    return 0;
+}
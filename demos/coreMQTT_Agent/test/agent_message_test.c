@@ -0,0 +1,324 @@
+/*
+ * FreeRTOS V202107.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file agent_message_test.c
+ * @brief Host test of the ring that carries commands to the MQTT agent task.
+ *
+ * Fixed cases fill, drain and wrap a small ring from one thread and check the
+ * block times. An agent thread then checks that a batch sent while it waits
+ * wakes it once. Last, several sender threads send numbered commands, one at
+ * a time and in batches, to an agent thread taking them in batches of random
+ * size; every command must arrive once and in the order its sender sent it.
+ * Build and run from this directory with:
+ *
+ *   gcc -std=c99 -Wall -Wextra -g -fsanitize=address,undefined -Istubs \
+ *       -I../../../libraries/common/abstractions/mqtt_agent/include \
+ *       agent_message_test.c stubs/freertos_stubs.c -pthread \
+ *       -o agent_message_test && ./agent_message_test
+ */
+
+#define _POSIX_C_SOURCE    200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Small ring, so that it fills and wraps often. */
+#define MQTT_AGENT_MESSAGE_RING_LENGTH    8U
+
+#include "../../../libraries/common/abstractions/mqtt_agent/freertos_agent_message.c"
+
+#define TEST_SENDERS                4U
+#define TEST_COMMANDS_PER_SENDER    50000U
+#define TEST_MAX_BATCH              12U
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+struct MQTTAgentCommand
+{
+    uint32_t ulSender;
+    uint32_t ulSequence;
+};
+
+static uint32_t ulFailures = 0;
+static MQTTAgentMessageContext_t xContext;
+static MQTTAgentCommand_t xCommands[ TEST_SENDERS ][ TEST_COMMANDS_PER_SENDER ];
+static TaskHandle_t xAgentTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+static void prvTestFixedCases( void )
+{
+    MQTTAgentCommand_t xFixed[ 3U * MQTT_AGENT_MESSAGE_RING_LENGTH ];
+    MQTTAgentCommand_t * pxSend[ 3U * MQTT_AGENT_MESSAGE_RING_LENGTH ];
+    MQTTAgentCommand_t * pxReceived[ 3U * MQTT_AGENT_MESSAGE_RING_LENGTH ];
+    MQTTAgentCommand_t * pxOne = NULL;
+    uint32_t i, ulPass, ulNext = 0, ulStart;
+    size_t xCount;
+
+    Agent_MessageInit( &xContext );
+
+    for( i = 0; i < 3U * MQTT_AGENT_MESSAGE_RING_LENGTH; i++ )
+    {
+        xFixed[ i ].ulSender = 0;
+        xFixed[ i ].ulSequence = i;
+        pxSend[ i ] = &xFixed[ i ];
+    }
+
+    /* Nothing to receive. */
+    TEST_CHECK( Agent_MessageReceive( &xContext, &pxOne, 0 ) == false );
+    ulStart = xTaskGetTickCount();
+    TEST_CHECK( Agent_MessageReceiveBatch( &xContext, pxReceived, 4, 20 ) == 0U );
+    TEST_CHECK( ( xTaskGetTickCount() - ulStart ) >= 19U );
+
+    /* Bad parameters. */
+    TEST_CHECK( Agent_MessageSend( NULL, &pxSend[ 0 ], 0 ) == false );
+    TEST_CHECK( Agent_MessageSend( &xContext, NULL, 0 ) == false );
+    TEST_CHECK( Agent_MessageReceive( NULL, &pxOne, 0 ) == false );
+    TEST_CHECK( Agent_MessageReceiveBatch( &xContext, pxReceived, 0, 0 ) == 0U );
+    TEST_CHECK( Agent_MessageSendBatch( &xContext, pxSend, 0, 0 ) == 0U );
+
+    /* Fill, refuse, then drain in pieces, over several passes of the ring. */
+    for( ulPass = 0; ulPass < 5U; ulPass++ )
+    {
+        for( i = 0; i < MQTT_AGENT_MESSAGE_RING_LENGTH; i++ )
+        {
+            TEST_CHECK( Agent_MessageSend( &xContext, &pxSend[ i ], 0 ) == true );
+        }
+
+        TEST_CHECK( Agent_MessageSend( &xContext, &pxSend[ 0 ], 0 ) == false );
+        ulStart = xTaskGetTickCount();
+        TEST_CHECK( Agent_MessageSend( &xContext, &pxSend[ 0 ], 10 ) == false );
+        TEST_CHECK( ( xTaskGetTickCount() - ulStart ) >= 9U );
+
+        xCount = Agent_MessageReceiveBatch( &xContext, pxReceived, 3, 0 );
+        TEST_CHECK( xCount == 3U );
+
+        for( i = 0; i < xCount; i++ )
+        {
+            TEST_CHECK( pxReceived[ i ] == pxSend[ i ] );
+        }
+
+        TEST_CHECK( Agent_MessageReceive( &xContext, &pxOne, 0 ) == true );
+        TEST_CHECK( pxOne == pxSend[ 3 ] );
+
+        xCount = Agent_MessageReceiveBatch( &xContext, pxReceived, 3U * MQTT_AGENT_MESSAGE_RING_LENGTH, 0 );
+        TEST_CHECK( xCount == ( MQTT_AGENT_MESSAGE_RING_LENGTH - 4U ) );
+
+        for( i = 0; i < xCount; i++ )
+        {
+            TEST_CHECK( pxReceived[ i ] == pxSend[ i + 4U ] );
+        }
+    }
+
+    /* A batch larger than the ring sends what fits, from the start. */
+    TEST_CHECK( Agent_MessageSendBatch( &xContext, pxSend, 3U * MQTT_AGENT_MESSAGE_RING_LENGTH, 0 ) == MQTT_AGENT_MESSAGE_RING_LENGTH );
+    xCount = Agent_MessageReceiveBatch( &xContext, pxReceived, 3U * MQTT_AGENT_MESSAGE_RING_LENGTH, 0 );
+    TEST_CHECK( xCount == MQTT_AGENT_MESSAGE_RING_LENGTH );
+
+    for( i = 0; i < xCount; i++ )
+    {
+        TEST_CHECK( pxReceived[ i ] == pxSend[ ulNext++ ] );
+    }
+
+    TEST_CHECK( Agent_MessageReceive( &xContext, &pxOne, 0 ) == false );
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvBatchAgent( void * pvArgument )
+{
+    MQTTAgentCommand_t * pxReceived[ MQTT_AGENT_MESSAGE_RING_LENGTH ];
+    size_t * pxCount = pvArgument;
+
+    __atomic_store_n( &xAgentTask, xTaskGetCurrentTaskHandle(), __ATOMIC_SEQ_CST );
+    *pxCount = Agent_MessageReceiveBatch( &xContext, pxReceived, MQTT_AGENT_MESSAGE_RING_LENGTH, 5000 );
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestSingleWake( void )
+{
+    MQTTAgentCommand_t xFixed[ MQTT_AGENT_MESSAGE_RING_LENGTH ];
+    MQTTAgentCommand_t * pxSend[ MQTT_AGENT_MESSAGE_RING_LENGTH ];
+    pthread_t xThread;
+    TaskHandle_t xTask = NULL;
+    size_t xCount = 0;
+    uint32_t i;
+
+    Agent_MessageInit( &xContext );
+
+    for( i = 0; i < MQTT_AGENT_MESSAGE_RING_LENGTH; i++ )
+    {
+        pxSend[ i ] = &xFixed[ i ];
+    }
+
+    xAgentTask = NULL;
+    TEST_CHECK( pthread_create( &xThread, NULL, prvBatchAgent, &xCount ) == 0 );
+
+    /* Wait for the agent to block on the empty ring. */
+    while( ( xTask == NULL ) || ( xStubTaskIsBlocked( xTask ) == pdFALSE ) )
+    {
+        vTaskDelay( 1 );
+        xTask = __atomic_load_n( &xAgentTask, __ATOMIC_SEQ_CST );
+    }
+
+    TEST_CHECK( Agent_MessageSendBatch( &xContext, pxSend, MQTT_AGENT_MESSAGE_RING_LENGTH, 0 ) == MQTT_AGENT_MESSAGE_RING_LENGTH );
+    TEST_CHECK( pthread_join( xThread, NULL ) == 0 );
+
+    /* The agent was woken once and took the whole batch. */
+    TEST_CHECK( xCount == MQTT_AGENT_MESSAGE_RING_LENGTH );
+    TEST_CHECK( ulStubTaskNotifyCount( xTask ) == 1U );
+    TEST_CHECK( ulStubTaskBlockCount( xTask ) == 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvSender( void * pvArgument )
+{
+    uint32_t ulSender = ( uint32_t ) ( uintptr_t ) pvArgument;
+    MQTTAgentCommand_t * pxSend[ TEST_MAX_BATCH ];
+    uint32_t ulNext = 0, ulBatch, i;
+    unsigned int uSeed = ulSender;
+
+    while( ulNext < TEST_COMMANDS_PER_SENDER )
+    {
+        ulBatch = ( ( uint32_t ) rand_r( &uSeed ) % TEST_MAX_BATCH ) + 1U;
+
+        if( ulBatch > ( TEST_COMMANDS_PER_SENDER - ulNext ) )
+        {
+            ulBatch = TEST_COMMANDS_PER_SENDER - ulNext;
+        }
+
+        for( i = 0; i < ulBatch; i++ )
+        {
+            pxSend[ i ] = &xCommands[ ulSender ][ ulNext + i ];
+        }
+
+        if( ulBatch == 1U )
+        {
+            TEST_CHECK( Agent_MessageSend( &xContext, &pxSend[ 0 ], 5000 ) == true );
+        }
+        else
+        {
+            TEST_CHECK( Agent_MessageSendBatch( &xContext, pxSend, ulBatch, 5000 ) == ulBatch );
+        }
+
+        ulNext += ulBatch;
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestConcurrentSenders( void )
+{
+    MQTTAgentCommand_t * pxReceived[ TEST_MAX_BATCH ];
+    pthread_t xThreads[ TEST_SENDERS ];
+    uint32_t ulExpected[ TEST_SENDERS ] = { 0 };
+    uint32_t ulReceived = 0, ulNotifications, i, j;
+    size_t xCount;
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    unsigned int uSeed = 7U;
+
+    Agent_MessageInit( &xContext );
+    ulNotifications = ulStubTaskNotifyCount( xTask );
+
+    for( i = 0; i < TEST_SENDERS; i++ )
+    {
+        for( j = 0; j < TEST_COMMANDS_PER_SENDER; j++ )
+        {
+            xCommands[ i ][ j ].ulSender = i;
+            xCommands[ i ][ j ].ulSequence = j;
+        }
+
+        TEST_CHECK( pthread_create( &xThreads[ i ], NULL, prvSender, ( void * ) ( uintptr_t ) i ) == 0 );
+    }
+
+    /* This thread is the agent. */
+    while( ulReceived < ( TEST_SENDERS * TEST_COMMANDS_PER_SENDER ) )
+    {
+        xCount = Agent_MessageReceiveBatch( &xContext, pxReceived, ( ( size_t ) rand_r( &uSeed ) % TEST_MAX_BATCH ) + 1U, 5000 );
+        TEST_CHECK( xCount > 0U );
+
+        if( xCount == 0U )
+        {
+            break;
+        }
+
+        for( i = 0; i < xCount; i++ )
+        {
+            TEST_CHECK( pxReceived[ i ]->ulSender < TEST_SENDERS );
+
+            if( pxReceived[ i ]->ulSender < TEST_SENDERS )
+            {
+                TEST_CHECK( pxReceived[ i ]->ulSequence == ulExpected[ pxReceived[ i ]->ulSender ] );
+                ulExpected[ pxReceived[ i ]->ulSender ] = pxReceived[ i ]->ulSequence + 1U;
+            }
+        }
+
+        ulReceived += ( uint32_t ) xCount;
+    }
+
+    for( i = 0; i < TEST_SENDERS; i++ )
+    {
+        TEST_CHECK( pthread_join( xThreads[ i ], NULL ) == 0 );
+        TEST_CHECK( ulExpected[ i ] == TEST_COMMANDS_PER_SENDER );
+    }
+
+    TEST_CHECK( Agent_MessageReceive( &xContext, &pxReceived[ 0 ], 0 ) == false );
+
+    /* The agent is only notified while it waits, so never more often than
+     * commands were sent. */
+    ulNotifications = ulStubTaskNotifyCount( xTask ) - ulNotifications;
+    TEST_CHECK( ulNotifications <= ulReceived );
+    printf( "%u commands from %u senders, %u notifications of the agent.\n",
+            ( unsigned ) ulReceived, ( unsigned ) TEST_SENDERS, ( unsigned ) ulNotifications );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    prvTestFixedCases();
+    prvTestSingleWake();
+    prvTestConcurrentSenders();
+
+    printf( "%s: %u failures\n", ( ulFailures == 0U ) ? "PASS" : "FAIL", ( unsigned ) ulFailures );
+
+    return ( ulFailures == 0U ) ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+/*
+ * Host build stand-in for FreeRTOS.h, used by the coreMQTT-Agent demo tests.
+ *
+ * Only what the agent message ring uses is provided. Tasks are POSIX threads
+ * and a tick is a millisecond; see freertos_stubs.c.
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long             BaseType_t;
+typedef unsigned long    UBaseType_t;
+typedef uint32_t         TickType_t;
+
+#define pdFALSE                      ( ( BaseType_t ) 0 )
+#define pdTRUE                       ( ( BaseType_t ) 1 )
+#define pdFAIL                       ( pdFALSE )
+#define pdPASS                       ( pdTRUE )
+
+#define portMAX_DELAY                ( ( TickType_t ) 0xffffffffUL )
+#define portTICK_PERIOD_MS           ( ( TickType_t ) 1 )
+#define pdMS_TO_TICKS( xTimeInMs )    ( ( TickType_t ) ( xTimeInMs ) )
+
+#define configASSERT( x )    assert( x )
+
+#endif /* INC_FREERTOS_H */
@@ -0,0 +1,24 @@
+/*
+ * Host build stand-in for atomic.h, used by the coreMQTT-Agent demo tests.
+ *
+ * The compare-and-swap is the compiler's sequentially consistent builtin.
+ */
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdint.h>
+
+#define ATOMIC_COMPARE_AND_SWAP_SUCCESS    0x1U
+#define ATOMIC_COMPARE_AND_SWAP_FAILURE    0x0U
+
+static inline uint32_t Atomic_CompareAndSwap_u32( uint32_t volatile * pulDestination,
+                                                  uint32_t ulExchange,
+                                                  uint32_t ulComparand )
+{
+    return __atomic_compare_exchange_n( pulDestination, &ulComparand, ulExchange, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) ? ATOMIC_COMPARE_AND_SWAP_SUCCESS :
+           ATOMIC_COMPARE_AND_SWAP_FAILURE;
+}
+
+#endif /* ATOMIC_H */
@@ -0,0 +1,52 @@
+/*
+ * Host build stand-in for core_mqtt.h, used by the coreMQTT-Agent demo tests.
+ *
+ * Only the publish description, the topic matcher, the time function type
+ * and the PUBLISH packet type are provided; the matcher is in
+ * core_mqtt_stubs.c.
+ */
+
+#ifndef CORE_MQTT_H
+#define CORE_MQTT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "transport_interface.h"
+
+#define MQTT_PACKET_TYPE_PUBLISH    ( ( uint8_t ) 0x30U )
+
+typedef uint32_t ( * MQTTGetCurrentTimeFunc_t )( void );
+
+typedef enum MQTTStatus
+{
+    MQTTSuccess = 0,
+    MQTTBadParameter
+} MQTTStatus_t;
+
+typedef enum MQTTQoS
+{
+    MQTTQoS0 = 0,
+    MQTTQoS1 = 1,
+    MQTTQoS2 = 2
+} MQTTQoS_t;
+
+typedef struct MQTTPublishInfo
+{
+    MQTTQoS_t qos;
+    bool retain;
+    bool dup;
+    const char * pTopicName;
+    uint16_t topicNameLength;
+    const void * pPayload;
+    size_t payloadLength;
+} MQTTPublishInfo_t;
+
+MQTTStatus_t MQTT_MatchTopic( const char * pTopicName,
+                              const uint16_t topicNameLength,
+                              const char * pTopicFilter,
+                              const uint16_t topicFilterLength,
+                              bool * pIsMatch );
+
+#endif /* CORE_MQTT_H */
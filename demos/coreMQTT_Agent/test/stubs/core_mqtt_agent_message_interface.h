@@ -0,0 +1,15 @@
+/*
+ * Host build stand-in for core_mqtt_agent_message_interface.h, used by the
+ * coreMQTT-Agent demo tests.
+ *
+ * Only the types named by freertos_agent_message.h are provided; tests define
+ * struct MQTTAgentCommand themselves.
+ */
+
+#ifndef CORE_MQTT_AGENT_MESSAGE_INTERFACE_H
+#define CORE_MQTT_AGENT_MESSAGE_INTERFACE_H
+
+typedef struct MQTTAgentMessageContext   MQTTAgentMessageContext_t;
+typedef struct MQTTAgentCommand          MQTTAgentCommand_t;
+
+#endif /* CORE_MQTT_AGENT_MESSAGE_INTERFACE_H */
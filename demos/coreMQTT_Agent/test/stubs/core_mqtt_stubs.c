@@ -0,0 +1,99 @@
+/*
+ * Host build stand-in for the coreMQTT topic matcher, used by the
+ * coreMQTT-Agent demo tests.
+ *
+ * Matches a topic name against a topic filter as MQTT 3.1.1 section 4.7
+ * describes: "+" matches one level, a trailing "#" matches the parent level
+ * and every level below it, and a filter starting with a wildcard does not
+ * match a topic starting with '$'.
+ */
+
+#include "core_mqtt.h"
+
+MQTTStatus_t MQTT_MatchTopic( const char * pTopicName,
+                              const uint16_t topicNameLength,
+                              const char * pTopicFilter,
+                              const uint16_t topicFilterLength,
+                              bool * pIsMatch )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint16_t nameIndex = 0U, filterIndex = 0U;
+    bool matched = false, done = false;
+
+    if( ( pTopicName == NULL ) || ( topicNameLength == 0U ) ||
+        ( pTopicFilter == NULL ) || ( topicFilterLength == 0U ) ||
+        ( pIsMatch == NULL ) )
+    {
+        status = MQTTBadParameter;
+    }
+    else if( ( pTopicName[ 0 ] == '$' ) &&
+             ( ( pTopicFilter[ 0 ] == '+' ) || ( pTopicFilter[ 0 ] == '#' ) ) )
+    {
+        done = true;
+    }
+
+    /* Each pass matches one level of the filter against one of the topic. */
+    while( ( status == MQTTSuccess ) && ( done == false ) )
+    {
+        if( ( pTopicFilter[ filterIndex ] == '#' ) && ( filterIndex + 1U == topicFilterLength ) )
+        {
+            matched = true;
+            done = true;
+        }
+        else if( ( pTopicFilter[ filterIndex ] == '+' ) &&
+                 ( ( filterIndex + 1U == topicFilterLength ) || ( pTopicFilter[ filterIndex + 1U ] == '/' ) ) )
+        {
+            while( ( nameIndex < topicNameLength ) && ( pTopicName[ nameIndex ] != '/' ) )
+            {
+                nameIndex++;
+            }
+
+            filterIndex++;
+        }
+        else
+        {
+            while( ( filterIndex < topicFilterLength ) && ( pTopicFilter[ filterIndex ] != '/' ) &&
+                   ( nameIndex < topicNameLength ) && ( pTopicName[ nameIndex ] == pTopicFilter[ filterIndex ] ) )
+            {
+                nameIndex++;
+                filterIndex++;
+            }
+
+            if( ( ( filterIndex < topicFilterLength ) && ( pTopicFilter[ filterIndex ] != '/' ) ) ||
+                ( ( nameIndex < topicNameLength ) && ( pTopicName[ nameIndex ] != '/' ) ) )
+            {
+                /* The levels differ. */
+                done = true;
+            }
+        }
+
+        if( done == false )
+        {
+            /* Both levels ended: at the end of both strings, or at a '/'. */
+            if( filterIndex == topicFilterLength )
+            {
+                matched = ( nameIndex == topicNameLength );
+                done = true;
+            }
+            else if( nameIndex == topicNameLength )
+            {
+                /* "a/#" matches "a" as well. */
+                matched = ( filterIndex + 2U == topicFilterLength ) &&
+                          ( pTopicFilter[ filterIndex + 1U ] == '#' );
+                done = true;
+            }
+            else
+            {
+                nameIndex++;
+                filterIndex++;
+            }
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        *pIsMatch = matched;
+    }
+
+    return status;
+}
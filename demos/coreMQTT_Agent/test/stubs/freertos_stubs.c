@@ -0,0 +1,347 @@
+/*
+ * Host build stand-ins for the FreeRTOS calls made by the agent message ring
+ * and its benchmark.
+ *
+ * Each thread that calls in is given one of a fixed set of task records, so
+ * that its handle stays valid for other threads once it ends. A task blocks
+ * on a condition variable of its own, both for notifications and for queues.
+ * A tick is a millisecond of the monotonic clock.
+ */
+
+#define _POSIX_C_SOURCE    200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#define STUB_MAX_TASKS    16U
+
+typedef struct StubTask
+{
+    pthread_mutex_t xMutex;
+    pthread_cond_t xCondition;
+    uint32_t ulNotifyValue[ configTASK_NOTIFICATION_ARRAY_ENTRIES ];
+    BaseType_t xBlocked;
+    uint32_t ulBlockCount;
+    uint32_t ulNotifyCount;
+} StubTask_t;
+
+typedef struct StubQueue
+{
+    pthread_mutex_t xMutex;
+    pthread_cond_t xNotEmpty;
+    pthread_cond_t xNotFull;
+    uint8_t * pucStorage;
+    UBaseType_t uxLength;
+    UBaseType_t uxItemSize;
+    UBaseType_t uxHead;
+    UBaseType_t uxCount;
+} StubQueue_t;
+
+static StubTask_t xTasks[ STUB_MAX_TASKS ];
+static uint32_t ulTaskCount = 0;
+static __thread StubTask_t * pxCurrentTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    uint32_t ulIndex;
+
+    if( NULL == pxCurrentTask )
+    {
+        ulIndex = __atomic_fetch_add( &ulTaskCount, 1U, __ATOMIC_SEQ_CST );
+        assert( ulIndex < STUB_MAX_TASKS );
+        pxCurrentTask = &xTasks[ ulIndex ];
+        ( void ) pthread_mutex_init( &pxCurrentTask->xMutex, NULL );
+        ( void ) pthread_cond_init( &pxCurrentTask->xCondition, NULL );
+    }
+
+    return pxCurrentTask;
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+    struct timespec xDelay;
+
+    xDelay.tv_sec = ( time_t ) ( xTicksToDelay / 1000U );
+    xDelay.tv_nsec = ( long ) ( xTicksToDelay % 1000U ) * 1000000L;
+    ( void ) nanosleep( &xDelay, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+TickType_t xTaskGetTickCount( void )
+{
+    struct timespec xNow;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( TickType_t ) ( ( xNow.tv_sec * 1000 ) + ( xNow.tv_nsec / 1000000 ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskSetTimeOutState( TimeOut_t * const pxTimeOut )
+{
+    pxTimeOut->xTimeOnEntering = xTaskGetTickCount();
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xTaskCheckForTimeOut( TimeOut_t * const pxTimeOut,
+                                 TickType_t * const pxTicksToWait )
+{
+    BaseType_t xTimedOut = pdFALSE;
+    TickType_t xNow = xTaskGetTickCount();
+    TickType_t xElapsed = xNow - pxTimeOut->xTimeOnEntering;
+
+    if( portMAX_DELAY == *pxTicksToWait )
+    {
+        /* Waits forever. */
+    }
+    else if( xElapsed < *pxTicksToWait )
+    {
+        *pxTicksToWait -= xElapsed;
+        pxTimeOut->xTimeOnEntering = xNow;
+    }
+    else
+    {
+        *pxTicksToWait = 0;
+        xTimedOut = pdTRUE;
+    }
+
+    return xTimedOut;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Turn a number of ticks from now into a deadline of the clock the
+ * condition variables use.
+ */
+static void prvDeadline( TickType_t xTicksToWait,
+                         struct timespec * pxDeadline )
+{
+    ( void ) clock_gettime( CLOCK_REALTIME, pxDeadline );
+    pxDeadline->tv_sec += ( time_t ) ( xTicksToWait / 1000U );
+    pxDeadline->tv_nsec += ( long ) ( xTicksToWait % 1000U ) * 1000000L;
+
+    if( pxDeadline->tv_nsec >= 1000000000L )
+    {
+        pxDeadline->tv_sec++;
+        pxDeadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Block the calling task on a condition variable until it is signalled
+ * or the deadline passes. The mutex is held.
+ *
+ * @return 0, or ETIMEDOUT.
+ */
+static int prvBlock( pthread_cond_t * pxCondition,
+                     pthread_mutex_t * pxMutex,
+                     TickType_t xTicksToWait,
+                     const struct timespec * pxDeadline )
+{
+    StubTask_t * pxTask = xTaskGetCurrentTaskHandle();
+    int lResult;
+
+    __atomic_store_n( &pxTask->xBlocked, pdTRUE, __ATOMIC_SEQ_CST );
+    pxTask->ulBlockCount++;
+
+    if( portMAX_DELAY == xTicksToWait )
+    {
+        lResult = pthread_cond_wait( pxCondition, pxMutex );
+    }
+    else
+    {
+        lResult = pthread_cond_timedwait( pxCondition, pxMutex, pxDeadline );
+    }
+
+    __atomic_store_n( &pxTask->xBlocked, pdFALSE, __ATOMIC_SEQ_CST );
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xTaskNotifyGiveIndexed( TaskHandle_t xTaskToNotify,
+                                   UBaseType_t uxIndexToNotify )
+{
+    assert( uxIndexToNotify < configTASK_NOTIFICATION_ARRAY_ENTRIES );
+
+    ( void ) pthread_mutex_lock( &xTaskToNotify->xMutex );
+    xTaskToNotify->ulNotifyValue[ uxIndexToNotify ]++;
+    xTaskToNotify->ulNotifyCount++;
+    ( void ) pthread_cond_signal( &xTaskToNotify->xCondition );
+    ( void ) pthread_mutex_unlock( &xTaskToNotify->xMutex );
+
+    return pdPASS;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulTaskNotifyTakeIndexed( UBaseType_t uxIndexToWaitOn,
+                                  BaseType_t xClearCountOnExit,
+                                  TickType_t xTicksToWait )
+{
+    StubTask_t * pxTask = xTaskGetCurrentTaskHandle();
+    struct timespec xDeadline;
+    uint32_t ulValue;
+    int lResult = 0;
+
+    assert( uxIndexToWaitOn < configTASK_NOTIFICATION_ARRAY_ENTRIES );
+    prvDeadline( xTicksToWait, &xDeadline );
+
+    ( void ) pthread_mutex_lock( &pxTask->xMutex );
+
+    while( ( 0U == pxTask->ulNotifyValue[ uxIndexToWaitOn ] ) && ( 0U != xTicksToWait ) && ( 0 == lResult ) )
+    {
+        lResult = prvBlock( &pxTask->xCondition, &pxTask->xMutex, xTicksToWait, &xDeadline );
+    }
+
+    ulValue = pxTask->ulNotifyValue[ uxIndexToWaitOn ];
+
+    if( 0U != ulValue )
+    {
+        pxTask->ulNotifyValue[ uxIndexToWaitOn ] = ( pdFALSE != xClearCountOnExit ) ? 0U : ( ulValue - 1U );
+    }
+
+    ( void ) pthread_mutex_unlock( &pxTask->xMutex );
+
+    return ulValue;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulStubTaskBlockCount( TaskHandle_t xTask )
+{
+    return xTask->ulBlockCount;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulStubTaskNotifyCount( TaskHandle_t xTask )
+{
+    uint32_t ulCount;
+
+    ( void ) pthread_mutex_lock( &xTask->xMutex );
+    ulCount = xTask->ulNotifyCount;
+    ( void ) pthread_mutex_unlock( &xTask->xMutex );
+
+    return ulCount;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xStubTaskIsBlocked( TaskHandle_t xTask )
+{
+    return __atomic_load_n( &xTask->xBlocked, __ATOMIC_SEQ_CST );
+}
+
+/*-----------------------------------------------------------*/
+
+QueueHandle_t xQueueCreate( UBaseType_t uxQueueLength,
+                            UBaseType_t uxItemSize )
+{
+    StubQueue_t * pxQueue = calloc( 1, sizeof( StubQueue_t ) );
+
+    if( NULL != pxQueue )
+    {
+        pxQueue->pucStorage = malloc( uxQueueLength * uxItemSize );
+        pxQueue->uxLength = uxQueueLength;
+        pxQueue->uxItemSize = uxItemSize;
+        ( void ) pthread_mutex_init( &pxQueue->xMutex, NULL );
+        ( void ) pthread_cond_init( &pxQueue->xNotEmpty, NULL );
+        ( void ) pthread_cond_init( &pxQueue->xNotFull, NULL );
+    }
+
+    return pxQueue;
+}
+
+/*-----------------------------------------------------------*/
+
+void vQueueDelete( QueueHandle_t xQueue )
+{
+    ( void ) pthread_mutex_destroy( &xQueue->xMutex );
+    ( void ) pthread_cond_destroy( &xQueue->xNotEmpty );
+    ( void ) pthread_cond_destroy( &xQueue->xNotFull );
+    free( xQueue->pucStorage );
+    free( xQueue );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xQueueSendToBack( QueueHandle_t xQueue,
+                             const void * pvItemToQueue,
+                             TickType_t xTicksToWait )
+{
+    BaseType_t xSent = pdFAIL;
+    struct timespec xDeadline;
+    int lResult = 0;
+
+    prvDeadline( xTicksToWait, &xDeadline );
+    ( void ) pthread_mutex_lock( &xQueue->xMutex );
+
+    while( ( xQueue->uxCount == xQueue->uxLength ) && ( 0U != xTicksToWait ) && ( 0 == lResult ) )
+    {
+        lResult = prvBlock( &xQueue->xNotFull, &xQueue->xMutex, xTicksToWait, &xDeadline );
+    }
+
+    if( xQueue->uxCount < xQueue->uxLength )
+    {
+        memcpy( &xQueue->pucStorage[ ( ( xQueue->uxHead + xQueue->uxCount ) % xQueue->uxLength ) * xQueue->uxItemSize ],
+                pvItemToQueue,
+                xQueue->uxItemSize );
+        xQueue->uxCount++;
+        ( void ) pthread_cond_signal( &xQueue->xNotEmpty );
+        xSent = pdPASS;
+    }
+
+    ( void ) pthread_mutex_unlock( &xQueue->xMutex );
+
+    return xSent;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xQueueReceive( QueueHandle_t xQueue,
+                          void * pvBuffer,
+                          TickType_t xTicksToWait )
+{
+    BaseType_t xReceived = pdFAIL;
+    struct timespec xDeadline;
+    int lResult = 0;
+
+    prvDeadline( xTicksToWait, &xDeadline );
+    ( void ) pthread_mutex_lock( &xQueue->xMutex );
+
+    while( ( 0U == xQueue->uxCount ) && ( 0U != xTicksToWait ) && ( 0 == lResult ) )
+    {
+        lResult = prvBlock( &xQueue->xNotEmpty, &xQueue->xMutex, xTicksToWait, &xDeadline );
+    }
+
+    if( 0U != xQueue->uxCount )
+    {
+        memcpy( pvBuffer, &xQueue->pucStorage[ xQueue->uxHead * xQueue->uxItemSize ], xQueue->uxItemSize );
+        xQueue->uxHead = ( xQueue->uxHead + 1U ) % xQueue->uxLength;
+        xQueue->uxCount--;
+        ( void ) pthread_cond_signal( &xQueue->xNotFull );
+        xReceived = pdPASS;
+    }
+
+    ( void ) pthread_mutex_unlock( &xQueue->xMutex );
+
+    return xReceived;
+}
@@ -0,0 +1,15 @@
+/*
+ * Host build stand-in for logging_levels.h, used by the coreMQTT-Agent demo
+ * tests.
+ */
+
+#ifndef LOGGING_LEVELS_H_
+#define LOGGING_LEVELS_H_
+
+#define LOG_NONE     0
+#define LOG_ERROR    1
+#define LOG_WARN     2
+#define LOG_INFO     3
+#define LOG_DEBUG    4
+
+#endif /* LOGGING_LEVELS_H_ */
@@ -0,0 +1,14 @@
+/*
+ * Host build stand-in for logging_stack.h, used by the coreMQTT-Agent demo
+ * tests. Logging is compiled out so that a test only prints its own results.
+ */
+
+#ifndef LOGGING_STACK_H_
+#define LOGGING_STACK_H_
+
+#define LogError( message )
+#define LogWarn( message )
+#define LogInfo( message )
+#define LogDebug( message )
+
+#endif /* LOGGING_STACK_H_ */
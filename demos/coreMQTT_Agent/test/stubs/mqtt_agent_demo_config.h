@@ -0,0 +1,10 @@
+/*
+ * Host build stand-in for mqtt_agent_demo_config.h, used by the
+ * coreMQTT-Agent demo tests. Each test sets the configuration it needs
+ * before including the module under test.
+ */
+
+#ifndef MQTT_AGENT_DEMO_CONFIG_H_
+#define MQTT_AGENT_DEMO_CONFIG_H_
+
+#endif /* MQTT_AGENT_DEMO_CONFIG_H_ */
@@ -0,0 +1,31 @@
+/*
+ * Host build stand-in for queue.h, used by the coreMQTT-Agent demo tests.
+ *
+ * Only what the benchmark needs to compare the agent message ring with a
+ * queue of command pointers is provided. A task blocked on a queue counts
+ * towards ulStubTaskBlockCount().
+ */
+
+#ifndef INC_QUEUE_H
+#define INC_QUEUE_H
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include queue.h"
+#endif
+
+typedef struct StubQueue * QueueHandle_t;
+
+QueueHandle_t xQueueCreate( UBaseType_t uxQueueLength,
+                            UBaseType_t uxItemSize );
+
+void vQueueDelete( QueueHandle_t xQueue );
+
+BaseType_t xQueueSendToBack( QueueHandle_t xQueue,
+                             const void * pvItemToQueue,
+                             TickType_t xTicksToWait );
+
+BaseType_t xQueueReceive( QueueHandle_t xQueue,
+                          void * pvBuffer,
+                          TickType_t xTicksToWait );
+
+#endif /* INC_QUEUE_H */
@@ -0,0 +1,49 @@
+/*
+ * Host build stand-in for task.h, used by the coreMQTT-Agent demo tests.
+ *
+ * Any thread calling these functions is a task; its handle and notification
+ * values are made on first use. The stubs also count, per task, how often it
+ * blocked and was notified, so that tests can tell how many times a task
+ * would have been switched in.
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include task.h"
+#endif
+
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES    4
+
+typedef struct StubTask * TaskHandle_t;
+
+typedef struct xTIME_OUT
+{
+    TickType_t xTimeOnEntering;
+} TimeOut_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
+
+void vTaskDelay( const TickType_t xTicksToDelay );
+
+TickType_t xTaskGetTickCount( void );
+
+void vTaskSetTimeOutState( TimeOut_t * const pxTimeOut );
+
+BaseType_t xTaskCheckForTimeOut( TimeOut_t * const pxTimeOut,
+                                 TickType_t * const pxTicksToWait );
+
+BaseType_t xTaskNotifyGiveIndexed( TaskHandle_t xTaskToNotify,
+                                   UBaseType_t uxIndexToNotify );
+
+uint32_t ulTaskNotifyTakeIndexed( UBaseType_t uxIndexToWaitOn,
+                                  BaseType_t xClearCountOnExit,
+                                  TickType_t xTicksToWait );
+
+/* Counters of the stubs. */
+uint32_t ulStubTaskBlockCount( TaskHandle_t xTask );
+uint32_t ulStubTaskNotifyCount( TaskHandle_t xTask );
+BaseType_t xStubTaskIsBlocked( TaskHandle_t xTask );
+
+#endif /* INC_TASK_H */
@@ -0,0 +1,40 @@
+/*
+ * Host build stand-in for transport_interface.h, used by the coreMQTT-Agent
+ * demo tests. The network context is left to the test to define.
+ */
+
+#ifndef TRANSPORT_INTERFACE_H_
+#define TRANSPORT_INTERFACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct NetworkContext NetworkContext_t;
+
+typedef struct TransportOutVector
+{
+    const void * iov_base;
+    size_t iov_len;
+} TransportOutVector_t;
+
+typedef int32_t ( * TransportRecv_t )( NetworkContext_t * pNetworkContext,
+                                       void * pBuffer,
+                                       size_t bytesToRecv );
+
+typedef int32_t ( * TransportSend_t )( NetworkContext_t * pNetworkContext,
+                                       const void * pBuffer,
+                                       size_t bytesToSend );
+
+typedef int32_t ( * TransportWritev_t )( NetworkContext_t * pNetworkContext,
+                                         TransportOutVector_t * pIoVec,
+                                         size_t ioVecCount );
+
+typedef struct TransportInterface
+{
+    TransportRecv_t recv;
+    TransportSend_t send;
+    TransportWritev_t writev;
+    NetworkContext_t * pNetworkContext;
+} TransportInterface_t;
+
+#endif /* TRANSPORT_INTERFACE_H_ */
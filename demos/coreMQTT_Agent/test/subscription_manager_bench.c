@@ -0,0 +1,198 @@
+/*
+ * FreeRTOS V202107.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file subscription_manager_bench.c
+ * @brief Host benchmark of publish dispatch through the topic filter trie.
+ *
+ * For a growing number of subscriptions, the time to dispatch a publish
+ * through handleIncomingPublishes() is compared with a scan that matches
+ * the topic against every subscription with MQTT_MatchTopic(), which is how
+ * the list was searched before the trie. Most filters name one device, a few
+ * use wildcards. The figures are host timings; they show how each approach
+ * scales, not what a target takes. Build and run from this directory with:
+ *
+ *   gcc -std=c99 -O2 -Istubs subscription_manager_bench.c \
+ *       stubs/core_mqtt_stubs.c -o subscription_manager_bench && \
+ *       ./subscription_manager_bench
+ */
+
+#define _POSIX_C_SOURCE    200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS    512U
+
+#include "../subscription_manager.c"
+
+#define BENCH_PUBLISHES      200000U
+#define BENCH_STRING_SIZE    48U
+
+static SubscriptionList_t xList;
+static char cFilters[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ][ BENCH_STRING_SIZE ];
+static char cTopics[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ][ BENCH_STRING_SIZE ];
+static volatile uint32_t ulCalls = 0;
+
+/*-----------------------------------------------------------*/
+
+static void prvCallback( void * pvContext,
+                         MQTTPublishInfo_t * pxPublishInfo )
+{
+    ( void ) pvContext;
+    ( void ) pxPublishInfo;
+    ulCalls++;
+}
+
+static double prvNow( void )
+{
+    struct timespec xNow;
+
+    clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( ( double ) xNow.tv_sec * 1e9 ) + ( double ) xNow.tv_nsec;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBuild( uint32_t ulSubscriptions )
+{
+    uint32_t i = 0;
+
+    memset( &xList, 0, sizeof( xList ) );
+
+    for( i = 0; i < ulSubscriptions; i++ )
+    {
+        /* One filter in sixteen takes every device. */
+        if( ( i % 16U ) == 15U )
+        {
+            snprintf( cFilters[ i ], BENCH_STRING_SIZE, "fleet/+/status/%u", ( unsigned ) i );
+        }
+        else
+        {
+            snprintf( cFilters[ i ], BENCH_STRING_SIZE, "fleet/dev%u/cmd/+", ( unsigned ) i );
+        }
+
+        snprintf( cTopics[ i ], BENCH_STRING_SIZE, "fleet/dev%u/cmd/reboot", ( unsigned ) i );
+
+        if( addSubscription( &xList, cFilters[ i ], ( uint16_t ) strlen( cFilters[ i ] ),
+                             prvCallback, NULL ) == false )
+        {
+            printf( "Could not add %s\n", cFilters[ i ] );
+        }
+    }
+}
+
+static double prvRunTrie( uint32_t ulSubscriptions )
+{
+    MQTTPublishInfo_t xPublish;
+    double xStart = 0;
+    uint32_t i = 0, ulTopic = 0;
+
+    memset( &xPublish, 0, sizeof( xPublish ) );
+    xStart = prvNow();
+
+    for( i = 0; i < BENCH_PUBLISHES; i++ )
+    {
+        ulTopic = ( i * 7919U ) % ulSubscriptions;
+        xPublish.pTopicName = cTopics[ ulTopic ];
+        xPublish.topicNameLength = ( uint16_t ) strlen( cTopics[ ulTopic ] );
+        ( void ) handleIncomingPublishes( &xList, &xPublish );
+    }
+
+    return ( prvNow() - xStart ) / BENCH_PUBLISHES;
+}
+
+static double prvRunScan( uint32_t ulSubscriptions )
+{
+    MQTTPublishInfo_t xPublish;
+    double xStart = 0;
+    uint32_t i = 0, j = 0, ulTopic = 0;
+    bool xMatch = false;
+
+    memset( &xPublish, 0, sizeof( xPublish ) );
+    xStart = prvNow();
+
+    for( i = 0; i < BENCH_PUBLISHES; i++ )
+    {
+        ulTopic = ( i * 7919U ) % ulSubscriptions;
+        xPublish.pTopicName = cTopics[ ulTopic ];
+        xPublish.topicNameLength = ( uint16_t ) strlen( cTopics[ ulTopic ] );
+
+        for( j = 0; j < ulSubscriptions; j++ )
+        {
+            ( void ) MQTT_MatchTopic( xPublish.pTopicName, xPublish.topicNameLength,
+                                      cFilters[ j ], ( uint16_t ) strlen( cFilters[ j ] ), &xMatch );
+
+            if( xMatch == true )
+            {
+                prvCallback( NULL, &xPublish );
+            }
+        }
+    }
+
+    return ( prvNow() - xStart ) / BENCH_PUBLISHES;
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    static const uint32_t ulSizes[] = { 8U, 64U, 512U };
+    uint32_t ulTrieCalls = 0, ulScanCalls = 0;
+    double xTrie = 0, xScan = 0;
+    size_t i = 0;
+    int lResult = 0;
+
+    printf( "%14s %14s %14s\n", "subscriptions", "trie ns/pub", "scan ns/pub" );
+
+    for( i = 0; i < sizeof( ulSizes ) / sizeof( ulSizes[ 0 ] ); i++ )
+    {
+        prvBuild( ulSizes[ i ] );
+
+        ulCalls = 0;
+        xTrie = prvRunTrie( ulSizes[ i ] );
+        ulTrieCalls = ulCalls;
+
+        ulCalls = 0;
+        xScan = prvRunScan( ulSizes[ i ] );
+        ulScanCalls = ulCalls;
+
+        /* Both must have made the same callbacks for the timing to count. */
+        if( ulTrieCalls != ulScanCalls )
+        {
+            printf( "Callback counts differ: trie %u, scan %u\n",
+                    ( unsigned ) ulTrieCalls, ( unsigned ) ulScanCalls );
+            lResult = 1;
+        }
+
+        printf( "%14u %14.1f %14.1f\n", ( unsigned ) ulSizes[ i ], xTrie, xScan );
+    }
+
+    return lResult;
+}
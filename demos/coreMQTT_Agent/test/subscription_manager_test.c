@@ -0,0 +1,496 @@
+/*
+ * FreeRTOS V202107.00
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://aws.amazon.com/freertos
+ *
+ */
+
+/**
+ * @file subscription_manager_test.c
+ * @brief Host test of the topic filter trie of the subscription manager.
+ *
+ * Random subscriptions are added and removed, and random topics are
+ * dispatched. Every dispatch must call exactly the callbacks of the
+ * subscriptions a reference matcher picks out of a plain list of the
+ * subscriptions. Few hash buckets are used so that levels share buckets.
+ * Build and run from this directory with:
+ *
+ *   gcc -std=c99 -Wall -Wextra -g -fsanitize=address,undefined -Istubs \
+ *       subscription_manager_test.c stubs/core_mqtt_stubs.c \
+ *       -o subscription_manager_test && ./subscription_manager_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Small trie, so that running out of elements and nodes is exercised. */
+#define SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS    24U
+#define SUBSCRIPTION_MANAGER_MAX_TRIE_NODES       48U
+#define SUBSCRIPTION_MANAGER_TRIE_BUCKETS         5U
+#define SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS     5U
+
+/* The module is included so that the test can check the trie once emptied. */
+#include "../subscription_manager.c"
+
+#define TEST_ROUNDS               200000U
+#define TEST_MAX_LEVELS           ( SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS + 1U )
+#define TEST_STRING_SIZE          64U
+#define TEST_REFERENCE_SIZE       ( SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS + 8U )
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+/**
+ * @brief A subscription of the reference list. Its address is the callback
+ * context, so a callback tells which subscription it was made for.
+ */
+typedef struct TestSubscription
+{
+    bool xActive;
+    char cFilter[ TEST_STRING_SIZE ];
+    uint16_t usFilterLength;
+    uint32_t ulCalls; /* Callbacks during the current dispatch. */
+} TestSubscription_t;
+
+static uint32_t ulFailures = 0;
+static SubscriptionList_t xList;
+static TestSubscription_t xReference[ TEST_REFERENCE_SIZE ];
+
+/* Levels topics and filters are made of. The empty level is one too. */
+static const char * const pcLevels[] = { "a", "b", "sensor", "$SYS", "" };
+
+#define TEST_LEVEL_COUNT    ( sizeof( pcLevels ) / sizeof( pcLevels[ 0 ] ) )
+
+/*-----------------------------------------------------------*/
+
+static void prvCallback( void * pvContext,
+                         MQTTPublishInfo_t * pxPublishInfo )
+{
+    TestSubscription_t * pxSubscription = ( TestSubscription_t * ) pvContext;
+
+    ( void ) pxPublishInfo;
+    TEST_CHECK( pxSubscription->xActive == true );
+    pxSubscription->ulCalls++;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t prvSplit( const char * pcString,
+                        char pcLevels[][ TEST_STRING_SIZE ] )
+{
+    size_t xLevels = 0, xLength = 0;
+    const char * pcEnd = NULL;
+
+    for( ; ; )
+    {
+        pcEnd = strchr( pcString, '/' );
+        xLength = ( pcEnd != NULL ) ? ( size_t ) ( pcEnd - pcString ) : strlen( pcString );
+        memcpy( pcLevels[ xLevels ], pcString, xLength );
+        pcLevels[ xLevels ][ xLength ] = '\0';
+        xLevels++;
+
+        if( pcEnd == NULL )
+        {
+            break;
+        }
+
+        pcString = pcEnd + 1;
+    }
+
+    return xLevels;
+}
+
+/* An independent matcher, level by level, kept deliberately plain. */
+static bool prvReferenceMatch( const char * pcTopic,
+                               const char * pcFilter )
+{
+    char cTopicLevels[ TEST_STRING_SIZE ][ TEST_STRING_SIZE ];
+    char cFilterLevels[ TEST_STRING_SIZE ][ TEST_STRING_SIZE ];
+    size_t xTopicLevels = prvSplit( pcTopic, cTopicLevels );
+    size_t xFilterLevels = prvSplit( pcFilter, cFilterLevels );
+    size_t xCompared = xFilterLevels;
+    size_t i = 0;
+    bool xMatch = true;
+
+    if( ( pcTopic[ 0 ] == '$' ) && ( ( pcFilter[ 0 ] == '+' ) || ( pcFilter[ 0 ] == '#' ) ) )
+    {
+        xMatch = false;
+    }
+    else
+    {
+        if( strcmp( cFilterLevels[ xFilterLevels - 1U ], "#" ) == 0 )
+        {
+            /* "#" stands for any number of levels, none included. */
+            xCompared = xFilterLevels - 1U;
+            xMatch = ( xTopicLevels >= xCompared );
+        }
+        else
+        {
+            xMatch = ( xTopicLevels == xFilterLevels );
+        }
+
+        for( i = 0; ( xMatch == true ) && ( i < xCompared ); i++ )
+        {
+            xMatch = ( strcmp( cFilterLevels[ i ], "+" ) == 0 ) ||
+                     ( strcmp( cFilterLevels[ i ], cTopicLevels[ i ] ) == 0 );
+        }
+    }
+
+    return xMatch;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Builds a topic, or a filter with wildcards in places. */
+static uint16_t prvRandomString( char * pcString,
+                                 bool xFilter )
+{
+    size_t xLevels = 1U + ( size_t ) ( rand() % TEST_MAX_LEVELS );
+    size_t i = 0, xLength = 0;
+    const char * pcLevel = NULL;
+    int lPick = 0;
+
+    for( i = 0; i < xLevels; i++ )
+    {
+        lPick = rand() % 8;
+
+        if( xFilter && ( lPick == 0 ) )
+        {
+            pcLevel = "+";
+        }
+        else if( xFilter && ( lPick == 1 ) && ( i == xLevels - 1U ) )
+        {
+            pcLevel = "#";
+        }
+        else
+        {
+            pcLevel = pcLevels[ ( size_t ) rand() % TEST_LEVEL_COUNT ];
+
+            /* '$' only starts a topic, as the server reserves it there. */
+            if( ( i > 0U ) && ( pcLevel[ 0 ] == '$' ) )
+            {
+                pcLevel = "b";
+            }
+        }
+
+        if( i > 0U )
+        {
+            pcString[ xLength++ ] = '/';
+        }
+
+        memcpy( &pcString[ xLength ], pcLevel, strlen( pcLevel ) );
+        xLength += strlen( pcLevel );
+    }
+
+    pcString[ xLength ] = '\0';
+
+    /* A topic or filter is never empty. */
+    if( xLength == 0U )
+    {
+        pcString[ xLength++ ] = 'a';
+        pcString[ xLength ] = '\0';
+    }
+
+    return ( uint16_t ) xLength;
+}
+
+static size_t prvLevelCount( const char * pcString )
+{
+    size_t xLevels = 1U;
+
+    for( ; *pcString != '\0'; pcString++ )
+    {
+        if( *pcString == '/' )
+        {
+            xLevels++;
+        }
+    }
+
+    return xLevels;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvAdd( void )
+{
+    TestSubscription_t * pxSubscription = NULL;
+    size_t i = 0, xActive = 0;
+    bool xAdded = false;
+
+    for( i = 0; i < TEST_REFERENCE_SIZE; i++ )
+    {
+        if( xReference[ i ].xActive == true )
+        {
+            xActive++;
+        }
+        else if( pxSubscription == NULL )
+        {
+            pxSubscription = &xReference[ i ];
+        }
+    }
+
+    if( ( xActive > 0U ) && ( ( rand() % 4 ) == 0 ) )
+    {
+        /* The same filter and context again is taken as already added. */
+        do
+        {
+            pxSubscription = &xReference[ ( size_t ) rand() % TEST_REFERENCE_SIZE ];
+        } while( pxSubscription->xActive == false );
+
+        xAdded = addSubscription( &xList, pxSubscription->cFilter, pxSubscription->usFilterLength,
+                                  prvCallback, pxSubscription );
+        TEST_CHECK( xAdded == true );
+    }
+    else if( pxSubscription != NULL )
+    {
+        if( ( xActive > 0U ) && ( ( rand() % 4 ) == 0 ) )
+        {
+            /* Another context on a filter already in the list. */
+            do
+            {
+                i = ( size_t ) rand() % TEST_REFERENCE_SIZE;
+            } while( xReference[ i ].xActive == false );
+
+            memcpy( pxSubscription->cFilter, xReference[ i ].cFilter, sizeof( pxSubscription->cFilter ) );
+            pxSubscription->usFilterLength = xReference[ i ].usFilterLength;
+        }
+        else
+        {
+            pxSubscription->usFilterLength = prvRandomString( pxSubscription->cFilter, true );
+        }
+
+        xAdded = addSubscription( &xList, pxSubscription->cFilter, pxSubscription->usFilterLength,
+                                  prvCallback, pxSubscription );
+
+        if( prvLevelCount( pxSubscription->cFilter ) > SUBSCRIPTION_MANAGER_MAX_TOPIC_LEVELS )
+        {
+            TEST_CHECK( xAdded == false );
+        }
+        else if( xActive < SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS )
+        {
+            /* Failing is only allowed once the nodes run out. */
+            TEST_CHECK( ( xAdded == true ) || ( xList.usNodesUsed == SUBSCRIPTION_MANAGER_MAX_TRIE_NODES - 1U ) );
+        }
+        else
+        {
+            TEST_CHECK( xAdded == false );
+        }
+
+        pxSubscription->xActive = xAdded;
+    }
+}
+
+static void prvRemove( void )
+{
+    char cFilter[ TEST_STRING_SIZE ];
+    uint16_t usLength = 0;
+    size_t i = 0;
+
+    if( ( rand() % 2 ) == 0 )
+    {
+        /* Most likely a filter nobody subscribed to. */
+        usLength = prvRandomString( cFilter, true );
+    }
+    else
+    {
+        i = ( size_t ) rand() % TEST_REFERENCE_SIZE;
+        memcpy( cFilter, xReference[ i ].cFilter, sizeof( cFilter ) );
+        usLength = xReference[ i ].usFilterLength;
+
+        if( usLength == 0U )
+        {
+            usLength = prvRandomString( cFilter, true );
+        }
+    }
+
+    removeSubscription( &xList, cFilter, usLength );
+
+    /* Every subscription with that filter goes, whatever its context. */
+    for( i = 0; i < TEST_REFERENCE_SIZE; i++ )
+    {
+        if( ( xReference[ i ].xActive == true ) && ( strcmp( xReference[ i ].cFilter, cFilter ) == 0 ) )
+        {
+            xReference[ i ].xActive = false;
+        }
+    }
+}
+
+static void prvDispatch( void )
+{
+    char cTopic[ TEST_STRING_SIZE ];
+    MQTTPublishInfo_t xPublish;
+    size_t i = 0;
+    bool xExpected = false, xHandled = false, xMatch = false;
+
+    memset( &xPublish, 0, sizeof( xPublish ) );
+    xPublish.topicNameLength = prvRandomString( cTopic, false );
+    xPublish.pTopicName = cTopic;
+
+    for( i = 0; i < TEST_REFERENCE_SIZE; i++ )
+    {
+        xReference[ i ].ulCalls = 0U;
+    }
+
+    xHandled = handleIncomingPublishes( &xList, &xPublish );
+
+    for( i = 0; i < TEST_REFERENCE_SIZE; i++ )
+    {
+        xMatch = ( xReference[ i ].xActive == true ) && prvReferenceMatch( cTopic, xReference[ i ].cFilter );
+        xExpected = xExpected || xMatch;
+
+        if( xReference[ i ].ulCalls != ( xMatch ? 1U : 0U ) )
+        {
+            printf( "topic \"%s\", filter \"%s\": %u calls\n", cTopic, xReference[ i ].cFilter,
+                    ( unsigned ) xReference[ i ].ulCalls );
+        }
+
+        TEST_CHECK( xReference[ i ].ulCalls == ( xMatch ? 1U : 0U ) );
+    }
+
+    TEST_CHECK( xHandled == xExpected );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestFixedCases( void )
+{
+    static const char * const pcCases[][ 3 ] =
+    {
+        /* Filter, topic, "1" if they match. */
+        { "a/b",      "a/b",      "1" },
+        { "a/b",      "a/b/c",    "0" },
+        { "a/+",      "a/",       "1" },
+        { "a/+",      "a",        "0" },
+        { "a/#",      "a",        "1" },
+        { "a/#",      "a/b/c",    "1" },
+        { "#",        "$SYS/a",   "0" },
+        { "+/a",      "$SYS/a",   "0" },
+        { "$SYS/#",   "$SYS/a",   "1" },
+        { "+/+",      "/",        "1" },
+        { "/a",       "a",        "0" },
+        { "sensor",   "sens",     "0" },
+    };
+    size_t i = 0;
+
+    for( i = 0; i < sizeof( pcCases ) / sizeof( pcCases[ 0 ] ); i++ )
+    {
+        memset( &xList, 0, sizeof( xList ) );
+        memset( xReference, 0, sizeof( xReference ) );
+        strcpy( xReference[ 0 ].cFilter, pcCases[ i ][ 0 ] );
+        xReference[ 0 ].usFilterLength = ( uint16_t ) strlen( pcCases[ i ][ 0 ] );
+        xReference[ 0 ].xActive = addSubscription( &xList, xReference[ 0 ].cFilter,
+                                                   xReference[ 0 ].usFilterLength,
+                                                   prvCallback, &xReference[ 0 ] );
+        TEST_CHECK( xReference[ 0 ].xActive == true );
+        TEST_CHECK( prvReferenceMatch( pcCases[ i ][ 1 ], pcCases[ i ][ 0 ] ) == ( pcCases[ i ][ 2 ][ 0 ] == '1' ) );
+
+        {
+            MQTTPublishInfo_t xPublish;
+
+            memset( &xPublish, 0, sizeof( xPublish ) );
+            xPublish.pTopicName = pcCases[ i ][ 1 ];
+            xPublish.topicNameLength = ( uint16_t ) strlen( pcCases[ i ][ 1 ] );
+            TEST_CHECK( handleIncomingPublishes( &xList, &xPublish ) == ( pcCases[ i ][ 2 ][ 0 ] == '1' ) );
+        }
+    }
+}
+
+static void prvCheckEmpty( void )
+{
+    const SubscriptionTrieNode_t * pxRoot = NODE( &xList, ROOT_LINK );
+    size_t i = 0, xFree = 0;
+    uint16_t usLink = NO_LINK;
+
+    TEST_CHECK( pxRoot->usReferences == 0U );
+    TEST_CHECK( pxRoot->usPlusChild == NO_LINK );
+    TEST_CHECK( pxRoot->usHashChild == NO_LINK );
+
+    for( i = 0; i < SUBSCRIPTION_MANAGER_TRIE_BUCKETS; i++ )
+    {
+        TEST_CHECK( xList.usBuckets[ i ] == NO_LINK );
+    }
+
+    /* Every node taken so far is back on the free list. */
+    for( usLink = xList.usFreeNodes; usLink != NO_LINK; usLink = NODE( &xList, usLink )->usNextInBucket )
+    {
+        xFree++;
+    }
+
+    TEST_CHECK( xFree == xList.usNodesUsed );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    uint32_t ulRound = 0;
+    size_t i = 0;
+    int lOp = 0;
+
+    srand( 1U );
+    prvTestFixedCases();
+
+    memset( &xList, 0, sizeof( xList ) );
+    memset( xReference, 0, sizeof( xReference ) );
+
+    for( ulRound = 0; ( ulRound < TEST_ROUNDS ) && ( ulFailures == 0U ); ulRound++ )
+    {
+        lOp = rand() % 10;
+
+        if( lOp < 4 )
+        {
+            prvAdd();
+        }
+        else if( lOp < 6 )
+        {
+            prvRemove();
+        }
+        else
+        {
+            prvDispatch();
+        }
+    }
+
+    /* Emptying the list frees every node of the trie. */
+    for( i = 0; i < TEST_REFERENCE_SIZE; i++ )
+    {
+        if( xReference[ i ].xActive == true )
+        {
+            removeSubscription( &xList, xReference[ i ].cFilter, xReference[ i ].usFilterLength );
+            xReference[ i ].xActive = false;
+        }
+    }
+
+    prvCheckEmpty();
+
+    printf( "%s: %u rounds, %u failures\n", ( ulFailures == 0U ) ? "PASS" : "FAIL",
+            ( unsigned ) ulRound, ( unsigned ) ulFailures );
+
+    return ( ulFailures == 0U ) ? 0 : 1;
+}
@@ -57,6 +57,9 @@
 /* Utilities include. */
 #include "core_pki_utils.h"
 
+/* TLS include. */
+#include "iot_tls.h"
+
 /* mbedTLS includes. */
 #include "mbedtls/pk.h"
 #include "mbedtls/oid.h"
@@ -788,6 +791,8 @@ CK_RV xDestroyProvidedObjects( CK_SESSION_HANDLE xSession,
         }
     }
 
+    TLS_InvalidateCredentialCache();
+
     return xResult;
 }
 
@@ -1268,6 +1273,9 @@ CK_RV xProvisionDevice( CK_SESSION_HANDLE xSession,
         }
     }
 
+    /* TLS connections must not keep using the previous credentials. */
+    TLS_InvalidateCredentialCache();
+
     /* Free memory. */
     if( NULL != xProvisionedState.pucDerPublicKey )
     {
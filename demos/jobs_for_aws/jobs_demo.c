@@ -236,6 +236,12 @@
  */
 #define DELAY_BETWEEN_DEMO_ITERATIONS_TICKS    ( pdMS_TO_TICKS( 5000U ) )
 
+/**
+ * @brief Time in milliseconds to wait for the PUBACK of the job updates still
+ * unacknowledged before unsubscribing and disconnecting.
+ */
+#define JOBS_OUTGOING_PUBLISHES_TIMEOUT_MS     ( 5000U )
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -432,11 +438,16 @@ static void prvSendUpdateForJob( char * pcJobId,
 
     if( xStatus == JobsSuccess )
     {
-        if( PublishToTopic( &xMqttContext,
-                            pUpdateJobTopic,
-                            ulTopicLength,
-                            pcJobStatusReport,
-                            strlen( pcJobStatusReport ) ) == pdFALSE )
+        /* This runs in the event callback of MQTT_ProcessLoop. The update is
+         * sent without waiting for its PUBACK, which the process loop of the
+         * demo task handles, so that the updates of a job are all on their way
+         * at once. The loop only runs again from within the callback when
+         * democonfigMAX_OUTGOING_PUBLISHES updates already wait. */
+        if( PublishToTopicNoWait( &xMqttContext,
+                                  pUpdateJobTopic,
+                                  ulTopicLength,
+                                  pcJobStatusReport,
+                                  strlen( pcJobStatusReport ) ) == pdFALSE )
         {
             /* Set global flag to terminate demo as PUBLISH operation to update job status failed. */
             xDemoEncounteredError = pdTRUE;
@@ -565,11 +576,11 @@ static void prvProcessJobDocument( char * pcJobId,
                     {
                         /* Publish to the parsed MQTT topic with the message obtained from
                          * the Jobs document.*/
-                        if( PublishToTopic( &xMqttContext,
-                                            pcTopic,
-                                            ulTopicLength,
-                                            pcMessage,
-                                            ulMessageLength ) == pdFALSE )
+                        if( PublishToTopicNoWait( &xMqttContext,
+                                                  pcTopic,
+                                                  ulTopicLength,
+                                                  pcMessage,
+                                                  ulMessageLength ) == pdFALSE )
                         {
                             /* Set global flag to terminate demo as PUBLISH operation to execute job failed. */
                             xDemoEncounteredError = pdTRUE;
@@ -875,11 +886,11 @@ int RunJobsDemo( bool awsIotMqttMode,
              * to the response topics or not.
              * This demo processes incoming messages from the response topics of the API in the prvEventCallback()
              * handler that is supplied to the coreMQTT library. */
-            if( PublishToTopic( &xMqttContext,
-                                DESCRIBE_NEXT_JOB_TOPIC( democonfigTHING_NAME ),
-                                sizeof( DESCRIBE_NEXT_JOB_TOPIC( democonfigTHING_NAME ) ) - 1,
-                                NULL,
-                                0 ) != pdPASS )
+            if( PublishToTopicNoWait( &xMqttContext,
+                                      DESCRIBE_NEXT_JOB_TOPIC( democonfigTHING_NAME ),
+                                      sizeof( DESCRIBE_NEXT_JOB_TOPIC( democonfigTHING_NAME ) ) - 1,
+                                      NULL,
+                                      0 ) != pdPASS )
             {
                 xDemoStatus = pdFAIL;
                 LogError( ( "Failed to publish to DescribeJobExecution API of AWS IoT Jobs service: "
@@ -948,6 +959,15 @@ int RunJobsDemo( bool awsIotMqttMode,
             retryDemoLoop = pdFALSE;
         }
 
+        /* Wait for the PUBACK of the job updates sent last, so that they are
+         * not lost with the connection. */
+        if( ( xMqttContext.connectStatus == MQTTConnected ) &&
+            ( WaitForOutgoingPublishes( &xMqttContext, JOBS_OUTGOING_PUBLISHES_TIMEOUT_MS ) != pdPASS ) )
+        {
+            xDemoStatus = pdFAIL;
+            LogError( ( "Job updates were not acknowledged by AWS IoT before disconnecting." ) );
+        }
+
         /* Unsubscribe from the NextJobExecutionChanged API topic. */
         if( UnsubscribeFromTopic( &xMqttContext,
                                   NEXT_JOB_EXECUTION_CHANGED_TOPIC( democonfigTHING_NAME ),
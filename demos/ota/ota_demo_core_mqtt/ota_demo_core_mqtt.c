@@ -257,6 +257,14 @@
  */
 #define otaexampleUNSUBSCRIBE_AFTER_OTA_SHUTDOWN    ( 1U )
 
+/**
+ * @brief Barrier ordering the writes to the free buffer ring between the
+ * MQTT agent task and the OTA agent task.
+ */
+#ifndef otaexampleMEMORY_BARRIER
+    #define otaexampleMEMORY_BARRIER()    __sync_synchronize()
+#endif
+
 /**
  * @brief The maximum number of retries for network operation with server.
  */
@@ -425,13 +433,13 @@ static MQTTAgentMessageContext_t xCommandQueue;
 static MQTTAgentMessageInterface_t xMessageInterface;
 
 /**
- * @brief The global array of subscription elements.
+ * @brief The global list of subscriptions.
  *
- * @note The subscription manager implementation expects that the array of the
- * subscription elements used for storing subscriptions to be initialized to 0.
- * As this is a global array, it will be intialized to 0 by default.
+ * @note The subscription manager implementation expects that the list used
+ * for storing subscriptions to be initialized to 0. As this is a global
+ * variable, it will be intialized to 0 by default.
  */
-static SubscriptionElement_t pxGlobalSubscriptionList[ SUBSCRIPTION_MANAGER_MAX_SUBSCRIPTIONS ];
+static SubscriptionList_t xGlobalSubscriptionList;
 
 /**
  * @brief The parameters for the network context using a TLS channel.
@@ -443,10 +451,6 @@ static SecureSocketsTransportParams_t xSecureSocketsTransportParams;
  */
 static NetworkContext_t xNetworkContextMqtt;
 
-/**
- * @brief Semaphore for synchronizing buffer operations.
- */
-static SemaphoreHandle_t xBufferSemaphore;
 
 /**
  * @brief Update File path buffer.
@@ -478,6 +482,25 @@ static uint8_t pucBitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ];
  */
 static OtaEventData_t pxEventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
 
+/**
+ * @brief Indices of the free event buffers.
+ *
+ * Buffers are only taken by the MQTT agent task, from the incoming publish
+ * callbacks, and only given back by the OTA agent task, from the application
+ * callback. With a single task on each side the ring needs no lock: only the
+ * taking side writes ulFreeHead and only the giving side writes ulFreeTail.
+ * Both count up forever; the ring never holds more than all the buffers.
+ */
+static uint8_t ucFreeEventBuffers[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
+static volatile uint32_t ulFreeHead = 0;
+static volatile uint32_t ulFreeTail = 0;
+
+/**
+ * @brief Buffer taken by the MQTT agent task but not handed to the OTA agent,
+ * kept for the next publish rather than given back through the ring.
+ */
+static OtaEventData_t * pxUnsentEventBuffer = NULL;
+
 /**
  * @brief Global entry time into the application to use as a reference timestamp
  * in the #prvGetTimeMs function. #prvGetTimeMs will always return the difference
@@ -809,16 +832,39 @@ static OtaTopicFilterCallback_t xOtaTopicFilterCallbacks[] =
 };
 /*-----------------------------------------------------------*/
 
+static void prvOtaEventBufferInit( void )
+{
+    uint32_t ulIndex = 0;
+
+    for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
+    {
+        pxEventBuffer[ ulIndex ].bufferUsed = false;
+        ucFreeEventBuffers[ ulIndex ] = ( uint8_t ) ulIndex;
+    }
+
+    pxUnsentEventBuffer = NULL;
+    ulFreeHead = 0;
+    ulFreeTail = otaconfigMAX_NUM_OTA_DATA_BUFFERS;
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvOtaEventBufferFree( OtaEventData_t * const pxBuffer )
 {
-    if( xSemaphoreTake( xBufferSemaphore, portMAX_DELAY ) == pdTRUE )
+    uint32_t ulTail = ulFreeTail;
+
+    if( pxBuffer->bufferUsed == true )
     {
         pxBuffer->bufferUsed = false;
-        ( void ) xSemaphoreGive( xBufferSemaphore );
+        ucFreeEventBuffers[ ulTail % ( otaconfigMAX_NUM_OTA_DATA_BUFFERS ) ] = ( uint8_t ) ( pxBuffer - pxEventBuffer );
+
+        /* Publish the index only once it is in the ring. */
+        otaexampleMEMORY_BARRIER();
+        ulFreeTail = ulTail + 1U;
     }
     else
     {
-        LogError( ( "Failed to get buffer semaphore." ) );
+        LogError( ( "OTA event buffer released twice." ) );
     }
 }
 
@@ -826,30 +872,43 @@ static void prvOtaEventBufferFree( OtaEventData_t * const pxBuffer )
 
 static OtaEventData_t * prvOtaEventBufferGet( void )
 {
-    uint32_t ulIndex = 0;
+    uint32_t ulHead = ulFreeHead;
     OtaEventData_t * pxFreeBuffer = NULL;
 
-    if( xSemaphoreTake( xBufferSemaphore, portMAX_DELAY ) == pdTRUE )
+    if( pxUnsentEventBuffer != NULL )
     {
-        for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
-        {
-            if( pxEventBuffer[ ulIndex ].bufferUsed == false )
-            {
-                pxEventBuffer[ ulIndex ].bufferUsed = true;
-                pxFreeBuffer = &pxEventBuffer[ ulIndex ];
-                break;
-            }
-        }
-
-        ( void ) xSemaphoreGive( xBufferSemaphore );
+        pxFreeBuffer = pxUnsentEventBuffer;
+        pxUnsentEventBuffer = NULL;
+    }
+    else if( ulHead != ulFreeTail )
+    {
+        /* Read the index only after seeing the tail that published it. */
+        otaexampleMEMORY_BARRIER();
+        pxFreeBuffer = &pxEventBuffer[ ucFreeEventBuffers[ ulHead % ( otaconfigMAX_NUM_OTA_DATA_BUFFERS ) ] ];
+        otaexampleMEMORY_BARRIER();
+        ulFreeHead = ulHead + 1U;
     }
     else
     {
-        LogError( ( "Failed to get buffer semaphore." ) );
+        /* All buffers are with the OTA agent. */
+    }
+
+    if( pxFreeBuffer != NULL )
+    {
+        pxFreeBuffer->bufferUsed = true;
     }
 
     return pxFreeBuffer;
 }
+
+/*-----------------------------------------------------------*/
+
+static void prvOtaEventBufferUnsent( OtaEventData_t * const pxBuffer )
+{
+    /* Only the OTA agent task gives buffers back through the ring, so keep
+     * this one on the taking side. */
+    pxUnsentEventBuffer = pxBuffer;
+}
 /*-----------------------------------------------------------*/
 
 static void prvOtaAppCallback( OtaJobEvent_t xEvent,
@@ -947,7 +1006,7 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pxMqttAgentContext,
 
     /* Fan out the incoming publishes to the callbacks registered using
      * subscription manager. */
-    xPublishHandled = SubscriptionManager_HandleIncomingPublishes( ( SubscriptionElement_t * ) pxMqttAgentContext->pIncomingCallbackContext,
+    xPublishHandled = SubscriptionManager_HandleIncomingPublishes( ( SubscriptionList_t * ) pxMqttAgentContext->pIncomingCallbackContext,
                                                                    pxPublishInfo );
 
     /* If there are no callbacks to handle the incoming publishes,
@@ -986,7 +1045,10 @@ static void prvMqttJobCallback( void * pvIncomingPublishCallbackContext,
         pxEventMsg.pEventData = pxEventData;
 
         /* Send job document received event. */
-        OTA_SignalEvent( &pxEventMsg );
+        if( OTA_SignalEvent( &pxEventMsg ) != true )
+        {
+            prvOtaEventBufferUnsent( pxEventData );
+        }
     }
     else
     {
@@ -1036,7 +1098,10 @@ static void prvMqttDataCallback( void * pvIncomingPublishCallbackContext,
         pxEventMsg.pEventData = pxEventData;
 
         /* Send job document received event. */
-        OTA_SignalEvent( &pxEventMsg );
+        if( OTA_SignalEvent( &pxEventMsg ) != true )
+        {
+            prvOtaEventBufferUnsent( pxEventData );
+        }
     }
     else
     {
@@ -1089,7 +1154,7 @@ static void prvRegisterOTACallback( const char * pcTopicFilter,
         {
             /* Add subscription so that incoming publishes are routed to the
              * application callback. */
-            xSubscriptionAdded = SubscriptionManager_AddSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+            xSubscriptionAdded = SubscriptionManager_AddSubscription( ( SubscriptionList_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
                                                                       pcTopicFilter,
                                                                       usTopicFilterLength,
                                                                       xOtaTopicFilterCallbacks[ usIndex ].xCallback,
@@ -1144,7 +1209,7 @@ static void prvMQTTUnsubscribeCompleteCallback( MQTTAgentCommandContext_t * pxCo
 
         /* Add subscription so that incoming publishes are routed to the
          * application callback. */
-        SubscriptionManager_RemoveSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+        SubscriptionManager_RemoveSubscription( ( SubscriptionList_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
                                                 pxSubscribeArgs->pSubscribeInfo->pTopicFilter,
                                                 pxSubscribeArgs->pSubscribeInfo->topicFilterLength );
 
@@ -1242,19 +1307,10 @@ static MQTTStatus_t prvMqttAgentInit( void )
     TransportInterface_t xTransport;
     MQTTStatus_t xReturn;
     MQTTFixedBuffer_t xFixedBuffer = { .pBuffer = pucNetworkBuffer, .size = MQTT_AGENT_NETWORK_BUFFER_SIZE };
-    static uint8_t ucStaticQueueStorageArea[ MQTT_AGENT_COMMAND_QUEUE_LENGTH * sizeof( MQTTAgentCommand_t * ) ];
-    static StaticQueue_t xStaticQueueStructure;
-
-    LogDebug( ( "Creating command queue." ) );
-#ifdef CONFIG_PLATFORM_AMEBAD2
-    xCommandQueue.queue = xQueueCreate( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
-                                        sizeof( MQTTAgentCommand_t * ) );
-#else
-    xCommandQueue.queue = xQueueCreateStatic( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
-                                              sizeof( MQTTAgentCommand_t * ),
-                                              ucStaticQueueStorageArea,
-                                              &xStaticQueueStructure );
-#endif
+
+    LogDebug( ( "Creating command ring." ) );
+    Agent_MessageInit( &xCommandQueue );
+
     /* Initialize the agent task pool. */
     Agent_InitializePool();
 
@@ -1269,7 +1325,7 @@ static MQTTStatus_t prvMqttAgentInit( void )
     xTransport.pNetworkContext = &xNetworkContextMqtt;
     xTransport.send = SecureSocketsTransport_Send;
     xTransport.recv = SecureSocketsTransport_Recv;
-    xTransport.writev = NULL;
+    xTransport.writev = SecureSocketsTransport_Writev;
 
     /* Initialize MQTT Agent. */
     xReturn = MQTTAgent_Init( &xGlobalMqttAgentContext,
@@ -1278,8 +1334,8 @@ static MQTTStatus_t prvMqttAgentInit( void )
                               &xTransport,
                               prvGetTimeMs,
                               prvIncomingPublishCallback,
-                              /* Context to pass into the callback. Passing the pointer to subscription array. */
-                              pxGlobalSubscriptionList );
+                              /* Context to pass into the callback. Passing the pointer to subscription list. */
+                              &xGlobalSubscriptionList );
 
     return xReturn;
 }
@@ -1914,17 +1970,9 @@ int RunOtaCoreMqttDemo( bool xAwsIotMqttMode,
                appFirmwareVersion.u.x.minor,
                appFirmwareVersion.u.x.build ) );
 
-    /* Initialize semaphore for buffer operations. */
-    xBufferSemaphore = xSemaphoreCreateMutex();
-
-    if( xBufferSemaphore == NULL )
-    {
-        LogError( ( "Failed to initialize buffer semaphore." ) );
-    }
-    else
-    {
-        xDemoStatus = pdPASS;
-    }
+    /* Initialize the free list of event buffers. */
+    prvOtaEventBufferInit();
+    xDemoStatus = pdPASS;
 
     /****************************** Init MQTT ******************************/
 
@@ -1979,7 +2027,7 @@ int RunOtaCoreMqttDemo( bool xAwsIotMqttMode,
      * Remvove callback for receiving messages intended for OTA agent from broker,
      * for which the topic has not been subscribed for.
      */
-    SubscriptionManager_RemoveSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+    SubscriptionManager_RemoveSubscription( ( SubscriptionList_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
                                             otaexampleDEFAULT_TOPIC_FILTER,
                                             otaexampleDEFAULT_TOPIC_FILTER_LENGTH );
 
@@ -1988,11 +2036,5 @@ int RunOtaCoreMqttDemo( bool xAwsIotMqttMode,
         prvDisconnectFromMQTTBroker();
     }
 
-    if( xBufferSemaphore != NULL )
-    {
-        /* Cleanup semaphore created for buffer operations. */
-        vSemaphoreDelete( xBufferSemaphore );
-    }
-
     return( ( xDemoStatus == pdPASS ) ? EXIT_SUCCESS : EXIT_FAILURE );
 }
@@ -396,8 +396,6 @@ static MQTTStatus_t prvMQTTInit( void )
     TransportInterface_t xTransport = { 0 };
     MQTTStatus_t xReturn;
     MQTTFixedBuffer_t xFixedBuffer = { .pBuffer = xNetworkBuffer, .size = MQTT_AGENT_NETWORK_BUFFER_SIZE };
-    static uint8_t staticQueueStorageArea[ MQTT_AGENT_COMMAND_QUEUE_LENGTH * sizeof( MQTTAgentCommand_t * ) ];
-    static StaticQueue_t staticQueueStructure;
     MQTTAgentMessageInterface_t messageInterface =
     {
         .pMsgCtx        = NULL,
@@ -407,12 +405,8 @@ static MQTTStatus_t prvMQTTInit( void )
         .releaseCommand = Agent_ReleaseCommand
     };
 
-    LogDebug( ( "Creating command queue." ) );
-    xCommandQueue.queue = xQueueCreateStatic( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
-                                              sizeof( MQTTAgentCommand_t * ),
-                                              staticQueueStorageArea,
-                                              &staticQueueStructure );
-    configASSERT( xCommandQueue.queue );
+    LogDebug( ( "Creating command ring." ) );
+    Agent_MessageInit( &xCommandQueue );
     messageInterface.pMsgCtx = &xCommandQueue;
 
     /* Initialize the command pool. */
@@ -423,7 +417,7 @@ static MQTTStatus_t prvMQTTInit( void )
     xTransport.pNetworkContext = &xNetworkContext;
     xTransport.send = SecureSocketsTransport_Send;
     xTransport.recv = SecureSocketsTransport_Recv;
-    xTransport.writev = NULL;
+    xTransport.writev = SecureSocketsTransport_Writev;
 
     /* Initialize MQTT library. */
     xReturn = MQTTAgent_Init( &xGlobalMqttAgentContext,
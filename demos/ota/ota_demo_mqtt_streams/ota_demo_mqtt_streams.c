@@ -74,6 +74,7 @@
 #include "transport_secure_sockets.h"
 
 #include "ota_demo_mqtt_streams.h"
+#include "ota_event_freertos.h"
 
 /* Include platform abstraction header. */
 #include "ota_pal_streams.h"
@@ -183,12 +184,25 @@
 #define otaexampleAGENT_TASK_STACK_SIZE          ( 4096 * 2 )
 
 
+/**
+ * @brief Maximum number of blocks requested but not yet written.
+ *
+ * A block that arrives ahead of the blocks before it keeps its OTA data
+ * buffer until it can be written, so the buffer pool grows with this value.
+ */
+#define otaexampleMAX_BLOCKS_IN_FLIGHT           ( 4U )
+
+/**
+ * @brief Time after which a block that has not arrived is requested again.
+ */
+#define otaexampleBLOCK_RETRY_TIMEOUT_MS         ( 3 * 1000U )
+
 #define CONFIG_MAX_FILE_SIZE                     200 /* TODO:!! */
 #define NUM_OF_BLOCKS_REQUESTED                  1U
 #define START_JOB_MSG_LENGTH                     147U
 #define MAX_JOB_ID_LENGTH                        64U
 #define UPDATE_JOB_MSG_LENGTH                    48U
-#define MAX_NUM_OF_OTA_DATA_BUFFERS              2U
+#define MAX_NUM_OF_OTA_DATA_BUFFERS              ( otaexampleMAX_BLOCKS_IN_FLIGHT + 1U )
 
 /* Max bytes supported for a file signature (3072 bit RSA is 384 bytes). */
 #define OTA_MAX_SIGNATURE_SIZE                   ( 384U )
@@ -206,6 +220,16 @@ struct MQTTAgentCommandContext
     void * pArgs;
 };
 
+/**
+ * @brief A block of the file between its request and its write to flash.
+ */
+typedef struct BlockSlot
+{
+    OtaDataEvent_New_t * dataEvent; /*!< Decoded block waiting for the blocks before it, or NULL. */
+    TickType_t requestTime;         /*!< When the block was last requested. */
+    uint32_t retries;               /*!< Number of times the block was requested again. */
+} BlockSlot_t;
+
 /*==============================================================================================================*/
 // Globals
 
@@ -214,6 +238,14 @@ static uint32_t numOfBlocksRemaining = 0;
 static uint32_t currentBlockOffset = 0;
 static uint8_t currentFileId = 0;
 static uint32_t totalBytesReceived = 0;
+
+/* Blocks from currentBlockOffset up to nextBlockToRequest are in flight. Block
+ * N uses slot N % otaexampleMAX_BLOCKS_IN_FLIGHT. */
+static BlockSlot_t blockSlots[ otaexampleMAX_BLOCKS_IN_FLIGHT ] = { 0 };
+static uint32_t nextBlockToRequest = 0;
+static uint32_t totalBlocks = 0;
+static uint32_t blockWindow = 1;
+static uint32_t blocksSinceWindowGrew = 0;
 char globalJobId[ MAX_JOB_ID_LENGTH ] = { 0 };
 
 static OtaDataEvent_New_t dataBuffers[ MAX_NUM_OF_OTA_DATA_BUFFERS ] = { 0 };
@@ -288,7 +320,33 @@ static OtaDataEvent_New_t * getOtaDataEventBuffer( void );
 /**
  * @brief This function requests a new MQTT data block to be downloaded from AWS
  */
-static void requestDataBlock( void );
+static void requestDataBlock( uint32_t blockId );
+
+/**
+ * @brief Release the blocks held for reassembly and close the window
+ */
+static void resetBlockWindow( void );
+
+/**
+ * @brief Skip the blocks the OTA PAL found already written before a reset
+ */
+static void resumeMqttDownloader( AfrOtaJobDocumentFields_t * jobFields );
+
+/**
+ * @brief Request new blocks until the window is full
+ */
+static void fillBlockWindow( void );
+
+/**
+ * @brief Request again the blocks that have not arrived in time, and halve
+ * the window if there were any
+ */
+static void retransmitExpiredBlocks( void );
+
+/**
+ * @brief Write the blocks that are next in order to flash
+ */
+static void writeReadyBlocks( void );
 
 /**
  * @brief Handler for parsing the MQTT streams data block
@@ -420,9 +478,11 @@ static void initMqttDownloader( AfrOtaJobDocumentFields_t * jobFields )
                            mqttFileDownloader_CONFIG_BLOCK_SIZE;
     numOfBlocksRemaining += ( jobFields->fileSize %
                               mqttFileDownloader_CONFIG_BLOCK_SIZE > 0 ) ? 1 : 0;
+    totalBlocks = numOfBlocksRemaining;
     currentFileId = ( uint8_t ) jobFields->fileId;
     currentBlockOffset = 0;
     totalBytesReceived = 0;
+    resetBlockWindow();
 
     /*
      * MQTT streams Library:
@@ -443,6 +503,25 @@ static void initMqttDownloader( AfrOtaJobDocumentFields_t * jobFields )
 
 /*-----------------------------------------------------------*/
 
+static void resumeMqttDownloader( AfrOtaJobDocumentFields_t * jobFields )
+{
+    uint32_t resumeBlock = otaPal_Streams_GetResumeOffset( jobFields ) /
+                           mqttFileDownloader_CONFIG_BLOCK_SIZE;
+
+    /* The PAL found the blocks before resumeBlock already in flash, written
+     * before a reset; they are not requested again. */
+    if( ( resumeBlock > 0U ) && ( resumeBlock < totalBlocks ) )
+    {
+        LogInfo(( "Resuming the download at block %u of %u. \n", resumeBlock, totalBlocks ));
+        currentBlockOffset = resumeBlock;
+        numOfBlocksRemaining = totalBlocks - resumeBlock;
+        totalBytesReceived = resumeBlock * mqttFileDownloader_CONFIG_BLOCK_SIZE;
+        resetBlockWindow();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static bool convertSignatureToDER( AfrOtaJobDocumentFields_t * jobFields )
 {
     bool returnVal = true;
@@ -492,7 +571,7 @@ static int16_t handleMqttStreamsBlockArrived( uint8_t * data,
 
 /*-----------------------------------------------------------*/
 
-static void requestDataBlock( void )
+static void requestDataBlock( uint32_t blockId )
 {
     char getStreamRequest[ GET_STREAM_REQUEST_BUFFER_SIZE ];
     size_t getStreamRequestLength = 0U;
@@ -506,7 +585,7 @@ static void requestDataBlock( void )
     getStreamRequestLength = mqttDownloader_createGetDataBlockRequest( mqttFileDownloaderContext.dataType,
                                                                        currentFileId,
                                                                        mqttFileDownloader_CONFIG_BLOCK_SIZE,
-                                                                       ( uint16_t ) currentBlockOffset,
+                                                                       ( uint16_t ) blockId,
                                                                        NUM_OF_BLOCKS_REQUESTED,
                                                                        getStreamRequest,
                                                                        GET_STREAM_REQUEST_BUFFER_SIZE );
@@ -519,6 +598,108 @@ static void requestDataBlock( void )
 
 /*-----------------------------------------------------------*/
 
+static void resetBlockWindow( void )
+{
+    uint32_t ulIndex = 0;
+
+    for( ulIndex = 0; ulIndex < otaexampleMAX_BLOCKS_IN_FLIGHT; ulIndex++ )
+    {
+        if( blockSlots[ ulIndex ].dataEvent != NULL )
+        {
+            freeOtaDataEventBuffer( blockSlots[ ulIndex ].dataEvent );
+        }
+    }
+
+    memset( blockSlots, 0, sizeof( blockSlots ) );
+    nextBlockToRequest = currentBlockOffset;
+    blockWindow = 1;
+    blocksSinceWindowGrew = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static void fillBlockWindow( void )
+{
+    BlockSlot_t * slot = NULL;
+
+    while( ( ( nextBlockToRequest - currentBlockOffset ) < blockWindow ) &&
+           ( nextBlockToRequest < totalBlocks ) )
+    {
+        slot = &blockSlots[ nextBlockToRequest % otaexampleMAX_BLOCKS_IN_FLIGHT ];
+        slot->dataEvent = NULL;
+        slot->retries = 0;
+        slot->requestTime = xTaskGetTickCount();
+
+        requestDataBlock( nextBlockToRequest );
+        nextBlockToRequest++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void retransmitExpiredBlocks( void )
+{
+    TickType_t now = xTaskGetTickCount();
+    BlockSlot_t * slot = NULL;
+    uint32_t blockId = 0;
+    bool expired = false;
+
+    for( blockId = currentBlockOffset; blockId < nextBlockToRequest; blockId++ )
+    {
+        slot = &blockSlots[ blockId % otaexampleMAX_BLOCKS_IN_FLIGHT ];
+
+        if( ( slot->dataEvent == NULL ) &&
+            ( ( now - slot->requestTime ) >= pdMS_TO_TICKS( otaexampleBLOCK_RETRY_TIMEOUT_MS ) ) )
+        {
+            LogInfo(( "Block %u did not arrive, requesting it again. \n", blockId ));
+            slot->requestTime = now;
+            slot->retries++;
+            requestDataBlock( blockId );
+            expired = true;
+        }
+    }
+
+    if( expired )
+    {
+        /* A lost block means the window was too large. The blocks already
+         * requested stay in flight; new ones wait until the window drains. */
+        blockWindow = ( blockWindow > 1U ) ? ( blockWindow / 2U ) : 1U;
+        blocksSinceWindowGrew = 0;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void writeReadyBlocks( void )
+{
+    BlockSlot_t * slot = &blockSlots[ currentBlockOffset % otaexampleMAX_BLOCKS_IN_FLIGHT ];
+    int16_t result = -1;
+
+    while( ( currentBlockOffset < nextBlockToRequest ) && ( slot->dataEvent != NULL ) )
+    {
+        result = handleMqttStreamsBlockArrived( slot->dataEvent->data, slot->dataEvent->dataLength );
+
+        freeOtaDataEventBuffer( slot->dataEvent );
+        slot->dataEvent = NULL;
+
+        if( result > 0 )
+        {
+            numOfBlocksRemaining--;
+            currentBlockOffset++;
+            slot = &blockSlots[ currentBlockOffset % otaexampleMAX_BLOCKS_IN_FLIGHT ];
+        }
+        else
+        {
+            LogError(( "Failed to write block %u, requesting it again. \n", currentBlockOffset ));
+            slot->requestTime = xTaskGetTickCount();
+            slot->retries++;
+            requestDataBlock( currentBlockOffset );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static bool closeFileHandler( void )
 {
     return( OtaPalSuccess_New == otaPal_Streams_CloseFile( &jobFields ) );
@@ -579,6 +760,11 @@ static OtaPalJobDocProcessingResult_New_t receivedJobDocumentHandler( OtaJobEven
             if( handled )
             {
                 xResult = otaPal_Streams_CreateFileForRx( &jobFields );
+
+                if( xResult == OtaPalJobDocFileCreated_New )
+                {
+                    resumeMqttDownloader( &jobFields );
+                }
             }
             else
             {
@@ -653,10 +839,28 @@ bool otaDemo_handleIncomingMQTTMessage( char * topic,
     {
         nextEvent.eventId = OtaAgentEventReceivedFileBlock_New;
         OtaDataEvent_New_t * dataBuf = getOtaDataEventBuffer();
-        memcpy( dataBuf->data, message, messageLength );
-        nextEvent.dataEvent = dataBuf;
-        dataBuf->dataLength = messageLength;
-        OtaSendEvent_FreeRTOS_New( &nextEvent );
+
+        if( ( dataBuf == NULL ) || ( messageLength > sizeof( dataBuf->data ) ) )
+        {
+            /* The block is requested again when its retry timeout expires. */
+            LogInfo(( "Dropping data block of %u bytes, no OTA buffer available. \n", ( unsigned ) messageLength ));
+
+            if( dataBuf != NULL )
+            {
+                freeOtaDataEventBuffer( dataBuf );
+            }
+        }
+        else
+        {
+            memcpy( dataBuf->data, message, messageLength );
+            nextEvent.dataEvent = dataBuf;
+            dataBuf->dataLength = messageLength;
+
+            if( OtaSendEvent_FreeRTOS_New( &nextEvent ) != OtaOsSuccess_New )
+            {
+                freeOtaDataEventBuffer( dataBuf );
+            }
+        }
     }
     else
     {
@@ -809,31 +1013,24 @@ static void processOTAEvents( void )
 {
     OtaEventMsg_New_t recvEvent = { 0 };
     OtaEvent_New_t recvEventId = 0;
-    static OtaEvent_New_t lastRecvEventId = OtaAgentEventStart_New;
     OtaEventMsg_New_t nextEvent = { 0 };
 
     OtaReceiveEvent_FreeRTOS_New( &recvEvent );
     recvEventId = recvEvent.eventId;
 
-    if( recvEventId != OtaAgentEventStart_New )
-    {
-        lastRecvEventId = recvEventId;
-    }
-    else
+    if( ( recvEventId == OtaAgentEventStart_New ) &&
+        ( otaAgentState == OtaAgentStateRequestingFileBlock_New ) )
     {
-        if( lastRecvEventId == OtaAgentEventRequestFileBlock_New )
+        /* No event since the last timeout. It is likely that the network was
+         * disconnected and reconnected, we should wait for the MQTT connection
+         * to go up before requesting the missing blocks again. */
+        while( !mqttWrapper_isConnected() )
         {
-            /* No current event and we have not received the new block
-             * since last timeout, try sending the request for block again. */
-            recvEventId = lastRecvEventId;
-
-            /* It is likely that the network was disconnected and reconnected,
-             * we should wait for the MQTT connection to go up. */
-            while( !mqttWrapper_isConnected() )
-            {
-                vTaskDelay( pdMS_TO_TICKS( 100 ) );
-            }
+            vTaskDelay( pdMS_TO_TICKS( 100 ) );
         }
+
+        retransmitExpiredBlocks();
+        fillBlockWindow();
     }
 
     switch( recvEventId )
@@ -899,7 +1096,7 @@ static void processOTAEvents( void )
                 LogInfo(( "Starting The Download. \n" ));
             }
 
-            requestDataBlock();
+            fillBlockWindow();
             LogInfo(( "ReqSent----------------------------\n" ));
             break;
 
@@ -917,11 +1114,11 @@ static void processOTAEvents( void )
             uint8_t decodedData[ mqttFileDownloader_CONFIG_BLOCK_SIZE ];
             size_t decodedDataLength = 0;
             MQTTFileDownloaderStatus_t xReturnStatus;
-            int16_t result = -1;
             int32_t fileId;
             int32_t blockId;
             int32_t blockSize;
-            static int32_t lastReceivedblockId = -1;
+            BlockSlot_t * slot = NULL;
+            bool held = false;
 
             /*
              * MQTT streams Library:
@@ -952,24 +1149,42 @@ static void processOTAEvents( void )
                 /* Error - the block size doesn't match with what we requested. It can be smaller as
                  * the last block may or may not be of exact size. */
             }
-            else if( blockId <= lastReceivedblockId )
+            else if( ( blockId < ( int32_t ) currentBlockOffset ) || ( blockId >= ( int32_t ) nextBlockToRequest ) )
             {
-                /* Ignore this block. */
+                /* Ignore this block, it was already written or never requested. */
             }
             else
             {
-                result = handleMqttStreamsBlockArrived( decodedData, decodedDataLength );
-                lastReceivedblockId = blockId;
-            }
+                slot = &blockSlots[ ( uint32_t ) blockId % otaexampleMAX_BLOCKS_IN_FLIGHT ];
 
-            freeOtaDataEventBuffer( recvEvent.dataEvent );
+                if( slot->dataEvent == NULL )
+                {
+                    /* Keep the decoded block in its event buffer until the
+                     * blocks before it have been written. */
+                    memcpy( recvEvent.dataEvent->data, decodedData, decodedDataLength );
+                    recvEvent.dataEvent->dataLength = decodedDataLength;
+                    slot->dataEvent = recvEvent.dataEvent;
+                    held = true;
+
+                    /* Grow the window by one block per window of blocks received. */
+                    blocksSinceWindowGrew++;
+
+                    if( ( blocksSinceWindowGrew >= blockWindow ) &&
+                        ( blockWindow < otaexampleMAX_BLOCKS_IN_FLIGHT ) )
+                    {
+                        blockWindow++;
+                        blocksSinceWindowGrew = 0;
+                    }
+                }
+            }
 
-            if( result > 0 )
+            if( !held )
             {
-                numOfBlocksRemaining--;
-                currentBlockOffset++;
+                freeOtaDataEventBuffer( recvEvent.dataEvent );
             }
 
+            writeReadyBlocks();
+
             if( ( numOfBlocksRemaining % 10 ) == 0 )
             {
                 LogInfo(( "Free OTA buffers %u", getFreeOTABuffers() ));
@@ -982,11 +1197,8 @@ static void processOTAEvents( void )
             }
             else
             {
-                if( currentBlockOffset % NUM_OF_BLOCKS_REQUESTED == 0 )
-                {
-                    nextEvent.eventId = OtaAgentEventRequestFileBlock_New;
-                    OtaSendEvent_FreeRTOS_New( &nextEvent );
-                }
+                retransmitExpiredBlocks();
+                fillBlockWindow();
             }
 
             break;
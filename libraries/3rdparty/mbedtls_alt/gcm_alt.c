@@ -0,0 +1,664 @@
+/*
+ * FreeRTOS mbed TLS V0.1.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file gcm_alt.c
+ * @brief GCM module for the mbed TLS MBEDTLS_GCM_ALT hook, with a GHASH
+ * kernel on the carry-less multiply instruction.
+ *
+ * mbed TLS 2.x has no per-function hook for GHASH, so the whole module is
+ * replaced; the API and its checks follow the stock gcm.c. Where the core
+ * has a carry-less multiply (PCLMULQDQ), four blocks are multiplied by H^4
+ * to H and summed before a single reduction. Elsewhere GHASH uses the same
+ * 4-bit tables as the stock module, and runs no faster than it.
+ */
+
+#if !defined( MBEDTLS_CONFIG_FILE )
+    #include "mbedtls/config.h"
+#else
+    #include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined( MBEDTLS_GCM_C ) && defined( MBEDTLS_GCM_ALT )
+
+#include <string.h>
+
+/* mbed TLS includes. */
+#include "mbedtls/gcm.h"
+#include "mbedtls/platform_util.h"
+
+#if defined( GCM_ALT_CLMUL )
+    #include <wmmintrin.h>
+    #include <tmmintrin.h>
+#endif
+
+#define GCM_ALT_GET_UINT64_BE( pucBuf, xOffset )               \
+    ( ( ( uint64_t ) ( pucBuf )[ ( xOffset ) ] << 56 ) |       \
+      ( ( uint64_t ) ( pucBuf )[ ( xOffset ) + 1 ] << 48 ) |   \
+      ( ( uint64_t ) ( pucBuf )[ ( xOffset ) + 2 ] << 40 ) |   \
+      ( ( uint64_t ) ( pucBuf )[ ( xOffset ) + 3 ] << 32 ) |   \
+      ( ( uint64_t ) ( pucBuf )[ ( xOffset ) + 4 ] << 24 ) |   \
+      ( ( uint64_t ) ( pucBuf )[ ( xOffset ) + 5 ] << 16 ) |   \
+      ( ( uint64_t ) ( pucBuf )[ ( xOffset ) + 6 ] << 8 ) |    \
+      ( ( uint64_t ) ( pucBuf )[ ( xOffset ) + 7 ] ) )
+
+#define GCM_ALT_PUT_UINT64_BE( ullValue, pucBuf, xOffset )                          \
+    do {                                                                            \
+        ( pucBuf )[ ( xOffset ) ] = ( unsigned char ) ( ( ullValue ) >> 56 );       \
+        ( pucBuf )[ ( xOffset ) + 1 ] = ( unsigned char ) ( ( ullValue ) >> 48 );   \
+        ( pucBuf )[ ( xOffset ) + 2 ] = ( unsigned char ) ( ( ullValue ) >> 40 );   \
+        ( pucBuf )[ ( xOffset ) + 3 ] = ( unsigned char ) ( ( ullValue ) >> 32 );   \
+        ( pucBuf )[ ( xOffset ) + 4 ] = ( unsigned char ) ( ( ullValue ) >> 24 );   \
+        ( pucBuf )[ ( xOffset ) + 5 ] = ( unsigned char ) ( ( ullValue ) >> 16 );   \
+        ( pucBuf )[ ( xOffset ) + 6 ] = ( unsigned char ) ( ( ullValue ) >> 8 );    \
+        ( pucBuf )[ ( xOffset ) + 7 ] = ( unsigned char ) ( ullValue );             \
+    } while( 0 )
+
+/* Blocks of keystream computed ahead of GHASH in one pass of the update. */
+#define GCM_ALT_PASS_BLOCKS    4U
+
+/*-----------------------------------------------------------*/
+
+#if defined( GCM_ALT_CLMUL )
+
+/**
+ * @brief Reverse the bytes of a block, so that the bit order of GCM maps
+ * onto the carry-less multiply.
+ */
+static __m128i prvReverse( __m128i xBlock )
+{
+    return _mm_shuffle_epi8( xBlock, _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) );
+}
+
+/**
+ * @brief Add the 256-bit carry-less product of a and b to lo and hi.
+ */
+static void prvClmulAdd( __m128i a,
+                         __m128i b,
+                         __m128i * pxLo,
+                         __m128i * pxHi )
+{
+    __m128i xMid = _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x10 ),
+                                  _mm_clmulepi64_si128( a, b, 0x01 ) );
+
+    *pxLo = _mm_xor_si128( *pxLo, _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x00 ), _mm_slli_si128( xMid, 8 ) ) );
+    *pxHi = _mm_xor_si128( *pxHi, _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x11 ), _mm_srli_si128( xMid, 8 ) ) );
+}
+
+/**
+ * @brief Reduce a 256-bit product modulo the GCM polynomial.
+ *
+ * The operands are bit reflected, so the product is shifted left by one
+ * bit first. The reduction is the two-phase shift method of the Intel
+ * carry-less multiplication white paper.
+ */
+static __m128i prvClmulReduce( __m128i xLo,
+                               __m128i xHi )
+{
+    __m128i t1, t2, t3;
+
+    t1 = _mm_srli_epi32( xLo, 31 );
+    t2 = _mm_srli_epi32( xHi, 31 );
+    xLo = _mm_slli_epi32( xLo, 1 );
+    xHi = _mm_slli_epi32( xHi, 1 );
+    t3 = _mm_srli_si128( t1, 12 );
+    t2 = _mm_slli_si128( t2, 4 );
+    t1 = _mm_slli_si128( t1, 4 );
+    xLo = _mm_or_si128( xLo, t1 );
+    xHi = _mm_or_si128( _mm_or_si128( xHi, t2 ), t3 );
+
+    t1 = _mm_xor_si128( _mm_xor_si128( _mm_slli_epi32( xLo, 31 ), _mm_slli_epi32( xLo, 30 ) ),
+                        _mm_slli_epi32( xLo, 25 ) );
+    t2 = _mm_srli_si128( t1, 4 );
+    xLo = _mm_xor_si128( xLo, _mm_slli_si128( t1, 12 ) );
+
+    t1 = _mm_xor_si128( _mm_xor_si128( _mm_srli_epi32( xLo, 1 ), _mm_srli_epi32( xLo, 2 ) ),
+                        _mm_xor_si128( _mm_srli_epi32( xLo, 7 ), t2 ) );
+
+    return _mm_xor_si128( xHi, _mm_xor_si128( xLo, t1 ) );
+}
+
+static __m128i prvClmulMul( __m128i a,
+                            __m128i b )
+{
+    __m128i xLo = _mm_setzero_si128();
+    __m128i xHi = _mm_setzero_si128();
+
+    prvClmulAdd( a, b, &xLo, &xHi );
+
+    return prvClmulReduce( xLo, xHi );
+}
+
+/**
+ * @brief Keep the powers of H for the multiply of four blocks at once.
+ */
+static void prvGhashSetKey( mbedtls_gcm_context * ctx,
+                            const unsigned char h[ 16 ] )
+{
+    __m128i xH = prvReverse( _mm_loadu_si128( ( const __m128i * ) h ) );
+    __m128i xPower = xH;
+    uint32_t i;
+
+    _mm_storeu_si128( ( __m128i * ) ctx->HPow[ 0 ], xH );
+
+    for( i = 1; i < 4U; i++ )
+    {
+        xPower = prvClmulMul( xPower, xH );
+        _mm_storeu_si128( ( __m128i * ) ctx->HPow[ i ], xPower );
+    }
+}
+
+/**
+ * @brief Fold whole blocks into the GHASH state x.
+ */
+static void prvGhashBlocks( const mbedtls_gcm_context * ctx,
+                            unsigned char x[ 16 ],
+                            const unsigned char * data,
+                            size_t blocks )
+{
+    __m128i xX = prvReverse( _mm_loadu_si128( ( const __m128i * ) x ) );
+    __m128i xH1 = _mm_loadu_si128( ( const __m128i * ) ctx->HPow[ 0 ] );
+    __m128i xH2 = _mm_loadu_si128( ( const __m128i * ) ctx->HPow[ 1 ] );
+    __m128i xH3 = _mm_loadu_si128( ( const __m128i * ) ctx->HPow[ 2 ] );
+    __m128i xH4 = _mm_loadu_si128( ( const __m128i * ) ctx->HPow[ 3 ] );
+    __m128i xLo, xHi;
+
+    /* (((x + d0) H + d1) H + d2) H + d3) H
+     *   = (x + d0) H^4 + d1 H^3 + d2 H^2 + d3 H, reduced once. */
+    for( ; blocks >= 4U; blocks -= 4U, data += 64 )
+    {
+        xLo = _mm_setzero_si128();
+        xHi = _mm_setzero_si128();
+        prvClmulAdd( _mm_xor_si128( xX, prvReverse( _mm_loadu_si128( ( const __m128i * ) data ) ) ), xH4, &xLo, &xHi );
+        prvClmulAdd( prvReverse( _mm_loadu_si128( ( const __m128i * ) ( data + 16 ) ) ), xH3, &xLo, &xHi );
+        prvClmulAdd( prvReverse( _mm_loadu_si128( ( const __m128i * ) ( data + 32 ) ) ), xH2, &xLo, &xHi );
+        prvClmulAdd( prvReverse( _mm_loadu_si128( ( const __m128i * ) ( data + 48 ) ) ), xH1, &xLo, &xHi );
+        xX = prvClmulReduce( xLo, xHi );
+    }
+
+    for( ; blocks > 0U; blocks--, data += 16 )
+    {
+        xX = prvClmulMul( _mm_xor_si128( xX, prvReverse( _mm_loadu_si128( ( const __m128i * ) data ) ) ), xH1 );
+    }
+
+    _mm_storeu_si128( ( __m128i * ) x, prvReverse( xX ) );
+}
+
+#else /* GCM_ALT_CLMUL */
+
+/**
+ * @brief Reduction of the four bits shifted out of a product, by the
+ * GCM polynomial, in the top 16 bits.
+ */
+static const uint64_t gcm_alt_last4[ 16 ] =
+{
+    0x0000, 0x1c20, 0x3840, 0x2460,
+    0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560,
+    0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+/**
+ * @brief Build the tables of the 16 multiples of H by a 4-bit value.
+ */
+static void prvGhashSetKey( mbedtls_gcm_context * ctx,
+                            const unsigned char h[ 16 ] )
+{
+    uint64_t ullHigh = GCM_ALT_GET_UINT64_BE( h, 0 );
+    uint64_t ullLow = GCM_ALT_GET_UINT64_BE( h, 8 );
+    uint64_t ullCarry;
+    uint32_t i, j;
+
+    /* In the bit order of GCM, index 8 is H itself; halving the index
+     * multiplies by x. */
+    ctx->HH[ 0 ] = 0;
+    ctx->HL[ 0 ] = 0;
+    ctx->HH[ 8 ] = ullHigh;
+    ctx->HL[ 8 ] = ullLow;
+
+    for( i = 4; i > 0U; i >>= 1 )
+    {
+        ullCarry = ( ullLow & 1U ) * 0xe1000000U;
+        ullLow = ( ullHigh << 63 ) | ( ullLow >> 1 );
+        ullHigh = ( ullHigh >> 1 ) ^ ( ullCarry << 32 );
+        ctx->HH[ i ] = ullHigh;
+        ctx->HL[ i ] = ullLow;
+    }
+
+    for( i = 2; i <= 8U; i <<= 1 )
+    {
+        for( j = 1; j < i; j++ )
+        {
+            ctx->HH[ i + j ] = ctx->HH[ i ] ^ ctx->HH[ j ];
+            ctx->HL[ i + j ] = ctx->HL[ i ] ^ ctx->HL[ j ];
+        }
+    }
+}
+
+/**
+ * @brief Multiply the 128-bit value z by x^4 and add the four bits shifted
+ * out, reduced.
+ */
+#define GCM_ALT_SHIFT4( ullHigh, ullLow )                                      \
+    do {                                                                        \
+        uint64_t ullRem = gcm_alt_last4[ ( ullLow ) & 0x0fU ];                  \
+        ( ullLow ) = ( ( ullHigh ) << 60 ) | ( ( ullLow ) >> 4 );               \
+        ( ullHigh ) = ( ( ullHigh ) >> 4 ) ^ ( ullRem << 48 );                  \
+    } while( 0 )
+
+/**
+ * @brief x = x * H, four bits of x at a time from the last.
+ */
+static void prvGhashMul( const mbedtls_gcm_context * ctx,
+                         unsigned char x[ 16 ] )
+{
+    uint64_t ullHigh, ullLow;
+    uint32_t ulByte;
+    int i;
+
+    ullHigh = ctx->HH[ x[ 15 ] & 0x0fU ];
+    ullLow = ctx->HL[ x[ 15 ] & 0x0fU ];
+    GCM_ALT_SHIFT4( ullHigh, ullLow );
+    ullHigh ^= ctx->HH[ x[ 15 ] >> 4 ];
+    ullLow ^= ctx->HL[ x[ 15 ] >> 4 ];
+
+    for( i = 14; i >= 0; i-- )
+    {
+        ulByte = x[ i ];
+        GCM_ALT_SHIFT4( ullHigh, ullLow );
+        ullHigh ^= ctx->HH[ ulByte & 0x0fU ];
+        ullLow ^= ctx->HL[ ulByte & 0x0fU ];
+        GCM_ALT_SHIFT4( ullHigh, ullLow );
+        ullHigh ^= ctx->HH[ ulByte >> 4 ];
+        ullLow ^= ctx->HL[ ulByte >> 4 ];
+    }
+
+    GCM_ALT_PUT_UINT64_BE( ullHigh, x, 0 );
+    GCM_ALT_PUT_UINT64_BE( ullLow, x, 8 );
+}
+
+/**
+ * @brief Fold whole blocks into the GHASH state x.
+ */
+static void prvGhashBlocks( const mbedtls_gcm_context * ctx,
+                            unsigned char x[ 16 ],
+                            const unsigned char * data,
+                            size_t blocks )
+{
+    uint32_t i;
+
+    for( ; blocks > 0U; blocks--, data += 16 )
+    {
+        for( i = 0; i < 16U; i++ )
+        {
+            x[ i ] ^= data[ i ];
+        }
+
+        prvGhashMul( ctx, x );
+    }
+}
+
+#endif /* GCM_ALT_CLMUL */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Fold data into the GHASH state x, the last block padded with
+ * zeros.
+ */
+static void prvGhashData( const mbedtls_gcm_context * ctx,
+                          unsigned char x[ 16 ],
+                          const unsigned char * data,
+                          size_t length )
+{
+    unsigned char pucLast[ 16 ];
+    size_t xWhole = length & ~( ( size_t ) 15U );
+
+    prvGhashBlocks( ctx, x, data, xWhole >> 4 );
+
+    if( xWhole < length )
+    {
+        memset( pucLast, 0, sizeof( pucLast ) );
+        memcpy( pucLast, &data[ xWhole ], length - xWhole );
+        prvGhashBlocks( ctx, x, pucLast, 1 );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int prvEncryptBlock( mbedtls_gcm_context * ctx,
+                            const unsigned char input[ 16 ],
+                            unsigned char output[ 16 ] )
+{
+    size_t olen = 0;
+
+    return mbedtls_cipher_update( &ctx->cipher_ctx, input, 16, output, &olen );
+}
+/*-----------------------------------------------------------*/
+
+void mbedtls_gcm_init( mbedtls_gcm_context * ctx )
+{
+    if( ctx != NULL )
+    {
+        memset( ctx, 0, sizeof( mbedtls_gcm_context ) );
+    }
+}
+/*-----------------------------------------------------------*/
+
+int mbedtls_gcm_setkey( mbedtls_gcm_context * ctx,
+                        mbedtls_cipher_id_t cipher,
+                        const unsigned char * key,
+                        unsigned int keybits )
+{
+    const mbedtls_cipher_info_t * cipher_info;
+    unsigned char h[ 16 ];
+    int ret;
+
+    if( ( ctx == NULL ) || ( key == NULL ) ||
+        ( ( keybits != 128U ) && ( keybits != 192U ) && ( keybits != 256U ) ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    cipher_info = mbedtls_cipher_info_from_values( cipher, ( int ) keybits, MBEDTLS_MODE_ECB );
+
+    if( ( cipher_info == NULL ) || ( cipher_info->block_size != 16U ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    mbedtls_cipher_free( &ctx->cipher_ctx );
+
+    if( ( ret = mbedtls_cipher_setup( &ctx->cipher_ctx, cipher_info ) ) != 0 )
+    {
+        return ret;
+    }
+
+    if( ( ret = mbedtls_cipher_setkey( &ctx->cipher_ctx, key, ( int ) keybits, MBEDTLS_ENCRYPT ) ) != 0 )
+    {
+        return ret;
+    }
+
+    /* H is the encrypted zero block. */
+    memset( h, 0, sizeof( h ) );
+
+    if( ( ret = prvEncryptBlock( ctx, h, h ) ) != 0 )
+    {
+        return ret;
+    }
+
+    prvGhashSetKey( ctx, h );
+    mbedtls_platform_zeroize( h, sizeof( h ) );
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+int mbedtls_gcm_starts( mbedtls_gcm_context * ctx,
+                        int mode,
+                        const unsigned char * iv,
+                        size_t iv_len,
+                        const unsigned char * add,
+                        size_t add_len )
+{
+    unsigned char work_buf[ 16 ];
+    uint64_t ullIvBits;
+    int ret;
+
+    if( ( ctx == NULL ) || ( iv == NULL ) || ( ( add_len != 0U ) && ( add == NULL ) ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    /* The lengths in bits must fit in 64 bits. */
+    if( ( iv_len == 0U ) || ( ( ( uint64_t ) iv_len ) >> 61 != 0U ) || ( ( ( uint64_t ) add_len ) >> 61 != 0U ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    memset( ctx->y, 0, sizeof( ctx->y ) );
+    memset( ctx->buf, 0, sizeof( ctx->buf ) );
+    ctx->mode = mode;
+    ctx->len = 0;
+    ctx->add_len = 0;
+
+    if( iv_len == 12U )
+    {
+        memcpy( ctx->y, iv, iv_len );
+        ctx->y[ 15 ] = 1;
+    }
+    else
+    {
+        memset( work_buf, 0, sizeof( work_buf ) );
+        ullIvBits = ( uint64_t ) iv_len * 8U;
+        GCM_ALT_PUT_UINT64_BE( ullIvBits, work_buf, 8 );
+        prvGhashData( ctx, ctx->y, iv, iv_len );
+        prvGhashBlocks( ctx, ctx->y, work_buf, 1 );
+    }
+
+    if( ( ret = prvEncryptBlock( ctx, ctx->y, ctx->base_ectr ) ) != 0 )
+    {
+        return ret;
+    }
+
+    ctx->add_len = add_len;
+    prvGhashData( ctx, ctx->buf, add, add_len );
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+int mbedtls_gcm_update( mbedtls_gcm_context * ctx,
+                        size_t length,
+                        const unsigned char * input,
+                        unsigned char * output )
+{
+    unsigned char ectr[ GCM_ALT_PASS_BLOCKS * 16U ];
+    size_t use_len, i;
+    uint32_t j;
+    int ret = 0;
+
+    if( ( ctx == NULL ) || ( ( length != 0U ) && ( ( input == NULL ) || ( output == NULL ) ) ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    if( ( output > input ) && ( ( size_t ) ( output - input ) < length ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    /* At most 2^39 - 256 bits of data. */
+    if( ( ctx->len + length < ctx->len ) || ( ( uint64_t ) ctx->len + length > 0xFFFFFFFE0ull ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    ctx->len += length;
+
+    /* A few blocks of keystream at a time, so that GHASH takes them
+     * together. The ciphertext is hashed before it is overwritten when
+     * decrypting in place. */
+    while( ( ret == 0 ) && ( length > 0U ) )
+    {
+        use_len = ( length < sizeof( ectr ) ) ? length : sizeof( ectr );
+
+        for( j = 0; ( ret == 0 ) && ( ( j << 4 ) < use_len ); j++ )
+        {
+            for( i = 16; i > 12U; i-- )
+            {
+                if( ++ctx->y[ i - 1U ] != 0U )
+                {
+                    break;
+                }
+            }
+
+            ret = prvEncryptBlock( ctx, ctx->y, &ectr[ j << 4 ] );
+        }
+
+        if( ret == 0 )
+        {
+            if( ctx->mode == MBEDTLS_GCM_DECRYPT )
+            {
+                prvGhashData( ctx, ctx->buf, input, use_len );
+            }
+
+            for( i = 0; i < use_len; i++ )
+            {
+                output[ i ] = ectr[ i ] ^ input[ i ];
+            }
+
+            if( ctx->mode == MBEDTLS_GCM_ENCRYPT )
+            {
+                prvGhashData( ctx, ctx->buf, output, use_len );
+            }
+
+            length -= use_len;
+            input += use_len;
+            output += use_len;
+        }
+    }
+
+    mbedtls_platform_zeroize( ectr, sizeof( ectr ) );
+
+    return ret;
+}
+/*-----------------------------------------------------------*/
+
+int mbedtls_gcm_finish( mbedtls_gcm_context * ctx,
+                        unsigned char * tag,
+                        size_t tag_len )
+{
+    unsigned char work_buf[ 16 ];
+    uint64_t ullLenBits, ullAddBits;
+    size_t i;
+
+    if( ( ctx == NULL ) || ( tag == NULL ) || ( tag_len > 16U ) || ( tag_len < 4U ) )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    ullLenBits = ctx->len * 8U;
+    ullAddBits = ctx->add_len * 8U;
+
+    memcpy( tag, ctx->base_ectr, tag_len );
+
+    if( ( ullLenBits != 0U ) || ( ullAddBits != 0U ) )
+    {
+        GCM_ALT_PUT_UINT64_BE( ullAddBits, work_buf, 0 );
+        GCM_ALT_PUT_UINT64_BE( ullLenBits, work_buf, 8 );
+        prvGhashBlocks( ctx, ctx->buf, work_buf, 1 );
+
+        for( i = 0; i < tag_len; i++ )
+        {
+            tag[ i ] ^= ctx->buf[ i ];
+        }
+    }
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+int mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context * ctx,
+                               int mode,
+                               size_t length,
+                               const unsigned char * iv,
+                               size_t iv_len,
+                               const unsigned char * add,
+                               size_t add_len,
+                               const unsigned char * input,
+                               unsigned char * output,
+                               size_t tag_len,
+                               unsigned char * tag )
+{
+    int ret;
+
+    if( ( ret = mbedtls_gcm_starts( ctx, mode, iv, iv_len, add, add_len ) ) != 0 )
+    {
+        return ret;
+    }
+
+    if( ( ret = mbedtls_gcm_update( ctx, length, input, output ) ) != 0 )
+    {
+        return ret;
+    }
+
+    return mbedtls_gcm_finish( ctx, tag, tag_len );
+}
+/*-----------------------------------------------------------*/
+
+int mbedtls_gcm_auth_decrypt( mbedtls_gcm_context * ctx,
+                              size_t length,
+                              const unsigned char * iv,
+                              size_t iv_len,
+                              const unsigned char * add,
+                              size_t add_len,
+                              const unsigned char * tag,
+                              size_t tag_len,
+                              const unsigned char * input,
+                              unsigned char * output )
+{
+    unsigned char check_tag[ 16 ];
+    unsigned char diff = 0;
+    size_t i;
+    int ret;
+
+    if( tag == NULL )
+    {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+
+    if( ( ret = mbedtls_gcm_crypt_and_tag( ctx, MBEDTLS_GCM_DECRYPT, length, iv, iv_len, add, add_len,
+                                           input, output, tag_len, check_tag ) ) != 0 )
+    {
+        return ret;
+    }
+
+    /* Check the tag in constant time. */
+    for( i = 0; i < tag_len; i++ )
+    {
+        diff |= tag[ i ] ^ check_tag[ i ];
+    }
+
+    if( diff != 0U )
+    {
+        mbedtls_platform_zeroize( output, length );
+        return MBEDTLS_ERR_GCM_AUTH_FAILED;
+    }
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+void mbedtls_gcm_free( mbedtls_gcm_context * ctx )
+{
+    if( ctx != NULL )
+    {
+        mbedtls_cipher_free( &ctx->cipher_ctx );
+        mbedtls_platform_zeroize( ctx, sizeof( mbedtls_gcm_context ) );
+    }
+}
+/*-----------------------------------------------------------*/
+
+#endif /* MBEDTLS_GCM_C && MBEDTLS_GCM_ALT */
@@ -0,0 +1,66 @@
+/*
+ * FreeRTOS mbed TLS V0.1.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file gcm_alt.h
+ * @brief Context of the GCM module of gcm_alt.c, for the mbed TLS
+ * MBEDTLS_GCM_ALT hook.
+ */
+
+#ifndef MBEDTLS_GCM_ALT_H
+#define MBEDTLS_GCM_ALT_H
+
+#include <stdint.h>
+
+/* mbed TLS includes. */
+#include "mbedtls/cipher.h"
+
+/**
+ * @brief GHASH runs on the carry-less multiply instruction when the
+ * compiler targets a core that has it, and on 4-bit tables otherwise.
+ */
+#if defined( __PCLMUL__ ) && defined( __SSSE3__ )
+    #define GCM_ALT_CLMUL
+#endif
+
+/**
+ * @brief The GCM context. Its layout does not depend on the GHASH in use,
+ * so that code built with and without the instruction can share it.
+ */
+typedef struct mbedtls_gcm_context
+{
+    mbedtls_cipher_context_t cipher_ctx; /**< The cipher of the counter mode. */
+    unsigned char HPow[ 4 ][ 16 ];       /**< H to H^4, bytes reversed, for the carry-less multiply. */
+    uint64_t HL[ 16 ];                   /**< Low halves of the multiples of H, for the tables. */
+    uint64_t HH[ 16 ];                   /**< High halves of the multiples of H, for the tables. */
+    uint64_t len;                        /**< Length of the data. */
+    uint64_t add_len;                    /**< Length of the additional data. */
+    unsigned char base_ectr[ 16 ];       /**< First counter block, encrypted. */
+    unsigned char y[ 16 ];               /**< Counter block. */
+    unsigned char buf[ 16 ];             /**< GHASH state. */
+    int mode;                            /**< MBEDTLS_GCM_ENCRYPT or MBEDTLS_GCM_DECRYPT. */
+} mbedtls_gcm_context;
+
+#endif /* MBEDTLS_GCM_ALT_H */
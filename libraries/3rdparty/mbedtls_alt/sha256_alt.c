@@ -0,0 +1,175 @@
+/*
+ * FreeRTOS mbed TLS V0.1.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file sha256_alt.c
+ * @brief Fully unrolled SHA-256 compression function for the mbed TLS
+ * MBEDTLS_SHA256_PROCESS_ALT hook.
+ *
+ * Compared with the stock implementation, the eight working variables are
+ * never shuffled (the round macro renames them instead), and the message
+ * schedule is kept in a 16-word circular window rather than a 64-word
+ * array.
+ */
+
+#if !defined( MBEDTLS_CONFIG_FILE )
+    #include "mbedtls/config.h"
+#else
+    #include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined( MBEDTLS_SHA256_C ) && defined( MBEDTLS_SHA256_PROCESS_ALT )
+
+/* mbed TLS includes. */
+#include "mbedtls/sha256.h"
+#include "mbedtls/platform_util.h"
+
+#define SHA256_ALT_ROTR( x, n )    ( ( ( x ) >> ( n ) ) | ( ( x ) << ( 32 - ( n ) ) ) )
+
+#define SHA256_ALT_S0( x )         ( SHA256_ALT_ROTR( x, 7 ) ^ SHA256_ALT_ROTR( x, 18 ) ^ ( ( x ) >> 3 ) )
+#define SHA256_ALT_S1( x )         ( SHA256_ALT_ROTR( x, 17 ) ^ SHA256_ALT_ROTR( x, 19 ) ^ ( ( x ) >> 10 ) )
+#define SHA256_ALT_S2( x )         ( SHA256_ALT_ROTR( x, 2 ) ^ SHA256_ALT_ROTR( x, 13 ) ^ SHA256_ALT_ROTR( x, 22 ) )
+#define SHA256_ALT_S3( x )         ( SHA256_ALT_ROTR( x, 6 ) ^ SHA256_ALT_ROTR( x, 11 ) ^ SHA256_ALT_ROTR( x, 25 ) )
+
+#define SHA256_ALT_CH( x, y, z )     ( ( z ) ^ ( ( x ) & ( ( y ) ^ ( z ) ) ) )
+#define SHA256_ALT_MAJ( x, y, z )    ( ( ( x ) & ( y ) ) | ( ( z ) & ( ( x ) | ( y ) ) ) )
+
+#define SHA256_ALT_GET_UINT32_BE( pucBuf, xOffset )           \
+    ( ( ( uint32_t ) ( pucBuf )[ ( xOffset ) ] << 24 ) |      \
+      ( ( uint32_t ) ( pucBuf )[ ( xOffset ) + 1 ] << 16 ) |  \
+      ( ( uint32_t ) ( pucBuf )[ ( xOffset ) + 2 ] << 8 ) |   \
+      ( ( uint32_t ) ( pucBuf )[ ( xOffset ) + 3 ] ) )
+
+/**
+ * @brief Message schedule word i (i >= 16), computed in the circular window.
+ */
+#define SHA256_ALT_W( i )                                                  \
+    ( pulW[ ( i ) & 15 ] += SHA256_ALT_S1( pulW[ ( ( i ) - 2 ) & 15 ] ) +  \
+                            pulW[ ( ( i ) - 7 ) & 15 ] +                   \
+                            SHA256_ALT_S0( pulW[ ( ( i ) - 15 ) & 15 ] ) )
+
+/**
+ * @brief One round; the caller rotates the variable names.
+ */
+#define SHA256_ALT_ROUND( a, b, c, d, e, f, g, h, ulWord, ulK )                            \
+    do {                                                                                   \
+        uint32_t ulT1 = ( h ) + SHA256_ALT_S3( e ) + SHA256_ALT_CH( e, f, g ) + ( ulK ) + ( ulWord ); \
+        ( d ) += ulT1;                                                                     \
+        ( h ) = ulT1 + SHA256_ALT_S2( a ) + SHA256_ALT_MAJ( a, b, c );                     \
+    } while( 0 )
+
+/**
+ * @brief Eight rounds, which bring the variable names back to their start.
+ */
+#define SHA256_ALT_ROUNDS8( i, W )                                             \
+    do {                                                                       \
+        SHA256_ALT_ROUND( a, b, c, d, e, f, g, h, W( ( i ) + 0 ), K[ ( i ) + 0 ] ); \
+        SHA256_ALT_ROUND( h, a, b, c, d, e, f, g, W( ( i ) + 1 ), K[ ( i ) + 1 ] ); \
+        SHA256_ALT_ROUND( g, h, a, b, c, d, e, f, W( ( i ) + 2 ), K[ ( i ) + 2 ] ); \
+        SHA256_ALT_ROUND( f, g, h, a, b, c, d, e, W( ( i ) + 3 ), K[ ( i ) + 3 ] ); \
+        SHA256_ALT_ROUND( e, f, g, h, a, b, c, d, W( ( i ) + 4 ), K[ ( i ) + 4 ] ); \
+        SHA256_ALT_ROUND( d, e, f, g, h, a, b, c, W( ( i ) + 5 ), K[ ( i ) + 5 ] ); \
+        SHA256_ALT_ROUND( c, d, e, f, g, h, a, b, W( ( i ) + 6 ), K[ ( i ) + 6 ] ); \
+        SHA256_ALT_ROUND( b, c, d, e, f, g, h, a, W( ( i ) + 7 ), K[ ( i ) + 7 ] ); \
+    } while( 0 )
+
+/**
+ * @brief Message word i (i < 16), loaded from the input block.
+ */
+#define SHA256_ALT_LOAD( i )    ( pulW[ ( i ) ] = SHA256_ALT_GET_UINT32_BE( data, ( i ) << 2 ) )
+
+/*-----------------------------------------------------------*/
+
+static const uint32_t K[] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+    0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+    0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+    0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+    0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+    0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_internal_sha256_process( mbedtls_sha256_context * ctx,
+                                     const unsigned char data[ 64 ] )
+{
+    uint32_t pulW[ 16 ];
+    uint32_t a, b, c, d, e, f, g, h;
+
+    a = ctx->state[ 0 ];
+    b = ctx->state[ 1 ];
+    c = ctx->state[ 2 ];
+    d = ctx->state[ 3 ];
+    e = ctx->state[ 4 ];
+    f = ctx->state[ 5 ];
+    g = ctx->state[ 6 ];
+    h = ctx->state[ 7 ];
+
+    SHA256_ALT_ROUNDS8( 0, SHA256_ALT_LOAD );
+    SHA256_ALT_ROUNDS8( 8, SHA256_ALT_LOAD );
+    SHA256_ALT_ROUNDS8( 16, SHA256_ALT_W );
+    SHA256_ALT_ROUNDS8( 24, SHA256_ALT_W );
+    SHA256_ALT_ROUNDS8( 32, SHA256_ALT_W );
+    SHA256_ALT_ROUNDS8( 40, SHA256_ALT_W );
+    SHA256_ALT_ROUNDS8( 48, SHA256_ALT_W );
+    SHA256_ALT_ROUNDS8( 56, SHA256_ALT_W );
+
+    ctx->state[ 0 ] += a;
+    ctx->state[ 1 ] += b;
+    ctx->state[ 2 ] += c;
+    ctx->state[ 3 ] += d;
+    ctx->state[ 4 ] += e;
+    ctx->state[ 5 ] += f;
+    ctx->state[ 6 ] += g;
+    ctx->state[ 7 ] += h;
+
+    mbedtls_platform_zeroize( pulW, sizeof( pulW ) );
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+#if !defined( MBEDTLS_DEPRECATED_REMOVED )
+    void mbedtls_sha256_process( mbedtls_sha256_context * ctx,
+                                 const unsigned char data[ 64 ] )
+    {
+        ( void ) mbedtls_internal_sha256_process( ctx, data );
+    }
+#endif
+/*-----------------------------------------------------------*/
+
+#endif /* MBEDTLS_SHA256_C && MBEDTLS_SHA256_PROCESS_ALT */
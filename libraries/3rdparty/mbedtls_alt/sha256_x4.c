@@ -0,0 +1,223 @@
+/*
+ * FreeRTOS mbed TLS V0.1.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file sha256_x4.c
+ * @brief SHA-256 of four independent messages, the rounds of the four
+ * computed together.
+ *
+ * Every round operates on four lanes, one per message, written as loops
+ * the compiler can turn into vector instructions. The tails and the
+ * padding go through the mbed TLS SHA-256 module.
+ */
+
+#if !defined( MBEDTLS_CONFIG_FILE )
+    #include "mbedtls/config.h"
+#else
+    #include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined( MBEDTLS_SHA256_C )
+
+#include "sha256_x4.h"
+#include "mbedtls/platform_util.h"
+
+#define SHA256_X4_LANES          4U
+
+#define SHA256_X4_ROTR( x, n )    ( ( ( x ) >> ( n ) ) | ( ( x ) << ( 32 - ( n ) ) ) )
+
+#define SHA256_X4_S0( x )         ( SHA256_X4_ROTR( x, 7 ) ^ SHA256_X4_ROTR( x, 18 ) ^ ( ( x ) >> 3 ) )
+#define SHA256_X4_S1( x )         ( SHA256_X4_ROTR( x, 17 ) ^ SHA256_X4_ROTR( x, 19 ) ^ ( ( x ) >> 10 ) )
+#define SHA256_X4_S2( x )         ( SHA256_X4_ROTR( x, 2 ) ^ SHA256_X4_ROTR( x, 13 ) ^ SHA256_X4_ROTR( x, 22 ) )
+#define SHA256_X4_S3( x )         ( SHA256_X4_ROTR( x, 6 ) ^ SHA256_X4_ROTR( x, 11 ) ^ SHA256_X4_ROTR( x, 25 ) )
+
+#define SHA256_X4_CH( x, y, z )     ( ( z ) ^ ( ( x ) & ( ( y ) ^ ( z ) ) ) )
+#define SHA256_X4_MAJ( x, y, z )    ( ( ( x ) & ( y ) ) | ( ( z ) & ( ( x ) | ( y ) ) ) )
+
+#define SHA256_X4_GET_UINT32_BE( pucBuf, xOffset )           \
+    ( ( ( uint32_t ) ( pucBuf )[ ( xOffset ) ] << 24 ) |     \
+      ( ( uint32_t ) ( pucBuf )[ ( xOffset ) + 1 ] << 16 ) | \
+      ( ( uint32_t ) ( pucBuf )[ ( xOffset ) + 2 ] << 8 ) |  \
+      ( ( uint32_t ) ( pucBuf )[ ( xOffset ) + 3 ] ) )
+
+/**
+ * @brief One round on the four lanes, using the lane index l of the caller;
+ * the caller rotates the variable names. Message words from 16 on are
+ * computed in the circular window first.
+ */
+#define SHA256_X4_ROUND( a, b, c, d, e, f, g, h, i )                                                    \
+    do {                                                                                                \
+        if( ( i ) >= 16U )                                                                              \
+        {                                                                                               \
+            for( l = 0; l < SHA256_X4_LANES; l++ )                                                      \
+            {                                                                                           \
+                pulW[ ( i ) & 15U ][ l ] += SHA256_X4_S1( pulW[ ( ( i ) - 2U ) & 15U ][ l ] ) +         \
+                                            pulW[ ( ( i ) - 7U ) & 15U ][ l ] +                         \
+                                            SHA256_X4_S0( pulW[ ( ( i ) - 15U ) & 15U ][ l ] );         \
+            }                                                                                           \
+        }                                                                                               \
+        for( l = 0; l < SHA256_X4_LANES; l++ )                                                          \
+        {                                                                                               \
+            uint32_t ulT1 = h[ l ] + SHA256_X4_S3( e[ l ] ) + SHA256_X4_CH( e[ l ], f[ l ], g[ l ] ) +  \
+                            sha256_x4_k[ ( i ) ] + pulW[ ( i ) & 15U ][ l ];                            \
+            d[ l ] += ulT1;                                                                             \
+            h[ l ] = ulT1 + SHA256_X4_S2( a[ l ] ) + SHA256_X4_MAJ( a[ l ], b[ l ], c[ l ] );           \
+        }                                                                                               \
+    } while( 0 )
+
+/*-----------------------------------------------------------*/
+
+static const uint32_t sha256_x4_k[] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+    0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+    0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+    0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+    0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+    0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_sha256_x4_process( mbedtls_sha256_context * ctx[ 4 ],
+                                const unsigned char * data[ 4 ] )
+{
+    uint32_t pulW[ 16 ][ SHA256_X4_LANES ];
+    uint32_t a[ SHA256_X4_LANES ], b[ SHA256_X4_LANES ], c[ SHA256_X4_LANES ], d[ SHA256_X4_LANES ];
+    uint32_t e[ SHA256_X4_LANES ], f[ SHA256_X4_LANES ], g[ SHA256_X4_LANES ], h[ SHA256_X4_LANES ];
+    uint32_t i, l;
+
+    for( l = 0; l < SHA256_X4_LANES; l++ )
+    {
+        a[ l ] = ctx[ l ]->state[ 0 ];
+        b[ l ] = ctx[ l ]->state[ 1 ];
+        c[ l ] = ctx[ l ]->state[ 2 ];
+        d[ l ] = ctx[ l ]->state[ 3 ];
+        e[ l ] = ctx[ l ]->state[ 4 ];
+        f[ l ] = ctx[ l ]->state[ 5 ];
+        g[ l ] = ctx[ l ]->state[ 6 ];
+        h[ l ] = ctx[ l ]->state[ 7 ];
+
+        for( i = 0; i < 16U; i++ )
+        {
+            pulW[ i ][ l ] = SHA256_X4_GET_UINT32_BE( data[ l ], i << 2 );
+        }
+    }
+
+    for( i = 0; i < 64U; i += 8U )
+    {
+        SHA256_X4_ROUND( a, b, c, d, e, f, g, h, i + 0U );
+        SHA256_X4_ROUND( h, a, b, c, d, e, f, g, i + 1U );
+        SHA256_X4_ROUND( g, h, a, b, c, d, e, f, i + 2U );
+        SHA256_X4_ROUND( f, g, h, a, b, c, d, e, i + 3U );
+        SHA256_X4_ROUND( e, f, g, h, a, b, c, d, i + 4U );
+        SHA256_X4_ROUND( d, e, f, g, h, a, b, c, i + 5U );
+        SHA256_X4_ROUND( c, d, e, f, g, h, a, b, i + 6U );
+        SHA256_X4_ROUND( b, c, d, e, f, g, h, a, i + 7U );
+    }
+
+    for( l = 0; l < SHA256_X4_LANES; l++ )
+    {
+        ctx[ l ]->state[ 0 ] += a[ l ];
+        ctx[ l ]->state[ 1 ] += b[ l ];
+        ctx[ l ]->state[ 2 ] += c[ l ];
+        ctx[ l ]->state[ 3 ] += d[ l ];
+        ctx[ l ]->state[ 4 ] += e[ l ];
+        ctx[ l ]->state[ 5 ] += f[ l ];
+        ctx[ l ]->state[ 6 ] += g[ l ];
+        ctx[ l ]->state[ 7 ] += h[ l ];
+    }
+
+    mbedtls_platform_zeroize( pulW, sizeof( pulW ) );
+}
+/*-----------------------------------------------------------*/
+
+int mbedtls_sha256_x4_ret( const unsigned char * input[ 4 ],
+                           size_t ilen,
+                           unsigned char output[ 4 ][ 32 ] )
+{
+    mbedtls_sha256_context pxCtx[ SHA256_X4_LANES ];
+    mbedtls_sha256_context * ppxCtx[ SHA256_X4_LANES ];
+    const unsigned char * ppucBlock[ SHA256_X4_LANES ];
+    size_t xDone = ilen & ~( ( size_t ) 63U );
+    size_t xOffset;
+    uint64_t ullBytes = ( uint64_t ) xDone;
+    int lResult = 0;
+    uint32_t l;
+
+    for( l = 0; l < SHA256_X4_LANES; l++ )
+    {
+        mbedtls_sha256_init( &pxCtx[ l ] );
+        ppxCtx[ l ] = &pxCtx[ l ];
+
+        if( lResult == 0 )
+        {
+            lResult = mbedtls_sha256_starts_ret( &pxCtx[ l ], 0 );
+        }
+    }
+
+    for( xOffset = 0; ( lResult == 0 ) && ( xOffset < xDone ); xOffset += 64U )
+    {
+        for( l = 0; l < SHA256_X4_LANES; l++ )
+        {
+            ppucBlock[ l ] = &input[ l ][ xOffset ];
+        }
+
+        mbedtls_sha256_x4_process( ppxCtx, ppucBlock );
+    }
+
+    /* The whole blocks are counted as if they went through the module. */
+    for( l = 0; ( lResult == 0 ) && ( l < SHA256_X4_LANES ); l++ )
+    {
+        pxCtx[ l ].total[ 0 ] = ( uint32_t ) ullBytes;
+        pxCtx[ l ].total[ 1 ] = ( uint32_t ) ( ullBytes >> 32 );
+        lResult = mbedtls_sha256_update_ret( &pxCtx[ l ], &input[ l ][ xDone ], ilen - xDone );
+
+        if( lResult == 0 )
+        {
+            lResult = mbedtls_sha256_finish_ret( &pxCtx[ l ], output[ l ] );
+        }
+    }
+
+    for( l = 0; l < SHA256_X4_LANES; l++ )
+    {
+        mbedtls_sha256_free( &pxCtx[ l ] );
+    }
+
+    return lResult;
+}
+/*-----------------------------------------------------------*/
+
+#endif /* MBEDTLS_SHA256_C */
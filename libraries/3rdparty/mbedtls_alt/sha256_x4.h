@@ -0,0 +1,63 @@
+/*
+ * FreeRTOS mbed TLS V0.1.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file sha256_x4.h
+ * @brief SHA-256 of four independent messages at once.
+ *
+ * SHA-256 cannot be split across lanes within one message, so the four
+ * computations run side by side. This only pays off where the compiler
+ * maps the four lanes to a vector unit, as on hosts with SSE2 or NEON.
+ */
+
+#ifndef SHA256_X4_H
+#define SHA256_X4_H
+
+/* mbed TLS includes. */
+#include "mbedtls/sha256.h"
+
+/**
+ * @brief Compresses one 64-byte block into each of four contexts.
+ *
+ * @param[in,out] ctx The four contexts; their state is updated.
+ * @param[in] data The block of each context.
+ */
+void mbedtls_sha256_x4_process( mbedtls_sha256_context * ctx[ 4 ],
+                                const unsigned char * data[ 4 ] );
+
+/**
+ * @brief SHA-256 of four messages of the same length.
+ *
+ * @param[in] input The four messages.
+ * @param[in] ilen Length of each message.
+ * @param[out] output The four digests.
+ *
+ * @return 0, or the error of the mbed TLS SHA-256 module.
+ */
+int mbedtls_sha256_x4_ret( const unsigned char * input[ 4 ],
+                           size_t ilen,
+                           unsigned char output[ 4 ][ 32 ] );
+
+#endif /* SHA256_X4_H */
@@ -0,0 +1,378 @@
+/*
+ * FreeRTOS mbed TLS V0.1.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file mbedtls_alt_benchmark.c
+ * @brief Host check and benchmark of the kernels of mbedtls_alt against
+ * the stock mbed TLS.
+ *
+ * The stock headers are included first; the alternative modules are then
+ * included with their functions renamed, so both run in one program. Each
+ * kernel is first checked against the stock result, then timed in MB/s
+ * and, on x86, in cycles per byte of the time stamp counter, which runs at
+ * the nominal clock. The program fails if a check fails. Build the stock
+ * library and run from this directory with:
+ *
+ *   make -C ../../mbedtls lib
+ *   gcc -std=c99 -O2 -march=native -I../../mbedtls/include -I.. \
+ *       mbedtls_alt_benchmark.c ../../mbedtls/library/libmbedcrypto.a \
+ *       -o mbedtls_alt_benchmark && ./mbedtls_alt_benchmark
+ *
+ * Without -march=native (or -mpclmul -mssse3) GHASH falls back to its
+ * 4-bit tables.
+ */
+
+#define _POSIX_C_SOURCE    199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+    #include <x86intrin.h>
+    #define BENCH_CYCLES()    __rdtsc()
+#else
+    #define BENCH_CYCLES()    0ULL
+#endif
+
+/* The stock modules. */
+#include "mbedtls/sha256.h"
+#include "mbedtls/gcm.h"
+
+/* The alternative modules, renamed. */
+#define MBEDTLS_SHA256_PROCESS_ALT
+#define mbedtls_internal_sha256_process    alt_sha256_process
+#include "../sha256_alt.c"
+#undef mbedtls_internal_sha256_process
+
+#include "../sha256_x4.c"
+
+#define MBEDTLS_GCM_ALT
+#define mbedtls_gcm_context          alt_gcm_context
+#define mbedtls_gcm_init             alt_gcm_init
+#define mbedtls_gcm_setkey           alt_gcm_setkey
+#define mbedtls_gcm_starts           alt_gcm_starts
+#define mbedtls_gcm_update           alt_gcm_update
+#define mbedtls_gcm_finish           alt_gcm_finish
+#define mbedtls_gcm_crypt_and_tag    alt_gcm_crypt_and_tag
+#define mbedtls_gcm_auth_decrypt     alt_gcm_auth_decrypt
+#define mbedtls_gcm_free             alt_gcm_free
+#include "../gcm_alt.h"
+#include "../gcm_alt.c"
+#undef mbedtls_gcm_context
+#undef mbedtls_gcm_init
+#undef mbedtls_gcm_setkey
+#undef mbedtls_gcm_starts
+#undef mbedtls_gcm_update
+#undef mbedtls_gcm_finish
+#undef mbedtls_gcm_crypt_and_tag
+#undef mbedtls_gcm_auth_decrypt
+#undef mbedtls_gcm_free
+
+#define BENCH_DATA_SIZE    ( 16U * 1024U )
+#define BENCH_SECONDS      ( 0.5 )
+#define BENCH_ROUNDS       ( 200U )
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+typedef void (* BenchFunction_t)( size_t xLength );
+
+static uint32_t ulFailures = 0;
+static unsigned char ucData[ 4 ][ BENCH_DATA_SIZE ];
+static unsigned char ucOut[ BENCH_DATA_SIZE ];
+static const unsigned char ucKey[ 32 ] = { 0 };
+static const unsigned char ucIv[ 12 ] = { 0 };
+static mbedtls_sha256_context xSha;
+static mbedtls_gcm_context xGcm;
+static alt_gcm_context xAltGcm;
+
+/*-----------------------------------------------------------*/
+
+static double prvSeconds( void )
+{
+    struct timespec xNow;
+
+    clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( double ) xNow.tv_sec + ( double ) xNow.tv_nsec * 1e-9;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Run a kernel on BENCH_DATA_SIZE bytes until BENCH_SECONDS have
+ * passed, and print its rate.
+ */
+static void prvBench( const char * pcName,
+                      BenchFunction_t xFunction,
+                      size_t xBytesPerCall )
+{
+    double xStart, xElapsed;
+    unsigned long long ullCycles;
+    size_t xCalls = 0;
+
+    xFunction( BENCH_DATA_SIZE );
+
+    xStart = prvSeconds();
+    ullCycles = BENCH_CYCLES();
+
+    do
+    {
+        xFunction( BENCH_DATA_SIZE );
+        xCalls++;
+        xElapsed = prvSeconds() - xStart;
+    } while( xElapsed < BENCH_SECONDS );
+
+    ullCycles = BENCH_CYCLES() - ullCycles;
+
+    printf( "%-28s %8.1f MB/s %8.2f cycles/byte\n", pcName,
+            ( double ) ( xCalls * xBytesPerCall ) / xElapsed / 1e6,
+            ( double ) ullCycles / ( double ) ( xCalls * xBytesPerCall ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvShaStock( size_t xLength )
+{
+    size_t i;
+
+    for( i = 0; i < xLength; i += 64U )
+    {
+        ( void ) mbedtls_internal_sha256_process( &xSha, &ucData[ 0 ][ i ] );
+    }
+}
+
+static void prvShaAlt( size_t xLength )
+{
+    size_t i;
+
+    for( i = 0; i < xLength; i += 64U )
+    {
+        ( void ) alt_sha256_process( &xSha, &ucData[ 0 ][ i ] );
+    }
+}
+
+static void prvShaStockFour( size_t xLength )
+{
+    unsigned char ucDigest[ 32 ];
+    uint32_t l;
+
+    for( l = 0; l < 4U; l++ )
+    {
+        ( void ) mbedtls_sha256_ret( ucData[ l ], xLength, ucDigest, 0 );
+    }
+}
+
+static void prvShaX4( size_t xLength )
+{
+    const unsigned char * ppucInput[ 4 ] = { ucData[ 0 ], ucData[ 1 ], ucData[ 2 ], ucData[ 3 ] };
+    unsigned char ucDigest[ 4 ][ 32 ];
+
+    ( void ) mbedtls_sha256_x4_ret( ppucInput, xLength, ucDigest );
+}
+
+static void prvGhashStock( size_t xLength )
+{
+    ( void ) mbedtls_gcm_starts( &xGcm, MBEDTLS_GCM_ENCRYPT, ucIv, sizeof( ucIv ), ucData[ 0 ], xLength );
+}
+
+static void prvGhashAlt( size_t xLength )
+{
+    ( void ) alt_gcm_starts( &xAltGcm, MBEDTLS_GCM_ENCRYPT, ucIv, sizeof( ucIv ), ucData[ 0 ], xLength );
+}
+
+static void prvGcmStock( size_t xLength )
+{
+    unsigned char ucTag[ 16 ];
+
+    ( void ) mbedtls_gcm_crypt_and_tag( &xGcm, MBEDTLS_GCM_ENCRYPT, xLength, ucIv, sizeof( ucIv ),
+                                        NULL, 0, ucData[ 0 ], ucOut, sizeof( ucTag ), ucTag );
+}
+
+static void prvGcmAlt( size_t xLength )
+{
+    unsigned char ucTag[ 16 ];
+
+    ( void ) alt_gcm_crypt_and_tag( &xAltGcm, MBEDTLS_GCM_ENCRYPT, xLength, ucIv, sizeof( ucIv ),
+                                    NULL, 0, ucData[ 0 ], ucOut, sizeof( ucTag ), ucTag );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCheckSha256( void )
+{
+    mbedtls_sha256_context xStock, xAlt;
+    const unsigned char * ppucInput[ 4 ] = { ucData[ 0 ], ucData[ 1 ], ucData[ 2 ], ucData[ 3 ] };
+    unsigned char ucDigest[ 4 ][ 32 ], ucExpected[ 32 ];
+    size_t xLength;
+    uint32_t ulRound, l;
+
+    mbedtls_sha256_init( &xStock );
+    mbedtls_sha256_init( &xAlt );
+    TEST_CHECK( mbedtls_sha256_starts_ret( &xStock, 0 ) == 0 );
+    TEST_CHECK( mbedtls_sha256_starts_ret( &xAlt, 0 ) == 0 );
+
+    for( ulRound = 0; ulRound < BENCH_ROUNDS; ulRound++ )
+    {
+        TEST_CHECK( mbedtls_internal_sha256_process( &xStock, &ucData[ 0 ][ ulRound * 64U ] ) == 0 );
+        TEST_CHECK( alt_sha256_process( &xAlt, &ucData[ 0 ][ ulRound * 64U ] ) == 0 );
+    }
+
+    TEST_CHECK( memcmp( xStock.state, xAlt.state, sizeof( xStock.state ) ) == 0 );
+
+    for( ulRound = 0; ulRound < BENCH_ROUNDS; ulRound++ )
+    {
+        xLength = ( ulRound < 130U ) ? ulRound : ( size_t ) rand() % BENCH_DATA_SIZE;
+        TEST_CHECK( mbedtls_sha256_x4_ret( ppucInput, xLength, ucDigest ) == 0 );
+
+        for( l = 0; l < 4U; l++ )
+        {
+            TEST_CHECK( mbedtls_sha256_ret( ucData[ l ], xLength, ucExpected, 0 ) == 0 );
+            TEST_CHECK( memcmp( ucDigest[ l ], ucExpected, sizeof( ucExpected ) ) == 0 );
+        }
+    }
+
+    mbedtls_sha256_free( &xStock );
+    mbedtls_sha256_free( &xAlt );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCheckGcm( void )
+{
+    /* Test cases 1 and 2 of the GCM specification. */
+    static const unsigned char ucTag1[ 16 ] =
+    {
+        0x58, 0xe2, 0xfc, 0xce, 0xfa, 0x7e, 0x30, 0x61, 0x36, 0x7f, 0x1d, 0x57, 0xa4, 0xe7, 0x45, 0x5a
+    };
+    static const unsigned char ucCipher2[ 16 ] =
+    {
+        0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92, 0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78
+    };
+    static const unsigned char ucTag2[ 16 ] =
+    {
+        0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd, 0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf
+    };
+    static unsigned char ucExpected[ BENCH_DATA_SIZE ], ucPlain[ BENCH_DATA_SIZE ];
+    unsigned char ucZero[ 16 ] = { 0 }, ucBlock[ 16 ], ucTag[ 16 ], ucExpectedTag[ 16 ];
+    size_t xLength, xIvLength, xAddLength;
+    uint32_t ulRound, ulKeyBits;
+
+    TEST_CHECK( alt_gcm_setkey( &xAltGcm, MBEDTLS_CIPHER_ID_AES, ucKey, 128 ) == 0 );
+    TEST_CHECK( alt_gcm_crypt_and_tag( &xAltGcm, MBEDTLS_GCM_ENCRYPT, 0, ucIv, sizeof( ucIv ),
+                                       NULL, 0, NULL, NULL, 16, ucTag ) == 0 );
+    TEST_CHECK( memcmp( ucTag, ucTag1, sizeof( ucTag ) ) == 0 );
+    TEST_CHECK( alt_gcm_crypt_and_tag( &xAltGcm, MBEDTLS_GCM_ENCRYPT, 16, ucIv, sizeof( ucIv ),
+                                       NULL, 0, ucZero, ucBlock, 16, ucTag ) == 0 );
+    TEST_CHECK( memcmp( ucBlock, ucCipher2, sizeof( ucBlock ) ) == 0 );
+    TEST_CHECK( memcmp( ucTag, ucTag2, sizeof( ucTag ) ) == 0 );
+
+    /* Random lengths of IV, additional data and data, against the stock
+     * module, in both directions and in place. */
+    for( ulRound = 0; ulRound < BENCH_ROUNDS; ulRound++ )
+    {
+        ulKeyBits = 128U + 64U * ( ulRound % 3U );
+        xLength = ( ulRound < 100U ) ? ulRound : ( size_t ) rand() % BENCH_DATA_SIZE;
+        xIvLength = ( ulRound & 1U ) ? 12U : 1U + ( size_t ) rand() % 64U;
+        xAddLength = ( size_t ) rand() % 300U;
+
+        TEST_CHECK( mbedtls_gcm_setkey( &xGcm, MBEDTLS_CIPHER_ID_AES, ucData[ 1 ], ulKeyBits ) == 0 );
+        TEST_CHECK( alt_gcm_setkey( &xAltGcm, MBEDTLS_CIPHER_ID_AES, ucData[ 1 ], ulKeyBits ) == 0 );
+        TEST_CHECK( mbedtls_gcm_crypt_and_tag( &xGcm, MBEDTLS_GCM_ENCRYPT, xLength, ucData[ 2 ], xIvLength,
+                                               ucData[ 3 ], xAddLength, ucData[ 0 ], ucExpected, 16, ucExpectedTag ) == 0 );
+        TEST_CHECK( alt_gcm_crypt_and_tag( &xAltGcm, MBEDTLS_GCM_ENCRYPT, xLength, ucData[ 2 ], xIvLength,
+                                           ucData[ 3 ], xAddLength, ucData[ 0 ], ucOut, 16, ucTag ) == 0 );
+        TEST_CHECK( memcmp( ucOut, ucExpected, xLength ) == 0 );
+        TEST_CHECK( memcmp( ucTag, ucExpectedTag, sizeof( ucTag ) ) == 0 );
+
+        TEST_CHECK( alt_gcm_auth_decrypt( &xAltGcm, xLength, ucData[ 2 ], xIvLength, ucData[ 3 ], xAddLength,
+                                          ucTag, 16, ucOut, ucOut ) == 0 );
+        TEST_CHECK( memcmp( ucOut, ucData[ 0 ], xLength ) == 0 );
+
+        memcpy( ucPlain, ucExpected, xLength );
+        ucExpectedTag[ ulRound % 16U ] ^= 1U;
+        TEST_CHECK( alt_gcm_auth_decrypt( &xAltGcm, xLength, ucData[ 2 ], xIvLength, ucData[ 3 ], xAddLength,
+                                          ucExpectedTag, 16, ucPlain, ucPlain ) == MBEDTLS_ERR_GCM_AUTH_FAILED );
+    }
+
+    TEST_CHECK( alt_gcm_update( &xAltGcm, 32, ucOut, &ucOut[ 16 ] ) == MBEDTLS_ERR_GCM_BAD_INPUT );
+    TEST_CHECK( alt_gcm_finish( &xAltGcm, ucTag, 3 ) == MBEDTLS_ERR_GCM_BAD_INPUT );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    size_t i;
+
+    srand( 1 );
+
+    for( i = 0; i < sizeof( ucData ); i++ )
+    {
+        ( ( unsigned char * ) ucData )[ i ] = ( unsigned char ) rand();
+    }
+
+    mbedtls_sha256_init( &xSha );
+    mbedtls_gcm_init( &xGcm );
+    alt_gcm_init( &xAltGcm );
+
+    prvCheckSha256();
+    prvCheckGcm();
+
+    ( void ) mbedtls_sha256_starts_ret( &xSha, 0 );
+    ( void ) mbedtls_gcm_setkey( &xGcm, MBEDTLS_CIPHER_ID_AES, ucKey, 128 );
+    ( void ) alt_gcm_setkey( &xAltGcm, MBEDTLS_CIPHER_ID_AES, ucKey, 128 );
+
+    #if defined( GCM_ALT_CLMUL )
+        printf( "GHASH of gcm_alt.c on the carry-less multiply\n" );
+    #else
+        printf( "GHASH of gcm_alt.c on 4-bit tables\n" );
+    #endif
+
+    prvBench( "SHA-256 block, stock", prvShaStock, BENCH_DATA_SIZE );
+    prvBench( "SHA-256 block, sha256_alt", prvShaAlt, BENCH_DATA_SIZE );
+    prvBench( "SHA-256 4 messages, stock", prvShaStockFour, 4U * BENCH_DATA_SIZE );
+    prvBench( "SHA-256 4 messages, x4", prvShaX4, 4U * BENCH_DATA_SIZE );
+    prvBench( "GHASH, stock", prvGhashStock, BENCH_DATA_SIZE );
+    prvBench( "GHASH, gcm_alt", prvGhashAlt, BENCH_DATA_SIZE );
+    prvBench( "AES-128-GCM, stock", prvGcmStock, BENCH_DATA_SIZE );
+    prvBench( "AES-128-GCM, gcm_alt", prvGcmAlt, BENCH_DATA_SIZE );
+
+    mbedtls_sha256_free( &xSha );
+    mbedtls_gcm_free( &xGcm );
+    alt_gcm_free( &xAltGcm );
+
+    printf( "%s: %u failures\n", ( ulFailures == 0U ) ? "PASS" : "FAIL", ( unsigned ) ulFailures );
+
+    return ( ulFailures == 0U ) ? 0 : 1;
+}
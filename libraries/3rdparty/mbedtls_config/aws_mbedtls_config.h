@@ -493,6 +493,24 @@
 //#define MBEDTLS_ECDSA_SIGN_ALT
 //#define MBEDTLS_ECDSA_GENKEY_ALT
 
+/*
+ * Kernels from libraries/3rdparty/mbedtls_alt. None is enabled by default;
+ * see its README.md for the measurements.
+ * - CONFIG_MBEDTLS_USE_AFR_SHA256_ALT selects sha256_alt.c, an unrolled
+ *   SHA-256 compression function.
+ * - CONFIG_MBEDTLS_USE_AFR_GCM_ALT selects gcm_alt.c, a GCM module whose
+ *   GHASH runs on the carry-less multiply instruction. Only enable it on
+ *   a core that has one; the mbedtls_alt folder must be on the include
+ *   path for gcm_alt.h.
+ */
+#ifdef CONFIG_MBEDTLS_USE_AFR_SHA256_ALT
+    #define MBEDTLS_SHA256_PROCESS_ALT
+#endif
+
+#ifdef CONFIG_MBEDTLS_USE_AFR_GCM_ALT
+    #define MBEDTLS_GCM_ALT
+#endif
+
 /**
  * \def MBEDTLS_ECP_INTERNAL_ALT
  *
@@ -1507,6 +1525,18 @@
  */
 #define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
 
+/**
+ * \def MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+ *
+ * Support for variable buffer lengths in the SSL context: once the handshake
+ * is complete, the I/O buffers are resized to the negotiated maximum fragment
+ * length, and iot_tls.c may shrink them further per connection or release
+ * them while the connection is idle.
+ *
+ * Comment this macro to keep both I/O buffers at their compile-time size.
+ */
+#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+
 /**
  * \def MBEDTLS_SSL_PROTO_SSL3
  *
@@ -3251,7 +3281,7 @@
  * Uncomment to set the maximum plaintext size of the outgoing I/O buffer
  * independently of the incoming I/O buffer.
  */
-//#define MBEDTLS_SSL_OUT_CONTENT_LEN             16384
+#define MBEDTLS_SSL_OUT_CONTENT_LEN             4096
 
 /** \def MBEDTLS_SSL_DTLS_MAX_BUFFERING
  *
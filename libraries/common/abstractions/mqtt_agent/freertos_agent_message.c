@@ -26,7 +26,7 @@
 
 /**
  * @file freertos_agent_message.c
- * @brief Implements functions to interact with queues.
+ * @brief Implements functions to deliver commands to the MQTT agent task.
  */
 
 /* Standard includes. */
@@ -35,7 +35,8 @@
 
 /* Kernel includes. */
 #include "FreeRTOS.h"
-#include "semphr.h"
+#include "task.h"
+#include "atomic.h"
 
 /* Header include. */
 #include "freertos_agent_message.h"
@@ -43,18 +44,134 @@
 
 /*-----------------------------------------------------------*/
 
-bool Agent_MessageSend( MQTTAgentMessageContext_t * pMsgCtx,
-                        MQTTAgentCommand_t * const * pCommandToSend,
-                        uint32_t blockTimeMs )
+#define RING_INDEX_MASK    ( MQTT_AGENT_MESSAGE_RING_LENGTH - 1U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Place a command in the next free position of the ring.
+ *
+ * A position is free for the pass a sender is on when its sequence equals the
+ * position. It is claimed by moving the head past it, and handed to the agent
+ * by setting its sequence one beyond the position once the command is
+ * written.
+ *
+ * @return pdTRUE if the command was placed, pdFALSE if the ring is full.
+ */
+static BaseType_t prvRingPush( MQTTAgentMessageContext_t * pMsgCtx,
+                               MQTTAgentCommand_t * pCommand )
+{
+    BaseType_t placed = pdFALSE;
+    AgentMessageSlot_t * pSlot = NULL;
+    uint32_t position;
+    int32_t difference;
+
+    do
+    {
+        position = pMsgCtx->head;
+        pSlot = &pMsgCtx->slots[ position & RING_INDEX_MASK ];
+        difference = ( int32_t ) ( pSlot->sequence - position );
+
+        if( difference < 0 )
+        {
+            /* The agent has not yet taken the command from the last pass. */
+            break;
+        }
+
+        /* A position ahead of its sequence was claimed by another sender
+         * after the head was read; the head is read again. */
+    } while( ( difference != 0 ) ||
+             ( Atomic_CompareAndSwap_u32( &pMsgCtx->head, position + 1U, position ) != ATOMIC_COMPARE_AND_SWAP_SUCCESS ) );
+
+    if( difference == 0 )
+    {
+        /* The compare-and-swap orders the write of the command before the
+         * hand over, even on a multi-core target. Nothing else changes the
+         * sequence of a claimed position, so it always succeeds. */
+        pSlot->pCommand = pCommand;
+        ( void ) Atomic_CompareAndSwap_u32( &pSlot->sequence, position + 1U, position );
+        placed = pdTRUE;
+    }
+
+    return placed;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Take the commands handed to the agent, in order.
+ *
+ * @return The number of commands taken.
+ */
+static size_t prvRingPop( MQTTAgentMessageContext_t * pMsgCtx,
+                          MQTTAgentCommand_t ** pReceivedCommands,
+                          size_t maxCommands )
+{
+    size_t receivedCount = 0;
+    AgentMessageSlot_t * pSlot;
+
+    while( receivedCount < maxCommands )
+    {
+        pSlot = &pMsgCtx->slots[ pMsgCtx->tail & RING_INDEX_MASK ];
+
+        /* Checking the sequence with compare-and-swap orders the read of the
+         * command after it. */
+        if( Atomic_CompareAndSwap_u32( &pSlot->sequence, pMsgCtx->tail + 1U, pMsgCtx->tail + 1U ) != ATOMIC_COMPARE_AND_SWAP_SUCCESS )
+        {
+            break;
+        }
+
+        pReceivedCommands[ receivedCount ] = pSlot->pCommand;
+        receivedCount++;
+
+        /* Free the position for the next pass of the ring. */
+        ( void ) Atomic_CompareAndSwap_u32( &pSlot->sequence, pMsgCtx->tail + MQTT_AGENT_MESSAGE_RING_LENGTH, pMsgCtx->tail + 1U );
+        pMsgCtx->tail++;
+    }
+
+    return receivedCount;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Notify the agent task if it is waiting for a command.
+ *
+ * The compare-and-swap orders the read of the flag after the commands just
+ * placed, so the agent either sees them before it waits or is notified.
+ */
+static void prvWakeAgent( MQTTAgentMessageContext_t * pMsgCtx )
+{
+    if( Atomic_CompareAndSwap_u32( &pMsgCtx->agentWaiting, 0U, 1U ) == ATOMIC_COMPARE_AND_SWAP_SUCCESS )
+    {
+        ( void ) xTaskNotifyGiveIndexed( pMsgCtx->agentTask, MQTT_AGENT_MESSAGE_NOTIFY_IDX );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_MessageInit( MQTTAgentMessageContext_t * pMsgCtx )
 {
-    BaseType_t queueStatus = pdFAIL;
+    uint32_t i;
 
-    if( ( pMsgCtx != NULL ) && ( pCommandToSend != NULL ) )
+    if( pMsgCtx != NULL )
     {
-        queueStatus = xQueueSendToBack( pMsgCtx->queue, pCommandToSend, pdMS_TO_TICKS( blockTimeMs ) );
+        memset( pMsgCtx, 0x00, sizeof( MQTTAgentMessageContext_t ) );
+
+        for( i = 0; i < MQTT_AGENT_MESSAGE_RING_LENGTH; i++ )
+        {
+            pMsgCtx->slots[ i ].sequence = i;
+        }
     }
+}
 
-    return ( queueStatus == pdPASS ) ? true : false;
+/*-----------------------------------------------------------*/
+
+bool Agent_MessageSend( MQTTAgentMessageContext_t * pMsgCtx,
+                        MQTTAgentCommand_t * const * pCommandToSend,
+                        uint32_t blockTimeMs )
+{
+    return ( Agent_MessageSendBatch( pMsgCtx, pCommandToSend, 1U, blockTimeMs ) == 1U ) ? true : false;
 }
 
 /*-----------------------------------------------------------*/
@@ -63,12 +180,98 @@ bool Agent_MessageReceive( MQTTAgentMessageContext_t * pMsgCtx,
                            MQTTAgentCommand_t ** pReceivedCommand,
                            uint32_t blockTimeMs )
 {
-    BaseType_t queueStatus = pdFAIL;
+    return ( Agent_MessageReceiveBatch( pMsgCtx, pReceivedCommand, 1U, blockTimeMs ) == 1U ) ? true : false;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t Agent_MessageSendBatch( MQTTAgentMessageContext_t * pMsgCtx,
+                               MQTTAgentCommand_t * const * pCommandsToSend,
+                               size_t commandCount,
+                               uint32_t blockTimeMs )
+{
+    size_t sentCount = 0;
+    size_t placedCount;
+    TimeOut_t timeOut;
+    TickType_t ticksToWait = pdMS_TO_TICKS( blockTimeMs );
+
+    if( ( pMsgCtx != NULL ) && ( pCommandsToSend != NULL ) )
+    {
+        vTaskSetTimeOutState( &timeOut );
+
+        do
+        {
+            placedCount = 0;
+
+            while( ( sentCount < commandCount ) &&
+                   ( prvRingPush( pMsgCtx, pCommandsToSend[ sentCount ] ) == pdTRUE ) )
+            {
+                sentCount++;
+                placedCount++;
+            }
+
+            /* One notification for all the commands placed. */
+            if( placedCount > 0U )
+            {
+                prvWakeAgent( pMsgCtx );
+            }
+
+            if( sentCount == commandCount )
+            {
+                break;
+            }
+
+            /* The ring is full; try again once the agent has run. */
+            if( xTaskCheckForTimeOut( &timeOut, &ticksToWait ) != pdFALSE )
+            {
+                break;
+            }
+
+            vTaskDelay( 1U );
+        } while( sentCount < commandCount );
+    }
+
+    return sentCount;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t Agent_MessageReceiveBatch( MQTTAgentMessageContext_t * pMsgCtx,
+                                  MQTTAgentCommand_t ** pReceivedCommands,
+                                  size_t maxCommands,
+                                  uint32_t blockTimeMs )
+{
+    size_t receivedCount = 0;
+    TimeOut_t timeOut;
+    TickType_t ticksToWait = pdMS_TO_TICKS( blockTimeMs );
 
-    if( ( pMsgCtx != NULL ) && ( pReceivedCommand != NULL ) )
+    if( ( pMsgCtx != NULL ) && ( pReceivedCommands != NULL ) && ( maxCommands > 0U ) )
     {
-        queueStatus = xQueueReceive( pMsgCtx->queue, pReceivedCommand, pdMS_TO_TICKS( blockTimeMs ) );
+        receivedCount = prvRingPop( pMsgCtx, pReceivedCommands, maxCommands );
+
+        if( receivedCount == 0U )
+        {
+            pMsgCtx->agentTask = xTaskGetCurrentTaskHandle();
+            vTaskSetTimeOutState( &timeOut );
+
+            /* The ring is checked again after the waiting flag is set, so that
+             * a command sent in between is not missed. A notification left
+             * from an earlier wait only makes the ring be checked once more. */
+            while( ( receivedCount == 0U ) && ( xTaskCheckForTimeOut( &timeOut, &ticksToWait ) == pdFALSE ) )
+            {
+                ( void ) Atomic_CompareAndSwap_u32( &pMsgCtx->agentWaiting, 1U, 0U );
+                receivedCount = prvRingPop( pMsgCtx, pReceivedCommands, maxCommands );
+
+                if( receivedCount == 0U )
+                {
+                    ( void ) ulTaskNotifyTakeIndexed( MQTT_AGENT_MESSAGE_NOTIFY_IDX, pdTRUE, ticksToWait );
+                    receivedCount = prvRingPop( pMsgCtx, pReceivedCommands, maxCommands );
+                }
+
+                ( void ) Atomic_CompareAndSwap_u32( &pMsgCtx->agentWaiting, 0U, 1U );
+            }
+        }
     }
 
-    return ( queueStatus == pdPASS ) ? true : false;
+    return receivedCount;
 }
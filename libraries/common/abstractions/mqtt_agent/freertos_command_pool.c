@@ -35,11 +35,11 @@
 
 /* Kernel includes. */
 #include "FreeRTOS.h"
-#include "semphr.h"
+#include "task.h"
+#include "atomic.h"
 
 /* Header include. */
 #include "freertos_command_pool.h"
-#include "freertos_agent_message.h"
 
 /* Logging subsystem include */
 #ifndef LIBRARY_LOG_NAME
@@ -52,8 +52,26 @@
 
 /*-----------------------------------------------------------*/
 
-#define QUEUE_NOT_INITIALIZED    ( 0U )
-#define QUEUE_INITIALIZED        ( 1U )
+#define POOL_NOT_INITIALIZED    ( 0U )
+#define POOL_INITIALIZED        ( 1U )
+
+/**
+ * @brief Index marking the end of the free list.
+ */
+#define POOL_INDEX_NONE          ( 0xFFFFU )
+
+/**
+ * @brief The low half of the free list head is the index of the first free
+ * structure, the high half a count of the changes made to the head. The count
+ * makes a compare-and-swap fail if the head was popped and pushed back in
+ * between, even though it holds the same index again.
+ */
+#define POOL_HEAD_INDEX_MASK     ( 0x0000FFFFUL )
+#define POOL_HEAD_TAG_INCREMENT  ( 0x00010000UL )
+
+#if ( MQTT_COMMAND_CONTEXTS_POOL_SIZE >= POOL_INDEX_NONE )
+    #error "MQTT_COMMAND_CONTEXTS_POOL_SIZE must be less than 65535."
+#endif
 
 /**
  * @brief The pool of command structures used to hold information on commands (such
@@ -63,54 +81,213 @@
 static MQTTAgentCommand_t commandStructurePool[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
 
 /**
- * @brief The message context used to guard the pool of MQTTAgentCommand_t structures.
- * For FreeRTOS, this is implemented with a queue. Structures may be
- * obtained by receiving a pointer from the queue, and returned by
- * sending the pointer back into it.
+ * @brief The free structures form a list linked by index, popped and pushed
+ * with compare-and-swap so that obtaining or releasing a structure takes no
+ * queue operation.
+ */
+static uint16_t nextFreeIndex[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+static volatile uint32_t freeListHead = POOL_INDEX_NONE;
+
+/**
+ * @brief 1 while a structure is obtained, so that releasing it twice is caught.
+ */
+static volatile uint32_t commandInUse[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+
+/**
+ * @brief Tasks waiting in Agent_GetCommand() for a structure to be released.
+ * Only touched when the pool is empty.
+ */
+static TaskHandle_t waitingTasks[ MQTT_COMMAND_POOL_MAX_WAITERS ];
+static volatile uint32_t waitingTaskCount = 0;
+
+/**
+ * @brief Counters of the pool.
+ */
+static AgentCommandPoolStats_t poolStats;
+
+/**
+ * @brief Initialization status of the pool.
+ */
+static volatile uint8_t initStatus = POOL_NOT_INITIALIZED;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Take the first structure off the free list.
+ *
+ * @return The structure, or NULL if the pool is empty.
+ */
+static MQTTAgentCommand_t * prvPopFree( void )
+{
+    MQTTAgentCommand_t * pCommand = NULL;
+    uint32_t head;
+    uint32_t newHead;
+    uint32_t index;
+
+    do
+    {
+        head = freeListHead;
+        index = head & POOL_HEAD_INDEX_MASK;
+
+        if( index == POOL_INDEX_NONE )
+        {
+            break;
+        }
+
+        newHead = ( ( head + POOL_HEAD_TAG_INCREMENT ) & ~POOL_HEAD_INDEX_MASK ) | nextFreeIndex[ index ];
+    } while( Atomic_CompareAndSwap_u32( &freeListHead, newHead, head ) != ATOMIC_COMPARE_AND_SWAP_SUCCESS );
+
+    if( index != POOL_INDEX_NONE )
+    {
+        pCommand = &commandStructurePool[ index ];
+        commandInUse[ index ] = 1U;
+    }
+
+    return pCommand;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Put a structure back at the head of the free list.
+ */
+static void prvPushFree( uint32_t index )
+{
+    uint32_t head;
+    uint32_t newHead;
+
+    do
+    {
+        head = freeListHead;
+        nextFreeIndex[ index ] = ( uint16_t ) ( head & POOL_HEAD_INDEX_MASK );
+        newHead = ( ( head + POOL_HEAD_TAG_INCREMENT ) & ~POOL_HEAD_INDEX_MASK ) | index;
+    } while( Atomic_CompareAndSwap_u32( &freeListHead, newHead, head ) != ATOMIC_COMPARE_AND_SWAP_SUCCESS );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Record a structure being obtained.
+ */
+static void prvCountObtained( void )
+{
+    uint32_t inUse = Atomic_Increment_u32( &poolStats.inUse ) + 1U;
+    uint32_t highWaterMark;
+
+    do
+    {
+        highWaterMark = poolStats.highWaterMark;
+    } while( ( inUse > highWaterMark ) &&
+             ( Atomic_CompareAndSwap_u32( &poolStats.highWaterMark, inUse, highWaterMark ) != ATOMIC_COMPARE_AND_SWAP_SUCCESS ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add the calling task to the waiting tasks.
+ *
+ * @return pdTRUE if it was added, pdFALSE if every slot is taken.
+ */
+static BaseType_t prvAddWaitingTask( void )
+{
+    BaseType_t added = pdFALSE;
+    size_t i;
+
+    taskENTER_CRITICAL();
+    {
+        for( i = 0; i < MQTT_COMMAND_POOL_MAX_WAITERS; i++ )
+        {
+            if( waitingTasks[ i ] == NULL )
+            {
+                waitingTasks[ i ] = xTaskGetCurrentTaskHandle();
+                waitingTaskCount++;
+                added = pdTRUE;
+                break;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return added;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Notify a waiting task that a structure may be free.
  */
-static MQTTAgentMessageContext_t commandStructMessageCtx;
+static void prvWakeWaitingTask( void )
+{
+    size_t i;
+
+    taskENTER_CRITICAL();
+    {
+        for( i = 0; i < MQTT_COMMAND_POOL_MAX_WAITERS; i++ )
+        {
+            if( waitingTasks[ i ] != NULL )
+            {
+                ( void ) xTaskNotifyGiveIndexed( waitingTasks[ i ], MQTT_COMMAND_POOL_NOTIFY_IDX );
+                break;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
 
 /**
- * @brief Initialization status of the queue.
+ * @brief Remove the calling task from the waiting tasks.
+ *
+ * The task may have been notified of a structure it did not take; the
+ * notification is then passed on to another waiting task.
  */
-static volatile uint8_t initStatus = QUEUE_NOT_INITIALIZED;
+static void prvRemoveWaitingTask( void )
+{
+    TaskHandle_t currentTask = xTaskGetCurrentTaskHandle();
+    size_t i;
+
+    taskENTER_CRITICAL();
+    {
+        for( i = 0; i < MQTT_COMMAND_POOL_MAX_WAITERS; i++ )
+        {
+            if( waitingTasks[ i ] == currentTask )
+            {
+                waitingTasks[ i ] = NULL;
+                waitingTaskCount--;
+                break;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( ( waitingTaskCount > 0U ) && ( ( freeListHead & POOL_HEAD_INDEX_MASK ) != POOL_INDEX_NONE ) )
+    {
+        prvWakeWaitingTask();
+    }
+}
 
 /*-----------------------------------------------------------*/
 
 void Agent_InitializePool( void )
 {
     size_t i;
-    MQTTAgentCommand_t * pCommand;
-    static uint8_t staticQueueStorageArea[ MQTT_COMMAND_CONTEXTS_POOL_SIZE * sizeof( MQTTAgentCommand_t * ) ];
-    static StaticQueue_t staticQueueStructure;
-    bool commandAdded = false;
 
-    if( initStatus == QUEUE_NOT_INITIALIZED )
+    if( initStatus == POOL_NOT_INITIALIZED )
     {
         memset( ( void * ) commandStructurePool, 0x00, sizeof( commandStructurePool ) );
+        memset( &poolStats, 0x00, sizeof( poolStats ) );
 
-#ifdef CONFIG_PLATFORM_AMEBAD2
-        commandStructMessageCtx.queue = xQueueCreate( MQTT_COMMAND_CONTEXTS_POOL_SIZE,
-                                                      sizeof( MQTTAgentCommand_t * ) );
-#else
-        commandStructMessageCtx.queue = xQueueCreateStatic( MQTT_COMMAND_CONTEXTS_POOL_SIZE,
-                                                            sizeof( MQTTAgentCommand_t * ),
-                                                            staticQueueStorageArea,
-                                                            &staticQueueStructure );
-#endif
-        configASSERT( commandStructMessageCtx.queue );
-
-        /* Populate the queue. */
+        /* Link every structure into the free list. */
         for( i = 0; i < MQTT_COMMAND_CONTEXTS_POOL_SIZE; i++ )
         {
-            /* Store the address as a variable. */
-            pCommand = &commandStructurePool[ i ];
-            /* Send the pointer to the queue. */
-            commandAdded = Agent_MessageSend( &commandStructMessageCtx, &pCommand, 0U );
-            configASSERT( commandAdded );
+            nextFreeIndex[ i ] = ( uint16_t ) ( ( ( i + 1U ) < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ? ( i + 1U ) : POOL_INDEX_NONE );
+            commandInUse[ i ] = 0U;
         }
 
-        initStatus = QUEUE_INITIALIZED;
+        freeListHead = ( MQTT_COMMAND_CONTEXTS_POOL_SIZE > 0U ) ? 0U : POOL_INDEX_NONE;
+
+        initStatus = POOL_INITIALIZED;
     }
 }
 
@@ -119,16 +296,54 @@ void Agent_InitializePool( void )
 MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs )
 {
     MQTTAgentCommand_t * structToUse = NULL;
-    bool structRetrieved = false;
+    TimeOut_t timeOut;
+    TickType_t ticksToWait = pdMS_TO_TICKS( blockTimeMs );
+    BaseType_t waiting = pdFALSE;
 
-    /* Check queue has been created. */
-    configASSERT( initStatus == QUEUE_INITIALIZED );
+    /* Check the pool has been initialized. */
+    configASSERT( initStatus == POOL_INITIALIZED );
 
-    /* Retrieve a struct from the queue. */
-    structRetrieved = Agent_MessageReceive( &commandStructMessageCtx, &( structToUse ), blockTimeMs );
+    structToUse = prvPopFree();
 
-    if( !structRetrieved )
+    if( structToUse == NULL )
     {
+        ( void ) Atomic_Increment_u32( &poolStats.exhaustedCount );
+        vTaskSetTimeOutState( &timeOut );
+
+        /* Wait for a structure to be released. The pool is tried again after
+         * the task is added to the waiting tasks, so that a release in between
+         * is not missed. A task finding no free slot polls every tick. */
+        while( ( structToUse == NULL ) && ( xTaskCheckForTimeOut( &timeOut, &ticksToWait ) == pdFALSE ) )
+        {
+            if( waiting == pdFALSE )
+            {
+                waiting = prvAddWaitingTask();
+            }
+
+            structToUse = prvPopFree();
+
+            if( structToUse == NULL )
+            {
+                ( void ) ulTaskNotifyTakeIndexed( MQTT_COMMAND_POOL_NOTIFY_IDX,
+                                                  pdTRUE,
+                                                  ( waiting == pdFALSE ) ? 1U : ticksToWait );
+                structToUse = prvPopFree();
+            }
+        }
+
+        if( waiting != pdFALSE )
+        {
+            prvRemoveWaitingTask();
+        }
+    }
+
+    if( structToUse != NULL )
+    {
+        prvCountObtained();
+    }
+    else
+    {
+        ( void ) Atomic_Increment_u32( &poolStats.failedCount );
         LogError( ( "No command structure available." ) );
     }
 
@@ -140,21 +355,55 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs )
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
 {
     bool structReturned = false;
+    uint32_t index;
 
-    configASSERT( initStatus == QUEUE_INITIALIZED );
+    configASSERT( initStatus == POOL_INITIALIZED );
 
-    /* See if the structure being returned is actually from the pool. */
-    if( ( pCommandToRelease >= commandStructurePool ) &&
-        ( pCommandToRelease < ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
+    /* See if the structure being returned is actually from the pool, and was
+     * obtained from it. */
+    if( ( ( uintptr_t ) pCommandToRelease >= ( uintptr_t ) commandStructurePool ) &&
+        ( ( uintptr_t ) pCommandToRelease < ( uintptr_t ) ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) &&
+        ( ( ( ( uintptr_t ) pCommandToRelease - ( uintptr_t ) commandStructurePool ) % sizeof( MQTTAgentCommand_t ) ) == 0U ) )
     {
-        structReturned = Agent_MessageSend( &commandStructMessageCtx, &pCommandToRelease, 0U );
+        index = ( uint32_t ) ( pCommandToRelease - commandStructurePool );
+
+        if( Atomic_CompareAndSwap_u32( &commandInUse[ index ], 0U, 1U ) == ATOMIC_COMPARE_AND_SWAP_SUCCESS )
+        {
+            ( void ) Atomic_Decrement_u32( &poolStats.inUse );
+            prvPushFree( index );
+            structReturned = true;
 
-        /* The send should not fail as the queue was created to hold every command
-         * in the pool. */
-        configASSERT( structReturned );
-        LogDebug( ( "Returned Command Context %d to pool",
-                    ( int ) ( pCommandToRelease - commandStructurePool ) ) );
+            LogDebug( ( "Returned Command Context %d to pool", ( int ) index ) );
+
+            if( waitingTaskCount > 0U )
+            {
+                prvWakeWaitingTask();
+            }
+        }
+        else
+        {
+            LogError( ( "Command Context %d released while not in use.", ( int ) index ) );
+        }
+    }
+
+    if( !structReturned )
+    {
+        ( void ) Atomic_Increment_u32( &poolStats.invalidReleaseCount );
     }
 
     return structReturned;
 }
+
+/*-----------------------------------------------------------*/
+
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pStats )
+{
+    if( pStats != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            *pStats = poolStats;
+        }
+        taskEXIT_CRITICAL();
+    }
+}
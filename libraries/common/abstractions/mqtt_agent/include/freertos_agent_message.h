@@ -26,7 +26,7 @@
 
 /**
  * @file freertos_agent_message.h
- * @brief Functions to interact with queues.
+ * @brief Functions to deliver commands to the MQTT agent task.
  */
 #ifndef FREERTOS_AGENT_MESSAGE_H
 #define FREERTOS_AGENT_MESSAGE_H
@@ -37,28 +37,81 @@
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
-#include "queue.h"
+#include "task.h"
 
 /* Include MQTT agent messaging interface. */
 #include "core_mqtt_agent_message_interface.h"
 
+/**
+ * @brief The number of commands the agent's ring holds. It must be a power of
+ * two.
+ */
+#ifndef MQTT_AGENT_MESSAGE_RING_LENGTH
+    #define MQTT_AGENT_MESSAGE_RING_LENGTH    ( 32U )
+#endif
+
+/**
+ * @brief The task notification index the agent task is woken on when
+ * commands are sent. It must be below configTASK_NOTIFICATION_ARRAY_ENTRIES
+ * and not be used otherwise by the agent task.
+ */
+#ifndef MQTT_AGENT_MESSAGE_NOTIFY_IDX
+    #define MQTT_AGENT_MESSAGE_NOTIFY_IDX    ( 1U )
+#endif
+
+#if ( ( MQTT_AGENT_MESSAGE_RING_LENGTH == 0U ) || ( ( MQTT_AGENT_MESSAGE_RING_LENGTH & ( MQTT_AGENT_MESSAGE_RING_LENGTH - 1U ) ) != 0U ) )
+    #error "MQTT_AGENT_MESSAGE_RING_LENGTH must be a power of two."
+#endif
+
+/**
+ * @brief A position of the ring. The sequence tells whether the position is
+ * free for the pass of the ring a sender is on, or holds a command for the
+ * agent to take.
+ */
+typedef struct AgentMessageSlot
+{
+    MQTTAgentCommand_t * volatile pCommand;
+    volatile uint32_t sequence;
+} AgentMessageSlot_t;
+
 /**
  * @ingroup mqtt_agent_struct_types
  * @brief Context with which tasks may deliver messages to the agent.
+ *
+ * The commands are held in a ring that any task may send to and that only the
+ * agent task receives from. Positions are claimed with compare-and-swap, so a
+ * send or a receive takes no queue operation, and the agent task is notified
+ * only when it is waiting for a command.
  */
 struct MQTTAgentMessageContext
 {
-    QueueHandle_t queue;
+    AgentMessageSlot_t slots[ MQTT_AGENT_MESSAGE_RING_LENGTH ];
+    volatile uint32_t head;           /**< The next position a sender claims. */
+    uint32_t tail;                    /**< The next position the agent takes. */
+    volatile uint32_t agentWaiting;   /**< 1 while the agent task waits for a command. */
+    TaskHandle_t agentTask;           /**< The task receiving from the ring. */
 };
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Prepare a context to deliver messages. It must be called before the
+ * context is passed to the agent.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ */
+void Agent_MessageInit( MQTTAgentMessageContext_t * pMsgCtx );
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Send a message to the specified context.
  * Must be thread safe.
  *
+ * If the ring is full, it is tried again every tick for at most blockTimeMs.
+ *
  * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
- * @param[in] pCommandToSend Pointer to address to send to queue.
+ * @param[in] pCommandToSend Pointer to address to send to the ring.
  * @param[in] blockTimeMs Block time to wait for a send.
  *
  * @return `true` if send was successful, else `false`.
@@ -69,7 +122,10 @@ bool Agent_MessageSend( MQTTAgentMessageContext_t * pMsgCtx,
 
 /**
  * @brief Receive a message from the specified context.
- * Must be thread safe.
+ * Must only be called by the agent task.
+ *
+ * This is Agent_MessageReceiveBatch() for a single message, so a message
+ * already in the ring is taken without blocking or a kernel call.
  *
  * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
  * @param[in] pReceivedCommand Pointer to write address of received command.
@@ -81,4 +137,45 @@ bool Agent_MessageReceive( MQTTAgentMessageContext_t * pMsgCtx,
                            MQTTAgentCommand_t ** pReceivedCommand,
                            uint32_t blockTimeMs );
 
+/**
+ * @brief Send several messages to the specified context, in order.
+ * Must be thread safe.
+ *
+ * The messages that fit in the ring are all placed before the agent task is
+ * notified, so that it is woken once for the whole batch instead of once per
+ * message. The others are sent as space is made, polling every tick for at
+ * most blockTimeMs in total.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[in] pCommandsToSend Array of the addresses to send to the ring.
+ * @param[in] commandCount Number of addresses in the array.
+ * @param[in] blockTimeMs Block time to wait for space.
+ *
+ * @return The number of messages sent, from the start of the array.
+ */
+size_t Agent_MessageSendBatch( MQTTAgentMessageContext_t * pMsgCtx,
+                               MQTTAgentCommand_t * const * pCommandsToSend,
+                               size_t commandCount,
+                               uint32_t blockTimeMs );
+
+/**
+ * @brief Receive the messages waiting in the specified context.
+ * Must only be called by the agent task.
+ *
+ * Only the first message is waited for; the others are those already in the
+ * ring.
+ *
+ * @param[in] pMsgCtx An #MQTTAgentMessageContext_t.
+ * @param[out] pReceivedCommands Array to write the addresses of the received
+ * commands to.
+ * @param[in] maxCommands Number of addresses the array can hold.
+ * @param[in] blockTimeMs Block time to wait for the first message.
+ *
+ * @return The number of messages received.
+ */
+size_t Agent_MessageReceiveBatch( MQTTAgentMessageContext_t * pMsgCtx,
+                                  MQTTAgentCommand_t ** pReceivedCommands,
+                                  size_t maxCommands,
+                                  uint32_t blockTimeMs );
+
 #endif /* FREERTOS_AGENT_MESSAGE_H */
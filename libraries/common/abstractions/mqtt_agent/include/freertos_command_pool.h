@@ -41,6 +41,35 @@
     #define MQTT_COMMAND_CONTEXTS_POOL_SIZE    ( 10U )
 #endif
 
+/**
+ * @brief The number of tasks that may wait at once in Agent_GetCommand() for a
+ * structure to be released. Further tasks poll the pool every tick.
+ */
+#ifndef MQTT_COMMAND_POOL_MAX_WAITERS
+    #define MQTT_COMMAND_POOL_MAX_WAITERS    ( 4U )
+#endif
+
+/**
+ * @brief The task notification index a task waiting in Agent_GetCommand() is
+ * notified on. It must be below configTASK_NOTIFICATION_ARRAY_ENTRIES and not
+ * be used otherwise by the tasks sending commands.
+ */
+#ifndef MQTT_COMMAND_POOL_NOTIFY_IDX
+    #define MQTT_COMMAND_POOL_NOTIFY_IDX    ( 1U )
+#endif
+
+/**
+ * @brief Counters of the command structure pool.
+ */
+typedef struct AgentCommandPoolStats
+{
+    uint32_t inUse;               /**< Structures currently obtained. */
+    uint32_t highWaterMark;       /**< Most structures obtained at once. */
+    uint32_t exhaustedCount;      /**< Calls to Agent_GetCommand() that found the pool empty. */
+    uint32_t failedCount;         /**< Calls to Agent_GetCommand() that returned NULL. */
+    uint32_t invalidReleaseCount; /**< Calls to Agent_ReleaseCommand() with a structure not obtained from the pool. */
+} AgentCommandPoolStats_t;
+
 /**
  * @brief Initialize the common task pool. Not thread safe.
  */
@@ -87,4 +116,12 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs );
  */
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease );
 
+/**
+ * @brief Copy the counters of the pool, to size MQTT_COMMAND_CONTEXTS_POOL_SIZE
+ * or see how often the pool runs out.
+ *
+ * @param[out] pStats Receives the counters.
+ */
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pStats );
+
 #endif /* FREERTOS_COMMAND_POOL_H */
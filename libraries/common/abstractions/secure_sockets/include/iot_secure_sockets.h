@@ -172,6 +172,9 @@ typedef struct xSOCKET * Socket_t; /**< @brief Socket handle data type. */
 #define SOCKETS_SO_TCPKEEPALIVE_INTERVAL         ( 19 ) /**< Set the time in seconds between individual TCP keep-alive probes. */
 #define SOCKETS_SO_TCPKEEPALIVE_COUNT            ( 20 ) /**< Set the maximum number of keep-alive probes TCP should send before dropping the connection. */
 #define SOCKETS_SO_TCPKEEPALIVE_IDLE_TIME        ( 21 ) /**< Set the time in seconds for which the connection needs to remain idle before TCP starts sending keep-alive probes. */
+#define SOCKETS_SO_TLS_IN_CONTENT_LENGTH         ( 22 ) /**< Largest incoming TLS record plaintext to provision the receive buffer for. */
+#define SOCKETS_SO_TLS_OUT_CONTENT_LENGTH        ( 23 ) /**< Largest outgoing TLS record plaintext to provision the send buffer for. */
+#define SOCKETS_SO_TLS_IDLE                      ( 24 ) /**< Release the TLS record buffers until the socket is used again. */
 
 /**@} */
 
@@ -206,6 +209,16 @@ typedef struct SocketsSockaddr
     uint32_t ulAddress;     /**< IP Address. Convention is to call this sin_addr. */
 } SocketsSockaddr_t;
 
+/**
+ * @ingroup SecureSockets_datatypes_paramstructs
+ * @brief One buffer of a vectored send.
+ */
+typedef struct SocketsIoVector
+{
+    const void * pvBase; /**< Start of the buffer. */
+    size_t xLength;      /**< Length of the buffer in bytes. */
+} SocketsIoVector_t;
+
 /**
  * @brief Well-known port numbers.
  */
@@ -386,6 +399,52 @@ int32_t SOCKETS_Send( Socket_t xSocket,
                       uint32_t ulFlags );
 /* @[declare_secure_sockets_send] */
 
+/**
+ * @brief Transmit the concatenation of several buffers to the remote socket.
+ *
+ * Behaves like a single SOCKETS_Send() of the concatenated buffers, without
+ * requiring the caller to copy them into one. On a TLS socket the buffers are
+ * packed into as few records as possible; otherwise they are passed to the
+ * network stack as one gather write.
+ *
+ * @param[in] xSocket The handle of the sending socket.
+ * @param[in] pxVectors The buffers to send, in order.
+ * @param[in] xVectorCount Number of entries in pxVectors; at most
+ * socketsconfigMAX_SEND_VECTORS.
+ * @param[in] ulFlags Applied to the socket writes like the ulFlags of
+ * SOCKETS_Send().
+ *
+ * @return
+ * * On success, the number of bytes actually sent is returned.
+ * * If an error occurred, a negative value is returned. @ref SocketsErrors
+ */
+/* @[declare_secure_sockets_sendv] */
+int32_t SOCKETS_SendV( Socket_t xSocket,
+                       const SocketsIoVector_t * pxVectors,
+                       size_t xVectorCount,
+                       uint32_t ulFlags );
+/* @[declare_secure_sockets_sendv] */
+
+/**
+ * @brief Check, without blocking or consuming anything, whether a connected
+ * socket is still usable.
+ *
+ * Meant for connections kept open between requests: anything that arrives on
+ * an idle connection, including a TLS close_notify alert, means the peer is
+ * about to close it or the protocol state is off.
+ *
+ * @param[in] xSocket The handle of the socket.
+ *
+ * @return
+ * * 0 if the connection is open and nothing has arrived.
+ * * A positive value if received data is waiting.
+ * * @ref SOCKETS_ECLOSED if the peer closed the connection, or another
+ *   negative value on error. @ref SocketsErrors
+ */
+/* @[declare_secure_sockets_poll] */
+int32_t SOCKETS_Poll( Socket_t xSocket );
+/* @[declare_secure_sockets_poll] */
+
 /**
  * @brief Closes all or part of a full-duplex connection on the socket.
  *
@@ -529,6 +588,23 @@ int32_t SOCKETS_Close( Socket_t xSocket );
  *      - Set the time in seconds for which the connection needs to remain idle
  *        before TCP starts sending keep-alive probes.
  *      - pvOptionValue is the time in seconds.
+ *    - @ref SOCKETS_SO_TLS_IN_CONTENT_LENGTH
+ *      - Request a smaller maximum fragment length from the server so that
+ *        a smaller TLS receive buffer can be kept for this connection.
+ *      - Must be set before SOCKETS_Connect() is called.
+ *      - pvOptionValue is a pointer to a uint32_t size in bytes. Zero keeps
+ *        the default.
+ *    - @ref SOCKETS_SO_TLS_OUT_CONTENT_LENGTH
+ *      - Limit the size of outgoing TLS records so that a smaller TLS send
+ *        buffer can be kept for this connection.
+ *      - Must be set before SOCKETS_Connect() is called.
+ *      - pvOptionValue is a pointer to a uint32_t size in bytes. Zero keeps
+ *        the default.
+ *    - @ref SOCKETS_SO_TLS_IDLE
+ *      - Release the TLS record buffers of a connected socket between bursts
+ *        of traffic. They are re-allocated by the next send or receive.
+ *      - Fails with SOCKETS_EWOULDBLOCK if data is still buffered.
+ *      - pvOptionValue is ignored for this option.
  *
  * @return
  * * On success, 0 is returned.
@@ -61,6 +61,25 @@
     #define socketsconfigDEFAULT_RECV_TIMEOUT    ( 10000 )
 #endif
 
+/**
+ * @brief Largest number of buffers accepted by a single SOCKETS_SendV() call.
+ *
+ * The vectors are translated on the stack of the caller.
+ */
+#ifndef socketsconfigMAX_SEND_VECTORS
+    #define socketsconfigMAX_SEND_VECTORS    ( 8 )
+#endif
+
+/**
+ * @brief Cache the results of SOCKETS_GetHostByName().
+ *
+ * Set to 0 to resolve the host name on every call. See iot_dns_cache.h for the
+ * cache configuration.
+ */
+#ifndef socketsconfigENABLE_DNS_CACHE
+    #define socketsconfigENABLE_DNS_CACHE    ( 1 )
+#endif
+
 /**
  * @brief By default, metrics of secure socket is disabled.
  *
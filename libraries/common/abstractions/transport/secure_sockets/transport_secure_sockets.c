@@ -34,6 +34,9 @@
 /* TCP/IP abstraction includes. */
 #include "transport_secure_sockets.h"
 
+/* Connection latency tracing. */
+#include "iot_connect_trace.h"
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -107,6 +110,46 @@ static int32_t tlsSetup( const SocketsConfig_t * pSocketsConfig,
 static TransportSocketStatus_t connectToServer( Socket_t tcpSocket,
                                                 const ServerInfo_t * pServerInfo );
 
+/**
+ * @brief Records traffic on a connection, which keeps it out of idle.
+ *
+ * @param[in] pSecureSocketsTransportParams The connection.
+ */
+static void recordTraffic( SecureSocketsTransportParams_t * pSecureSocketsTransportParams );
+
+/**
+ * @brief Releases the TLS record buffers of a connection that had no traffic
+ * for #SECURE_SOCKETS_TRANSPORT_IDLE_TIMEOUT_MS.
+ *
+ * @param[in] pNetworkContext The network context of the connection.
+ */
+static void releaseIfIdle( NetworkContext_t * pNetworkContext );
+
+/*-----------------------------------------------------------*/
+
+static void recordTraffic( SecureSocketsTransportParams_t * pSecureSocketsTransportParams )
+{
+    pSecureSocketsTransportParams->lastTrafficTicks = xTaskGetTickCount();
+    pSecureSocketsTransportParams->tlsIdle = false;
+}
+
+/*-----------------------------------------------------------*/
+
+static void releaseIfIdle( NetworkContext_t * pNetworkContext )
+{
+    SecureSocketsTransportParams_t * pSecureSocketsTransportParams = pNetworkContext->pParams;
+
+    if( ( SECURE_SOCKETS_TRANSPORT_IDLE_TIMEOUT_MS != 0U ) &&
+        ( pSecureSocketsTransportParams->tlsEnabled == true ) &&
+        ( pSecureSocketsTransportParams->tlsIdle == false ) &&
+        ( ( xTaskGetTickCount() - pSecureSocketsTransportParams->lastTrafficTicks ) >=
+          pdMS_TO_TICKS( SECURE_SOCKETS_TRANSPORT_IDLE_TIMEOUT_MS ) ) )
+    {
+        /* Data still buffered keeps the buffers until the next timeout. */
+        ( void ) SecureSocketsTransport_Idle( pNetworkContext );
+    }
+}
+
 /*-----------------------------------------------------------*/
 
 /* MISRA Rule 8.13 flags the following line for not using the const qualifier
@@ -144,6 +187,8 @@ int32_t SecureSocketsTransport_Send( NetworkContext_t * pNetworkContext,
         /* If an error occurred, a negative value is returned. @ref SocketsErrors. */
         if( bytesSent >= 0 )
         {
+            recordTraffic( pSecureSocketsTransportParams );
+
             if( bytesSent < ( int32_t ) bytesToSend )
             {
                 LogWarn( ( "bytesSent %d < bytesToSend %lu.", bytesSent, bytesToSend ) );
@@ -164,6 +209,126 @@ int32_t SecureSocketsTransport_Send( NetworkContext_t * pNetworkContext,
 
 /*-----------------------------------------------------------*/
 
+int32_t SecureSocketsTransport_Writev( NetworkContext_t * pNetworkContext,
+                                       TransportOutVector_t * pIoVec,
+                                       size_t ioVecCount )
+{
+    int32_t bytesSent = 0;
+    int32_t batchSent = 0;
+    size_t batchLength = 0;
+    size_t batchCount = 0;
+    size_t vectorIndex = 0;
+    SocketsIoVector_t batch[ socketsconfigMAX_SEND_VECTORS ];
+
+    if( ( pIoVec == NULL ) ||
+        ( ioVecCount == 0UL ) ||
+        ( pNetworkContext == NULL ) ||
+        ( pNetworkContext->pParams == NULL ) )
+    {
+        LogError( ( "Invalid parameter: pIoVec=%p, ioVecCount=%lu, pNetworkContext=%p",
+                    ( void * ) pIoVec, ioVecCount, ( void * ) pNetworkContext ) );
+        bytesSent = SOCKETS_EINVAL;
+    }
+    else if( pNetworkContext->pParams->tcpSocket == SOCKETS_INVALID_SOCKET )
+    {
+        LogError( ( "Invalid parameter: pNetworkContext->pParams->tcpSocket cannot be SOCKETS_INVALID_SOCKET." ) );
+        bytesSent = SOCKETS_EINVAL;
+    }
+    else
+    {
+        /* Vectors beyond what one SOCKETS_SendV() call accepts go out in
+         * further calls, which stop at the first partial write. */
+        while( vectorIndex < ioVecCount )
+        {
+            batchCount = 0;
+            batchLength = 0;
+
+            while( ( vectorIndex < ioVecCount ) && ( batchCount < ( size_t ) socketsconfigMAX_SEND_VECTORS ) )
+            {
+                batch[ batchCount ].pvBase = pIoVec[ vectorIndex ].iov_base;
+                batch[ batchCount ].xLength = pIoVec[ vectorIndex ].iov_len;
+                batchLength += pIoVec[ vectorIndex ].iov_len;
+                batchCount++;
+                vectorIndex++;
+            }
+
+            batchSent = SOCKETS_SendV( pNetworkContext->pParams->tcpSocket,
+                                       batch,
+                                       batchCount,
+                                       0 );
+
+            if( batchSent < 0 )
+            {
+                LogError( ( "Failed to send data over network. bytesSent=%d.", batchSent ) );
+
+                /* Report the error only if nothing was sent. */
+                if( bytesSent == 0 )
+                {
+                    bytesSent = batchSent;
+                }
+
+                break;
+            }
+
+            bytesSent += batchSent;
+
+            if( ( size_t ) batchSent < batchLength )
+            {
+                LogWarn( ( "bytesSent %d < bytesToSend %lu.", batchSent, batchLength ) );
+                break;
+            }
+        }
+
+        if( bytesSent > 0 )
+        {
+            recordTraffic( pNetworkContext->pParams );
+            LogInfo( ( "Successfully sent %d bytes over network.", bytesSent ) );
+        }
+    }
+
+    return bytesSent;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t SecureSocketsTransport_Idle( NetworkContext_t * pNetworkContext )
+{
+    int32_t idleStatus = ( int32_t ) SOCKETS_ERROR_NONE;
+
+    if( ( pNetworkContext == NULL ) ||
+        ( pNetworkContext->pParams == NULL ) ||
+        ( pNetworkContext->pParams->tcpSocket == SOCKETS_INVALID_SOCKET ) )
+    {
+        LogError( ( "Invalid parameter: pNetworkContext=%p", ( void * ) pNetworkContext ) );
+        idleStatus = SOCKETS_EINVAL;
+    }
+    else
+    {
+        idleStatus = SOCKETS_SetSockOpt( pNetworkContext->pParams->tcpSocket,
+                                         0,
+                                         SOCKETS_SO_TLS_IDLE,
+                                         NULL,
+                                         0 );
+
+        if( idleStatus == SOCKETS_EWOULDBLOCK )
+        {
+            LogDebug( ( "TLS buffers kept: data is still buffered." ) );
+        }
+        else if( idleStatus != ( int32_t ) SOCKETS_ERROR_NONE )
+        {
+            LogError( ( "Failed to release TLS buffers. idleStatus=%d.", idleStatus ) );
+        }
+        else
+        {
+            pNetworkContext->pParams->tlsIdle = true;
+        }
+    }
+
+    return idleStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 /* MISRA Rule 8.13 flags the following line for not using the const qualifier
  * on `pNetworkContext`. Indeed, the object pointed by it is not modified
  * by Secure Sockets, but other implementations of `TransportRecv_t` may do so. */
@@ -197,11 +362,12 @@ int32_t SecureSocketsTransport_Recv( NetworkContext_t * pNetworkContext,
                                       bytesToRecv,
                                       0 );
 
-        if( bytesReceived == SOCKETS_EWOULDBLOCK )
+        if( ( bytesReceived == SOCKETS_EWOULDBLOCK ) || ( bytesReceived == 0 ) )
         {
             /* The return value EWOULDBLOCK means no data was received within
              * the receive timeout. */
             bytesReceived = 0;
+            releaseIfIdle( pNetworkContext );
         }
         else if( bytesReceived < 0 )
         {
@@ -209,6 +375,8 @@ int32_t SecureSocketsTransport_Recv( NetworkContext_t * pNetworkContext,
         }
         else if( bytesReceived >= 0 )
         {
+            recordTraffic( pSecureSocketsTransportParams );
+
             if( bytesReceived < ( int32_t ) bytesToRecv )
             {
                 LogInfo( ( "Receive requested %d bytes, but %lu bytes received instead.",
@@ -303,6 +471,39 @@ static int32_t tlsSetup( const SocketsConfig_t * pSocketsConfig,
         }
     }
 
+    /* Set record buffer sizes. */
+    if( ( secureSocketStatus == SOCKETS_ERROR_NONE ) && ( pSocketsConfig->inContentLength != 0U ) )
+    {
+        uint32_t inContentLength = ( uint32_t ) pSocketsConfig->inContentLength;
+
+        secureSocketStatus = SOCKETS_SetSockOpt( tcpSocket,
+                                                 0,
+                                                 SOCKETS_SO_TLS_IN_CONTENT_LENGTH,
+                                                 &inContentLength,
+                                                 sizeof( inContentLength ) );
+
+        if( secureSocketStatus != ( int32_t ) SOCKETS_ERROR_NONE )
+        {
+            LogError( ( "Failed to set TLS receive buffer size for socket. secureSocketStatus=%d", secureSocketStatus ) );
+        }
+    }
+
+    if( ( secureSocketStatus == SOCKETS_ERROR_NONE ) && ( pSocketsConfig->outContentLength != 0U ) )
+    {
+        uint32_t outContentLength = ( uint32_t ) pSocketsConfig->outContentLength;
+
+        secureSocketStatus = SOCKETS_SetSockOpt( tcpSocket,
+                                                 0,
+                                                 SOCKETS_SO_TLS_OUT_CONTENT_LENGTH,
+                                                 &outContentLength,
+                                                 sizeof( outContentLength ) );
+
+        if( secureSocketStatus != ( int32_t ) SOCKETS_ERROR_NONE )
+        {
+            LogError( ( "Failed to set TLS send buffer size for socket. secureSocketStatus=%d", secureSocketStatus ) );
+        }
+    }
+
     return secureSocketStatus;
 }
 
@@ -318,7 +519,10 @@ static TransportSocketStatus_t connectToServer( Socket_t tcpSocket,
     /* Establish connection. */
     serverAddress.ucSocketDomain = SOCKETS_AF_INET;
     serverAddress.usPort = SOCKETS_htons( pServerInfo->port );
+
+    ConnectTrace_PhaseStart( eConnectTracePhaseDns );
     serverAddress.ulAddress = SOCKETS_GetHostByName( pServerInfo->pHostName );
+    ConnectTrace_PhaseEnd( eConnectTracePhaseDns );
 
     /* Check for errors from DNS lookup. */
     if( serverAddress.ulAddress == ( uint32_t ) 0 )
@@ -478,6 +682,8 @@ static TransportSocketStatus_t establishConnect( NetworkContext_t * pNetworkCont
     {
         /* Set the socket in the network context. */
         pSecureSocketsTransportParams->tcpSocket = tcpSocket;
+        pSecureSocketsTransportParams->tlsEnabled = pSocketsConfig->enableTls;
+        recordTraffic( pSecureSocketsTransportParams );
     }
     else
     {
@@ -498,6 +704,7 @@ TransportSocketStatus_t SecureSocketsTransport_Connect( NetworkContext_t * pNetw
                                                         const SocketsConfig_t * pSocketsConfig )
 {
     TransportSocketStatus_t returnStatus = TRANSPORT_SOCKET_STATUS_SUCCESS;
+    BaseType_t traceOwner = pdFALSE;
 
     /* Sanity checks for input parameters. */
     if( pSocketsConfig == NULL )
@@ -532,10 +739,12 @@ TransportSocketStatus_t SecureSocketsTransport_Connect( NetworkContext_t * pNetw
     }
     else
     {
-        /* Establish the TCP connection. */
+        /* Establish the TCP connection, recording the latency of each phase. */
+        traceOwner = ConnectTrace_Begin();
         returnStatus = establishConnect( pNetworkContext,
                                          pServerInfo,
                                          pSocketsConfig );
+        ConnectTrace_End( traceOwner, ( int32_t ) returnStatus );
     }
 
     return returnStatus;
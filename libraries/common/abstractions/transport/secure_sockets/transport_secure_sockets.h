@@ -64,6 +64,19 @@
 /* Logging implementation header include. */
 #include "logging_stack.h"
 
+/**
+ * @brief Time without traffic after which a TLS connection releases its
+ * record buffers.
+ *
+ * SecureSocketsTransport_Recv() releases them when a receive times out and
+ * nothing was sent or received for this long. The next send or receive
+ * allocates them again. Set to 0 to release them only through
+ * SecureSocketsTransport_Idle().
+ */
+#ifndef SECURE_SOCKETS_TRANSPORT_IDLE_TIMEOUT_MS
+    #define SECURE_SOCKETS_TRANSPORT_IDLE_TIMEOUT_MS    ( 5000U )
+#endif
+
 /**
  * @brief Definition of the network context for the transport interface
  * implementation that uses Secure Sockets API.
@@ -71,6 +84,9 @@
 typedef struct SecureSocketsTransportParams
 {
     Socket_t tcpSocket;
+    bool tlsEnabled;             /**< @brief Whether the connection uses TLS. */
+    bool tlsIdle;                /**< @brief Whether the TLS record buffers are released. */
+    TickType_t lastTrafficTicks; /**< @brief Tick count of the last data sent or received. */
 } SecureSocketsTransportParams_t;
 
 /**
@@ -134,6 +150,16 @@ typedef struct SocketsConfig
      */
     size_t maxFragmentLength;
 
+    /**
+     * @brief Set these to non-zero values to provision smaller TLS receive
+     * and send buffers for this connection.
+     *
+     * The incoming size is requested from the server with TLS MFL and only
+     * takes effect if the server accepts it. The outgoing size always does.
+     */
+    size_t inContentLength;
+    size_t outContentLength; /**< @brief See #SocketsConfig_t.inContentLength. */
+
     const char * pRootCa; /**< @brief String representing a trusted server Root CA certificate. */
     size_t rootCaSize;    /**< @brief Size associated with #IotNetworkCredentials_t.pRootCa. */
 } SocketsConfig_t;
@@ -171,7 +197,9 @@ TransportSocketStatus_t SecureSocketsTransport_Disconnect( const NetworkContext_
  * @brief Receives data over an established TLS session using the Secure Sockets API.
  *
  * This can be used as #TransportInterface.recv function for receiving data
- * from the network.
+ * from the network. A receive that times out on a TLS connection without
+ * traffic for #SECURE_SOCKETS_TRANSPORT_IDLE_TIMEOUT_MS also releases its
+ * record buffers, as SecureSocketsTransport_Idle() does.
  *
  * @param[in] pNetworkContext The network context created using Socket_Connect API.
  * @param[out] pBuffer Buffer to receive network data into.
@@ -201,4 +229,36 @@ int32_t SecureSocketsTransport_Send( NetworkContext_t * pNetworkContext,
                                      const void * pMessage,
                                      size_t bytesToSend );
 
+/**
+ * @brief Sends the concatenation of several buffers over an established TLS
+ * session using the Secure Sockets API.
+ *
+ * This can be used as the #TransportInterface.writev function, so that
+ * packets built from several buffers are encrypted into as few TLS records as
+ * possible without being copied into one buffer first.
+ *
+ * @param[in] pNetworkContext The network context created using Secure Sockets API.
+ * @param[in] pIoVec Buffers to send, in order.
+ * @param[in] ioVecCount Number of entries in pIoVec.
+ *
+ * @return Number of bytes sent if successful; negative value on error.
+ */
+int32_t SecureSocketsTransport_Writev( NetworkContext_t * pNetworkContext,
+                                       TransportOutVector_t * pIoVec,
+                                       size_t ioVecCount );
+
+/**
+ * @brief Releases the TLS record buffers of an idle connection.
+ *
+ * The buffers are re-allocated by the next send or receive. Call this from
+ * the task that sends and receives on the connection, for instance when a
+ * request completed and the connection is kept for the next one.
+ *
+ * @param[in] pNetworkContext The network context created using Secure Sockets API.
+ *
+ * @return #SOCKETS_ERROR_NONE if the buffers were released;
+ *         #SOCKETS_EWOULDBLOCK if data is still buffered; other negative value on error.
+ */
+int32_t SecureSocketsTransport_Idle( NetworkContext_t * pNetworkContext );
+
 #endif /* TRANSPORT_SECURE_SOCKETS_H */
@@ -84,6 +84,11 @@ typedef BaseType_t ( * NetworkSend_t )( void * pvCallerContext,
  * @param[in] pxNetworkSend Caller-defined network send function pointer.
  * @param[in] pvCallerContext Caller-defined context handle to be used with callback
  * functions.
+ * @param[in] ulInContentLength Largest incoming record plaintext to provision
+ * the receive buffer for. It is requested from the server through the max
+ * fragment length extension. Zero keeps the mbedTLS default.
+ * @param[in] ulOutContentLength Largest outgoing record plaintext to provision
+ * the send buffer for. Zero keeps the mbedTLS default.
  */
 typedef struct xTLS_PARAMS
 {
@@ -97,8 +102,82 @@ typedef struct xTLS_PARAMS
     NetworkRecv_t pxNetworkRecv;
     NetworkSend_t pxNetworkSend;
     void * pvCallerContext;
+    uint32_t ulInContentLength;
+    uint32_t ulOutContentLength;
 } TLSParams_t;
 
+/**
+ * @brief One buffer of a vectored send.
+ *
+ * @param[in] pvBase Start of the buffer.
+ * @param[in] xLength Length of the buffer in bytes.
+ */
+typedef struct TLSIoVector
+{
+    const void * pvBase;
+    size_t xLength;
+} TLSIoVector_t;
+
+/**
+ * @brief Counters describing how application writes were mapped to TLS records.
+ *
+ * A message is one TLS_Send() or TLS_SendV() call. Bytes per record is
+ * ulBytesSent / ulRecordsSent; records per message is
+ * ulRecordsSent / ulMessagesSent.
+ *
+ * @param[out] ulBytesSent Plaintext bytes handed to mbedTLS.
+ * @param[out] ulRecordsSent TLS application data records written.
+ * @param[out] ulMessagesSent Messages written, as defined above.
+ */
+typedef struct xTLS_WRITE_METRICS
+{
+    uint32_t ulBytesSent;
+    uint32_t ulRecordsSent;
+    uint32_t ulMessagesSent;
+} TLSWriteMetrics_t;
+
+/**
+ * @brief RAM held by a TLS context for the lifetime of the connection.
+ *
+ * Transient handshake allocations and the peer's certificate chain are not
+ * included.
+ *
+ * @param[out] xContextBytes Size of the TLS context structure itself.
+ * @param[out] xInBufferBytes Current size of the mbedTLS receive record buffer.
+ * @param[out] xOutBufferBytes Current size of the mbedTLS send record buffer.
+ * @param[out] xIdle Non-zero while the record buffers are released by TLS_Idle().
+ */
+typedef struct xTLS_MEMORY_USAGE
+{
+    size_t xContextBytes;
+    size_t xInBufferBytes;
+    size_t xOutBufferBytes;
+    BaseType_t xIdle;
+} TLSMemoryUsage_t;
+
+/**
+ * @brief Counters describing how client credentials were loaded by TLS_Connect().
+ *
+ * A hit reuses the cached PKCS #11 session, private key handle and parsed
+ * client certificate; a miss looks them up and reads the certificate out of
+ * storage. The average connect-time saving of the cache is
+ * xMissTicks / ulMisses - xHitTicks / ulHits.
+ *
+ * @param[out] ulHits Connections that used the cached credentials.
+ * @param[out] ulMisses Connections that loaded the credentials from PKCS #11.
+ * @param[out] ulInvalidations Times the cache was invalidated.
+ * @param[out] xHitTicks Total ticks spent setting up credentials on hits.
+ * @param[out] xMissTicks Total ticks spent setting up credentials on misses.
+ */
+typedef struct xTLS_CREDENTIAL_CACHE_METRICS
+{
+    uint32_t ulHits;
+    uint32_t ulMisses;
+    uint32_t ulInvalidations;
+    TickType_t xHitTicks;
+    TickType_t xMissTicks;
+} TLSCredentialCacheMetrics_t;
+
 /**
  * @brief Initializes the TLS context.
  *
@@ -146,6 +225,91 @@ BaseType_t TLS_Send( void * pvContext,
                      const unsigned char * pucMsg,
                      size_t xMsgLength );
 
+/**
+ * @brief Writes the concatenation of several buffers to the secure connection.
+ *
+ * The buffers are gathered straight into the mbedTLS record buffer, so they
+ * are packed into as few records as possible without first being copied into
+ * one contiguous message.
+ *
+ * When fewer bytes than the total are sent, part of the next record may
+ * already be sealed. The next write on the context must then be TLS_SendV()
+ * again, with the data that was not reported as sent. TLS_Send() sends
+ * nothing and returns 0 until that retry.
+ *
+ * @param pvContext Opaque context handle for TLS library.
+ * @param pxVectors Buffers to send, in order.
+ * @param xVectorCount Number of entries in pxVectors.
+ *
+ * @return Number of bytes sent, which is less than the total length if the
+ * network would block. Error return codes have the high bit set.
+ */
+BaseType_t TLS_SendV( void * pvContext,
+                      const TLSIoVector_t * pxVectors,
+                      size_t xVectorCount );
+
+/**
+ * @brief Releases the record buffers of an idle connection.
+ *
+ * The mbedTLS record buffers are shrunk to the few bytes of record state that
+ * must survive, and re-grown on demand by the next TLS_Send(), TLS_SendV() or
+ * TLS_Recv() that receives data. A TLS_Recv() that times out leaves them
+ * released, so an idle connection can still be polled. The call has no effect if
+ * decrypted data or a partial record is still buffered in either direction, or
+ * if mbedTLS was built without MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH.
+ *
+ * If there is not enough memory to re-grow the buffers, TLS_Send(),
+ * TLS_SendV() and TLS_Recv() return MBEDTLS_ERR_SSL_ALLOC_FAILED without
+ * sending or reading anything. The connection stays open and the call can be
+ * retried once memory was freed.
+ *
+ * @param pvContext Opaque context handle for TLS library.
+ *
+ * @return Zero if the buffers were released or already idle, non-zero if the
+ * connection is not idle.
+ */
+BaseType_t TLS_Idle( void * pvContext );
+
+/**
+ * @brief Reports the RAM currently held by a TLS context.
+ *
+ * @param pvContext Opaque context handle for TLS library.
+ * @param pxUsage Receives the sizes.
+ */
+void TLS_GetMemoryUsage( void * pvContext,
+                         TLSMemoryUsage_t * pxUsage );
+
+/**
+ * @brief Reads the write counters of a TLS context.
+ *
+ * The counters belong to the context, which is used by one task at a time, so
+ * they are kept without a lock. Totals across connections are for the caller
+ * to add up.
+ *
+ * @param pvContext Opaque context handle for TLS library. If NULL, the
+ * counters are set to zero.
+ * @param pxMetrics Receives the counters.
+ */
+void TLS_GetWriteMetrics( void * pvContext,
+                          TLSWriteMetrics_t * pxMetrics );
+
+/**
+ * @brief Drops the cached client credentials.
+ *
+ * The PKCS #11 session, private key handle and parsed client certificate are
+ * kept between connections. Call this after the device credentials were
+ * changed, so that the next TLS_Connect() reads them again. Connections that
+ * are already established keep their credentials until they are cleaned up.
+ */
+void TLS_InvalidateCredentialCache( void );
+
+/**
+ * @brief Reads the client credential cache counters.
+ *
+ * @param pxMetrics Receives the counters.
+ */
+void TLS_GetCredentialCacheMetrics( TLSCredentialCacheMetrics_t * pxMetrics );
+
 /**
  * @brief Frees resources consumed by the TLS context.
  *
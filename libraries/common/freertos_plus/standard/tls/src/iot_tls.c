@@ -31,9 +31,11 @@
 #include "core_pkcs11_config.h"
 #include "core_pkcs11.h"
 #include "task.h"
+#include "semphr.h"
 #include "aws_clientcredential_keys.h"
 #include "iot_default_root_certificates.h"
 #include "core_pki_utils.h"
+#include "iot_connect_trace.h"
 
 /* mbedTLS includes. */
 #include "mbedtls/platform.h"
@@ -44,6 +46,8 @@
 #include "mbedtls/pk.h"
 #include "mbedtls/pk_internal.h"
 #include "mbedtls/debug.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/ssl_internal.h"
 
 #ifdef MBEDTLS_DEBUG_C
     #define tlsDEBUG_VERBOSE    4
@@ -105,6 +109,16 @@ static const char * pNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Code>";
  * @param[out] pxP11FunctionList PKCS#11 function list structure.
  * @param[out] xP11Session PKCS#11 session context.
  * @param[out] xP11PrivateKey PKCS#11 private key context.
+ * @param[out] xUsesCachedSession Whether xP11Session is borrowed from the credential cache.
+ * @param[out] xWriteMetrics Record and message counters for this connection.
+ * @param[in] ulInContentLength Requested incoming record plaintext size.
+ * @param[in] ulOutContentLength Requested outgoing record plaintext size.
+ * @param[out] xInBufferLength Size of the mbedTLS receive buffer while active.
+ * @param[out] xOutBufferLength Size of the mbedTLS send buffer while active.
+ * @param[out] xOutContentLength Largest plaintext passed to one mbedtls_ssl_write call.
+ * @param[out] xBuffersIdle Whether the record buffers are released by TLS_Idle().
+ * @param[out] ucLookahead First byte received while the record buffers were released.
+ * @param[out] xHasLookahead Whether ucLookahead is yet to be handed to mbedTLS.
  */
 typedef struct TLSContext
 {
@@ -133,6 +147,23 @@ typedef struct TLSContext
     CK_SESSION_HANDLE xP11Session;
     CK_OBJECT_HANDLE xP11PrivateKey;
     CK_KEY_TYPE xKeyType;
+    BaseType_t xUsesCachedSession;
+
+    TLSWriteMetrics_t xWriteMetrics;
+
+    /* Record buffer sizing. */
+    uint32_t ulInContentLength;
+    uint32_t ulOutContentLength;
+    size_t xInBufferLength;
+    size_t xOutBufferLength;
+    size_t xOutContentLength;
+    BaseType_t xBuffersIdle;
+    uint8_t ucLookahead;
+    BaseType_t xHasLookahead;
+
+    /* Payload length of a record sealed by prvSslWriteV() that has not yet
+     * fully left out_left, and so has not been reported as sent. */
+    size_t xPendingVectorRecord;
 } TLSContext_t;
 
 #define TLS_HANDSHAKE_NOT_STARTED    ( 0 )      /* Must be 0 */
@@ -141,10 +172,55 @@ typedef struct TLSContext
 
 #define TLS_PRINT( X )    configPRINTF( X )
 
+/*
+ * Bytes an mbedTLS send buffer needs on top of the plaintext it carries:
+ * counter, header, explicit IV, MAC and padding.
+ */
+#define TLS_OUT_BUFFER_OVERHEAD    ( MBEDTLS_SSL_OUT_BUFFER_LEN - MBEDTLS_SSL_OUT_CONTENT_LEN )
+
 static BaseType_t prvDefault_DateIsInThePast( BaseType_t day,
                                               BaseType_t month,
                                               BaseType_t year );
 static DateIsInThePast_t pDateIsInThePast = prvDefault_DateIsInThePast;
+static int prvEnsureActiveBuffers( TLSContext_t * pxCtx );
+
+/**
+ * @brief Keep the PKCS #11 session, private key handle and parsed client
+ * certificate between connections. Set to 0 to load them on every connect.
+ */
+#ifndef tlsconfigCACHE_CLIENT_CREDENTIALS
+    #define tlsconfigCACHE_CLIENT_CREDENTIALS    1
+#endif
+
+/**
+ * @brief Client credentials shared by all TLS contexts.
+ *
+ * Contexts borrow xSession in TLS_Init() and return it when they are freed.
+ * After an invalidation the session and certificate stay alive until the last
+ * borrower returns them.
+ *
+ * @param[in] xMutex Guards the fields below and serializes signing on xSession.
+ * @param[in] xValid Whether new connections may use the cached credentials.
+ * @param[in] xSession Logged-in PKCS #11 session owned by the cache.
+ * @param[in] xPrivateKey Handle of the device private key.
+ * @param[in] xKeyType Type of the device private key.
+ * @param[in] xCertificate Parsed client certificate chain.
+ * @param[in] ulUsers Contexts currently holding xSession.
+ * @param[out] xMetrics Hit, miss and timing counters.
+ */
+typedef struct TLSCredentialCache
+{
+    SemaphoreHandle_t xMutex;
+    BaseType_t xValid;
+    CK_SESSION_HANDLE xSession;
+    CK_OBJECT_HANDLE xPrivateKey;
+    CK_KEY_TYPE xKeyType;
+    mbedtls_x509_crt xCertificate;
+    uint32_t ulUsers;
+    TLSCredentialCacheMetrics_t xMetrics;
+} TLSCredentialCache_t;
+
+static TLSCredentialCache_t xCredentialCache = { 0 };
 
 /*-----------------------------------------------------------*/
 
@@ -152,6 +228,125 @@ static DateIsInThePast_t pDateIsInThePast = prvDefault_DateIsInThePast;
  * Helper routines.
  */
 
+/**
+ * @brief Take the credential cache mutex, creating it on first use.
+ *
+ * @return pdTRUE if the mutex is held, pdFALSE if caching is unavailable.
+ */
+static BaseType_t prvCredentialCacheLock( void )
+{
+    BaseType_t xLocked = pdFALSE;
+
+    #if ( tlsconfigCACHE_CLIENT_CREDENTIALS == 1 )
+        SemaphoreHandle_t xMutex = NULL;
+
+        if( NULL == xCredentialCache.xMutex )
+        {
+            xMutex = xSemaphoreCreateMutex();
+
+            taskENTER_CRITICAL();
+
+            if( NULL == xCredentialCache.xMutex )
+            {
+                xCredentialCache.xMutex = xMutex;
+                xMutex = NULL;
+            }
+
+            taskEXIT_CRITICAL();
+
+            /* Another task won the race. */
+            if( NULL != xMutex )
+            {
+                vSemaphoreDelete( xMutex );
+            }
+        }
+
+        if( NULL != xCredentialCache.xMutex )
+        {
+            xLocked = xSemaphoreTake( xCredentialCache.xMutex, portMAX_DELAY );
+        }
+    #endif /* if ( tlsconfigCACHE_CLIENT_CREDENTIALS == 1 ) */
+
+    return xLocked;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCredentialCacheUnlock( void )
+{
+    ( void ) xSemaphoreGive( xCredentialCache.xMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Release the cached session and certificate. The mutex must be held
+ * and no context may be using them.
+ */
+static void prvCredentialCacheDrop( void )
+{
+    CK_FUNCTION_LIST_PTR pxP11FunctionList = NULL;
+
+    mbedtls_x509_crt_free( &xCredentialCache.xCertificate );
+
+    if( ( CK_INVALID_HANDLE != xCredentialCache.xSession ) &&
+        ( CKR_OK == C_GetFunctionList( &pxP11FunctionList ) ) &&
+        ( NULL != pxP11FunctionList->C_CloseSession ) )
+    {
+        pxP11FunctionList->C_CloseSession( xCredentialCache.xSession ); /*lint !e534 This function always return CKR_OK. */
+    }
+
+    xCredentialCache.xValid = pdFALSE;
+    xCredentialCache.xSession = CK_INVALID_HANDLE;
+    xCredentialCache.xPrivateKey = CK_INVALID_HANDLE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Let a new context use the cached PKCS #11 session, if there is one.
+ */
+static void prvBorrowCachedSession( TLSContext_t * pxCtx )
+{
+    if( pdTRUE == prvCredentialCacheLock() )
+    {
+        if( pdFALSE != xCredentialCache.xValid )
+        {
+            pxCtx->xP11Session = xCredentialCache.xSession;
+            pxCtx->xUsesCachedSession = pdTRUE;
+            xCredentialCache.ulUsers++;
+        }
+
+        prvCredentialCacheUnlock();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Give a borrowed session back to the cache.
+ */
+static void prvReleaseCachedSession( TLSContext_t * pxCtx )
+{
+    if( ( pdFALSE != pxCtx->xUsesCachedSession ) &&
+        ( pdTRUE == prvCredentialCacheLock() ) )
+    {
+        xCredentialCache.ulUsers--;
+
+        if( ( pdFALSE == xCredentialCache.xValid ) && ( 0U == xCredentialCache.ulUsers ) )
+        {
+            prvCredentialCacheDrop();
+        }
+
+        prvCredentialCacheUnlock();
+
+        pxCtx->xUsesCachedSession = pdFALSE;
+        pxCtx->xP11Session = CK_INVALID_HANDLE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief TLS internal context rundown helper routine.
  *
@@ -161,14 +356,27 @@ static void prvFreeContext( TLSContext_t * pxCtx )
 {
     if( NULL != pxCtx )
     {
-        /* Cleanup mbedTLS. */
-        mbedtls_ssl_close_notify( &pxCtx->xMbedSslCtx ); /*lint !e534 The error is already taken care of inside mbedtls_ssl_close_notify*/
+        /* Cleanup mbedTLS. The alert needs a full-size send buffer. */
+        if( 0 == prvEnsureActiveBuffers( pxCtx ) )
+        {
+            mbedtls_ssl_close_notify( &pxCtx->xMbedSslCtx ); /*lint !e534 The error is already taken care of inside mbedtls_ssl_close_notify*/
+        }
+
         mbedtls_ssl_free( &pxCtx->xMbedSslCtx );
         mbedtls_ssl_config_free( &pxCtx->xMbedSslConfig );
         mbedtls_ctr_drbg_free( &pxCtx->xMbedDrbgCtx );
 
-        /* Cleanup PKCS11 only if the handshake was started. */
-        if( ( TLS_HANDSHAKE_NOT_STARTED != pxCtx->xTLSHandshakeState ) &&
+        pxCtx->xBuffersIdle = pdFALSE;
+        pxCtx->xHasLookahead = pdFALSE;
+        pxCtx->xPendingVectorRecord = 0;
+
+        /* A cached session is shared; it is only returned to the cache.
+         * Otherwise cleanup PKCS11 only if the handshake was started. */
+        if( pdFALSE != pxCtx->xUsesCachedSession )
+        {
+            prvReleaseCachedSession( pxCtx );
+        }
+        else if( ( TLS_HANDSHAKE_NOT_STARTED != pxCtx->xTLSHandshakeState ) &&
             ( NULL != pxCtx->pxP11FunctionList ) &&
             ( NULL != pxCtx->pxP11FunctionList->C_CloseSession ) &&
             ( CK_INVALID_HANDLE != pxCtx->xP11Session ) )
@@ -190,41 +398,591 @@ static BaseType_t prvDefault_DateIsInThePast( BaseType_t day,
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Network send callback shim.
+ * @brief Network send callback shim.
+ *
+ * @param[in] pvContext Caller context.
+ * @param[in] pucData Byte buffer to send.
+ * @param[in] xDataLength Length of byte buffer to send.
+ *
+ * @return Number of bytes sent, or a negative value on error.
+ */
+static int prvNetworkSend( void * pvContext,
+                           const unsigned char * pucData,
+                           size_t xDataLength )
+{
+    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+
+    return ( int ) pxCtx->xNetworkSend( pxCtx->pvCallerContext, pucData, xDataLength );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Network receive callback shim.
+ *
+ * @param[in] pvContext Caller context.
+ * @param[out] pucReceiveBuffer Byte buffer to receive into.
+ * @param[in] xReceiveLength Length of byte buffer for receive.
+ *
+ * @return Number of bytes received, or a negative value on error.
+ */
+static int prvNetworkRecv( void * pvContext,
+                           unsigned char * pucReceiveBuffer,
+                           size_t xReceiveLength )
+{
+    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+    int lResult = 0;
+
+    if( ( pdFALSE != pxCtx->xHasLookahead ) && ( 0U != xReceiveLength ) )
+    {
+        /* The byte that woke up an idle connection comes first. */
+        pucReceiveBuffer[ 0 ] = pxCtx->ucLookahead;
+        pxCtx->xHasLookahead = pdFALSE;
+        lResult = 1;
+    }
+    else
+    {
+        lResult = ( int ) pxCtx->xNetworkRecv( pxCtx->pvCallerContext, pucReceiveBuffer, xReceiveLength );
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends what is left of a record sealed by prvSslWriteV() that the
+ * network did not take in full.
+ *
+ * Only records sealed by prvSslWriteV() are drained here. mbedtls_ssl_write()
+ * drains its own leftover output when the caller retries with the same data.
+ *
+ * @param[in] pxCtx TLS context with a completed handshake.
+ *
+ * @return Zero if nothing is left, the number of bytes still pending if the
+ * network would block, or a negative value on a hard error. On a hard error
+ * the context is invalidated.
+ */
+static BaseType_t prvFlushPendingRecord( TLSContext_t * pxCtx )
+{
+    BaseType_t xResult = 0;
+
+    if( 0U != pxCtx->xMbedSslCtx.out_left )
+    {
+        do
+        {
+            xResult = mbedtls_ssl_flush_output( &pxCtx->xMbedSslCtx );
+        } while( MBEDTLS_ERR_SSL_WANT_WRITE == xResult );
+
+        if( ( 0 <= xResult ) || ( -pdFREERTOS_ERRNO_ENOSPC == xResult ) )
+        {
+            xResult = ( BaseType_t ) pxCtx->xMbedSslCtx.out_left;
+        }
+        else
+        {
+            prvFreeContext( pxCtx );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Encrypts and sends a buffer, one TLS record per mbedtls_ssl_write call.
+ *
+ * @param[in] pxCtx TLS context with a completed handshake.
+ * @param[in] pucMsg Byte buffer to send.
+ * @param[in] xMsgLength Length of byte buffer to send.
+ *
+ * @return Number of bytes sent, which is less than xMsgLength if the network
+ * would block, or a negative value on a hard error. On a hard error the
+ * context is invalidated.
+ */
+static BaseType_t prvSslWrite( TLSContext_t * pxCtx,
+                               const unsigned char * pucMsg,
+                               size_t xMsgLength )
+{
+    BaseType_t xResult = 0;
+    size_t xWritten = 0;
+    size_t xChunk = 0;
+
+    if( 0U != pxCtx->xPendingVectorRecord )
+    {
+        /* mbedtls_ssl_write() would take the rest of a TLS_SendV() record for
+         * a retry of this data and report this data as sent. Drain it, but
+         * send nothing: the payload of that record is reported by the
+         * TLS_SendV() retry, which must come before any other write. */
+        xResult = prvFlushPendingRecord( pxCtx );
+        xMsgLength = 0;
+    }
+
+    while( xWritten < xMsgLength )
+    {
+        /* mbedTLS sizes records by the negotiated fragment length, which can
+         * exceed a send buffer that was shrunk for this connection. */
+        xChunk = xMsgLength - xWritten;
+
+        if( ( 0U != pxCtx->xOutContentLength ) && ( xChunk > pxCtx->xOutContentLength ) )
+        {
+            xChunk = pxCtx->xOutContentLength;
+        }
+
+        xResult = mbedtls_ssl_write( &pxCtx->xMbedSslCtx,
+                                     pucMsg + xWritten,
+                                     xChunk );
+
+        if( 0 < xResult )
+        {
+            /* Sent data, so update the tally and keep looping. mbedTLS never
+             * puts more than one record's payload into a single write. */
+            xWritten += ( size_t ) xResult;
+            pxCtx->xWriteMetrics.ulBytesSent += ( uint32_t ) xResult;
+            pxCtx->xWriteMetrics.ulRecordsSent++;
+        }
+        else if( ( 0 == xResult ) || ( -pdFREERTOS_ERRNO_ENOSPC == xResult ) )
+        {
+            /* No data sent. The secure sockets
+             * API supports non-blocking send, so stop the loop but don't
+             * flag an error. */
+            xResult = 0;
+            break;
+        }
+        else if( MBEDTLS_ERR_SSL_WANT_WRITE != xResult )
+        {
+            /* Hard error: invalidate the context and stop. */
+            prvFreeContext( pxCtx );
+            break;
+        }
+    }
+
+    if( 0 <= xResult )
+    {
+        xResult = ( BaseType_t ) xWritten;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Encrypts and sends the concatenation of several buffers.
+ *
+ * Plaintext is gathered directly into the record buffer, where mbedTLS
+ * encrypts it in place, so every record but the last is full regardless of
+ * how the message is split across the vectors. This is the copy
+ * mbedtls_ssl_write() makes of a contiguous buffer; renegotiation and DTLS,
+ * which that function also deals with, are not enabled.
+ *
+ * A record the network does not take in full is reported as sent only once it
+ * has left the record buffer, by the call that retries with the same data.
+ *
+ * @param[in] pxCtx TLS context with a completed handshake.
+ * @param[in] pxVectors Buffers to send.
+ * @param[in] xVectorCount Number of entries in pxVectors.
+ *
+ * @return Number of bytes sent, which is less than the total length if the
+ * network would block, or a negative value on a hard error. On a hard error
+ * the context is invalidated.
+ */
+static BaseType_t prvSslWriteV( TLSContext_t * pxCtx,
+                                const TLSIoVector_t * pxVectors,
+                                size_t xVectorCount )
+{
+    mbedtls_ssl_context * pxSsl = &pxCtx->xMbedSslCtx;
+    BaseType_t xResult = 0;
+    size_t xMaxPayload = 0;
+    size_t xRecordLength = 0;
+    size_t xWritten = 0;
+    size_t xVector = 0;
+    size_t xOffset = 0;
+    size_t xChunk = 0;
+
+    xResult = mbedtls_ssl_get_max_out_record_payload( pxSsl );
+
+    if( 0 < xResult )
+    {
+        xMaxPayload = ( size_t ) xResult;
+        xResult = 0;
+
+        if( ( 0U != pxCtx->xOutContentLength ) && ( xMaxPayload > pxCtx->xOutContentLength ) )
+        {
+            xMaxPayload = pxCtx->xOutContentLength;
+        }
+
+        if( 0U != pxCtx->xPendingVectorRecord )
+        {
+            xResult = prvFlushPendingRecord( pxCtx );
+
+            if( 0 == xResult )
+            {
+                /* The record has left, and the caller retries with the same
+                 * data, which starts with its payload. */
+                xWritten = pxCtx->xPendingVectorRecord;
+                pxCtx->xPendingVectorRecord = 0;
+                pxCtx->xWriteMetrics.ulBytesSent += ( uint32_t ) xWritten;
+                pxCtx->xWriteMetrics.ulRecordsSent++;
+                xChunk = xWritten;
+
+                while( ( xVector < xVectorCount ) && ( 0U != xChunk ) )
+                {
+                    if( pxVectors[ xVector ].xLength > xChunk )
+                    {
+                        xOffset = xChunk;
+                        xChunk = 0;
+                    }
+                    else
+                    {
+                        xChunk -= pxVectors[ xVector ].xLength;
+                        xVector++;
+                    }
+                }
+            }
+        }
+        else if( 0U != pxSsl->out_left )
+        {
+            /* Left by mbedtls_ssl_write(), which only drains it when
+             * TLS_Send() is retried with the same data. */
+            xResult = 1;
+        }
+
+        if( 0 < xResult )
+        {
+            /* Still blocked on the previous record. */
+            xVector = xVectorCount;
+            xResult = 0;
+        }
+    }
+    else
+    {
+        xResult = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    while( ( 0 == xResult ) && ( xVector < xVectorCount ) )
+    {
+        xRecordLength = 0;
+
+        while( ( xVector < xVectorCount ) && ( xRecordLength < xMaxPayload ) )
+        {
+            xChunk = pxVectors[ xVector ].xLength - xOffset;
+
+            if( xChunk > ( xMaxPayload - xRecordLength ) )
+            {
+                xChunk = xMaxPayload - xRecordLength;
+            }
+
+            if( 0U != xChunk )
+            {
+                memcpy( pxSsl->out_msg + xRecordLength,
+                        ( const unsigned char * ) pxVectors[ xVector ].pvBase + xOffset, /*lint !e9079 Allow casting void* to other types. */
+                        xChunk );
+                xRecordLength += xChunk;
+                xOffset += xChunk;
+            }
+
+            if( xOffset == pxVectors[ xVector ].xLength )
+            {
+                xVector++;
+                xOffset = 0;
+            }
+        }
+
+        if( 0U == xRecordLength )
+        {
+            /* Only empty vectors were left. */
+            break;
+        }
+
+        pxSsl->out_msglen = xRecordLength;
+        pxSsl->out_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+
+        /* Seal the record and push it to the network. */
+        xResult = mbedtls_ssl_write_record( pxSsl, 1U );
+
+        while( MBEDTLS_ERR_SSL_WANT_WRITE == xResult )
+        {
+            xResult = mbedtls_ssl_flush_output( pxSsl );
+        }
+
+        if( ( ( 0 <= xResult ) || ( -pdFREERTOS_ERRNO_ENOSPC == xResult ) ) &&
+            ( 0U != pxSsl->out_left ) )
+        {
+            /* The network would block partway through the record. Hold its
+             * payload back until the rest has been sent, and stop. */
+            pxCtx->xPendingVectorRecord = xRecordLength;
+            xResult = 1;
+        }
+        else if( 0 <= xResult )
+        {
+            xWritten += xRecordLength;
+            pxCtx->xWriteMetrics.ulBytesSent += ( uint32_t ) xRecordLength;
+            pxCtx->xWriteMetrics.ulRecordsSent++;
+        }
+        else
+        {
+            /* Hard error: invalidate the context and stop. */
+            prvFreeContext( pxCtx );
+        }
+    }
+
+    if( 0 <= xResult )
+    {
+        xResult = ( BaseType_t ) xWritten;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+#if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+
+/**
+ * @brief Moves an mbedTLS record buffer to a new allocation of a given size,
+ * keeping as much of its content as fits.
+ *
+ * @param[in,out] ppucBuffer Buffer to resize.
+ * @param[in,out] pxLength Current length of the buffer.
+ * @param[in] xNewLength Requested length.
+ *
+ * @return Zero on success, or MBEDTLS_ERR_SSL_ALLOC_FAILED with the buffer unchanged.
+ */
+    static int prvResizeBuffer( unsigned char ** ppucBuffer,
+                                size_t * pxLength,
+                                size_t xNewLength )
+    {
+        int lResult = 0;
+        unsigned char * pucNewBuffer = NULL;
+
+        if( *pxLength != xNewLength )
+        {
+            pucNewBuffer = ( unsigned char * ) mbedtls_calloc( 1, xNewLength );
+
+            if( NULL == pucNewBuffer )
+            {
+                lResult = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            }
+            else
+            {
+                memcpy( pucNewBuffer, *ppucBuffer, ( *pxLength < xNewLength ) ? *pxLength : xNewLength );
+                mbedtls_platform_zeroize( *ppucBuffer, *pxLength );
+                mbedtls_free( *ppucBuffer );
+
+                *ppucBuffer = pucNewBuffer;
+                *pxLength = xNewLength;
+            }
+        }
+
+        return lResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Resizes both mbedTLS record buffers of an established connection.
+ *
+ * This follows what mbedTLS itself does after the handshake: the record
+ * pointers are re-derived from the new buffers at their old offsets. The
+ * caller must ensure no record data beyond those offsets is still needed.
+ *
+ * @param[in] pxCtx TLS context with a completed handshake.
+ * @param[in] xInLength New receive buffer length.
+ * @param[in] xOutLength New send buffer length.
+ *
+ * @return Zero on success, or MBEDTLS_ERR_SSL_ALLOC_FAILED.
+ */
+    static int prvResizeRecordBuffers( TLSContext_t * pxCtx,
+                                       size_t xInLength,
+                                       size_t xOutLength )
+    {
+        int lResult = 0;
+        mbedtls_ssl_context * pxSsl = &pxCtx->xMbedSslCtx;
+        size_t xInMsgOffset = ( size_t ) ( pxSsl->in_msg - pxSsl->in_buf );
+        size_t xInIvOffset = ( size_t ) ( pxSsl->in_iv - pxSsl->in_buf );
+        size_t xInLenOffset = ( size_t ) ( pxSsl->in_len - pxSsl->in_buf );
+        size_t xOutMsgOffset = ( size_t ) ( pxSsl->out_msg - pxSsl->out_buf );
+        size_t xOutIvOffset = ( size_t ) ( pxSsl->out_iv - pxSsl->out_buf );
+        size_t xOutLenOffset = ( size_t ) ( pxSsl->out_len - pxSsl->out_buf );
+
+        lResult = prvResizeBuffer( &pxSsl->in_buf, &pxSsl->in_buf_len, xInLength );
+
+        if( 0 == lResult )
+        {
+            lResult = prvResizeBuffer( &pxSsl->out_buf, &pxSsl->out_buf_len, xOutLength );
+        }
+
+        /* Re-derive the record pointers even if only one buffer moved. */
+        mbedtls_ssl_reset_in_out_pointers( pxSsl );
+        pxSsl->in_msg = pxSsl->in_buf + xInMsgOffset;
+        pxSsl->in_iv = pxSsl->in_buf + xInIvOffset;
+        pxSsl->in_len = pxSsl->in_buf + xInLenOffset;
+        pxSsl->out_msg = pxSsl->out_buf + xOutMsgOffset;
+        pxSsl->out_iv = pxSsl->out_buf + xOutIvOffset;
+        pxSsl->out_len = pxSsl->out_buf + xOutLenOffset;
+
+        return lResult;
+    }
+
+#endif /* if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH ) */
+
+/*-----------------------------------------------------------*/
+
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+
+/**
+ * @brief Maps a requested incoming record size to the smallest max fragment
+ * length code that can carry it.
+ *
+ * @param[in] ulContentLength Requested plaintext size, or zero for the default.
+ *
+ * @return One of the MBEDTLS_SSL_MAX_FRAG_LEN_* codes.
+ */
+static unsigned char prvMaxFragLenCode( uint32_t ulContentLength )
+{
+    unsigned char ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+
+    if( 0U == ulContentLength )
+    {
+        /* 4096 bytes is currently the largest fragment size permitted. */
+    }
+    else if( ulContentLength <= 512U )
+    {
+        ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_512;
+    }
+    else if( ulContentLength <= 1024U )
+    {
+        ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+    }
+    else if( ulContentLength <= 2048U )
+    {
+        ucCode = MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+    }
+    else
+    {
+        /* MISRA 15.7 */
+    }
+
+    return ucCode;
+}
+
+#endif /* ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sizes the record buffers for the rest of the connection.
+ *
+ * mbedTLS has already fitted the buffers to the negotiated fragment length.
+ * The receive buffer must stay that large, since the server is free to send
+ * records up to it, but the send buffer only has to carry what this side
+ * chooses to write, so it is shrunk to the requested outgoing size.
+ *
+ * @param[in] pxCtx TLS context with a completed handshake.
+ */
+static void prvSetupRecordBuffers( TLSContext_t * pxCtx )
+{
+    #ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+        size_t xInContentLength = mbedtls_ssl_get_input_max_frag_len( &pxCtx->xMbedSslCtx );
+        size_t xOutContentLength = mbedtls_ssl_get_output_max_frag_len( &pxCtx->xMbedSslCtx );
+    #else
+        size_t xInContentLength = MBEDTLS_SSL_IN_CONTENT_LEN;
+        size_t xOutContentLength = MBEDTLS_SSL_OUT_CONTENT_LEN;
+    #endif
+
+    if( ( 0U != pxCtx->ulOutContentLength ) && ( xOutContentLength > pxCtx->ulOutContentLength ) )
+    {
+        xOutContentLength = ( size_t ) pxCtx->ulOutContentLength;
+    }
+
+    if( ( 0U != pxCtx->ulInContentLength ) && ( xInContentLength > pxCtx->ulInContentLength ) )
+    {
+        TLS_PRINT( ( "WARN: Server did not accept a %u byte fragment length, receive buffer kept at %u bytes.\r\n",
+                     ( unsigned ) pxCtx->ulInContentLength,
+                     ( unsigned ) xInContentLength ) );
+    }
+
+    #if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+        if( 0 == prvResizeRecordBuffers( pxCtx,
+                                         pxCtx->xMbedSslCtx.in_buf_len,
+                                         xOutContentLength + TLS_OUT_BUFFER_OVERHEAD ) )
+        {
+            pxCtx->xOutContentLength = xOutContentLength;
+        }
+
+        pxCtx->xInBufferLength = pxCtx->xMbedSslCtx.in_buf_len;
+        pxCtx->xOutBufferLength = pxCtx->xMbedSslCtx.out_buf_len;
+    #else
+        pxCtx->xOutContentLength = xOutContentLength;
+        pxCtx->xInBufferLength = MBEDTLS_SSL_IN_BUFFER_LEN;
+        pxCtx->xOutBufferLength = MBEDTLS_SSL_OUT_BUFFER_LEN;
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Re-grows buffers released by TLS_Idle() before they are used again.
  *
- * @param[in] pvContext Caller context.
- * @param[in] pucData Byte buffer to send.
- * @param[in] xDataLength Length of byte buffer to send.
+ * @param[in] pxCtx TLS context.
  *
- * @return Number of bytes sent, or a negative value on error.
+ * @return Zero if the record buffers are usable, or MBEDTLS_ERR_SSL_ALLOC_FAILED.
  */
-static int prvNetworkSend( void * pvContext,
-                           const unsigned char * pucData,
-                           size_t xDataLength )
+static int prvEnsureActiveBuffers( TLSContext_t * pxCtx )
 {
-    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+    int lResult = 0;
 
-    return ( int ) pxCtx->xNetworkSend( pxCtx->pvCallerContext, pucData, xDataLength );
+    #if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+        if( pdFALSE != pxCtx->xBuffersIdle )
+        {
+            lResult = prvResizeRecordBuffers( pxCtx, pxCtx->xInBufferLength, pxCtx->xOutBufferLength );
+
+            if( 0 == lResult )
+            {
+                pxCtx->xBuffersIdle = pdFALSE;
+            }
+            else
+            {
+                TLS_PRINT( ( "ERROR: No memory to re-grow idle TLS record buffers.\r\n" ) );
+            }
+        }
+    #else /* if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH ) */
+        ( void ) pxCtx;
+    #endif /* if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH ) */
+
+    return lResult;
 }
 
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Network receive callback shim.
+ * @brief Waits for data on a connection released by TLS_Idle() without
+ * re-growing its buffers, so that polling an idle connection stays cheap.
  *
- * @param[in] pvContext Caller context.
- * @param[out] pucReceiveBuffer Byte buffer to receive into.
- * @param[in] xReceiveLength Length of byte buffer for receive.
+ * The first byte received is kept and handed to mbedTLS by prvNetworkRecv().
  *
- * @return Number of bytes received, or a negative value on error.
+ * @param[in] pxCtx TLS context.
+ *
+ * @return 1 if the buffers are needed, 0 if nothing arrived, or a negative
+ * network error.
  */
-static int prvNetworkRecv( void * pvContext,
-                           unsigned char * pucReceiveBuffer,
-                           size_t xReceiveLength )
+static BaseType_t prvWaitWhileIdle( TLSContext_t * pxCtx )
 {
-    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+    BaseType_t xResult = 1;
+
+    if( ( pdFALSE != pxCtx->xBuffersIdle ) && ( pdFALSE == pxCtx->xHasLookahead ) )
+    {
+        xResult = pxCtx->xNetworkRecv( pxCtx->pvCallerContext, &pxCtx->ucLookahead, 1U );
+
+        if( 0 < xResult )
+        {
+            pxCtx->xHasLookahead = pdTRUE;
+            xResult = 1;
+        }
+    }
 
-    return ( int ) pxCtx->xNetworkRecv( pxCtx->pvCallerContext, pucReceiveBuffer, xReceiveLength );
+    return xResult;
 }
 
 /*-----------------------------------------------------------*/
@@ -325,6 +1083,7 @@ static int prvPrivateKeySigningCallback( void * pvContext,
     CK_MECHANISM xMech = { 0 };
     CK_BYTE xToBeSigned[ 256 ];
     CK_ULONG xToBeSignedLen = sizeof( xToBeSigned );
+    BaseType_t xLocked = pdFALSE;
 
     /* Unreferenced parameters. */
     ( void ) ( piRng );
@@ -360,6 +1119,14 @@ static int prvPrivateKeySigningCallback( void * pvContext,
         xResult = CKR_ARGUMENTS_BAD;
     }
 
+    /* A shared session carries one sign operation at a time. */
+    if( ( CKR_OK == xResult ) && ( pdFALSE != pxTLSContext->xUsesCachedSession ) )
+    {
+        xLocked = prvCredentialCacheLock();
+    }
+
+    ConnectTrace_PhaseStart( eConnectTracePhaseSign );
+
     if( CKR_OK == xResult )
     {
         /* Use the PKCS#11 module to sign. */
@@ -378,6 +1145,25 @@ static int prvPrivateKeySigningCallback( void * pvContext,
                                                            ( CK_ULONG_PTR ) pxSigLen );
     }
 
+    if( pdTRUE == xLocked )
+    {
+        prvCredentialCacheUnlock();
+    }
+
+    ConnectTrace_PhaseEnd( eConnectTracePhaseSign );
+
+    /* Cached handles no longer resolve, e.g. after the module was finalized
+     * or the key was replaced. Make the next connection look them up again. */
+    if( ( pdFALSE != pxTLSContext->xUsesCachedSession ) &&
+        ( ( CKR_SESSION_HANDLE_INVALID == xResult ) ||
+          ( CKR_SESSION_CLOSED == xResult ) ||
+          ( CKR_KEY_HANDLE_INVALID == xResult ) ||
+          ( CKR_OBJECT_HANDLE_INVALID == xResult ) ||
+          ( CKR_CRYPTOKI_NOT_INITIALIZED == xResult ) ) )
+    {
+        TLS_InvalidateCredentialCache();
+    }
+
     if( ( xResult == CKR_OK ) && ( CKK_EC == pxTLSContext->xKeyType ) )
     {
         /* PKCS #11 for P256 returns a 64-byte signature with 32 bytes for R and 32 bytes for S.
@@ -522,10 +1308,110 @@ static int prvInitializeClientCredential_alt( TLSContext_t * pxCtx )
 }
 
 #else
+/**
+ * @brief Take the private key handle and client certificate from the cache.
+ *
+ * @param[in] pxCtx Caller context, which must have borrowed the cached session.
+ * @param[out] ppxCertificate Receives the cached certificate chain.
+ *
+ * @return pdTRUE on a cache hit.
+ */
+static BaseType_t prvLoadCachedCredential( TLSContext_t * pxCtx,
+                                           mbedtls_x509_crt ** ppxCertificate )
+{
+    BaseType_t xHit = pdFALSE;
+
+    if( ( pdFALSE != pxCtx->xUsesCachedSession ) &&
+        ( pdTRUE == prvCredentialCacheLock() ) )
+    {
+        if( pdFALSE != xCredentialCache.xValid )
+        {
+            pxCtx->xP11PrivateKey = xCredentialCache.xPrivateKey;
+            pxCtx->xKeyType = xCredentialCache.xKeyType;
+            *ppxCertificate = &xCredentialCache.xCertificate;
+            xHit = pdTRUE;
+        }
+
+        prvCredentialCacheUnlock();
+    }
+
+    return xHit;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Hand freshly loaded credentials over to an empty cache.
+ *
+ * The context's session, key handle and parsed certificate become the cached
+ * ones, and the context turns into the first borrower. Nothing happens if the
+ * cache still holds credentials, possibly invalidated ones in use elsewhere.
+ *
+ * @param[in] pxCtx Caller context with its own, logged-in session.
+ * @param[in,out] ppxCertificate Certificate chain to adopt; updated to the
+ * cached copy when it was adopted.
+ */
+static void prvStoreCachedCredential( TLSContext_t * pxCtx,
+                                      mbedtls_x509_crt ** ppxCertificate )
+{
+    if( ( pdFALSE == pxCtx->xUsesCachedSession ) &&
+        ( pdTRUE == prvCredentialCacheLock() ) )
+    {
+        if( CK_INVALID_HANDLE == xCredentialCache.xSession )
+        {
+            xCredentialCache.xSession = pxCtx->xP11Session;
+            xCredentialCache.xPrivateKey = pxCtx->xP11PrivateKey;
+            xCredentialCache.xKeyType = pxCtx->xKeyType;
+
+            /* The parsed chain only holds heap pointers, so moving its head
+             * structure moves the whole chain. */
+            memcpy( &xCredentialCache.xCertificate, *ppxCertificate, sizeof( mbedtls_x509_crt ) );
+            mbedtls_x509_crt_init( *ppxCertificate );
+            *ppxCertificate = &xCredentialCache.xCertificate;
+
+            xCredentialCache.ulUsers = 1;
+            xCredentialCache.xValid = pdTRUE;
+            pxCtx->xUsesCachedSession = pdTRUE;
+        }
+
+        prvCredentialCacheUnlock();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Account one credential setup in the cache counters.
+ */
+static void prvRecordCredentialLoad( BaseType_t xHit,
+                                     TickType_t xTicks )
+{
+    if( pdTRUE == prvCredentialCacheLock() )
+    {
+        if( pdFALSE != xHit )
+        {
+            xCredentialCache.xMetrics.ulHits++;
+            xCredentialCache.xMetrics.xHitTicks += xTicks;
+        }
+        else
+        {
+            xCredentialCache.xMetrics.ulMisses++;
+            xCredentialCache.xMetrics.xMissTicks += xTicks;
+        }
+
+        prvCredentialCacheUnlock();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Helper for setting up potentially hardware-based cryptographic context
  * for the client TLS certificate and private key.
  *
+ * The session, key handle and client certificate come from the credential
+ * cache when it is populated, and populate it otherwise.
+ *
  * @param Caller context.
  *
  * @return Zero on success.
@@ -536,6 +1422,9 @@ static int prvInitializeClientCredential( TLSContext_t * pxCtx )
     CK_ATTRIBUTE xTemplate[ 2 ];
     mbedtls_pk_type_t xKeyAlgo = ( mbedtls_pk_type_t ) ~0;
     char * pcJitrCertificate = keyJITR_DEVICE_CERTIFICATE_AUTHORITY_PEM;
+    mbedtls_x509_crt * pxCertificate = &pxCtx->xMbedX509Cli;
+    BaseType_t xCacheHit = pdFALSE;
+    TickType_t xStartTicks = xTaskGetTickCount();
 
     /* Initialize the mbed contexts. */
     mbedtls_x509_crt_init( &pxCtx->xMbedX509Cli );
@@ -546,17 +1435,22 @@ static int prvInitializeClientCredential( TLSContext_t * pxCtx )
         TLS_PRINT( ( "Error: PKCS #11 session was not initialized.\r\n" ) );
     }
 
-    /* Put the module in authenticated mode. */
     if( CKR_OK == xResult )
     {
         pxCtx->xTLSHandshakeState = TLS_HANDSHAKE_STARTED;
+        xCacheHit = prvLoadCachedCredential( pxCtx, &pxCertificate );
+    }
+
+    /* Put the module in authenticated mode. */
+    if( ( CKR_OK == xResult ) && ( pdFALSE == xCacheHit ) )
+    {
         xResult = ( BaseType_t ) pxCtx->pxP11FunctionList->C_Login( pxCtx->xP11Session,
                                                                     CKU_USER,
                                                                     ( CK_UTF8CHAR_PTR ) configPKCS11_DEFAULT_USER_PIN,
                                                                     sizeof( configPKCS11_DEFAULT_USER_PIN ) - 1 );
     }
 
-    if( CKR_OK == xResult )
+    if( ( CKR_OK == xResult ) && ( pdFALSE == xCacheHit ) )
     {
         /* Get the handle of the device private key. */
         xResult = xFindObjectWithLabelAndClass( pxCtx->xP11Session,
@@ -573,7 +1467,7 @@ static int prvInitializeClientCredential( TLSContext_t * pxCtx )
     }
 
     /* Query the device private key type. */
-    if( xResult == CKR_OK )
+    if( ( xResult == CKR_OK ) && ( pdFALSE == xCacheHit ) )
     {
         xTemplate[ 0 ].type = CKA_KEY_TYPE;
         xTemplate[ 0 ].pValue = &pxCtx->xKeyType;
@@ -614,7 +1508,7 @@ static int prvInitializeClientCredential( TLSContext_t * pxCtx )
     }
 
     /* Get the handle of the device client certificate. */
-    if( xResult == CKR_OK )
+    if( ( xResult == CKR_OK ) && ( pdFALSE == xCacheHit ) )
     {
         xResult = prvReadCertificateIntoContext( pxCtx,
                                                  pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
@@ -624,7 +1518,7 @@ static int prvInitializeClientCredential( TLSContext_t * pxCtx )
 
     /* Add a Just-in-Time Registration (JITR) device issuer certificate, if
      * present, to the TLS context handle. */
-    if( xResult == CKR_OK )
+    if( ( xResult == CKR_OK ) && ( pdFALSE == xCacheHit ) )
     {
         /* Prioritize a statically defined certificate over one in storage. */
         if( ( NULL != pcJitrCertificate ) &&
@@ -648,16 +1542,30 @@ static int prvInitializeClientCredential( TLSContext_t * pxCtx )
                 xResult = CKR_OK;
             }
         }
+
+        if( xResult == CKR_OK )
+        {
+            prvStoreCachedCredential( pxCtx, &pxCertificate );
+        }
     }
 
     /* Attach the client certificate(s) and private key to the TLS configuration. */
     if( 0 == xResult )
     {
         xResult = mbedtls_ssl_conf_own_cert( &pxCtx->xMbedSslConfig,
-                                             &pxCtx->xMbedX509Cli,
+                                             pxCertificate,
                                              &pxCtx->xMbedPkCtx );
     }
 
+    if( 0 == xResult )
+    {
+        xStartTicks = xTaskGetTickCount() - xStartTicks;
+        prvRecordCredentialLoad( xCacheHit, xStartTicks );
+        TLS_PRINT( ( "INFO: Client credentials %s in %u ms.\r\n",
+                     ( pdFALSE != xCacheHit ) ? "reused" : "loaded",
+                     ( unsigned ) ( xStartTicks * portTICK_PERIOD_MS ) ) );
+    }
+
     return xResult;
 }
 #endif
@@ -736,12 +1644,26 @@ BaseType_t TLS_Init( void ** ppvContext,
         pxCtx->xNetworkSend = pxParams->pxNetworkSend;
         pxCtx->pvCallerContext = pxParams->pvCallerContext;
 
+        /* Fields appended to TLSParams_t are only read if the caller's
+         * structure is large enough to contain them. */
+        if( pxParams->ulSize >= sizeof( TLSParams_t ) )
+        {
+            pxCtx->ulInContentLength = pxParams->ulInContentLength;
+            pxCtx->ulOutContentLength = pxParams->ulOutContentLength;
+        }
+
         /* Get the function pointer list for the PKCS#11 module. */
         xCkGetFunctionList = C_GetFunctionList;
         xResult = ( BaseType_t ) xCkGetFunctionList( &pxCtx->pxP11FunctionList );
 
-        /* Ensure that the PKCS #11 module is initialized and create a session. */
+        /* Reuse the cached session, if any. */
         if( xResult == CKR_OK )
+        {
+            prvBorrowCachedSession( pxCtx );
+        }
+
+        /* Ensure that the PKCS #11 module is initialized and create a session. */
+        if( ( xResult == CKR_OK ) && ( pdFALSE == pxCtx->xUsesCachedSession ) )
         {
             xResult = xInitializePkcs11Session( &pxCtx->xP11Session );
 
@@ -810,6 +1732,8 @@ BaseType_t TLS_Connect( void * pvContext )
     mbedtls_ssl_config_init( &pxCtx->xMbedSslConfig );
     mbedtls_x509_crt_init( &pxCtx->xMbedX509CA );
 
+    ConnectTrace_PhaseStart( eConnectTracePhaseCertParse );
+
     /* Decode the root certificate: either the default or the override. */
     if( NULL != pxCtx->pcServerCertificate )
     {
@@ -860,6 +1784,8 @@ BaseType_t TLS_Connect( void * pvContext )
         }
     }
 
+    ConnectTrace_PhaseEnd( eConnectTracePhaseCertParse );
+
     /* Start with protocol defaults. */
     if( 0 == xResult )
     {
@@ -900,11 +1826,13 @@ BaseType_t TLS_Connect( void * pvContext )
          * are not loaded. This allows the TLS layer to still connect to servers
          * that do not require mutual authentication. If the server does
          * require mutual authentication, the handshake will fail. */
+        ConnectTrace_PhaseStart( eConnectTracePhaseCredentials );
 #if defined(KEY_PLAINTEXT) && (KEY_PLAINTEXT == 1)
         xPKCSResult = prvInitializeClientCredential_alt( pxCtx );
 #else
         xPKCSResult = prvInitializeClientCredential( pxCtx );
 #endif
+        ConnectTrace_PhaseEnd( eConnectTracePhaseCredentials );
     }
 
     if( ( 0 == xResult ) && ( NULL != pxCtx->ppcAlpnProtocols ) )
@@ -936,9 +1864,11 @@ BaseType_t TLS_Connect( void * pvContext )
             /* Enable the max fragment extension. 4096 bytes is currently the largest fragment size permitted.
              * See RFC 8449 https://tools.ietf.org/html/rfc8449 for more information.
              *
-             * Smaller values can be found in "mbedtls/include/ssl.h".
+             * A smaller fragment is requested when the caller provisions a
+             * smaller receive buffer.
              */
-            xResult = mbedtls_ssl_conf_max_frag_len( &pxCtx->xMbedSslConfig, MBEDTLS_SSL_MAX_FRAG_LEN_4096 );
+            xResult = mbedtls_ssl_conf_max_frag_len( &pxCtx->xMbedSslConfig,
+                                                     prvMaxFragLenCode( pxCtx->ulInContentLength ) );
         }
     #endif
 
@@ -958,6 +1888,8 @@ BaseType_t TLS_Connect( void * pvContext )
                              NULL );
 
         /* Negotiate. */
+        ConnectTrace_PhaseStart( eConnectTracePhaseHandshake );
+
         while( 0 != ( xResult = mbedtls_ssl_handshake( &pxCtx->xMbedSslCtx ) ) )
         {
             if( ( MBEDTLS_ERR_SSL_WANT_READ != xResult ) &&
@@ -989,12 +1921,24 @@ BaseType_t TLS_Connect( void * pvContext )
                 break;
             }
         }
+
+        ConnectTrace_PhaseEnd( eConnectTracePhaseHandshake );
     }
 
     /* Keep track of successful completion of the handshake. */
     if( 0 == xResult )
     {
+        TLSMemoryUsage_t xUsage;
+
         pxCtx->xTLSHandshakeState = TLS_HANDSHAKE_SUCCESSFUL;
+        prvSetupRecordBuffers( pxCtx );
+
+        TLS_GetMemoryUsage( pxCtx, &xUsage );
+        TLS_PRINT( ( "INFO: TLS connection holds %u bytes (context %u, in %u, out %u).\r\n",
+                     ( unsigned ) ( xUsage.xContextBytes + xUsage.xInBufferBytes + xUsage.xOutBufferBytes ),
+                     ( unsigned ) xUsage.xContextBytes,
+                     ( unsigned ) xUsage.xInBufferBytes,
+                     ( unsigned ) xUsage.xOutBufferBytes ) );
     }
     else if( xResult > 0 )
     {
@@ -1022,27 +1966,48 @@ BaseType_t TLS_Recv( void * pvContext,
     BaseType_t xResult = 0;
     TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
     size_t xRead = 0;
+    BaseType_t xOutOfMemory = pdFALSE;
 
     if( ( NULL != pxCtx ) && ( TLS_HANDSHAKE_SUCCESSFUL == pxCtx->xTLSHandshakeState ) )
     {
-        /* This routine will return however many bytes are returned from from mbedtls_ssl_read
-         * immediately unless MBEDTLS_ERR_SSL_WANT_READ is returned, in which case we try again. */
-        do
+        /* Zero when nothing arrived on an idle connection, which then stays idle. */
+        xResult = prvWaitWhileIdle( pxCtx );
+
+        if( 0 < xResult )
         {
-            xResult = mbedtls_ssl_read( &pxCtx->xMbedSslCtx,
-                                        pucReadBuffer + xRead,
-                                        xReadLength - xRead );
+            xResult = prvEnsureActiveBuffers( pxCtx );
 
-            if( xResult > 0 )
+            if( 0 != xResult )
             {
-                /* Got data, so update the tally and keep looping. */
-                xRead += ( size_t ) xResult;
+                /* Out of memory. The context is still usable once memory frees up. */
+                xOutOfMemory = pdTRUE;
             }
 
-            /* If xResult == 0, then no data was received (and there is no error).
-             * The secure sockets API supports non-blocking read, so stop the loop,
-             * but don't flag an error. */
-        } while( ( xResult == MBEDTLS_ERR_SSL_WANT_READ ) );
+            /* This routine will return however many bytes are returned from from mbedtls_ssl_read
+             * immediately unless MBEDTLS_ERR_SSL_WANT_READ is returned, in which case we try again. */
+            while( xResult >= 0 )
+            {
+                xResult = mbedtls_ssl_read( &pxCtx->xMbedSslCtx,
+                                            pucReadBuffer + xRead,
+                                            xReadLength - xRead );
+
+                if( xResult > 0 )
+                {
+                    /* Got data, so update the tally and keep looping. */
+                    xRead += ( size_t ) xResult;
+                }
+
+                /* If xResult == 0, then no data was received (and there is no error).
+                 * The secure sockets API supports non-blocking read, so stop the loop,
+                 * but don't flag an error. */
+                if( xResult != MBEDTLS_ERR_SSL_WANT_READ )
+                {
+                    break;
+                }
+
+                xResult = 0;
+            }
+        }
     }
     else
     {
@@ -1053,6 +2018,10 @@ BaseType_t TLS_Recv( void * pvContext,
     {
         xResult = ( BaseType_t ) xRead;
     }
+    else if( pdFALSE != xOutOfMemory )
+    {
+        /* Same as TLS_Send(): report the error, keep the connection. */
+    }
     else
     {
         /* xResult < 0 is a hard error, so invalidate the context and stop. */
@@ -1070,34 +2039,57 @@ BaseType_t TLS_Send( void * pvContext,
 {
     BaseType_t xResult = 0;
     TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
-    size_t xWritten = 0;
 
     if( ( NULL != pxCtx ) && ( TLS_HANDSHAKE_SUCCESSFUL == pxCtx->xTLSHandshakeState ) )
     {
-        while( xWritten < xMsgLength )
+        xResult = prvEnsureActiveBuffers( pxCtx );
+
+        if( 0 != xResult )
         {
-            xResult = mbedtls_ssl_write( &pxCtx->xMbedSslCtx,
-                                         pucMsg + xWritten,
-                                         xMsgLength - xWritten );
+            /* Out of memory. The context is still usable once memory frees up. */
+        }
+        else
+        {
+            xResult = prvSslWrite( pxCtx, pucMsg, xMsgLength );
 
             if( 0 < xResult )
             {
-                /* Sent data, so update the tally and keep looping. */
-                xWritten += ( size_t ) xResult;
-            }
-            else if( ( 0 == xResult ) || ( -pdFREERTOS_ERRNO_ENOSPC == xResult ) )
-            {
-                /* No data sent. The secure sockets
-                 * API supports non-blocking send, so stop the loop but don't
-                 * flag an error. */
-                xResult = 0;
-                break;
+                pxCtx->xWriteMetrics.ulMessagesSent++;
             }
-            else if( MBEDTLS_ERR_SSL_WANT_WRITE != xResult )
+        }
+    }
+    else
+    {
+        xResult = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TLS_SendV( void * pvContext,
+                      const TLSIoVector_t * pxVectors,
+                      size_t xVectorCount )
+{
+    BaseType_t xResult = 0;
+    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+
+    if( ( NULL != pxCtx ) && ( NULL != pxVectors ) && ( TLS_HANDSHAKE_SUCCESSFUL == pxCtx->xTLSHandshakeState ) )
+    {
+        xResult = prvEnsureActiveBuffers( pxCtx );
+
+        if( 0 != xResult )
+        {
+            /* Out of memory. The context is still usable once memory frees up. */
+        }
+        else
+        {
+            xResult = prvSslWriteV( pxCtx, pxVectors, xVectorCount );
+
+            if( 0 < xResult )
             {
-                /* Hard error: invalidate the context and stop. */
-                prvFreeContext( pxCtx );
-                break;
+                pxCtx->xWriteMetrics.ulMessagesSent++;
             }
         }
     }
@@ -1106,9 +2098,52 @@ BaseType_t TLS_Send( void * pvContext,
         xResult = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    if( 0 <= xResult )
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TLS_Idle( void * pvContext )
+{
+    BaseType_t xResult = -1;
+    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+
+    if( ( NULL != pxCtx ) && ( TLS_HANDSHAKE_SUCCESSFUL == pxCtx->xTLSHandshakeState ) )
     {
-        xResult = ( BaseType_t ) xWritten;
+        #if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+            mbedtls_ssl_context * pxSsl = &pxCtx->xMbedSslCtx;
+
+            if( pdFALSE != pxCtx->xBuffersIdle )
+            {
+                xResult = 0;
+            }
+            else if( ( 0U == pxSsl->in_left ) &&
+                     ( 0U == pxSsl->out_left ) &&
+                     ( 0U == mbedtls_ssl_get_bytes_avail( pxSsl ) ) &&
+                     ( 0 == mbedtls_ssl_check_pending( pxSsl ) ) )
+            {
+                /* Only the record counter, header and IV in front of the
+                 * payload carry state from one record to the next. */
+                xResult = prvResizeRecordBuffers( pxCtx,
+                                                  ( size_t ) ( pxSsl->in_msg - pxSsl->in_buf ),
+                                                  ( size_t ) ( pxSsl->out_msg - pxSsl->out_buf ) );
+
+                if( 0 == xResult )
+                {
+                    pxCtx->xBuffersIdle = pdTRUE;
+                }
+                else
+                {
+                    /* A partial shrink is harmless; re-grow what did shrink. */
+                    pxCtx->xBuffersIdle = pdTRUE;
+                    ( void ) prvEnsureActiveBuffers( pxCtx );
+                }
+            }
+            else
+            {
+                /* Data still in flight. */
+            }
+        #endif /* if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH ) */
     }
 
     return xResult;
@@ -1116,22 +2151,113 @@ BaseType_t TLS_Send( void * pvContext,
 
 /*-----------------------------------------------------------*/
 
+void TLS_GetMemoryUsage( void * pvContext,
+                         TLSMemoryUsage_t * pxUsage )
+{
+    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+
+    if( ( NULL != pxCtx ) && ( NULL != pxUsage ) )
+    {
+        memset( pxUsage, 0, sizeof( TLSMemoryUsage_t ) );
+        pxUsage->xContextBytes = sizeof( TLSContext_t );
+        pxUsage->xIdle = pxCtx->xBuffersIdle;
+
+        #if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+            pxUsage->xInBufferBytes = ( NULL != pxCtx->xMbedSslCtx.in_buf ) ? pxCtx->xMbedSslCtx.in_buf_len : 0U;
+            pxUsage->xOutBufferBytes = ( NULL != pxCtx->xMbedSslCtx.out_buf ) ? pxCtx->xMbedSslCtx.out_buf_len : 0U;
+        #else
+            pxUsage->xInBufferBytes = ( NULL != pxCtx->xMbedSslCtx.in_buf ) ? MBEDTLS_SSL_IN_BUFFER_LEN : 0U;
+            pxUsage->xOutBufferBytes = ( NULL != pxCtx->xMbedSslCtx.out_buf ) ? MBEDTLS_SSL_OUT_BUFFER_LEN : 0U;
+        #endif
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void TLS_GetWriteMetrics( void * pvContext,
+                          TLSWriteMetrics_t * pxMetrics )
+{
+    TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+
+    if( NULL != pxMetrics )
+    {
+        if( NULL != pxCtx )
+        {
+            *pxMetrics = pxCtx->xWriteMetrics;
+        }
+        else
+        {
+            memset( pxMetrics, 0, sizeof( TLSWriteMetrics_t ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void TLS_InvalidateCredentialCache( void )
+{
+    if( pdTRUE == prvCredentialCacheLock() )
+    {
+        if( CK_INVALID_HANDLE != xCredentialCache.xSession )
+        {
+            xCredentialCache.xValid = pdFALSE;
+            xCredentialCache.xMetrics.ulInvalidations++;
+
+            /* Otherwise the last borrower drops it. */
+            if( 0U == xCredentialCache.ulUsers )
+            {
+                prvCredentialCacheDrop();
+            }
+        }
+
+        prvCredentialCacheUnlock();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void TLS_GetCredentialCacheMetrics( TLSCredentialCacheMetrics_t * pxMetrics )
+{
+    if( NULL != pxMetrics )
+    {
+        memset( pxMetrics, 0, sizeof( TLSCredentialCacheMetrics_t ) );
+
+        if( pdTRUE == prvCredentialCacheLock() )
+        {
+            *pxMetrics = xCredentialCache.xMetrics;
+            prvCredentialCacheUnlock();
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 void TLS_Cleanup( void * pvContext )
 {
     TLSContext_t * pxCtx = ( TLSContext_t * ) pvContext; /*lint !e9087 !e9079 Allow casting void* to other types. */
+    BaseType_t xLocked = pdFALSE;
 
     if( NULL != pxCtx )
     {
         prvFreeContext( pxCtx );
-        
-        /* Deinit PKCS11 */
+
+        /* Deinit PKCS11, unless the credential cache keeps a session open.
+         * The lock keeps another connection from caching one meanwhile. */
+        xLocked = prvCredentialCacheLock();
+
         if( ( NULL != pxCtx->pxP11FunctionList ) &&
-            ( NULL != pxCtx->pxP11FunctionList->C_Finalize ) )
+            ( NULL != pxCtx->pxP11FunctionList->C_Finalize ) &&
+            ( CK_INVALID_HANDLE == xCredentialCache.xSession ) )
         {
             pxCtx->pxP11FunctionList->C_Finalize( NULL );
             TLS_PRINT( ( "INFO: Deinitialized PKCS #11 module!\r\n" ) );
         }
-        
+
+        if( pdTRUE == xLocked )
+        {
+            prvCredentialCacheUnlock();
+        }
+
         /* Free memory. */
         vPortFree( pxCtx );
     }
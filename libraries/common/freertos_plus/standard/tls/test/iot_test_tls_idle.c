@@ -0,0 +1,593 @@
+/*
+ * FreeRTOS TLS V1.3.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_test_tls_idle.c
+ * @brief Host test of TLS_Idle() and of the record buffers it releases.
+ *
+ * The context is set up as mbedTLS leaves it after a TLS 1.2 AES-GCM
+ * handshake: both record buffers allocated at their full size, with the
+ * payload 21 bytes in, behind the counter, the header and the explicit IV.
+ * The heap used by the record buffers is counted by the mbedtls_calloc() of
+ * this test, and is printed while the connection is active and while it is
+ * idle. mbedtls_ssl_read() is faked to pass the network data through, and
+ * needs the receive buffer at full size to do so.
+ * Build and run from this directory with:
+ *
+ *   gcc -std=c99 -Wall -Wextra -Wno-unused-parameter -g \
+ *       -fsanitize=address,undefined -Istubs -I../include \
+ *       -I../../crypto/include -I../../utils/include \
+ *       -I../../../../c_sdk/standard/common/include/private \
+ *       -I../../../../../3rdparty/mbedtls_utils -I../../../../../../demos/include \
+ *       iot_test_tls_idle.c stubs/tls_stubs.c \
+ *       -o iot_test_tls_idle && ./iot_test_tls_idle
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Build the module as with aws_mbedtls_config.h. */
+#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+
+/* The module is included to reach its context structure. */
+#include "../src/iot_tls.c"
+
+#define TEST_IV_OFFSET         ( 13U )
+#define TEST_MSG_OFFSET        ( 21U )
+#define TEST_WIRE_SIZE         ( 16U * 1024U )
+#define TEST_MESSAGE_LENGTH    ( 6000U )
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+static uint32_t ulFailures = 0;
+
+static TLSContext_t xTestCtx;
+
+static unsigned char ucWire[ TEST_WIRE_SIZE ];
+static size_t xWireLength = 0;
+static size_t xLargestWrite = 0;
+
+static unsigned char ucInbound[ 64 ];
+static size_t xInboundLength = 0;
+static size_t xInboundRead = 0;
+static uint32_t ulNetworkReads = 0;
+
+static size_t xHeapBytes = 0;       /* Bytes allocated through mbedtls_calloc(). */
+static BaseType_t xFailAllocations = pdFALSE;
+static size_t xBytesAvailable = 0;  /* Decrypted data mbedTLS holds for the reader. */
+static int lRecordsPending = 0;     /* Records mbedTLS holds for the reader. */
+
+/*-----------------------------------------------------------*/
+
+void * mbedtls_calloc( size_t n,
+                       size_t size )
+{
+    size_t * pxBlock = NULL;
+
+    if( pdFALSE == xFailAllocations )
+    {
+        pxBlock = calloc( 1, sizeof( size_t ) + ( n * size ) );
+    }
+
+    if( NULL != pxBlock )
+    {
+        *pxBlock = n * size;
+        xHeapBytes += n * size;
+        pxBlock++;
+    }
+
+    return pxBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_free( void * ptr )
+{
+    size_t * pxBlock = ( size_t * ) ptr;
+
+    if( NULL != pxBlock )
+    {
+        pxBlock--;
+        xHeapBytes -= *pxBlock;
+        free( pxBlock );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_platform_zeroize( void * buf,
+                               size_t len )
+{
+    memset( buf, 0, len );
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_ssl_reset_in_out_pointers( mbedtls_ssl_context * ssl )
+{
+    ssl->in_len = ssl->in_buf + 11U;
+    ssl->in_iv = ssl->in_buf + TEST_IV_OFFSET;
+    ssl->in_msg = ssl->in_iv;
+    ssl->out_len = ssl->out_buf + 11U;
+    ssl->out_iv = ssl->out_buf + TEST_IV_OFFSET;
+    ssl->out_msg = ssl->out_iv;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t mbedtls_ssl_get_bytes_avail( const mbedtls_ssl_context * ssl )
+{
+    ( void ) ssl;
+
+    return xBytesAvailable;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_check_pending( const mbedtls_ssl_context * ssl )
+{
+    ( void ) ssl;
+
+    return lRecordsPending;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvTestNetworkRecv( void * pvCallerContext,
+                                      unsigned char * pucReceiveBuffer,
+                                      size_t xReceiveLength )
+{
+    size_t xLength = xInboundLength - xInboundRead;
+
+    ( void ) pvCallerContext;
+
+    if( xLength > xReceiveLength )
+    {
+        xLength = xReceiveLength;
+    }
+
+    memcpy( pucReceiveBuffer, ucInbound + xInboundRead, xLength );
+    xInboundRead += xLength;
+    ulNetworkReads++;
+
+    /* Zero when the receive timed out. */
+    return ( BaseType_t ) xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_read( mbedtls_ssl_context * ssl,
+                      unsigned char * buf,
+                      size_t len )
+{
+    int lResult = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    int lReceived = 0;
+    size_t xRecord = 0;
+
+    if( ssl->in_buf_len - TEST_MSG_OFFSET >= MBEDTLS_SSL_IN_CONTENT_LEN )
+    {
+        /* The whole record through the BIO, as mbedTLS reads it. */
+        do
+        {
+            lReceived = prvNetworkRecv( &xTestCtx,
+                                        ssl->in_msg + xRecord,
+                                        MBEDTLS_SSL_IN_CONTENT_LEN - xRecord );
+            xRecord += ( size_t ) lReceived;
+        } while( 0 < lReceived );
+
+        if( xRecord > len )
+        {
+            xRecord = len;
+        }
+
+        memcpy( buf, ssl->in_msg, xRecord );
+        lResult = ( int ) xRecord;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_get_max_out_record_payload( const mbedtls_ssl_context * ssl )
+{
+    return ( int ) ( ssl->out_buf_len - ( size_t ) ( ssl->out_msg - ssl->out_buf ) );
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_flush_output( mbedtls_ssl_context * ssl )
+{
+    ssl->out_left = 0;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_write_record( mbedtls_ssl_context * ssl,
+                              uint8_t force_flush )
+{
+    int lResult = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+
+    ( void ) force_flush;
+
+    if( xWireLength + ssl->out_msglen <= TEST_WIRE_SIZE )
+    {
+        memcpy( ucWire + xWireLength, ssl->out_msg, ssl->out_msglen );
+        xWireLength += ssl->out_msglen;
+        lResult = 0;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_write( mbedtls_ssl_context * ssl,
+                       const unsigned char * buf,
+                       size_t len )
+{
+    int lResult = 0;
+    size_t xRoom = ( size_t ) mbedtls_ssl_get_max_out_record_payload( ssl );
+
+    if( len > xRoom )
+    {
+        len = xRoom;
+    }
+
+    if( len > xLargestWrite )
+    {
+        xLargestWrite = len;
+    }
+
+    /* Seal the record in place, as mbedTLS does. */
+    memcpy( ssl->out_msg, buf, len );
+    ssl->out_msglen = len;
+    ssl->out_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    lResult = mbedtls_ssl_write_record( ssl, 1U );
+
+    if( 0 == lResult )
+    {
+        lResult = ( int ) len;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sets up a context as mbedTLS leaves it after the handshake, then
+ * lets TLS_Connect() size its buffers.
+ *
+ * @param[in] ulOutContentLength Requested outgoing record size, or zero.
+ */
+static void prvConnect( uint32_t ulOutContentLength )
+{
+    mbedtls_ssl_context * pxSsl = &xTestCtx.xMbedSslCtx;
+
+    memset( &xTestCtx, 0, sizeof( xTestCtx ) );
+    xTestCtx.xTLSHandshakeState = TLS_HANDSHAKE_SUCCESSFUL;
+    xTestCtx.xNetworkRecv = prvTestNetworkRecv;
+    xTestCtx.ulOutContentLength = ulOutContentLength;
+
+    pxSsl->in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
+    pxSsl->in_buf = mbedtls_calloc( 1, pxSsl->in_buf_len );
+    pxSsl->out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+    pxSsl->out_buf = mbedtls_calloc( 1, pxSsl->out_buf_len );
+    mbedtls_ssl_reset_in_out_pointers( pxSsl );
+    pxSsl->in_msg = pxSsl->in_buf + TEST_MSG_OFFSET;
+    pxSsl->out_msg = pxSsl->out_buf + TEST_MSG_OFFSET;
+
+    /* Record counters and explicit IVs carry over from one record to the next. */
+    memcpy( pxSsl->in_buf, "inbound counter and IV", TEST_MSG_OFFSET );
+    memcpy( pxSsl->out_buf, "outbound counter & IV", TEST_MSG_OFFSET );
+
+    prvSetupRecordBuffers( &xTestCtx );
+
+    xWireLength = 0;
+    xLargestWrite = 0;
+    xFailAllocations = pdFALSE;
+    xBytesAvailable = 0;
+    lRecordsPending = 0;
+    xInboundLength = 0;
+    xInboundRead = 0;
+    ulNetworkReads = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDisconnect( void )
+{
+    mbedtls_free( xTestCtx.xMbedSslCtx.in_buf );
+    mbedtls_free( xTestCtx.xMbedSslCtx.out_buf );
+    memset( &xTestCtx, 0, sizeof( xTestCtx ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Checks that the state carried from record to record survived a resize.
+ */
+static BaseType_t prvRecordStateKept( void )
+{
+    const mbedtls_ssl_context * pxSsl = &xTestCtx.xMbedSslCtx;
+
+    return ( ( 0 == memcmp( pxSsl->in_buf, "inbound counter and IV", TEST_MSG_OFFSET ) ) &&
+             ( 0 == memcmp( pxSsl->out_buf, "outbound counter & IV", TEST_MSG_OFFSET ) ) &&
+             ( pxSsl->in_msg == pxSsl->in_buf + TEST_MSG_OFFSET ) &&
+             ( pxSsl->in_iv == pxSsl->in_buf + TEST_IV_OFFSET ) &&
+             ( pxSsl->out_msg == pxSsl->out_buf + TEST_MSG_OFFSET ) &&
+             ( pxSsl->out_iv == pxSsl->out_buf + TEST_IV_OFFSET ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends a message and checks it reached the wire whole.
+ */
+static BaseType_t prvSendMessage( void )
+{
+    static unsigned char ucMessage[ TEST_MESSAGE_LENGTH ];
+    size_t i;
+    size_t xSent = 0;
+    BaseType_t xResult = 0;
+
+    for( i = 0; i < sizeof( ucMessage ); i++ )
+    {
+        ucMessage[ i ] = ( unsigned char ) ( i * 7U );
+    }
+
+    xWireLength = 0;
+
+    while( ( 0 <= xResult ) && ( xSent < sizeof( ucMessage ) ) )
+    {
+        xResult = TLS_Send( &xTestCtx, ucMessage + xSent, sizeof( ucMessage ) - xSent );
+
+        if( 0 < xResult )
+        {
+            xSent += ( size_t ) xResult;
+        }
+    }
+
+    return ( ( xSent == sizeof( ucMessage ) ) &&
+             ( xWireLength == sizeof( ucMessage ) ) &&
+             ( 0 == memcmp( ucWire, ucMessage, sizeof( ucMessage ) ) ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief An idle connection keeps only the record state, and gets its
+ * buffers back on the next send.
+ */
+static void prvTestIdleReleasesBuffers( void )
+{
+    TLSMemoryUsage_t xUsage;
+    size_t xActiveHeap;
+
+    prvConnect( 0U );
+
+    TLS_GetMemoryUsage( &xTestCtx, &xUsage );
+    TEST_CHECK( MBEDTLS_SSL_IN_BUFFER_LEN == xUsage.xInBufferBytes );
+    TEST_CHECK( MBEDTLS_SSL_OUT_BUFFER_LEN == xUsage.xOutBufferBytes );
+    TEST_CHECK( pdFALSE == xUsage.xIdle );
+    TEST_CHECK( xUsage.xInBufferBytes + xUsage.xOutBufferBytes == xHeapBytes );
+    xActiveHeap = xHeapBytes;
+
+    TEST_CHECK( 0 == TLS_Idle( &xTestCtx ) );
+    TLS_GetMemoryUsage( &xTestCtx, &xUsage );
+    TEST_CHECK( TEST_MSG_OFFSET == xUsage.xInBufferBytes );
+    TEST_CHECK( TEST_MSG_OFFSET == xUsage.xOutBufferBytes );
+    TEST_CHECK( pdFALSE != xUsage.xIdle );
+    TEST_CHECK( xUsage.xInBufferBytes + xUsage.xOutBufferBytes == xHeapBytes );
+    TEST_CHECK( pdTRUE == prvRecordStateKept() );
+
+    printf( "Record buffer heap per connection: %u bytes active, %u bytes idle.\n",
+            ( unsigned ) xActiveHeap,
+            ( unsigned ) xHeapBytes );
+
+    /* Already idle. */
+    TEST_CHECK( 0 == TLS_Idle( &xTestCtx ) );
+    TEST_CHECK( 2U * TEST_MSG_OFFSET == xHeapBytes );
+
+    TEST_CHECK( pdTRUE == prvSendMessage() );
+    TLS_GetMemoryUsage( &xTestCtx, &xUsage );
+    TEST_CHECK( MBEDTLS_SSL_IN_BUFFER_LEN == xUsage.xInBufferBytes );
+    TEST_CHECK( MBEDTLS_SSL_OUT_BUFFER_LEN == xUsage.xOutBufferBytes );
+    TEST_CHECK( pdFALSE == xUsage.xIdle );
+    TEST_CHECK( xActiveHeap == xHeapBytes );
+    TEST_CHECK( pdTRUE == prvRecordStateKept() );
+
+    prvDisconnect();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Buffers holding data in either direction are kept.
+ */
+static void prvTestIdleKeepsPendingData( void )
+{
+    size_t xActiveHeap;
+
+    prvConnect( 0U );
+    xActiveHeap = xHeapBytes;
+
+    xTestCtx.xMbedSslCtx.out_left = 5U;
+    TEST_CHECK( 0 != TLS_Idle( &xTestCtx ) );
+    xTestCtx.xMbedSslCtx.out_left = 0U;
+
+    xTestCtx.xMbedSslCtx.in_left = 5U;
+    TEST_CHECK( 0 != TLS_Idle( &xTestCtx ) );
+    xTestCtx.xMbedSslCtx.in_left = 0U;
+
+    xBytesAvailable = 1U;
+    TEST_CHECK( 0 != TLS_Idle( &xTestCtx ) );
+    xBytesAvailable = 0U;
+
+    lRecordsPending = 1;
+    TEST_CHECK( 0 != TLS_Idle( &xTestCtx ) );
+    lRecordsPending = 0;
+
+    TEST_CHECK( xActiveHeap == xHeapBytes );
+    TEST_CHECK( pdFALSE == xTestCtx.xBuffersIdle );
+
+    TEST_CHECK( 0 == TLS_Idle( &xTestCtx ) );
+
+    prvDisconnect();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A send that cannot re-grow the buffers fails without harming the
+ * connection, and the next one goes through.
+ */
+static void prvTestRegrowOutOfMemory( void )
+{
+    unsigned char ucByte = 0x5AU;
+
+    prvConnect( 0U );
+    TEST_CHECK( 0 == TLS_Idle( &xTestCtx ) );
+
+    xFailAllocations = pdTRUE;
+    TEST_CHECK( MBEDTLS_ERR_SSL_ALLOC_FAILED == TLS_Send( &xTestCtx, &ucByte, 1U ) );
+    TEST_CHECK( TLS_HANDSHAKE_SUCCESSFUL == xTestCtx.xTLSHandshakeState );
+    TEST_CHECK( pdFALSE != xTestCtx.xBuffersIdle );
+    TEST_CHECK( 2U * TEST_MSG_OFFSET == xHeapBytes );
+    TEST_CHECK( pdTRUE == prvRecordStateKept() );
+    TEST_CHECK( 0U == xWireLength );
+
+    xFailAllocations = pdFALSE;
+    TEST_CHECK( pdTRUE == prvSendMessage() );
+    TEST_CHECK( pdFALSE == xTestCtx.xBuffersIdle );
+
+    prvDisconnect();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A smaller outgoing record size shrinks the send buffer for the
+ * whole connection, and it comes back at that size after idling.
+ */
+static void prvTestSmallerSendBuffer( void )
+{
+    TLSMemoryUsage_t xUsage;
+
+    prvConnect( 1024U );
+
+    TLS_GetMemoryUsage( &xTestCtx, &xUsage );
+    TEST_CHECK( 1024U + MBEDTLS_SSL_RECORD_OVERHEAD == xUsage.xOutBufferBytes );
+    TEST_CHECK( 1024U == xTestCtx.xOutContentLength );
+
+    TEST_CHECK( 0 == TLS_Idle( &xTestCtx ) );
+    TEST_CHECK( pdTRUE == prvSendMessage() );
+    TEST_CHECK( 1024U >= xLargestWrite );
+
+    TLS_GetMemoryUsage( &xTestCtx, &xUsage );
+    TEST_CHECK( 1024U + MBEDTLS_SSL_RECORD_OVERHEAD == xUsage.xOutBufferBytes );
+    TEST_CHECK( pdTRUE == prvRecordStateKept() );
+
+    prvDisconnect();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Polling an idle connection leaves it idle until data arrives, and
+ * the data then reaches the reader whole.
+ */
+static void prvTestIdleRecv( void )
+{
+    unsigned char ucBuffer[ 64 ];
+    size_t xActiveHeap;
+
+    prvConnect( 0U );
+    xActiveHeap = xHeapBytes;
+    TEST_CHECK( 0 == TLS_Recv( &xTestCtx, ucBuffer, sizeof( ucBuffer ) ) );
+    TEST_CHECK( 0 == TLS_Idle( &xTestCtx ) );
+    ulNetworkReads = 0U;
+
+    TEST_CHECK( 0 == TLS_Recv( &xTestCtx, ucBuffer, sizeof( ucBuffer ) ) );
+    TEST_CHECK( 0 == TLS_Recv( &xTestCtx, ucBuffer, sizeof( ucBuffer ) ) );
+    TEST_CHECK( 2U == ulNetworkReads );
+    TEST_CHECK( pdFALSE != xTestCtx.xBuffersIdle );
+    TEST_CHECK( 2U * TEST_MSG_OFFSET == xHeapBytes );
+
+    memcpy( ucInbound, "hello, idle connection", 22U );
+    xInboundLength = 22U;
+    TEST_CHECK( 22 == TLS_Recv( &xTestCtx, ucBuffer, sizeof( ucBuffer ) ) );
+    TEST_CHECK( 0 == memcmp( ucBuffer, "hello, idle connection", 22U ) );
+    TEST_CHECK( pdFALSE == xTestCtx.xBuffersIdle );
+    TEST_CHECK( xActiveHeap == xHeapBytes );
+    TEST_CHECK( pdTRUE == prvRecordStateKept() );
+
+    /* Data that wakes the connection while memory is short waits for it. */
+    TEST_CHECK( 0 == TLS_Idle( &xTestCtx ) );
+    memcpy( ucInbound, "second", 6U );
+    xInboundLength = 6U;
+    xInboundRead = 0U;
+    xFailAllocations = pdTRUE;
+    TEST_CHECK( MBEDTLS_ERR_SSL_ALLOC_FAILED == TLS_Recv( &xTestCtx, ucBuffer, sizeof( ucBuffer ) ) );
+    TEST_CHECK( TLS_HANDSHAKE_SUCCESSFUL == xTestCtx.xTLSHandshakeState );
+    TEST_CHECK( 2U * TEST_MSG_OFFSET == xHeapBytes );
+    xFailAllocations = pdFALSE;
+    TEST_CHECK( 6 == TLS_Recv( &xTestCtx, ucBuffer, sizeof( ucBuffer ) ) );
+    TEST_CHECK( 0 == memcmp( ucBuffer, "second", 6U ) );
+    TEST_CHECK( xActiveHeap == xHeapBytes );
+
+    prvDisconnect();
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    prvTestIdleReleasesBuffers();
+    prvTestIdleKeepsPendingData();
+    prvTestRegrowOutOfMemory();
+    prvTestSmallerSendBuffer();
+    prvTestIdleRecv();
+
+    TEST_CHECK( 0U == xHeapBytes );
+
+    if( 0U == ulFailures )
+    {
+        printf( "PASS\n" );
+    }
+
+    return ( 0U == ulFailures ) ? 0 : 1;
+}
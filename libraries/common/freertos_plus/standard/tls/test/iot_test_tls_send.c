@@ -0,0 +1,468 @@
+/*
+ * FreeRTOS TLS V1.3.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_test_tls_send.c
+ * @brief Host test of TLS_Send() and TLS_SendV() on a network that blocks.
+ *
+ * The context starts with its handshake complete. The record layer of mbedTLS
+ * is faked: records are sealed without encryption behind a 5 byte header, and
+ * mbedtls_ssl_write() keeps the leftover of a record for a retry of the same
+ * data, as mbedTLS does. The network takes a set number of bytes and then
+ * would block. The records that reach it are parsed back and their payload
+ * must be every byte sent, once, in order.
+ * Build and run from this directory with:
+ *
+ *   gcc -std=c99 -Wall -Wextra -Wno-unused-parameter -g \
+ *       -fsanitize=address,undefined -Istubs -I../include \
+ *       -I../../crypto/include -I../../utils/include \
+ *       -I../../../../c_sdk/standard/common/include/private \
+ *       -I../../../../../3rdparty/mbedtls_utils -I../../../../../../demos/include \
+ *       iot_test_tls_send.c stubs/tls_stubs.c \
+ *       -o iot_test_tls_send && ./iot_test_tls_send
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The module is included to reach its context structure. */
+#include "../src/iot_tls.c"
+
+#define TEST_HEADER_LENGTH    ( 5U )
+#define TEST_MAX_PAYLOAD      ( 16U )
+#define TEST_WIRE_SIZE        ( 256U * 1024U )
+#define TEST_MESSAGES         ( 3000U )
+#define TEST_MAX_MESSAGE      ( 60U )
+#define TEST_MAX_VECTORS      ( 4U )
+#define TEST_MAX_ATTEMPTS     ( 1000U )
+#define TEST_UNLIMITED        ( TEST_WIRE_SIZE )
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+static uint32_t ulFailures = 0;
+
+static TLSContext_t xTestCtx;
+static unsigned char ucOutBuf[ TEST_HEADER_LENGTH + TEST_MAX_PAYLOAD ];
+static size_t xRecordLength = 0; /* Header and payload of the sealed record. */
+
+static unsigned char ucWire[ TEST_WIRE_SIZE ];
+static size_t xWireLength = 0;
+static size_t xBudget = 0; /* Bytes the network takes before it would block. */
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvTestNetworkSend( void * pvCallerContext,
+                                      const unsigned char * pucData,
+                                      size_t xDataLength )
+{
+    BaseType_t xResult = -pdFREERTOS_ERRNO_ENOSPC;
+
+    ( void ) pvCallerContext;
+
+    if( xDataLength > xBudget )
+    {
+        xDataLength = xBudget;
+    }
+
+    if( ( 0U != xDataLength ) && ( xWireLength + xDataLength <= TEST_WIRE_SIZE ) )
+    {
+        memcpy( ucWire + xWireLength, pucData, xDataLength );
+        xWireLength += xDataLength;
+        xBudget -= xDataLength;
+        xResult = ( BaseType_t ) xDataLength;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_get_max_out_record_payload( const mbedtls_ssl_context * ssl )
+{
+    ( void ) ssl;
+
+    return ( int ) TEST_MAX_PAYLOAD;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_flush_output( mbedtls_ssl_context * ssl )
+{
+    int lResult = 0;
+
+    while( 0U != ssl->out_left )
+    {
+        lResult = prvNetworkSend( &xTestCtx,
+                                  ssl->out_buf + xRecordLength - ssl->out_left,
+                                  ssl->out_left );
+
+        if( 0 >= lResult )
+        {
+            break;
+        }
+
+        ssl->out_left -= ( size_t ) lResult;
+        lResult = 0;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_write_record( mbedtls_ssl_context * ssl,
+                              uint8_t force_flush )
+{
+    ( void ) force_flush;
+
+    ssl->out_buf[ 0 ] = ( unsigned char ) ssl->out_msgtype;
+    ssl->out_buf[ 1 ] = 3;
+    ssl->out_buf[ 2 ] = 3;
+    ssl->out_buf[ 3 ] = ( unsigned char ) ( ssl->out_msglen >> 8 );
+    ssl->out_buf[ 4 ] = ( unsigned char ) ssl->out_msglen;
+    xRecordLength = TEST_HEADER_LENGTH + ssl->out_msglen;
+    ssl->out_left = xRecordLength;
+
+    return mbedtls_ssl_flush_output( ssl );
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_write( mbedtls_ssl_context * ssl,
+                       const unsigned char * buf,
+                       size_t len )
+{
+    int lResult = 0;
+
+    if( len > TEST_MAX_PAYLOAD )
+    {
+        len = TEST_MAX_PAYLOAD;
+    }
+
+    if( 0U != ssl->out_left )
+    {
+        /* A retry: the data is taken to be that of the sealed record. */
+        lResult = mbedtls_ssl_flush_output( ssl );
+    }
+    else
+    {
+        memcpy( ssl->out_msg, buf, len );
+        ssl->out_msglen = len;
+        ssl->out_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+        lResult = mbedtls_ssl_write_record( ssl, 1U );
+    }
+
+    if( 0 == lResult )
+    {
+        lResult = ( int ) len;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_ssl_read( mbedtls_ssl_context * ssl,
+                      unsigned char * buf,
+                      size_t len )
+{
+    ( void ) ssl;
+    ( void ) buf;
+    ( void ) len;
+
+    /* Not used by these tests. */
+    return -1;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvResetContext( void )
+{
+    memset( &xTestCtx, 0, sizeof( xTestCtx ) );
+    xTestCtx.xTLSHandshakeState = TLS_HANDSHAKE_SUCCESSFUL;
+    xTestCtx.xNetworkSend = prvTestNetworkSend;
+    xTestCtx.xMbedSslCtx.out_buf = ucOutBuf;
+    xTestCtx.xMbedSslCtx.out_msg = ucOutBuf + TEST_HEADER_LENGTH;
+    xTestCtx.xOutContentLength = TEST_MAX_PAYLOAD;
+    xRecordLength = 0;
+    xWireLength = 0;
+    xBudget = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Checks that the records on the wire carry exactly the given bytes.
+ */
+static BaseType_t prvWireCarries( const unsigned char * pucExpected,
+                                  size_t xExpectedLength )
+{
+    BaseType_t xResult = pdTRUE;
+    size_t xWire = 0;
+    size_t xPlain = 0;
+    size_t xLength = 0;
+
+    while( ( pdTRUE == xResult ) && ( xWire < xWireLength ) )
+    {
+        if( xWire + TEST_HEADER_LENGTH > xWireLength )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            xLength = ( ( size_t ) ucWire[ xWire + 3U ] << 8 ) | ucWire[ xWire + 4U ];
+
+            if( ( MBEDTLS_SSL_MSG_APPLICATION_DATA != ucWire[ xWire ] ) ||
+                ( 0U == xLength ) ||
+                ( xLength > TEST_MAX_PAYLOAD ) ||
+                ( xWire + TEST_HEADER_LENGTH + xLength > xWireLength ) ||
+                ( xPlain + xLength > xExpectedLength ) ||
+                ( 0 != memcmp( ucWire + xWire + TEST_HEADER_LENGTH, pucExpected + xPlain, xLength ) ) )
+            {
+                xResult = pdFALSE;
+            }
+
+            xWire += TEST_HEADER_LENGTH + xLength;
+            xPlain += xLength;
+        }
+    }
+
+    if( xPlain != xExpectedLength )
+    {
+        xResult = pdFALSE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A short TLS_SendV(), then a TLS_Send() of other data that has to
+ * wait, first while the vector record is still leaving and then after it
+ * has left, then both retries.
+ */
+static void prvTestSendWaitsForSendVRetry( void )
+{
+    static const unsigned char ucExpected[] = "AAAAAAAABBBBCCCCCC";
+    TLSIoVector_t xVectors[ 2 ] =
+    {
+        { ucExpected,      8U },
+        { ucExpected + 8U, 4U }
+    };
+    const unsigned char * pucSend = ucExpected + 12U;
+
+    prvResetContext();
+
+    /* The 17 byte record of the vectors leaves 10 bytes. */
+    xBudget = 10U;
+    TEST_CHECK( 0 == TLS_SendV( &xTestCtx, xVectors, 2U ) );
+
+    /* The rest of it leaves, but no new record may be sealed. */
+    xBudget = 10U;
+    TEST_CHECK( 0 == TLS_Send( &xTestCtx, pucSend, 6U ) );
+    TEST_CHECK( 0U == xTestCtx.xMbedSslCtx.out_left );
+    TEST_CHECK( 17U == xWireLength );
+
+    xBudget = TEST_UNLIMITED;
+    TEST_CHECK( 0 == TLS_Send( &xTestCtx, pucSend, 6U ) );
+    TEST_CHECK( 17U == xWireLength );
+
+    TEST_CHECK( 12 == TLS_SendV( &xTestCtx, xVectors, 2U ) );
+    TEST_CHECK( 6 == TLS_Send( &xTestCtx, pucSend, 6U ) );
+
+    TEST_CHECK( pdTRUE == prvWireCarries( ucExpected, 18U ) );
+    TEST_CHECK( 18U == xTestCtx.xWriteMetrics.ulBytesSent );
+    TEST_CHECK( 2U == xTestCtx.xWriteMetrics.ulRecordsSent );
+    TEST_CHECK( 2U == xTestCtx.xWriteMetrics.ulMessagesSent );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A short TLS_Send(), then a TLS_SendV() that has to wait for its
+ * retry.
+ */
+static void prvTestSendVWaitsForSendRetry( void )
+{
+    static const unsigned char ucExpected[] = "AAAAAAAAAAAAAAAAAABBBB";
+    TLSIoVector_t xVector = { ucExpected + 18U, 4U };
+
+    prvResetContext();
+
+    /* The first record leaves, the second only in part. */
+    xBudget = 23U;
+    TEST_CHECK( 16 == TLS_Send( &xTestCtx, ucExpected, 18U ) );
+
+    xBudget = TEST_UNLIMITED;
+    TEST_CHECK( 0 == TLS_SendV( &xTestCtx, &xVector, 1U ) );
+    TEST_CHECK( 2 == TLS_Send( &xTestCtx, ucExpected + 16U, 2U ) );
+    TEST_CHECK( 4 == TLS_SendV( &xTestCtx, &xVector, 1U ) );
+
+    TEST_CHECK( pdTRUE == prvWireCarries( ucExpected, 22U ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Random messages through both calls over a network that takes a
+ * random number of bytes at a time. A caller that was sent short retries
+ * with the rest, at times after trying to write other data with the other
+ * call, which must send nothing.
+ */
+static void prvTestRandomMix( void )
+{
+    static unsigned char ucExpected[ TEST_MESSAGES * TEST_MAX_MESSAGE ];
+    static const unsigned char ucOther[ TEST_MAX_MESSAGE ] = { 0 };
+    TLSIoVector_t xOtherVector = { ucOther, TEST_MAX_MESSAGE };
+    TLSIoVector_t xVectors[ TEST_MAX_VECTORS ];
+    TLSIoVector_t xRest[ TEST_MAX_VECTORS ];
+    size_t xVectorCount = 0;
+    size_t xRestCount = 0;
+    size_t xTotal = 0;
+    size_t xLength = 0;
+    size_t xSent = 0;
+    size_t xSkip = 0;
+    size_t i = 0;
+    uint32_t ulMessage = 0;
+    uint32_t ulAttempts = 0;
+    BaseType_t xVectored = pdFALSE;
+    BaseType_t xResult = 0;
+
+    prvResetContext();
+    srand( 7 );
+
+    for( ulMessage = 0; ( ulMessage < TEST_MESSAGES ) && ( 0U == ulFailures ); ulMessage++ )
+    {
+        xLength = 1U + ( ( size_t ) rand() % TEST_MAX_MESSAGE );
+
+        for( i = 0; i < xLength; i++ )
+        {
+            ucExpected[ xTotal + i ] = ( unsigned char ) rand();
+        }
+
+        /* Split vectored messages at random points, empty vectors included. */
+        xVectored = ( 0 == ( rand() % 2 ) ) ? pdTRUE : pdFALSE;
+        xVectorCount = 1U + ( ( size_t ) rand() % TEST_MAX_VECTORS );
+        xSkip = 0;
+
+        for( i = 0; i < xVectorCount; i++ )
+        {
+            xVectors[ i ].pvBase = ucExpected + xTotal + xSkip;
+            xVectors[ i ].xLength = ( i + 1U == xVectorCount ) ? ( xLength - xSkip ) :
+                                    ( ( size_t ) rand() % ( xLength - xSkip + 1U ) );
+            xSkip += xVectors[ i ].xLength;
+        }
+
+        xSent = 0;
+        ulAttempts = 0;
+
+        while( ( xSent < xLength ) && ( ulAttempts < TEST_MAX_ATTEMPTS ) )
+        {
+            if( ( 0U != ulAttempts ) && ( 0 == ( rand() % 3 ) ) )
+            {
+                xBudget = ( size_t ) rand() % 40U;
+
+                if( pdTRUE == xVectored )
+                {
+                    TEST_CHECK( 0 == TLS_Send( &xTestCtx, ucOther, TEST_MAX_MESSAGE ) );
+                }
+                else
+                {
+                    TEST_CHECK( 0 == TLS_SendV( &xTestCtx, &xOtherVector, 1U ) );
+                }
+            }
+
+            xBudget = ( size_t ) rand() % 40U;
+
+            if( pdTRUE == xVectored )
+            {
+                /* The vectors less what was reported as sent. */
+                xSkip = xSent;
+                xRestCount = 0;
+
+                for( i = 0; i < xVectorCount; i++ )
+                {
+                    if( xSkip >= xVectors[ i ].xLength )
+                    {
+                        xSkip -= xVectors[ i ].xLength;
+                    }
+                    else
+                    {
+                        xRest[ xRestCount ].pvBase = ( const unsigned char * ) xVectors[ i ].pvBase + xSkip;
+                        xRest[ xRestCount ].xLength = xVectors[ i ].xLength - xSkip;
+                        xRestCount++;
+                        xSkip = 0;
+                    }
+                }
+
+                xResult = TLS_SendV( &xTestCtx, xRest, xRestCount );
+            }
+            else
+            {
+                xResult = TLS_Send( &xTestCtx, ucExpected + xTotal + xSent, xLength - xSent );
+            }
+
+            TEST_CHECK( ( 0 <= xResult ) && ( ( size_t ) xResult <= xLength - xSent ) );
+
+            if( 0 < xResult )
+            {
+                xSent += ( size_t ) xResult;
+            }
+
+            ulAttempts++;
+        }
+
+        TEST_CHECK( xSent == xLength );
+        xTotal += xLength;
+    }
+
+    TEST_CHECK( pdTRUE == prvWireCarries( ucExpected, xTotal ) );
+    TEST_CHECK( xTotal == xTestCtx.xWriteMetrics.ulBytesSent );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    prvTestSendWaitsForSendVRetry();
+    prvTestSendVWaitsForSendRetry();
+    prvTestRandomMix();
+
+    if( 0U == ulFailures )
+    {
+        printf( "PASS\n" );
+    }
+
+    return ( 0U == ulFailures ) ? 0 : 1;
+}
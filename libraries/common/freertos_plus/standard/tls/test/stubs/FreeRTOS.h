@@ -0,0 +1,40 @@
+/*
+ * Host build stand-in for FreeRTOS.h, used by the TLS tests.
+ *
+ * Only what iot_tls.c uses is provided; see tls_stubs.c.
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long             BaseType_t;
+typedef unsigned long    UBaseType_t;
+typedef uint32_t         TickType_t;
+
+#define pdFALSE                    ( ( BaseType_t ) 0 )
+#define pdTRUE                     ( ( BaseType_t ) 1 )
+#define pdFAIL                     ( pdFALSE )
+#define pdPASS                     ( pdTRUE )
+
+#define portMAX_DELAY              ( ( TickType_t ) 0xffffffffUL )
+#define portTICK_PERIOD_MS         ( ( TickType_t ) 1 )
+#define pdMS_TO_TICKS( xTimeInMs )    ( ( TickType_t ) ( xTimeInMs ) )
+
+#define pdFREERTOS_ERRNO_NONE      0
+#define pdFREERTOS_ERRNO_ENOSPC    28
+
+#define configASSERT( x )    assert( x )
+#define configPRINTF( X )    vLoggingPrintf X
+
+void * pvPortMalloc( size_t xWantedSize );
+
+void vPortFree( void * pv );
+
+void vLoggingPrintf( const char * pcFormat,
+                     ... );
+
+#endif /* INC_FREERTOS_H */
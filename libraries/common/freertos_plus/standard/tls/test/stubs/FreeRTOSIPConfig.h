@@ -0,0 +1,3 @@
+/*
+ * Host build stand-in for FreeRTOSIPConfig.h, used by the TLS tests.
+ */
@@ -0,0 +1,113 @@
+/*
+ * Host build stand-in for core_pkcs11.h, used by the TLS tests.
+ *
+ * Only the types, constants and calls that iot_tls.c uses are provided.
+ */
+
+#ifndef CORE_PKCS11_H_
+#define CORE_PKCS11_H_
+
+typedef unsigned long   CK_RV;
+typedef unsigned long   CK_ULONG;
+typedef unsigned long   CK_SESSION_HANDLE;
+typedef unsigned long   CK_OBJECT_HANDLE;
+typedef unsigned long   CK_KEY_TYPE;
+typedef unsigned long   CK_OBJECT_CLASS;
+typedef unsigned long   CK_MECHANISM_TYPE;
+typedef unsigned long   CK_ATTRIBUTE_TYPE;
+typedef unsigned long   CK_USER_TYPE;
+typedef unsigned char   CK_BYTE;
+typedef unsigned char   CK_UTF8CHAR;
+typedef CK_BYTE *       CK_BYTE_PTR;
+typedef CK_UTF8CHAR *   CK_UTF8CHAR_PTR;
+typedef CK_ULONG *      CK_ULONG_PTR;
+typedef CK_OBJECT_HANDLE * CK_OBJECT_HANDLE_PTR;
+
+typedef struct CK_ATTRIBUTE
+{
+    CK_ATTRIBUTE_TYPE type;
+    void * pValue;
+    CK_ULONG ulValueLen;
+} CK_ATTRIBUTE;
+
+typedef struct CK_MECHANISM
+{
+    CK_MECHANISM_TYPE mechanism;
+    void * pParameter;
+    CK_ULONG ulParameterLen;
+} CK_MECHANISM;
+
+typedef struct CK_FUNCTION_LIST
+{
+    CK_RV ( * C_Finalize )( void * pReserved );
+    CK_RV ( * C_CloseSession )( CK_SESSION_HANDLE hSession );
+    CK_RV ( * C_Login )( CK_SESSION_HANDLE hSession,
+                         CK_USER_TYPE userType,
+                         CK_UTF8CHAR_PTR pPin,
+                         CK_ULONG ulPinLen );
+    CK_RV ( * C_Logout )( CK_SESSION_HANDLE hSession );
+    CK_RV ( * C_GetAttributeValue )( CK_SESSION_HANDLE hSession,
+                                     CK_OBJECT_HANDLE hObject,
+                                     CK_ATTRIBUTE * pTemplate,
+                                     CK_ULONG ulCount );
+    CK_RV ( * C_SignInit )( CK_SESSION_HANDLE hSession,
+                            CK_MECHANISM * pMechanism,
+                            CK_OBJECT_HANDLE hKey );
+    CK_RV ( * C_Sign )( CK_SESSION_HANDLE hSession,
+                        CK_BYTE_PTR pData,
+                        CK_ULONG ulDataLen,
+                        CK_BYTE_PTR pSignature,
+                        CK_ULONG_PTR pulSignatureLen );
+} CK_FUNCTION_LIST;
+
+typedef CK_FUNCTION_LIST *      CK_FUNCTION_LIST_PTR;
+typedef CK_FUNCTION_LIST_PTR *  CK_FUNCTION_LIST_PTR_PTR;
+
+typedef CK_RV ( * CK_C_GetFunctionList )( CK_FUNCTION_LIST_PTR_PTR ppFunctionList );
+
+#define CK_INVALID_HANDLE                     ( 0UL )
+
+#define CKR_OK                                ( 0x000UL )
+#define CKR_HOST_MEMORY                       ( 0x002UL )
+#define CKR_FUNCTION_FAILED                   ( 0x006UL )
+#define CKR_ARGUMENTS_BAD                     ( 0x007UL )
+#define CKR_ATTRIBUTE_VALUE_INVALID           ( 0x013UL )
+#define CKR_KEY_HANDLE_INVALID                ( 0x060UL )
+#define CKR_OBJECT_HANDLE_INVALID             ( 0x082UL )
+#define CKR_SESSION_CLOSED                    ( 0x0B0UL )
+#define CKR_SESSION_HANDLE_INVALID            ( 0x0B3UL )
+#define CKR_USER_ALREADY_LOGGED_IN            ( 0x100UL )
+#define CKR_CRYPTOKI_NOT_INITIALIZED          ( 0x190UL )
+#define CKR_CRYPTOKI_ALREADY_INITIALIZED      ( 0x191UL )
+
+#define CKA_VALUE                             ( 0x011UL )
+#define CKA_KEY_TYPE                          ( 0x100UL )
+#define CKO_CERTIFICATE                       ( 0x001UL )
+#define CKO_PRIVATE_KEY                       ( 0x003UL )
+#define CKK_RSA                               ( 0x000UL )
+#define CKK_EC                                ( 0x003UL )
+#define CKM_RSA_PKCS                          ( 0x001UL )
+#define CKM_ECDSA                             ( 0x1041UL )
+#define CKU_USER                              ( 1UL )
+
+#define pkcs11RSA_SIGNATURE_INPUT_LENGTH      51
+#define pkcs11ECDSA_P256_SIGNATURE_LENGTH     64
+
+CK_RV C_GetFunctionList( CK_FUNCTION_LIST_PTR_PTR ppFunctionList );
+
+CK_RV C_GenerateRandom( CK_SESSION_HANDLE hSession,
+                        CK_BYTE_PTR RandomData,
+                        CK_ULONG ulRandomLen );
+
+CK_RV xInitializePkcs11Session( CK_SESSION_HANDLE * pxSession );
+
+CK_RV xFindObjectWithLabelAndClass( CK_SESSION_HANDLE xSession,
+                                    char * pcLabelName,
+                                    CK_ULONG ulLabelNameLen,
+                                    CK_OBJECT_CLASS xClass,
+                                    CK_OBJECT_HANDLE_PTR pxHandle );
+
+CK_RV vAppendSHA256AlgorithmIdentifierSequence( const uint8_t * puc32ByteHashedMessage,
+                                                uint8_t * puc51ByteHashOidBuffer );
+
+#endif /* CORE_PKCS11_H_ */
@@ -0,0 +1,13 @@
+/*
+ * Host build stand-in for core_pkcs11_config.h, used by the TLS tests.
+ */
+
+#ifndef CORE_PKCS11_CONFIG_H_
+#define CORE_PKCS11_CONFIG_H_
+
+#define configPKCS11_DEFAULT_USER_PIN                    "0000"
+#define pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS     "Device Priv TLS Key"
+#define pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS     "Device Cert"
+#define pkcs11configLABEL_JITP_CERTIFICATE               "JITP Cert"
+
+#endif /* CORE_PKCS11_CONFIG_H_ */
@@ -0,0 +1,14 @@
+/*
+ * Host build stand-in for core_pki_utils.h, used by the TLS tests.
+ */
+
+#ifndef CORE_PKI_UTILS_H_
+#define CORE_PKI_UTILS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+int8_t PKI_pkcs11SignatureTombedTLSSignature( uint8_t * pucSig,
+                                              size_t * pxSigLen );
+
+#endif /* CORE_PKI_UTILS_H_ */
@@ -0,0 +1,211 @@
+/*
+ * Host build stand-in for the mbedTLS headers, used by the TLS tests.
+ *
+ * Only the types, fields and calls that iot_tls.c uses are provided. Every
+ * other mbedtls/ header used by iot_tls.c includes this one. A test that
+ * defines MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH gets the record buffer lengths
+ * and calls of that option, and provides those calls itself.
+ */
+
+#ifndef MBEDTLS_SSL_H
+#define MBEDTLS_SSL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sizes of mbedTLS 2.x with aws_mbedtls_config.h: 8 byte counter and 5 byte
+ * header, then up to 16 bytes of IV, 32 of SHA-256 MAC and 256 of CBC
+ * padding around the content. */
+#define MBEDTLS_SSL_IN_CONTENT_LEN           8192
+#define MBEDTLS_SSL_OUT_CONTENT_LEN          4096
+#define MBEDTLS_SSL_RECORD_OVERHEAD          ( 13 + 16 + 32 + 256 )
+#define MBEDTLS_SSL_IN_BUFFER_LEN            ( MBEDTLS_SSL_IN_CONTENT_LEN + MBEDTLS_SSL_RECORD_OVERHEAD )
+#define MBEDTLS_SSL_OUT_BUFFER_LEN           ( MBEDTLS_SSL_OUT_CONTENT_LEN + MBEDTLS_SSL_RECORD_OVERHEAD )
+
+#define MBEDTLS_SSL_MSG_APPLICATION_DATA     23
+
+#define MBEDTLS_SSL_IS_CLIENT                0
+#define MBEDTLS_SSL_TRANSPORT_STREAM         0
+#define MBEDTLS_SSL_PRESET_DEFAULT           0
+#define MBEDTLS_SSL_VERIFY_REQUIRED          2
+
+#define MBEDTLS_ERR_SSL_WANT_READ            -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE           -0x6880
+#define MBEDTLS_ERR_SSL_INTERNAL_ERROR       -0x6C00
+#define MBEDTLS_ERR_SSL_ALLOC_FAILED         -0x7F00
+#define MBEDTLS_ERR_ENTROPY_SOURCE_FAILED    -0x003C
+#define MBEDTLS_X509_BADCERT_EXPIRED         0x01
+
+typedef enum
+{
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256
+} mbedtls_md_type_t;
+
+typedef enum
+{
+    MBEDTLS_PK_NONE = 0,
+    MBEDTLS_PK_RSA,
+    MBEDTLS_PK_ECKEY
+} mbedtls_pk_type_t;
+
+typedef struct mbedtls_x509_time
+{
+    int year, mon, day;
+} mbedtls_x509_time;
+
+typedef struct mbedtls_x509_crt
+{
+    mbedtls_x509_time valid_to;
+    struct mbedtls_x509_crt * next;
+} mbedtls_x509_crt;
+
+typedef struct mbedtls_pk_info_t
+{
+    int ( * sign_func )( void * ctx,
+                         mbedtls_md_type_t md_alg,
+                         const unsigned char * hash,
+                         size_t hash_len,
+                         unsigned char * sig,
+                         size_t * sig_len,
+                         int ( * f_rng )( void *, unsigned char *, size_t ),
+                         void * p_rng );
+} mbedtls_pk_info_t;
+
+typedef struct mbedtls_pk_context
+{
+    const mbedtls_pk_info_t * pk_info;
+    void * pk_ctx;
+} mbedtls_pk_context;
+
+typedef struct mbedtls_ctr_drbg_context
+{
+    int unused;
+} mbedtls_ctr_drbg_context;
+
+typedef struct mbedtls_ssl_config
+{
+    int unused;
+} mbedtls_ssl_config;
+
+typedef struct mbedtls_ssl_context
+{
+    unsigned char * in_buf;
+    #if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+        size_t in_buf_len;
+    #endif
+    unsigned char * in_len;
+    unsigned char * in_iv;
+    unsigned char * in_msg;
+    size_t in_left;
+
+    unsigned char * out_buf;
+    #if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+        size_t out_buf_len;
+    #endif
+    unsigned char * out_len;
+    unsigned char * out_iv;
+    unsigned char * out_msg;
+    int out_msgtype;
+    size_t out_msglen;
+    size_t out_left;
+} mbedtls_ssl_context;
+
+typedef int mbedtls_ssl_send_t( void * ctx,
+                                const unsigned char * buf,
+                                size_t len );
+typedef int mbedtls_ssl_recv_t( void * ctx,
+                                unsigned char * buf,
+                                size_t len );
+typedef int mbedtls_ssl_recv_timeout_t( void * ctx,
+                                        unsigned char * buf,
+                                        size_t len,
+                                        uint32_t timeout );
+
+void * mbedtls_calloc( size_t n,
+                       size_t size );
+void mbedtls_free( void * ptr );
+void mbedtls_platform_zeroize( void * buf,
+                               size_t len );
+
+void mbedtls_ctr_drbg_init( mbedtls_ctr_drbg_context * ctx );
+void mbedtls_ctr_drbg_free( mbedtls_ctr_drbg_context * ctx );
+int mbedtls_ctr_drbg_seed( mbedtls_ctr_drbg_context * ctx,
+                           int ( * f_entropy )( void *, unsigned char *, size_t ),
+                           void * p_entropy,
+                           const unsigned char * custom,
+                           size_t len );
+int mbedtls_ctr_drbg_random( void * p_rng,
+                             unsigned char * output,
+                             size_t output_len );
+
+void mbedtls_x509_crt_init( mbedtls_x509_crt * crt );
+void mbedtls_x509_crt_free( mbedtls_x509_crt * crt );
+int mbedtls_x509_crt_parse( mbedtls_x509_crt * chain,
+                            const unsigned char * buf,
+                            size_t buflen );
+
+void mbedtls_pk_init( mbedtls_pk_context * ctx );
+void mbedtls_pk_free( mbedtls_pk_context * ctx );
+int mbedtls_pk_parse_key( mbedtls_pk_context * ctx,
+                          const unsigned char * key,
+                          size_t keylen,
+                          const unsigned char * pwd,
+                          size_t pwdlen );
+const mbedtls_pk_info_t * mbedtls_pk_info_from_type( mbedtls_pk_type_t pk_type );
+
+void mbedtls_ssl_config_init( mbedtls_ssl_config * conf );
+void mbedtls_ssl_config_free( mbedtls_ssl_config * conf );
+int mbedtls_ssl_config_defaults( mbedtls_ssl_config * conf,
+                                 int endpoint,
+                                 int transport,
+                                 int preset );
+void mbedtls_ssl_conf_authmode( mbedtls_ssl_config * conf,
+                                int authmode );
+void mbedtls_ssl_conf_verify( mbedtls_ssl_config * conf,
+                              int ( * f_vrfy )( void *, mbedtls_x509_crt *, int, uint32_t * ),
+                              void * p_vrfy );
+void mbedtls_ssl_conf_rng( mbedtls_ssl_config * conf,
+                           int ( * f_rng )( void *, unsigned char *, size_t ),
+                           void * p_rng );
+void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config * conf,
+                                mbedtls_x509_crt * ca_chain,
+                                void * ca_crl );
+int mbedtls_ssl_conf_own_cert( mbedtls_ssl_config * conf,
+                               mbedtls_x509_crt * own_cert,
+                               mbedtls_pk_context * pk_key );
+int mbedtls_ssl_conf_alpn_protocols( mbedtls_ssl_config * conf,
+                                     const char ** protos );
+
+void mbedtls_ssl_init( mbedtls_ssl_context * ssl );
+void mbedtls_ssl_free( mbedtls_ssl_context * ssl );
+int mbedtls_ssl_setup( mbedtls_ssl_context * ssl,
+                       const mbedtls_ssl_config * conf );
+int mbedtls_ssl_set_hostname( mbedtls_ssl_context * ssl,
+                              const char * hostname );
+void mbedtls_ssl_set_bio( mbedtls_ssl_context * ssl,
+                          void * p_bio,
+                          mbedtls_ssl_send_t * f_send,
+                          mbedtls_ssl_recv_t * f_recv,
+                          mbedtls_ssl_recv_timeout_t * f_recv_timeout );
+int mbedtls_ssl_handshake( mbedtls_ssl_context * ssl );
+int mbedtls_ssl_read( mbedtls_ssl_context * ssl,
+                      unsigned char * buf,
+                      size_t len );
+int mbedtls_ssl_write( mbedtls_ssl_context * ssl,
+                       const unsigned char * buf,
+                       size_t len );
+int mbedtls_ssl_close_notify( mbedtls_ssl_context * ssl );
+size_t mbedtls_ssl_get_bytes_avail( const mbedtls_ssl_context * ssl );
+int mbedtls_ssl_check_pending( const mbedtls_ssl_context * ssl );
+int mbedtls_ssl_get_max_out_record_payload( const mbedtls_ssl_context * ssl );
+
+/* From ssl_internal.h. */
+int mbedtls_ssl_write_record( mbedtls_ssl_context * ssl,
+                              uint8_t force_flush );
+int mbedtls_ssl_flush_output( mbedtls_ssl_context * ssl );
+#if defined( MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH )
+    void mbedtls_ssl_reset_in_out_pointers( mbedtls_ssl_context * ssl );
+#endif
+
+#endif /* MBEDTLS_SSL_H */
@@ -0,0 +1,5 @@
+/*
+ * Host build stand-in, used by the TLS tests; see ssl.h.
+ */
+
+#include "ssl.h"
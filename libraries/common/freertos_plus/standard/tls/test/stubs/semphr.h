@@ -0,0 +1,23 @@
+/*
+ * Host build stand-in for semphr.h, used by the TLS tests.
+ */
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include semphr.h"
+#endif
+
+typedef void * SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void );
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore,
+                           TickType_t xBlockTime );
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore );
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore );
+
+#endif /* SEMAPHORE_H */
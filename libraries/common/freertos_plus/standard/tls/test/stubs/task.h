@@ -0,0 +1,18 @@
+/*
+ * Host build stand-in for task.h, used by the TLS tests.
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include task.h"
+#endif
+
+TickType_t xTaskGetTickCount( void );
+
+/* Nothing runs concurrently in the TLS tests. */
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#endif /* INC_TASK_H */
@@ -0,0 +1,352 @@
+/*
+ * Host build stand-ins for the calls iot_tls.c makes outside the record write
+ * path, used by the TLS tests.
+ *
+ * The tests start from a context whose handshake is complete, so connection
+ * setup and teardown are never exercised: setup calls fail and teardown calls
+ * do nothing. Heap calls use the C library. The record write path
+ * (mbedtls_ssl_write, mbedtls_ssl_write_record, mbedtls_ssl_flush_output and
+ * mbedtls_ssl_get_max_out_record_payload) is faked by each test.
+ */
+
+#include <stdlib.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "core_pkcs11.h"
+#include "core_pki_utils.h"
+#include "iot_connect_trace.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls_error.h"
+
+/*-----------------------------------------------------------*/
+
+void * pvPortMalloc( size_t xWantedSize )
+{
+    return malloc( xWantedSize );
+}
+
+void vPortFree( void * pv )
+{
+    free( pv );
+}
+
+void vLoggingPrintf( const char * pcFormat,
+                     ... )
+{
+    ( void ) pcFormat;
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+    return 0;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+    return NULL;
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore,
+                           TickType_t xBlockTime )
+{
+    ( void ) xSemaphore;
+    ( void ) xBlockTime;
+
+    return pdFALSE;
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+    ( void ) xSemaphore;
+
+    return pdFALSE;
+}
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore )
+{
+    ( void ) xSemaphore;
+}
+
+void ConnectTrace_PhaseStart( ConnectTracePhase_t ePhase )
+{
+    ( void ) ePhase;
+}
+
+void ConnectTrace_PhaseEnd( ConnectTracePhase_t ePhase )
+{
+    ( void ) ePhase;
+}
+
+/*-----------------------------------------------------------*/
+
+CK_RV C_GetFunctionList( CK_FUNCTION_LIST_PTR_PTR ppFunctionList )
+{
+    ( void ) ppFunctionList;
+
+    return CKR_FUNCTION_FAILED;
+}
+
+CK_RV C_GenerateRandom( CK_SESSION_HANDLE hSession,
+                        CK_BYTE_PTR RandomData,
+                        CK_ULONG ulRandomLen )
+{
+    ( void ) hSession;
+    ( void ) RandomData;
+    ( void ) ulRandomLen;
+
+    return CKR_FUNCTION_FAILED;
+}
+
+CK_RV xInitializePkcs11Session( CK_SESSION_HANDLE * pxSession )
+{
+    ( void ) pxSession;
+
+    return CKR_FUNCTION_FAILED;
+}
+
+CK_RV xFindObjectWithLabelAndClass( CK_SESSION_HANDLE xSession,
+                                    char * pcLabelName,
+                                    CK_ULONG ulLabelNameLen,
+                                    CK_OBJECT_CLASS xClass,
+                                    CK_OBJECT_HANDLE_PTR pxHandle )
+{
+    ( void ) xSession;
+    ( void ) pcLabelName;
+    ( void ) ulLabelNameLen;
+    ( void ) xClass;
+    ( void ) pxHandle;
+
+    return CKR_FUNCTION_FAILED;
+}
+
+CK_RV vAppendSHA256AlgorithmIdentifierSequence( const uint8_t * puc32ByteHashedMessage,
+                                                uint8_t * puc51ByteHashOidBuffer )
+{
+    ( void ) puc32ByteHashedMessage;
+    ( void ) puc51ByteHashOidBuffer;
+
+    return CKR_FUNCTION_FAILED;
+}
+
+int8_t PKI_pkcs11SignatureTombedTLSSignature( uint8_t * pucSig,
+                                              size_t * pxSigLen )
+{
+    ( void ) pucSig;
+    ( void ) pxSigLen;
+
+    return -1;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * mbedtls_strerror_highlevel( int errnum )
+{
+    ( void ) errnum;
+
+    return NULL;
+}
+
+const char * mbedtls_strerror_lowlevel( int errnum )
+{
+    ( void ) errnum;
+
+    return NULL;
+}
+
+void mbedtls_ctr_drbg_init( mbedtls_ctr_drbg_context * ctx )
+{
+    ( void ) ctx;
+}
+
+void mbedtls_ctr_drbg_free( mbedtls_ctr_drbg_context * ctx )
+{
+    ( void ) ctx;
+}
+
+int mbedtls_ctr_drbg_seed( mbedtls_ctr_drbg_context * ctx,
+                           int ( * f_entropy )( void *, unsigned char *, size_t ),
+                           void * p_entropy,
+                           const unsigned char * custom,
+                           size_t len )
+{
+    ( void ) ctx;
+    ( void ) f_entropy;
+    ( void ) p_entropy;
+    ( void ) custom;
+    ( void ) len;
+
+    return -1;
+}
+
+int mbedtls_ctr_drbg_random( void * p_rng,
+                             unsigned char * output,
+                             size_t output_len )
+{
+    ( void ) p_rng;
+    ( void ) output;
+    ( void ) output_len;
+
+    return -1;
+}
+
+void mbedtls_x509_crt_init( mbedtls_x509_crt * crt )
+{
+    ( void ) crt;
+}
+
+void mbedtls_x509_crt_free( mbedtls_x509_crt * crt )
+{
+    ( void ) crt;
+}
+
+int mbedtls_x509_crt_parse( mbedtls_x509_crt * chain,
+                            const unsigned char * buf,
+                            size_t buflen )
+{
+    ( void ) chain;
+    ( void ) buf;
+    ( void ) buflen;
+
+    return -1;
+}
+
+const mbedtls_pk_info_t * mbedtls_pk_info_from_type( mbedtls_pk_type_t pk_type )
+{
+    ( void ) pk_type;
+
+    return NULL;
+}
+
+void mbedtls_ssl_config_init( mbedtls_ssl_config * conf )
+{
+    ( void ) conf;
+}
+
+void mbedtls_ssl_config_free( mbedtls_ssl_config * conf )
+{
+    ( void ) conf;
+}
+
+int mbedtls_ssl_config_defaults( mbedtls_ssl_config * conf,
+                                 int endpoint,
+                                 int transport,
+                                 int preset )
+{
+    ( void ) conf;
+    ( void ) endpoint;
+    ( void ) transport;
+    ( void ) preset;
+
+    return -1;
+}
+
+void mbedtls_ssl_conf_authmode( mbedtls_ssl_config * conf,
+                                int authmode )
+{
+    ( void ) conf;
+    ( void ) authmode;
+}
+
+void mbedtls_ssl_conf_verify( mbedtls_ssl_config * conf,
+                              int ( * f_vrfy )( void *, mbedtls_x509_crt *, int, uint32_t * ),
+                              void * p_vrfy )
+{
+    ( void ) conf;
+    ( void ) f_vrfy;
+    ( void ) p_vrfy;
+}
+
+void mbedtls_ssl_conf_rng( mbedtls_ssl_config * conf,
+                           int ( * f_rng )( void *, unsigned char *, size_t ),
+                           void * p_rng )
+{
+    ( void ) conf;
+    ( void ) f_rng;
+    ( void ) p_rng;
+}
+
+void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config * conf,
+                                mbedtls_x509_crt * ca_chain,
+                                void * ca_crl )
+{
+    ( void ) conf;
+    ( void ) ca_chain;
+    ( void ) ca_crl;
+}
+
+int mbedtls_ssl_conf_own_cert( mbedtls_ssl_config * conf,
+                               mbedtls_x509_crt * own_cert,
+                               mbedtls_pk_context * pk_key )
+{
+    ( void ) conf;
+    ( void ) own_cert;
+    ( void ) pk_key;
+
+    return -1;
+}
+
+int mbedtls_ssl_conf_alpn_protocols( mbedtls_ssl_config * conf,
+                                     const char ** protos )
+{
+    ( void ) conf;
+    ( void ) protos;
+
+    return -1;
+}
+
+void mbedtls_ssl_init( mbedtls_ssl_context * ssl )
+{
+    ( void ) ssl;
+}
+
+void mbedtls_ssl_free( mbedtls_ssl_context * ssl )
+{
+    ( void ) ssl;
+}
+
+int mbedtls_ssl_setup( mbedtls_ssl_context * ssl,
+                       const mbedtls_ssl_config * conf )
+{
+    ( void ) ssl;
+    ( void ) conf;
+
+    return -1;
+}
+
+int mbedtls_ssl_set_hostname( mbedtls_ssl_context * ssl,
+                              const char * hostname )
+{
+    ( void ) ssl;
+    ( void ) hostname;
+
+    return -1;
+}
+
+void mbedtls_ssl_set_bio( mbedtls_ssl_context * ssl,
+                          void * p_bio,
+                          mbedtls_ssl_send_t * f_send,
+                          mbedtls_ssl_recv_t * f_recv,
+                          mbedtls_ssl_recv_timeout_t * f_recv_timeout )
+{
+    ( void ) ssl;
+    ( void ) p_bio;
+    ( void ) f_send;
+    ( void ) f_recv;
+    ( void ) f_recv_timeout;
+}
+
+int mbedtls_ssl_handshake( mbedtls_ssl_context * ssl )
+{
+    ( void ) ssl;
+
+    return -1;
+}
+
+int mbedtls_ssl_close_notify( mbedtls_ssl_context * ssl )
+{
+    ( void ) ssl;
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_connect_trace.h
+ * @brief Per-phase latency tracing of connection attempts.
+ *
+ * A connection attempt runs in a single task, from the transport down to the
+ * TLS signing callback. ConnectTrace_Begin() opens a record for the calling
+ * task, each layer brackets its phase with ConnectTrace_PhaseStart() and
+ * ConnectTrace_PhaseEnd(), and ConnectTrace_End() moves the record into a
+ * fixed ring of the most recent attempts. Phase calls made while no attempt is
+ * open for the calling task are ignored.
+ */
+
+#ifndef _IOT_CONNECT_TRACE_H_
+#define _IOT_CONNECT_TRACE_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_connect_trace.h"
+#endif
+
+/**
+ * @brief Number of completed attempts kept in the ring.
+ */
+#ifndef connecttraceconfigRING_LENGTH
+    #define connecttraceconfigRING_LENGTH    ( 8 )
+#endif
+
+/**
+ * @brief Number of tasks that can have an attempt open at the same time.
+ */
+#ifndef connecttraceconfigMAX_ACTIVE
+    #define connecttraceconfigMAX_ACTIVE    ( 4 )
+#endif
+
+/**
+ * @brief Set to 1 to print the report line of every attempt when it ends.
+ */
+#ifndef connecttraceconfigLOG_ATTEMPTS
+    #define connecttraceconfigLOG_ATTEMPTS    ( 0 )
+#endif
+
+/**
+ * @brief Phases of a connection attempt.
+ *
+ * eConnectTracePhaseSign runs inside eConnectTracePhaseHandshake.
+ */
+typedef enum ConnectTracePhase
+{
+    eConnectTracePhaseDns = 0,     /*!< Host name resolution. */
+    eConnectTracePhaseTcp,         /*!< TCP connect. */
+    eConnectTracePhaseCertParse,   /*!< Parsing of the trusted server certificates. */
+    eConnectTracePhaseCredentials, /*!< Loading of the client certificate and key. */
+    eConnectTracePhaseHandshake,   /*!< TLS handshake. */
+    eConnectTracePhaseSign,        /*!< Private key operations during the handshake. */
+    eConnectTracePhaseMax
+} ConnectTracePhase_t;
+
+/**
+ * @brief Timing of one phase.
+ *
+ * @param[out] ulStartMs Start of the first span of the phase, relative to the
+ * start of the attempt.
+ * @param[out] ulDurationMs Total time spent in the phase.
+ */
+typedef struct ConnectTraceSpan
+{
+    uint32_t ulStartMs;
+    uint32_t ulDurationMs;
+} ConnectTraceSpan_t;
+
+/**
+ * @brief One connection attempt.
+ *
+ * @param[out] ulAttempt Sequence number of the attempt since boot.
+ * @param[out] ulStartMs Start of the attempt, in milliseconds since boot.
+ * @param[out] ulTotalMs Duration of the whole attempt.
+ * @param[out] lStatus Status the attempt ended with; zero on success.
+ * @param[out] ulPhaseMask Bit ( 1 << phase ) is set for every phase that ran.
+ * @param[out] xSpans Timing of each phase, indexed by ConnectTracePhase_t.
+ */
+typedef struct ConnectTraceRecord
+{
+    uint32_t ulAttempt;
+    uint32_t ulStartMs;
+    uint32_t ulTotalMs;
+    int32_t lStatus;
+    uint32_t ulPhaseMask;
+    ConnectTraceSpan_t xSpans[ eConnectTracePhaseMax ];
+} ConnectTraceRecord_t;
+
+/**
+ * @brief Opens an attempt for the calling task.
+ *
+ * Nested calls from lower layers of the same attempt are allowed; only the
+ * outermost caller owns the attempt.
+ *
+ * @return pdTRUE if the caller owns the new attempt and must pass pdTRUE to
+ * ConnectTrace_End(), pdFALSE otherwise.
+ */
+BaseType_t ConnectTrace_Begin( void );
+
+/**
+ * @brief Closes the calling task's attempt and stores it in the ring.
+ *
+ * @param[in] xOwner Value returned by the matching ConnectTrace_Begin().
+ * @param[in] lStatus Result of the attempt; zero on success.
+ */
+void ConnectTrace_End( BaseType_t xOwner,
+                       int32_t lStatus );
+
+/**
+ * @brief Marks the start of a phase of the calling task's attempt.
+ *
+ * @param[in] ePhase The phase.
+ */
+void ConnectTrace_PhaseStart( ConnectTracePhase_t ePhase );
+
+/**
+ * @brief Marks the end of a phase of the calling task's attempt.
+ *
+ * @param[in] ePhase The phase.
+ */
+void ConnectTrace_PhaseEnd( ConnectTracePhase_t ePhase );
+
+/**
+ * @brief Copies the completed attempts out of the ring, newest first.
+ *
+ * @param[out] pxRecords Array receiving the records.
+ * @param[in] ulMaxRecords Number of entries in pxRecords.
+ *
+ * @return Number of records copied.
+ */
+uint32_t ConnectTrace_GetRecords( ConnectTraceRecord_t * pxRecords,
+                                  uint32_t ulMaxRecords );
+
+/**
+ * @brief Empties the ring.
+ */
+void ConnectTrace_Clear( void );
+
+/**
+ * @brief Formats a record as one compact line.
+ *
+ * Example: "#12 rc=0 total=842 dns=35 tcp=120 cert=40 cred=3 hs=630 sign=210".
+ * Durations are in milliseconds and phases that did not run are omitted.
+ *
+ * @param[in] pxRecord The record.
+ * @param[out] pcBuffer Receives the NULL terminated line.
+ * @param[in] xBufferLength Size of pcBuffer.
+ *
+ * @return Length of the line, excluding the terminator.
+ */
+size_t ConnectTrace_FormatRecord( const ConnectTraceRecord_t * pxRecord,
+                                  char * pcBuffer,
+                                  size_t xBufferLength );
+
+/**
+ * @brief Prints every record in the ring, newest first.
+ */
+void ConnectTrace_PrintReport( void );
+
+#endif /* _IOT_CONNECT_TRACE_H_ */
@@ -0,0 +1,230 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_decompress_stream.h
+ * @brief Streaming decompression of heatshrink data.
+ *
+ * The input is the raw output of the heatshrink encoder, for instance
+ * "heatshrink -e -w 10 -l 4", with the window and lookahead sizes set below.
+ * It is decoded as it is received and the output is handed back in fixed size
+ * blocks at increasing offsets, the way an uncompressed download would deliver
+ * it. Compressed blocks may arrive out of order; up to
+ * decompressstreamconfigHELD_BLOCKS of them are kept until the gap before them
+ * is filled.
+ *
+ * The window is part of the context, and the output block and the held block
+ * buffers are allocated by DecompressStream_Init(); nothing is allocated while
+ * data is decoded.
+ */
+
+#ifndef _IOT_DECOMPRESS_STREAM_H_
+#define _IOT_DECOMPRESS_STREAM_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_decompress_stream.h"
+#endif
+
+/**
+ * @brief Base 2 log of the window size, heatshrink's -w. Between 4 and 15.
+ */
+#ifndef decompressstreamconfigWINDOW_BITS
+    #define decompressstreamconfigWINDOW_BITS    ( 10 )
+#endif
+
+/**
+ * @brief Base 2 log of the lookahead size, heatshrink's -l. Between 3 and
+ * decompressstreamconfigWINDOW_BITS - 1.
+ */
+#ifndef decompressstreamconfigLOOKAHEAD_BITS
+    #define decompressstreamconfigLOOKAHEAD_BITS    ( 4 )
+#endif
+
+/**
+ * @brief Number of compressed blocks that may arrive ahead of a missing one.
+ */
+#ifndef decompressstreamconfigHELD_BLOCKS
+    #define decompressstreamconfigHELD_BLOCKS    ( 2 )
+#endif
+
+#define decompressstreamWINDOW_SIZE    ( 1U << decompressstreamconfigWINDOW_BITS )
+
+/**
+ * @brief Writes a block of the decompressed data.
+ *
+ * Blocks are written in order. All but the last are the block size given to
+ * DecompressStream_Init(). The data may be modified by the callback.
+ *
+ * @param[in] pvContext The context given to DecompressStream_Init().
+ * @param[in] ulOffset Offset of the block in the decompressed data.
+ * @param[in] pucData The block.
+ * @param[in] ulLength Size of the block.
+ *
+ * @return pdTRUE if the block was written.
+ */
+typedef BaseType_t (* DecompressStreamWrite_t)( void * pvContext,
+                                                uint32_t ulOffset,
+                                                uint8_t * pucData,
+                                                uint32_t ulLength );
+
+/**
+ * @brief Results of the decompression functions.
+ *
+ * Once a call failed, later calls return the same error.
+ */
+typedef enum DecompressStreamStatus
+{
+    DecompressStreamSuccess = 0,  /**< The data was taken. */
+    DecompressStreamBadParameter, /**< A parameter was invalid. */
+    DecompressStreamNoMemory,     /**< A buffer could not be allocated. */
+    DecompressStreamOutOfOrder,   /**< A block arrived too far ahead, or is larger than a held block buffer. */
+    DecompressStreamWriteError    /**< An output block could not be written. */
+} DecompressStreamStatus_t;
+
+/**
+ * @brief Counters of a stream.
+ *
+ * @param[out] ulInputBytes Compressed bytes decoded.
+ * @param[out] ulOutputBytes Bytes produced.
+ * @param[out] ulHeldBlocks Compressed blocks held because they arrived early.
+ * @param[out] ulDecodeTicks Ticks spent decoding, without the time spent in
+ * the write callback.
+ */
+typedef struct DecompressStreamStats
+{
+    uint32_t ulInputBytes;
+    uint32_t ulOutputBytes;
+    uint32_t ulHeldBlocks;
+    TickType_t ulDecodeTicks;
+} DecompressStreamStats_t;
+
+/**
+ * @brief A compressed block received ahead of the stream position.
+ */
+typedef struct DecompressStreamHeldBlock
+{
+    uint32_t ulOffset;
+    uint32_t ulLength;
+    uint8_t * pucData;
+} DecompressStreamHeldBlock_t;
+
+/**
+ * @brief State of a stream being decompressed.
+ *
+ * The members are private to the module.
+ */
+typedef struct DecompressStreamContext
+{
+    DecompressStreamWrite_t xWrite;
+    void * pvCallbackContext;
+
+    /* Output block being built. */
+    uint8_t * pucBlock;
+    uint32_t ulBlockSize;
+    uint32_t ulBlockFill;
+    uint32_t ulBlockOffset;
+
+    /* Input stream. */
+    uint32_t ulInputOffset;
+    uint32_t ulHeldSize;
+    DecompressStreamHeldBlock_t xHeld[ decompressstreamconfigHELD_BLOCKS ];
+
+    /* Decoder. */
+    uint32_t ulBits;
+    uint8_t ucBitCount;
+    uint8_t ucState;
+    uint32_t ulBackrefIndex;
+    uint32_t ulHead;
+    TickType_t xCallbackTicks;
+
+    DecompressStreamStatus_t xError;
+    DecompressStreamStats_t xStats;
+    uint8_t ucWindow[ decompressstreamWINDOW_SIZE ];
+} DecompressStreamContext_t;
+
+/**
+ * @brief Prepares a context for a new stream and allocates its buffers.
+ *
+ * @param[out] pxContext The context.
+ * @param[in] ulBlockSize Size of the output blocks.
+ * @param[in] ulMaxInputBlock Largest compressed block that may be held.
+ * @param[in] xWrite Writes the output blocks.
+ * @param[in] pvCallbackContext Passed to xWrite.
+ *
+ * @return DecompressStreamSuccess, DecompressStreamBadParameter or
+ * DecompressStreamNoMemory.
+ */
+DecompressStreamStatus_t DecompressStream_Init( DecompressStreamContext_t * pxContext,
+                                                uint32_t ulBlockSize,
+                                                uint32_t ulMaxInputBlock,
+                                                DecompressStreamWrite_t xWrite,
+                                                void * pvCallbackContext );
+
+/**
+ * @brief Decompresses a block of the stream.
+ *
+ * Blocks may arrive in any order and more than once.
+ *
+ * @param[in] pxContext The context.
+ * @param[in] ulOffset Offset of the block in the compressed stream.
+ * @param[in] pucData The block; it is not referenced after the call.
+ * @param[in] ulLength Size of the block.
+ *
+ * @return DecompressStreamSuccess or the error that stopped the stream.
+ */
+DecompressStreamStatus_t DecompressStream_Write( DecompressStreamContext_t * pxContext,
+                                                 uint32_t ulOffset,
+                                                 const uint8_t * pucData,
+                                                 uint32_t ulLength );
+
+/**
+ * @brief Writes the last, partial, output block.
+ *
+ * The heatshrink format carries no length, so the padding bits of the last
+ * byte are the only end marker; the caller checks the output it received.
+ *
+ * @param[in] pxContext The context.
+ *
+ * @return DecompressStreamSuccess if every output block was written.
+ */
+DecompressStreamStatus_t DecompressStream_Finish( DecompressStreamContext_t * pxContext );
+
+/**
+ * @brief Frees the buffers of a context.
+ *
+ * @param[in] pxContext The context.
+ */
+void DecompressStream_Free( DecompressStreamContext_t * pxContext );
+
+/**
+ * @brief Copies the counters of a stream.
+ *
+ * @param[in] pxContext The context.
+ * @param[out] pxStats Receives the counters.
+ */
+void DecompressStream_GetStats( const DecompressStreamContext_t * pxContext,
+                                DecompressStreamStats_t * pxStats );
+
+#endif /* _IOT_DECOMPRESS_STREAM_H_ */
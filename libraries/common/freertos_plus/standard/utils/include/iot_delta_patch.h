@@ -0,0 +1,256 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_delta_patch.h
+ * @brief Streaming application of binary patches.
+ *
+ * A patch rebuilds a target image from a source image that is already on the
+ * device. It is applied as it is received: the source is read through a
+ * callback and the target is handed back in fixed size blocks at increasing
+ * offsets, the way a full download would deliver it. RAM use is one target
+ * block, a small source buffer and, while patch data arrives out of order,
+ * copies of up to deltapatchconfigHELD_BLOCKS patch blocks.
+ *
+ * A patch starts with a 12 byte header: the magic "ADP1", then the source and
+ * the target sizes as 32 bit little endian numbers. Commands follow, each an
+ * opcode byte and an unsigned LEB128 argument:
+ *
+ * - 0x01 COPY n: copy n bytes from the source position, which moves by n.
+ * - 0x02 ADD n: n patch bytes follow; each is added, modulo 256, to the next
+ *   source byte. The source position moves by n. This is the bsdiff "diff"
+ *   step and keeps patches small when code moved and addresses changed.
+ * - 0x03 INSERT n: n patch bytes follow and are copied to the target as is.
+ * - 0x04 SEEK z: move the source position by the zigzag encoded signed z.
+ *
+ * The patch ends once the whole target was written.
+ */
+
+#ifndef _IOT_DELTA_PATCH_H_
+#define _IOT_DELTA_PATCH_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_delta_patch.h"
+#endif
+
+/**
+ * @brief Size of the buffer the source is read through.
+ */
+#ifndef deltapatchconfigSOURCE_BUFFER_SIZE
+    #define deltapatchconfigSOURCE_BUFFER_SIZE    ( 256 )
+#endif
+
+/**
+ * @brief Number of patch blocks that may arrive ahead of a missing one.
+ */
+#ifndef deltapatchconfigHELD_BLOCKS
+    #define deltapatchconfigHELD_BLOCKS    ( 2 )
+#endif
+
+/**
+ * @brief Size of the patch header.
+ */
+#define deltapatchHEADER_SIZE    ( 12U )
+
+/**
+ * @brief Reads the source image.
+ *
+ * @param[in] pvContext The context given to DeltaPatch_Init().
+ * @param[in] ulOffset Offset in the source image.
+ * @param[out] pucBuffer Receives the data.
+ * @param[in] ulLength Number of bytes to read.
+ *
+ * @return pdTRUE if the data was read.
+ */
+typedef BaseType_t (* DeltaPatchReadSource_t)( void * pvContext,
+                                               uint32_t ulOffset,
+                                               uint8_t * pucBuffer,
+                                               uint32_t ulLength );
+
+/**
+ * @brief Writes a block of the target image.
+ *
+ * Blocks are written in order. All but the last are the block size given to
+ * DeltaPatch_Init(). The data may be modified by the callback.
+ *
+ * @param[in] pvContext The context given to DeltaPatch_Init().
+ * @param[in] ulOffset Offset of the block in the target image.
+ * @param[in] pucData The block.
+ * @param[in] ulLength Size of the block.
+ *
+ * @return pdTRUE if the block was written.
+ */
+typedef BaseType_t (* DeltaPatchWriteTarget_t)( void * pvContext,
+                                                uint32_t ulOffset,
+                                                uint8_t * pucData,
+                                                uint32_t ulLength );
+
+/**
+ * @brief Results of the patch functions.
+ *
+ * Once a call failed, later calls return the same error.
+ */
+typedef enum DeltaPatchStatus
+{
+    DeltaPatchSuccess = 0,  /**< The data was taken. */
+    DeltaPatchBadParameter, /**< A parameter was invalid. */
+    DeltaPatchNoMemory,     /**< A buffer could not be allocated. */
+    DeltaPatchOutOfOrder,   /**< Too many patch blocks arrived ahead of a missing one. */
+    DeltaPatchInvalid,      /**< The patch is malformed or does not fit the source. */
+    DeltaPatchSourceError,  /**< The source could not be read. */
+    DeltaPatchTargetError,  /**< A target block could not be written. */
+    DeltaPatchIncomplete    /**< The patch ended before the whole target was written. */
+} DeltaPatchStatus_t;
+
+/**
+ * @brief Counters of a patch.
+ *
+ * @param[out] ulSourceSize Source size from the header, 0 until it is received.
+ * @param[out] ulTargetSize Target size from the header, 0 until it is received.
+ * @param[out] ulCopied Target bytes copied from the source.
+ * @param[out] ulAdded Target bytes built from the source and the patch.
+ * @param[out] ulInserted Target bytes taken from the patch.
+ * @param[out] ulHeldBlocks Patch blocks held because they arrived early.
+ */
+typedef struct DeltaPatchStats
+{
+    uint32_t ulSourceSize;
+    uint32_t ulTargetSize;
+    uint32_t ulCopied;
+    uint32_t ulAdded;
+    uint32_t ulInserted;
+    uint32_t ulHeldBlocks;
+} DeltaPatchStats_t;
+
+/**
+ * @brief A patch block received ahead of the patch position.
+ */
+typedef struct DeltaPatchHeldBlock
+{
+    uint32_t ulOffset;
+    uint32_t ulLength;
+    uint8_t * pucData;
+} DeltaPatchHeldBlock_t;
+
+/**
+ * @brief State of a patch being applied.
+ *
+ * The members are private to the module.
+ */
+typedef struct DeltaPatchContext
+{
+    DeltaPatchReadSource_t xReadSource;
+    DeltaPatchWriteTarget_t xWriteTarget;
+    void * pvCallbackContext;
+    uint32_t ulSourceLimit;
+
+    /* Target block being built. */
+    uint8_t * pucTargetBlock;
+    uint32_t ulBlockSize;
+    uint32_t ulBlockFill;
+    uint32_t ulBlockOffset;
+
+    /* Patch stream. */
+    uint32_t ulPatchOffset;
+    DeltaPatchHeldBlock_t xHeld[ deltapatchconfigHELD_BLOCKS ];
+    uint8_t ucHeader[ deltapatchHEADER_SIZE ];
+    uint8_t ucState;
+    uint8_t ucOpcode;
+    uint8_t ucShift;
+    uint32_t ulArgument;
+    uint32_t ulRemaining;
+
+    /* Positions in the source and target images. */
+    uint32_t ulSourcePosition;
+    uint32_t ulTargetPosition;
+
+    DeltaPatchStatus_t xError;
+    DeltaPatchStats_t xStats;
+    uint8_t ucSource[ deltapatchconfigSOURCE_BUFFER_SIZE ];
+} DeltaPatchContext_t;
+
+/**
+ * @brief Prepares a context for a new patch.
+ *
+ * @param[out] pxContext The context.
+ * @param[in] ulSourceLimit Largest source size a patch may declare.
+ * @param[in] ulBlockSize Size of the target blocks.
+ * @param[in] xReadSource Reads the source image.
+ * @param[in] xWriteTarget Writes the target image.
+ * @param[in] pvCallbackContext Passed to the callbacks.
+ *
+ * @return DeltaPatchSuccess, DeltaPatchBadParameter or DeltaPatchNoMemory.
+ */
+DeltaPatchStatus_t DeltaPatch_Init( DeltaPatchContext_t * pxContext,
+                                    uint32_t ulSourceLimit,
+                                    uint32_t ulBlockSize,
+                                    DeltaPatchReadSource_t xReadSource,
+                                    DeltaPatchWriteTarget_t xWriteTarget,
+                                    void * pvCallbackContext );
+
+/**
+ * @brief Applies a block of the patch.
+ *
+ * Blocks may arrive in any order and more than once; blocks ahead of the
+ * patch position are copied and applied once the gap before them is filled.
+ *
+ * @param[in] pxContext The context.
+ * @param[in] ulOffset Offset of the block in the patch.
+ * @param[in] pucData The block; it is not referenced after the call.
+ * @param[in] ulLength Size of the block.
+ *
+ * @return DeltaPatchSuccess or the error that stopped the patch.
+ */
+DeltaPatchStatus_t DeltaPatch_Write( DeltaPatchContext_t * pxContext,
+                                     uint32_t ulOffset,
+                                     const uint8_t * pucData,
+                                     uint32_t ulLength );
+
+/**
+ * @brief Checks that the target is complete and writes its last block.
+ *
+ * @param[in] pxContext The context.
+ *
+ * @return DeltaPatchSuccess if the whole target was written.
+ */
+DeltaPatchStatus_t DeltaPatch_Finish( DeltaPatchContext_t * pxContext );
+
+/**
+ * @brief Frees the buffers of a context.
+ *
+ * @param[in] pxContext The context.
+ */
+void DeltaPatch_Free( DeltaPatchContext_t * pxContext );
+
+/**
+ * @brief Copies the counters of a patch.
+ *
+ * @param[in] pxContext The context.
+ * @param[out] pxStats Receives the counters.
+ */
+void DeltaPatch_GetStats( const DeltaPatchContext_t * pxContext,
+                          DeltaPatchStats_t * pxStats );
+
+#endif /* _IOT_DELTA_PATCH_H_ */
@@ -0,0 +1,167 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_dns_cache.h
+ * @brief Host name resolution cache.
+ *
+ * Entries are fresh for dnscacheconfigTTL_MS after a successful resolution.
+ * A hit during the last dnscacheconfigPREFETCH_MS of that window refreshes
+ * the entry from a short-lived task, so hosts that are connected to regularly
+ * never block on the resolver.
+ *
+ * For dnscacheconfigSTALE_MS after expiry the entry is still returned at
+ * once, and each such hit starts the same background refresh unless one is
+ * already running (stale-while-revalidate). A failed refresh leaves the entry
+ * as it was. Only a lookup of a host name without a usable entry blocks on
+ * the resolver.
+ *
+ * The resolver itself is passed in by the caller, which keeps this module
+ * independent of the network stack. Calls to the resolver are serialized, so
+ * non-reentrant resolvers such as gethostbyname() can be used as is.
+ */
+
+#ifndef _IOT_DNS_CACHE_H_
+#define _IOT_DNS_CACHE_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_dns_cache.h"
+#endif
+
+/**
+ * @brief Number of host names cached.
+ */
+#ifndef dnscacheconfigENTRIES
+    #define dnscacheconfigENTRIES    ( 4 )
+#endif
+
+/**
+ * @brief Size of the host name buffer of an entry, including the terminator.
+ *
+ * Longer host names are resolved every time.
+ */
+#ifndef dnscacheconfigHOST_NAME_LENGTH
+    #define dnscacheconfigHOST_NAME_LENGTH    ( 80 )
+#endif
+
+/**
+ * @brief Time an address is used without asking the resolver again.
+ *
+ * lwIP does not report the TTL of the DNS record to gethostbyname() callers,
+ * so this should not exceed the TTL the endpoint is published with.
+ */
+#ifndef dnscacheconfigTTL_MS
+    #define dnscacheconfigTTL_MS    ( 60000 )
+#endif
+
+/**
+ * @brief Time after expiry during which the last good address is still
+ * served while it is refreshed in the background. Set to 0 to block on the
+ * resolver as soon as an entry expires.
+ */
+#ifndef dnscacheconfigSTALE_MS
+    #define dnscacheconfigSTALE_MS    ( 3600000 )
+#endif
+
+/**
+ * @brief Time before expiry from which a hit starts a background refresh.
+ * Set to 0 to only refresh entries once they expired.
+ */
+#ifndef dnscacheconfigPREFETCH_MS
+    #define dnscacheconfigPREFETCH_MS    ( 10000 )
+#endif
+
+/**
+ * @brief Stack depth, in words, of the background refresh task.
+ */
+#ifndef dnscacheconfigPREFETCH_TASK_STACK_DEPTH
+    #define dnscacheconfigPREFETCH_TASK_STACK_DEPTH    ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+/**
+ * @brief Priority of the background refresh task.
+ */
+#ifndef dnscacheconfigPREFETCH_TASK_PRIORITY
+    #define dnscacheconfigPREFETCH_TASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Resolves a host name.
+ *
+ * @param[in] pcHostName The host name.
+ *
+ * @return The IPv4 address in network byte order, or 0 on failure.
+ */
+typedef uint32_t (* DnsCacheResolver_t)( const char * pcHostName );
+
+/**
+ * @brief Counters of the cache.
+ *
+ * @param[out] ulHits Lookups answered with a fresh entry.
+ * @param[out] ulMisses Lookups that called the resolver.
+ * @param[out] ulStaleHits Lookups answered with an expired entry while it is
+ * refreshed.
+ * @param[out] ulPrefetches Background refreshes started.
+ * @param[out] ulFailures Lookups that returned 0.
+ */
+typedef struct DnsCacheStats
+{
+    uint32_t ulHits;
+    uint32_t ulMisses;
+    uint32_t ulStaleHits;
+    uint32_t ulPrefetches;
+    uint32_t ulFailures;
+} DnsCacheStats_t;
+
+/**
+ * @brief Resolves a host name through the cache.
+ *
+ * A fresh entry, or one that expired less than dnscacheconfigSTALE_MS ago, is
+ * returned without waiting for the resolver. Otherwise the caller waits for
+ * the resolver.
+ *
+ * @param[in] pcHostName The host name.
+ * @param[in] xResolver Called on a miss and for background refreshes.
+ *
+ * @return The IPv4 address in network byte order, or 0 on failure.
+ */
+uint32_t DnsCache_Resolve( const char * pcHostName,
+                           DnsCacheResolver_t xResolver );
+
+/**
+ * @brief Drops cached addresses.
+ *
+ * @param[in] pcHostName The host name to drop, or NULL to drop all of them.
+ */
+void DnsCache_Flush( const char * pcHostName );
+
+/**
+ * @brief Copies the counters of the cache.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void DnsCache_GetStats( DnsCacheStats_t * pxStats );
+
+#endif /* _IOT_DNS_CACHE_H_ */
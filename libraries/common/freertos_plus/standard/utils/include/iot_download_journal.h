@@ -0,0 +1,217 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_download_journal.h
+ * @brief Journal of the blocks of a download already in flash, kept across
+ * resets.
+ *
+ * The journal lives in a few reserved flash sectors. Records are only ever
+ * appended to the current sector; once it is full, the live content (the
+ * download, its state and the bitmap of the blocks written) is copied to the
+ * next sector, which then becomes current. Each sector is therefore erased
+ * once per trip around the region. Every record carries a CRC, so a record
+ * torn by a reset is ignored and the journal goes on from the last complete
+ * one.
+ *
+ * A download is identified by a key chosen by the caller, for instance its
+ * signature. Starting a download with the key of the unfinished one in the
+ * journal resumes it: the blocks marked written before the reset are reported
+ * again, along with the state the caller saved.
+ *
+ * Only one download is journaled at a time.
+ */
+
+#ifndef _IOT_DOWNLOAD_JOURNAL_H_
+#define _IOT_DOWNLOAD_JOURNAL_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_download_journal.h"
+#endif
+
+/**
+ * @brief Largest number of blocks in a download.
+ */
+#ifndef downloadjournalconfigMAX_BLOCKS
+    #define downloadjournalconfigMAX_BLOCKS    ( 2048 )
+#endif
+
+/**
+ * @brief Reads the journal region.
+ *
+ * @param[in] ulAddress Flash offset to read.
+ * @param[out] pucBuffer Receives the data.
+ * @param[in] ulLength Number of bytes to read.
+ *
+ * @return pdTRUE if the data was read.
+ */
+typedef BaseType_t (* DownloadJournalRead_t)( uint32_t ulAddress,
+                                              uint8_t * pucBuffer,
+                                              uint32_t ulLength );
+
+/**
+ * @brief Programs erased bytes of the journal region.
+ *
+ * @param[in] ulAddress Flash offset to program.
+ * @param[in] pucData The data.
+ * @param[in] ulLength Number of bytes to program.
+ *
+ * @return pdTRUE if the data was programmed.
+ */
+typedef BaseType_t (* DownloadJournalProgram_t)( uint32_t ulAddress,
+                                                 const uint8_t * pucData,
+                                                 uint32_t ulLength );
+
+/**
+ * @brief Erases a sector of the journal region.
+ *
+ * @param[in] ulAddress Flash offset of the sector.
+ *
+ * @return pdTRUE if the sector was erased.
+ */
+typedef BaseType_t (* DownloadJournalErase_t)( uint32_t ulAddress );
+
+/**
+ * @brief Flash access and placement of the journal.
+ *
+ * @param[in] ulAddress Flash offset of the region, sector aligned.
+ * @param[in] ulSectorSize Size of a sector.
+ * @param[in] ulSectors Number of sectors in the region, at least 2.
+ * @param[in] xRead Reads the region.
+ * @param[in] xProgram Programs the region.
+ * @param[in] xErase Erases a sector of the region.
+ */
+typedef struct DownloadJournalFlash
+{
+    uint32_t ulAddress;
+    uint32_t ulSectorSize;
+    uint32_t ulSectors;
+    DownloadJournalRead_t xRead;
+    DownloadJournalProgram_t xProgram;
+    DownloadJournalErase_t xErase;
+} DownloadJournalFlash_t;
+
+/**
+ * @brief Counters of the journal since it was started.
+ *
+ * @param[out] ulResumedBlocks Blocks found written when the download started.
+ * @param[out] ulRecords Records appended.
+ * @param[out] ulCompactions Times the live content moved to the next sector.
+ * @param[out] ulFailures Flash operations that failed.
+ */
+typedef struct DownloadJournalStats
+{
+    uint32_t ulResumedBlocks;
+    uint32_t ulRecords;
+    uint32_t ulCompactions;
+    uint32_t ulFailures;
+} DownloadJournalStats_t;
+
+/**
+ * @brief Starts journaling a download, resuming it if the journal holds the
+ * unfinished download with the same key and number of blocks.
+ *
+ * @param[in] pxFlash The journal region; the structure must stay valid until
+ * the journal is stopped.
+ * @param[in] pucKey Identifies the download.
+ * @param[in] ulKeyLength Size of the key.
+ * @param[in] ulBlocks Number of blocks in the download.
+ *
+ * @return The number of blocks already written, 0 for a new download. The
+ * journal is disabled, and every later call does nothing, if the region
+ * cannot be used.
+ */
+uint32_t DownloadJournal_Start( const DownloadJournalFlash_t * pxFlash,
+                                const uint8_t * pucKey,
+                                uint32_t ulKeyLength,
+                                uint32_t ulBlocks );
+
+/**
+ * @brief Saves the state the caller needs to resume the download. It
+ * replaces the state saved before.
+ *
+ * @param[in] pvState The state.
+ * @param[in] ulLength Size of the state.
+ *
+ * @return pdTRUE if the state was saved.
+ */
+BaseType_t DownloadJournal_SetState( const void * pvState,
+                                     uint32_t ulLength );
+
+/**
+ * @brief Reads back the state saved for the download.
+ *
+ * @param[out] pvState Receives the state.
+ * @param[in] ulLength Size of the state; a state of another size is not read.
+ *
+ * @return pdTRUE if a state of this size was read.
+ */
+BaseType_t DownloadJournal_GetState( void * pvState,
+                                     uint32_t ulLength );
+
+/**
+ * @brief Records blocks as written.
+ *
+ * The caller makes sure the blocks are in flash first: a block recorded here
+ * is not requested again after a reset.
+ *
+ * @param[in] ulFirst The first block.
+ * @param[in] ulCount Number of blocks.
+ *
+ * @return pdTRUE if the blocks were recorded.
+ */
+BaseType_t DownloadJournal_MarkWritten( uint32_t ulFirst,
+                                        uint32_t ulCount );
+
+/**
+ * @brief Checks if a block was recorded as written.
+ *
+ * @param[in] ulBlock The block.
+ *
+ * @return pdTRUE if the block is written.
+ */
+BaseType_t DownloadJournal_IsWritten( uint32_t ulBlock );
+
+/**
+ * @brief Counts the blocks written from the first one on without a gap.
+ *
+ * @return The number of blocks.
+ */
+uint32_t DownloadJournal_GetWrittenPrefix( void );
+
+/**
+ * @brief Ends the download, which can then no longer be resumed, and stops
+ * the journal.
+ */
+void DownloadJournal_Clear( void );
+
+/**
+ * @brief Copies the counters of the journal.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void DownloadJournal_GetStats( DownloadJournalStats_t * pxStats );
+
+#endif /* _IOT_DOWNLOAD_JOURNAL_H_ */
@@ -0,0 +1,149 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_flash_erase_ahead.h
+ * @brief Erases a flash region just ahead of the writes to it.
+ *
+ * FlashEraseAhead_Start() registers a region without erasing it. Writers call
+ * FlashEraseAhead_Prepare() before each write; it erases whatever part of the
+ * written range is not erased yet and moves the write cursor forward. A
+ * background task keeps the units up to a configurable distance past the
+ * cursor erased, so that in-order writes normally find their flash ready.
+ *
+ * The erased state of every unit is kept in a bitmap, so a write that lands
+ * behind the cursor, or far ahead of it, is still preceded by an erase, and no
+ * unit is ever erased twice. Only one region is handled at a time.
+ */
+
+#ifndef _IOT_FLASH_ERASE_AHEAD_H_
+#define _IOT_FLASH_ERASE_AHEAD_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_flash_erase_ahead.h"
+#endif
+
+/**
+ * @brief Largest number of erase units in a region.
+ */
+#ifndef flasheraseaheadconfigMAX_UNITS
+    #define flasheraseaheadconfigMAX_UNITS    ( 1024 )
+#endif
+
+/**
+ * @brief Stack depth, in words, of the background erase task.
+ */
+#ifndef flasheraseaheadconfigTASK_STACK_DEPTH
+    #define flasheraseaheadconfigTASK_STACK_DEPTH    ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+/**
+ * @brief Priority of the background erase task.
+ *
+ * It should be below the task writing the region, so that the writer is not
+ * held up by erases it does not need yet.
+ */
+#ifndef flasheraseaheadconfigTASK_PRIORITY
+    #define flasheraseaheadconfigTASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Erases one unit of flash.
+ *
+ * @param[in] ulAddress Flash offset of the unit.
+ * @param[in] ulLength Size of the unit.
+ *
+ * @return pdTRUE if the unit was erased.
+ */
+typedef BaseType_t (* FlashEraseAheadEraser_t)( uint32_t ulAddress,
+                                                uint32_t ulLength );
+
+/**
+ * @brief Counters of the current region.
+ *
+ * @param[out] ulErasedAhead Units erased by the background task.
+ * @param[out] ulErasedOnDemand Units erased by FlashEraseAhead_Prepare(),
+ * which the writer had to wait for.
+ * @param[out] ulEraseFailures Erases that failed.
+ */
+typedef struct FlashEraseAheadStats
+{
+    uint32_t ulErasedAhead;
+    uint32_t ulErasedOnDemand;
+    uint32_t ulEraseFailures;
+} FlashEraseAheadStats_t;
+
+/**
+ * @brief Registers the region to erase and starts the background task.
+ *
+ * A region that was already registered is stopped first. If the task cannot
+ * be created, the region is still registered and erased on demand.
+ *
+ * @param[in] ulAddress Flash offset of the region, a multiple of ulUnitSize.
+ * @param[in] ulLength Size of the region, rounded up to whole units.
+ * @param[in] ulUnitSize Erase unit, such as a 4 KB sector or a 64 KB block.
+ * @param[in] ulAheadLength How far past the write cursor the task erases.
+ * @param[in] xEraser Erases one unit.
+ *
+ * @return pdTRUE if the region was registered, pdFALSE if the parameters are
+ * invalid or the region has more than flasheraseaheadconfigMAX_UNITS units. The
+ * caller must then erase the region itself.
+ */
+BaseType_t FlashEraseAhead_Start( uint32_t ulAddress,
+                                  uint32_t ulLength,
+                                  uint32_t ulUnitSize,
+                                  uint32_t ulAheadLength,
+                                  FlashEraseAheadEraser_t xEraser );
+
+/**
+ * @brief Makes sure a range is erased before it is written.
+ *
+ * The parts of the range outside the region, and every range while no region
+ * is registered, are left to the caller.
+ *
+ * @param[in] ulAddress Flash offset of the range.
+ * @param[in] ulLength Size of the range.
+ *
+ * @return pdFALSE if an erase failed, pdTRUE otherwise.
+ */
+BaseType_t FlashEraseAhead_Prepare( uint32_t ulAddress,
+                                    uint32_t ulLength );
+
+/**
+ * @brief Stops the background task and forgets the region.
+ *
+ * Waits for an erase in progress to finish. Units that were not reached stay
+ * as they were.
+ */
+void FlashEraseAhead_Stop( void );
+
+/**
+ * @brief Copies the counters of the current or last region.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void FlashEraseAhead_GetStats( FlashEraseAheadStats_t * pxStats );
+
+#endif /* _IOT_FLASH_ERASE_AHEAD_H_ */
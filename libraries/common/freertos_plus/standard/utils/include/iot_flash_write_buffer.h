@@ -0,0 +1,160 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_flash_write_buffer.h
+ * @brief Page aligned write combining in front of a flash program function.
+ *
+ * Writes are split at flash page boundaries. Runs of whole pages are
+ * programmed straight from the caller's buffer in one operation. The partial
+ * pages at either end of a write are held in a small cache of page buffers
+ * until the neighbouring write fills them, so the tail of one block and the
+ * head of the next are programmed together as one page whatever order the
+ * blocks arrive in. A page that is still partial when its buffer is needed
+ * for another page, or when the writer is flushed, is programmed as it is.
+ *
+ * Writes must not overlap and must go to erased flash. Only one writer is
+ * handled at a time and the functions must be called from a single task.
+ */
+
+#ifndef _IOT_FLASH_WRITE_BUFFER_H_
+#define _IOT_FLASH_WRITE_BUFFER_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_flash_write_buffer.h"
+#endif
+
+/**
+ * @brief Size of a flash program page, a power of two.
+ */
+#ifndef flashwritebufferconfigPAGE_SIZE
+    #define flashwritebufferconfigPAGE_SIZE    ( 256 )
+#endif
+
+/**
+ * @brief Number of partial pages held at a time.
+ *
+ * Each in-order write leaves at most one partial page behind; the others
+ * catch the edges of blocks that arrive out of order.
+ */
+#ifndef flashwritebufferconfigCACHED_PAGES
+    #define flashwritebufferconfigCACHED_PAGES    ( 4 )
+#endif
+
+/**
+ * @brief Programs erased flash.
+ *
+ * @param[in] ulAddress Flash offset to program.
+ * @param[in] pucData Data to program.
+ * @param[in] ulLength Number of bytes to program.
+ *
+ * @return pdTRUE if the data was programmed.
+ */
+typedef BaseType_t (* FlashWriteBufferProgram_t)( uint32_t ulAddress,
+                                                  const uint8_t * pucData,
+                                                  uint32_t ulLength );
+
+/**
+ * @brief Counters since the last FlashWriteBuffer_Start().
+ *
+ * @param[out] ulWrites Calls to FlashWriteBuffer_Write().
+ * @param[out] ulProgramOps Calls to the program function.
+ * @param[out] ulFullPages Whole pages programmed.
+ * @param[out] ulPartialPages Pages programmed while only partly written.
+ */
+typedef struct FlashWriteBufferStats
+{
+    uint32_t ulWrites;
+    uint32_t ulProgramOps;
+    uint32_t ulFullPages;
+    uint32_t ulPartialPages;
+} FlashWriteBufferStats_t;
+
+/**
+ * @brief Starts a new write session, discarding anything still buffered.
+ *
+ * @param[in] xProgram Programs the flash.
+ */
+void FlashWriteBuffer_Start( FlashWriteBufferProgram_t xProgram );
+
+/**
+ * @brief Writes data through the buffer.
+ *
+ * @param[in] ulAddress Flash offset of the data.
+ * @param[in] pucData The data; it is not referenced after the call.
+ * @param[in] ulLength Number of bytes.
+ *
+ * @return pdFALSE if no session is started or programming failed.
+ */
+BaseType_t FlashWriteBuffer_Write( uint32_t ulAddress,
+                                   const uint8_t * pucData,
+                                   uint32_t ulLength );
+
+/**
+ * @brief Programs every buffered page.
+ *
+ * Must be called before the written flash is read back.
+ *
+ * @return pdFALSE if programming failed.
+ */
+BaseType_t FlashWriteBuffer_Flush( void );
+
+/**
+ * @brief Copies the bytes still buffered for a range over data read back
+ * from flash, so that the range reads as it was written.
+ *
+ * @param[in] ulAddress Flash offset of the data.
+ * @param[in,out] pucData Data read from flash at ulAddress.
+ * @param[in] ulLength Number of bytes.
+ */
+void FlashWriteBuffer_Overlay( uint32_t ulAddress,
+                               uint8_t * pucData,
+                               uint32_t ulLength );
+
+/**
+ * @brief Checks if any byte of a range is still buffered, that is not yet
+ * programmed.
+ *
+ * @param[in] ulAddress Flash offset of the range.
+ * @param[in] ulLength Number of bytes.
+ *
+ * @return pdTRUE if part of the range is buffered.
+ */
+BaseType_t FlashWriteBuffer_IsBuffered( uint32_t ulAddress,
+                                        uint32_t ulLength );
+
+/**
+ * @brief Drops the buffered pages and ends the session.
+ */
+void FlashWriteBuffer_Discard( void );
+
+/**
+ * @brief Copies the counters of the current or last session.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void FlashWriteBuffer_GetStats( FlashWriteBufferStats_t * pxStats );
+
+#endif /* _IOT_FLASH_WRITE_BUFFER_H_ */
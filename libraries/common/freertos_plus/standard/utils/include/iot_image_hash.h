@@ -0,0 +1,169 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_image_hash.h
+ * @brief Hash of an image written in blocks, in whatever order they arrive.
+ *
+ * The hash can only take the image in order, so a block is hashed from the
+ * caller's buffer when it starts where the hashed part ends. A block that
+ * lands further on is written but not hashed; its range is recorded. Once
+ * the blocks before it have arrived, the recorded ranges that now follow the
+ * hashed part are read back and hashed, and the hash goes on from the
+ * caller's buffers again. Only the bytes that arrived ahead of a missing
+ * block are ever read back.
+ *
+ * Only one image is hashed at a time and the functions must be called from
+ * a single task.
+ */
+
+#ifndef _IOT_IMAGE_HASH_H_
+#define _IOT_IMAGE_HASH_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_image_hash.h"
+#endif
+
+/**
+ * @brief Number of ranges written ahead of the hashed part that are
+ * recorded.
+ *
+ * Adjacent ranges are merged, so this bounds the number of holes before the
+ * data, not the number of blocks. A range that does not fit is not recorded;
+ * it is read back when the image is finished instead.
+ */
+#ifndef imagehashconfigMAX_RANGES
+    #define imagehashconfigMAX_RANGES    ( 8 )
+#endif
+
+/**
+ * @brief Size of the buffer used to read ranges back.
+ */
+#ifndef imagehashconfigREAD_SIZE
+    #define imagehashconfigREAD_SIZE    ( 1024 )
+#endif
+
+/**
+ * @brief Adds data to the hash; CRYPTO_SignatureVerificationUpdate() fits.
+ *
+ * @param[in] pvContext The hash context.
+ * @param[in] pucData The data.
+ * @param[in] xLength Number of bytes.
+ */
+typedef void (* ImageHashUpdate_t)( void * pvContext,
+                                    const uint8_t * pucData,
+                                    size_t xLength );
+
+/**
+ * @brief Reads written image data back.
+ *
+ * Data still held in a write buffer must be returned too.
+ *
+ * @param[in] ulOffset Offset in the image.
+ * @param[out] pucBuffer Receives the data.
+ * @param[in] ulLength Number of bytes.
+ *
+ * @return pdTRUE if the data was read.
+ */
+typedef BaseType_t (* ImageHashRead_t)( uint32_t ulOffset,
+                                        uint8_t * pucBuffer,
+                                        uint32_t ulLength );
+
+/**
+ * @brief Counters since the last ImageHash_Start().
+ *
+ * @param[out] ulHashedBytes Bytes hashed straight from the written blocks.
+ * @param[out] ulReadBackBytes Bytes read back to be hashed.
+ * @param[out] ulAheadWrites Blocks written ahead of the hashed part.
+ * @param[out] ulUntrackedWrites Of those, the ones whose range did not fit.
+ */
+typedef struct ImageHashStats
+{
+    uint32_t ulHashedBytes;
+    uint32_t ulReadBackBytes;
+    uint32_t ulAheadWrites;
+    uint32_t ulUntrackedWrites;
+} ImageHashStats_t;
+
+/**
+ * @brief Starts hashing an image, forgetting the one hashed before.
+ *
+ * @param[in] pvContext The hash context; the caller creates it, and has
+ * already hashed the first ulHashedLength bytes of the image into it.
+ * @param[in] xUpdate Adds data to the hash.
+ * @param[in] xRead Reads the image back.
+ * @param[in] ulHashedLength Number of bytes already hashed.
+ */
+void ImageHash_Start( void * pvContext,
+                      ImageHashUpdate_t xUpdate,
+                      ImageHashRead_t xRead,
+                      uint32_t ulHashedLength );
+
+/**
+ * @brief Hashes or records data just written to the image.
+ *
+ * Writes must not overlap. Data before the hashed part is ignored.
+ *
+ * @param[in] ulOffset Offset of the data in the image.
+ * @param[in] pucData The data.
+ * @param[in] ulLength Number of bytes.
+ *
+ * @return pdFALSE if no image is being hashed or reading back failed.
+ */
+BaseType_t ImageHash_Write( uint32_t ulOffset,
+                            const uint8_t * pucData,
+                            uint32_t ulLength );
+
+/**
+ * @brief Hashes the rest of the image, reading back what was not hashed as
+ * it was written, and ends the session. The context is left to the caller.
+ *
+ * @param[in] ulLength Size of the image.
+ *
+ * @return pdFALSE if no image is being hashed or reading back failed.
+ */
+BaseType_t ImageHash_Finish( uint32_t ulLength );
+
+/**
+ * @brief Ends the session without hashing more. The context is left to the
+ * caller.
+ */
+void ImageHash_Stop( void );
+
+/**
+ * @brief Returns the context of the image being hashed.
+ *
+ * @return The context, or NULL if no image is being hashed.
+ */
+void * ImageHash_GetContext( void );
+
+/**
+ * @brief Copies the counters of the current or last session.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void ImageHash_GetStats( ImageHashStats_t * pxStats );
+
+#endif /* _IOT_IMAGE_HASH_H_ */
@@ -0,0 +1,213 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_publish_store.h
+ * @brief Bounded store of messages kept while they cannot be sent, for
+ * instance publishes issued while the MQTT connection is down.
+ *
+ * Messages are kept in a RAM ring first. Once it is full, they are appended
+ * to a log in a few reserved flash sectors, where they survive a reset. Every
+ * record carries a CRC, so a record torn by a reset is ignored. A sector is
+ * erased again once every message in it was forwarded.
+ *
+ * Each message has a priority class, 0 being the most urgent. Messages are
+ * handed back by class, and in the order they were stored within a class.
+ * Forwarding is recorded in flash as it happens; a message forwarded just
+ * before a reset may be handed back again after it.
+ *
+ * The functions are not thread safe: the caller serializes them.
+ */
+
+#ifndef _IOT_PUBLISH_STORE_H_
+#define _IOT_PUBLISH_STORE_H_
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include iot_publish_store.h"
+#endif
+
+/**
+ * @brief Size in bytes of the RAM ring. A message takes 4 bytes more than
+ * its length, rounded up to 4 bytes.
+ */
+#ifndef publishstoreconfigRAM_SIZE
+    #define publishstoreconfigRAM_SIZE    ( 2048 )
+#endif
+
+/**
+ * @brief Number of priority classes.
+ */
+#ifndef publishstoreconfigCLASSES
+    #define publishstoreconfigCLASSES    ( 2 )
+#endif
+
+/**
+ * @brief Largest message.
+ */
+#ifndef publishstoreconfigMAX_MESSAGE
+    #define publishstoreconfigMAX_MESSAGE    ( 512 )
+#endif
+
+/**
+ * @brief Reads the store region.
+ *
+ * @param[in] ulAddress Flash offset to read.
+ * @param[out] pucBuffer Receives the data.
+ * @param[in] ulLength Number of bytes to read.
+ *
+ * @return pdTRUE if the data was read.
+ */
+typedef BaseType_t (* PublishStoreRead_t)( uint32_t ulAddress,
+                                           uint8_t * pucBuffer,
+                                           uint32_t ulLength );
+
+/**
+ * @brief Programs erased bytes of the store region.
+ *
+ * @param[in] ulAddress Flash offset to program.
+ * @param[in] pucData The data.
+ * @param[in] ulLength Number of bytes to program.
+ *
+ * @return pdTRUE if the data was programmed.
+ */
+typedef BaseType_t (* PublishStoreProgram_t)( uint32_t ulAddress,
+                                              const uint8_t * pucData,
+                                              uint32_t ulLength );
+
+/**
+ * @brief Erases a sector of the store region.
+ *
+ * @param[in] ulAddress Flash offset of the sector.
+ *
+ * @return pdTRUE if the sector was erased.
+ */
+typedef BaseType_t (* PublishStoreErase_t)( uint32_t ulAddress );
+
+/**
+ * @brief Flash access and placement of the store.
+ *
+ * @param[in] ulAddress Flash offset of the region, sector aligned.
+ * @param[in] ulSectorSize Size of a sector.
+ * @param[in] ulSectors Number of sectors in the region, at least 2.
+ * @param[in] xRead Reads the region.
+ * @param[in] xProgram Programs the region.
+ * @param[in] xErase Erases a sector of the region.
+ */
+typedef struct PublishStoreFlash
+{
+    uint32_t ulAddress;
+    uint32_t ulSectorSize;
+    uint32_t ulSectors;
+    PublishStoreRead_t xRead;
+    PublishStoreProgram_t xProgram;
+    PublishStoreErase_t xErase;
+} PublishStoreFlash_t;
+
+/**
+ * @brief Counters of the store since it was initialized.
+ *
+ * @param[out] ulStored Messages taken.
+ * @param[out] ulSpilled Messages taken into flash because the RAM ring was
+ * full or held older messages of the class.
+ * @param[out] ulForwarded Messages removed after they were sent.
+ * @param[out] ulDropped Messages refused because the store was full.
+ * @param[out] ulRecovered Messages found in flash at initialization.
+ * @param[out] ulLost Messages in flash that could not be read back.
+ * @param[out] ulFailures Flash operations that failed.
+ */
+typedef struct PublishStoreStats
+{
+    uint32_t ulStored;
+    uint32_t ulSpilled;
+    uint32_t ulForwarded;
+    uint32_t ulDropped;
+    uint32_t ulRecovered;
+    uint32_t ulLost;
+    uint32_t ulFailures;
+} PublishStoreStats_t;
+
+/**
+ * @brief Empties the RAM ring and recovers the messages left in flash.
+ *
+ * @param[in] pxFlash The flash region, or NULL to keep messages in RAM only.
+ * The structure must stay valid while the store is used.
+ *
+ * @return pdTRUE if the store can be used, pdFALSE if the region is invalid,
+ * in which case the store keeps messages in RAM only.
+ */
+BaseType_t PublishStore_Init( const PublishStoreFlash_t * pxFlash );
+
+/**
+ * @brief Stores a message.
+ *
+ * @param[in] ucClass Priority class, below publishstoreconfigCLASSES.
+ * @param[in] pucData The message.
+ * @param[in] ulLength Size of the message, at most
+ * publishstoreconfigMAX_MESSAGE.
+ *
+ * @return pdTRUE if the message was stored, pdFALSE if it was dropped.
+ */
+BaseType_t PublishStore_Put( uint8_t ucClass,
+                             const uint8_t * pucData,
+                             uint32_t ulLength );
+
+/**
+ * @brief Copies the next message to send: the oldest of the most urgent class
+ * holding one. It stays in the store until PublishStore_Remove().
+ *
+ * @param[out] pucBuffer Receives the message; publishstoreconfigMAX_MESSAGE
+ * bytes.
+ * @param[out] pucClass Receives the class of the message. May be NULL.
+ *
+ * @return The size of the message, 0 if the store is empty.
+ */
+uint32_t PublishStore_Peek( uint8_t * pucBuffer,
+                            uint8_t * pucClass );
+
+/**
+ * @brief Removes the message returned by the last PublishStore_Peek(), once
+ * it was sent.
+ *
+ * @return pdTRUE if the message was removed, pdFALSE if there was none to
+ * remove. A message from flash whose removal cannot be recorded, for instance
+ * because the flash region is full, may be handed back again after a reset.
+ */
+BaseType_t PublishStore_Remove( void );
+
+/**
+ * @brief Counts the messages in the store.
+ *
+ * @return The number of messages.
+ */
+uint32_t PublishStore_GetCount( void );
+
+/**
+ * @brief Copies the counters of the store.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void PublishStore_GetStats( PublishStoreStats_t * pxStats );
+
+#endif /* _IOT_PUBLISH_STORE_H_ */
@@ -0,0 +1,64 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_sockets_sendv.h
+ * @brief SOCKETS_SendV() body shared by the lwIP based Secure Sockets ports.
+ *
+ * A port checks its own socket state, then hands the vectors to
+ * SocketsSendV_Send() together with its TLS context, if TLS was negotiated,
+ * and its lwIP socket.
+ */
+
+#ifndef _IOT_SOCKETS_SENDV_H_
+#define _IOT_SOCKETS_SENDV_H_
+
+#include "iot_secure_sockets.h"
+
+/**
+ * @brief Sends the concatenation of several buffers.
+ *
+ * With a TLS context the buffers go through TLS_SendV(); the port's network
+ * send callback applies ulFlags to the socket writes. Without one they are
+ * written to the socket with lwip_sendmsg(), which is passed ulFlags as is,
+ * like lwip_send() is for SOCKETS_Send().
+ *
+ * @param[in] lSocket The connected lwIP socket.
+ * @param[in] pvTlsContext The TLS context, or NULL to write to the socket directly.
+ * @param[in] pxVectors The buffers to send, in order.
+ * @param[in] xVectorCount Number of entries in pxVectors; at most
+ * socketsconfigMAX_SEND_VECTORS.
+ * @param[in] ulFlags Flags of the socket write.
+ *
+ * @return The number of bytes sent, SOCKETS_EINVAL for a bad vector list, or
+ * another negative value if the write failed.
+ */
+int32_t SocketsSendV_Send( int lSocket,
+                           void * pvTlsContext,
+                           const SocketsIoVector_t * pxVectors,
+                           size_t xVectorCount,
+                           uint32_t ulFlags );
+
+#endif /* _IOT_SOCKETS_SENDV_H_ */
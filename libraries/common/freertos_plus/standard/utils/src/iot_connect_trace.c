@@ -0,0 +1,361 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_connect_trace.c
+ * @brief Per-phase latency tracing of connection attempts.
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "iot_connect_trace.h"
+
+/**
+ * @brief Millisecond clock used for all timestamps.
+ */
+#ifndef connecttraceconfigGET_TIME_MS
+    #define connecttraceconfigGET_TIME_MS()    ( ( uint32_t ) ( xTaskGetTickCount() * portTICK_PERIOD_MS ) )
+#endif
+
+/**
+ * @brief An attempt that is still open.
+ *
+ * @param[in] xTask Task running the attempt; NULL if the slot is free.
+ * @param[in] pulOpenMs Start time of the phases currently running.
+ * @param[out] xRecord The record being built.
+ */
+typedef struct ConnectTraceActive
+{
+    TaskHandle_t xTask;
+    uint32_t pulOpenMs[ eConnectTracePhaseMax ];
+    ConnectTraceRecord_t xRecord;
+} ConnectTraceActive_t;
+
+/**
+ * @brief Short names of the phases, as used in the report line.
+ */
+static const char * const pcPhaseNames[ eConnectTracePhaseMax ] =
+{
+    "dns",
+    "tcp",
+    "cert",
+    "cred",
+    "hs",
+    "sign"
+};
+
+static ConnectTraceActive_t xActive[ connecttraceconfigMAX_ACTIVE ];
+static ConnectTraceRecord_t xRing[ connecttraceconfigRING_LENGTH ];
+static uint32_t ulRingCount = 0;
+static uint32_t ulRingHead = 0;
+static uint32_t ulAttempts = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the open attempt of the calling task.
+ *
+ * The slot is only written by its own task once claimed, so it can be used
+ * outside the critical section.
+ */
+static ConnectTraceActive_t * prvFindActive( void )
+{
+    ConnectTraceActive_t * pxActive = NULL;
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    uint32_t i;
+
+    for( i = 0; i < ( uint32_t ) connecttraceconfigMAX_ACTIVE; i++ )
+    {
+        if( xActive[ i ].xTask == xTask )
+        {
+            pxActive = &xActive[ i ];
+            break;
+        }
+    }
+
+    return pxActive;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Advance a string length by an snprintf() result, staying within the
+ * buffer even when the output was truncated.
+ */
+static size_t prvClampLength( int lWritten,
+                              size_t xLength,
+                              size_t xBufferLength )
+{
+    if( lWritten > 0 )
+    {
+        xLength += ( size_t ) lWritten;
+    }
+
+    if( xLength >= xBufferLength )
+    {
+        xLength = xBufferLength - 1U;
+    }
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectTrace_Begin( void )
+{
+    BaseType_t xOwner = pdFALSE;
+    ConnectTraceActive_t * pxActive = NULL;
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    uint32_t ulAttempt = 0;
+    uint32_t i;
+
+    if( NULL == prvFindActive() )
+    {
+        taskENTER_CRITICAL();
+
+        for( i = 0; i < ( uint32_t ) connecttraceconfigMAX_ACTIVE; i++ )
+        {
+            if( NULL == xActive[ i ].xTask )
+            {
+                pxActive = &xActive[ i ];
+                pxActive->xTask = xTask;
+                break;
+            }
+        }
+
+        ulAttempts++;
+        ulAttempt = ulAttempts;
+
+        taskEXIT_CRITICAL();
+
+        if( NULL != pxActive )
+        {
+            memset( &pxActive->xRecord, 0, sizeof( ConnectTraceRecord_t ) );
+            pxActive->xRecord.ulAttempt = ulAttempt;
+            pxActive->xRecord.ulStartMs = connecttraceconfigGET_TIME_MS();
+            xOwner = pdTRUE;
+        }
+    }
+
+    return xOwner;
+}
+
+/*-----------------------------------------------------------*/
+
+void ConnectTrace_End( BaseType_t xOwner,
+                       int32_t lStatus )
+{
+    ConnectTraceActive_t * pxActive = NULL;
+
+    #if ( connecttraceconfigLOG_ATTEMPTS == 1 )
+        char cLine[ 96 ];
+    #endif
+
+    if( pdFALSE != xOwner )
+    {
+        pxActive = prvFindActive();
+    }
+
+    if( NULL != pxActive )
+    {
+        pxActive->xRecord.ulTotalMs = connecttraceconfigGET_TIME_MS() - pxActive->xRecord.ulStartMs;
+        pxActive->xRecord.lStatus = lStatus;
+
+        #if ( connecttraceconfigLOG_ATTEMPTS == 1 )
+            ( void ) ConnectTrace_FormatRecord( &pxActive->xRecord, cLine, sizeof( cLine ) );
+            configPRINTF( ( "Connect trace: %s\r\n", cLine ) );
+        #endif
+
+        taskENTER_CRITICAL();
+
+        xRing[ ulRingHead ] = pxActive->xRecord;
+        ulRingHead = ( ulRingHead + 1U ) % ( uint32_t ) connecttraceconfigRING_LENGTH;
+
+        if( ulRingCount < ( uint32_t ) connecttraceconfigRING_LENGTH )
+        {
+            ulRingCount++;
+        }
+
+        pxActive->xTask = NULL;
+
+        taskEXIT_CRITICAL();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void ConnectTrace_PhaseStart( ConnectTracePhase_t ePhase )
+{
+    ConnectTraceActive_t * pxActive = NULL;
+    uint32_t ulNow = 0;
+
+    if( ePhase < eConnectTracePhaseMax )
+    {
+        pxActive = prvFindActive();
+    }
+
+    if( NULL != pxActive )
+    {
+        ulNow = connecttraceconfigGET_TIME_MS();
+        pxActive->pulOpenMs[ ePhase ] = ulNow;
+
+        if( 0U == ( pxActive->xRecord.ulPhaseMask & ( 1UL << ( uint32_t ) ePhase ) ) )
+        {
+            pxActive->xRecord.ulPhaseMask |= ( 1UL << ( uint32_t ) ePhase );
+            pxActive->xRecord.xSpans[ ePhase ].ulStartMs = ulNow - pxActive->xRecord.ulStartMs;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void ConnectTrace_PhaseEnd( ConnectTracePhase_t ePhase )
+{
+    ConnectTraceActive_t * pxActive = NULL;
+
+    if( ePhase < eConnectTracePhaseMax )
+    {
+        pxActive = prvFindActive();
+    }
+
+    if( ( NULL != pxActive ) &&
+        ( 0U != ( pxActive->xRecord.ulPhaseMask & ( 1UL << ( uint32_t ) ePhase ) ) ) )
+    {
+        pxActive->xRecord.xSpans[ ePhase ].ulDurationMs += connecttraceconfigGET_TIME_MS() -
+                                                           pxActive->pulOpenMs[ ePhase ];
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ConnectTrace_GetRecords( ConnectTraceRecord_t * pxRecords,
+                                  uint32_t ulMaxRecords )
+{
+    uint32_t ulCopied = 0;
+    uint32_t ulIndex;
+
+    if( NULL != pxRecords )
+    {
+        taskENTER_CRITICAL();
+
+        ulIndex = ulRingHead;
+
+        while( ( ulCopied < ulMaxRecords ) && ( ulCopied < ulRingCount ) )
+        {
+            ulIndex = ( ulIndex + ( uint32_t ) connecttraceconfigRING_LENGTH - 1U ) %
+                      ( uint32_t ) connecttraceconfigRING_LENGTH;
+            pxRecords[ ulCopied ] = xRing[ ulIndex ];
+            ulCopied++;
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    return ulCopied;
+}
+
+/*-----------------------------------------------------------*/
+
+void ConnectTrace_Clear( void )
+{
+    taskENTER_CRITICAL();
+    ulRingCount = 0;
+    ulRingHead = 0;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+size_t ConnectTrace_FormatRecord( const ConnectTraceRecord_t * pxRecord,
+                                  char * pcBuffer,
+                                  size_t xBufferLength )
+{
+    size_t xLength = 0;
+    int lWritten = 0;
+    uint32_t i;
+
+    if( ( NULL != pxRecord ) && ( NULL != pcBuffer ) && ( xBufferLength > 0U ) )
+    {
+        lWritten = snprintf( pcBuffer, xBufferLength, "#%u rc=%d total=%u",
+                             ( unsigned ) pxRecord->ulAttempt,
+                             ( int ) pxRecord->lStatus,
+                             ( unsigned ) pxRecord->ulTotalMs );
+        xLength = prvClampLength( lWritten, 0U, xBufferLength );
+
+        for( i = 0; i < ( uint32_t ) eConnectTracePhaseMax; i++ )
+        {
+            if( 0U != ( pxRecord->ulPhaseMask & ( 1UL << i ) ) )
+            {
+                lWritten = snprintf( &pcBuffer[ xLength ], xBufferLength - xLength, " %s=%u",
+                                     pcPhaseNames[ i ],
+                                     ( unsigned ) pxRecord->xSpans[ i ].ulDurationMs );
+                xLength = prvClampLength( lWritten, xLength, xBufferLength );
+            }
+        }
+    }
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+void ConnectTrace_PrintReport( void )
+{
+    ConnectTraceRecord_t xRecord;
+    char cLine[ 96 ];
+    uint32_t ulIndex;
+    uint32_t ulSlot;
+    BaseType_t xFound;
+
+    for( ulIndex = 0; ulIndex < ( uint32_t ) connecttraceconfigRING_LENGTH; ulIndex++ )
+    {
+        /* Copy one record at a time to keep the critical section short. */
+        taskENTER_CRITICAL();
+
+        xFound = ( ulIndex < ulRingCount ) ? pdTRUE : pdFALSE;
+
+        if( pdFALSE != xFound )
+        {
+            ulSlot = ( ulRingHead + ( uint32_t ) connecttraceconfigRING_LENGTH - 1U - ulIndex ) %
+                     ( uint32_t ) connecttraceconfigRING_LENGTH;
+            xRecord = xRing[ ulSlot ];
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( pdFALSE == xFound )
+        {
+            break;
+        }
+
+        ( void ) ConnectTrace_FormatRecord( &xRecord, cLine, sizeof( cLine ) );
+        configPRINTF( ( "Connect trace: %s\r\n", cLine ) );
+    }
+}
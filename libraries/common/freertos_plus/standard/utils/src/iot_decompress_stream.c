@@ -0,0 +1,464 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_decompress_stream.c
+ * @brief Streaming decompression of heatshrink data.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "iot_decompress_stream.h"
+
+#if ( decompressstreamconfigWINDOW_BITS < 4 ) || ( decompressstreamconfigWINDOW_BITS > 15 )
+    #error "decompressstreamconfigWINDOW_BITS must be between 4 and 15"
+#endif
+
+#if ( decompressstreamconfigLOOKAHEAD_BITS < 3 ) || ( decompressstreamconfigLOOKAHEAD_BITS >= decompressstreamconfigWINDOW_BITS )
+    #error "decompressstreamconfigLOOKAHEAD_BITS must be between 3 and decompressstreamconfigWINDOW_BITS - 1"
+#endif
+
+#define decompressstreamWINDOW_MASK    ( decompressstreamWINDOW_SIZE - 1U )
+
+/* Decoder states: the next bits are a tag, a literal byte, or the index or the
+ * count of a back reference. */
+#define decompressstreamSTATE_TAG         ( 0U )
+#define decompressstreamSTATE_LITERAL     ( 1U )
+#define decompressstreamSTATE_INDEX       ( 2U )
+#define decompressstreamSTATE_COUNT       ( 3U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Take bits from the input, most significant first.
+ *
+ * @return pdFALSE if the input ran out first; the bits taken so far are kept
+ * for the next call.
+ */
+static BaseType_t prvGetBits( DecompressStreamContext_t * pxContext,
+                              const uint8_t ** ppucData,
+                              uint32_t * pulLength,
+                              uint8_t ucCount,
+                              uint32_t * pulValue )
+{
+    BaseType_t xResult = pdTRUE;
+
+    while( ( pdFALSE != xResult ) && ( pxContext->ucBitCount < ucCount ) )
+    {
+        if( 0U == *pulLength )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            pxContext->ulBits = ( pxContext->ulBits << 8 ) | **ppucData;
+            pxContext->ucBitCount += 8U;
+            ( *ppucData )++;
+            ( *pulLength )--;
+            pxContext->xStats.ulInputBytes++;
+        }
+    }
+
+    if( pdFALSE != xResult )
+    {
+        pxContext->ucBitCount -= ucCount;
+        *pulValue = ( pxContext->ulBits >> pxContext->ucBitCount ) & ( ( 1UL << ucCount ) - 1UL );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Write the output block and start the next one.
+ */
+static DecompressStreamStatus_t prvWriteBlock( DecompressStreamContext_t * pxContext )
+{
+    DecompressStreamStatus_t xStatus = DecompressStreamSuccess;
+    TickType_t xStart = xTaskGetTickCount();
+
+    if( pdFALSE == pxContext->xWrite( pxContext->pvCallbackContext,
+                                      pxContext->ulBlockOffset,
+                                      pxContext->pucBlock,
+                                      pxContext->ulBlockFill ) )
+    {
+        xStatus = DecompressStreamWriteError;
+    }
+
+    pxContext->xCallbackTicks += xTaskGetTickCount() - xStart;
+    pxContext->ulBlockOffset += pxContext->ulBlockFill;
+    pxContext->ulBlockFill = 0;
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Output a byte and remember it in the window.
+ */
+static DecompressStreamStatus_t prvOutput( DecompressStreamContext_t * pxContext,
+                                          uint8_t ucByte )
+{
+    DecompressStreamStatus_t xStatus = DecompressStreamSuccess;
+
+    pxContext->ucWindow[ pxContext->ulHead & decompressstreamWINDOW_MASK ] = ucByte;
+    pxContext->ulHead++;
+    pxContext->pucBlock[ pxContext->ulBlockFill ] = ucByte;
+    pxContext->ulBlockFill++;
+    pxContext->xStats.ulOutputBytes++;
+
+    if( pxContext->ulBlockFill == pxContext->ulBlockSize )
+    {
+        xStatus = prvWriteBlock( pxContext );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Decode input at the stream position.
+ */
+static DecompressStreamStatus_t prvDecode( DecompressStreamContext_t * pxContext,
+                                           const uint8_t * pucData,
+                                           uint32_t ulLength )
+{
+    DecompressStreamStatus_t xStatus = DecompressStreamSuccess;
+    BaseType_t xMore = pdTRUE;
+    uint32_t ulValue = 0;
+    uint32_t i;
+
+    pxContext->ulInputOffset += ulLength;
+
+    while( ( DecompressStreamSuccess == xStatus ) && ( pdFALSE != xMore ) )
+    {
+        switch( pxContext->ucState )
+        {
+            case decompressstreamSTATE_TAG:
+                xMore = prvGetBits( pxContext, &pucData, &ulLength, 1U, &ulValue );
+
+                if( pdFALSE != xMore )
+                {
+                    pxContext->ucState = ( 0U != ulValue ) ? decompressstreamSTATE_LITERAL : decompressstreamSTATE_INDEX;
+                }
+
+                break;
+
+            case decompressstreamSTATE_LITERAL:
+                xMore = prvGetBits( pxContext, &pucData, &ulLength, 8U, &ulValue );
+
+                if( pdFALSE != xMore )
+                {
+                    xStatus = prvOutput( pxContext, ( uint8_t ) ulValue );
+                    pxContext->ucState = decompressstreamSTATE_TAG;
+                }
+
+                break;
+
+            case decompressstreamSTATE_INDEX:
+                xMore = prvGetBits( pxContext, &pucData, &ulLength, ( uint8_t ) decompressstreamconfigWINDOW_BITS, &ulValue );
+
+                if( pdFALSE != xMore )
+                {
+                    pxContext->ulBackrefIndex = ulValue + 1U;
+                    pxContext->ucState = decompressstreamSTATE_COUNT;
+                }
+
+                break;
+
+            case decompressstreamSTATE_COUNT:
+                xMore = prvGetBits( pxContext, &pucData, &ulLength, ( uint8_t ) decompressstreamconfigLOOKAHEAD_BITS, &ulValue );
+
+                if( pdFALSE != xMore )
+                {
+                    for( i = 0; ( i <= ulValue ) && ( DecompressStreamSuccess == xStatus ); i++ )
+                    {
+                        xStatus = prvOutput( pxContext,
+                                             pxContext->ucWindow[ ( pxContext->ulHead - pxContext->ulBackrefIndex ) & decompressstreamWINDOW_MASK ] );
+                    }
+
+                    pxContext->ucState = decompressstreamSTATE_TAG;
+                }
+
+                break;
+
+            default:
+                pxContext->ucState = decompressstreamSTATE_TAG;
+                break;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Decode the part of a block past the stream position, if the block
+ * reaches it.
+ *
+ * @return pdTRUE if the block is used up, pdFALSE if it starts past the
+ * stream position.
+ */
+static BaseType_t prvDecodeFromPosition( DecompressStreamContext_t * pxContext,
+                                         uint32_t ulOffset,
+                                         const uint8_t * pucData,
+                                         uint32_t ulLength,
+                                         DecompressStreamStatus_t * pxStatus )
+{
+    BaseType_t xUsed = pdTRUE;
+    uint32_t ulSkip;
+
+    if( ulOffset > pxContext->ulInputOffset )
+    {
+        xUsed = pdFALSE;
+    }
+    else
+    {
+        ulSkip = pxContext->ulInputOffset - ulOffset;
+
+        /* Blocks received again are dropped. */
+        if( ulSkip < ulLength )
+        {
+            *pxStatus = prvDecode( pxContext, &pucData[ ulSkip ], ulLength - ulSkip );
+        }
+    }
+
+    return xUsed;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Keep a copy of a block that arrived ahead of the stream position.
+ */
+static DecompressStreamStatus_t prvHold( DecompressStreamContext_t * pxContext,
+                                         uint32_t ulOffset,
+                                         const uint8_t * pucData,
+                                         uint32_t ulLength )
+{
+    DecompressStreamStatus_t xStatus = DecompressStreamOutOfOrder;
+    DecompressStreamHeldBlock_t * pxFree = NULL;
+    uint32_t i;
+
+    for( i = 0; i < ( uint32_t ) decompressstreamconfigHELD_BLOCKS; i++ )
+    {
+        if( 0U == pxContext->xHeld[ i ].ulLength )
+        {
+            if( NULL == pxFree )
+            {
+                pxFree = &pxContext->xHeld[ i ];
+            }
+        }
+        else if( ulOffset == pxContext->xHeld[ i ].ulOffset )
+        {
+            /* Already held. */
+            xStatus = DecompressStreamSuccess;
+            pxFree = NULL;
+            break;
+        }
+        else
+        {
+            /* Keep looking. */
+        }
+    }
+
+    if( ( NULL != pxFree ) && ( ulLength <= pxContext->ulHeldSize ) )
+    {
+        memcpy( pxFree->pucData, pucData, ulLength );
+        pxFree->ulOffset = ulOffset;
+        pxFree->ulLength = ulLength;
+        pxContext->xStats.ulHeldBlocks++;
+        xStatus = DecompressStreamSuccess;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+DecompressStreamStatus_t DecompressStream_Init( DecompressStreamContext_t * pxContext,
+                                                uint32_t ulBlockSize,
+                                                uint32_t ulMaxInputBlock,
+                                                DecompressStreamWrite_t xWrite,
+                                                void * pvCallbackContext )
+{
+    DecompressStreamStatus_t xStatus = DecompressStreamBadParameter;
+    uint32_t i;
+
+    if( ( NULL != pxContext ) && ( NULL != xWrite ) && ( 0U != ulBlockSize ) )
+    {
+        memset( pxContext, 0, sizeof( DecompressStreamContext_t ) );
+        pxContext->xWrite = xWrite;
+        pxContext->pvCallbackContext = pvCallbackContext;
+        pxContext->ulBlockSize = ulBlockSize;
+        pxContext->ulHeldSize = ulMaxInputBlock;
+        pxContext->ucState = decompressstreamSTATE_TAG;
+        pxContext->pucBlock = pvPortMalloc( ulBlockSize );
+        xStatus = ( NULL != pxContext->pucBlock ) ? DecompressStreamSuccess : DecompressStreamNoMemory;
+
+        for( i = 0; ( i < ( uint32_t ) decompressstreamconfigHELD_BLOCKS ) && ( DecompressStreamSuccess == xStatus ); i++ )
+        {
+            if( 0U != ulMaxInputBlock )
+            {
+                pxContext->xHeld[ i ].pucData = pvPortMalloc( ulMaxInputBlock );
+
+                if( NULL == pxContext->xHeld[ i ].pucData )
+                {
+                    xStatus = DecompressStreamNoMemory;
+                }
+            }
+        }
+
+        if( DecompressStreamSuccess != xStatus )
+        {
+            DecompressStream_Free( pxContext );
+        }
+
+        pxContext->xError = xStatus;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+DecompressStreamStatus_t DecompressStream_Write( DecompressStreamContext_t * pxContext,
+                                                 uint32_t ulOffset,
+                                                 const uint8_t * pucData,
+                                                 uint32_t ulLength )
+{
+    DecompressStreamStatus_t xStatus = DecompressStreamBadParameter;
+    BaseType_t xProgress = pdTRUE;
+    DecompressStreamHeldBlock_t * pxHeld = NULL;
+    TickType_t xStart = xTaskGetTickCount();
+    uint32_t i;
+
+    if( ( NULL != pxContext ) && ( ( NULL != pucData ) || ( 0U == ulLength ) ) )
+    {
+        xStatus = pxContext->xError;
+        pxContext->xCallbackTicks = 0;
+
+        if( DecompressStreamSuccess == xStatus )
+        {
+            if( pdFALSE == prvDecodeFromPosition( pxContext, ulOffset, pucData, ulLength, &xStatus ) )
+            {
+                xStatus = prvHold( pxContext, ulOffset, pucData, ulLength );
+                xProgress = pdFALSE;
+            }
+
+            /* The block may have filled the gap before held blocks. */
+            while( ( DecompressStreamSuccess == xStatus ) && ( pdFALSE != xProgress ) )
+            {
+                xProgress = pdFALSE;
+
+                for( i = 0; ( i < ( uint32_t ) decompressstreamconfigHELD_BLOCKS ) && ( DecompressStreamSuccess == xStatus ); i++ )
+                {
+                    pxHeld = &pxContext->xHeld[ i ];
+
+                    if( ( 0U != pxHeld->ulLength ) &&
+                        ( pdFALSE != prvDecodeFromPosition( pxContext, pxHeld->ulOffset, pxHeld->pucData, pxHeld->ulLength, &xStatus ) ) )
+                    {
+                        pxHeld->ulLength = 0;
+                        xProgress = pdTRUE;
+                    }
+                }
+            }
+
+            pxContext->xError = xStatus;
+        }
+
+        pxContext->xStats.ulDecodeTicks += ( xTaskGetTickCount() - xStart ) - pxContext->xCallbackTicks;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+DecompressStreamStatus_t DecompressStream_Finish( DecompressStreamContext_t * pxContext )
+{
+    DecompressStreamStatus_t xStatus = DecompressStreamBadParameter;
+
+    if( NULL != pxContext )
+    {
+        xStatus = pxContext->xError;
+
+        if( ( DecompressStreamSuccess == xStatus ) && ( 0U != pxContext->ulBlockFill ) )
+        {
+            xStatus = prvWriteBlock( pxContext );
+            pxContext->xError = xStatus;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void DecompressStream_Free( DecompressStreamContext_t * pxContext )
+{
+    uint32_t i;
+
+    if( NULL != pxContext )
+    {
+        for( i = 0; i < ( uint32_t ) decompressstreamconfigHELD_BLOCKS; i++ )
+        {
+            if( NULL != pxContext->xHeld[ i ].pucData )
+            {
+                vPortFree( pxContext->xHeld[ i ].pucData );
+                pxContext->xHeld[ i ].pucData = NULL;
+            }
+
+            pxContext->xHeld[ i ].ulLength = 0;
+        }
+
+        if( NULL != pxContext->pucBlock )
+        {
+            vPortFree( pxContext->pucBlock );
+            pxContext->pucBlock = NULL;
+        }
+
+        pxContext->xError = DecompressStreamBadParameter;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void DecompressStream_GetStats( const DecompressStreamContext_t * pxContext,
+                                DecompressStreamStats_t * pxStats )
+{
+    if( ( NULL != pxContext ) && ( NULL != pxStats ) )
+    {
+        *pxStats = pxContext->xStats;
+    }
+}
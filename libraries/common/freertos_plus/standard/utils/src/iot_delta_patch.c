@@ -0,0 +1,650 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_delta_patch.c
+ * @brief Streaming application of binary patches.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "iot_delta_patch.h"
+
+/* Patch commands. */
+#define deltapatchOP_COPY            ( 0x01U )
+#define deltapatchOP_ADD             ( 0x02U )
+#define deltapatchOP_INSERT          ( 0x03U )
+#define deltapatchOP_SEEK            ( 0x04U )
+
+/* Parser states. */
+#define deltapatchSTATE_HEADER       ( 0U )
+#define deltapatchSTATE_OPCODE       ( 1U )
+#define deltapatchSTATE_ARGUMENT     ( 2U )
+#define deltapatchSTATE_ADD_DATA     ( 3U )
+#define deltapatchSTATE_INSERT_DATA  ( 4U )
+
+static const uint8_t ucMagic[ 4 ] = { 'A', 'D', 'P', '1' };
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvReadLE32( const uint8_t * pucData )
+{
+    return ( uint32_t ) pucData[ 0 ] |
+           ( ( uint32_t ) pucData[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucData[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucData[ 3 ] << 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add data to the target block, writing the block once it is full.
+ */
+static DeltaPatchStatus_t prvEmit( DeltaPatchContext_t * pxContext,
+                                   const uint8_t * pucData,
+                                   uint32_t ulLength )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchSuccess;
+    uint32_t ulChunk;
+
+    while( ( DeltaPatchSuccess == xStatus ) && ( ulLength > 0U ) )
+    {
+        ulChunk = pxContext->ulBlockSize - pxContext->ulBlockFill;
+
+        if( ulChunk > ulLength )
+        {
+            ulChunk = ulLength;
+        }
+
+        memcpy( &pxContext->pucTargetBlock[ pxContext->ulBlockFill ], pucData, ulChunk );
+        pxContext->ulBlockFill += ulChunk;
+        pxContext->ulTargetPosition += ulChunk;
+        pucData += ulChunk;
+        ulLength -= ulChunk;
+
+        if( pxContext->ulBlockFill == pxContext->ulBlockSize )
+        {
+            if( pdFALSE == pxContext->xWriteTarget( pxContext->pvCallbackContext,
+                                                    pxContext->ulBlockOffset,
+                                                    pxContext->pucTargetBlock,
+                                                    pxContext->ulBlockSize ) )
+            {
+                xStatus = DeltaPatchTargetError;
+            }
+
+            pxContext->ulBlockOffset += pxContext->ulBlockSize;
+            pxContext->ulBlockFill = 0;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read up to one source buffer at the source position.
+ */
+static DeltaPatchStatus_t prvReadSource( DeltaPatchContext_t * pxContext,
+                                         uint32_t ulLength )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchSuccess;
+
+    if( pdFALSE == pxContext->xReadSource( pxContext->pvCallbackContext,
+                                           pxContext->ulSourcePosition,
+                                           pxContext->ucSource,
+                                           ulLength ) )
+    {
+        xStatus = DeltaPatchSourceError;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Check that a command producing target bytes stays in both images.
+ */
+static BaseType_t prvFits( const DeltaPatchContext_t * pxContext,
+                           uint32_t ulLength,
+                           BaseType_t xReadsSource )
+{
+    BaseType_t xFits = pdTRUE;
+
+    if( ulLength > ( pxContext->xStats.ulTargetSize - pxContext->ulTargetPosition ) )
+    {
+        xFits = pdFALSE;
+    }
+    else if( ( pdFALSE != xReadsSource ) &&
+             ( ulLength > ( pxContext->xStats.ulSourceSize - pxContext->ulSourcePosition ) ) )
+    {
+        xFits = pdFALSE;
+    }
+
+    return xFits;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Run a command once its argument is complete.
+ */
+static DeltaPatchStatus_t prvStartCommand( DeltaPatchContext_t * pxContext )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchSuccess;
+    uint32_t ulLength = pxContext->ulArgument;
+    uint32_t ulChunk;
+
+    pxContext->ucState = deltapatchSTATE_OPCODE;
+
+    switch( pxContext->ucOpcode )
+    {
+        case deltapatchOP_COPY:
+
+            if( pdFALSE == prvFits( pxContext, ulLength, pdTRUE ) )
+            {
+                xStatus = DeltaPatchInvalid;
+            }
+
+            while( ( DeltaPatchSuccess == xStatus ) && ( ulLength > 0U ) )
+            {
+                ulChunk = ( ulLength < ( uint32_t ) deltapatchconfigSOURCE_BUFFER_SIZE ) ?
+                          ulLength : ( uint32_t ) deltapatchconfigSOURCE_BUFFER_SIZE;
+                xStatus = prvReadSource( pxContext, ulChunk );
+
+                if( DeltaPatchSuccess == xStatus )
+                {
+                    pxContext->ulSourcePosition += ulChunk;
+                    pxContext->xStats.ulCopied += ulChunk;
+                    ulLength -= ulChunk;
+                    xStatus = prvEmit( pxContext, pxContext->ucSource, ulChunk );
+                }
+            }
+
+            break;
+
+        case deltapatchOP_ADD:
+        case deltapatchOP_INSERT:
+
+            if( pdFALSE == prvFits( pxContext, ulLength, ( deltapatchOP_ADD == pxContext->ucOpcode ) ? pdTRUE : pdFALSE ) )
+            {
+                xStatus = DeltaPatchInvalid;
+            }
+            else if( ulLength > 0U )
+            {
+                pxContext->ulRemaining = ulLength;
+                pxContext->ucState = ( deltapatchOP_ADD == pxContext->ucOpcode ) ?
+                                     deltapatchSTATE_ADD_DATA : deltapatchSTATE_INSERT_DATA;
+            }
+            else
+            {
+                /* Nothing to do. */
+            }
+
+            break;
+
+        case deltapatchOP_SEEK:
+
+            /* Zigzag: odd arguments move back by ( n + 1 ) / 2, even ones
+             * forward by n / 2. */
+            if( 0U != ( ulLength & 1U ) )
+            {
+                ulChunk = ( ulLength >> 1 ) + 1U;
+
+                if( ulChunk > pxContext->ulSourcePosition )
+                {
+                    xStatus = DeltaPatchInvalid;
+                }
+                else
+                {
+                    pxContext->ulSourcePosition -= ulChunk;
+                }
+            }
+            else
+            {
+                ulChunk = ulLength >> 1;
+
+                if( ulChunk > ( pxContext->xStats.ulSourceSize - pxContext->ulSourcePosition ) )
+                {
+                    xStatus = DeltaPatchInvalid;
+                }
+                else
+                {
+                    pxContext->ulSourcePosition += ulChunk;
+                }
+            }
+
+            break;
+
+        default:
+            xStatus = DeltaPatchInvalid;
+            break;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Apply patch bytes at the patch position.
+ */
+static DeltaPatchStatus_t prvApply( DeltaPatchContext_t * pxContext,
+                                    const uint8_t * pucData,
+                                    uint32_t ulLength )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchSuccess;
+    uint32_t ulChunk;
+    uint32_t i;
+
+    pxContext->ulPatchOffset += ulLength;
+
+    while( ( DeltaPatchSuccess == xStatus ) && ( ulLength > 0U ) )
+    {
+        switch( pxContext->ucState )
+        {
+            case deltapatchSTATE_HEADER:
+                ulChunk = deltapatchHEADER_SIZE - pxContext->ulRemaining;
+
+                if( ulChunk > ulLength )
+                {
+                    ulChunk = ulLength;
+                }
+
+                memcpy( &pxContext->ucHeader[ pxContext->ulRemaining ], pucData, ulChunk );
+                pxContext->ulRemaining += ulChunk;
+                pucData += ulChunk;
+                ulLength -= ulChunk;
+
+                if( deltapatchHEADER_SIZE == pxContext->ulRemaining )
+                {
+                    pxContext->ulRemaining = 0;
+                    pxContext->xStats.ulSourceSize = prvReadLE32( &pxContext->ucHeader[ 4 ] );
+                    pxContext->xStats.ulTargetSize = prvReadLE32( &pxContext->ucHeader[ 8 ] );
+                    pxContext->ucState = deltapatchSTATE_OPCODE;
+
+                    if( ( 0 != memcmp( pxContext->ucHeader, ucMagic, sizeof( ucMagic ) ) ) ||
+                        ( pxContext->xStats.ulSourceSize > pxContext->ulSourceLimit ) )
+                    {
+                        xStatus = DeltaPatchInvalid;
+                    }
+                }
+
+                break;
+
+            case deltapatchSTATE_OPCODE:
+
+                /* Nothing may follow the end of the target. */
+                if( pxContext->ulTargetPosition == pxContext->xStats.ulTargetSize )
+                {
+                    xStatus = DeltaPatchInvalid;
+                }
+                else
+                {
+                    pxContext->ucOpcode = *pucData;
+                    pxContext->ulArgument = 0;
+                    pxContext->ucShift = 0;
+                    pxContext->ucState = deltapatchSTATE_ARGUMENT;
+                    pucData++;
+                    ulLength--;
+                }
+
+                break;
+
+            case deltapatchSTATE_ARGUMENT:
+
+                if( ( pxContext->ucShift > 28U ) ||
+                    ( ( 28U == pxContext->ucShift ) && ( ( *pucData & 0x70U ) != 0U ) ) )
+                {
+                    xStatus = DeltaPatchInvalid;
+                }
+                else
+                {
+                    pxContext->ulArgument |= ( uint32_t ) ( *pucData & 0x7FU ) << pxContext->ucShift;
+                    pxContext->ucShift += 7U;
+
+                    if( 0U == ( *pucData & 0x80U ) )
+                    {
+                        xStatus = prvStartCommand( pxContext );
+                    }
+
+                    pucData++;
+                    ulLength--;
+                }
+
+                break;
+
+            case deltapatchSTATE_ADD_DATA:
+                ulChunk = ( ulLength < pxContext->ulRemaining ) ? ulLength : pxContext->ulRemaining;
+
+                if( ulChunk > ( uint32_t ) deltapatchconfigSOURCE_BUFFER_SIZE )
+                {
+                    ulChunk = ( uint32_t ) deltapatchconfigSOURCE_BUFFER_SIZE;
+                }
+
+                xStatus = prvReadSource( pxContext, ulChunk );
+
+                if( DeltaPatchSuccess == xStatus )
+                {
+                    for( i = 0; i < ulChunk; i++ )
+                    {
+                        pxContext->ucSource[ i ] = ( uint8_t ) ( pxContext->ucSource[ i ] + pucData[ i ] );
+                    }
+
+                    pxContext->ulSourcePosition += ulChunk;
+                    pxContext->xStats.ulAdded += ulChunk;
+                    xStatus = prvEmit( pxContext, pxContext->ucSource, ulChunk );
+                }
+
+                pxContext->ulRemaining -= ulChunk;
+                pucData += ulChunk;
+                ulLength -= ulChunk;
+
+                if( 0U == pxContext->ulRemaining )
+                {
+                    pxContext->ucState = deltapatchSTATE_OPCODE;
+                }
+
+                break;
+
+            case deltapatchSTATE_INSERT_DATA:
+                ulChunk = ( ulLength < pxContext->ulRemaining ) ? ulLength : pxContext->ulRemaining;
+                pxContext->xStats.ulInserted += ulChunk;
+                xStatus = prvEmit( pxContext, pucData, ulChunk );
+                pxContext->ulRemaining -= ulChunk;
+                pucData += ulChunk;
+                ulLength -= ulChunk;
+
+                if( 0U == pxContext->ulRemaining )
+                {
+                    pxContext->ucState = deltapatchSTATE_OPCODE;
+                }
+
+                break;
+
+            default:
+                xStatus = DeltaPatchInvalid;
+                break;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Apply the part of a block past the patch position, if the block
+ * reaches it.
+ *
+ * @return pdTRUE if the block is used up, pdFALSE if it starts past the
+ * patch position.
+ */
+static BaseType_t prvApplyFromPosition( DeltaPatchContext_t * pxContext,
+                                        uint32_t ulOffset,
+                                        const uint8_t * pucData,
+                                        uint32_t ulLength,
+                                        DeltaPatchStatus_t * pxStatus )
+{
+    BaseType_t xUsed = pdTRUE;
+    uint32_t ulSkip;
+
+    if( ulOffset > pxContext->ulPatchOffset )
+    {
+        xUsed = pdFALSE;
+    }
+    else
+    {
+        ulSkip = pxContext->ulPatchOffset - ulOffset;
+
+        /* Blocks received again are dropped. */
+        if( ulSkip < ulLength )
+        {
+            *pxStatus = prvApply( pxContext, &pucData[ ulSkip ], ulLength - ulSkip );
+        }
+    }
+
+    return xUsed;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Keep a copy of a block that arrived ahead of the patch position.
+ */
+static DeltaPatchStatus_t prvHold( DeltaPatchContext_t * pxContext,
+                                   uint32_t ulOffset,
+                                   const uint8_t * pucData,
+                                   uint32_t ulLength )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchOutOfOrder;
+    DeltaPatchHeldBlock_t * pxFree = NULL;
+    uint32_t i;
+
+    for( i = 0; i < ( uint32_t ) deltapatchconfigHELD_BLOCKS; i++ )
+    {
+        if( NULL == pxContext->xHeld[ i ].pucData )
+        {
+            if( NULL == pxFree )
+            {
+                pxFree = &pxContext->xHeld[ i ];
+            }
+        }
+        else if( ulOffset == pxContext->xHeld[ i ].ulOffset )
+        {
+            /* Already held. */
+            xStatus = DeltaPatchSuccess;
+            pxFree = NULL;
+            break;
+        }
+        else
+        {
+            /* Keep looking. */
+        }
+    }
+
+    if( NULL != pxFree )
+    {
+        pxFree->pucData = pvPortMalloc( ulLength );
+
+        if( NULL == pxFree->pucData )
+        {
+            xStatus = DeltaPatchNoMemory;
+        }
+        else
+        {
+            memcpy( pxFree->pucData, pucData, ulLength );
+            pxFree->ulOffset = ulOffset;
+            pxFree->ulLength = ulLength;
+            pxContext->xStats.ulHeldBlocks++;
+            xStatus = DeltaPatchSuccess;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+DeltaPatchStatus_t DeltaPatch_Init( DeltaPatchContext_t * pxContext,
+                                    uint32_t ulSourceLimit,
+                                    uint32_t ulBlockSize,
+                                    DeltaPatchReadSource_t xReadSource,
+                                    DeltaPatchWriteTarget_t xWriteTarget,
+                                    void * pvCallbackContext )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchBadParameter;
+
+    if( ( NULL != pxContext ) && ( NULL != xReadSource ) && ( NULL != xWriteTarget ) && ( 0U != ulBlockSize ) )
+    {
+        memset( pxContext, 0, sizeof( DeltaPatchContext_t ) );
+        pxContext->xReadSource = xReadSource;
+        pxContext->xWriteTarget = xWriteTarget;
+        pxContext->pvCallbackContext = pvCallbackContext;
+        pxContext->ulSourceLimit = ulSourceLimit;
+        pxContext->ulBlockSize = ulBlockSize;
+        pxContext->ucState = deltapatchSTATE_HEADER;
+        pxContext->pucTargetBlock = pvPortMalloc( ulBlockSize );
+
+        xStatus = ( NULL != pxContext->pucTargetBlock ) ? DeltaPatchSuccess : DeltaPatchNoMemory;
+        pxContext->xError = xStatus;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+DeltaPatchStatus_t DeltaPatch_Write( DeltaPatchContext_t * pxContext,
+                                     uint32_t ulOffset,
+                                     const uint8_t * pucData,
+                                     uint32_t ulLength )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchBadParameter;
+    BaseType_t xProgress = pdTRUE;
+    DeltaPatchHeldBlock_t * pxHeld = NULL;
+    uint32_t i;
+
+    if( ( NULL != pxContext ) && ( ( NULL != pucData ) || ( 0U == ulLength ) ) )
+    {
+        xStatus = pxContext->xError;
+
+        if( DeltaPatchSuccess == xStatus )
+        {
+            if( pdFALSE == prvApplyFromPosition( pxContext, ulOffset, pucData, ulLength, &xStatus ) )
+            {
+                xStatus = prvHold( pxContext, ulOffset, pucData, ulLength );
+                xProgress = pdFALSE;
+            }
+
+            /* The block may have filled the gap before held blocks. */
+            while( ( DeltaPatchSuccess == xStatus ) && ( pdFALSE != xProgress ) )
+            {
+                xProgress = pdFALSE;
+
+                for( i = 0; ( i < ( uint32_t ) deltapatchconfigHELD_BLOCKS ) && ( DeltaPatchSuccess == xStatus ); i++ )
+                {
+                    pxHeld = &pxContext->xHeld[ i ];
+
+                    if( ( NULL != pxHeld->pucData ) &&
+                        ( pdFALSE != prvApplyFromPosition( pxContext, pxHeld->ulOffset, pxHeld->pucData, pxHeld->ulLength, &xStatus ) ) )
+                    {
+                        vPortFree( pxHeld->pucData );
+                        pxHeld->pucData = NULL;
+                        xProgress = pdTRUE;
+                    }
+                }
+            }
+
+            pxContext->xError = xStatus;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+DeltaPatchStatus_t DeltaPatch_Finish( DeltaPatchContext_t * pxContext )
+{
+    DeltaPatchStatus_t xStatus = DeltaPatchBadParameter;
+
+    if( NULL != pxContext )
+    {
+        xStatus = pxContext->xError;
+
+        if( DeltaPatchSuccess == xStatus )
+        {
+            if( ( deltapatchSTATE_OPCODE != pxContext->ucState ) ||
+                ( pxContext->ulTargetPosition != pxContext->xStats.ulTargetSize ) )
+            {
+                xStatus = DeltaPatchIncomplete;
+            }
+            else if( 0U != pxContext->ulBlockFill )
+            {
+                if( pdFALSE == pxContext->xWriteTarget( pxContext->pvCallbackContext,
+                                                        pxContext->ulBlockOffset,
+                                                        pxContext->pucTargetBlock,
+                                                        pxContext->ulBlockFill ) )
+                {
+                    xStatus = DeltaPatchTargetError;
+                }
+
+                pxContext->ulBlockOffset += pxContext->ulBlockFill;
+                pxContext->ulBlockFill = 0;
+            }
+            else
+            {
+                /* The target ended on a block boundary. */
+            }
+
+            pxContext->xError = xStatus;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void DeltaPatch_Free( DeltaPatchContext_t * pxContext )
+{
+    uint32_t i;
+
+    if( NULL != pxContext )
+    {
+        for( i = 0; i < ( uint32_t ) deltapatchconfigHELD_BLOCKS; i++ )
+        {
+            if( NULL != pxContext->xHeld[ i ].pucData )
+            {
+                vPortFree( pxContext->xHeld[ i ].pucData );
+                pxContext->xHeld[ i ].pucData = NULL;
+            }
+        }
+
+        if( NULL != pxContext->pucTargetBlock )
+        {
+            vPortFree( pxContext->pucTargetBlock );
+            pxContext->pucTargetBlock = NULL;
+        }
+
+        pxContext->xError = DeltaPatchBadParameter;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void DeltaPatch_GetStats( const DeltaPatchContext_t * pxContext,
+                          DeltaPatchStats_t * pxStats )
+{
+    if( ( NULL != pxContext ) && ( NULL != pxStats ) )
+    {
+        *pxStats = pxContext->xStats;
+    }
+}
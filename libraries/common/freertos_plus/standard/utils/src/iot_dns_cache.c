@@ -0,0 +1,416 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file iot_dns_cache.c
+ * @brief Host name resolution cache.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "iot_dns_cache.h"
+
+/**
+ * @brief Millisecond clock used for the age of the entries.
+ */
+#ifndef dnscacheconfigGET_TIME_MS
+    #define dnscacheconfigGET_TIME_MS()    ( ( uint32_t ) ( xTaskGetTickCount() * portTICK_PERIOD_MS ) )
+#endif
+
+/**
+ * @brief A cached address.
+ *
+ * @param[in] cHostName The host name; empty if the entry is free.
+ * @param[in] ulAddress The address the host name resolved to.
+ * @param[in] ulResolvedMs Time of the resolution.
+ * @param[in] ulUsedMs Time of the last lookup, used to pick the entry to evict.
+ */
+typedef struct DnsCacheEntry
+{
+    char cHostName[ dnscacheconfigHOST_NAME_LENGTH ];
+    uint32_t ulAddress;
+    uint32_t ulResolvedMs;
+    uint32_t ulUsedMs;
+} DnsCacheEntry_t;
+
+/* The entries and counters are protected by critical sections. */
+static DnsCacheEntry_t xEntries[ dnscacheconfigENTRIES ];
+static DnsCacheStats_t xStats;
+
+/* Serializes calls to the resolver. */
+static SemaphoreHandle_t xResolverMutex = NULL;
+
+/* The background refresh in progress. The host name and resolver are owned by
+ * the refresh task while xPrefetchPending is set. */
+static BaseType_t xPrefetchPending = pdFALSE;
+static char cPrefetchHostName[ dnscacheconfigHOST_NAME_LENGTH ];
+static DnsCacheResolver_t xPrefetchResolver = NULL;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the entry of a host name.
+ *
+ * Must be called from a critical section.
+ */
+static DnsCacheEntry_t * prvFindEntry( const char * pcHostName )
+{
+    DnsCacheEntry_t * pxEntry = NULL;
+    uint32_t i;
+
+    for( i = 0; i < ( uint32_t ) dnscacheconfigENTRIES; i++ )
+    {
+        if( ( '\0' != xEntries[ i ].cHostName[ 0 ] ) &&
+            ( 0 == strcmp( xEntries[ i ].cHostName, pcHostName ) ) )
+        {
+            pxEntry = &xEntries[ i ];
+            break;
+        }
+    }
+
+    return pxEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Take the resolver mutex, creating it on first use.
+ *
+ * @return pdTRUE if the mutex was taken. The resolver is still called if the
+ * mutex could not be created.
+ */
+static BaseType_t prvResolverLock( void )
+{
+    BaseType_t xLocked = pdFALSE;
+    SemaphoreHandle_t xMutex = NULL;
+
+    if( NULL == xResolverMutex )
+    {
+        xMutex = xSemaphoreCreateMutex();
+
+        taskENTER_CRITICAL();
+
+        if( NULL == xResolverMutex )
+        {
+            xResolverMutex = xMutex;
+            xMutex = NULL;
+        }
+
+        taskEXIT_CRITICAL();
+
+        /* Another task won the race. */
+        if( NULL != xMutex )
+        {
+            vSemaphoreDelete( xMutex );
+        }
+    }
+
+    if( NULL != xResolverMutex )
+    {
+        xLocked = xSemaphoreTake( xResolverMutex, portMAX_DELAY );
+    }
+
+    return xLocked;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Look a host name up in the cache.
+ *
+ * @param[in] pcHostName The host name.
+ * @param[out] pxPrefetch Set to pdTRUE if the caller must start a background
+ * refresh; NULL if the caller does not start refreshes.
+ *
+ * @return The address of a fresh entry, or of an expired one that may still
+ * be served while it is refreshed, or 0.
+ */
+static uint32_t prvLookup( const char * pcHostName,
+                           BaseType_t * pxPrefetch )
+{
+    DnsCacheEntry_t * pxEntry = NULL;
+    uint32_t ulAddress = 0;
+    uint32_t ulNow = dnscacheconfigGET_TIME_MS();
+    uint32_t ulAge = 0;
+    BaseType_t xRefresh = pdFALSE;
+
+    taskENTER_CRITICAL();
+
+    pxEntry = prvFindEntry( pcHostName );
+
+    if( NULL != pxEntry )
+    {
+        ulAge = ulNow - pxEntry->ulResolvedMs;
+
+        if( ulAge < ( uint32_t ) dnscacheconfigTTL_MS )
+        {
+            ulAddress = pxEntry->ulAddress;
+            pxEntry->ulUsedMs = ulNow;
+            xStats.ulHits++;
+
+            xRefresh = ( ( ( uint32_t ) dnscacheconfigPREFETCH_MS > 0U ) &&
+                         ( ulAge >= ( ( uint32_t ) dnscacheconfigTTL_MS - ( uint32_t ) dnscacheconfigPREFETCH_MS ) ) ) ? pdTRUE : pdFALSE;
+        }
+        else if( ulAge < ( ( uint32_t ) dnscacheconfigTTL_MS + ( uint32_t ) dnscacheconfigSTALE_MS ) )
+        {
+            ulAddress = pxEntry->ulAddress;
+            pxEntry->ulUsedMs = ulNow;
+            xStats.ulStaleHits++;
+            xRefresh = pdTRUE;
+        }
+        else
+        {
+            /* Too old to be of any use. */
+            pxEntry->cHostName[ 0 ] = '\0';
+        }
+
+        if( ( pdFALSE != xRefresh ) &&
+            ( NULL != pxPrefetch ) &&
+            ( pdFALSE == xPrefetchPending ) )
+        {
+            xPrefetchPending = pdTRUE;
+            ( void ) strcpy( cPrefetchHostName, pxEntry->cHostName );
+            *pxPrefetch = pdTRUE;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    return ulAddress;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Store a resolved address, evicting the least recently used entry if
+ * the cache is full.
+ */
+static void prvStore( const char * pcHostName,
+                      uint32_t ulAddress )
+{
+    DnsCacheEntry_t * pxEntry = NULL;
+    uint32_t ulNow = dnscacheconfigGET_TIME_MS();
+    uint32_t ulOldest = 0;
+    uint32_t i;
+
+    taskENTER_CRITICAL();
+
+    pxEntry = prvFindEntry( pcHostName );
+
+    if( NULL == pxEntry )
+    {
+        for( i = 0; i < ( uint32_t ) dnscacheconfigENTRIES; i++ )
+        {
+            if( '\0' == xEntries[ i ].cHostName[ 0 ] )
+            {
+                pxEntry = &xEntries[ i ];
+                break;
+            }
+
+            if( ( NULL == pxEntry ) || ( ( ulNow - xEntries[ i ].ulUsedMs ) > ulOldest ) )
+            {
+                ulOldest = ulNow - xEntries[ i ].ulUsedMs;
+                pxEntry = &xEntries[ i ];
+            }
+        }
+    }
+
+    ( void ) strcpy( pxEntry->cHostName, pcHostName );
+    pxEntry->ulAddress = ulAddress;
+    pxEntry->ulResolvedMs = ulNow;
+    pxEntry->ulUsedMs = ulNow;
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Refresh cPrefetchHostName in the background, then delete itself.
+ */
+static void prvPrefetchTask( void * pvParameters )
+{
+    BaseType_t xLocked = pdFALSE;
+    uint32_t ulAddress = 0;
+
+    ( void ) pvParameters;
+
+    xLocked = prvResolverLock();
+
+    ulAddress = xPrefetchResolver( cPrefetchHostName );
+
+    if( 0U != ulAddress )
+    {
+        prvStore( cPrefetchHostName, ulAddress );
+    }
+
+    if( pdFALSE != xLocked )
+    {
+        ( void ) xSemaphoreGive( xResolverMutex );
+    }
+
+    taskENTER_CRITICAL();
+    xPrefetchPending = pdFALSE;
+    taskEXIT_CRITICAL();
+
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Start the background refresh claimed by prvLookup().
+ */
+static void prvStartPrefetch( DnsCacheResolver_t xResolver )
+{
+    BaseType_t xResult = pdFAIL;
+
+    xPrefetchResolver = xResolver;
+
+    xResult = xTaskCreate( prvPrefetchTask,
+                           "DnsPrefetch",
+                           dnscacheconfigPREFETCH_TASK_STACK_DEPTH,
+                           NULL,
+                           dnscacheconfigPREFETCH_TASK_PRIORITY,
+                           NULL );
+
+    taskENTER_CRITICAL();
+
+    if( pdPASS == xResult )
+    {
+        xStats.ulPrefetches++;
+    }
+    else
+    {
+        /* A later hit tries again. */
+        xPrefetchPending = pdFALSE;
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t DnsCache_Resolve( const char * pcHostName,
+                           DnsCacheResolver_t xResolver )
+{
+    BaseType_t xCacheable = pdFALSE;
+    BaseType_t xPrefetch = pdFALSE;
+    BaseType_t xLocked = pdFALSE;
+    uint32_t ulAddress = 0;
+
+    if( ( NULL != pcHostName ) && ( NULL != xResolver ) )
+    {
+        if( strlen( pcHostName ) < ( size_t ) dnscacheconfigHOST_NAME_LENGTH )
+        {
+            xCacheable = pdTRUE;
+            ulAddress = prvLookup( pcHostName, &xPrefetch );
+        }
+
+        if( 0U != ulAddress )
+        {
+            if( pdFALSE != xPrefetch )
+            {
+                prvStartPrefetch( xResolver );
+            }
+        }
+        else
+        {
+            xLocked = prvResolverLock();
+
+            /* Whoever held the resolver may have just resolved the same name. */
+            if( pdFALSE != xCacheable )
+            {
+                ulAddress = prvLookup( pcHostName, NULL );
+            }
+
+            if( 0U == ulAddress )
+            {
+                taskENTER_CRITICAL();
+                xStats.ulMisses++;
+                taskEXIT_CRITICAL();
+
+                ulAddress = xResolver( pcHostName );
+
+                if( ( 0U != ulAddress ) && ( pdFALSE != xCacheable ) )
+                {
+                    prvStore( pcHostName, ulAddress );
+                }
+            }
+
+            if( pdFALSE != xLocked )
+            {
+                ( void ) xSemaphoreGive( xResolverMutex );
+            }
+
+            if( 0U == ulAddress )
+            {
+                taskENTER_CRITICAL();
+                xStats.ulFailures++;
+                taskEXIT_CRITICAL();
+            }
+        }
+    }
+
+    return ulAddress;
+}
+
+/*-----------------------------------------------------------*/
+
+void DnsCache_Flush( const char * pcHostName )
+{
+    uint32_t i;
+
+    taskENTER_CRITICAL();
+
+    for( i = 0; i < ( uint32_t ) dnscacheconfigENTRIES; i++ )
+    {
+        if( ( NULL == pcHostName ) ||
+            ( 0 == strcmp( xEntries[ i ].cHostName, pcHostName ) ) )
+        {
+            xEntries[ i ].cHostName[ 0 ] = '\0';
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void DnsCache_GetStats( DnsCacheStats_t * pxStats )
+{
+    if( NULL != pxStats )
+    {
+        taskENTER_CRITICAL();
+        *pxStats = xStats;
+        taskEXIT_CRITICAL();
+    }
+}
@@ -0,0 +1,691 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_download_journal.c
+ * @brief Append-only journal of a download in reserved flash sectors.
+ *
+ * A sector starts with a 12 byte header: the magic "DLJ1", a sequence number
+ * and its complement. The valid sector with the highest sequence number is
+ * the current one. Its header is programmed last when the live content is
+ * copied in, so a reset during the copy leaves the previous sector current.
+ *
+ * Records follow the header. Each is a type byte, a zero byte and a 16 bit
+ * payload length, the payload padded to 4 bytes, then the CRC-32 of the
+ * type, the zero byte, the length and the payload. Numbers are little
+ * endian.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "iot_download_journal.h"
+
+#define downloadjournalMAGIC                 ( 0x314A4C44UL ) /* "DLJ1" */
+#define downloadjournalSECTOR_HEADER_SIZE    ( 12U )
+#define downloadjournalRECORD_HEADER_SIZE    ( 4U )
+#define downloadjournalCRC_SIZE              ( 4U )
+#define downloadjournalCHUNK_SIZE            ( 32U )
+#define downloadjournalBITMAP_SIZE           ( ( ( uint32_t ) downloadjournalconfigMAX_BLOCKS + 7U ) / 8U )
+
+/* Record types. */
+#define downloadjournalRECORD_BEGIN          ( 1U ) /* Key and number of blocks of a new download. */
+#define downloadjournalRECORD_STATE          ( 2U ) /* State saved by the caller. */
+#define downloadjournalRECORD_BLOCKS         ( 3U ) /* First block and number of blocks written. */
+#define downloadjournalRECORD_BITMAP         ( 4U ) /* Every block written, when the content moved. */
+#define downloadjournalRECORD_END            ( 5U ) /* The download is over. */
+
+#define downloadjournalRECORD_SIZE( ulLength ) \
+    ( downloadjournalRECORD_HEADER_SIZE + ( ( ( ulLength ) + 3U ) & ~3UL ) + downloadjournalCRC_SIZE )
+
+static const DownloadJournalFlash_t * pxJournalFlash = NULL;
+
+/* Position in the region. */
+static uint32_t ulCurrentSector = 0;
+static uint32_t ulSequence = 0;
+static uint32_t ulWriteOffset = 0;
+static BaseType_t xNeedsCompaction = pdFALSE;
+
+/* The download. The state is not kept in RAM; ulStateAddress is where its
+ * payload is in flash, or 0. */
+static BaseType_t xActive = pdFALSE;
+static uint32_t ulKey = 0;
+static uint32_t ulBlockCount = 0;
+static uint32_t ulStateAddress = 0;
+static uint32_t ulStateLength = 0;
+static uint8_t ucBitmap[ downloadjournalBITMAP_SIZE ];
+
+static DownloadJournalStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvCrc32( uint32_t ulCrc,
+                          const uint8_t * pucData,
+                          uint32_t ulLength )
+{
+    uint32_t i;
+    uint32_t j;
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        ulCrc ^= pucData[ i ];
+
+        for( j = 0; j < 8U; j++ )
+        {
+            ulCrc = ( ulCrc >> 1 ) ^ ( 0xEDB88320UL & ( 0UL - ( ulCrc & 1UL ) ) );
+        }
+    }
+
+    return ulCrc;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPutLE32( uint8_t * pucBuffer,
+                        uint32_t ulValue )
+{
+    pucBuffer[ 0 ] = ( uint8_t ) ulValue;
+    pucBuffer[ 1 ] = ( uint8_t ) ( ulValue >> 8 );
+    pucBuffer[ 2 ] = ( uint8_t ) ( ulValue >> 16 );
+    pucBuffer[ 3 ] = ( uint8_t ) ( ulValue >> 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvGetLE32( const uint8_t * pucBuffer )
+{
+    return ( uint32_t ) pucBuffer[ 0 ] |
+           ( ( uint32_t ) pucBuffer[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucBuffer[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucBuffer[ 3 ] << 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvSectorAddress( uint32_t ulSector )
+{
+    return pxJournalFlash->ulAddress + ( ulSector * pxJournalFlash->ulSectorSize );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSetBits( uint32_t ulFirst,
+                        uint32_t ulCount )
+{
+    uint32_t i;
+
+    for( i = ulFirst; i < ( ulFirst + ulCount ); i++ )
+    {
+        ucBitmap[ i / 8U ] |= ( uint8_t ) ( 1U << ( i % 8U ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Program a record, its payload taken from RAM or, if pucPayload is
+ * NULL, copied from flash at ulPayloadAddress.
+ */
+static BaseType_t prvWriteRecord( uint32_t ulAddress,
+                                  uint8_t ucType,
+                                  const uint8_t * pucPayload,
+                                  uint32_t ulPayloadAddress,
+                                  uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint8_t ucBuffer[ downloadjournalCHUNK_SIZE ];
+    uint32_t ulCrc;
+    uint32_t ulChunk;
+    uint32_t i;
+
+    ucBuffer[ 0 ] = ucType;
+    ucBuffer[ 1 ] = 0U;
+    ucBuffer[ 2 ] = ( uint8_t ) ulLength;
+    ucBuffer[ 3 ] = ( uint8_t ) ( ulLength >> 8 );
+    ulCrc = prvCrc32( 0xFFFFFFFFUL, ucBuffer, downloadjournalRECORD_HEADER_SIZE );
+    xResult = pxJournalFlash->xProgram( ulAddress, ucBuffer, downloadjournalRECORD_HEADER_SIZE );
+
+    if( NULL != pucPayload )
+    {
+        ulCrc = prvCrc32( ulCrc, pucPayload, ulLength );
+
+        if( ( pdFALSE != xResult ) && ( ulLength > 0U ) )
+        {
+            xResult = pxJournalFlash->xProgram( ulAddress + downloadjournalRECORD_HEADER_SIZE, pucPayload, ulLength );
+        }
+    }
+    else
+    {
+        for( i = 0; ( i < ulLength ) && ( pdFALSE != xResult ); i += ulChunk )
+        {
+            ulChunk = ( ( ulLength - i ) > downloadjournalCHUNK_SIZE ) ? downloadjournalCHUNK_SIZE : ( ulLength - i );
+            xResult = pxJournalFlash->xRead( ulPayloadAddress + i, ucBuffer, ulChunk );
+
+            if( pdFALSE != xResult )
+            {
+                ulCrc = prvCrc32( ulCrc, ucBuffer, ulChunk );
+                xResult = pxJournalFlash->xProgram( ulAddress + downloadjournalRECORD_HEADER_SIZE + i, ucBuffer, ulChunk );
+            }
+        }
+    }
+
+    if( pdFALSE != xResult )
+    {
+        prvPutLE32( ucBuffer, ~ulCrc );
+        xResult = pxJournalFlash->xProgram( ulAddress + downloadjournalRECORD_SIZE( ulLength ) - downloadjournalCRC_SIZE,
+                                            ucBuffer,
+                                            downloadjournalCRC_SIZE );
+    }
+
+    if( pdFALSE == xResult )
+    {
+        xStats.ulFailures++;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copy the live content to the next sector and make it current.
+ */
+static BaseType_t prvCompact( void )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulNext = ( ulCurrentSector + 1U ) % pxJournalFlash->ulSectors;
+    uint32_t ulSector = prvSectorAddress( ulNext );
+    uint32_t ulOffset = downloadjournalSECTOR_HEADER_SIZE;
+    uint32_t ulNewStateAddress = 0;
+    uint32_t ulBitmapLength = ( ulBlockCount + 7U ) / 8U;
+    uint8_t ucBuffer[ downloadjournalSECTOR_HEADER_SIZE ];
+
+    if( pdFALSE == xActive )
+    {
+        xResult = pdTRUE;
+    }
+    else if( ( ulOffset + downloadjournalRECORD_SIZE( 8U ) +
+               ( ( 0U != ulStateAddress ) ? downloadjournalRECORD_SIZE( ulStateLength ) : 0U ) +
+               downloadjournalRECORD_SIZE( ulBitmapLength ) ) <= pxJournalFlash->ulSectorSize )
+    {
+        xResult = pdTRUE;
+    }
+    else
+    {
+        /* The content does not fit in a sector. */
+    }
+
+    if( pdFALSE != xResult )
+    {
+        xResult = pxJournalFlash->xErase( ulSector );
+    }
+
+    if( ( pdFALSE != xResult ) && ( pdFALSE != xActive ) )
+    {
+        prvPutLE32( &ucBuffer[ 0 ], ulKey );
+        prvPutLE32( &ucBuffer[ 4 ], ulBlockCount );
+        xResult = prvWriteRecord( ulSector + ulOffset, downloadjournalRECORD_BEGIN, ucBuffer, 0, 8U );
+        ulOffset += downloadjournalRECORD_SIZE( 8U );
+
+        if( ( pdFALSE != xResult ) && ( 0U != ulStateAddress ) )
+        {
+            xResult = prvWriteRecord( ulSector + ulOffset, downloadjournalRECORD_STATE, NULL, ulStateAddress, ulStateLength );
+            ulNewStateAddress = ulSector + ulOffset + downloadjournalRECORD_HEADER_SIZE;
+            ulOffset += downloadjournalRECORD_SIZE( ulStateLength );
+        }
+
+        if( pdFALSE != xResult )
+        {
+            xResult = prvWriteRecord( ulSector + ulOffset, downloadjournalRECORD_BITMAP, ucBitmap, 0, ulBitmapLength );
+            ulOffset += downloadjournalRECORD_SIZE( ulBitmapLength );
+        }
+    }
+
+    if( pdFALSE != xResult )
+    {
+        prvPutLE32( &ucBuffer[ 0 ], downloadjournalMAGIC );
+        prvPutLE32( &ucBuffer[ 4 ], ulSequence + 1U );
+        prvPutLE32( &ucBuffer[ 8 ], ~( ulSequence + 1U ) );
+        xResult = pxJournalFlash->xProgram( ulSector, ucBuffer, downloadjournalSECTOR_HEADER_SIZE );
+    }
+
+    if( pdFALSE != xResult )
+    {
+        ulCurrentSector = ulNext;
+        ulSequence++;
+        ulWriteOffset = ulOffset;
+        ulStateAddress = ulNewStateAddress;
+        xNeedsCompaction = pdFALSE;
+        xStats.ulCompactions++;
+    }
+    else
+    {
+        xStats.ulFailures++;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Append a record to the current sector, moving to the next sector
+ * first if it does not fit.
+ */
+static BaseType_t prvAppend( uint8_t ucType,
+                             const uint8_t * pucPayload,
+                             uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulSize = downloadjournalRECORD_SIZE( ulLength );
+
+    if( ( pdFALSE != xNeedsCompaction ) || ( ( ulWriteOffset + ulSize ) > pxJournalFlash->ulSectorSize ) )
+    {
+        xResult = prvCompact();
+    }
+
+    if( ( pdFALSE != xResult ) && ( ( ulWriteOffset + ulSize ) > pxJournalFlash->ulSectorSize ) )
+    {
+        xResult = pdFALSE;
+    }
+
+    if( pdFALSE != xResult )
+    {
+        xResult = prvWriteRecord( prvSectorAddress( ulCurrentSector ) + ulWriteOffset, ucType, pucPayload, 0, ulLength );
+
+        if( pdFALSE != xResult )
+        {
+            if( downloadjournalRECORD_STATE == ucType )
+            {
+                ulStateAddress = prvSectorAddress( ulCurrentSector ) + ulWriteOffset + downloadjournalRECORD_HEADER_SIZE;
+                ulStateLength = ulLength;
+            }
+
+            xStats.ulRecords++;
+        }
+        else
+        {
+            /* The space may hold part of the record; go on elsewhere. */
+            xNeedsCompaction = pdTRUE;
+        }
+
+        ulWriteOffset += ulSize;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Check the CRC of the record at ulAddress.
+ */
+static BaseType_t prvCheckRecord( uint32_t ulAddress,
+                                  const uint8_t * pucHeader,
+                                  uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint8_t ucBuffer[ downloadjournalCHUNK_SIZE ];
+    uint32_t ulCrc = prvCrc32( 0xFFFFFFFFUL, pucHeader, downloadjournalRECORD_HEADER_SIZE );
+    uint32_t ulChunk;
+    uint32_t i;
+
+    for( i = 0; ( i < ulLength ) && ( pdFALSE != xResult ); i += ulChunk )
+    {
+        ulChunk = ( ( ulLength - i ) > downloadjournalCHUNK_SIZE ) ? downloadjournalCHUNK_SIZE : ( ulLength - i );
+        xResult = pxJournalFlash->xRead( ulAddress + downloadjournalRECORD_HEADER_SIZE + i, ucBuffer, ulChunk );
+        ulCrc = prvCrc32( ulCrc, ucBuffer, ulChunk );
+    }
+
+    if( pdFALSE != xResult )
+    {
+        xResult = pxJournalFlash->xRead( ulAddress + downloadjournalRECORD_SIZE( ulLength ) - downloadjournalCRC_SIZE,
+                                         ucBuffer,
+                                         downloadjournalCRC_SIZE );
+    }
+
+    if( ( pdFALSE != xResult ) && ( prvGetLE32( ucBuffer ) != ~ulCrc ) )
+    {
+        xResult = pdFALSE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Apply the records of the current sector, up to the first erased or
+ * damaged one.
+ */
+static void prvReplay( void )
+{
+    uint32_t ulSector = prvSectorAddress( ulCurrentSector );
+    uint32_t ulOffset = downloadjournalSECTOR_HEADER_SIZE;
+    uint32_t ulLength;
+    uint32_t ulFirst;
+    uint32_t ulCount;
+    uint8_t ucHeader[ downloadjournalRECORD_HEADER_SIZE ];
+    uint8_t ucPayload[ 8 ];
+    BaseType_t xDone = pdFALSE;
+
+    xActive = pdFALSE;
+    ulStateAddress = 0;
+
+    while( pdFALSE == xDone )
+    {
+        xDone = pdTRUE;
+
+        if( ( ulOffset + downloadjournalRECORD_SIZE( 0U ) ) > pxJournalFlash->ulSectorSize )
+        {
+            /* The sector is full. */
+        }
+        else if( pdFALSE == pxJournalFlash->xRead( ulSector + ulOffset, ucHeader, sizeof( ucHeader ) ) )
+        {
+            xNeedsCompaction = pdTRUE;
+        }
+        else if( 0xFFFFFFFFUL == prvGetLE32( ucHeader ) )
+        {
+            /* Erased: the end of the journal. */
+        }
+        else
+        {
+            ulLength = ( uint32_t ) ucHeader[ 2 ] | ( ( uint32_t ) ucHeader[ 3 ] << 8 );
+
+            if( ( ( ulOffset + downloadjournalRECORD_SIZE( ulLength ) ) > pxJournalFlash->ulSectorSize ) ||
+                ( pdFALSE == prvCheckRecord( ulSector + ulOffset, ucHeader, ulLength ) ) )
+            {
+                /* Torn by a reset; what follows cannot be trusted. */
+                xNeedsCompaction = pdTRUE;
+            }
+            else
+            {
+                if( ulLength == sizeof( ucPayload ) )
+                {
+                    ( void ) pxJournalFlash->xRead( ulSector + ulOffset + downloadjournalRECORD_HEADER_SIZE, ucPayload, sizeof( ucPayload ) );
+                }
+
+                if( ( downloadjournalRECORD_BEGIN == ucHeader[ 0 ] ) && ( ulLength == sizeof( ucPayload ) ) )
+                {
+                    ulKey = prvGetLE32( &ucPayload[ 0 ] );
+                    ulBlockCount = prvGetLE32( &ucPayload[ 4 ] );
+                    xActive = ( ulBlockCount <= ( uint32_t ) downloadjournalconfigMAX_BLOCKS ) ? pdTRUE : pdFALSE;
+                    ulStateAddress = 0;
+                    memset( ucBitmap, 0, sizeof( ucBitmap ) );
+                }
+                else if( pdFALSE == xActive )
+                {
+                    /* Records of a download that is over. */
+                }
+                else if( downloadjournalRECORD_STATE == ucHeader[ 0 ] )
+                {
+                    ulStateAddress = ulSector + ulOffset + downloadjournalRECORD_HEADER_SIZE;
+                    ulStateLength = ulLength;
+                }
+                else if( ( downloadjournalRECORD_BLOCKS == ucHeader[ 0 ] ) && ( ulLength == sizeof( ucPayload ) ) )
+                {
+                    ulFirst = prvGetLE32( &ucPayload[ 0 ] );
+                    ulCount = prvGetLE32( &ucPayload[ 4 ] );
+
+                    if( ( ulFirst < ulBlockCount ) && ( ulCount <= ( ulBlockCount - ulFirst ) ) )
+                    {
+                        prvSetBits( ulFirst, ulCount );
+                    }
+                }
+                else if( ( downloadjournalRECORD_BITMAP == ucHeader[ 0 ] ) && ( ulLength == ( ( ulBlockCount + 7U ) / 8U ) ) )
+                {
+                    ( void ) pxJournalFlash->xRead( ulSector + ulOffset + downloadjournalRECORD_HEADER_SIZE, ucBitmap, ulLength );
+                }
+                else if( downloadjournalRECORD_END == ucHeader[ 0 ] )
+                {
+                    xActive = pdFALSE;
+                }
+                else
+                {
+                    /* Unknown record. */
+                }
+
+                ulOffset += downloadjournalRECORD_SIZE( ulLength );
+                xDone = pdFALSE;
+            }
+        }
+    }
+
+    ulWriteOffset = ulOffset;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t DownloadJournal_Start( const DownloadJournalFlash_t * pxFlash,
+                                const uint8_t * pucKey,
+                                uint32_t ulKeyLength,
+                                uint32_t ulBlocks )
+{
+    uint32_t ulWritten = 0;
+    uint32_t ulNewKey;
+    uint32_t ulSeq;
+    uint32_t i;
+    uint8_t ucBuffer[ downloadjournalSECTOR_HEADER_SIZE ];
+    BaseType_t xFound = pdFALSE;
+
+    pxJournalFlash = NULL;
+    memset( &xStats, 0, sizeof( xStats ) );
+
+    if( ( NULL != pxFlash ) && ( NULL != pxFlash->xRead ) && ( NULL != pxFlash->xProgram ) && ( NULL != pxFlash->xErase ) &&
+        ( pxFlash->ulSectors >= 2U ) && ( pxFlash->ulSectorSize >= 256U ) &&
+        ( ( NULL != pucKey ) || ( 0U == ulKeyLength ) ) &&
+        ( ulBlocks > 0U ) && ( ulBlocks <= ( uint32_t ) downloadjournalconfigMAX_BLOCKS ) )
+    {
+        pxJournalFlash = pxFlash;
+
+        /* The current sector is the valid one with the highest sequence. */
+        for( i = 0; i < pxFlash->ulSectors; i++ )
+        {
+            if( ( pdFALSE != pxFlash->xRead( prvSectorAddress( i ), ucBuffer, sizeof( ucBuffer ) ) ) &&
+                ( downloadjournalMAGIC == prvGetLE32( &ucBuffer[ 0 ] ) ) &&
+                ( prvGetLE32( &ucBuffer[ 4 ] ) == ~prvGetLE32( &ucBuffer[ 8 ] ) ) )
+            {
+                ulSeq = prvGetLE32( &ucBuffer[ 4 ] );
+
+                if( ( pdFALSE == xFound ) || ( ( int32_t ) ( ulSeq - ulSequence ) > 0 ) )
+                {
+                    xFound = pdTRUE;
+                    ulCurrentSector = i;
+                    ulSequence = ulSeq;
+                }
+            }
+        }
+
+        xNeedsCompaction = pdFALSE;
+
+        if( pdFALSE != xFound )
+        {
+            prvReplay();
+        }
+        else
+        {
+            /* A blank region; the first record starts sector 0. */
+            ulCurrentSector = pxFlash->ulSectors - 1U;
+            ulSequence = 0;
+            xActive = pdFALSE;
+            xNeedsCompaction = pdTRUE;
+        }
+
+        ulNewKey = ~prvCrc32( 0xFFFFFFFFUL, pucKey, ulKeyLength );
+
+        if( ( pdFALSE != xActive ) && ( ulKey == ulNewKey ) && ( ulBlockCount == ulBlocks ) )
+        {
+            for( i = 0; i < ulBlocks; i++ )
+            {
+                if( pdFALSE != DownloadJournal_IsWritten( i ) )
+                {
+                    ulWritten++;
+                }
+            }
+
+            xStats.ulResumedBlocks = ulWritten;
+        }
+        else
+        {
+            xActive = pdFALSE;
+            ulStateAddress = 0;
+            memset( ucBitmap, 0, sizeof( ucBitmap ) );
+            prvPutLE32( &ucBuffer[ 0 ], ulNewKey );
+            prvPutLE32( &ucBuffer[ 4 ], ulBlocks );
+
+            if( pdFALSE != prvAppend( downloadjournalRECORD_BEGIN, ucBuffer, 8U ) )
+            {
+                xActive = pdTRUE;
+                ulKey = ulNewKey;
+                ulBlockCount = ulBlocks;
+            }
+            else
+            {
+                pxJournalFlash = NULL;
+            }
+        }
+    }
+
+    return ulWritten;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DownloadJournal_SetState( const void * pvState,
+                                     uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( NULL != pxJournalFlash ) && ( NULL != pvState ) && ( ulLength <= 0xFFFFU ) )
+    {
+        xResult = prvAppend( downloadjournalRECORD_STATE, ( const uint8_t * ) pvState, ulLength );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DownloadJournal_GetState( void * pvState,
+                                     uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( NULL != pxJournalFlash ) && ( NULL != pvState ) && ( 0U != ulStateAddress ) && ( ulLength == ulStateLength ) )
+    {
+        xResult = pxJournalFlash->xRead( ulStateAddress, ( uint8_t * ) pvState, ulLength );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DownloadJournal_MarkWritten( uint32_t ulFirst,
+                                        uint32_t ulCount )
+{
+    BaseType_t xResult = pdFALSE;
+    uint8_t ucPayload[ 8 ];
+    uint32_t i;
+
+    if( ( NULL != pxJournalFlash ) && ( ulFirst < ulBlockCount ) && ( ulCount <= ( ulBlockCount - ulFirst ) ) )
+    {
+        xResult = pdTRUE;
+
+        for( i = ulFirst; ( i < ( ulFirst + ulCount ) ) && ( pdFALSE != xResult ); i++ )
+        {
+            xResult = DownloadJournal_IsWritten( i );
+        }
+
+        /* Nothing to append if every block was recorded already. */
+        if( pdFALSE == xResult )
+        {
+            prvPutLE32( &ucPayload[ 0 ], ulFirst );
+            prvPutLE32( &ucPayload[ 4 ], ulCount );
+            xResult = prvAppend( downloadjournalRECORD_BLOCKS, ucPayload, sizeof( ucPayload ) );
+
+            if( pdFALSE != xResult )
+            {
+                prvSetBits( ulFirst, ulCount );
+            }
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DownloadJournal_IsWritten( uint32_t ulBlock )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( NULL != pxJournalFlash ) && ( ulBlock < ulBlockCount ) &&
+        ( 0U != ( ucBitmap[ ulBlock / 8U ] & ( 1U << ( ulBlock % 8U ) ) ) ) )
+    {
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t DownloadJournal_GetWrittenPrefix( void )
+{
+    uint32_t ulCount = 0;
+
+    while( pdFALSE != DownloadJournal_IsWritten( ulCount ) )
+    {
+        ulCount++;
+    }
+
+    return ulCount;
+}
+
+/*-----------------------------------------------------------*/
+
+void DownloadJournal_Clear( void )
+{
+    if( ( NULL != pxJournalFlash ) && ( pdFALSE != xActive ) )
+    {
+        xActive = pdFALSE;
+        ( void ) prvAppend( downloadjournalRECORD_END, NULL, 0 );
+    }
+
+    pxJournalFlash = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void DownloadJournal_GetStats( DownloadJournalStats_t * pxStats )
+{
+    if( NULL != pxStats )
+    {
+        *pxStats = xStats;
+    }
+}
@@ -0,0 +1,359 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_flash_erase_ahead.c
+ * @brief Erases a flash region just ahead of the writes to it.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "iot_flash_erase_ahead.h"
+
+/**
+ * @brief Number of 32 bit words in the erased bitmap.
+ */
+#define flasheraseaheadBITMAP_WORDS    ( ( ( uint32_t ) flasheraseaheadconfigMAX_UNITS + 31U ) / 32U )
+
+/* Serializes erases and protects the region state below. It is held for the
+ * whole of an erase, so that a unit is never erased by two tasks at once. */
+static SemaphoreHandle_t xRegionMutex = NULL;
+
+static uint32_t ulRegionAddress = 0;
+static uint32_t ulRegionUnitSize = 0;
+static uint32_t ulUnitCount = 0;
+static uint32_t ulAheadUnits = 0;
+static FlashEraseAheadEraser_t xRegionEraser = NULL;
+
+/* Units below ulCursor have been prepared for writing; units below ulLowest
+ * are all erased. */
+static uint32_t ulCursor = 0;
+static uint32_t ulLowest = 0;
+static uint32_t ulErased[ flasheraseaheadBITMAP_WORDS ];
+
+static TaskHandle_t xEraseTask = NULL;
+
+/* The counters are protected by critical sections. */
+static FlashEraseAheadStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Whether a unit of the region is erased.
+ */
+static BaseType_t prvIsErased( uint32_t ulUnit )
+{
+    return ( 0U != ( ulErased[ ulUnit / 32U ] & ( 1UL << ( ulUnit % 32U ) ) ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Erase a unit of the region and record it. Called with the mutex held.
+ *
+ * @return pdTRUE if the unit is erased.
+ */
+static BaseType_t prvEraseUnit( uint32_t ulUnit,
+                                BaseType_t xAhead )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( pdFALSE == prvIsErased( ulUnit ) )
+    {
+        xResult = xRegionEraser( ulRegionAddress + ( ulUnit * ulRegionUnitSize ), ulRegionUnitSize );
+
+        taskENTER_CRITICAL();
+
+        if( pdFALSE == xResult )
+        {
+            xStats.ulEraseFailures++;
+        }
+        else if( pdFALSE != xAhead )
+        {
+            xStats.ulErasedAhead++;
+        }
+        else
+        {
+            xStats.ulErasedOnDemand++;
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( pdFALSE != xResult )
+        {
+            ulErased[ ulUnit / 32U ] |= ( 1UL << ( ulUnit % 32U ) );
+
+            while( ( ulLowest < ulUnitCount ) && ( pdFALSE != prvIsErased( ulLowest ) ) )
+            {
+                ulLowest++;
+            }
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the lowest unit the background task should erase next. Called
+ * with the mutex held.
+ *
+ * Units skipped by out-of-order writes come first, then the units up to the
+ * erase-ahead distance past the cursor.
+ *
+ * @return The unit, or ulUnitCount if there is nothing to erase yet.
+ */
+static uint32_t prvNextUnit( void )
+{
+    uint32_t ulLimit = ulCursor + ulAheadUnits;
+    uint32_t ulUnit;
+
+    if( ulLimit > ulUnitCount )
+    {
+        ulLimit = ulUnitCount;
+    }
+
+    for( ulUnit = ulLowest; ulUnit < ulLimit; ulUnit++ )
+    {
+        if( pdFALSE == prvIsErased( ulUnit ) )
+        {
+            break;
+        }
+    }
+
+    return ( ulUnit < ulLimit ) ? ulUnit : ulUnitCount;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Erases ahead of the write cursor, one unit at a time so that the
+ * writer never waits for more than one erase, and sleeps until the cursor
+ * moves once it is far enough ahead.
+ */
+static void prvEraseTask( void * pvParameters )
+{
+    BaseType_t xErased = pdFALSE;
+    uint32_t ulUnit;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        xErased = pdFALSE;
+
+        ( void ) xSemaphoreTake( xRegionMutex, portMAX_DELAY );
+
+        ulUnit = prvNextUnit();
+
+        if( ulUnit < ulUnitCount )
+        {
+            xErased = prvEraseUnit( ulUnit, pdTRUE );
+        }
+
+        ( void ) xSemaphoreGive( xRegionMutex );
+
+        /* After a failure the writer retries the unit on demand and reports
+         * the error; erasing further ahead waits until the cursor moves. */
+        if( pdFALSE == xErased )
+        {
+            ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t FlashEraseAhead_Start( uint32_t ulAddress,
+                                  uint32_t ulLength,
+                                  uint32_t ulUnitSize,
+                                  uint32_t ulAheadLength,
+                                  FlashEraseAheadEraser_t xEraser )
+{
+    BaseType_t xResult = pdFALSE;
+    SemaphoreHandle_t xMutex = NULL;
+    uint32_t ulUnits = 0;
+
+    if( ( NULL != xEraser ) && ( 0U != ulUnitSize ) && ( 0U != ulLength ) )
+    {
+        ulUnits = ( ( ulLength - 1U ) / ulUnitSize ) + 1U;
+    }
+
+    if( NULL == xRegionMutex )
+    {
+        xMutex = xSemaphoreCreateMutex();
+
+        taskENTER_CRITICAL();
+
+        if( NULL == xRegionMutex )
+        {
+            xRegionMutex = xMutex;
+            xMutex = NULL;
+        }
+
+        taskEXIT_CRITICAL();
+
+        /* Another task won the race. */
+        if( NULL != xMutex )
+        {
+            vSemaphoreDelete( xMutex );
+        }
+    }
+
+    FlashEraseAhead_Stop();
+
+    if( ( NULL != xRegionMutex ) &&
+        ( 0U != ulUnits ) &&
+        ( ulUnits <= ( uint32_t ) flasheraseaheadconfigMAX_UNITS ) )
+    {
+        ( void ) xSemaphoreTake( xRegionMutex, portMAX_DELAY );
+
+        ulRegionAddress = ulAddress;
+        ulRegionUnitSize = ulUnitSize;
+        ulUnitCount = ulUnits;
+        ulAheadUnits = ( ulAheadLength + ulUnitSize - 1U ) / ulUnitSize;
+        xRegionEraser = xEraser;
+        ulCursor = 0;
+        ulLowest = 0;
+        memset( ulErased, 0, sizeof( ulErased ) );
+
+        taskENTER_CRITICAL();
+        memset( &xStats, 0, sizeof( xStats ) );
+        taskEXIT_CRITICAL();
+
+        /* Without the task every unit is erased on demand. */
+        if( 0U != ulAheadUnits )
+        {
+            if( pdPASS != xTaskCreate( prvEraseTask,
+                                       "EraseAhead",
+                                       flasheraseaheadconfigTASK_STACK_DEPTH,
+                                       NULL,
+                                       flasheraseaheadconfigTASK_PRIORITY,
+                                       &xEraseTask ) )
+            {
+                xEraseTask = NULL;
+            }
+        }
+
+        ( void ) xSemaphoreGive( xRegionMutex );
+
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t FlashEraseAhead_Prepare( uint32_t ulAddress,
+                                    uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulStart;
+    uint32_t ulEnd;
+    uint32_t ulRegionEnd;
+    uint32_t ulUnit;
+
+    if( NULL != xRegionMutex )
+    {
+        ( void ) xSemaphoreTake( xRegionMutex, portMAX_DELAY );
+
+        if( 0U != ulUnitCount )
+        {
+            ulRegionEnd = ulRegionAddress + ( ulUnitCount * ulRegionUnitSize );
+            ulStart = ( ulAddress > ulRegionAddress ) ? ulAddress : ulRegionAddress;
+            ulEnd = ( ( ulAddress + ulLength ) < ulRegionEnd ) ? ( ulAddress + ulLength ) : ulRegionEnd;
+
+            if( ( 0U != ulLength ) && ( ulStart < ulEnd ) )
+            {
+                for( ulUnit = ( ulStart - ulRegionAddress ) / ulRegionUnitSize;
+                     ulUnit <= ( ulEnd - 1U - ulRegionAddress ) / ulRegionUnitSize;
+                     ulUnit++ )
+                {
+                    if( pdFALSE == prvEraseUnit( ulUnit, pdFALSE ) )
+                    {
+                        xResult = pdFALSE;
+                        break;
+                    }
+                }
+
+                if( ulUnit > ulCursor )
+                {
+                    ulCursor = ulUnit;
+                }
+            }
+        }
+
+        if( NULL != xEraseTask )
+        {
+            ( void ) xTaskNotifyGive( xEraseTask );
+        }
+
+        ( void ) xSemaphoreGive( xRegionMutex );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void FlashEraseAhead_Stop( void )
+{
+    if( NULL != xRegionMutex )
+    {
+        /* The task only erases with the mutex held, so deleting it while the
+         * mutex is held here never interrupts an erase. */
+        ( void ) xSemaphoreTake( xRegionMutex, portMAX_DELAY );
+
+        if( NULL != xEraseTask )
+        {
+            vTaskDelete( xEraseTask );
+            xEraseTask = NULL;
+        }
+
+        ulUnitCount = 0;
+        xRegionEraser = NULL;
+
+        ( void ) xSemaphoreGive( xRegionMutex );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void FlashEraseAhead_GetStats( FlashEraseAheadStats_t * pxStats )
+{
+    if( NULL != pxStats )
+    {
+        taskENTER_CRITICAL();
+        *pxStats = xStats;
+        taskEXIT_CRITICAL();
+    }
+}
@@ -0,0 +1,394 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_flash_write_buffer.c
+ * @brief Page aligned write combining in front of a flash program function.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "iot_flash_write_buffer.h"
+
+#define flashwritebufferPAGE_MASK    ( ( uint32_t ) flashwritebufferconfigPAGE_SIZE - 1U )
+
+/**
+ * @brief A partly written page.
+ *
+ * The bytes written so far are contiguous, from ulStart to ulEnd within the
+ * page; writes never overlap, so the pieces of a page are always adjacent
+ * unless a block in between is missing.
+ *
+ * @param[in] xUsed Whether the buffer holds a page.
+ * @param[in] ulPage Flash offset of the page.
+ * @param[in] ulStart Offset in the page of the first byte written.
+ * @param[in] ulEnd Offset in the page past the last byte written.
+ * @param[in] ulLastUse Write count at the last use, to pick the buffer to evict.
+ * @param[in] ucData The page.
+ */
+typedef struct FlashWriteBufferPage
+{
+    BaseType_t xUsed;
+    uint32_t ulPage;
+    uint32_t ulStart;
+    uint32_t ulEnd;
+    uint32_t ulLastUse;
+    uint8_t ucData[ flashwritebufferconfigPAGE_SIZE ];
+} FlashWriteBufferPage_t;
+
+static FlashWriteBufferPage_t xPages[ flashwritebufferconfigCACHED_PAGES ];
+static FlashWriteBufferProgram_t xProgramFunction = NULL;
+static FlashWriteBufferStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Program a range and count the operation.
+ */
+static BaseType_t prvProgram( uint32_t ulAddress,
+                              const uint8_t * pucData,
+                              uint32_t ulLength )
+{
+    xStats.ulProgramOps++;
+
+    return xProgramFunction( ulAddress, pucData, ulLength );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Program what a page buffer holds and free it.
+ */
+static BaseType_t prvFlushPage( FlashWriteBufferPage_t * pxPage )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( ( pdFALSE != pxPage->xUsed ) && ( pxPage->ulEnd > pxPage->ulStart ) )
+    {
+        if( ( 0U == pxPage->ulStart ) && ( ( uint32_t ) flashwritebufferconfigPAGE_SIZE == pxPage->ulEnd ) )
+        {
+            xStats.ulFullPages++;
+        }
+        else
+        {
+            xStats.ulPartialPages++;
+        }
+
+        xResult = prvProgram( pxPage->ulPage + pxPage->ulStart,
+                              &pxPage->ucData[ pxPage->ulStart ],
+                              pxPage->ulEnd - pxPage->ulStart );
+    }
+
+    pxPage->xUsed = pdFALSE;
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Get the buffer of a page, evicting the least recently used page if
+ * every buffer is taken.
+ *
+ * @return The buffer, or NULL if the evicted page could not be programmed.
+ */
+static FlashWriteBufferPage_t * prvGetPage( uint32_t ulPage )
+{
+    FlashWriteBufferPage_t * pxPage = NULL;
+    FlashWriteBufferPage_t * pxFree = NULL;
+    FlashWriteBufferPage_t * pxOldest = NULL;
+    uint32_t i;
+
+    for( i = 0; i < ( uint32_t ) flashwritebufferconfigCACHED_PAGES; i++ )
+    {
+        if( pdFALSE == xPages[ i ].xUsed )
+        {
+            if( NULL == pxFree )
+            {
+                pxFree = &xPages[ i ];
+            }
+        }
+        else if( ulPage == xPages[ i ].ulPage )
+        {
+            pxPage = &xPages[ i ];
+            break;
+        }
+        else if( ( NULL == pxOldest ) || ( xPages[ i ].ulLastUse < pxOldest->ulLastUse ) )
+        {
+            pxOldest = &xPages[ i ];
+        }
+    }
+
+    if( NULL == pxPage )
+    {
+        pxPage = pxFree;
+
+        if( ( NULL == pxPage ) && ( pdFALSE != prvFlushPage( pxOldest ) ) )
+        {
+            pxPage = pxOldest;
+        }
+
+        if( NULL != pxPage )
+        {
+            pxPage->xUsed = pdTRUE;
+            pxPage->ulPage = ulPage;
+            pxPage->ulStart = 0;
+            pxPage->ulEnd = 0;
+        }
+    }
+
+    return pxPage;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Add part of a page to its buffer, programming the page once it is
+ * complete.
+ */
+static BaseType_t prvWritePartialPage( uint32_t ulAddress,
+                                       const uint8_t * pucData,
+                                       uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+    FlashWriteBufferPage_t * pxPage = NULL;
+    uint32_t ulOffset = ulAddress & flashwritebufferPAGE_MASK;
+
+    pxPage = prvGetPage( ulAddress - ulOffset );
+
+    if( NULL != pxPage )
+    {
+        xResult = pdTRUE;
+
+        /* A gap between the pieces; program what is there and keep going
+         * with the new piece. */
+        if( ( pxPage->ulEnd > pxPage->ulStart ) &&
+            ( ( ulOffset + ulLength ) != pxPage->ulStart ) &&
+            ( ulOffset != pxPage->ulEnd ) )
+        {
+            xResult = prvFlushPage( pxPage );
+            pxPage->xUsed = pdTRUE;
+            pxPage->ulStart = 0;
+            pxPage->ulEnd = 0;
+        }
+
+        if( pdFALSE != xResult )
+        {
+            memcpy( &pxPage->ucData[ ulOffset ], pucData, ulLength );
+
+            if( pxPage->ulEnd == pxPage->ulStart )
+            {
+                pxPage->ulStart = ulOffset;
+                pxPage->ulEnd = ulOffset + ulLength;
+            }
+            else if( ulOffset == pxPage->ulEnd )
+            {
+                pxPage->ulEnd = ulOffset + ulLength;
+            }
+            else
+            {
+                pxPage->ulStart = ulOffset;
+            }
+
+            pxPage->ulLastUse = xStats.ulWrites;
+
+            if( ( 0U == pxPage->ulStart ) && ( ( uint32_t ) flashwritebufferconfigPAGE_SIZE == pxPage->ulEnd ) )
+            {
+                xResult = prvFlushPage( pxPage );
+            }
+        }
+        else
+        {
+            pxPage->xUsed = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void FlashWriteBuffer_Start( FlashWriteBufferProgram_t xProgram )
+{
+    FlashWriteBuffer_Discard();
+
+    memset( &xStats, 0, sizeof( xStats ) );
+    xProgramFunction = xProgram;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t FlashWriteBuffer_Write( uint32_t ulAddress,
+                                   const uint8_t * pucData,
+                                   uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulOffset;
+    uint32_t ulChunk;
+
+    if( ( NULL != xProgramFunction ) && ( ( NULL != pucData ) || ( 0U == ulLength ) ) )
+    {
+        xResult = pdTRUE;
+        xStats.ulWrites++;
+
+        while( ( pdFALSE != xResult ) && ( ulLength > 0U ) )
+        {
+            ulOffset = ulAddress & flashwritebufferPAGE_MASK;
+
+            if( ( 0U == ulOffset ) && ( ulLength >= ( uint32_t ) flashwritebufferconfigPAGE_SIZE ) )
+            {
+                /* Every whole page in one operation, straight from the caller. */
+                ulChunk = ulLength & ~flashwritebufferPAGE_MASK;
+                xStats.ulFullPages += ulChunk / ( uint32_t ) flashwritebufferconfigPAGE_SIZE;
+                xResult = prvProgram( ulAddress, pucData, ulChunk );
+            }
+            else
+            {
+                ulChunk = ( uint32_t ) flashwritebufferconfigPAGE_SIZE - ulOffset;
+
+                if( ulChunk > ulLength )
+                {
+                    ulChunk = ulLength;
+                }
+
+                xResult = prvWritePartialPage( ulAddress, pucData, ulChunk );
+            }
+
+            ulAddress += ulChunk;
+            pucData += ulChunk;
+            ulLength -= ulChunk;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t FlashWriteBuffer_Flush( void )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t i;
+
+    for( i = 0; i < ( uint32_t ) flashwritebufferconfigCACHED_PAGES; i++ )
+    {
+        if( pdFALSE != xPages[ i ].xUsed )
+        {
+            if( pdFALSE == prvFlushPage( &xPages[ i ] ) )
+            {
+                xResult = pdFALSE;
+            }
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void FlashWriteBuffer_Overlay( uint32_t ulAddress,
+                               uint8_t * pucData,
+                               uint32_t ulLength )
+{
+    uint32_t ulStart;
+    uint32_t ulEnd;
+    uint32_t i;
+
+    for( i = 0; ( i < ( uint32_t ) flashwritebufferconfigCACHED_PAGES ) && ( NULL != pucData ); i++ )
+    {
+        if( pdFALSE != xPages[ i ].xUsed )
+        {
+            /* The written part of the page, clipped to the range. */
+            ulStart = xPages[ i ].ulPage + xPages[ i ].ulStart;
+            ulEnd = xPages[ i ].ulPage + xPages[ i ].ulEnd;
+
+            if( ulStart < ulAddress )
+            {
+                ulStart = ulAddress;
+            }
+
+            if( ulEnd > ( ulAddress + ulLength ) )
+            {
+                ulEnd = ulAddress + ulLength;
+            }
+
+            if( ulStart < ulEnd )
+            {
+                memcpy( &pucData[ ulStart - ulAddress ],
+                        &xPages[ i ].ucData[ ulStart - xPages[ i ].ulPage ],
+                        ulEnd - ulStart );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t FlashWriteBuffer_IsBuffered( uint32_t ulAddress,
+                                        uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t i;
+
+    for( i = 0; ( i < ( uint32_t ) flashwritebufferconfigCACHED_PAGES ) && ( pdFALSE == xResult ); i++ )
+    {
+        if( ( pdFALSE != xPages[ i ].xUsed ) &&
+            ( xPages[ i ].ulEnd > xPages[ i ].ulStart ) &&
+            ( ( xPages[ i ].ulPage + xPages[ i ].ulStart ) < ( ulAddress + ulLength ) ) &&
+            ( ( xPages[ i ].ulPage + xPages[ i ].ulEnd ) > ulAddress ) )
+        {
+            xResult = pdTRUE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void FlashWriteBuffer_Discard( void )
+{
+    uint32_t i;
+
+    for( i = 0; i < ( uint32_t ) flashwritebufferconfigCACHED_PAGES; i++ )
+    {
+        xPages[ i ].xUsed = pdFALSE;
+    }
+
+    xProgramFunction = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void FlashWriteBuffer_GetStats( FlashWriteBufferStats_t * pxStats )
+{
+    if( NULL != pxStats )
+    {
+        *pxStats = xStats;
+    }
+}
@@ -0,0 +1,276 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_image_hash.c
+ * @brief Hash of an image written in blocks, in whatever order they arrive.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "iot_image_hash.h"
+
+/**
+ * @brief Part of the image written ahead of the hashed part.
+ *
+ * @param[in] ulStart Offset of the first byte.
+ * @param[in] ulEnd Offset past the last byte.
+ */
+typedef struct ImageHashRange
+{
+    uint32_t ulStart;
+    uint32_t ulEnd;
+} ImageHashRange_t;
+
+static void * pvHashContext = NULL;
+static ImageHashUpdate_t xUpdateFunction = NULL;
+static ImageHashRead_t xReadFunction = NULL;
+static uint32_t ulHashedEnd = 0;
+
+/* Sorted by offset; adjacent ranges are always merged. */
+static ImageHashRange_t xRanges[ imagehashconfigMAX_RANGES ];
+static uint32_t ulRangeCount = 0;
+
+static ImageHashStats_t xHashStats;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Record a range written ahead of the hashed part, merging it with
+ * the ranges it touches.
+ */
+static void prvRecordRange( uint32_t ulStart,
+                            uint32_t ulEnd )
+{
+    uint32_t ulIndex = 0;
+    BaseType_t xJoinsPrevious;
+    BaseType_t xJoinsNext;
+
+    while( ( ulIndex < ulRangeCount ) && ( xRanges[ ulIndex ].ulStart < ulStart ) )
+    {
+        ulIndex++;
+    }
+
+    xJoinsPrevious = ( ( ulIndex > 0U ) && ( xRanges[ ulIndex - 1U ].ulEnd == ulStart ) ) ? pdTRUE : pdFALSE;
+    xJoinsNext = ( ( ulIndex < ulRangeCount ) && ( xRanges[ ulIndex ].ulStart == ulEnd ) ) ? pdTRUE : pdFALSE;
+
+    if( ( pdFALSE != xJoinsPrevious ) && ( pdFALSE != xJoinsNext ) )
+    {
+        /* The range fills the hole between two others. */
+        xRanges[ ulIndex - 1U ].ulEnd = xRanges[ ulIndex ].ulEnd;
+        memmove( &xRanges[ ulIndex ], &xRanges[ ulIndex + 1U ],
+                 ( ulRangeCount - ulIndex - 1U ) * sizeof( ImageHashRange_t ) );
+        ulRangeCount--;
+    }
+    else if( pdFALSE != xJoinsPrevious )
+    {
+        xRanges[ ulIndex - 1U ].ulEnd = ulEnd;
+    }
+    else if( pdFALSE != xJoinsNext )
+    {
+        xRanges[ ulIndex ].ulStart = ulStart;
+    }
+    else if( ulRangeCount < ( uint32_t ) imagehashconfigMAX_RANGES )
+    {
+        memmove( &xRanges[ ulIndex + 1U ], &xRanges[ ulIndex ],
+                 ( ulRangeCount - ulIndex ) * sizeof( ImageHashRange_t ) );
+        xRanges[ ulIndex ].ulStart = ulStart;
+        xRanges[ ulIndex ].ulEnd = ulEnd;
+        ulRangeCount++;
+    }
+    else
+    {
+        /* Left for ImageHash_Finish(); the hash stops at its start until
+         * then. */
+        xHashStats.ulUntrackedWrites++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read back and hash the image from the end of the hashed part up to
+ * ulEnd.
+ */
+static BaseType_t prvHashReadBack( uint32_t ulEnd )
+{
+    BaseType_t xResult = pdTRUE;
+    uint8_t * pucBuffer = NULL;
+    uint32_t ulChunk;
+
+    if( ulHashedEnd < ulEnd )
+    {
+        pucBuffer = pvPortMalloc( imagehashconfigREAD_SIZE );
+
+        if( NULL == pucBuffer )
+        {
+            xResult = pdFALSE;
+        }
+
+        while( ( pdFALSE != xResult ) && ( ulHashedEnd < ulEnd ) )
+        {
+            ulChunk = ulEnd - ulHashedEnd;
+
+            if( ulChunk > ( uint32_t ) imagehashconfigREAD_SIZE )
+            {
+                ulChunk = ( uint32_t ) imagehashconfigREAD_SIZE;
+            }
+
+            xResult = xReadFunction( ulHashedEnd, pucBuffer, ulChunk );
+
+            if( pdFALSE != xResult )
+            {
+                xUpdateFunction( pvHashContext, pucBuffer, ulChunk );
+                ulHashedEnd += ulChunk;
+                xHashStats.ulReadBackBytes += ulChunk;
+            }
+        }
+
+        vPortFree( pucBuffer );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Hash the recorded ranges that now follow the hashed part.
+ */
+static BaseType_t prvCatchUp( void )
+{
+    BaseType_t xResult = pdTRUE;
+
+    while( ( pdFALSE != xResult ) && ( ulRangeCount > 0U ) && ( xRanges[ 0 ].ulStart == ulHashedEnd ) )
+    {
+        xResult = prvHashReadBack( xRanges[ 0 ].ulEnd );
+
+        if( pdFALSE != xResult )
+        {
+            ulRangeCount--;
+            memmove( &xRanges[ 0 ], &xRanges[ 1 ], ulRangeCount * sizeof( ImageHashRange_t ) );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void ImageHash_Start( void * pvContext,
+                      ImageHashUpdate_t xUpdate,
+                      ImageHashRead_t xRead,
+                      uint32_t ulHashedLength )
+{
+    pvHashContext = pvContext;
+    xUpdateFunction = xUpdate;
+    xReadFunction = xRead;
+    ulHashedEnd = ulHashedLength;
+    ulRangeCount = 0;
+
+    memset( &xHashStats, 0, sizeof( xHashStats ) );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ImageHash_Write( uint32_t ulOffset,
+                            const uint8_t * pucData,
+                            uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulSkip;
+
+    if( ( NULL != pvHashContext ) && ( ( NULL != pucData ) || ( 0U == ulLength ) ) )
+    {
+        xResult = pdTRUE;
+
+        if( ulOffset <= ulHashedEnd )
+        {
+            /* Only what follows the hashed part is new. */
+            ulSkip = ulHashedEnd - ulOffset;
+
+            if( ulLength > ulSkip )
+            {
+                xUpdateFunction( pvHashContext, &pucData[ ulSkip ], ulLength - ulSkip );
+                ulHashedEnd += ulLength - ulSkip;
+                xHashStats.ulHashedBytes += ulLength - ulSkip;
+
+                xResult = prvCatchUp();
+            }
+        }
+        else if( ulLength > 0U )
+        {
+            xHashStats.ulAheadWrites++;
+            prvRecordRange( ulOffset, ulOffset + ulLength );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ImageHash_Finish( uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( NULL != pvHashContext )
+    {
+        xResult = prvHashReadBack( ulLength );
+        ImageHash_Stop();
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void ImageHash_Stop( void )
+{
+    pvHashContext = NULL;
+    xUpdateFunction = NULL;
+    xReadFunction = NULL;
+    ulRangeCount = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+void * ImageHash_GetContext( void )
+{
+    return pvHashContext;
+}
+
+/*-----------------------------------------------------------*/
+
+void ImageHash_GetStats( ImageHashStats_t * pxStats )
+{
+    if( NULL != pxStats )
+    {
+        *pxStats = xHashStats;
+    }
+}
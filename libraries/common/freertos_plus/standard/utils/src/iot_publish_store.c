@@ -0,0 +1,1019 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_publish_store.c
+ * @brief RAM ring and append-only flash log of messages waiting to be sent.
+ *
+ * The RAM ring holds records of a class byte, a state byte and a 16 bit
+ * length, followed by the message padded to 4 bytes. A record is marked taken
+ * when it is removed, and the space is reused once every record before it is
+ * taken too. A taken record fills the end of the ring when the next one does
+ * not fit there.
+ *
+ * The flash sectors are used in turn. A sector starts with a 12 byte header:
+ * the magic "PSS1", a sequence number and its complement; the sequence grows
+ * by one from a sector to the next. Records follow, in the format of the
+ * download journal: a type byte, the class, a 16 bit payload length, the
+ * payload padded to 4 bytes, then the CRC-32 of the type, class, length and
+ * payload. Numbers are little endian.
+ *
+ * A message record holds a 32 bit message number, then the message. Within a
+ * class, messages are forwarded in order, so a forwarded record holding the
+ * number of the last message of its class forwarded is enough to tell which
+ * are left. Each sector starts with such a record per class, so that the
+ * oldest sector can be erased once all its messages are forwarded.
+ *
+ * A class whose messages are in flash keeps storing there until they are all
+ * forwarded, so that its messages in RAM are always older than those in flash.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "iot_publish_store.h"
+
+#define publishstoreMAGIC                 ( 0x31535350UL ) /* "PSS1" */
+#define publishstoreSECTOR_HEADER_SIZE    ( 12U )
+#define publishstoreRECORD_HEADER_SIZE    ( 4U )
+#define publishstoreCRC_SIZE              ( 4U )
+#define publishstoreNUMBER_SIZE           ( 4U )
+#define publishstoreCHUNK_SIZE            ( 32U )
+
+/* Flash record types. */
+#define publishstoreRECORD_MESSAGE        ( 1U ) /* Message number and message. */
+#define publishstoreRECORD_FORWARDED      ( 2U ) /* Number of the last message of the class forwarded. */
+
+/* RAM record states, and the class of the record filling the end. */
+#define publishstoreRAM_LIVE              ( 0U )
+#define publishstoreRAM_TAKEN             ( 1U )
+#define publishstoreRAM_FILLER            ( 0xFFU )
+
+#define publishstoreRECORD_SIZE( ulLength ) \
+    ( publishstoreRECORD_HEADER_SIZE + ( ( ( ulLength ) + 3U ) & ~3UL ) + publishstoreCRC_SIZE )
+
+#define publishstoreRAM_RECORD_SIZE( ulLength ) \
+    ( publishstoreRECORD_HEADER_SIZE + ( ( ( ulLength ) + 3U ) & ~3UL ) )
+
+/* Whether message number ulA comes after ulB. */
+#define publishstoreIS_AFTER( ulA, ulB )    ( ( int32_t ) ( ( ulA ) - ( ulB ) ) > 0 )
+
+#if ( ( publishstoreconfigRAM_SIZE % 4 ) != 0 )
+    #error "publishstoreconfigRAM_SIZE must be a multiple of 4."
+#endif
+
+#if ( publishstoreconfigCLASSES < 1 ) || ( publishstoreconfigCLASSES > 254 )
+    #error "publishstoreconfigCLASSES must be between 1 and 254."
+#endif
+
+#if ( publishstoreconfigMAX_MESSAGE < 1 ) || ( publishstoreconfigMAX_MESSAGE > 0xFFF0 )
+    #error "publishstoreconfigMAX_MESSAGE must be between 1 and 65520."
+#endif
+
+static const PublishStoreFlash_t * pxStoreFlash = NULL;
+
+/* RAM ring. */
+static uint8_t ucRing[ publishstoreconfigRAM_SIZE ];
+static uint32_t ulRingHead = 0;
+static uint32_t ulRingTail = 0;
+static uint32_t ulRingUsed = 0;
+static uint32_t ulRamCount[ publishstoreconfigCLASSES ];
+
+/* Position in the flash region: the current sector and its sequence number,
+ * and the sequence number of the oldest sector in use. */
+static uint32_t ulCurrentSector = 0;
+static uint32_t ulSequence = 0;
+static uint32_t ulOldestSequence = 0;
+static uint32_t ulWriteOffset = 0;
+static BaseType_t xNeedsNewSector = pdFALSE;
+
+/* Messages in flash. No message of a class before its cursor is left. */
+static uint32_t ulNextNumber = 1;
+static uint32_t ulForwardedNumber[ publishstoreconfigCLASSES ];
+static uint32_t ulFlashCount[ publishstoreconfigCLASSES ];
+static uint32_t ulCursorSequence[ publishstoreconfigCLASSES ];
+static uint32_t ulCursorOffset[ publishstoreconfigCLASSES ];
+
+/* Message returned by the last PublishStore_Peek(). */
+static BaseType_t xPeeked = pdFALSE;
+static BaseType_t xPeekedInRam = pdFALSE;
+static uint8_t ucPeekedClass = 0;
+static uint32_t ulPeekedOffset = 0;
+static uint32_t ulPeekedNumber = 0;
+static uint32_t ulPeekedSequence = 0;
+static uint32_t ulPeekedSize = 0;
+
+static PublishStoreStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvCrc32( uint32_t ulCrc,
+                          const uint8_t * pucData,
+                          uint32_t ulLength )
+{
+    uint32_t i;
+    uint32_t j;
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        ulCrc ^= pucData[ i ];
+
+        for( j = 0; j < 8U; j++ )
+        {
+            ulCrc = ( ulCrc >> 1 ) ^ ( 0xEDB88320UL & ( 0UL - ( ulCrc & 1UL ) ) );
+        }
+    }
+
+    return ulCrc;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPutLE32( uint8_t * pucBuffer,
+                        uint32_t ulValue )
+{
+    pucBuffer[ 0 ] = ( uint8_t ) ulValue;
+    pucBuffer[ 1 ] = ( uint8_t ) ( ulValue >> 8 );
+    pucBuffer[ 2 ] = ( uint8_t ) ( ulValue >> 16 );
+    pucBuffer[ 3 ] = ( uint8_t ) ( ulValue >> 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvGetLE32( const uint8_t * pucBuffer )
+{
+    return ( uint32_t ) pucBuffer[ 0 ] |
+           ( ( uint32_t ) pucBuffer[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucBuffer[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucBuffer[ 3 ] << 24 );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Flash offset of the sector with sequence number ulSeq, which must be
+ * in use.
+ */
+static uint32_t prvSectorAddress( uint32_t ulSeq )
+{
+    uint32_t ulSector = ( ulCurrentSector + pxStoreFlash->ulSectors - ( ( ulSequence - ulSeq ) % pxStoreFlash->ulSectors ) ) %
+                        pxStoreFlash->ulSectors;
+
+    return pxStoreFlash->ulAddress + ( ulSector * pxStoreFlash->ulSectorSize );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the oldest live RAM record of a class.
+ *
+ * @return pdTRUE and its offset in pulOffset if there is one.
+ */
+static BaseType_t prvRingFind( uint8_t ucClass,
+                               uint32_t * pulOffset )
+{
+    BaseType_t xFound = pdFALSE;
+    uint32_t ulOffset = ulRingTail;
+    uint32_t ulLeft = ulRingUsed;
+    uint32_t ulSize;
+
+    while( ( pdFALSE == xFound ) && ( ulLeft > 0U ) )
+    {
+        ulSize = publishstoreRAM_RECORD_SIZE( ( uint32_t ) ucRing[ ulOffset + 2U ] | ( ( uint32_t ) ucRing[ ulOffset + 3U ] << 8 ) );
+
+        if( ( publishstoreRAM_LIVE == ucRing[ ulOffset + 1U ] ) && ( ucClass == ucRing[ ulOffset ] ) )
+        {
+            *pulOffset = ulOffset;
+            xFound = pdTRUE;
+        }
+        else
+        {
+            ulOffset = ( ulOffset + ulSize ) % publishstoreconfigRAM_SIZE;
+            ulLeft -= ulSize;
+        }
+    }
+
+    return xFound;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Append a message to the RAM ring.
+ */
+static BaseType_t prvRingPut( uint8_t ucClass,
+                              const uint8_t * pucData,
+                              uint32_t ulLength )
+{
+    BaseType_t xFits = pdFALSE;
+    uint32_t ulSize = publishstoreRAM_RECORD_SIZE( ulLength );
+    uint32_t ulEnd;
+
+    if( 0U == ulRingUsed )
+    {
+        ulRingHead = 0;
+        ulRingTail = 0;
+    }
+
+    if( ( ulRingHead < ulRingTail ) || ( ( ulRingHead == ulRingTail ) && ( ulRingUsed > 0U ) ) )
+    {
+        /* The free space is between the head and the tail. */
+        xFits = ( ulSize <= ( ulRingTail - ulRingHead ) ) ? pdTRUE : pdFALSE;
+    }
+    else if( ulSize <= ( publishstoreconfigRAM_SIZE - ulRingHead ) )
+    {
+        xFits = pdTRUE;
+    }
+    else if( ulSize <= ulRingTail )
+    {
+        /* Fill the end of the ring and go on at its start. */
+        ulEnd = publishstoreconfigRAM_SIZE - ulRingHead;
+        ucRing[ ulRingHead ] = publishstoreRAM_FILLER;
+        ucRing[ ulRingHead + 1U ] = publishstoreRAM_TAKEN;
+        ucRing[ ulRingHead + 2U ] = ( uint8_t ) ( ulEnd - publishstoreRECORD_HEADER_SIZE );
+        ucRing[ ulRingHead + 3U ] = ( uint8_t ) ( ( ulEnd - publishstoreRECORD_HEADER_SIZE ) >> 8 );
+        ulRingUsed += ulEnd;
+        ulRingHead = 0;
+        xFits = pdTRUE;
+    }
+    else
+    {
+        /* Full. */
+    }
+
+    if( pdFALSE != xFits )
+    {
+        ucRing[ ulRingHead ] = ucClass;
+        ucRing[ ulRingHead + 1U ] = publishstoreRAM_LIVE;
+        ucRing[ ulRingHead + 2U ] = ( uint8_t ) ulLength;
+        ucRing[ ulRingHead + 3U ] = ( uint8_t ) ( ulLength >> 8 );
+        ( void ) memcpy( &ucRing[ ulRingHead + publishstoreRECORD_HEADER_SIZE ], pucData, ulLength );
+        ulRingHead = ( ulRingHead + ulSize ) % publishstoreconfigRAM_SIZE;
+        ulRingUsed += ulSize;
+        ulRamCount[ ucClass ]++;
+    }
+
+    return xFits;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Release the taken records at the tail of the RAM ring.
+ */
+static void prvRingTrim( void )
+{
+    uint32_t ulSize;
+
+    while( ( ulRingUsed > 0U ) && ( publishstoreRAM_TAKEN == ucRing[ ulRingTail + 1U ] ) )
+    {
+        ulSize = publishstoreRAM_RECORD_SIZE( ( uint32_t ) ucRing[ ulRingTail + 2U ] | ( ( uint32_t ) ucRing[ ulRingTail + 3U ] << 8 ) );
+        ulRingTail = ( ulRingTail + ulSize ) % publishstoreconfigRAM_SIZE;
+        ulRingUsed -= ulSize;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Program a record whose payload is a message number followed by
+ * ulLength bytes of data.
+ */
+static BaseType_t prvWriteRecord( uint32_t ulAddress,
+                                  uint8_t ucType,
+                                  uint8_t ucClass,
+                                  uint32_t ulNumber,
+                                  const uint8_t * pucData,
+                                  uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint8_t ucBuffer[ publishstoreRECORD_HEADER_SIZE + publishstoreNUMBER_SIZE ];
+    uint32_t ulPayloadLength = publishstoreNUMBER_SIZE + ulLength;
+    uint32_t ulCrc;
+
+    ucBuffer[ 0 ] = ucType;
+    ucBuffer[ 1 ] = ucClass;
+    ucBuffer[ 2 ] = ( uint8_t ) ulPayloadLength;
+    ucBuffer[ 3 ] = ( uint8_t ) ( ulPayloadLength >> 8 );
+    prvPutLE32( &ucBuffer[ publishstoreRECORD_HEADER_SIZE ], ulNumber );
+    ulCrc = prvCrc32( 0xFFFFFFFFUL, ucBuffer, sizeof( ucBuffer ) );
+    ulCrc = prvCrc32( ulCrc, pucData, ulLength );
+
+    xResult = pxStoreFlash->xProgram( ulAddress, ucBuffer, sizeof( ucBuffer ) );
+
+    if( ( pdFALSE != xResult ) && ( ulLength > 0U ) )
+    {
+        xResult = pxStoreFlash->xProgram( ulAddress + sizeof( ucBuffer ), pucData, ulLength );
+    }
+
+    if( pdFALSE != xResult )
+    {
+        prvPutLE32( ucBuffer, ~ulCrc );
+        xResult = pxStoreFlash->xProgram( ulAddress + publishstoreRECORD_SIZE( ulPayloadLength ) - publishstoreCRC_SIZE,
+                                          ucBuffer,
+                                          publishstoreCRC_SIZE );
+    }
+
+    if( pdFALSE == xResult )
+    {
+        xStats.ulFailures++;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read the payload of a record and check its CRC. The message number
+ * goes to pulNumber and, if pucData is not NULL, the rest to pucData.
+ */
+static BaseType_t prvReadRecord( uint32_t ulAddress,
+                                 const uint8_t * pucHeader,
+                                 uint32_t * pulNumber,
+                                 uint8_t * pucData )
+{
+    BaseType_t xResult = pdTRUE;
+    uint8_t ucBuffer[ publishstoreCHUNK_SIZE ];
+    uint32_t ulLength = ( uint32_t ) pucHeader[ 2 ] | ( ( uint32_t ) pucHeader[ 3 ] << 8 );
+    uint32_t ulCrc = prvCrc32( 0xFFFFFFFFUL, pucHeader, publishstoreRECORD_HEADER_SIZE );
+    uint32_t ulChunk;
+    uint32_t i;
+
+    if( ulLength < publishstoreNUMBER_SIZE )
+    {
+        xResult = pdFALSE;
+    }
+    else
+    {
+        xResult = pxStoreFlash->xRead( ulAddress + publishstoreRECORD_HEADER_SIZE, ucBuffer, publishstoreNUMBER_SIZE );
+        ulCrc = prvCrc32( ulCrc, ucBuffer, publishstoreNUMBER_SIZE );
+        *pulNumber = prvGetLE32( ucBuffer );
+    }
+
+    /* Read the data straight into the caller's buffer, or in chunks only to
+     * check it. */
+    for( i = publishstoreNUMBER_SIZE; ( i < ulLength ) && ( pdFALSE != xResult ); i += ulChunk )
+    {
+        if( NULL != pucData )
+        {
+            ulChunk = ulLength - i;
+            xResult = pxStoreFlash->xRead( ulAddress + publishstoreRECORD_HEADER_SIZE + i, &pucData[ i - publishstoreNUMBER_SIZE ], ulChunk );
+            ulCrc = prvCrc32( ulCrc, &pucData[ i - publishstoreNUMBER_SIZE ], ulChunk );
+        }
+        else
+        {
+            ulChunk = ( ( ulLength - i ) > publishstoreCHUNK_SIZE ) ? publishstoreCHUNK_SIZE : ( ulLength - i );
+            xResult = pxStoreFlash->xRead( ulAddress + publishstoreRECORD_HEADER_SIZE + i, ucBuffer, ulChunk );
+            ulCrc = prvCrc32( ulCrc, ucBuffer, ulChunk );
+        }
+    }
+
+    if( pdFALSE != xResult )
+    {
+        xResult = pxStoreFlash->xRead( ulAddress + publishstoreRECORD_SIZE( ulLength ) - publishstoreCRC_SIZE,
+                                       ucBuffer,
+                                       publishstoreCRC_SIZE );
+    }
+
+    if( ( pdFALSE != xResult ) && ( prvGetLE32( ucBuffer ) != ~ulCrc ) )
+    {
+        xResult = pdFALSE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the record at or after a position of the log, moving to the
+ * next sector at the end of one.
+ *
+ * The end of a sector is the write offset for the current one, and the first
+ * erased or oversized record for the others.
+ *
+ * @return pdTRUE and the record header if there is one, with the position
+ * updated to it; pdFALSE at the end of the log.
+ */
+static BaseType_t prvNextRecord( uint32_t * pulSeq,
+                                 uint32_t * pulOffset,
+                                 uint8_t * pucHeader )
+{
+    BaseType_t xFound = pdFALSE;
+    BaseType_t xEnd = pdFALSE;
+    uint32_t ulEndOffset;
+    uint32_t ulLength;
+
+    while( ( pdFALSE == xFound ) && ( pdFALSE == xEnd ) )
+    {
+        ulEndOffset = ( *pulSeq == ulSequence ) ? ulWriteOffset : pxStoreFlash->ulSectorSize;
+
+        if( ( ( *pulOffset + publishstoreRECORD_SIZE( 0U ) ) <= ulEndOffset ) &&
+            ( pdFALSE != pxStoreFlash->xRead( prvSectorAddress( *pulSeq ) + *pulOffset, pucHeader, publishstoreRECORD_HEADER_SIZE ) ) &&
+            ( 0xFFFFFFFFUL != prvGetLE32( pucHeader ) ) )
+        {
+            ulLength = ( uint32_t ) pucHeader[ 2 ] | ( ( uint32_t ) pucHeader[ 3 ] << 8 );
+            xFound = ( ( *pulOffset + publishstoreRECORD_SIZE( ulLength ) ) <= ulEndOffset ) ? pdTRUE : pdFALSE;
+        }
+
+        if( pdFALSE != xFound )
+        {
+            /* Found. */
+        }
+        else if( *pulSeq == ulSequence )
+        {
+            xEnd = pdTRUE;
+        }
+        else
+        {
+            *pulSeq += 1U;
+            *pulOffset = publishstoreSECTOR_HEADER_SIZE;
+        }
+    }
+
+    return xFound;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Check whether a sector still holds a message to forward.
+ */
+static BaseType_t prvSectorHasMessages( uint32_t ulSeq )
+{
+    BaseType_t xPending = pdFALSE;
+    uint32_t ulRecordSeq = ulSeq;
+    uint32_t ulOffset = publishstoreSECTOR_HEADER_SIZE;
+    uint32_t ulNumber;
+    uint8_t ucHeader[ publishstoreRECORD_HEADER_SIZE ];
+    uint8_t ucNumber[ publishstoreNUMBER_SIZE ];
+
+    while( ( pdFALSE == xPending ) &&
+           ( pdFALSE != prvNextRecord( &ulRecordSeq, &ulOffset, ucHeader ) ) &&
+           ( ulRecordSeq == ulSeq ) )
+    {
+        if( ( publishstoreRECORD_MESSAGE == ucHeader[ 0 ] ) && ( ucHeader[ 1 ] < publishstoreconfigCLASSES ) &&
+            ( pdFALSE != pxStoreFlash->xRead( prvSectorAddress( ulSeq ) + ulOffset + publishstoreRECORD_HEADER_SIZE, ucNumber, sizeof( ucNumber ) ) ) )
+        {
+            ulNumber = prvGetLE32( ucNumber );
+
+            if( publishstoreIS_AFTER( ulNumber, ulForwardedNumber[ ucHeader[ 1 ] ] ) )
+            {
+                xPending = pdTRUE;
+            }
+        }
+
+        ulOffset += publishstoreRECORD_SIZE( ( uint32_t ) ucHeader[ 2 ] | ( ( uint32_t ) ucHeader[ 3 ] << 8 ) );
+    }
+
+    return xPending;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Erase the sector after the current one and make it current, with a
+ * forwarded record per class. The oldest sector is reused only if all its
+ * messages were forwarded.
+ */
+static BaseType_t prvNextSector( void )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulNext = ( ulCurrentSector + 1U ) % pxStoreFlash->ulSectors;
+    uint32_t ulAddress = pxStoreFlash->ulAddress + ( ulNext * pxStoreFlash->ulSectorSize );
+    uint32_t ulOffset = publishstoreSECTOR_HEADER_SIZE;
+    uint8_t ucBuffer[ publishstoreSECTOR_HEADER_SIZE ];
+    uint32_t i;
+
+    if( ( ulSequence - ulOldestSequence + 1U ) >= pxStoreFlash->ulSectors )
+    {
+        /* The next sector is the oldest one. */
+        if( pdFALSE != prvSectorHasMessages( ulOldestSequence ) )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            ulOldestSequence++;
+
+            for( i = 0; i < publishstoreconfigCLASSES; i++ )
+            {
+                if( publishstoreIS_AFTER( ulOldestSequence, ulCursorSequence[ i ] ) )
+                {
+                    ulCursorSequence[ i ] = ulOldestSequence;
+                    ulCursorOffset[ i ] = publishstoreSECTOR_HEADER_SIZE;
+                }
+            }
+        }
+    }
+
+    if( pdFALSE == xResult )
+    {
+        /* Full. */
+    }
+    else if( pdFALSE == pxStoreFlash->xErase( ulAddress ) )
+    {
+        xStats.ulFailures++;
+        xResult = pdFALSE;
+    }
+    else
+    {
+        prvPutLE32( &ucBuffer[ 0 ], publishstoreMAGIC );
+        prvPutLE32( &ucBuffer[ 4 ], ulSequence + 1U );
+        prvPutLE32( &ucBuffer[ 8 ], ~( ulSequence + 1U ) );
+        xResult = pxStoreFlash->xProgram( ulAddress, ucBuffer, publishstoreSECTOR_HEADER_SIZE );
+
+        if( pdFALSE == xResult )
+        {
+            xStats.ulFailures++;
+        }
+    }
+
+    if( pdFALSE != xResult )
+    {
+        ulCurrentSector = ulNext;
+        ulSequence++;
+
+        for( i = 0; ( i < publishstoreconfigCLASSES ) && ( pdFALSE != xResult ); i++ )
+        {
+            if( 0U != ulForwardedNumber[ i ] )
+            {
+                xResult = prvWriteRecord( ulAddress + ulOffset, publishstoreRECORD_FORWARDED, ( uint8_t ) i, ulForwardedNumber[ i ], NULL, 0U );
+                ulOffset += publishstoreRECORD_SIZE( publishstoreNUMBER_SIZE );
+            }
+        }
+
+        ulWriteOffset = ulOffset;
+        xNeedsNewSector = ( pdFALSE != xResult ) ? pdFALSE : pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Append a record to the current sector, moving to the next sector
+ * first if it does not fit.
+ */
+static BaseType_t prvAppend( uint8_t ucType,
+                             uint8_t ucClass,
+                             uint32_t ulNumber,
+                             const uint8_t * pucData,
+                             uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulSize = publishstoreRECORD_SIZE( publishstoreNUMBER_SIZE + ulLength );
+
+    if( ( pdFALSE != xNeedsNewSector ) || ( ( ulWriteOffset + ulSize ) > pxStoreFlash->ulSectorSize ) )
+    {
+        xResult = prvNextSector();
+    }
+
+    if( ( pdFALSE != xResult ) && ( ( ulWriteOffset + ulSize ) > pxStoreFlash->ulSectorSize ) )
+    {
+        xResult = pdFALSE;
+    }
+
+    if( pdFALSE != xResult )
+    {
+        xResult = prvWriteRecord( prvSectorAddress( ulSequence ) + ulWriteOffset, ucType, ucClass, ulNumber, pucData, ulLength );
+
+        if( pdFALSE == xResult )
+        {
+            /* The space may hold part of the record; go on elsewhere. */
+            xNeedsNewSector = pdTRUE;
+        }
+
+        ulWriteOffset += ulSize;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Go through the records of the sectors in use, up to the first
+ * erased or damaged one of each. The first pass finds the end of the current
+ * sector, the last message number and the forwarded records; the second one
+ * counts the messages left.
+ */
+static void prvReplay( BaseType_t xCount )
+{
+    uint32_t ulSeq;
+    uint32_t ulAddress;
+    uint32_t ulOffset;
+    uint32_t ulLength;
+    uint32_t ulNumber = 0;
+    uint8_t ucHeader[ publishstoreRECORD_HEADER_SIZE ];
+    BaseType_t xDone;
+
+    for( ulSeq = ulOldestSequence; ulSeq != ( ulSequence + 1U ); ulSeq++ )
+    {
+        ulAddress = prvSectorAddress( ulSeq );
+        ulOffset = publishstoreSECTOR_HEADER_SIZE;
+        xDone = pdFALSE;
+
+        while( pdFALSE == xDone )
+        {
+            xDone = pdTRUE;
+
+            if( ( ulOffset + publishstoreRECORD_SIZE( 0U ) ) > pxStoreFlash->ulSectorSize )
+            {
+                /* The sector is full. */
+            }
+            else if( pdFALSE == pxStoreFlash->xRead( ulAddress + ulOffset, ucHeader, sizeof( ucHeader ) ) )
+            {
+                xNeedsNewSector = pdTRUE;
+            }
+            else if( 0xFFFFFFFFUL == prvGetLE32( ucHeader ) )
+            {
+                /* Erased: the end of the sector. */
+            }
+            else
+            {
+                ulLength = ( uint32_t ) ucHeader[ 2 ] | ( ( uint32_t ) ucHeader[ 3 ] << 8 );
+
+                if( ( ( ulOffset + publishstoreRECORD_SIZE( ulLength ) ) > pxStoreFlash->ulSectorSize ) ||
+                    ( ucHeader[ 1 ] >= publishstoreconfigCLASSES ) ||
+                    ( pdFALSE == prvReadRecord( ulAddress + ulOffset, ucHeader, &ulNumber, NULL ) ) )
+                {
+                    /* Torn by a reset; nothing follows it in the sector. */
+                    xNeedsNewSector = ( ulSeq == ulSequence ) ? pdTRUE : xNeedsNewSector;
+                }
+                else
+                {
+                    if( pdFALSE == xCount )
+                    {
+                        /* The messages of a forwarded record may be gone with
+                         * their sector; the next number follows both. */
+                        if( publishstoreIS_AFTER( ulNumber + 1U, ulNextNumber ) )
+                        {
+                            ulNextNumber = ulNumber + 1U;
+                        }
+
+                        if( ( publishstoreRECORD_FORWARDED == ucHeader[ 0 ] ) &&
+                            ( ( 0U == ulForwardedNumber[ ucHeader[ 1 ] ] ) || publishstoreIS_AFTER( ulNumber, ulForwardedNumber[ ucHeader[ 1 ] ] ) ) )
+                        {
+                            ulForwardedNumber[ ucHeader[ 1 ] ] = ulNumber;
+                        }
+                    }
+                    else if( ( publishstoreRECORD_MESSAGE == ucHeader[ 0 ] ) &&
+                             publishstoreIS_AFTER( ulNumber, ulForwardedNumber[ ucHeader[ 1 ] ] ) )
+                    {
+                        ulFlashCount[ ucHeader[ 1 ] ]++;
+                        xStats.ulRecovered++;
+                    }
+                    else
+                    {
+                        /* Already forwarded. */
+                    }
+
+                    ulOffset += publishstoreRECORD_SIZE( ulLength );
+                    xDone = pdFALSE;
+                }
+            }
+        }
+
+        if( ulSeq == ulSequence )
+        {
+            ulWriteOffset = ulOffset;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t PublishStore_Init( const PublishStoreFlash_t * pxFlash )
+{
+    BaseType_t xResult = pdTRUE;
+    BaseType_t xFound = pdFALSE;
+    uint8_t ucBuffer[ publishstoreSECTOR_HEADER_SIZE ];
+    uint32_t ulSeq;
+    uint32_t ulSector;
+    uint32_t i;
+
+    pxStoreFlash = NULL;
+    ulRingHead = 0;
+    ulRingTail = 0;
+    ulRingUsed = 0;
+    ulNextNumber = 1;
+    xNeedsNewSector = pdFALSE;
+    xPeeked = pdFALSE;
+    memset( ulRamCount, 0, sizeof( ulRamCount ) );
+    memset( ulForwardedNumber, 0, sizeof( ulForwardedNumber ) );
+    memset( ulFlashCount, 0, sizeof( ulFlashCount ) );
+    memset( &xStats, 0, sizeof( xStats ) );
+
+    if( NULL == pxFlash )
+    {
+        /* RAM only. */
+    }
+    else if( ( NULL == pxFlash->xRead ) || ( NULL == pxFlash->xProgram ) || ( NULL == pxFlash->xErase ) ||
+             ( pxFlash->ulSectors < 2U ) ||
+             ( pxFlash->ulSectorSize < ( publishstoreSECTOR_HEADER_SIZE +
+                                         ( publishstoreconfigCLASSES * publishstoreRECORD_SIZE( publishstoreNUMBER_SIZE ) ) +
+                                         publishstoreRECORD_SIZE( publishstoreNUMBER_SIZE + publishstoreconfigMAX_MESSAGE ) ) ) )
+    {
+        xResult = pdFALSE;
+    }
+    else
+    {
+        pxStoreFlash = pxFlash;
+
+        /* The current sector is the valid one with the highest sequence. */
+        for( i = 0; i < pxFlash->ulSectors; i++ )
+        {
+            if( ( pdFALSE != pxFlash->xRead( pxFlash->ulAddress + ( i * pxFlash->ulSectorSize ), ucBuffer, sizeof( ucBuffer ) ) ) &&
+                ( publishstoreMAGIC == prvGetLE32( &ucBuffer[ 0 ] ) ) &&
+                ( prvGetLE32( &ucBuffer[ 4 ] ) == ~prvGetLE32( &ucBuffer[ 8 ] ) ) )
+            {
+                ulSeq = prvGetLE32( &ucBuffer[ 4 ] );
+
+                if( ( pdFALSE == xFound ) || publishstoreIS_AFTER( ulSeq, ulSequence ) )
+                {
+                    xFound = pdTRUE;
+                    ulCurrentSector = i;
+                    ulSequence = ulSeq;
+                }
+            }
+        }
+
+        if( pdFALSE == xFound )
+        {
+            /* Nothing stored yet: start with the first sector. */
+            ulCurrentSector = pxFlash->ulSectors - 1U;
+            ulSequence = 0;
+            ulOldestSequence = 1;
+            xResult = prvNextSector();
+        }
+        else
+        {
+            /* The sectors before the current one in turn, with the sequence
+             * numbers before its, are still in use. */
+            ulOldestSequence = ulSequence;
+
+            for( i = 1; i < pxFlash->ulSectors; i++ )
+            {
+                ulSector = ( ulCurrentSector + pxFlash->ulSectors - i ) % pxFlash->ulSectors;
+
+                if( ( pdFALSE != pxFlash->xRead( pxFlash->ulAddress + ( ulSector * pxFlash->ulSectorSize ), ucBuffer, sizeof( ucBuffer ) ) ) &&
+                    ( publishstoreMAGIC == prvGetLE32( &ucBuffer[ 0 ] ) ) &&
+                    ( prvGetLE32( &ucBuffer[ 4 ] ) == ~prvGetLE32( &ucBuffer[ 8 ] ) ) &&
+                    ( prvGetLE32( &ucBuffer[ 4 ] ) == ( ulSequence - i ) ) )
+                {
+                    ulOldestSequence = ulSequence - i;
+                }
+                else
+                {
+                    break;
+                }
+            }
+
+            prvReplay( pdFALSE );
+            prvReplay( pdTRUE );
+        }
+
+        for( i = 0; i < publishstoreconfigCLASSES; i++ )
+        {
+            ulCursorSequence[ i ] = ulOldestSequence;
+            ulCursorOffset[ i ] = publishstoreSECTOR_HEADER_SIZE;
+        }
+
+        if( pdFALSE == xResult )
+        {
+            pxStoreFlash = NULL;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t PublishStore_Put( uint8_t ucClass,
+                             const uint8_t * pucData,
+                             uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( ucClass >= publishstoreconfigCLASSES ) || ( NULL == pucData ) ||
+        ( 0U == ulLength ) || ( ulLength > ( uint32_t ) publishstoreconfigMAX_MESSAGE ) )
+    {
+        /* Invalid message. */
+    }
+    else if( ( 0U == ulFlashCount[ ucClass ] ) && ( pdFALSE != prvRingPut( ucClass, pucData, ulLength ) ) )
+    {
+        xResult = pdTRUE;
+    }
+    else if( ( NULL != pxStoreFlash ) &&
+             ( pdFALSE != prvAppend( publishstoreRECORD_MESSAGE, ucClass, ulNextNumber, pucData, ulLength ) ) )
+    {
+        ulNextNumber++;
+
+        /* Numbers of forwarded messages are compared to it; skip 0. */
+        if( 0U == ulNextNumber )
+        {
+            ulNextNumber = 1;
+        }
+
+        ulFlashCount[ ucClass ]++;
+        xStats.ulSpilled++;
+        xResult = pdTRUE;
+    }
+    else
+    {
+        /* The store is full. */
+    }
+
+    if( pdFALSE != xResult )
+    {
+        xStats.ulStored++;
+    }
+    else
+    {
+        xStats.ulDropped++;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t PublishStore_Peek( uint8_t * pucBuffer,
+                            uint8_t * pucClass )
+{
+    uint32_t ulLength = 0;
+    uint32_t ulOffset;
+    uint32_t ulNumber;
+    uint32_t i;
+    uint8_t ucHeader[ publishstoreRECORD_HEADER_SIZE ];
+
+    xPeeked = pdFALSE;
+
+    for( i = 0; ( i < publishstoreconfigCLASSES ) && ( pdFALSE == xPeeked ) && ( NULL != pucBuffer ); i++ )
+    {
+        if( ( ulRamCount[ i ] > 0U ) && ( pdFALSE != prvRingFind( ( uint8_t ) i, &ulOffset ) ) )
+        {
+            ulLength = ( uint32_t ) ucRing[ ulOffset + 2U ] | ( ( uint32_t ) ucRing[ ulOffset + 3U ] << 8 );
+            ( void ) memcpy( pucBuffer, &ucRing[ ulOffset + publishstoreRECORD_HEADER_SIZE ], ulLength );
+            ulPeekedOffset = ulOffset;
+            xPeekedInRam = pdTRUE;
+            xPeeked = pdTRUE;
+        }
+
+        /* Messages of the class in flash follow those in RAM. */
+        while( ( pdFALSE == xPeeked ) && ( ulFlashCount[ i ] > 0U ) )
+        {
+            if( pdFALSE == prvNextRecord( &ulCursorSequence[ i ], &ulCursorOffset[ i ], ucHeader ) )
+            {
+                xStats.ulLost += ulFlashCount[ i ];
+                ulFlashCount[ i ] = 0;
+            }
+            else
+            {
+                ulLength = ( uint32_t ) ucHeader[ 2 ] | ( ( uint32_t ) ucHeader[ 3 ] << 8 );
+
+                if( ( publishstoreRECORD_MESSAGE != ucHeader[ 0 ] ) || ( i != ucHeader[ 1 ] ) ||
+                    ( ulLength > ( publishstoreNUMBER_SIZE + publishstoreconfigMAX_MESSAGE ) ) )
+                {
+                    /* Not a message of this class. */
+                }
+                else if( pdFALSE == prvReadRecord( prvSectorAddress( ulCursorSequence[ i ] ) + ulCursorOffset[ i ], ucHeader, &ulNumber, pucBuffer ) )
+                {
+                    /* Torn by a reset and not counted, or damaged since; the
+                     * count is settled at the end of the log. */
+                }
+                else if( publishstoreIS_AFTER( ulNumber, ulForwardedNumber[ i ] ) )
+                {
+                    ulPeekedNumber = ulNumber;
+                    ulPeekedSequence = ulCursorSequence[ i ];
+                    ulPeekedOffset = ulCursorOffset[ i ];
+                    ulPeekedSize = publishstoreRECORD_SIZE( ulLength );
+                    ulLength -= publishstoreNUMBER_SIZE;
+                    xPeekedInRam = pdFALSE;
+                    xPeeked = pdTRUE;
+                }
+                else
+                {
+                    /* Already forwarded. */
+                }
+
+                if( pdFALSE == xPeeked )
+                {
+                    ulCursorOffset[ i ] += publishstoreRECORD_SIZE( ( uint32_t ) ucHeader[ 2 ] | ( ( uint32_t ) ucHeader[ 3 ] << 8 ) );
+                }
+            }
+        }
+
+        if( pdFALSE != xPeeked )
+        {
+            ucPeekedClass = ( uint8_t ) i;
+        }
+    }
+
+    if( pdFALSE == xPeeked )
+    {
+        ulLength = 0;
+    }
+    else if( NULL != pucClass )
+    {
+        *pucClass = ucPeekedClass;
+    }
+    else
+    {
+        /* The caller does not need the class. */
+    }
+
+    return ulLength;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t PublishStore_Remove( void )
+{
+    BaseType_t xResult = xPeeked;
+
+    if( pdFALSE == xPeeked )
+    {
+        /* Nothing to remove. */
+    }
+    else if( pdFALSE != xPeekedInRam )
+    {
+        ucRing[ ulPeekedOffset + 1U ] = publishstoreRAM_TAKEN;
+        ulRamCount[ ucPeekedClass ]--;
+        prvRingTrim();
+    }
+    else
+    {
+        ulForwardedNumber[ ucPeekedClass ] = ulPeekedNumber;
+        ulFlashCount[ ucPeekedClass ]--;
+
+        /* The cursor stays on the message until it is forwarded. */
+        ulCursorSequence[ ucPeekedClass ] = ulPeekedSequence;
+        ulCursorOffset[ ucPeekedClass ] = ulPeekedOffset + ulPeekedSize;
+
+        /* If this fails, the message may be handed back again after a
+         * reset. */
+        ( void ) prvAppend( publishstoreRECORD_FORWARDED, ucPeekedClass, ulPeekedNumber, NULL, 0U );
+    }
+
+    if( pdFALSE != xResult )
+    {
+        xStats.ulForwarded++;
+        xPeeked = pdFALSE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t PublishStore_GetCount( void )
+{
+    uint32_t ulCount = 0;
+    uint32_t i;
+
+    for( i = 0; i < publishstoreconfigCLASSES; i++ )
+    {
+        ulCount += ulRamCount[ i ] + ulFlashCount[ i ];
+    }
+
+    return ulCount;
+}
+
+/*-----------------------------------------------------------*/
+
+void PublishStore_GetStats( PublishStoreStats_t * pxStats )
+{
+    if( NULL != pxStats )
+    {
+        *pxStats = xStats;
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file iot_sockets_sendv.c
+ * @brief SOCKETS_SendV() body shared by the lwIP based Secure Sockets ports.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "iot_secure_sockets.h"
+#include "iot_tls.h"
+#include "iot_sockets_sendv.h"
+
+/* lwIP includes. */
+#include "lwip/sockets.h"
+
+/*-----------------------------------------------------------*/
+
+int32_t SocketsSendV_Send( int lSocket,
+                           void * pvTlsContext,
+                           const SocketsIoVector_t * pxVectors,
+                           size_t xVectorCount,
+                           uint32_t ulFlags )
+{
+    int32_t lResult = SOCKETS_EINVAL;
+    size_t i;
+
+    if( ( NULL == pxVectors ) || ( 0U == xVectorCount ) ||
+        ( xVectorCount > socketsconfigMAX_SEND_VECTORS ) )
+    {
+        /* Bad vector list; lResult is already SOCKETS_EINVAL. */
+    }
+    else if( NULL != pvTlsContext )
+    {
+        TLSIoVector_t xTlsVectors[ socketsconfigMAX_SEND_VECTORS ];
+
+        for( i = 0; i < xVectorCount; i++ )
+        {
+            xTlsVectors[ i ].pvBase = pxVectors[ i ].pvBase;
+            xTlsVectors[ i ].xLength = pxVectors[ i ].xLength;
+        }
+
+        lResult = ( int32_t ) TLS_SendV( pvTlsContext, xTlsVectors, xVectorCount );
+    }
+    else
+    {
+        struct iovec xIov[ socketsconfigMAX_SEND_VECTORS ];
+        struct msghdr xMessage;
+
+        for( i = 0; i < xVectorCount; i++ )
+        {
+            xIov[ i ].iov_base = ( void * ) pxVectors[ i ].pvBase; /*lint !e9005 lwIP does not write to the buffers. */
+            xIov[ i ].iov_len = pxVectors[ i ].xLength;
+        }
+
+        ( void ) memset( &xMessage, 0, sizeof( xMessage ) );
+        xMessage.msg_iov = xIov;
+        xMessage.msg_iovlen = ( int ) xVectorCount;
+
+        /* lwip_writev() takes no flags; lwip_sendmsg() is the same gather
+         * write with them. */
+        lResult = ( int32_t ) lwip_sendmsg( lSocket, &xMessage, ( int ) ulFlags );
+    }
+
+    return lResult;
+}
@@ -0,0 +1,436 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_test_dns_cache.c
+ * @brief Host test of the host name resolution cache.
+ *
+ * The cache runs against a fake resolver and a fake millisecond clock. The
+ * background refresh task is a POSIX thread. Build and run from this
+ * directory with:
+ *
+ *   gcc -std=c99 -Wall -Wextra -g -fsanitize=address,undefined -pthread \
+ *       -Istubs -I../include iot_test_dns_cache.c stubs/freertos_stubs.c \
+ *       -o iot_test_dns_cache && ./iot_test_dns_cache
+ */
+
+#define _POSIX_C_SOURCE    200809L
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Small, fast configuration with a clock the test moves by hand. */
+#define dnscacheconfigENTRIES               ( 2 )
+#define dnscacheconfigHOST_NAME_LENGTH      ( 16 )
+#define dnscacheconfigTTL_MS                ( 1000 )
+#define dnscacheconfigPREFETCH_MS           ( 200 )
+#define dnscacheconfigSTALE_MS              ( 5000 )
+#define dnscacheconfigGET_TIME_MS()         ( ulTestTimeMs )
+
+static volatile uint32_t ulTestTimeMs = 0;
+
+/* The module is included so that every test starts from an empty cache. */
+#include "../src/iot_dns_cache.c"
+
+#define TEST_ADDRESS_A     ( 0x0A000001UL )
+#define TEST_ADDRESS_B     ( 0x0A000002UL )
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+static uint32_t ulFailures = 0;
+
+/* Fake resolver state, protected by xResolverStateMutex. */
+static pthread_mutex_t xResolverStateMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t ulResolverAddress = TEST_ADDRESS_A;
+static uint32_t ulResolverCalls = 0;
+static uint32_t ulResolverActive = 0;
+static uint32_t ulResolverMaxActive = 0;
+static long lResolverDelayMs = 0;
+static BaseType_t xResolverGateClosed = pdFALSE; /* Holds resolver calls back. */
+
+/*-----------------------------------------------------------*/
+
+static void prvSleepMs( long lMs )
+{
+    struct timespec xDelay;
+
+    xDelay.tv_sec = lMs / 1000;
+    xDelay.tv_nsec = ( lMs % 1000 ) * 1000000L;
+    ( void ) nanosleep( &xDelay, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvResolverGateClosed( void )
+{
+    BaseType_t xClosed;
+
+    ( void ) pthread_mutex_lock( &xResolverStateMutex );
+    xClosed = xResolverGateClosed;
+    ( void ) pthread_mutex_unlock( &xResolverStateMutex );
+
+    return xClosed;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSetResolverGate( BaseType_t xClosed )
+{
+    ( void ) pthread_mutex_lock( &xResolverStateMutex );
+    xResolverGateClosed = xClosed;
+    ( void ) pthread_mutex_unlock( &xResolverStateMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvFakeResolver( const char * pcHostName )
+{
+    uint32_t ulAddress = 0;
+    long lDelayMs = 0;
+    uint32_t i;
+
+    ( void ) pcHostName;
+
+    ( void ) pthread_mutex_lock( &xResolverStateMutex );
+    ulResolverCalls++;
+    ulResolverActive++;
+
+    if( ulResolverActive > ulResolverMaxActive )
+    {
+        ulResolverMaxActive = ulResolverActive;
+    }
+
+    lDelayMs = lResolverDelayMs;
+    ( void ) pthread_mutex_unlock( &xResolverStateMutex );
+
+    if( lDelayMs > 0 )
+    {
+        prvSleepMs( lDelayMs );
+    }
+
+    /* Held until the gate opens, or 2 s at most so that a test that blocks
+     * here fails instead of hanging. */
+    for( i = 0; ( i < 2000U ) && ( pdFALSE != prvResolverGateClosed() ); i++ )
+    {
+        prvSleepMs( 1 );
+    }
+
+    ( void ) pthread_mutex_lock( &xResolverStateMutex );
+    ulAddress = ulResolverAddress;
+    ulResolverActive--;
+    ( void ) pthread_mutex_unlock( &xResolverStateMutex );
+
+    return ulAddress;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvResolverCalls( void )
+{
+    uint32_t ulCalls;
+
+    ( void ) pthread_mutex_lock( &xResolverStateMutex );
+    ulCalls = ulResolverCalls;
+    ( void ) pthread_mutex_unlock( &xResolverStateMutex );
+
+    return ulCalls;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvResolverActive( void )
+{
+    uint32_t ulActive;
+
+    ( void ) pthread_mutex_lock( &xResolverStateMutex );
+    ulActive = ulResolverActive;
+    ( void ) pthread_mutex_unlock( &xResolverStateMutex );
+
+    return ulActive;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWaitForPrefetch( void )
+{
+    BaseType_t xPending = pdTRUE;
+    uint32_t i;
+
+    for( i = 0; ( i < 2000U ) && ( pdFALSE != xPending ); i++ )
+    {
+        taskENTER_CRITICAL();
+        xPending = xPrefetchPending;
+        taskEXIT_CRITICAL();
+
+        if( pdFALSE != xPending )
+        {
+            prvSleepMs( 1 );
+        }
+    }
+
+    TEST_CHECK( pdFALSE == xPending );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvReset( void )
+{
+    prvWaitForPrefetch();
+    DnsCache_Flush( NULL );
+    memset( &xStats, 0, sizeof( xStats ) );
+
+    ulTestTimeMs = 100000U;
+    ulResolverAddress = TEST_ADDRESS_A;
+    ulResolverCalls = 0;
+    ulResolverActive = 0;
+    ulResolverMaxActive = 0;
+    lResolverDelayMs = 0;
+    xResolverGateClosed = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestHitAndExpiry( void )
+{
+    DnsCacheStats_t xResult;
+
+    prvReset();
+
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    TEST_CHECK( 1U == prvResolverCalls() );
+
+    /* Fresh and before the prefetch window: answered from the cache. */
+    ulTestTimeMs += 500U;
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    TEST_CHECK( 1U == prvResolverCalls() );
+
+    /* Expired for longer than the stale window: the caller blocks on the
+     * resolver and gets the new address. */
+    ulTestTimeMs += 6000U;
+    ulResolverAddress = TEST_ADDRESS_B;
+    TEST_CHECK( TEST_ADDRESS_B == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    TEST_CHECK( 2U == prvResolverCalls() );
+
+    DnsCache_GetStats( &xResult );
+    TEST_CHECK( 1U == xResult.ulHits );
+    TEST_CHECK( 2U == xResult.ulMisses );
+    TEST_CHECK( 0U == xResult.ulPrefetches );
+    TEST_CHECK( 0U == xResult.ulStaleHits );
+    TEST_CHECK( 0U == xResult.ulFailures );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestPrefetch( void )
+{
+    DnsCacheStats_t xResult;
+
+    prvReset();
+
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+
+    /* In the prefetch window the cached address is returned at once and a
+     * background refresh stores the new one. */
+    ulTestTimeMs += 900U;
+    ulResolverAddress = TEST_ADDRESS_B;
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    prvWaitForPrefetch();
+    TEST_CHECK( 2U == prvResolverCalls() );
+
+    /* Past the original expiry the refreshed entry is still fresh. */
+    ulTestTimeMs += 500U;
+    TEST_CHECK( TEST_ADDRESS_B == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    TEST_CHECK( 2U == prvResolverCalls() );
+
+    DnsCache_GetStats( &xResult );
+    TEST_CHECK( 1U == xResult.ulPrefetches );
+    TEST_CHECK( 1U == xResult.ulMisses );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestStaleWhileRevalidate( void )
+{
+    DnsCacheStats_t xResult;
+    uint32_t i;
+
+    prvReset();
+
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+
+    /* Expired: the last address is returned while the refresh is still held
+     * in the resolver, so the lookup did not wait for it. */
+    ulTestTimeMs += 2000U;
+    ulResolverAddress = TEST_ADDRESS_B;
+    prvSetResolverGate( pdTRUE );
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+
+    for( i = 0; ( i < 2000U ) && ( 0U == prvResolverActive() ); i++ )
+    {
+        prvSleepMs( 1 );
+    }
+
+    TEST_CHECK( 1U == prvResolverActive() );
+
+    /* A second stale hit does not start another refresh. */
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    TEST_CHECK( 2U == prvResolverCalls() );
+
+    prvSetResolverGate( pdFALSE );
+    prvWaitForPrefetch();
+    TEST_CHECK( TEST_ADDRESS_B == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    TEST_CHECK( 2U == prvResolverCalls() );
+
+    /* A failed refresh keeps the entry, and the next stale hit retries. */
+    ulTestTimeMs += 2000U;
+    ulResolverAddress = 0U;
+    TEST_CHECK( TEST_ADDRESS_B == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    prvWaitForPrefetch();
+    TEST_CHECK( TEST_ADDRESS_B == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    prvWaitForPrefetch();
+    TEST_CHECK( 4U == prvResolverCalls() );
+
+    /* Past the stale window the lookup blocks, and fails with the resolver. */
+    ulTestTimeMs += 5000U;
+    TEST_CHECK( 0U == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+    TEST_CHECK( 5U == prvResolverCalls() );
+
+    /* The dropped entry is not served again even if the clock went back. */
+    ulTestTimeMs -= 5000U;
+    TEST_CHECK( 0U == DnsCache_Resolve( "a.example", prvFakeResolver ) );
+
+    DnsCache_GetStats( &xResult );
+    TEST_CHECK( 4U == xResult.ulStaleHits );
+    TEST_CHECK( 3U == xResult.ulPrefetches );
+    TEST_CHECK( 2U == xResult.ulFailures );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestEvictionAndLongNames( void )
+{
+    prvReset();
+
+    ( void ) DnsCache_Resolve( "a.example", prvFakeResolver );
+    ulTestTimeMs += 10U;
+    ( void ) DnsCache_Resolve( "b.example", prvFakeResolver );
+    ulTestTimeMs += 10U;
+
+    /* a.example is used again, so b.example is the one evicted. */
+    ( void ) DnsCache_Resolve( "a.example", prvFakeResolver );
+    ulTestTimeMs += 10U;
+    ( void ) DnsCache_Resolve( "c.example", prvFakeResolver );
+    TEST_CHECK( 3U == prvResolverCalls() );
+
+    ( void ) DnsCache_Resolve( "a.example", prvFakeResolver );
+    TEST_CHECK( 3U == prvResolverCalls() );
+    ( void ) DnsCache_Resolve( "b.example", prvFakeResolver );
+    TEST_CHECK( 4U == prvResolverCalls() );
+
+    /* Names that do not fit an entry are resolved every time. */
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a-long-name.example", prvFakeResolver ) );
+    TEST_CHECK( TEST_ADDRESS_A == DnsCache_Resolve( "a-long-name.example", prvFakeResolver ) );
+    TEST_CHECK( 6U == prvResolverCalls() );
+
+    /* Flushing one name only drops that name. */
+    DnsCache_Flush( "a.example" );
+    ( void ) DnsCache_Resolve( "b.example", prvFakeResolver );
+    TEST_CHECK( 6U == prvResolverCalls() );
+    ( void ) DnsCache_Resolve( "a.example", prvFakeResolver );
+    TEST_CHECK( 7U == prvResolverCalls() );
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvResolveThread( void * pvHostName )
+{
+    uint32_t ulAddress = DnsCache_Resolve( ( const char * ) pvHostName, prvFakeResolver );
+
+    TEST_CHECK( TEST_ADDRESS_A == ulAddress );
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestSingleResolver( void )
+{
+    static const char * pcHosts[] = { "a.example", "a.example", "a.example", "b.example", "b.example", "b.example" };
+    pthread_t xThreads[ sizeof( pcHosts ) / sizeof( pcHosts[ 0 ] ) ];
+    size_t i;
+
+    prvReset();
+    lResolverDelayMs = 20;
+
+    for( i = 0; i < ( sizeof( pcHosts ) / sizeof( pcHosts[ 0 ] ) ); i++ )
+    {
+        TEST_CHECK( 0 == pthread_create( &xThreads[ i ], NULL, prvResolveThread, ( void * ) pcHosts[ i ] ) );
+    }
+
+    for( i = 0; i < ( sizeof( pcHosts ) / sizeof( pcHosts[ 0 ] ) ); i++ )
+    {
+        ( void ) pthread_join( xThreads[ i ], NULL );
+    }
+
+    /* Never two resolver calls at once, and callers that waited for the
+     * resolver pick up what the caller before them stored. */
+    TEST_CHECK( 1U == ulResolverMaxActive );
+    TEST_CHECK( 2U == prvResolverCalls() );
+
+    /* A refresh in the background takes the same lock. */
+    prvReset();
+    lResolverDelayMs = 20;
+    ( void ) DnsCache_Resolve( "a.example", prvFakeResolver );
+    ulTestTimeMs += 900U;
+    ( void ) DnsCache_Resolve( "a.example", prvFakeResolver );
+    ( void ) DnsCache_Resolve( "b.example", prvFakeResolver );
+    prvWaitForPrefetch();
+    TEST_CHECK( 1U == ulResolverMaxActive );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    prvTestHitAndExpiry();
+    prvTestPrefetch();
+    prvTestStaleWhileRevalidate();
+    prvTestEvictionAndLongNames();
+    prvTestSingleResolver();
+
+    printf( "%s: %lu failure(s)\n", __FILE__, ( unsigned long ) ulFailures );
+
+    return ( 0U == ulFailures ) ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_test_image_hash.c
+ * @brief Host test of the hash of an image written in any block order.
+ *
+ * Blocks of a random image go through the page write buffer to a fake flash
+ * that only programs erased bytes, and to the image hash, in order, with
+ * blocks held back for a while, with one block left to the end, and shuffled
+ * at random. The hash is an order sensitive FNV-1a; once the image is
+ * finished it must equal the hash of the image taken in order. A reference
+ * model tells how many bytes must have been read back: those of the blocks
+ * written while a block before them was still missing, and no more. Every
+ * written block the write buffer no longer holds must be in flash.
+ * Build and run from this directory with:
+ *
+ *   gcc -std=c99 -Wall -Wextra -g -fsanitize=address,undefined \
+ *       -Istubs -I../include iot_test_image_hash.c \
+ *       -o iot_test_image_hash && ./iot_test_image_hash
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The modules are included so that every test starts from a clean state. */
+#include "../src/iot_flash_write_buffer.c"
+#include "../src/iot_image_hash.c"
+
+#define TEST_IMAGE_SIZE      ( 96U * 1024U + 123U )
+#define TEST_BLOCK_SIZE      ( 1000U )
+#define TEST_BLOCKS          ( ( TEST_IMAGE_SIZE + TEST_BLOCK_SIZE - 1U ) / TEST_BLOCK_SIZE )
+#define TEST_ROUNDS          ( 200U )
+#define TEST_FNV_OFFSET      ( 0xcbf29ce484222325ULL )
+#define TEST_FNV_PRIME       ( 0x100000001b3ULL )
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+static uint32_t ulFailures = 0;
+static uint8_t ucImage[ TEST_IMAGE_SIZE ];
+static uint8_t ucFlash[ TEST_IMAGE_SIZE ];
+static uint32_t ulOrder[ TEST_BLOCKS ];
+
+/*-----------------------------------------------------------*/
+
+static void prvHashUpdate( void * pvContext,
+                           const uint8_t * pucData,
+                           size_t xLength )
+{
+    uint64_t * pullHash = ( uint64_t * ) pvContext;
+    size_t i;
+
+    for( i = 0; i < xLength; i++ )
+    {
+        *pullHash = ( *pullHash ^ pucData[ i ] ) * TEST_FNV_PRIME;
+    }
+}
+
+static BaseType_t prvFlashProgram( uint32_t ulAddress,
+                                   const uint8_t * pucData,
+                                   uint32_t ulLength )
+{
+    uint32_t i;
+
+    TEST_CHECK( ( ulAddress + ulLength ) <= sizeof( ucFlash ) );
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        TEST_CHECK( 0xFFU == ucFlash[ ulAddress + i ] );
+        ucFlash[ ulAddress + i ] = pucData[ i ];
+    }
+
+    return pdTRUE;
+}
+
+static BaseType_t prvFlashRead( uint32_t ulOffset,
+                                uint8_t * pucBuffer,
+                                uint32_t ulLength )
+{
+    TEST_CHECK( ( ulOffset + ulLength ) <= sizeof( ucFlash ) );
+    memcpy( pucBuffer, &ucFlash[ ulOffset ], ulLength );
+    FlashWriteBuffer_Overlay( ulOffset, pucBuffer, ulLength );
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Write the image in the order of ulOrder and check the hash and the
+ * bytes read back.
+ *
+ * @param[in] ulHashedLength Bytes of block 0 hashed before the hash starts,
+ * as a PAL does with the signature or manifest.
+ * @param[in] xAllTracked Whether every range written ahead fits the
+ * recorded ranges, so that the read back is exactly what the model says.
+ */
+static void prvRunOrder( uint32_t ulHashedLength,
+                         BaseType_t xAllTracked )
+{
+    uint64_t ullExpected = TEST_FNV_OFFSET;
+    uint64_t ullHash = TEST_FNV_OFFSET;
+    static uint8_t ucWritten[ TEST_BLOCKS ];
+    uint32_t ulAheadBytes = 0;
+    uint32_t ulBlock;
+    uint32_t ulLength;
+    uint32_t i;
+    uint32_t j;
+    ImageHashStats_t xStats;
+
+    prvHashUpdate( &ullExpected, ucImage, TEST_IMAGE_SIZE );
+
+    memset( ucFlash, 0xFF, sizeof( ucFlash ) );
+    memset( ucWritten, 0, sizeof( ucWritten ) );
+    FlashWriteBuffer_Start( prvFlashProgram );
+
+    prvHashUpdate( &ullHash, ucImage, ulHashedLength );
+    ImageHash_Start( &ullHash, prvHashUpdate, prvFlashRead, ulHashedLength );
+
+    for( i = 0; i < TEST_BLOCKS; i++ )
+    {
+        ulBlock = ulOrder[ i ];
+        ulLength = ( ulBlock == ( TEST_BLOCKS - 1U ) ) ? ( TEST_IMAGE_SIZE - ulBlock * TEST_BLOCK_SIZE ) : TEST_BLOCK_SIZE;
+
+        /* The model: a block is read back if one before it is missing. */
+        for( j = 0; j < ulBlock; j++ )
+        {
+            if( 0U == ucWritten[ j ] )
+            {
+                ulAheadBytes += ulLength;
+                break;
+            }
+        }
+
+        ucWritten[ ulBlock ] = 1U;
+
+        TEST_CHECK( FlashWriteBuffer_Write( ulBlock * TEST_BLOCK_SIZE, &ucImage[ ulBlock * TEST_BLOCK_SIZE ], ulLength ) == pdTRUE );
+        TEST_CHECK( ImageHash_Write( ulBlock * TEST_BLOCK_SIZE, &ucImage[ ulBlock * TEST_BLOCK_SIZE ], ulLength ) == pdTRUE );
+
+        /* A written block no longer buffered is in flash, as a PAL that
+         * journals the blocks in flash relies on. */
+        for( j = 0; j < TEST_BLOCKS; j++ )
+        {
+            ulLength = ( j == ( TEST_BLOCKS - 1U ) ) ? ( TEST_IMAGE_SIZE - j * TEST_BLOCK_SIZE ) : TEST_BLOCK_SIZE;
+
+            if( ( 0U != ucWritten[ j ] ) &&
+                ( FlashWriteBuffer_IsBuffered( j * TEST_BLOCK_SIZE, ulLength ) == pdFALSE ) )
+            {
+                TEST_CHECK( memcmp( &ucFlash[ j * TEST_BLOCK_SIZE ], &ucImage[ j * TEST_BLOCK_SIZE ], ulLength ) == 0 );
+            }
+        }
+    }
+
+    TEST_CHECK( FlashWriteBuffer_Flush() == pdTRUE );
+    FlashWriteBuffer_Discard();
+    TEST_CHECK( ImageHash_Finish( TEST_IMAGE_SIZE ) == pdTRUE );
+    TEST_CHECK( ImageHash_GetContext() == NULL );
+    ImageHash_GetStats( &xStats );
+
+    TEST_CHECK( ullHash == ullExpected );
+    TEST_CHECK( memcmp( ucFlash, ucImage, TEST_IMAGE_SIZE ) == 0 );
+    TEST_CHECK( ( xStats.ulHashedBytes + xStats.ulReadBackBytes + ulHashedLength ) == TEST_IMAGE_SIZE );
+
+    if( pdFALSE != xAllTracked )
+    {
+        TEST_CHECK( xStats.ulUntrackedWrites == 0U );
+        TEST_CHECK( xStats.ulReadBackBytes == ulAheadBytes );
+    }
+    else
+    {
+        TEST_CHECK( xStats.ulReadBackBytes >= ulAheadBytes );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestInOrder( void )
+{
+    uint32_t i;
+    ImageHashStats_t xStats;
+
+    for( i = 0; i < TEST_BLOCKS; i++ )
+    {
+        ulOrder[ i ] = i;
+    }
+
+    prvRunOrder( 0U, pdTRUE );
+    ImageHash_GetStats( &xStats );
+    TEST_CHECK( xStats.ulReadBackBytes == 0U );
+    TEST_CHECK( xStats.ulAheadWrites == 0U );
+
+    /* The caller hashed part of block 0 itself. */
+    prvRunOrder( 100U, pdTRUE );
+    ImageHash_GetStats( &xStats );
+    TEST_CHECK( xStats.ulReadBackBytes == 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestLateBlock( void )
+{
+    uint32_t i;
+    ImageHashStats_t xStats;
+
+    /* Block 5 comes three blocks late: only the three blocks written ahead
+     * of it are read back, and the rest is hashed as it is written. */
+    for( i = 0; i < TEST_BLOCKS; i++ )
+    {
+        ulOrder[ i ] = i;
+    }
+
+    ulOrder[ 5 ] = 6;
+    ulOrder[ 6 ] = 7;
+    ulOrder[ 7 ] = 8;
+    ulOrder[ 8 ] = 5;
+
+    prvRunOrder( 0U, pdTRUE );
+    ImageHash_GetStats( &xStats );
+    TEST_CHECK( xStats.ulReadBackBytes == 3U * TEST_BLOCK_SIZE );
+    TEST_CHECK( xStats.ulAheadWrites == 3U );
+
+    /* Block 5 is left to the very end: everything after it is read back,
+     * as the hash cannot skip it. */
+    for( i = 0; i < TEST_BLOCKS; i++ )
+    {
+        ulOrder[ i ] = ( i < 5U ) ? i : ( ( i < ( TEST_BLOCKS - 1U ) ) ? ( i + 1U ) : 5U );
+    }
+
+    prvRunOrder( 0U, pdTRUE );
+    ImageHash_GetStats( &xStats );
+    TEST_CHECK( xStats.ulReadBackBytes == ( TEST_IMAGE_SIZE - 6U * TEST_BLOCK_SIZE ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTestShuffled( void )
+{
+    uint32_t ulRound;
+    uint32_t ulWindow;
+    uint32_t ulSwap;
+    uint32_t ulTmp;
+    uint32_t i;
+
+    for( ulRound = 0; ulRound < TEST_ROUNDS; ulRound++ )
+    {
+        for( i = 0; i < TEST_BLOCKS; i++ )
+        {
+            ulOrder[ i ] = i;
+        }
+
+        /* Blocks move by less than the number of recorded ranges, as with
+         * a request window of that many blocks, so every range fits. Every
+         * tenth round shuffles the whole image, which does not. */
+        ulWindow = ( 0U == ( ulRound % 10U ) ) ? TEST_BLOCKS : ( uint32_t ) imagehashconfigMAX_RANGES;
+
+        for( i = 0; i < TEST_BLOCKS; i++ )
+        {
+            ulSwap = i + ( uint32_t ) rand() % ulWindow;
+
+            if( ( ulSwap < TEST_BLOCKS ) && ( ( ulSwap - i ) < ulWindow ) )
+            {
+                ulTmp = ulOrder[ i ];
+                ulOrder[ i ] = ulOrder[ ulSwap ];
+                ulOrder[ ulSwap ] = ulTmp;
+            }
+        }
+
+        prvRunOrder( ( uint32_t ) rand() % TEST_BLOCK_SIZE,
+                     ( ulWindow == TEST_BLOCKS ) ? pdFALSE : pdTRUE );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    uint32_t i;
+
+    srand( 1 );
+
+    for( i = 0; i < TEST_IMAGE_SIZE; i++ )
+    {
+        ucImage[ i ] = ( uint8_t ) rand();
+    }
+
+    prvTestInOrder();
+    prvTestLateBlock();
+    prvTestShuffled();
+
+    printf( "%s: %u failures\n", ( ulFailures == 0U ) ? "PASS" : "FAIL", ( unsigned int ) ulFailures );
+
+    return ( ulFailures == 0U ) ? 0 : 1;
+}
@@ -0,0 +1,595 @@
+/*
+ * FreeRTOS Utils V1.2.1
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_test_publish_store.c
+ * @brief Host test of the store of publishes kept while offline.
+ *
+ * The store runs on a fake flash of four small sectors that only programs
+ * erased bytes, and that can be made to stop programming part way through, as
+ * a reset would. A stand-in broker takes the messages the store hands out and
+ * at times drops the connection before the message is removed. A reference
+ * model of the messages stored tells which one must come next: the oldest of
+ * the most urgent class, with only the messages of flash surviving a reset,
+ * and those whose removal was not recorded handed back again after it.
+ * Build and run from this directory with:
+ *
+ *   gcc -std=c99 -Wall -Wextra -g -fsanitize=address,undefined \
+ *       -Istubs -I../include iot_test_publish_store.c \
+ *       -o iot_test_publish_store && ./iot_test_publish_store
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Small RAM ring, so that messages spill to flash. */
+#define publishstoreconfigRAM_SIZE    ( 512 )
+
+/* The module is included so that every test starts from an empty store. */
+#include "../src/iot_publish_store.c"
+
+#define TEST_SECTOR_SIZE     ( 1024U )
+#define TEST_SECTORS         ( 4U )
+#define TEST_ROUNDS          ( 300U )
+#define TEST_OPERATIONS      ( 2000U )
+#define TEST_MAX_MESSAGES    ( TEST_OPERATIONS + 1U )
+#define TEST_NO_MESSAGE      ( 0U )
+
+#define TEST_CHECK( x )                                                 \
+    do {                                                                \
+        if( !( x ) )                                                    \
+        {                                                               \
+            printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, # x );      \
+            ulFailures++;                                               \
+        }                                                               \
+    } while( 0 )
+
+/**
+ * @brief A message of the reference model.
+ */
+typedef struct TestMessage
+{
+    uint8_t ucClass;
+    BaseType_t xInFlash;  /* Spilled to flash, so it survives a reset. */
+    BaseType_t xDelivered;
+    BaseType_t xLost;     /* Held in RAM through a reset. */
+} TestMessage_t;
+
+static uint32_t ulFailures = 0;
+
+/* Fake flash. A negative budget programs without limit. Once the budget is
+ * spent, the write in progress fails; then, unless xTearOnly is set, nothing
+ * is programmed or erased until the next reset. */
+static uint8_t ucFlash[ TEST_SECTOR_SIZE * TEST_SECTORS ];
+static long lProgramBudget = -1;
+static BaseType_t xTearOnly = pdFALSE;
+static BaseType_t xFlashStopped = pdFALSE;
+static uint32_t ulErases[ TEST_SECTORS ];
+
+/* Reference model: messages by number, from 1, and per class in order. */
+static TestMessage_t xMessages[ TEST_MAX_MESSAGES ];
+static uint32_t ulClassMessages[ publishstoreconfigCLASSES ][ TEST_MAX_MESSAGES ];
+static uint32_t ulClassCount[ publishstoreconfigCLASSES ];
+static uint32_t ulClassHead[ publishstoreconfigCLASSES ];
+static uint32_t ulLastMessage = 0;
+
+/* Last message of each class handed out since the last reset. */
+static uint32_t ulLastHandedOut[ publishstoreconfigCLASSES ];
+static uint32_t ulRedelivered = 0;
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvFlashRead( uint32_t ulAddress,
+                                uint8_t * pucBuffer,
+                                uint32_t ulLength )
+{
+    TEST_CHECK( ( ulAddress + ulLength ) <= sizeof( ucFlash ) );
+    memcpy( pucBuffer, &ucFlash[ ulAddress ], ulLength );
+
+    return pdTRUE;
+}
+
+static BaseType_t prvFlashProgram( uint32_t ulAddress,
+                                   const uint8_t * pucData,
+                                   uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t i;
+
+    TEST_CHECK( ( ulAddress + ulLength ) <= sizeof( ucFlash ) );
+
+    for( i = 0; ( i < ulLength ) && ( pdFALSE != xResult ); i++ )
+    {
+        if( pdFALSE != xFlashStopped )
+        {
+            xResult = pdFALSE;
+        }
+        else if( 0 == lProgramBudget )
+        {
+            /* Torn: the bytes before were programmed. */
+            lProgramBudget = -1;
+            xFlashStopped = ( pdFALSE != xTearOnly ) ? pdFALSE : pdTRUE;
+            xResult = pdFALSE;
+        }
+        else
+        {
+            /* Programming only clears bits of erased bytes. */
+            TEST_CHECK( 0xFFU == ucFlash[ ulAddress + i ] );
+            ucFlash[ ulAddress + i ] = pucData[ i ];
+
+            if( lProgramBudget > 0 )
+            {
+                lProgramBudget--;
+            }
+        }
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvFlashErase( uint32_t ulAddress )
+{
+    BaseType_t xResult = pdFALSE;
+
+    TEST_CHECK( 0U == ( ulAddress % TEST_SECTOR_SIZE ) );
+
+    if( pdFALSE == xFlashStopped )
+    {
+        memset( &ucFlash[ ulAddress ], 0xFF, TEST_SECTOR_SIZE );
+        ulErases[ ulAddress / TEST_SECTOR_SIZE ]++;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static const PublishStoreFlash_t xFlash =
+{
+    0, TEST_SECTOR_SIZE, TEST_SECTORS, prvFlashRead, prvFlashProgram, prvFlashErase
+};
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Fill a message with its class, its number, then bytes derived from
+ * the number.
+ */
+static void prvMakeMessage( uint8_t * pucMessage,
+                            uint8_t ucClass,
+                            uint32_t ulNumber,
+                            uint32_t ulLength )
+{
+    uint32_t i;
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        pucMessage[ i ] = ( uint8_t ) ( ( ulNumber * 7U ) + i );
+    }
+
+    pucMessage[ 0 ] = ucClass;
+    memcpy( &pucMessage[ 1 ], &ulNumber, sizeof( ulNumber ) );
+}
+
+/**
+ * @brief Check a message handed out is intact, and get its number.
+ */
+static BaseType_t prvCheckMessage( const uint8_t * pucMessage,
+                                   uint32_t ulLength,
+                                   uint8_t ucClass,
+                                   uint32_t * pulNumber )
+{
+    BaseType_t xIntact = ( ulLength > sizeof( uint32_t ) ) && ( ucClass == pucMessage[ 0 ] );
+    uint32_t i;
+
+    memcpy( pulNumber, &pucMessage[ 1 ], sizeof( uint32_t ) );
+
+    for( i = 1U + sizeof( uint32_t ); ( i < ulLength ) && ( pdFALSE != xIntact ); i++ )
+    {
+        xIntact = ( pucMessage[ i ] == ( uint8_t ) ( ( *pulNumber * 7U ) + i ) );
+    }
+
+    return ( pdFALSE != xIntact ) && ( *pulNumber > 0U ) && ( *pulNumber <= ulLastMessage );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvModelReset( void )
+{
+    memset( xMessages, 0, sizeof( xMessages ) );
+    memset( ulClassCount, 0, sizeof( ulClassCount ) );
+    memset( ulClassHead, 0, sizeof( ulClassHead ) );
+    memset( ulLastHandedOut, 0, sizeof( ulLastHandedOut ) );
+    ulLastMessage = 0;
+}
+
+/**
+ * @brief The oldest message of a class still to be delivered, or
+ * TEST_NO_MESSAGE.
+ */
+static uint32_t prvModelNext( uint8_t ucClass )
+{
+    uint32_t ulNumber = TEST_NO_MESSAGE;
+
+    while( ( TEST_NO_MESSAGE == ulNumber ) && ( ulClassHead[ ucClass ] < ulClassCount[ ucClass ] ) )
+    {
+        ulNumber = ulClassMessages[ ucClass ][ ulClassHead[ ucClass ] ];
+
+        if( ( pdFALSE != xMessages[ ulNumber ].xDelivered ) || ( pdFALSE != xMessages[ ulNumber ].xLost ) )
+        {
+            ulNumber = TEST_NO_MESSAGE;
+            ulClassHead[ ucClass ]++;
+        }
+    }
+
+    return ulNumber;
+}
+
+static uint32_t prvModelCount( void )
+{
+    uint32_t ulCount = 0;
+    uint32_t i;
+
+    for( i = 1; i <= ulLastMessage; i++ )
+    {
+        if( ( pdFALSE == xMessages[ i ].xDelivered ) && ( pdFALSE == xMessages[ i ].xLost ) )
+        {
+            ulCount++;
+        }
+    }
+
+    return ulCount;
+}
+
+/**
+ * @brief Store a message of a class, and note it in the model if taken.
+ */
+static BaseType_t prvPut( uint8_t ucClass,
+                          uint32_t ulLength )
+{
+    uint8_t ucMessage[ publishstoreconfigMAX_MESSAGE ];
+    PublishStoreStats_t xBefore, xAfter;
+    uint32_t ulNumber = ulLastMessage + 1U;
+    BaseType_t xStored;
+
+    prvMakeMessage( ucMessage, ucClass, ulNumber, ulLength );
+    PublishStore_GetStats( &xBefore );
+    xStored = PublishStore_Put( ucClass, ucMessage, ulLength );
+    PublishStore_GetStats( &xAfter );
+
+    if( pdFALSE != xStored )
+    {
+        ulLastMessage = ulNumber;
+        xMessages[ ulNumber ].ucClass = ucClass;
+        xMessages[ ulNumber ].xInFlash = ( xAfter.ulSpilled != xBefore.ulSpilled ) ? pdTRUE : pdFALSE;
+        ulClassMessages[ ucClass ][ ulClassCount[ ucClass ]++ ] = ulNumber;
+    }
+
+    return xStored;
+}
+
+/**
+ * @brief Stand-in broker: take the next message from the store, check it is
+ * the one the model expects, and remove it unless the connection dropped.
+ *
+ * @return pdFALSE once the store is empty.
+ */
+static BaseType_t prvForward( BaseType_t xConnectionDrops )
+{
+    uint8_t ucMessage[ publishstoreconfigMAX_MESSAGE ];
+    uint8_t ucClass = 0;
+    uint32_t ulLength = PublishStore_Peek( ucMessage, &ucClass );
+    uint32_t ulNumber = 0;
+    uint32_t i;
+
+    if( 0U == ulLength )
+    {
+        /* Nothing the model still holds may be missing. */
+        for( i = 0; i < publishstoreconfigCLASSES; i++ )
+        {
+            TEST_CHECK( TEST_NO_MESSAGE == prvModelNext( ( uint8_t ) i ) );
+        }
+
+        TEST_CHECK( 0U == PublishStore_GetCount() );
+    }
+    else if( pdFALSE == prvCheckMessage( ucMessage, ulLength, ucClass, &ulNumber ) )
+    {
+        printf( "FAIL %s:%d: damaged message of class %u\n", __FILE__, __LINE__, ( unsigned ) ucClass );
+        ulFailures++;
+    }
+    else
+    {
+        /* No message of a more urgent class is left. */
+        for( i = 0; i < ucClass; i++ )
+        {
+            TEST_CHECK( TEST_NO_MESSAGE == prvModelNext( ( uint8_t ) i ) );
+        }
+
+        if( pdFALSE != xMessages[ ulNumber ].xDelivered )
+        {
+            /* Handed back after a reset: a message of flash whose removal was
+             * not recorded, older than those still to deliver. */
+            TEST_CHECK( pdFALSE != xMessages[ ulNumber ].xInFlash );
+            TEST_CHECK( ulNumber >= ulLastHandedOut[ ucClass ] );
+            TEST_CHECK( ( TEST_NO_MESSAGE == prvModelNext( ucClass ) ) || ( ulNumber < prvModelNext( ucClass ) ) );
+        }
+        else
+        {
+            TEST_CHECK( ulNumber == prvModelNext( ucClass ) );
+        }
+
+        ulLastHandedOut[ ucClass ] = ulNumber;
+
+        if( ( pdFALSE != xConnectionDrops ) && ( 0 == ( rand() % 10 ) ) )
+        {
+            /* Lost with the connection: handed out again next time. */
+        }
+        else
+        {
+            TEST_CHECK( pdFALSE != PublishStore_Remove() );
+
+            if( pdFALSE != xMessages[ ulNumber ].xDelivered )
+            {
+                ulRedelivered++;
+            }
+
+            xMessages[ ulNumber ].xDelivered = pdTRUE;
+        }
+    }
+
+    return ( 0U != ulLength ) ? pdTRUE : pdFALSE;
+}
+
+/**
+ * @brief Reset: the RAM ring is lost, the flash is kept.
+ */
+static void prvReset( void )
+{
+    uint32_t i;
+
+    for( i = 1; i <= ulLastMessage; i++ )
+    {
+        if( ( pdFALSE == xMessages[ i ].xDelivered ) && ( pdFALSE == xMessages[ i ].xInFlash ) )
+        {
+            xMessages[ i ].xLost = pdTRUE;
+        }
+    }
+
+    memset( ulLastHandedOut, 0, sizeof( ulLastHandedOut ) );
+    lProgramBudget = -1;
+    xFlashStopped = pdFALSE;
+    TEST_CHECK( pdFALSE != PublishStore_Init( &xFlash ) );
+}
+
+static void prvEraseFlash( void )
+{
+    memset( ucFlash, 0xFF, sizeof( ucFlash ) );
+    memset( ulErases, 0, sizeof( ulErases ) );
+    lProgramBudget = -1;
+    xFlashStopped = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Random puts and forwards. In one round out of three, a flash write
+ * is torn at times by a reset; in another, it just fails, the store goes on
+ * with the flash, and resets come later.
+ */
+static void prvTestRandom( void )
+{
+    PublishStoreStats_t xStats;
+    uint32_t ulRound;
+    uint32_t ulOperation;
+    uint32_t ulResets = 0;
+    BaseType_t xWasReset;
+
+    for( ulRound = 0; ( ulRound < TEST_ROUNDS ) && ( 0U == ulFailures ); ulRound++ )
+    {
+        prvEraseFlash();
+        prvModelReset();
+        TEST_CHECK( pdFALSE != PublishStore_Init( &xFlash ) );
+        xWasReset = pdFALSE;
+
+        for( ulOperation = 0; ( ulOperation < TEST_OPERATIONS ) && ( 0U == ulFailures ); ulOperation++ )
+        {
+            if( ( rand() % 10 ) < 5 )
+            {
+                ( void ) prvPut( ( uint8_t ) ( rand() % publishstoreconfigCLASSES ), 6U + ( uint32_t ) ( rand() % 200 ) );
+            }
+            else
+            {
+                ( void ) prvForward( pdTRUE );
+            }
+
+            /* After a reset, the store also counts the messages it is to
+             * hand back. */
+            TEST_CHECK( ( PublishStore_GetCount() == prvModelCount() ) ||
+                        ( ( pdFALSE != xWasReset ) && ( PublishStore_GetCount() > prvModelCount() ) ) );
+
+            if( ( 0U != ( ulRound % 3U ) ) && ( 0U == ( ulOperation % 100U ) ) )
+            {
+                xTearOnly = ( 2U == ( ulRound % 3U ) ) ? pdTRUE : pdFALSE;
+                lProgramBudget = rand() % 300;
+            }
+
+            /* Writes that only failed must not cost what was stored around
+             * them either. */
+            if( ( pdFALSE != xFlashStopped ) ||
+                ( ( 2U == ( ulRound % 3U ) ) && ( 499U == ( ulOperation % 500U ) ) ) )
+            {
+                prvReset();
+                ulResets++;
+                xWasReset = pdTRUE;
+            }
+        }
+
+        while( pdFALSE != prvForward( pdFALSE ) )
+        {
+        }
+
+        PublishStore_GetStats( &xStats );
+        TEST_CHECK( 0U == xStats.ulLost );
+    }
+
+    printf( "Random: %u rounds, %u resets, %u messages handed back after a reset\n",
+            ( unsigned ) ulRound, ( unsigned ) ulResets, ( unsigned ) ulRedelivered );
+}
+
+/**
+ * @brief Messages in flash are recovered after a reset, by class then in
+ * order, except those removed before it.
+ */
+static void prvTestRecovery( void )
+{
+    PublishStoreStats_t xStats;
+    uint32_t ulInFlash;
+    uint32_t i;
+
+    prvEraseFlash();
+    prvModelReset();
+    TEST_CHECK( pdFALSE != PublishStore_Init( &xFlash ) );
+
+    for( i = 1; i <= 200U; i++ )
+    {
+        ( void ) prvPut( ( uint8_t ) ( i % 2U ), 50U );
+    }
+
+    PublishStore_GetStats( &xStats );
+    ulInFlash = xStats.ulSpilled;
+    TEST_CHECK( ulInFlash > 0U );
+    TEST_CHECK( xStats.ulDropped > 0U );
+
+    for( i = 0; i < 3U; i++ )
+    {
+        TEST_CHECK( pdFALSE != prvForward( pdFALSE ) );
+    }
+
+    prvReset();
+    PublishStore_GetStats( &xStats );
+    TEST_CHECK( xStats.ulRecovered > 0U );
+    TEST_CHECK( xStats.ulRecovered <= ulInFlash );
+    TEST_CHECK( PublishStore_GetCount() == prvModelCount() );
+
+    while( pdFALSE != prvForward( pdFALSE ) )
+    {
+    }
+
+    /* Every removal was recorded, so nothing is recovered again. */
+    prvReset();
+    PublishStore_GetStats( &xStats );
+    TEST_CHECK( 0U == xStats.ulRecovered );
+    TEST_CHECK( 0U == PublishStore_GetCount() );
+}
+
+/**
+ * @brief Filling the store until it drops messages, then emptying it, goes
+ * around the sectors: each is erased again once its messages are removed.
+ */
+static void prvTestFullAndSectorReuse( void )
+{
+    PublishStoreStats_t xStats;
+    uint32_t ulCycle;
+    uint32_t ulStored;
+    uint32_t ulForwarded;
+    uint32_t i;
+
+    prvEraseFlash();
+    TEST_CHECK( pdFALSE != PublishStore_Init( &xFlash ) );
+
+    for( ulCycle = 0; ulCycle < 20U; ulCycle++ )
+    {
+        prvModelReset();
+
+        for( ulStored = 0; pdFALSE != prvPut( 1U, 300U ); ulStored++ )
+        {
+        }
+
+        /* Full: one message in the RAM ring and three in each sector, but
+         * for one the last sector written may have no room left for. */
+        TEST_CHECK( ulStored >= ( 3U * TEST_SECTORS ) );
+        TEST_CHECK( PublishStore_GetCount() == ulStored );
+
+        for( ulForwarded = 0; pdFALSE != prvForward( pdFALSE ); ulForwarded++ )
+        {
+        }
+
+        TEST_CHECK( ulForwarded == ulStored );
+    }
+
+    for( i = 0; i < TEST_SECTORS; i++ )
+    {
+        TEST_CHECK( ulErases[ i ] > 10U );
+    }
+
+    PublishStore_GetStats( &xStats );
+    TEST_CHECK( 0U == xStats.ulLost );
+    TEST_CHECK( 0U == xStats.ulFailures );
+}
+
+/**
+ * @brief Without flash, messages are kept in RAM, by class then in order.
+ */
+static void prvTestRamOnly( void )
+{
+    uint32_t ulStored = 0;
+    uint32_t i;
+
+    prvModelReset();
+    TEST_CHECK( pdFALSE != PublishStore_Init( NULL ) );
+
+    for( i = 1; i <= 100U; i++ )
+    {
+        if( pdFALSE != prvPut( ( uint8_t ) ( i % 2U ), 60U ) )
+        {
+            ulStored++;
+        }
+    }
+
+    TEST_CHECK( ulStored > 0U );
+    TEST_CHECK( ulStored < 100U );
+
+    while( pdFALSE != prvForward( pdTRUE ) )
+    {
+    }
+
+    TEST_CHECK( 0U == prvModelCount() );
+}
+
+/*-----------------------------------------------------------*/
+
+int main( void )
+{
+    srand( 1 );
+
+    prvTestRecovery();
+    prvTestFullAndSectorReuse();
+    prvTestRamOnly();
+    prvTestRandom();
+
+    printf( "%s: %lu failure(s)\n", __FILE__, ( unsigned long ) ulFailures );
+
+    return ( 0U == ulFailures ) ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+/*
+ * Host build stand-in for FreeRTOS.h, used by the utils tests.
+ *
+ * Only what the utils modules use is provided. Tasks are POSIX threads and
+ * critical sections take one process-wide recursive mutex; see
+ * freertos_stubs.c.
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef long             BaseType_t;
+typedef unsigned long    UBaseType_t;
+typedef uint32_t         TickType_t;
+
+#define pdFALSE                     ( ( BaseType_t ) 0 )
+#define pdTRUE                      ( ( BaseType_t ) 1 )
+#define pdFAIL                      ( pdFALSE )
+#define pdPASS                      ( pdTRUE )
+
+#define portMAX_DELAY               ( ( TickType_t ) 0xffffffffUL )
+#define portTICK_PERIOD_MS          ( ( TickType_t ) 1 )
+
+#define configMINIMAL_STACK_SIZE    ( ( uint16_t ) 128 )
+#define configASSERT( x )    assert( x )
+#define tskIDLE_PRIORITY            ( ( UBaseType_t ) 0U )
+
+void vStubEnterCritical( void );
+void vStubExitCritical( void );
+
+#define taskENTER_CRITICAL()    vStubEnterCritical()
+#define taskEXIT_CRITICAL()     vStubExitCritical()
+
+#define pvPortMalloc( xSize )    malloc( xSize )
+#define vPortFree( pv )          free( pv )
+
+#endif /* INC_FREERTOS_H */
@@ -0,0 +1,177 @@
+/*
+ * Host build stand-ins for the FreeRTOS calls made by the utils modules.
+ *
+ * Tasks run as detached POSIX threads; vTaskDelete( NULL ) ends the calling
+ * thread. Mutexes are POSIX mutexes, and critical sections take a single
+ * recursive mutex shared by the whole process.
+ */
+
+#define _POSIX_C_SOURCE    200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+static pthread_mutex_t xCriticalMutex;
+static pthread_once_t xCriticalOnce = PTHREAD_ONCE_INIT;
+
+typedef struct StubTask
+{
+    TaskFunction_t pxTaskCode;
+    void * pvParameters;
+} StubTask_t;
+
+/*-----------------------------------------------------------*/
+
+static void prvCriticalInit( void )
+{
+    pthread_mutexattr_t xAttributes;
+
+    ( void ) pthread_mutexattr_init( &xAttributes );
+    ( void ) pthread_mutexattr_settype( &xAttributes, PTHREAD_MUTEX_RECURSIVE );
+    ( void ) pthread_mutex_init( &xCriticalMutex, &xAttributes );
+    ( void ) pthread_mutexattr_destroy( &xAttributes );
+}
+
+/*-----------------------------------------------------------*/
+
+void vStubEnterCritical( void )
+{
+    ( void ) pthread_once( &xCriticalOnce, prvCriticalInit );
+    ( void ) pthread_mutex_lock( &xCriticalMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+void vStubExitCritical( void )
+{
+    ( void ) pthread_mutex_unlock( &xCriticalMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvTaskEntry( void * pvArgument )
+{
+    StubTask_t xTask = *( ( StubTask_t * ) pvArgument );
+
+    free( pvArgument );
+    xTask.pxTaskCode( xTask.pvParameters );
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xTaskCreate( TaskFunction_t pxTaskCode,
+                        const char * const pcName,
+                        const uint16_t usStackDepth,
+                        void * const pvParameters,
+                        UBaseType_t uxPriority,
+                        TaskHandle_t * const pxCreatedTask )
+{
+    BaseType_t xResult = pdFAIL;
+    StubTask_t * pxTask = malloc( sizeof( StubTask_t ) );
+    pthread_t xThread;
+
+    ( void ) pcName;
+    ( void ) usStackDepth;
+    ( void ) uxPriority;
+
+    if( NULL != pxTask )
+    {
+        pxTask->pxTaskCode = pxTaskCode;
+        pxTask->pvParameters = pvParameters;
+
+        if( 0 == pthread_create( &xThread, NULL, prvTaskEntry, pxTask ) )
+        {
+            ( void ) pthread_detach( xThread );
+            xResult = pdPASS;
+
+            if( NULL != pxCreatedTask )
+            {
+                *pxCreatedTask = NULL;
+            }
+        }
+        else
+        {
+            free( pxTask );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskDelete( TaskHandle_t xTaskToDelete )
+{
+    /* Only self-deletion is used by the utils modules. */
+    assert( NULL == xTaskToDelete );
+    pthread_exit( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+    struct timespec xDelay;
+
+    xDelay.tv_sec = ( time_t ) ( xTicksToDelay / 1000U );
+    xDelay.tv_nsec = ( long ) ( xTicksToDelay % 1000U ) * 1000000L;
+    ( void ) nanosleep( &xDelay, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+TickType_t xTaskGetTickCount( void )
+{
+    struct timespec xNow;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( TickType_t ) ( ( xNow.tv_sec * 1000 ) + ( xNow.tv_nsec / 1000000 ) );
+}
+
+/*-----------------------------------------------------------*/
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+    pthread_mutex_t * pxMutex = malloc( sizeof( pthread_mutex_t ) );
+
+    if( NULL != pxMutex )
+    {
+        ( void ) pthread_mutex_init( pxMutex, NULL );
+    }
+
+    return pxMutex;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore,
+                           TickType_t xBlockTime )
+{
+    /* Only blocking takes are used by the utils modules. */
+    assert( portMAX_DELAY == xBlockTime );
+
+    return ( 0 == pthread_mutex_lock( ( pthread_mutex_t * ) xSemaphore ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+    return ( 0 == pthread_mutex_unlock( ( pthread_mutex_t * ) xSemaphore ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore )
+{
+    ( void ) pthread_mutex_destroy( ( pthread_mutex_t * ) xSemaphore );
+    free( xSemaphore );
+}
@@ -0,0 +1,28 @@
+/*
+ * Host build stand-in for task.h, used by the utils tests.
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include task.h"
+#endif
+
+typedef void * TaskHandle_t;
+typedef void (* TaskFunction_t)( void * );
+
+BaseType_t xTaskCreate( TaskFunction_t pxTaskCode,
+                        const char * const pcName,
+                        const uint16_t usStackDepth,
+                        void * const pvParameters,
+                        UBaseType_t uxPriority,
+                        TaskHandle_t * const pxCreatedTask );
+
+void vTaskDelete( TaskHandle_t xTaskToDelete );
+
+void vTaskDelay( const TickType_t xTicksToDelay );
+
+TickType_t xTaskGetTickCount( void );
+
+#endif /* INC_TASK_H */
@@ -35,6 +35,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "flash_api.h"
 #include <device_lock.h>
 #include "platform_stdlib.h"
+#include "iot_flash_erase_ahead.h"
+#include "iot_flash_write_buffer.h"
+#include "iot_image_hash.h"
+#include "iot_delta_patch.h"
+#include "iot_decompress_stream.h"
 
 #define OTA_MEMDUMP 0
 #define OTA_PRINT DiagPrintf
@@ -51,6 +56,28 @@ static uint8_t aws_ota_signature[8] = {0};
 #define OTA1_FLASH_START_ADDRESS		LS_IMG2_OTA1_ADDR	//0x08006000
 #define OTA2_FLASH_START_ADDRESS		LS_IMG2_OTA2_ADDR	//0x08106000
 
+/* How far ahead of the download the target slot is erased. */
+#ifndef AWS_OTA_ERASE_AHEAD_SIZE
+#define AWS_OTA_ERASE_AHEAD_SIZE		(64 * 1024)
+#endif
+
+/* Jobs with this file type carry a patch instead of the full OTA file. The
+ * patch rebuilds the OTA file, header included, from the image in the running
+ * slot as it is in flash, and the job signature covers the rebuilt image. */
+#ifndef AWS_OTA_DELTA_FILE_TYPE
+#define AWS_OTA_DELTA_FILE_TYPE			1
+#endif
+
+/* Jobs with these file types carry the OTA file, or the patch, compressed
+ * with heatshrink. It is decompressed as it arrives and the job signature
+ * covers the decompressed image. */
+#ifndef AWS_OTA_COMPRESSED_FILE_TYPE
+#define AWS_OTA_COMPRESSED_FILE_TYPE		2
+#endif
+#ifndef AWS_OTA_COMPRESSED_DELTA_FILE_TYPE
+#define AWS_OTA_COMPRESSED_DELTA_FILE_TYPE	3
+#endif
+
 //move to platform_opts.h
 //#define AWS_OTA_IMAGE_STATE_FLASH_OFFSET			( 0x101000 ) // 0x0810_0000 - 0x0810_2000-1
 #define AWS_OTA_IMAGE_STATE_FLAG_IMG_NEW			0xffffffffU /* 11111111b A new image that hasn't yet been run. */
@@ -64,6 +91,24 @@ typedef struct {
 
 static ameba_ota_context_t ota_ctx;
 
+/* Timing of the last close, for the close-to-activate latency. */
+static TickType_t aws_ota_close_tick = 0;
+static uint32_t aws_ota_verify_ms = 0;
+
+/* Timing of the download, from the file being created. */
+static TickType_t aws_ota_start_tick = 0;
+static uint32_t aws_ota_first_block_ms = 0;
+static bool aws_ota_first_block_get = false;
+
+/* Patch being applied when the job is a delta update. */
+static bool aws_ota_delta = false;
+static uint32_t aws_ota_delta_src = 0;
+static DeltaPatchContext_t aws_ota_delta_ctx;
+
+/* Stream being decompressed when the job is a compressed update. */
+static bool aws_ota_compressed = false;
+static DecompressStreamContext_t aws_ota_decompress_ctx;
+
 #if OTA_MEMDUMP
 void vMemDump(u32 addr, const u8 *start, u32 size, char * strHeader)
 {
@@ -182,8 +227,136 @@ static void prvSysReset_rtl8721d(u32 timeout_ms)
 	WDG_Cmd(ENABLE);
 }
 
+static void prvHashReset_rtl8721d(void)
+{
+	void *ctx = ImageHash_GetContext();
+
+	ImageHash_Stop();
+	if (ctx != NULL) {
+		/* Without a certificate this only releases the context. */
+		(void) CRYPTO_SignatureVerificationFinal(ctx, NULL, 0, NULL, 0);
+	}
+}
+
+/* Read image bytes back for the hash, with those still in the write buffer. */
+static BaseType_t prvHashRead_rtl8721d(uint32_t img_offset, uint8_t *buf, uint32_t len)
+{
+	flash_t flash;
+	uint32_t address = aws_ota_target_hdr.FileImgHdr[HdrIdx].FlashAddr - SPI_FLASH_BASE + img_offset;
+
+	flash_stream_read(&flash, address, len, buf);
+	Cache_Flush();
+	FlashWriteBuffer_Overlay(address, buf, len);
+	return pdTRUE;
+}
+
+/* Hash the image bytes just written at img_offset. The first block starts
+ * the hash with the signature in place of the bytes it was taken from, as
+ * the read back at close does. Later blocks are hashed as they are written;
+ * those that land ahead of a missing block are read back once it is in. */
+static void prvHashWrite_rtl8721d(u32 img_offset, const u8 *pData, u32 len)
+{
+	void *ctx = NULL;
+
+	if (img_offset == 0) {
+		prvHashReset_rtl8721d();
+		if ((len >= AWS_OTA_IMAGE_SIGNATURE_LEN) &&
+			(CRYPTO_SignatureVerificationStart(&ctx, cryptoASYMMETRIC_ALGORITHM_ECDSA, cryptoHASH_ALGORITHM_SHA256) == pdTRUE)) {
+			CRYPTO_SignatureVerificationUpdate(ctx, aws_ota_signature, AWS_OTA_IMAGE_SIGNATURE_LEN);
+			CRYPTO_SignatureVerificationUpdate(ctx, pData + AWS_OTA_IMAGE_SIGNATURE_LEN, len - AWS_OTA_IMAGE_SIGNATURE_LEN);
+			ImageHash_Start(ctx, CRYPTO_SignatureVerificationUpdate, prvHashRead_rtl8721d, len);
+		}
+	} else {
+		/* A read back that fails is done again by the close. */
+		(void) ImageHash_Write(img_offset, pData, len);
+	}
+}
+
+static BaseType_t prvEraseSector_rtl8721d(uint32_t address, uint32_t len)
+{
+	erase_ota_target_flash(address, len);
+	return pdTRUE;
+}
+
+static BaseType_t prvProgram_rtl8721d(uint32_t address, const uint8_t *data, uint32_t len)
+{
+	return (ota_writestream_user(address, len, (u8 *)data) < 0) ? pdFALSE : pdTRUE;
+}
+
+static void prvPrepareSlot_rtl8721d(uint32_t size)
+{
+	int sector_cnt = ((size - 1) / (1024 * 4)) + 1;
+
+	/* The sectors are erased just ahead of the blocks being written, so
+	 * that the first block can be requested right away. */
+	if (FlashEraseAhead_Start(aws_ota_imgaddr - SPI_FLASH_BASE, sector_cnt * (1024*4), (1024*4),
+							  AWS_OTA_ERASE_AHEAD_SIZE, prvEraseSector_rtl8721d) != pdTRUE) {
+		for(int i = 0; i < sector_cnt; i++)
+		{
+			OTA_PRINT("[OTA] Erase sector_cnt @ 0x%x\n", aws_ota_imgaddr - SPI_FLASH_BASE + i * (1024*4));
+			erase_ota_target_flash(aws_ota_imgaddr - SPI_FLASH_BASE + i * (1024*4), (1024*4));
+		}
+	}
+}
+
+static int32_t prvWriteImageBlock_rtl8721d(OtaFileContext_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize);
+
+static BaseType_t prvDeltaReadSource_rtl8721d(void *ctx, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+	flash_t flash;
+
+	(void) ctx;
+	flash_stream_read(&flash, aws_ota_delta_src - SPI_FLASH_BASE + offset, len, buf);
+	return pdTRUE;
+}
+
+static BaseType_t prvDeltaWriteTarget_rtl8721d(void *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+	DeltaPatchStats_t stats;
+
+	/* The image size is only known once the patch header arrived. */
+	if (offset == 0) {
+		DeltaPatch_GetStats(&aws_ota_delta_ctx, &stats);
+		OTA_PRINT("[OTA] Patch rebuilds %d bytes from %d bytes @ 0x%x\n", stats.ulTargetSize, stats.ulSourceSize, aws_ota_delta_src);
+		prvPrepareSlot_rtl8721d(stats.ulTargetSize);
+	}
+
+	return (prvWriteImageBlock_rtl8721d((OtaFileContext_t *)ctx, offset, data, len) < 0) ? pdFALSE : pdTRUE;
+}
+
+/* Write a block of the OTA file, or of the patch that rebuilds it. */
+static int32_t prvWriteFileBlock_rtl8721d(OtaFileContext_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize)
+{
+	DeltaPatchStatus_t status;
+
+	if (!aws_ota_delta)
+		return prvWriteImageBlock_rtl8721d(C, ulOffset, pData, ulBlockSize);
+
+	/* Patch blocks rebuild the image, which is written as it comes out. */
+	status = DeltaPatch_Write(&aws_ota_delta_ctx, ulOffset, pData, ulBlockSize);
+	if (status != DeltaPatchSuccess) {
+		OTA_PRINT("[%s] Patch failed @ 0x%x: %d\n", __FUNCTION__, ulOffset, status);
+		return -1;
+	}
+
+	return ulBlockSize;
+}
+
+static BaseType_t prvDecompressWrite_rtl8721d(void *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+	return (prvWriteFileBlock_rtl8721d((OtaFileContext_t *)ctx, offset, data, len) < 0) ? pdFALSE : pdTRUE;
+}
+
 OtaPalStatus_t prvPAL_Abort_rtl8721d(OtaFileContext_t *C)
 {
+	FlashEraseAhead_Stop();
+	FlashWriteBuffer_Discard();
+	DeltaPatch_Free(&aws_ota_delta_ctx);
+	aws_ota_delta = false;
+	DecompressStream_Free(&aws_ota_decompress_ctx);
+	aws_ota_compressed = false;
+	prvHashReset_rtl8721d();
+
 	if (C != NULL && C->pFile != NULL) {
 		LogInfo(("[%s] Abort OTA update", __FUNCTION__));
 		C->pFile = NULL;
@@ -197,17 +370,15 @@ bool prvPAL_CreateFileForRx_rtl8721d(OtaFileContext_t *C)
 	OtaPalMainStatus_t mainErr = OtaPalSuccess;
 	OtaPalSubStatus_t subErr = 0;
 
-	int sector_cnt = 0;
-
 	if (ota_get_cur_index() == OTA_INDEX_1) {
 		ota_target_index = OTA_INDEX_2;
 		ota_ctx.lFileHandle = OTA2_FLASH_START_ADDRESS;
-		sector_cnt = ((C->fileSize - 1) / (1024 * 4)) + 1;
+		aws_ota_delta_src = OTA1_FLASH_START_ADDRESS;
 		OTA_PRINT("\n\r[%s] OTA2 address space will be upgraded\n", __FUNCTION__);
 	} else {
 		ota_target_index = OTA_INDEX_1;
 		ota_ctx.lFileHandle = OTA1_FLASH_START_ADDRESS;
-		sector_cnt = ((C->fileSize - 1) / (1024 * 4)) + 1;
+		aws_ota_delta_src = OTA2_FLASH_START_ADDRESS;
 		OTA_PRINT("\n\r[%s] OTA1 address space will be upgraded\n", __FUNCTION__);
 	}
 
@@ -221,16 +392,45 @@ bool prvPAL_CreateFileForRx_rtl8721d(OtaFileContext_t *C)
 		aws_ota_target_hdr_get = false;
 		memset((void *)&aws_ota_target_hdr, 0, sizeof(update_ota_target_hdr));
 		memset((void *)aws_ota_signature, 0, sizeof(aws_ota_signature));
-
-		for(int i = 0; i < sector_cnt; i++)
-		{
-			OTA_PRINT("[OTA] Erase sector_cnt @ 0x%x\n", ota_ctx.lFileHandle - SPI_FLASH_BASE + i * (1024*4));
-			erase_ota_target_flash(aws_ota_imgaddr - SPI_FLASH_BASE + i * (1024*4), (1024*4));
+		prvHashReset_rtl8721d();
+		aws_ota_start_tick = xTaskGetTickCount();
+		aws_ota_first_block_get = false;
+
+		/* Blocks rarely start on a flash page; they are programmed through
+		 * the write buffer so that pages are programmed whole. */
+		FlashWriteBuffer_Start(prvProgram_rtl8721d);
+
+		DeltaPatch_Free(&aws_ota_delta_ctx);
+		DecompressStream_Free(&aws_ota_decompress_ctx);
+		aws_ota_delta = (C->fileType == AWS_OTA_DELTA_FILE_TYPE || C->fileType == AWS_OTA_COMPRESSED_DELTA_FILE_TYPE);
+		aws_ota_compressed = (C->fileType == AWS_OTA_COMPRESSED_FILE_TYPE || C->fileType == AWS_OTA_COMPRESSED_DELTA_FILE_TYPE);
+
+		if (aws_ota_compressed && DecompressStream_Init(&aws_ota_decompress_ctx, otaconfigFILE_BLOCK_SIZE, otaconfigFILE_BLOCK_SIZE,
+								   prvDecompressWrite_rtl8721d, C) != DecompressStreamSuccess) {
+			OTA_PRINT("[OTA] No memory to decompress the file\n");
+			aws_ota_compressed = false;
+			aws_ota_delta = false;
+			ota_ctx.lFileHandle = 0;
+		} else if (!aws_ota_delta) {
+			/* The size of a compressed image is not known until it is done. */
+			prvPrepareSlot_rtl8721d(aws_ota_compressed ? OTA2_FLASH_START_ADDRESS - OTA1_FLASH_START_ADDRESS : C->fileSize);
+		} else if (DeltaPatch_Init(&aws_ota_delta_ctx, OTA2_FLASH_START_ADDRESS - OTA1_FLASH_START_ADDRESS, otaconfigFILE_BLOCK_SIZE,
+								   prvDeltaReadSource_rtl8721d, prvDeltaWriteTarget_rtl8721d, C) != DeltaPatchSuccess) {
+			OTA_PRINT("[OTA] No memory to apply a patch\n");
+			DecompressStream_Free(&aws_ota_decompress_ctx);
+			aws_ota_compressed = false;
+			aws_ota_delta = false;
+			ota_ctx.lFileHandle = 0;
+		} else {
+			OTA_PRINT("[OTA] Delta update, patch of %d bytes\n", C->fileSize);
 		}
+
+		if (aws_ota_compressed)
+			OTA_PRINT("[OTA] Compressed update, %d bytes\n", C->fileSize);
 	}
 	else {
 		OTA_PRINT("[OTA] invalid ota addr (%d) \r\n", ota_ctx.lFileHandle);
-		ota_ctx.lFileHandle = NULL; 	 /* Nullify the file handle in all error cases. */
+		ota_ctx.lFileHandle = 0; 	 /* Nullify the file handle in all error cases. */
 	}
 
 	if(ota_ctx.lFileHandle <= SPI_FLASH_BASE)
@@ -280,40 +480,24 @@ static OtaPalStatus_t prvSignatureVerificationUpdate_rtl8721d(OtaFileContext_t *
 	OtaPalMainStatus_t mainErr = OtaPalSuccess;
 	OtaPalSubStatus_t subErr = 0;
 
-	u32 i;
-	flash_t flash;
-	u8 * pTempbuf;
-	int rlen;
 	u32 len = aws_ota_imgsz;
-	u32 addr = aws_ota_target_hdr.FileImgHdr[HdrIdx].FlashAddr;
 
 	if(len <= 0) {
 		mainErr = OtaPalSignatureCheckFailed;
 		return OTA_PAL_COMBINE_ERR( mainErr, subErr );
 	}
 
-	pTempbuf = ota_update_malloc(BUF_SIZE);
-	if(!pTempbuf){
-		mainErr = OtaPalSignatureCheckFailed;
-		goto error;
+	if (ImageHash_GetContext() == NULL) {
+		/*add image signature(81958711)*/
+		CRYPTO_SignatureVerificationUpdate(pvContext, aws_ota_signature, AWS_OTA_IMAGE_SIGNATURE_LEN);
+		ImageHash_Start(pvContext, CRYPTO_SignatureVerificationUpdate, prvHashRead_rtl8721d, AWS_OTA_IMAGE_SIGNATURE_LEN);
 	}
 
-	/*add image signature(81958711)*/
-	CRYPTO_SignatureVerificationUpdate(pvContext, aws_ota_signature, AWS_OTA_IMAGE_SIGNATURE_LEN);
-
-	len = len-8;
-	/* read flash data back to check signature of the image */
-	for(i=0;i<len;i+=BUF_SIZE){
-		rlen = (len-i)>BUF_SIZE?BUF_SIZE:(len-i);
-		flash_stream_read(&flash, addr - SPI_FLASH_BASE+i+AWS_OTA_IMAGE_SIGNATURE_LEN, rlen, pTempbuf);
-		Cache_Flush();
-		CRYPTO_SignatureVerificationUpdate(pvContext, pTempbuf, rlen);
+	/* read back the flash data that was not hashed while being written */
+	if (ImageHash_Finish(len) != pdTRUE) {
+		mainErr = OtaPalSignatureCheckFailed;
 	}
 
-error:
-	if(pTempbuf)
-		ota_update_free(pTempbuf);
-
 	return OTA_PAL_COMBINE_ERR( mainErr, subErr );
 }
 
@@ -324,7 +508,7 @@ OtaPalStatus_t prvPAL_CheckFileSignature_rtl8721d(OtaFileContext_t * const C)
 	OtaPalSubStatus_t subErr = 0;
 
 	int32_t lSignerCertSize;
-	void *pvSigVerifyContext;
+	void *pvSigVerifyContext = NULL;
 	uint8_t *pucSignerCert = NULL;
 
 #if (defined(__ICCARM__))
@@ -332,8 +516,11 @@ OtaPalStatus_t prvPAL_CheckFileSignature_rtl8721d(OtaFileContext_t * const C)
 	mbedtls_platform_set_calloc_free(calloc_freertos, vPortFree);
 #endif
 
-	/* Verify an ECDSA-SHA256 signature. */
-	if (CRYPTO_SignatureVerificationStart( &pvSigVerifyContext, cryptoASYMMETRIC_ALGORITHM_ECDSA, cryptoHASH_ALGORITHM_SHA256) == pdFALSE) {
+	/* Verify an ECDSA-SHA256 signature, continuing the hash of the blocks written. */
+	pvSigVerifyContext = ImageHash_GetContext();
+	if ((pvSigVerifyContext == NULL) &&
+		(CRYPTO_SignatureVerificationStart( &pvSigVerifyContext, cryptoASYMMETRIC_ALGORITHM_ECDSA, cryptoHASH_ALGORITHM_SHA256) == pdFALSE)) {
+		pvSigVerifyContext = NULL;
 		mainErr = OtaPalSignatureCheckFailed;
 		goto exit;
 	}
@@ -349,13 +536,20 @@ OtaPalStatus_t prvPAL_CheckFileSignature_rtl8721d(OtaFileContext_t * const C)
 		goto exit;
 	}
 
+	/* The final call releases the context whatever its result. */
 	if (CRYPTO_SignatureVerificationFinal(pvSigVerifyContext, (char *)pucSignerCert, lSignerCertSize, C->pSignature->data, C->pSignature->size) == pdFALSE) {
+		pvSigVerifyContext = NULL;
 		mainErr = OtaPalSignatureCheckFailed;
 		prvPAL_SetPlatformImageState_rtl8721d(OtaImageStateRejected);
 		goto exit;
 	}
+	pvSigVerifyContext = NULL;
 
 exit:
+	ImageHash_Stop();
+	if (pvSigVerifyContext != NULL) {
+		(void) CRYPTO_SignatureVerificationFinal(pvSigVerifyContext, NULL, 0, NULL, 0);
+	}
 	/* Free the signer certificate that we now own after prvPAL_ReadAndAssumeCertificate(). */
 	if (pucSignerCert != NULL) {
 		vPortFree(pucSignerCert);
@@ -368,14 +562,78 @@ OtaPalStatus_t prvPAL_CloseFile_rtl8721d(OtaFileContext_t *C)
 {
 	OtaPalStatus_t mainErr = OtaPalSuccess;
 	OtaPalSubStatus_t subErr = 0;
+	FlashEraseAheadStats_t erase_stats;
+	FlashWriteBufferStats_t write_stats;
+	ImageHashStats_t hash_stats;
+	BaseType_t flushed;
+	DeltaPatchStatus_t delta_status = DeltaPatchSuccess;
+	DeltaPatchStats_t delta_stats;
+	DecompressStreamStatus_t decompress_status = DecompressStreamSuccess;
+	DecompressStreamStats_t decompress_stats;
+
+	/* The tail of a compressed file is still in the decompressor. */
+	if (aws_ota_compressed) {
+		decompress_status = DecompressStream_Finish(&aws_ota_decompress_ctx);
+		DecompressStream_GetStats(&aws_ota_decompress_ctx, &decompress_stats);
+		DecompressStream_Free(&aws_ota_decompress_ctx);
+		aws_ota_compressed = false;
+		LogInfo(("[OTA] %u bytes received, %u decompressed, %u written to flash, decoding took %u ms, %u blocks held, status %d.",
+				decompress_stats.ulInputBytes, decompress_stats.ulOutputBytes, aws_ota_imgsz,
+				decompress_stats.ulDecodeTicks * portTICK_PERIOD_MS, decompress_stats.ulHeldBlocks, decompress_status));
+	}
+
+	/* The last block of a rebuilt image is written once the patch is done. */
+	if (aws_ota_delta) {
+		delta_status = DeltaPatch_Finish(&aws_ota_delta_ctx);
+		DeltaPatch_GetStats(&aws_ota_delta_ctx, &delta_stats);
+		DeltaPatch_Free(&aws_ota_delta_ctx);
+		aws_ota_delta = false;
+		LogInfo(("[OTA] Patch rebuilt %u bytes, %u copied, %u added, %u inserted, %u blocks held, status %d.",
+				delta_stats.ulTargetSize, delta_stats.ulCopied, delta_stats.ulAdded, delta_stats.ulInserted,
+				delta_stats.ulHeldBlocks, delta_status));
+	}
+
+	/* The signature check reads the image back from flash. */
+	flushed = FlashWriteBuffer_Flush();
+	FlashWriteBuffer_GetStats(&write_stats);
+	FlashWriteBuffer_Discard();
+	FlashEraseAhead_GetStats(&erase_stats);
+	FlashEraseAhead_Stop();
 
 	LogInfo(("[OTA] Authenticating and closing file.\r\n"));
+	aws_ota_close_tick = xTaskGetTickCount();
+	LogInfo(("[OTA] Download took %u ms, first block after %u ms, %u sectors erased ahead, %u on demand.",
+			(aws_ota_close_tick - aws_ota_start_tick) * portTICK_PERIOD_MS, aws_ota_first_block_ms,
+			erase_stats.ulErasedAhead, erase_stats.ulErasedOnDemand));
+	LogInfo(("[OTA] %u block writes took %u flash programs, %u full pages and %u partial.",
+			write_stats.ulWrites, write_stats.ulProgramOps, write_stats.ulFullPages, write_stats.ulPartialPages));
 
 	if (C == NULL) {
 		mainErr = OtaPalNullFileContext;
 		goto exit;
 	}
 
+	if (flushed != pdTRUE) {
+		LogError(("[%s] Write sector failed", __FUNCTION__));
+		C->pFile = NULL;
+		mainErr = OtaPalFileClose;
+		goto exit;
+	}
+
+	if (decompress_status != DecompressStreamSuccess) {
+		LogError(("[%s] File could not be decompressed: %d", __FUNCTION__, decompress_status));
+		C->pFile = NULL;
+		mainErr = OtaPalFileClose;
+		goto exit;
+	}
+
+	if (delta_status != DeltaPatchSuccess) {
+		LogError(("[%s] Patch could not be applied: %d", __FUNCTION__, delta_status));
+		C->pFile = NULL;
+		mainErr = OtaPalFileClose;
+		goto exit;
+	}
+
 	/* close the fw file */
 	if (C->pFile) {
 		C->pFile = NULL;
@@ -389,6 +647,11 @@ OtaPalStatus_t prvPAL_CloseFile_rtl8721d(OtaFileContext_t *C)
 		mainErr = OtaPalSignatureCheckFailed;
 		}
 
+	aws_ota_verify_ms = (xTaskGetTickCount() - aws_ota_close_tick) * portTICK_PERIOD_MS;
+	ImageHash_GetStats(&hash_stats);
+	LogInfo(("[OTA] Signature check took %u ms, %u bytes hashed as written, %u read back, %u blocks ahead of a missing one.",
+			aws_ota_verify_ms, hash_stats.ulHashedBytes, hash_stats.ulReadBackBytes, hash_stats.ulAheadWrites));
+
 	if (mainErr == OtaPalSuccess) {
 		LogInfo(("[%s] %s signature verification passed.", __FUNCTION__, OTA_JsonFileSignatureKey));
 	} else {
@@ -402,7 +665,7 @@ exit:
 	return OTA_PAL_COMBINE_ERR(mainErr, subErr);
 }
 
-int32_t prvPAL_WriteBlock_rtl8721d(OtaFileContext_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize)
+static int32_t prvWriteImageBlock_rtl8721d(OtaFileContext_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize)
 {
 	flash_t flash;
 	uint32_t address = ota_ctx.lFileHandle - SPI_FLASH_BASE;
@@ -487,13 +750,15 @@ int32_t prvPAL_WriteBlock_rtl8721d(OtaFileContext_t *C, uint32_t ulOffset, uint8
 		}
 
 		OTA_PRINT("[OTA] FIRST Write %d bytes @ 0x%x\n", byte_to_write, address);
-		if(ota_writestream_user(address, byte_to_write, pData) < 0){
+		if(FlashEraseAhead_Prepare(address, byte_to_write) != pdTRUE || FlashWriteBuffer_Write(address, pData, byte_to_write) != pdTRUE){
 			OTA_PRINT("[%s] Write sector failed\n", __FUNCTION__);
 			return -1;
 		}
 #if OTA_MEMDUMP
 		vMemDump(address, pData, byte_to_write, "PAYLOAD1");
 #endif
+		if(ulOffset == 0)
+			prvHashWrite_rtl8721d(0, pData, byte_to_write);
 		aws_ota_imgsz += byte_to_write;
 		return ulBlockSize;
 	}
@@ -509,22 +774,48 @@ int32_t prvPAL_WriteBlock_rtl8721d(OtaFileContext_t *C, uint32_t ulOffset, uint8
 	}
 
 	LogInfo( ("[OTA] Write %d bytes @ 0x%x \n", WriteLen, address + offset) );
-	if(ota_writestream_user(address + offset, WriteLen, pData) < 0){
+	if(FlashEraseAhead_Prepare(address + offset, WriteLen) != pdTRUE || FlashWriteBuffer_Write(address + offset, pData, WriteLen) != pdTRUE){
 		LogInfo( ("[%s] Write sector failed\n", __FUNCTION__) );
 		return -1;
 	}
 #if OTA_MEMDUMP
 	vMemDump(address+offset, pData, ulBlockSize, "PAYLOAD2");
 #endif
+	prvHashWrite_rtl8721d(offset, pData, WriteLen);
 	aws_ota_imgsz += WriteLen;
 
 	return ulBlockSize;
 }
 
+int32_t prvPAL_WriteBlock_rtl8721d(OtaFileContext_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize)
+{
+	DecompressStreamStatus_t status;
+
+	if (!aws_ota_first_block_get) {
+		aws_ota_first_block_get = true;
+		aws_ota_first_block_ms = (xTaskGetTickCount() - aws_ota_start_tick) * portTICK_PERIOD_MS;
+		LogInfo(("[OTA] First block received %u ms after the file was created.", aws_ota_first_block_ms));
+	}
+
+	if (!aws_ota_compressed)
+		return prvWriteFileBlock_rtl8721d(C, ulOffset, pData, ulBlockSize);
+
+	/* The decompressed file comes out in blocks of the same size, in order. */
+	status = DecompressStream_Write(&aws_ota_decompress_ctx, ulOffset, pData, ulBlockSize);
+	if (status != DecompressStreamSuccess) {
+		OTA_PRINT("[%s] Decompression failed @ 0x%x: %d\n", __FUNCTION__, ulOffset, status);
+		return -1;
+	}
+
+	return ulBlockSize;
+}
+
 OtaPalStatus_t prvPAL_ActivateNewImage_rtl8721d(void)
 {
 	flash_t flash;
 	OTA_PRINT("[OTA] [%s] Download new firmware %d bytes completed @ 0x%x\n", __FUNCTION__, aws_ota_imgsz, aws_ota_imgaddr);
+	LogInfo(("[OTA] Activating %u ms after close (signature check %u ms).",
+			(xTaskGetTickCount() - aws_ota_close_tick) * portTICK_PERIOD_MS, aws_ota_verify_ms));
 	OTA_PRINT("[OTA] FirmwareSize = %d, OtaTargetHdr.FileImgHdr.ImgLen = %d\n", aws_ota_imgsz, aws_ota_target_hdr.FileImgHdr[HdrIdx].ImgLen);
 
 	/*------------- verify checksum and update signature-----------------*/
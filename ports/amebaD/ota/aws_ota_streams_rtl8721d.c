@@ -33,6 +33,12 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "flash_api.h"
 #include <device_lock.h>
 #include "platform_stdlib.h"
+#include "iot_flash_erase_ahead.h"
+#include "iot_flash_write_buffer.h"
+#include "iot_image_hash.h"
+#include "iot_decompress_stream.h"
+#include "iot_download_journal.h"
+#include "MQTTFileDownloader_config.h"
 
 #define OTA_MEMDUMP 0
 #define OTA_PRINT DiagPrintf
@@ -49,6 +55,29 @@ static uint8_t aws_ota_signature[8] = {0};
 #define OTA1_FLASH_START_ADDRESS		LS_IMG2_OTA1_ADDR	//0x08006000
 #define OTA2_FLASH_START_ADDRESS		LS_IMG2_OTA2_ADDR	//0x08106000
 
+/* How far ahead of the download the target slot is erased. */
+#ifndef AWS_OTA_ERASE_AHEAD_SIZE
+#define AWS_OTA_ERASE_AHEAD_SIZE		(64 * 1024)
+#endif
+
+/* Jobs with this file type carry the OTA file compressed with heatshrink. It
+ * is decompressed as it arrives and the job signature covers the decompressed
+ * image. */
+#ifndef AWS_OTA_COMPRESSED_FILE_TYPE
+#define AWS_OTA_COMPRESSED_FILE_TYPE		2
+#endif
+
+/* Flash offset of the sectors journaling the download, so that a download cut
+ * short by a reset is resumed. Set it in platform_opts.h to
+ * AWS_OTA_JOURNAL_SECTORS free sectors outside both OTA slots; 0 keeps the
+ * journal off. */
+#ifndef AWS_OTA_JOURNAL_FLASH_OFFSET
+#define AWS_OTA_JOURNAL_FLASH_OFFSET		0
+#endif
+#ifndef AWS_OTA_JOURNAL_SECTORS
+#define AWS_OTA_JOURNAL_SECTORS			2
+#endif
+
 //move to platform_opts.h
 //#define AWS_OTA_IMAGE_STATE_FLASH_OFFSET			( 0x101000 ) // 0x0810_0000 - 0x0810_2000-1
 #define AWS_OTA_IMAGE_STATE_FLAG_IMG_NEW			0xffffffffU /* 11111111b A new image that hasn't yet been run. */
@@ -62,6 +91,42 @@ typedef struct {
 
 static ameba_ota_context_t ota_ctx;
 
+/* Timing of the last close, for the close-to-activate latency. */
+static TickType_t aws_ota_close_tick = 0;
+static uint32_t aws_ota_verify_ms = 0;
+
+/* Timing of the download, from the file being created. */
+static TickType_t aws_ota_start_tick = 0;
+static uint32_t aws_ota_first_block_ms = 0;
+static bool aws_ota_first_block_get = false;
+
+/* Stream being decompressed when the job is a compressed update. */
+static bool aws_ota_compressed = false;
+static DecompressStreamContext_t aws_ota_decompress_ctx;
+
+/* Download being journaled. The blocks in order up to aws_ota_journal_next
+ * are written, those up to aws_ota_journal_marked are in flash and in the
+ * journal. A write that fails stops the journaling, since the pages it could
+ * not program may belong to blocks written before. Below
+ * aws_ota_program_floor the slot already holds the image of a resumed
+ * download and is not programmed again. */
+typedef struct {
+	uint32_t file_size;
+	uint32_t image_addr;
+	uint8_t signature[64];
+} aws_ota_journal_key_t;
+
+typedef struct {
+	update_ota_target_hdr hdr;
+	uint8_t signature[AWS_OTA_IMAGE_SIGNATURE_LEN];
+} aws_ota_journal_state_t;
+
+static bool aws_ota_journaled = false;
+static uint32_t aws_ota_journal_next = 0;
+static uint32_t aws_ota_journal_marked = 0;
+static uint32_t aws_ota_resume_offset = 0;
+static uint32_t aws_ota_program_floor = 0;
+
 OtaPalStatus_New_t prvPAL_Streams_CheckFileSignature_rtl8721d(AfrOtaJobDocumentFields_t * const C);
 
 extern void rtc_backup_timeinfo(void);
@@ -85,8 +150,249 @@ static void prvPAL_Streams_SysReset_rtl8721d(u32 timeout_ms)
 	WDG_Cmd(ENABLE);
 }
 
+static void prvPAL_Streams_HashReset_rtl8721d(void)
+{
+	void *ctx = ImageHash_GetContext();
+
+	ImageHash_Stop();
+	if ( ctx != NULL ) {
+		/* Without a certificate this only releases the context. */
+		(void) CRYPTO_SignatureVerificationFinal(ctx, NULL, 0, NULL, 0);
+	}
+}
+
+/* Read image bytes back for the hash, with those still in the write buffer. */
+static BaseType_t prvPAL_Streams_HashRead_rtl8721d(uint32_t img_offset, uint8_t *buf, uint32_t len)
+{
+	flash_t flash;
+	uint32_t address = aws_ota_target_hdr.FileImgHdr[HdrIdx].FlashAddr - SPI_FLASH_BASE + img_offset;
+
+	flash_stream_read(&flash, address, len, buf);
+	Cache_Flush();
+	FlashWriteBuffer_Overlay(address, buf, len);
+	return pdTRUE;
+}
+
+/* Hash the image bytes just written at img_offset. The first block starts
+ * the hash with the signature in place of the bytes it was taken from, as
+ * the read back at close does. Later blocks are hashed as they are written;
+ * those that land ahead of a missing block are read back once it is in. */
+static void prvPAL_Streams_HashWrite_rtl8721d(u32 img_offset, const u8 *pData, u32 len)
+{
+	void *ctx = NULL;
+
+	if ( img_offset == 0 ) {
+		prvPAL_Streams_HashReset_rtl8721d();
+		if ( (len >= AWS_OTA_IMAGE_SIGNATURE_LEN) &&
+			 (CRYPTO_SignatureVerificationStart(&ctx, cryptoASYMMETRIC_ALGORITHM_ECDSA, cryptoHASH_ALGORITHM_SHA256) == pdTRUE) ) {
+			CRYPTO_SignatureVerificationUpdate(ctx, aws_ota_signature, AWS_OTA_IMAGE_SIGNATURE_LEN);
+			CRYPTO_SignatureVerificationUpdate(ctx, pData + AWS_OTA_IMAGE_SIGNATURE_LEN, len - AWS_OTA_IMAGE_SIGNATURE_LEN);
+			ImageHash_Start(ctx, CRYPTO_SignatureVerificationUpdate, prvPAL_Streams_HashRead_rtl8721d, len);
+		}
+	} else {
+		/* A read back that fails is done again by the close. */
+		(void) ImageHash_Write(img_offset, pData, len);
+	}
+}
+
+static BaseType_t prvPAL_Streams_EraseSector_rtl8721d(uint32_t address, uint32_t len)
+{
+	erase_ota_target_flash(address, len);
+	return pdTRUE;
+}
+
+static BaseType_t prvPAL_Streams_Program_rtl8721d(uint32_t address, const uint8_t *data, uint32_t len)
+{
+	uint32_t skip;
+
+	if ( address < aws_ota_program_floor ) {
+		skip = ( (aws_ota_program_floor - address) < len ) ? (aws_ota_program_floor - address) : len;
+		address += skip;
+		data += skip;
+		len -= skip;
+		if ( len == 0 ) {
+			return pdTRUE;
+		}
+	}
+	return ( ota_writestream_user(address, len, (u8 *)data) < 0 ) ? pdFALSE : pdTRUE;
+}
+
+static BaseType_t prvPAL_Streams_JournalRead_rtl8721d(uint32_t address, uint8_t *buf, uint32_t len)
+{
+	flash_t flash;
+
+	flash_stream_read(&flash, address, len, buf);
+	return pdTRUE;
+}
+
+static BaseType_t prvPAL_Streams_JournalProgram_rtl8721d(uint32_t address, const uint8_t *data, uint32_t len)
+{
+	flash_t flash;
+
+	return ( flash_stream_write(&flash, address, len, (u8 *)data) < 0 ) ? pdFALSE : pdTRUE;
+}
+
+/* flash_erase_sector() reports nothing, so the sector is read back to check
+ * that it was erased. */
+static BaseType_t prvPAL_Streams_JournalErase_rtl8721d(uint32_t address)
+{
+	flash_t flash;
+	uint8_t buf[64];
+	uint32_t i, j;
+	BaseType_t ret = pdTRUE;
+
+	flash_erase_sector(&flash, address);
+	for ( i = 0; (i < (1024*4)) && (ret == pdTRUE); i += sizeof(buf) ) {
+		flash_stream_read(&flash, address + i, sizeof(buf), buf);
+		for ( j = 0; j < sizeof(buf); j++ ) {
+			if ( buf[j] != 0xFF ) {
+				ret = pdFALSE;
+				break;
+			}
+		}
+	}
+	return ret;
+}
+
+static const DownloadJournalFlash_t aws_ota_journal_flash = {
+	AWS_OTA_JOURNAL_FLASH_OFFSET, (1024*4), AWS_OTA_JOURNAL_SECTORS,
+	prvPAL_Streams_JournalRead_rtl8721d, prvPAL_Streams_JournalProgram_rtl8721d, prvPAL_Streams_JournalErase_rtl8721d
+};
+
+/* Flash range of the image bytes of a stream block, if it has any. */
+static uint32_t prvPAL_Streams_BlockRange_rtl8721d(uint32_t block, uint32_t *address)
+{
+	uint32_t img_offset = aws_ota_target_hdr.FileImgHdr[HdrIdx].Offset;
+	uint32_t img_len = aws_ota_target_hdr.FileImgHdr[HdrIdx].ImgLen;
+	uint32_t start = block * mqttFileDownloader_CONFIG_BLOCK_SIZE;
+	uint32_t end = start + mqttFileDownloader_CONFIG_BLOCK_SIZE;
+
+	start = ( start > img_offset ) ? (start - img_offset) : 0;
+	end = ( end > img_offset ) ? (end - img_offset) : 0;
+	end = ( end < img_len ) ? end : img_len;
+	*address = aws_ota_imgaddr - SPI_FLASH_BASE + start;
+	return ( end > start ) ? (end - start) : 0;
+}
+
+/* Start journaling the download, resuming it if the journal holds this file
+ * unfinished. The download goes on from the first block not in the journal.
+ * Returns how much of the image is left out of the erase: the sector the
+ * download stopped in is kept, since it holds blocks of the journal. The
+ * rest of it is either erased or holds the same bytes of this image, written
+ * after the last record, and programming them again leaves them as they are. */
+static uint32_t prvPAL_Streams_JournalStart_rtl8721d(AfrOtaJobDocumentFields_t *C)
+{
+	aws_ota_journal_key_t key;
+	aws_ota_journal_state_t state;
+	uint32_t blocks, done = 0, resume_block = 0, img_offset;
+
+	aws_ota_journaled = false;
+	aws_ota_journal_next = 0;
+	aws_ota_journal_marked = 0;
+	aws_ota_resume_offset = 0;
+	aws_ota_program_floor = 0;
+
+	if ( (AWS_OTA_JOURNAL_FLASH_OFFSET == 0) || aws_ota_compressed || (C->fileSize == 0) ) {
+		return 0;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.file_size = C->fileSize;
+	key.image_addr = aws_ota_imgaddr;
+	if ( C->signature != NULL ) {
+		memcpy(key.signature, C->signature, (C->signatureLen < sizeof(key.signature)) ? C->signatureLen : sizeof(key.signature));
+	}
+	blocks = ((C->fileSize - 1) / mqttFileDownloader_CONFIG_BLOCK_SIZE) + 1;
+	aws_ota_journaled = true;
+
+	if ( DownloadJournal_Start(&aws_ota_journal_flash, (const uint8_t *)&key, sizeof(key), blocks) == 0 ) {
+		return 0;
+	}
+
+	if ( DownloadJournal_GetState(&state, sizeof(state)) == pdTRUE ) {
+		/* The last block is requested again if every block is in, so that
+		 * the download is closed as usual. */
+		resume_block = DownloadJournal_GetWrittenPrefix();
+		if ( resume_block >= blocks ) {
+			resume_block = blocks - 1;
+		}
+		img_offset = state.hdr.FileImgHdr[HdrIdx].Offset;
+		done = resume_block * mqttFileDownloader_CONFIG_BLOCK_SIZE;
+		done = (done > img_offset) ? (done - img_offset) : 0;
+		if ( done > state.hdr.FileImgHdr[HdrIdx].ImgLen ) {
+			done = state.hdr.FileImgHdr[HdrIdx].ImgLen;
+		}
+	}
+
+	if ( resume_block == 0 ) {
+		/* Too little to resume from; the download starts over. */
+		DownloadJournal_Clear();
+		(void) DownloadJournal_Start(&aws_ota_journal_flash, (const uint8_t *)&key, sizeof(key), blocks);
+		return 0;
+	}
+
+	memcpy(&aws_ota_target_hdr, &state.hdr, sizeof(aws_ota_target_hdr));
+	memcpy(aws_ota_signature, state.signature, sizeof(aws_ota_signature));
+	aws_ota_target_hdr_get = true;
+	aws_ota_imgsz = done;
+	aws_ota_resume_offset = resume_block * mqttFileDownloader_CONFIG_BLOCK_SIZE;
+	aws_ota_journal_next = resume_block;
+	aws_ota_journal_marked = resume_block;
+	aws_ota_program_floor = aws_ota_imgaddr - SPI_FLASH_BASE + done;
+	OTA_PRINT("[OTA] Resuming the download at block %u of %u, %u bytes of the image already in flash.\n", resume_block, blocks, done);
+
+	return (done + (1024*4) - 1) & ~((1024*4) - 1);
+}
+
+/* Journal the blocks written in order as soon as the write buffer has
+ * programmed them, so that a reset only loses the blocks it still holds.
+ * The header parsed from the first block is journaled with it. */
+static void prvPAL_Streams_JournalWrite_rtl8721d(uint32_t ulOffset)
+{
+	aws_ota_journal_state_t state;
+	uint32_t address, len, count = 0;
+
+	if ( !aws_ota_journaled || (ulOffset != aws_ota_journal_next * mqttFileDownloader_CONFIG_BLOCK_SIZE) ) {
+		return;
+	}
+
+	if ( ulOffset == 0 ) {
+		memcpy(&state.hdr, &aws_ota_target_hdr, sizeof(state.hdr));
+		memcpy(state.signature, aws_ota_signature, sizeof(state.signature));
+		(void) DownloadJournal_SetState(&state, sizeof(state));
+	}
+	aws_ota_journal_next++;
+
+	while ( (aws_ota_journal_marked + count) < aws_ota_journal_next ) {
+		len = prvPAL_Streams_BlockRange_rtl8721d(aws_ota_journal_marked + count, &address);
+		if ( (len > 0) && (FlashWriteBuffer_IsBuffered(address, len) == pdTRUE) ) {
+			break;
+		}
+		count++;
+	}
+	if ( (count > 0) && (DownloadJournal_MarkWritten(aws_ota_journal_marked, count) == pdTRUE) ) {
+		aws_ota_journal_marked += count;
+	}
+}
+
+static int32_t prvPAL_Streams_WriteImageBlock_rtl8721d(AfrOtaJobDocumentFields_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize);
+
+static BaseType_t prvPAL_Streams_DecompressWrite_rtl8721d(void *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+	return ( prvPAL_Streams_WriteImageBlock_rtl8721d((AfrOtaJobDocumentFields_t *)ctx, offset, data, len) < 0 ) ? pdFALSE : pdTRUE;
+}
+
 OtaPalStatus_New_t prvPAL_Streams_Abort_rtl8721d(AfrOtaJobDocumentFields_t *C)
 {
+	FlashEraseAhead_Stop();
+	FlashWriteBuffer_Discard();
+	DecompressStream_Free(&aws_ota_decompress_ctx);
+	aws_ota_compressed = false;
+	prvPAL_Streams_HashReset_rtl8721d();
+	DownloadJournal_Clear();
+	aws_ota_journaled = false;
+	aws_ota_program_floor = 0;
+
 	if ( C != NULL && C->filepath != NULL ) {
 		OTA_PRINT("[%s] Abort OTA update\n", __FUNCTION__);
 		C->filepath = NULL;
@@ -100,6 +406,7 @@ bool prvPAL_Streams_CreateFileForRx_rtl8721d(AfrOtaJobDocumentFields_t *C)
 	OtaPalStatus_New_t mainErr = OtaPalSuccess_New;
 
 	int sector_cnt = 0;
+	uint32_t resumed = 0;
 	OTA_PRINT("\n\r[%s] OTA filesize: %d\n", __FUNCTION__, C->fileSize);
 
 	/* determine the segment to store the OTA download in */
@@ -115,6 +422,12 @@ bool prvPAL_Streams_CreateFileForRx_rtl8721d(AfrOtaJobDocumentFields_t *C)
 		OTA_PRINT("\n\r[%s] OTA1 address space will be upgraded\n", __FUNCTION__);
 	}
 
+	/* The size of a compressed image is not known until it is done. */
+	aws_ota_compressed = ( C->fileType == AWS_OTA_COMPRESSED_FILE_TYPE );
+	if ( aws_ota_compressed ) {
+		sector_cnt = (OTA2_FLASH_START_ADDRESS - OTA1_FLASH_START_ADDRESS) / (1024 * 4);
+	}
+
 	/* check the segment is valid and prepare the segment for write  */
 	if ( ota_ctx.lFileHandle > SPI_FLASH_BASE ) {
 		OTA_PRINT("[OTA] valid ota addr (0x%x) \r\n", ota_ctx.lFileHandle);
@@ -123,10 +436,40 @@ bool prvPAL_Streams_CreateFileForRx_rtl8721d(AfrOtaJobDocumentFields_t *C)
 		aws_ota_target_hdr_get = false;
 		memset((void *)&aws_ota_target_hdr, 0, sizeof(update_ota_target_hdr));
 		memset((void *)aws_ota_signature, 0, sizeof(aws_ota_signature));
+		prvPAL_Streams_HashReset_rtl8721d();
+		aws_ota_start_tick = xTaskGetTickCount();
+		aws_ota_first_block_get = false;
+
+		/* Stream blocks rarely start on a flash page; they are programmed
+		 * through the write buffer so that pages are programmed whole. */
+		FlashWriteBuffer_Start(prvPAL_Streams_Program_rtl8721d);
+
+		/* A download cut short by a reset goes on from the first block
+		 * missing from the journal; the blocks before it are neither erased
+		 * nor programmed again. */
+		resumed = prvPAL_Streams_JournalStart_rtl8721d(C);
+
+		/* The sectors are erased just ahead of the blocks being written, so
+		 * that the first block can be requested right away. */
+		if ( FlashEraseAhead_Start(aws_ota_imgaddr - SPI_FLASH_BASE + resumed, sector_cnt * (1024*4) - resumed, (1024*4),
+								   AWS_OTA_ERASE_AHEAD_SIZE, prvPAL_Streams_EraseSector_rtl8721d) != pdTRUE ) {
+			for(int i = resumed / (1024*4); i < sector_cnt; i++) {
+				OTA_PRINT("[OTA] Erase sector_cnt @ 0x%x\n", ota_ctx.lFileHandle - SPI_FLASH_BASE + i * (1024*4));
+				erase_ota_target_flash(aws_ota_imgaddr - SPI_FLASH_BASE + i * (1024*4), (1024*4));
+			}
+		}
 
-		for(int i = 0; i < sector_cnt; i++) {
-			OTA_PRINT("[OTA] Erase sector_cnt @ 0x%x\n", ota_ctx.lFileHandle - SPI_FLASH_BASE + i * (1024*4));
-			erase_ota_target_flash(aws_ota_imgaddr - SPI_FLASH_BASE + i * (1024*4), (1024*4));
+		DecompressStream_Free(&aws_ota_decompress_ctx);
+		if ( aws_ota_compressed ) {
+			if ( DecompressStream_Init(&aws_ota_decompress_ctx, mqttFileDownloader_CONFIG_BLOCK_SIZE, mqttFileDownloader_CONFIG_BLOCK_SIZE,
+									   prvPAL_Streams_DecompressWrite_rtl8721d, C) != DecompressStreamSuccess ) {
+				OTA_PRINT("[OTA] No memory to decompress the file\n");
+				FlashEraseAhead_Stop();
+				aws_ota_compressed = false;
+				ota_ctx.lFileHandle = 0;
+			} else {
+				OTA_PRINT("[OTA] Compressed update, %d bytes\n", C->fileSize);
+			}
 		}
 	} else {
 		OTA_PRINT("[OTA] invalid ota addr (%d) \r\n", ota_ctx.lFileHandle);
@@ -146,39 +489,22 @@ static OtaPalStatus_New_t prvPAL_Streams_SignatureVerificationUpdate_rtl8721d(Af
 
 	OtaPalStatus_New_t mainErr = OtaPalSuccess_New;
 
-	u32 i;
-	flash_t flash;
-	u8 * pTempbuf;
-	int rlen;
 	u32 len = aws_ota_imgsz;
-	u32 addr = aws_ota_target_hdr.FileImgHdr[HdrIdx].FlashAddr;
 
 	if( len <= 0 ) {
 		mainErr = OtaPalSignatureCheckFailed_New;
 		return mainErr;
 	}
 
-	pTempbuf = ota_update_malloc(BUF_SIZE);
-	if( pTempbuf == NULL ) {
-		mainErr = OtaPalSignatureCheckFailed_New;
-		goto error;
-	}
-
-	/*add image signature(81958711)*/
-	CRYPTO_SignatureVerificationUpdate(pvContext, aws_ota_signature, AWS_OTA_IMAGE_SIGNATURE_LEN);
-
-	len = len-8;
-	/* read flash data back to check signature of the image */
-	for( i = 0; i < len; i += BUF_SIZE ) {
-		rlen = (len - i) > BUF_SIZE ? BUF_SIZE : (len - i);
-		flash_stream_read(&flash, addr - SPI_FLASH_BASE + i + AWS_OTA_IMAGE_SIGNATURE_LEN, rlen, pTempbuf);
-		Cache_Flush();
-		CRYPTO_SignatureVerificationUpdate(pvContext, pTempbuf, rlen);
+	if( ImageHash_GetContext() == NULL ) {
+		/*add image signature(81958711)*/
+		CRYPTO_SignatureVerificationUpdate(pvContext, aws_ota_signature, AWS_OTA_IMAGE_SIGNATURE_LEN);
+		ImageHash_Start(pvContext, CRYPTO_SignatureVerificationUpdate, prvPAL_Streams_HashRead_rtl8721d, AWS_OTA_IMAGE_SIGNATURE_LEN);
 	}
 
-error:
-	if( pTempbuf != NULL ) {
-		ota_update_free(pTempbuf);
+	/* read back the flash data that was not hashed while being written */
+	if( ImageHash_Finish(len) != pdTRUE ) {
+		mainErr = OtaPalSignatureCheckFailed_New;
 	}
 
 	return mainErr;
@@ -190,14 +516,67 @@ OtaPalStatus_New_t prvPAL_Streams_SetPlatformImageState_rtl8721d (OtaImageState_
 OtaPalStatus_New_t prvPAL_Streams_CloseFile_rtl8721d(AfrOtaJobDocumentFields_t *C)
 {
 	OtaPalStatus_New_t mainErr = OtaPalSuccess_New;
+	FlashEraseAheadStats_t erase_stats;
+	FlashWriteBufferStats_t write_stats;
+	ImageHashStats_t hash_stats;
+	BaseType_t flushed;
+	DecompressStreamStatus_t decompress_status = DecompressStreamSuccess;
+	DecompressStreamStats_t decompress_stats;
+	DownloadJournalStats_t journal_stats;
+
+	/* The tail of a compressed file is still in the decompressor. */
+	if ( aws_ota_compressed ) {
+		decompress_status = DecompressStream_Finish(&aws_ota_decompress_ctx);
+		DecompressStream_GetStats(&aws_ota_decompress_ctx, &decompress_stats);
+		DecompressStream_Free(&aws_ota_decompress_ctx);
+		aws_ota_compressed = false;
+		OTA_PRINT("[OTA] %u bytes received, %u decompressed, %u written to flash, decoding took %u ms, %u blocks held, status %d.\n",
+				  decompress_stats.ulInputBytes, decompress_stats.ulOutputBytes, aws_ota_imgsz,
+				  decompress_stats.ulDecodeTicks * portTICK_PERIOD_MS, decompress_stats.ulHeldBlocks, decompress_status);
+	}
+
+	/* The signature check reads the image back from flash. */
+	flushed = FlashWriteBuffer_Flush();
+	FlashWriteBuffer_GetStats(&write_stats);
+	FlashWriteBuffer_Discard();
+	FlashEraseAhead_GetStats(&erase_stats);
+	FlashEraseAhead_Stop();
+
+	/* Whatever the outcome, the next download of the file starts over. */
+	if ( aws_ota_journaled ) {
+		DownloadJournal_GetStats(&journal_stats);
+		OTA_PRINT("[OTA] Resumed with %u blocks in flash, %u journal records, %u journal sector moves, %u journal failures.\n",
+				  journal_stats.ulResumedBlocks, journal_stats.ulRecords, journal_stats.ulCompactions, journal_stats.ulFailures);
+	}
+	DownloadJournal_Clear();
+	aws_ota_journaled = false;
+	aws_ota_program_floor = 0;
 
 	OTA_PRINT("[OTA] Authenticating and closing file.\n");
+	aws_ota_close_tick = xTaskGetTickCount();
+	OTA_PRINT("[OTA] Download took %u ms, first block after %u ms, %u sectors erased ahead, %u on demand.\n",
+			  (aws_ota_close_tick - aws_ota_start_tick) * portTICK_PERIOD_MS, aws_ota_first_block_ms,
+			  erase_stats.ulErasedAhead, erase_stats.ulErasedOnDemand);
+	OTA_PRINT("[OTA] %u block writes took %u flash programs, %u full pages and %u partial.\n",
+			  write_stats.ulWrites, write_stats.ulProgramOps, write_stats.ulFullPages, write_stats.ulPartialPages);
 
 	if ( C == NULL ) {
 		mainErr = OtaPalNullFileContext_New;
 		goto exit;
 	}
 
+	if ( flushed != pdTRUE ) {
+		OTA_PRINT("[%s] Write sector failed\n", __FUNCTION__);
+		mainErr = OtaPalFileClose_New;
+		goto exit;
+	}
+
+	if ( decompress_status != DecompressStreamSuccess ) {
+		OTA_PRINT("[%s] File could not be decompressed: %d\n", __FUNCTION__, decompress_status);
+		mainErr = OtaPalFileClose_New;
+		goto exit;
+	}
+
 	/* close the fw file */
 	if ( C->signature != NULL ) {
 		/* TODO: Verify the file signature, close the file and return the signature verification result. */
@@ -207,6 +586,11 @@ OtaPalStatus_New_t prvPAL_Streams_CloseFile_rtl8721d(AfrOtaJobDocumentFields_t *
 		mainErr = OtaPalSignatureCheckFailed_New;
 	}
 
+	aws_ota_verify_ms = (xTaskGetTickCount() - aws_ota_close_tick) * portTICK_PERIOD_MS;
+	ImageHash_GetStats(&hash_stats);
+	OTA_PRINT("[OTA] Signature check took %u ms, %u bytes hashed as written, %u read back, %u blocks ahead of a missing one.\n",
+			  aws_ota_verify_ms, hash_stats.ulHashedBytes, hash_stats.ulReadBackBytes, hash_stats.ulAheadWrites);
+
 	if ( mainErr == OtaPalSuccess_New ) {
 		OTA_PRINT("[%s] %s signature verification passed.\n", __FUNCTION__, OTA_SIG_KEY_STR);
 	} else {
@@ -220,7 +604,7 @@ exit:
 	return mainErr;
 }
 
-int32_t prvPAL_Streams_WriteBlock_rtl8721d(AfrOtaJobDocumentFields_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize)
+static int32_t prvPAL_Streams_WriteImageBlock_rtl8721d(AfrOtaJobDocumentFields_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize)
 {
 	(void) C;	// unused
 
@@ -288,11 +672,14 @@ int32_t prvPAL_Streams_WriteBlock_rtl8721d(AfrOtaJobDocumentFields_t *C, uint32_
 		}
 
 		OTA_PRINT("[OTA] FIRST Write %d bytes @ 0x%x\n", byte_to_write, address);
-		if( ota_writestream_user(address, byte_to_write, pData) < 0 ) {
+		if( FlashEraseAhead_Prepare(address, byte_to_write) != pdTRUE || FlashWriteBuffer_Write(address, pData, byte_to_write) != pdTRUE ) {
 			OTA_PRINT("[%s] Write sector failed\n", __FUNCTION__);
 			return -1;
 		}
 		OTA_PRINT("[%s] ok\n", __FUNCTION__);
+		if( ulOffset == 0 ) {
+			prvPAL_Streams_HashWrite_rtl8721d(0, pData, byte_to_write);
+		}
 		aws_ota_imgsz += byte_to_write;
 		return ulBlockSize;
 	}
@@ -311,20 +698,59 @@ int32_t prvPAL_Streams_WriteBlock_rtl8721d(AfrOtaJobDocumentFields_t *C, uint32_
 
 	/* write block data for Nth block (N > 1) */
 	OTA_PRINT("[OTA] Write %d bytes @ 0x%x \n", WriteLen, address + offset);
-	if( ota_writestream_user(address + offset, WriteLen, pData) < 0 ) {
+	if( FlashEraseAhead_Prepare(address + offset, WriteLen) != pdTRUE || FlashWriteBuffer_Write(address + offset, pData, WriteLen) != pdTRUE ) {
 		OTA_PRINT("[%s] Write sector failed\n", __FUNCTION__);
 		return -1;
 	}
 
+	prvPAL_Streams_HashWrite_rtl8721d(offset, pData, WriteLen);
 	aws_ota_imgsz += WriteLen;
 
 	return ulBlockSize;
 }
 
+int32_t prvPAL_Streams_WriteBlock_rtl8721d(AfrOtaJobDocumentFields_t *C, uint32_t ulOffset, uint8_t* pData, uint32_t ulBlockSize)
+{
+	DecompressStreamStatus_t status;
+	int32_t ret;
+
+	if ( !aws_ota_first_block_get ) {
+		aws_ota_first_block_get = true;
+		aws_ota_first_block_ms = (xTaskGetTickCount() - aws_ota_start_tick) * portTICK_PERIOD_MS;
+		OTA_PRINT("[OTA] First block received %u ms after the file was created.\n", aws_ota_first_block_ms);
+	}
+
+	if ( !aws_ota_compressed ) {
+		ret = prvPAL_Streams_WriteImageBlock_rtl8721d(C, ulOffset, pData, ulBlockSize);
+		if ( ret >= 0 ) {
+			prvPAL_Streams_JournalWrite_rtl8721d(ulOffset);
+		} else {
+			aws_ota_journaled = false;
+		}
+		return ret;
+	}
+
+	/* The decompressed file comes out in blocks of the same size, in order. */
+	status = DecompressStream_Write(&aws_ota_decompress_ctx, ulOffset, pData, ulBlockSize);
+	if ( status != DecompressStreamSuccess ) {
+		OTA_PRINT("[%s] Decompression failed @ 0x%x: %d\n", __FUNCTION__, ulOffset, status);
+		return -1;
+	}
+
+	return ulBlockSize;
+}
+
+uint32_t prvPAL_Streams_GetResumeOffset_rtl8721d(void)
+{
+	return aws_ota_resume_offset;
+}
+
 OtaPalStatus_New_t prvPAL_Streams_ActivateNewImage_rtl8721d(void)
 {
 	flash_t flash;
 	OTA_PRINT("[OTA] Download new firmware %d bytes completed @ 0x%x\n", aws_ota_imgsz, aws_ota_imgaddr);
+	OTA_PRINT("[OTA] Activating %u ms after close (signature check %u ms).\n",
+			  (xTaskGetTickCount() - aws_ota_close_tick) * portTICK_PERIOD_MS, aws_ota_verify_ms);
 	OTA_PRINT("[OTA] FirmwareSize = %d, OtaTargetHdr.FileImgHdr.ImgLen = %d\n", aws_ota_imgsz, aws_ota_target_hdr.FileImgHdr[HdrIdx].ImgLen);
 
 	/*------------- verify checksum and update signature-----------------*/
@@ -436,7 +862,7 @@ OtaPalStatus_New_t prvPAL_Streams_CheckFileSignature_rtl8721d(AfrOtaJobDocumentF
 	OtaPalStatus_New_t mainErr = OtaPalSuccess_New;
 
 	int32_t lSignerCertSize;
-	void *pvSigVerifyContext;
+	void *pvSigVerifyContext = NULL;
 	uint8_t *pucSignerCert = NULL;
 
 #if (defined(__ICCARM__))
@@ -444,8 +870,11 @@ OtaPalStatus_New_t prvPAL_Streams_CheckFileSignature_rtl8721d(AfrOtaJobDocumentF
 	mbedtls_platform_set_calloc_free(calloc_freertos, vPortFree);
 #endif
 
-	/* Verify an ECDSA-SHA256 signature. */
-	if ( CRYPTO_SignatureVerificationStart( &pvSigVerifyContext, cryptoASYMMETRIC_ALGORITHM_ECDSA, cryptoHASH_ALGORITHM_SHA256) == pdFALSE ) {
+	/* Verify an ECDSA-SHA256 signature, continuing the hash of the blocks written. */
+	pvSigVerifyContext = ImageHash_GetContext();
+	if ( (pvSigVerifyContext == NULL) &&
+		 (CRYPTO_SignatureVerificationStart( &pvSigVerifyContext, cryptoASYMMETRIC_ALGORITHM_ECDSA, cryptoHASH_ALGORITHM_SHA256) == pdFALSE) ) {
+		pvSigVerifyContext = NULL;
 		mainErr = OtaPalSignatureCheckFailed_New;
 		goto exit;
 	}
@@ -462,13 +891,20 @@ OtaPalStatus_New_t prvPAL_Streams_CheckFileSignature_rtl8721d(AfrOtaJobDocumentF
 		goto exit;
 	}
 
+	/* The final call releases the context whatever its result. */
 	if ( CRYPTO_SignatureVerificationFinal(pvSigVerifyContext, (char *)pucSignerCert, lSignerCertSize, (uint8_t *)C->signature, C->signatureLen) == pdFALSE ) {
+		pvSigVerifyContext = NULL;
 		mainErr = OtaPalSignatureCheckFailed_New;
 		prvPAL_Streams_SetPlatformImageState_rtl8721d(OtaImageStateRejected_New);
 		goto exit;
 	}
+	pvSigVerifyContext = NULL;
 
 exit:
+	ImageHash_Stop();
+	if ( pvSigVerifyContext != NULL ) {
+		(void) CRYPTO_SignatureVerificationFinal(pvSigVerifyContext, NULL, 0, NULL, 0);
+	}
 	/* Free the signer certificate that we now own after prvPAL_Streams_ReadAndAssumeCertificate(). */
 	if ( pucSignerCert != NULL ) {
 		vPortFree(pucSignerCert);
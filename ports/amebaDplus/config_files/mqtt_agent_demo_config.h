@@ -102,9 +102,42 @@
  */
 
 /**
- * @brief The length of the queue used to hold commands for the agent.
+ * @brief Set to 1 to have the agent hold QoS0 PUBLISH back and write several
+ * of them out together.
  *
- * #define MQTT_AGENT_COMMAND_QUEUE_LENGTH    ( insert here. )
+ * #define MQTT_AGENT_COALESCE_PUBLISHES    ( insert here. )
+ */
+
+/**
+ * @brief Size in bytes of the buffer holding the QoS0 PUBLISH held back.
+ *
+ * #define MQTT_AGENT_COALESCE_BUFFER_SIZE    ( insert here. )
+ */
+
+/**
+ * @brief Longest time in microseconds a QoS0 PUBLISH is held back.
+ *
+ * #define MQTT_AGENT_COALESCE_DEADLINE_US    ( insert here. )
+ */
+
+/**
+ * @brief Set to 1 to store the publishes issued while the agent is offline
+ * and forward them after the reconnect.
+ *
+ * #define MQTT_AGENT_STORE_AND_FORWARD    ( insert here. )
+ */
+
+/**
+ * @brief Largest number of stored publishes forwarded per second.
+ *
+ * #define MQTT_AGENT_FORWARD_RATE_PER_SECOND    ( insert here. )
+ */
+
+/**
+ * @brief Pointer to the PublishStoreFlash_t describing the flash sectors the
+ * store spills to, or NULL to keep it in RAM only.
+ *
+ * #define MQTT_AGENT_STORE_FLASH    ( insert here. )
  */
 
 /**
@@ -84,11 +84,6 @@
  */
 #define MQTT_RECV_POLLING_TIMEOUT_MS            ( 1000U ) /* TODO Set a timeout in msecs for data received from MQTT. Recommend values > 1 s. */
 
-/**
- * @brief The length of the queue used to hold commands for the agent.
- */
-#define MQTT_AGENT_COMMAND_QUEUE_LENGTH         ( 25 ) /* TODO */
-
 /**
  * @brief Dimensions the buffer used to serialise and deserialise MQTT packets.
  * @note Specified in bytes. Must be large enough to hold the maximum
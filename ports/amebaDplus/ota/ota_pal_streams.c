@@ -42,6 +42,7 @@ OtaPalStatus_New_t otaPal_Streams_ActivateNewImage( AfrOtaJobDocumentFields_t *
 OtaPalStatus_New_t otaPal_Streams_SetPlatformImageState( AfrOtaJobDocumentFields_t * const pFileContext, OtaImageState_New_t eState );
 OtaPalImageState_New_t otaPal_Streams_GetPlatformImageState( AfrOtaJobDocumentFields_t * const pFileContext );
 OtaPalStatus_New_t otaPal_Streams_ResetDevice( AfrOtaJobDocumentFields_t * const pFileContext );
+uint32_t otaPal_Streams_GetResumeOffset( AfrOtaJobDocumentFields_t * const pFileContext );
 
 /* private prototypes declared by internal code */
 OtaPalStatus_New_t prvPAL_Streams_Abort_rtl8721d(AfrOtaJobDocumentFields_t *C);
@@ -53,6 +54,7 @@ OtaPalStatus_New_t prvPAL_Streams_ActivateNewImage_rtl8721d(void);
 OtaPalStatus_New_t prvPAL_Streams_SetPlatformImageState_rtl8721d (OtaImageState_New_t eState);
 OtaPalImageState_New_t prvPAL_Streams_GetPlatformImageState_rtl8721d( void );
 OtaPalStatus_New_t prvPAL_Streams_ResetDevice_rtl8721d(void);
+uint32_t prvPAL_Streams_GetResumeOffset_rtl8721d(void);
 uint8_t * prvPAL_Streams_ReadAndAssumeCertificate_rtl8721d(const uint8_t * const pucCertName, int32_t * const lSignerCertSize);
 
 /*-----------------------------------------------------------*/
@@ -114,6 +116,14 @@ OtaPalStatus_New_t otaPal_Streams_ResetDevice( AfrOtaJobDocumentFields_t * const
 
 /*-----------------------------------------------------------*/
 
+uint32_t otaPal_Streams_GetResumeOffset( AfrOtaJobDocumentFields_t * const pFileContext )
+{
+    (void) pFileContext;
+    return prvPAL_Streams_GetResumeOffset_rtl8721d();
+}
+
+/*-----------------------------------------------------------*/
+
 static OtaPalStatus_New_t otaPal_Streams_CheckFileSignature( AfrOtaJobDocumentFields_t * const pFileContext )
 {
     return prvPAL_Streams_CheckFileSignature_rtl8721d(pFileContext);
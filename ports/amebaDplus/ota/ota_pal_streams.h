@@ -123,4 +123,14 @@ OtaPalStatus_New_t otaPal_Streams_SetPlatformImageState( AfrOtaJobDocumentFields
 OtaPalImageState_New_t otaPal_Streams_GetPlatformImageState( AfrOtaJobDocumentFields_t * const pFileContext );
 OtaPalStatus_New_t otaPal_Streams_ResetDevice( AfrOtaJobDocumentFields_t * const pFileContext );
 
+/**
+ * @brief Offset in the file from which the download goes on.
+ *
+ * A download cut short by a reset is resumed when the same file is received
+ * again: after otaPal_Streams_CreateFileForRx(), the blocks before this
+ * offset are already in flash and need not be requested. 0 for a new
+ * download.
+ */
+uint32_t otaPal_Streams_GetResumeOffset( AfrOtaJobDocumentFields_t * const pFileContext );
+
 #endif /* ifndef OTA_PAL_H_ */
\ No newline at end of file
@@ -39,6 +39,9 @@
 #include "lwip/netdb.h"
 #include "iot_wifi.h"
 #include "iot_tls.h"
+#include "iot_connect_trace.h"
+#include "iot_dns_cache.h"
+#include "iot_sockets_sendv.h"
 #include "FreeRTOSConfig.h"
 #include "task.h"
 #include <stdbool.h>
@@ -82,6 +85,9 @@ typedef struct _ss_ctx_t
 
     char ** ppcAlpnProtocols;
     uint32_t ulAlpnProtocolsCount;
+
+    uint32_t ulInContentLength;
+    uint32_t ulOutContentLength;
 } ss_ctx_t;
 
 /*-----------------------------------------------------------*/
@@ -302,9 +308,9 @@ Socket_t SOCKETS_Socket( int32_t lDomain,
 
 /*-----------------------------------------------------------*/
 
-int32_t SOCKETS_Connect( Socket_t xSocket,
-                         SocketsSockaddr_t * pxAddress,
-                         Socklen_t xAddressLength )
+static int32_t prvConnect( Socket_t xSocket,
+                           SocketsSockaddr_t * pxAddress,
+                           Socklen_t xAddressLength )
 {
     ss_ctx_t * ctx;
 
@@ -345,9 +351,11 @@ int32_t SOCKETS_Connect( Socket_t xSocket,
         sa_addr.sin_addr.s_addr = pxAddress->ulAddress;
         sa_addr.sin_port        = pxAddress->usPort;
 
+        ConnectTrace_PhaseStart( eConnectTracePhaseTcp );
         ret = lwip_connect( ctx->ip_socket,
                             (struct sockaddr *) &sa_addr,
                             sizeof(sa_addr));
+        ConnectTrace_PhaseEnd( eConnectTracePhaseTcp );
 
         if( 0 == ret )
         {
@@ -370,6 +378,8 @@ int32_t SOCKETS_Connect( Socket_t xSocket,
             tls_params.pxNetworkSend             = prvNetworkSend;
             tls_params.ppcAlpnProtocols          = ( const char ** ) ctx->ppcAlpnProtocols;
             tls_params.ulAlpnProtocolsCount      = ctx->ulAlpnProtocolsCount;
+            tls_params.ulInContentLength         = ctx->ulInContentLength;
+            tls_params.ulOutContentLength        = ctx->ulOutContentLength;
 
             status = TLS_Init( &ctx->tls_ctx, &tls_params );
 
@@ -406,6 +416,23 @@ int32_t SOCKETS_Connect( Socket_t xSocket,
 
 /*-----------------------------------------------------------*/
 
+int32_t SOCKETS_Connect( Socket_t xSocket,
+                         SocketsSockaddr_t * pxAddress,
+                         Socklen_t xAddressLength )
+{
+    int32_t lStatus;
+    BaseType_t xTraceOwner;
+
+    /* Only traced here when the caller did not open an attempt itself. */
+    xTraceOwner = ConnectTrace_Begin();
+    lStatus = prvConnect( xSocket, pxAddress, xAddressLength );
+    ConnectTrace_End( xTraceOwner, lStatus );
+
+    return lStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 int32_t SOCKETS_Recv( Socket_t xSocket,
                       void * pvBuffer,
                       size_t xBufferLength,
@@ -502,6 +529,93 @@ int32_t SOCKETS_Send( Socket_t xSocket,
 
 /*-----------------------------------------------------------*/
 
+int32_t SOCKETS_SendV( Socket_t xSocket,
+                       const SocketsIoVector_t * pxVectors,
+                       size_t xVectorCount,
+                       uint32_t ulFlags )
+{
+    ss_ctx_t * ctx;
+
+    if( SOCKETS_INVALID_SOCKET == xSocket )
+    {
+        return SOCKETS_SOCKET_ERROR;
+    }
+
+    ctx            = ( ss_ctx_t * )xSocket;
+
+    if( NULL == ctx )
+    {
+        return SOCKETS_SOCKET_ERROR;
+    }
+
+    if( ( ctx->status & SS_STATUS_CONNECTED ) != SS_STATUS_CONNECTED )
+    {
+        return SOCKETS_ENOTCONN;
+    }
+
+    ctx->send_flag = ulFlags;
+
+    if( 0 > ctx->ip_socket )
+    {
+        return SOCKETS_SOCKET_ERROR;
+    }
+
+    /* Send through TLS pipe, if negotiated. */
+    return SocketsSendV_Send( ctx->ip_socket,
+                              ctx->enforce_tls ? ctx->tls_ctx : NULL,
+                              pxVectors,
+                              xVectorCount,
+                              ulFlags );
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t SOCKETS_Poll( Socket_t xSocket )
+{
+    ss_ctx_t * ctx;
+    uint8_t ucByte;
+    int ret;
+
+    if( SOCKETS_INVALID_SOCKET == xSocket )
+    {
+        return SOCKETS_SOCKET_ERROR;
+    }
+
+    ctx            = ( ss_ctx_t * )xSocket;
+
+    if( ( NULL == ctx ) || ( 0 > ctx->ip_socket ) )
+    {
+        return SOCKETS_SOCKET_ERROR;
+    }
+
+    if( ( ctx->status & SS_STATUS_CONNECTED ) != SS_STATUS_CONNECTED )
+    {
+        return SOCKETS_ENOTCONN;
+    }
+
+    /* Look at the TCP stream only; TLS records stay queued for TLS_Recv(). */
+    ret = lwip_recv( ctx->ip_socket, &ucByte, sizeof( ucByte ), MSG_PEEK | MSG_DONTWAIT );
+
+    if( 0 < ret )
+    {
+        return ( int32_t )ret;
+    }
+
+    if( 0 == ret )
+    {
+        return SOCKETS_ECLOSED;
+    }
+
+    if( ( errno == EWOULDBLOCK ) || ( errno == EAGAIN ) )
+    {
+        return SOCKETS_ERROR_NONE;
+    }
+
+    return SOCKETS_SOCKET_ERROR;
+}
+
+/*-----------------------------------------------------------*/
+
 int32_t SOCKETS_Shutdown( Socket_t xSocket,
                           uint32_t ulHow )
 {
@@ -699,6 +813,44 @@ int32_t SOCKETS_SetSockOpt( Socket_t xSocket,
             ctx->enforce_tls = true;
             break;
 
+        case SOCKETS_SO_TLS_IN_CONTENT_LENGTH:
+        case SOCKETS_SO_TLS_OUT_CONTENT_LENGTH:
+
+            if( ctx->status & SS_STATUS_CONNECTED )
+            {
+                return SOCKETS_EISCONN;
+            }
+
+            if( ( NULL == pvOptionValue ) || ( sizeof( uint32_t ) != xOptionLength ) )
+            {
+                return SOCKETS_EINVAL;
+            }
+
+            if( lOptionName == SOCKETS_SO_TLS_IN_CONTENT_LENGTH )
+            {
+                ctx->ulInContentLength = *( ( const uint32_t * ) pvOptionValue );
+            }
+            else
+            {
+                ctx->ulOutContentLength = *( ( const uint32_t * ) pvOptionValue );
+            }
+
+            break;
+
+        case SOCKETS_SO_TLS_IDLE:
+
+            if( ( ctx->status & SS_STATUS_SECURED ) != SS_STATUS_SECURED )
+            {
+                return SOCKETS_ENOTCONN;
+            }
+
+            if( 0 != TLS_Idle( ctx->tls_ctx ) )
+            {
+                return SOCKETS_EWOULDBLOCK;
+            }
+
+            break;
+
         case SOCKETS_SO_TRUSTED_SERVER_CERTIFICATE:
 
             if( ctx->status & SS_STATUS_CONNECTED )
@@ -825,14 +977,28 @@ int32_t SOCKETS_SetSockOpt( Socket_t xSocket,
 }
 /*-----------------------------------------------------------*/
 
-uint32_t SOCKETS_GetHostByName( const char * pcHostName )
+#if LWIP_DNS
+static uint32_t prvResolveHostName( const char * pcHostName )
 {
     uint32_t addr = 0;
-#if LWIP_DNS
     struct hostent *server_host = gethostbyname( pcHostName );
     if( server_host ) {
         memcpy(&addr, server_host->h_addr, sizeof(addr));
     }
+    return addr;
+}
+#endif
+/*-----------------------------------------------------------*/
+
+uint32_t SOCKETS_GetHostByName( const char * pcHostName )
+{
+    uint32_t addr = 0;
+#if LWIP_DNS
+#if ( socketsconfigENABLE_DNS_CACHE == 1 )
+    addr = DnsCache_Resolve( pcHostName, prvResolveHostName );
+#else
+    addr = prvResolveHostName( pcHostName );
+#endif
 #endif
     return addr;
 }
@@ -22,7 +22,6 @@
 #ifndef CORE_MQTT_AGENT_CONFIG_H_
 #define CORE_MQTT_AGENT_CONFIG_H_
 
-#define MQTT_AGENT_COMMAND_QUEUE_LENGTH     ( 25 )
 #define MQTT_COMMAND_CONTEXTS_POOL_SIZE     ( 10 )
 
 /**